@@ -48,6 +48,7 @@ FILE(GLOB LCB_CAPI_SRC src/capi/*.cc)
 SET(LCB_CORE_CXXSRC
     src/analytics/analytics.cc
     src/analytics/analytics_handle.cc
+    src/analytics/ingest_queue.cc
     src/auth.cc
     src/bootstrap.cc
     src/bucketconfig/bc_cccp.cc
@@ -69,8 +70,10 @@ SET(LCB_CORE_CXXSRC
     src/hostlist.cc
     src/http/http.cc
     src/http/http_io.cc
+    src/http/http2.cc
     src/instance.cc
     src/iometrics.cc
+    src/lcbht/hpack.cc
     src/lcbht/lcbht.cc
     src/mcserver/mcserver.cc
     src/mcserver/negotiate.cc
@@ -101,6 +104,8 @@ SET(LCB_CORE_CXXSRC
     src/retrychk.cc
     src/retryq.cc
     src/rnd.cc
+    src/scan/scan.cc
+    src/scan/scan_handle.cc
     src/search/search.cc
     src/search/search_handle.cc
     src/settings.cc
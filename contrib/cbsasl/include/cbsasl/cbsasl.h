@@ -92,8 +92,8 @@ extern "C" {
         void *get_password_ctx;
         char *nonce; // client nonce for SCRAM-SHA authentication
         char *client_first_message_bare; // for SCRAM-SHA authentication
-        unsigned char *saltedpassword; // for SCRAM-SHA authentication
-        unsigned int saltedpasslen; // length of the salted password field
+        unsigned char *server_key; // for SCRAM-SHA authentication
+        unsigned int server_key_len; // length of the server key field
         char *auth_message; // for SCRAM-SHA authentication
     };
 
@@ -257,8 +257,7 @@ cbsasl_error_t cbsasl_client_step(cbsasl_conn_t *conn, const char *serverin, uns
                 const char *salt = NULL; // salt extracted from server's first reply
                 unsigned int saltlen = 0;
                 unsigned int itcount = 0;
-                unsigned char saltedpassword[CBSASL_SHA512_DIGEST_SIZE]; // max digest size
-                unsigned int saltedpasslen = 0;
+                scram_keys_t keys;
                 unsigned int prooflen = 0; // proof size in base64
 
                 ret =
@@ -275,19 +274,19 @@ cbsasl_error_t cbsasl_client_step(cbsasl_conn_t *conn, const char *serverin, uns
                     // the combined nonce doesn't start with the client nonce we sent previously
                     return SASL_BADPARAM;
                 }
-                // ok, now we can compute the client proof
-                ret = generate_salted_password(conn->c.client.auth_mech, pass, salt, saltlen, itcount, saltedpassword,
-                                               &saltedpasslen);
+                // ok, now we can compute the client proof. The keys are shared with the other
+                // connections using the same credentials, so PBKDF2 runs only once per salt.
+                ret = derive_scram_keys(conn->c.client.auth_mech, pass, salt, saltlen, itcount, &keys);
                 if (ret != SASL_OK) {
                     return ret;
                 }
-                // save salted password for later use
-                conn->c.client.saltedpassword = calloc(saltedpasslen, 1);
-                if (conn->c.client.saltedpassword == NULL) {
+                // save server key to verify the server signature later
+                conn->c.client.server_key = calloc(keys.length, 1);
+                if (conn->c.client.server_key == NULL) {
                     return SASL_NOMEM;
                 }
-                memcpy(conn->c.client.saltedpassword, saltedpassword, saltedpasslen);
-                conn->c.client.saltedpasslen = saltedpasslen;
+                memcpy(conn->c.client.server_key, keys.server_key, keys.length);
+                conn->c.client.server_key_len = keys.length;
 
 // before building the client proof, we start building the client final message,
 // as it is used for the computation of the proof
@@ -317,8 +316,8 @@ cbsasl_error_t cbsasl_client_step(cbsasl_conn_t *conn, const char *serverin, uns
                 memcpy(conn->c.client.userdata + strlen(FINAL_HEADER), combinednonce, noncelen);
                 memcpy(conn->c.client.userdata + strlen(FINAL_HEADER) + noncelen, PROOF_ATTR, strlen(PROOF_ATTR));
 
-                ret = compute_client_proof(
-                    conn->c.client.auth_mech, saltedpassword, saltedpasslen, conn->c.client.client_first_message_bare,
+                ret = compute_client_proof_with_keys(
+                    conn->c.client.auth_mech, &keys, conn->c.client.client_first_message_bare,
                     strlen(conn->c.client.client_first_message_bare), serverin, serverinlen, conn->c.client.userdata,
                     strlen(FINAL_HEADER) + noncelen, &(conn->c.client.auth_message),
                     conn->c.client.userdata + strlen(FINAL_HEADER) + noncelen + strlen(PROOF_ATTR), prooflen + 1);
@@ -369,9 +368,9 @@ cbsasl_error_t cbsasl_client_check(cbsasl_conn_t *conn, const char *serverin, un
                     default:
                         break;
                 }
-                ret = compute_server_signature(conn->c.client.auth_mech, conn->c.client.saltedpassword,
-                                               conn->c.client.saltedpasslen, conn->c.client.auth_message, serversign,
-                                               sizeof(serversign));
+                ret = compute_server_signature_with_key(conn->c.client.auth_mech, conn->c.client.server_key,
+                                                        conn->c.client.server_key_len, conn->c.client.auth_message,
+                                                        serversign, sizeof(serversign));
                 if (ret != SASL_OK) {
                     return ret;
                 }
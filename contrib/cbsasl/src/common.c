@@ -26,7 +26,7 @@ void cbsasl_dispose(cbsasl_conn_t **conn)
             free((*conn)->c.client.userdata);
             free((*conn)->c.client.nonce);
             free((*conn)->c.client.client_first_message_bare);
-            free((*conn)->c.client.saltedpassword);
+            free((*conn)->c.client.server_key);
             free((*conn)->c.client.auth_message);
         } else {
             free((*conn)->c.server.username);
@@ -18,6 +18,10 @@
 #include "config.h"
 #include <ctime>
 #include <cctype>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 #include "strcodecs/strcodecs.h"
 
 #ifndef LCB_NO_SSL
@@ -25,6 +29,7 @@
 #include <openssl/evp.h>
 #include <openssl/hmac.h>
 #include <openssl/sha.h>
+#include <openssl/crypto.h>
 
 #ifdef _WIN32
 #include <process.h> // for _getpid
@@ -331,62 +336,241 @@ static cbsasl_error_t HMAC_digest(cbsasl_auth_mechanism_t auth_mech, const unsig
 }
 #endif
 
+#ifndef LCB_NO_SSL
 /**
- * Computes the client proof. It is computed as:
- *
- * ClientKey       := HMAC(SaltedPassword, "Client Key")
- * StoredKey       := H(ClientKey)
- * AuthMessage     := client-first-message-bare + "," +
- *                    server-first-message + "," +
- *                    client-final-message-without-proof
- * ClientSignature := HMAC(StoredKey, AuthMessage)
- * ClientProof     := ClientKey XOR ClientSignature
+ * Hashes the data with the digest algorithm of the mechanism.
  */
-cbsasl_error_t compute_client_proof(cbsasl_auth_mechanism_t auth_mech, const unsigned char *saltedpassword,
-                                    unsigned int saltedpasslen, const char *clientfirstbare, unsigned int cfblen,
-                                    const char *serverfirstmess, unsigned int sfmlen,
-                                    const char *clientfinalwithoutproof, unsigned int cfwplen, char **authmessage,
-                                    char *outclientproof, unsigned int outprooflen)
+static cbsasl_error_t hash_digest(cbsasl_auth_mechanism_t auth_mech, const unsigned char *data, unsigned int datalen,
+                                  unsigned char *digest, unsigned int *digestlen)
 {
-#ifndef LCB_NO_SSL
-    const char *clientkeystr = "Client Key";
-    unsigned char clientkeyhmac[EVP_MAX_MD_SIZE];
-    unsigned int hmaclen = 0;
-    // we first compute the client key
-    // ClientKey       := HMAC(SaltedPassword, "Client Key")
-    cbsasl_error_t ret = HMAC_digest(auth_mech, saltedpassword, saltedpasslen, (const unsigned char *)clientkeystr,
-                                     strlen(clientkeystr), clientkeyhmac, &hmaclen);
-    if (ret != SASL_OK) {
-        return ret;
-    }
-
-    // then we hashes the client key to compute the storey key
-    // StoredKey       := H(ClientKey)
-    unsigned char storedkey[EVP_MAX_MD_SIZE];
-    unsigned int storedkeylen = 0;
     switch (auth_mech) {
         case SASL_AUTH_MECH_SCRAM_SHA1:
-            if (SHA1(clientkeyhmac, hmaclen, storedkey) == nullptr) {
+            if (SHA1(data, datalen, digest) == nullptr) {
                 return SASL_FAIL;
             }
-            storedkeylen = SHA_DIGEST_LENGTH;
+            *digestlen = SHA_DIGEST_LENGTH;
             break;
         case SASL_AUTH_MECH_SCRAM_SHA256:
-            if (SHA256(clientkeyhmac, hmaclen, storedkey) == nullptr) {
+            if (SHA256(data, datalen, digest) == nullptr) {
                 return SASL_FAIL;
             }
-            storedkeylen = SHA256_DIGEST_LENGTH;
+            *digestlen = SHA256_DIGEST_LENGTH;
             break;
         case SASL_AUTH_MECH_SCRAM_SHA512:
-            if (SHA512(clientkeyhmac, hmaclen, storedkey) == nullptr) {
+            if (SHA512(data, datalen, digest) == nullptr) {
                 return SASL_FAIL;
             }
-            storedkeylen = SHA512_DIGEST_LENGTH;
+            *digestlen = SHA512_DIGEST_LENGTH;
             break;
         default:
             return SASL_BADPARAM;
     }
+    return SASL_OK;
+}
+#endif
+
+/**
+ * Computes the keys from the salted password:
+ *
+ * ClientKey       := HMAC(SaltedPassword, "Client Key")
+ * StoredKey       := H(ClientKey)
+ * ServerKey       := HMAC(SaltedPassword, "Server Key")
+ */
+cbsasl_error_t compute_scram_keys(cbsasl_auth_mechanism_t auth_mech, const unsigned char *saltedpassword,
+                                  unsigned int saltedpasslen, scram_keys_t *keys)
+{
+#ifndef LCB_NO_SSL
+    const char *clientkeystr = "Client Key";
+    const char *serverkeystr = "Server Key";
+    unsigned int clientkeylen = 0, storedkeylen = 0, serverkeylen = 0;
+
+    cbsasl_error_t ret = HMAC_digest(auth_mech, saltedpassword, saltedpasslen, (const unsigned char *)clientkeystr,
+                                     strlen(clientkeystr), keys->client_key, &clientkeylen);
+    if (ret != SASL_OK) {
+        return ret;
+    }
+    ret = hash_digest(auth_mech, keys->client_key, clientkeylen, keys->stored_key, &storedkeylen);
+    if (ret != SASL_OK) {
+        return ret;
+    }
+    ret = HMAC_digest(auth_mech, saltedpassword, saltedpasslen, (const unsigned char *)serverkeystr,
+                      strlen(serverkeystr), keys->server_key, &serverkeylen);
+    if (ret != SASL_OK) {
+        return ret;
+    }
+    keys->length = clientkeylen;
+    return SASL_OK;
+#else
+    (void)auth_mech;
+    (void)saltedpassword;
+    (void)saltedpasslen;
+    (void)keys;
+    return SASL_BADPARAM;
+#endif
+}
+
+#ifndef LCB_NO_SSL
+namespace
+{
+/**
+ * Bounded LRU map from (mechanism, iterations, salt, H(password)) to the
+ * derived keys. An application normally uses a handful of credentials, so a
+ * small capacity is enough to absorb the reconnect storms.
+ */
+class scram_keys_cache
+{
+  public:
+    static scram_keys_cache &instance()
+    {
+        static scram_keys_cache cache;
+        return cache;
+    }
+
+    bool get(const std::string &key, scram_keys_t *keys)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(key);
+        if (it == index_.end()) {
+            ++misses_;
+            return false;
+        }
+        entries_.splice(entries_.begin(), entries_, it->second);
+        *keys = it->second->second;
+        ++hits_;
+        return true;
+    }
+
+    void put(const std::string &key, const scram_keys_t &keys)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            /* another connection has derived the same keys concurrently */
+            entries_.splice(entries_.begin(), entries_, it->second);
+            return;
+        }
+        entries_.emplace_front(key, keys);
+        index_.emplace(key, entries_.begin());
+        while (entries_.size() > capacity) {
+            auto &victim = entries_.back();
+            index_.erase(victim.first);
+            OPENSSL_cleanse(&victim.second, sizeof(victim.second));
+            entries_.pop_back();
+        }
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto &entry : entries_) {
+            OPENSSL_cleanse(&entry.second, sizeof(entry.second));
+        }
+        entries_.clear();
+        index_.clear();
+        hits_ = 0;
+        misses_ = 0;
+    }
+
+    void stats(unsigned long *hits, unsigned long *misses)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        *hits = hits_;
+        *misses = misses_;
+    }
+
+  private:
+    static const std::size_t capacity = 64;
+
+    std::mutex mutex_{};
+    std::list<std::pair<std::string, scram_keys_t>> entries_{};
+    std::unordered_map<std::string, std::list<std::pair<std::string, scram_keys_t>>::iterator> index_{};
+    unsigned long hits_{0};
+    unsigned long misses_{0};
+};
+} // namespace
+#endif
+
+/**
+ * Returns the keys for the password, the salt and the iteration count,
+ * running PBKDF2 only if they are not in the process-wide cache.
+ */
+cbsasl_error_t derive_scram_keys(cbsasl_auth_mechanism_t auth_mech, const cbsasl_secret_t *passwd, const char *salt,
+                                 unsigned int saltlen, unsigned int itcount, scram_keys_t *keys)
+{
+#ifndef LCB_NO_SSL
+    unsigned char passwddigest[SHA256_DIGEST_LENGTH];
+    if (SHA256(passwd->data, passwd->len, passwddigest) == nullptr) {
+        return SASL_FAIL;
+    }
+    std::string key;
+    key.reserve(1 + sizeof(itcount) + sizeof(passwddigest) + saltlen);
+    key.push_back(static_cast<char>(auth_mech));
+    key.append(reinterpret_cast<const char *>(&itcount), sizeof(itcount));
+    key.append(reinterpret_cast<const char *>(passwddigest), sizeof(passwddigest));
+    key.append(salt, saltlen);
+    OPENSSL_cleanse(passwddigest, sizeof(passwddigest));
+
+    scram_keys_cache &cache = scram_keys_cache::instance();
+    if (cache.get(key, keys)) {
+        return SASL_OK;
+    }
+
+    unsigned char saltedpassword[CBSASL_SHA512_DIGEST_SIZE];
+    unsigned int saltedpasslen = 0;
+    cbsasl_error_t ret =
+        generate_salted_password(auth_mech, passwd, salt, saltlen, itcount, saltedpassword, &saltedpasslen);
+    if (ret == SASL_OK) {
+        ret = compute_scram_keys(auth_mech, saltedpassword, saltedpasslen, keys);
+    }
+    OPENSSL_cleanse(saltedpassword, sizeof(saltedpassword));
+    if (ret == SASL_OK) {
+        cache.put(key, *keys);
+    }
+    return ret;
+#else
+    (void)auth_mech;
+    (void)passwd;
+    (void)salt;
+    (void)saltlen;
+    (void)itcount;
+    (void)keys;
+    return SASL_BADPARAM;
+#endif
+}
 
+void scram_keys_cache_clear(void)
+{
+#ifndef LCB_NO_SSL
+    scram_keys_cache::instance().clear();
+#endif
+}
+
+void scram_keys_cache_stats(unsigned long *hits, unsigned long *misses)
+{
+#ifndef LCB_NO_SSL
+    scram_keys_cache::instance().stats(hits, misses);
+#else
+    *hits = 0;
+    *misses = 0;
+#endif
+}
+
+/**
+ * Computes the client proof from the derived keys:
+ *
+ * AuthMessage     := client-first-message-bare + "," +
+ *                    server-first-message + "," +
+ *                    client-final-message-without-proof
+ * ClientSignature := HMAC(StoredKey, AuthMessage)
+ * ClientProof     := ClientKey XOR ClientSignature
+ */
+cbsasl_error_t compute_client_proof_with_keys(cbsasl_auth_mechanism_t auth_mech, const scram_keys_t *keys,
+                                              const char *clientfirstbare, unsigned int cfblen,
+                                              const char *serverfirstmess, unsigned int sfmlen,
+                                              const char *clientfinalwithoutproof, unsigned int cfwplen,
+                                              char **authmessage, char *outclientproof, unsigned int outprooflen)
+{
+#ifndef LCB_NO_SSL
     // now we can compute the AuthMessage
     // AuthMessage     := client-first-message-bare + "," +
     //                   server-first-message + "," +
@@ -407,8 +591,8 @@ cbsasl_error_t compute_client_proof(cbsasl_auth_mechanism_t auth_mech, const uns
     // ClientSignature := HMAC(StoredKey, AuthMessage)
     unsigned char clientsign[EVP_MAX_MD_SIZE];
     unsigned int clientsignlen = 0;
-    ret = HMAC_digest(auth_mech, storedkey, storedkeylen, (const unsigned char *)authmess, authmesslen, clientsign,
-                      &clientsignlen);
+    cbsasl_error_t ret = HMAC_digest(auth_mech, keys->stored_key, keys->length, (const unsigned char *)authmess,
+                                     authmesslen, clientsign, &clientsignlen);
     if (ret != SASL_OK) {
         return ret;
     }
@@ -417,7 +601,7 @@ cbsasl_error_t compute_client_proof(cbsasl_auth_mechanism_t auth_mech, const uns
     // ClientProof     := ClientKey XOR ClientSignature
     char clientproof[EVP_MAX_MD_SIZE]; // binary client proof
     for (unsigned i = 0; i < clientsignlen; ++i) {
-        clientproof[i] = clientkeyhmac[i] ^ clientsign[i];
+        clientproof[i] = keys->client_key[i] ^ clientsign[i];
     }
 
     // the final client proof must be encoded in base64
@@ -429,8 +613,7 @@ cbsasl_error_t compute_client_proof(cbsasl_auth_mechanism_t auth_mech, const uns
 #else
     // nothing to do if OpenSSL is not present
     (void)auth_mech;
-    (void)saltedpassword;
-    (void)saltedpasslen;
+    (void)keys;
     (void)clientfirstbare;
     (void)cfblen;
     (void)serverfirstmess;
@@ -445,34 +628,63 @@ cbsasl_error_t compute_client_proof(cbsasl_auth_mechanism_t auth_mech, const uns
 }
 
 /**
- * Computes the Server Signature. It is computed as:
+ * Computes the client proof. It is computed as:
  *
- * SaltedPassword  := Hi(Normalize(password), salt, i)
- * ServerKey       := HMAC(SaltedPassword, "Server Key")
- * ServerSignature := HMAC(ServerKey, AuthMessage)
+ * ClientKey       := HMAC(SaltedPassword, "Client Key")
+ * StoredKey       := H(ClientKey)
+ * AuthMessage     := client-first-message-bare + "," +
+ *                    server-first-message + "," +
+ *                    client-final-message-without-proof
+ * ClientSignature := HMAC(StoredKey, AuthMessage)
+ * ClientProof     := ClientKey XOR ClientSignature
  */
-cbsasl_error_t compute_server_signature(cbsasl_auth_mechanism_t auth_mech, const unsigned char *saltedpassword,
-                                        unsigned int saltedpasslen, const char *authmessage, char *outserversign,
-                                        unsigned int outsignlen)
+cbsasl_error_t compute_client_proof(cbsasl_auth_mechanism_t auth_mech, const unsigned char *saltedpassword,
+                                    unsigned int saltedpasslen, const char *clientfirstbare, unsigned int cfblen,
+                                    const char *serverfirstmess, unsigned int sfmlen,
+                                    const char *clientfinalwithoutproof, unsigned int cfwplen, char **authmessage,
+                                    char *outclientproof, unsigned int outprooflen)
 {
 #ifndef LCB_NO_SSL
-    const char *serverkeystr = "Server Key";
-    unsigned char serverkeyhmac[EVP_MAX_MD_SIZE];
-    unsigned int hmaclen = 0;
-    // we first compute the server key
-    // ServerKey       := HMAC(SaltedPassword, "Server Key")
-    cbsasl_error_t ret = HMAC_digest(auth_mech, saltedpassword, saltedpasslen, (unsigned char *)serverkeystr,
-                                     strlen(serverkeystr), serverkeyhmac, &hmaclen);
+    scram_keys_t keys;
+    cbsasl_error_t ret = compute_scram_keys(auth_mech, saltedpassword, saltedpasslen, &keys);
     if (ret != SASL_OK) {
         return ret;
     }
+    return compute_client_proof_with_keys(auth_mech, &keys, clientfirstbare, cfblen, serverfirstmess, sfmlen,
+                                          clientfinalwithoutproof, cfwplen, authmessage, outclientproof, outprooflen);
+#else
+    // nothing to do if OpenSSL is not present
+    (void)auth_mech;
+    (void)saltedpassword;
+    (void)saltedpasslen;
+    (void)clientfirstbare;
+    (void)cfblen;
+    (void)serverfirstmess;
+    (void)sfmlen;
+    (void)clientfinalwithoutproof;
+    (void)cfwplen;
+    (void)authmessage;
+    (void)outclientproof;
+    (void)outprooflen;
+    return SASL_OK;
+#endif
+}
 
-    // let's compute the server signature
+/**
+ * Computes the Server Signature from the derived key:
+ *
+ * ServerSignature := HMAC(ServerKey, AuthMessage)
+ */
+cbsasl_error_t compute_server_signature_with_key(cbsasl_auth_mechanism_t auth_mech, const unsigned char *serverkey,
+                                                 unsigned int serverkeylen, const char *authmessage,
+                                                 char *outserversign, unsigned int outsignlen)
+{
+#ifndef LCB_NO_SSL
     // ServerSignature := HMAC(ServerKey, AuthMessage)
     unsigned char serversign[EVP_MAX_MD_SIZE];
     unsigned int serversignlen = 0;
-    ret = HMAC_digest(auth_mech, serverkeyhmac, hmaclen, (unsigned char *)authmessage, strlen(authmessage), serversign,
-                      &serversignlen);
+    cbsasl_error_t ret = HMAC_digest(auth_mech, serverkey, serverkeylen, (unsigned char *)authmessage,
+                                     strlen(authmessage), serversign, &serversignlen);
     if (ret != SASL_OK) {
         return ret;
     }
@@ -483,6 +695,37 @@ cbsasl_error_t compute_server_signature(cbsasl_auth_mechanism_t auth_mech, const
     }
     // and we are done
 
+#else
+    // nothing to do if OpenSSL is not present
+    (void)auth_mech;
+    (void)serverkey;
+    (void)serverkeylen;
+    (void)authmessage;
+    (void)outserversign;
+    (void)outsignlen;
+#endif
+    return SASL_OK;
+}
+
+/**
+ * Computes the Server Signature. It is computed as:
+ *
+ * SaltedPassword  := Hi(Normalize(password), salt, i)
+ * ServerKey       := HMAC(SaltedPassword, "Server Key")
+ * ServerSignature := HMAC(ServerKey, AuthMessage)
+ */
+cbsasl_error_t compute_server_signature(cbsasl_auth_mechanism_t auth_mech, const unsigned char *saltedpassword,
+                                        unsigned int saltedpasslen, const char *authmessage, char *outserversign,
+                                        unsigned int outsignlen)
+{
+#ifndef LCB_NO_SSL
+    scram_keys_t keys;
+    cbsasl_error_t ret = compute_scram_keys(auth_mech, saltedpassword, saltedpasslen, &keys);
+    if (ret != SASL_OK) {
+        return ret;
+    }
+    return compute_server_signature_with_key(auth_mech, keys.server_key, keys.length, authmessage, outserversign,
+                                             outsignlen);
 #else
     // nothing to do if OpenSSL is not present
     (void)auth_mech;
@@ -491,6 +734,6 @@ cbsasl_error_t compute_server_signature(cbsasl_auth_mechanism_t auth_mech, const
     (void)authmessage;
     (void)outserversign;
     (void)outsignlen;
-#endif
     return SASL_OK;
+#endif
 }
@@ -64,6 +64,69 @@ cbsasl_error_t generate_salted_password(cbsasl_auth_mechanism_t auth_mech, const
                                         const char *salt, unsigned int saltlen, unsigned int itcount,
                                         unsigned char *outbuffer, unsigned int *outlength);
 
+/**
+ * Keys derived from the salted password. They depend only on the password,
+ * the salt, the iteration count and the mechanism, so they can be shared by
+ * all connections authenticating with the same credentials.
+ */
+typedef struct {
+    unsigned char client_key[CBSASL_SHA512_DIGEST_SIZE];
+    unsigned char stored_key[CBSASL_SHA512_DIGEST_SIZE];
+    unsigned char server_key[CBSASL_SHA512_DIGEST_SIZE];
+    unsigned int length; /* digest size of the mechanism */
+} scram_keys_t;
+
+/**
+ * Computes the keys from the salted password:
+ *
+ * ClientKey       := HMAC(SaltedPassword, "Client Key")
+ * StoredKey       := H(ClientKey)
+ * ServerKey       := HMAC(SaltedPassword, "Server Key")
+ */
+cbsasl_error_t compute_scram_keys(cbsasl_auth_mechanism_t auth_mech, const unsigned char *saltedpassword,
+                                  unsigned int saltedpasslen, scram_keys_t *keys);
+
+/**
+ * Returns the keys for the password, the (base64-encoded) salt and the
+ * iteration count sent by the server.
+ *
+ * Running PBKDF2 with thousands of iterations is the most expensive part of
+ * the handshake, and after a node restart every connection of every instance
+ * in the process asks for the same keys. Therefore the results are kept in a
+ * small process-wide LRU cache. The cache does not store the password itself,
+ * only its digest as part of the lookup key.
+ */
+cbsasl_error_t derive_scram_keys(cbsasl_auth_mechanism_t auth_mech, const cbsasl_secret_t *passwd, const char *salt,
+                                 unsigned int saltlen, unsigned int itcount, scram_keys_t *keys);
+
+/**
+ * Drops all cached keys and resets the counters.
+ */
+void scram_keys_cache_clear(void);
+
+/**
+ * Reports how many times derive_scram_keys() has been served from the cache,
+ * and how many times it had to run PBKDF2.
+ */
+void scram_keys_cache_stats(unsigned long *hits, unsigned long *misses);
+
+/**
+ * Same as compute_client_proof(), but uses the keys which are already derived.
+ */
+cbsasl_error_t compute_client_proof_with_keys(cbsasl_auth_mechanism_t auth_mech, const scram_keys_t *keys,
+                                              const char *clientfirstbare, unsigned int cfblen,
+                                              const char *serverfirstmess, unsigned int sfmlen,
+                                              const char *clientfinalwithoutproof, unsigned int cfwplen,
+                                              char **authmessage, char *outclientproof, unsigned int outprooflen);
+
+/**
+ * Same as compute_server_signature(), but takes ServerKey instead of the
+ * salted password.
+ */
+cbsasl_error_t compute_server_signature_with_key(cbsasl_auth_mechanism_t auth_mech, const unsigned char *serverkey,
+                                                 unsigned int serverkeylen, const char *authmessage,
+                                                 char *outserversign, unsigned int outsignlen);
+
 /**
  * Computes the client proof. It is computed as:
  *
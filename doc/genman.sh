@@ -6,7 +6,7 @@ set -x
 OUTDIR=man
 SRCDIR=.
 
-MANPAGES="cbc cbc-pillowfight cbc-n1qlback cbc-subdoc"
+MANPAGES="cbc cbc-pillowfight cbc-n1qlback cbc-subdoc cbc-import"
 for page in $MANPAGES; do
   ruby -e "puts ARGF.read.gsub('@@common-options.markdown@@', File.read('common-options.markdown'))" $SRCDIR/$page.markdown | \
   ruby -e "puts ARGF.read.gsub('@@common-additional-options.markdown@@', File.read('common-additional-options.markdown'))" | \
@@ -1326,11 +1326,316 @@ typedef enum {
  */
 #define LCB_CNTL_ENABLE_OP_METRICS 0x67
 
+/**
+ * @brief Fraction of operations which should be traced.
+ *
+ * Head-based probabilistic sampling: the decision is made when the operation
+ * is scheduled, and the operations which have not been selected do not create
+ * any spans. Operations with explicit parent span are always traced.
+ * The value must be in range from 0 to 1. Default is 1 (trace everything).
+ *
+ * Use `tracing_sample_rate` in the connection string
+ *
+ * @code{.c}
+ * float rate = 0.01; // trace one of hundred operations
+ * lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_TRACING_SAMPLE_RATE, &rate);
+ * @endcode
+ *
+ * @cntl_arg_both{float*}
+ * @uncommitted
+ */
+#define LCB_CNTL_TRACING_SAMPLE_RATE 0x68
+
+/**
+ * @brief Enable/disable tail-based tracing of KV operations.
+ *
+ * When enabled together with the default threshold logging tracer, KV
+ * operations do not create spans when scheduled. Instead the span is built
+ * from the timestamps already stored on the request, and only for operations
+ * which exceeded the KV threshold, failed, or became orphaned. Timeouts,
+ * network and server errors count as failures, while the expected outcomes of
+ * the operation (e.g. missing key, CAS mismatch or subdoc path errors) do not. This way the
+ * threshold and orphan reports keep full coverage, but fast operations do not
+ * pay the cost of the span. Disabled by default.
+ *
+ * Use `tracing_tail_based` in the connection string
+ *
+ * @cntl_arg_both{int* (as boolean)}
+ * @uncommitted
+ */
+#define LCB_CNTL_TRACING_TAIL_BASED 0x69
+
+/**
+ * @brief Maximum number of pooled HTTP connections per node.
+ *
+ * Limits the number of connections (in use, idle and connecting) which the
+ * library opens to a single HTTP endpoint. When the limit is reached, new
+ * requests wait until one of the connections is released back into the pool.
+ * The value should not be smaller than LCB_CNTL_HTTP_POOLSIZE, otherwise the
+ * released connections will be closed instead of being reused.
+ * Default is 0 (no limit).
+ *
+ * Use `http_max_connections_per_node` in the connection string
+ *
+ * @cntl_arg_both{lcb_SIZE*}
+ * @uncommitted
+ */
+#define LCB_CNTL_HTTP_MAX_CONNECTIONS_PER_NODE 0x6a
+
+/**
+ * @brief Number of connections to open in advance to each query, search and
+ * analytics node.
+ *
+ * The connections are opened every time the library receives new cluster
+ * configuration, and placed into the HTTP connection pool, so that first
+ * requests do not wait for connection (and TLS handshake). The pool keeps at
+ * least this number of connections to each node while the node is part of
+ * the cluster: the idle ones do not expire after LCB_CNTL_HTTP_POOL_TIMEOUT,
+ * and the closed ones are reopened in the background (with exponential
+ * backoff if the node is not reachable).
+ * Default is 0 (do not warm up the pool).
+ *
+ * Use `http_warmup_connections` in the connection string
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @uncommitted
+ */
+#define LCB_CNTL_HTTP_WARMUP_CONNECTIONS 0x6b
+
+/**
+ * @brief Send the HTTP requests over HTTP/2.
+ *
+ * When enabled, the requests of lcb_http(), lcb_query(), lcb_search() and
+ * lcb_analytics() (and of the operations built on top of them) to the same
+ * host and port share a single connection, and are sent as concurrent
+ * HTTP/2 streams, instead of occupying a connection (with its own TCP and
+ * TLS handshakes) each. The library speaks cleartext HTTP/2 without upgrade
+ * (h2c with prior knowledge), or negotiates `h2` through ALPN when TLS is
+ * used. Every stream is subject to HTTP/2 flow control, so that a paused
+ * streaming request does not stop the other requests on the connection.
+ *
+ * If the server answers the connection preface with HTTP/1.x, the host is
+ * remembered, and its requests are sent over the regular HTTP/1.1 connection
+ * pool. The connection is closed after it has been idle for
+ * @ref LCB_CNTL_HTTP_POOL_TIMEOUT.
+ * Default is false.
+ *
+ * Use `enable_http2` in the connection string
+ *
+ * @cntl_arg_both{int (as boolean)}
+ * @uncommitted
+ */
+#define LCB_CNTL_ENABLE_HTTP2 0x6c
+
+/**
+ * @brief Maximum number of prepared statements kept in the N1QL plan cache.
+ *
+ * When the cache is full, the least recently used plan is evicted. Setting a
+ * smaller value does not evict plans immediately, but on the next insertion.
+ * The value must be greater than zero.
+ * Default is 5000.
+ *
+ * Use `n1ql_cache_size` in the connection string
+ *
+ * @cntl_arg_both{lcb_SIZE*}
+ * @uncommitted
+ */
+#define LCB_CNTL_N1QL_CACHE_SIZE 0x6d
+
+/**
+ * @brief Share N1QL prepared statements between instances.
+ *
+ * When enabled, the plans are also stored in the process-wide cache, which is
+ * shared by all instances connected to the same cluster (the same set of
+ * nodes) with this setting enabled, so that a statement prepared by one
+ * instance does not have to be prepared again by the others. The shared cache
+ * is thread-safe. @ref LCB_CNTL_QUERY_CLEARACHE only clears the plans of the
+ * instance, the ones in the shared cache are kept for the other instances.
+ * Default is false.
+ *
+ * Use `n1ql_shared_cache` in the connection string
+ *
+ * @cntl_arg_both{int (as boolean)}
+ * @uncommitted
+ */
+#define LCB_CNTL_N1QL_SHARED_CACHE 0x6e
+
+/**
+ * @brief Statistics of the N1QL plan cache
+ * @see LCB_CNTL_N1QL_CACHE_STATS
+ * @uncommitted
+ */
+typedef struct {
+    lcb_U64 hits;      /**< Lookups which found the plan (locally or in the shared cache) */
+    lcb_U64 misses;    /**< Lookups which did not find the plan */
+    lcb_U64 evictions; /**< Plans removed from the instance cache because of capacity */
+    lcb_U64 coalesced; /**< Queries which waited for PREPARE issued by another query */
+    lcb_SIZE size;     /**< Number of plans in the instance cache */
+} lcb_N1QL_CACHE_STATS;
+
+/**
+ * @brief Retrieve statistics of the N1QL plan cache.
+ *
+ * Concurrent queries for the statement, which is not in the cache yet, wait
+ * for a single PREPARE request, and are counted as `coalesced`.
+ *
+ * @cntl_arg_getonly{lcb_N1QL_CACHE_STATS*}
+ * @uncommitted
+ */
+#define LCB_CNTL_N1QL_CACHE_STATS 0x6f
+
+/**
+ * @brief Pipeline the commands of the KV connection negotiation.
+ *
+ * By default every new KV connection waits for the list of SASL mechanisms
+ * before it starts authentication, and for the authentication before it
+ * selects the bucket. When this setting is enabled, the library remembers the
+ * mechanism negotiated by the previous connection, sends SASL_AUTH together
+ * with HELLO, and sends SELECT_BUCKET together with the final authentication
+ * step, so that the negotiation takes two round trips with SCRAM-SHA, and a
+ * single one with PLAIN (over TLS) or client certificates. The error map is
+ * also fetched only by the first connection of the instance. If the server
+ * rejects the remembered mechanism, the connection falls back to the regular
+ * negotiation.
+ * Default is false.
+ *
+ * Use `optimistic_negotiation` in the connection string
+ *
+ * @cntl_arg_both{int (as boolean)}
+ * @uncommitted
+ */
+#define LCB_CNTL_OPTIMISTIC_NEGOTIATION 0x70
+
+/**
+ * @brief Resume TLS sessions of the previous connections.
+ *
+ * When enabled, the library keeps the TLS session (or session ticket) of the
+ * last connection to each endpoint, and offers it when it connects to the same
+ * host and port again, so that the server can skip the certificate exchange
+ * and the key agreement of the full handshake. The sessions are shared by the
+ * KV, HTTP and configuration connections of the instance.
+ * Default is true.
+ *
+ * Use `tls_session_cache` in the connection string
+ *
+ * @cntl_arg_both{int (as boolean)}
+ * @uncommitted
+ */
+#define LCB_CNTL_TLS_SESSION_CACHE 0x71
+
+/**
+ * @brief Statistics of TLS handshakes
+ * @see LCB_CNTL_TLS_SESSION_STATS
+ * @uncommitted
+ */
+typedef struct {
+    lcb_U64 full_handshakes;    /**< Handshakes which established a new session */
+    lcb_U64 resumed_handshakes; /**< Handshakes which resumed a cached session */
+    lcb_SIZE size;              /**< Number of sessions kept for resumption */
+    lcb_U64 ktls_connections;   /**< Connections which send data through kernel TLS (@ref LCB_CNTL_ENABLE_KTLS) */
+} lcb_TLS_SESSION_STATS;
+
+/**
+ * @brief Retrieve statistics of TLS handshakes performed by the instance.
+ *
+ * All the counters are zero when TLS is not used.
+ *
+ * @cntl_arg_getonly{lcb_TLS_SESSION_STATS*}
+ * @uncommitted
+ */
+#define LCB_CNTL_TLS_SESSION_STATS 0x72
+
+/**
+ * @brief Offload TLS encryption to the kernel (Linux only).
+ *
+ * When enabled, the TLS handshake is still performed by OpenSSL, but then the
+ * session keys are installed into the socket (kTLS), and the outgoing data is
+ * written to the socket directly, without copying it into the TLS library.
+ * Incoming records are decrypted by the kernel too. The connection falls back
+ * to regular userspace TLS if the kernel does not support kTLS for the
+ * negotiated cipher, or if OpenSSL has been built without kTLS support (it
+ * requires OpenSSL 3.0 or newer). Only the built-in I/O plugins with event
+ * model (`select`, `libevent` and `libev`) are supported: custom or wrapped
+ * plugins keep their own socket routines, and use regular TLS.
+ * Use @ref LCB_CNTL_TLS_SESSION_STATS to see how many connections use kTLS.
+ * Default is false.
+ *
+ * Use `enable_ktls` in the connection string
+ *
+ * @cntl_arg_both{int (as boolean)}
+ * @uncommitted
+ */
+#define LCB_CNTL_ENABLE_KTLS 0x73
+
+/**
+ * @brief Collect latency histograms for every KV pipeline.
+ *
+ * When enabled, every KV packet is timestamped when it has been written to the
+ * socket and when its response has been read, and the times are aggregated
+ * into the histograms of the node in @ref lcb_SERVERMETRICS:
+ *
+ * - `queue_latency`: from scheduling of the operation until the packet has
+ *   been written to the socket (time spent in the client queue)
+ * - `wire_latency`: from the write until the response has been read
+ *   (time spent in the kernel buffers, on the network and on the server)
+ * - `server_latency`: the duration reported by the server in the response
+ *
+ * The histograms can be inspected with lcb_histogram_read(), and are also
+ * included into the report of lcb_diag(). This setting implies
+ * @ref LCB_CNTL_METRICS, and should be set before connecting.
+ * Default is false.
+ *
+ * Use `pipeline_latency` in the connection string
+ *
+ * @cntl_arg_both{int (as boolean)}
+ * @uncommitted
+ */
+#define LCB_CNTL_PIPELINE_LATENCY 0x74
+
+/**
+ * @brief How long the resolved addresses of the host are reused.
+ *
+ * The host names are resolved on background threads, so that the event loop
+ * is not blocked by the name lookup, and the resolved addresses are shared by
+ * all connections of the instance (KV, HTTP and configuration) for the given
+ * amount of time. The system resolver does not expose the TTL of the DNS
+ * records, so the value should not exceed the TTL used by the DNS zone of the
+ * cluster. Zero disables the cache.
+ *
+ * Default is 60 seconds.
+ *
+ * Use `dns_cache_ttl` in the connection string
+ *
+ * @cntl_arg_both{lcb_U32* (microseconds)}
+ * @uncommitted
+ */
+#define LCB_CNTL_DNS_CACHE_TTL 0x75
+
+/**
+ * @brief Connect to the KV nodes before the commands need the connections.
+ *
+ * By default the connection to the KV node is opened when the first command
+ * is scheduled to it, and after the connection has been lost, it is reopened
+ * only when the next command arrives. When this setting is enabled, the
+ * library connects to all KV nodes when it receives the cluster configuration
+ * (during bootstrap and whenever the topology changes), and the connections
+ * which failed or have been closed are reopened in the background, with the
+ * delay between the attempts growing exponentially from 100ms up to 10s.
+ *
+ * Default is false.
+ *
+ * Use `kv_preconnect` in the connection string
+ *
+ * @cntl_arg_both{int (as boolean)}
+ * @uncommitted
+ */
+#define LCB_CNTL_KV_PRECONNECT 0x76
+
 /**
  * This is not a command, but rather an indicator of the last item.
  * @internal
  */
-#define LCB_CNTL__MAX 0x68
+#define LCB_CNTL__MAX 0x77
 /**@}*/
 
 #ifdef __cplusplus
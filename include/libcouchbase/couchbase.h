@@ -517,6 +517,9 @@ typedef enum {
 
 #define LCB_CALLBACK_OPEN -6
 
+/** Callback type for KV scans (cannot be used for lcb_install_callback3()) */
+#define LCB_CALLBACK_SCAN -7
+
 /**
  * @uncommitted
  * Durability levels
@@ -997,6 +1000,38 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_collection(lcb_CMDSTORE *cmd, const cha
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_key(lcb_CMDSTORE *cmd, const char *key, size_t key_len);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_value(lcb_CMDSTORE *cmd, const char *value, size_t value_len);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_value_iov(lcb_CMDSTORE *cmd, const lcb_IOV *value, size_t value_len);
+/**
+ * Set the value of the document without copying it into the library buffers.
+ *
+ * The memory is referenced by the command and written to the network directly
+ * from the application buffers. It must remain valid until
+ * lcb_pktflushed_callback is invoked with the cookie passed to lcb_store().
+ * The callback is invoked once for every operation accepted by lcb_store():
+ * after the value has been written, or when the operation is dropped before
+ * that, i.e. on lcb_sched_fail(), when it fails while waiting for the
+ * configuration or the collection ID, and for the operations still pending in
+ * lcb_destroy(). The only exception are completion-based I/O plugins (e.g.
+ * libuv or IOCP) which are still writing the value when lcb_destroy() is
+ * called: the callback cannot be delivered anymore, and the buffers must
+ * remain valid until the event loop has completed the pending write.
+ * If lcb_store() returns an error, the callback is not invoked.
+ * Values set this way are never compressed by the library.
+ *
+ * @param cmd the command
+ * @param value the value buffer
+ * @param value_len the size of the value
+ * @see lcb_set_pktflushed_callback
+ * @uncommitted
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_value_borrowed(lcb_CMDSTORE *cmd, const char *value, size_t value_len);
+/**
+ * Same as lcb_cmdstore_value_borrowed(), but the value is a list of fragments.
+ * Only the memory referenced by the fragments has to outlive the call, the
+ * `value` array itself is copied.
+ * @uncommitted
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_value_iov_borrowed(lcb_CMDSTORE *cmd, const lcb_IOV *value,
+                                                            size_t value_len);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_expiry(lcb_CMDSTORE *cmd, uint32_t expiration);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_preserve_expiry(lcb_CMDSTORE *cmd, int should_preserve);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_cas(lcb_CMDSTORE *cmd, uint64_t cas);
@@ -2425,6 +2460,140 @@ int lcb_is_redacting_logs(lcb_INSTANCE *instance);
 
 /** @} */
 
+/**
+ * @ingroup lcb-public-api
+ * @defgroup lcb-columnar-api Columnar Rows
+ * @brief Decode query rows into typed columns
+ *
+ * Instead of handing every result row to the application as JSON text, the
+ * library can extract a fixed set of fields from the rows while they are
+ * being split out of the HTTP response, and deliver them in batches of typed
+ * arrays (one array per field). This avoids materializing a JSON document for
+ * every row in the application.
+ *
+ * @code{.c}
+ * lcb_COLUMN_SCHEMA *schema;
+ * lcb_column_schema_create(&schema);
+ * lcb_column_schema_add(schema, "id", 2, LCB_COLUMN_INT64);
+ * lcb_column_schema_add(schema, "geo.lat", 7, LCB_COLUMN_DOUBLE);
+ * lcb_column_schema_add(schema, "name", 4, LCB_COLUMN_STRING);
+ * lcb_cmdquery_columnar(cmd, schema);
+ * lcb_column_schema_destroy(schema);
+ *
+ * static void row_callback(lcb_INSTANCE *instance, int type, const lcb_RESPQUERY *resp)
+ * {
+ *     const lcb_COLUMN_BATCH *batch = NULL;
+ *     if (lcb_respquery_columns(resp, &batch) == LCB_SUCCESS) {
+ *         const int64_t *ids;
+ *         const uint8_t *valid;
+ *         size_t ii;
+ *         lcb_column_batch_int64(batch, 0, &ids, &valid);
+ *         for (ii = 0; ii < lcb_column_batch_rows(batch); ii++) {
+ *             if (valid[ii]) {
+ *                 printf("%lld\n", (long long)ids[ii]);
+ *             }
+ *         }
+ *     }
+ * }
+ * @endcode
+ *
+ * @addtogroup lcb-columnar-api
+ * @{
+ */
+
+/**
+ * @uncommitted
+ * Type of the values in the column
+ */
+typedef enum {
+    /** Integer numbers, which fit into int64_t */
+    LCB_COLUMN_INT64 = 0,
+    /** Any JSON numbers */
+    LCB_COLUMN_DOUBLE,
+    /** JSON strings */
+    LCB_COLUMN_STRING,
+    /** JSON true and false */
+    LCB_COLUMN_BOOLEAN
+} lcb_COLUMN_TYPE;
+
+/**
+ * @uncommitted
+ * Value of the string column. Unless the string contains escape sequences, it
+ * points directly into the received data, so it is valid only during the
+ * callback.
+ */
+typedef struct {
+    const char *data;
+    size_t length;
+} lcb_COLUMN_STRING;
+
+typedef struct lcb_COLUMN_SCHEMA_ lcb_COLUMN_SCHEMA;
+typedef struct lcb_COLUMN_BATCH_ lcb_COLUMN_BATCH;
+
+/**
+ * @uncommitted
+ * Create the empty schema. Add the columns with lcb_column_schema_add().
+ *
+ * @param[out] schema the new schema
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_column_schema_create(lcb_COLUMN_SCHEMA **schema);
+/**
+ * @uncommitted
+ * Release the schema. The commands copy the schema, so it might be destroyed
+ * right after lcb_cmdquery_columnar() or lcb_cmdanalytics_columnar().
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_column_schema_destroy(lcb_COLUMN_SCHEMA *schema);
+/**
+ * @uncommitted
+ * Append the column to the schema. The columns are numbered in order they
+ * were added, starting from zero.
+ *
+ * The path addresses the field of the row object, the nested fields are
+ * separated by dots (e.g. `"address.city"`). The empty path selects the row
+ * itself (e.g. for `SELECT RAW` queries). The values which do not match the
+ * type of the column (including missing fields and `null`) are reported as
+ * not valid.
+ *
+ * @param schema the schema
+ * @param path path to the field
+ * @param path_len length of the path
+ * @param type type of the column
+ * @return LCB_ERR_INVALID_ARGUMENT if the path contains empty components
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_column_schema_add(lcb_COLUMN_SCHEMA *schema, const char *path, size_t path_len,
+                                                  lcb_COLUMN_TYPE type);
+/**
+ * @uncommitted
+ * Set the maximum number of rows in the batch (1024 by default). The batch
+ * might contain less rows, as it is also delivered when the library runs out
+ * of received data.
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_column_schema_batch_size(lcb_COLUMN_SCHEMA *schema, size_t rows);
+
+/**
+ * @uncommitted
+ * Get the number of rows in the batch. The batch and its values are only
+ * valid inside the callback, which has received it.
+ */
+LIBCOUCHBASE_API size_t lcb_column_batch_rows(const lcb_COLUMN_BATCH *batch);
+/**
+ * @uncommitted
+ * Get values of the column. The arrays have lcb_column_batch_rows() elements,
+ * and the value is only meaningful when the corresponding `valid` flag is set.
+ *
+ * @return LCB_ERR_INVALID_ARGUMENT if the column does not exist or has different type
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_column_batch_int64(const lcb_COLUMN_BATCH *batch, size_t column,
+                                                   const int64_t **values, const uint8_t **valid);
+LIBCOUCHBASE_API lcb_STATUS lcb_column_batch_double(const lcb_COLUMN_BATCH *batch, size_t column,
+                                                    const double **values, const uint8_t **valid);
+LIBCOUCHBASE_API lcb_STATUS lcb_column_batch_string(const lcb_COLUMN_BATCH *batch, size_t column,
+                                                    const lcb_COLUMN_STRING **values, const uint8_t **valid);
+LIBCOUCHBASE_API lcb_STATUS lcb_column_batch_boolean(const lcb_COLUMN_BATCH *batch, size_t column,
+                                                     const uint8_t **values, const uint8_t **valid);
+
+/** @} */
+
 /**
  * @ingroup lcb-public-api
  * @defgroup lcb-analytics-api Analytics Queries
@@ -2455,6 +2624,16 @@ LIBCOUCHBASE_API lcb_STATUS lcb_respanalytics_status(const lcb_RESPANALYTICS *re
 LIBCOUCHBASE_API lcb_STATUS lcb_respanalytics_cookie(const lcb_RESPANALYTICS *resp, void **cookie);
 LIBCOUCHBASE_API lcb_STATUS lcb_respanalytics_row(const lcb_RESPANALYTICS *resp, const char **row, size_t *row_len);
 LIBCOUCHBASE_API lcb_STATUS lcb_respanalytics_http_response(const lcb_RESPANALYTICS *resp, const lcb_RESPHTTP **http);
+/**
+ * @uncommitted
+ * Get the batch of decoded rows, when the command was configured with
+ * @ref lcb_cmdanalytics_columnar. In this mode the rows are not delivered
+ * one by one, and @ref lcb_respanalytics_row returns the metadata only for
+ * the final response.
+ *
+ * @return LCB_ERR_INVALID_ARGUMENT if the response does not carry the batch
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_respanalytics_columns(const lcb_RESPANALYTICS *resp, const lcb_COLUMN_BATCH **batch);
 /**
  * Get handle to analytics query.  Used when canceling analytics request.  See @ref lcb_cmdanalytics_handle also
  *
@@ -2512,6 +2691,59 @@ LIBCOUCHBASE_API lcb_STATUS lcb_ingest_options_expiry(lcb_INGEST_OPTIONS *option
 LIBCOUCHBASE_API lcb_STATUS lcb_ingest_options_ignore_error(lcb_INGEST_OPTIONS *options, int flag);
 LIBCOUCHBASE_API lcb_STATUS lcb_ingest_options_data_converter(lcb_INGEST_OPTIONS *options,
                                                               lcb_INGEST_DATACONVERTER_CALLBACK callback);
+/**
+ * @uncommitted
+ * Limit the number of store operations in flight for each KV node (16 by
+ * default). When the rows are arriving faster than they can be stored, the
+ * analytics response stream is paused.
+ *
+ * @param options the ingest options
+ * @param operations the size of the window, must be greater than zero
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_ingest_options_window(lcb_INGEST_OPTIONS *options, uint32_t operations);
+/**
+ * @uncommitted
+ * Run the custom data converter on the worker threads. The rows are converted
+ * in batches, and the threads are only used while the batch is being
+ * converted. The converter must be thread safe, and must not use the instance
+ * passed to it. By default (zero threads) the rows are converted on the IO
+ * thread. This setting does not apply to the default converter.
+ *
+ * @param options the ingest options
+ * @param threads number of the worker threads
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_ingest_options_converter_threads(lcb_INGEST_OPTIONS *options, uint32_t threads);
+
+/**
+ * @uncommitted
+ * Statistics of the ingestion, available with the final response of the
+ * analytics query (see @ref lcb_respanalytics_ingest_stats).
+ */
+typedef struct {
+    /** Number of rows received for ingestion */
+    uint64_t rows;
+    /** Number of rows, which have been stored successfully */
+    uint64_t stored;
+    /** Number of rows, which have been skipped by the data converter */
+    uint64_t ignored;
+    /** Number of rows, which failed to convert or to store */
+    uint64_t failed;
+    /** Number of store operations, which have been retried after temporary failure */
+    uint64_t retries;
+    /** Time between the first row and completion of the last one */
+    uint64_t elapsed_us;
+    /** Number of completed rows per second */
+    double rows_per_second;
+} lcb_INGEST_STATS;
+
+/**
+ * @uncommitted
+ * Get the statistics of the ingestion (see @ref lcb_cmdanalytics_ingest_options).
+ * The final response is delivered when all the rows have been stored.
+ *
+ * @return LCB_ERR_INVALID_ARGUMENT if the response is not final, or the ingestion was not requested
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_respanalytics_ingest_stats(const lcb_RESPANALYTICS *resp, lcb_INGEST_STATS *stats);
 
 LIBCOUCHBASE_API lcb_STATUS lcb_ingest_dataconverter_param_cookie(lcb_INGEST_PARAM *param, void **cookie);
 LIBCOUCHBASE_API lcb_STATUS lcb_ingest_dataconverter_param_row(lcb_INGEST_PARAM *param, const char **row,
@@ -2582,6 +2814,15 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdanalytics_positional_params(lcb_CMDANALYTICS
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdanalytics_positional_param(lcb_CMDANALYTICS *cmd, const char *value,
                                                               size_t value_len);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdanalytics_ingest_options(lcb_CMDANALYTICS *cmd, lcb_INGEST_OPTIONS *options);
+/**
+ * @uncommitted
+ * Deliver the rows in batches, decoded according to the schema (see @ref lcb-columnar-api).
+ * The schema is copied, so it might be destroyed after the call.
+ *
+ * @param cmd the command
+ * @param schema the schema, or NULL to receive JSON rows
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdanalytics_columnar(lcb_CMDANALYTICS *cmd, const lcb_COLUMN_SCHEMA *schema);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdanalytics_deferred(lcb_CMDANALYTICS *cmd, int deferred);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdanalytics_client_context_id(lcb_CMDANALYTICS *cmd, const char *value,
                                                                size_t value_len);
@@ -2882,6 +3123,16 @@ LIBCOUCHBASE_API lcb_STATUS lcb_respquery_status(const lcb_RESPQUERY *resp);
 LIBCOUCHBASE_API lcb_STATUS lcb_respquery_cookie(const lcb_RESPQUERY *resp, void **cookie);
 LIBCOUCHBASE_API lcb_STATUS lcb_respquery_row(const lcb_RESPQUERY *resp, const char **row, size_t *row_len);
 LIBCOUCHBASE_API lcb_STATUS lcb_respquery_http_response(const lcb_RESPQUERY *resp, const lcb_RESPHTTP **http);
+/**
+ * @uncommitted
+ * Get the batch of decoded rows, when the command was configured with
+ * @ref lcb_cmdquery_columnar. In this mode the rows are not delivered one by
+ * one, and @ref lcb_respquery_row returns the metadata only for the final
+ * response.
+ *
+ * @return LCB_ERR_INVALID_ARGUMENT if the response does not carry the batch
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_respquery_columns(const lcb_RESPQUERY *resp, const lcb_COLUMN_BATCH **batch);
 LIBCOUCHBASE_API lcb_STATUS lcb_respquery_handle(const lcb_RESPQUERY *resp, lcb_QUERY_HANDLE **handle);
 LIBCOUCHBASE_API lcb_STATUS lcb_respquery_error_context(const lcb_RESPQUERY *resp, const lcb_QUERY_ERROR_CONTEXT **ctx);
 LIBCOUCHBASE_API int lcb_respquery_is_final(const lcb_RESPQUERY *resp);
@@ -3110,6 +3361,15 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdquery_option(lcb_CMDQUERY *cmd, const char *n
                                                 size_t value_len);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdquery_handle(lcb_CMDQUERY *cmd, lcb_QUERY_HANDLE **handle);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdquery_timeout(lcb_CMDQUERY *cmd, uint32_t timeout);
+/**
+ * @uncommitted
+ * Deliver the rows in batches, decoded according to the schema (see @ref lcb-columnar-api).
+ * The schema is copied, so it might be destroyed after the call.
+ *
+ * @param cmd the command
+ * @param schema the schema, or NULL to receive JSON rows
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdquery_columnar(lcb_CMDQUERY *cmd, const lcb_COLUMN_SCHEMA *schema);
  /**
  * @uncommitted
  * Indicates that the query engine to preserve expiration values set on any
@@ -3212,6 +3472,39 @@ LIBCOUCHBASE_API lcb_STATUS lcb_respview_handle(const lcb_RESPVIEW *resp, lcb_VI
 LIBCOUCHBASE_API lcb_STATUS lcb_respview_error_context(const lcb_RESPVIEW *resp, const lcb_VIEW_ERROR_CONTEXT **ctx);
 LIBCOUCHBASE_API int lcb_respview_is_final(const lcb_RESPVIEW *resp);
 
+/**
+ * @uncommitted
+ * Statistics of the document fetching for the views with @ref lcb_cmdview_include_docs.
+ *
+ * The documents are fetched from every KV node with its own window, which
+ * grows while the node responds quickly, and shrinks on errors and latency
+ * spikes.
+ */
+typedef struct {
+    /** Number of documents, which have been fetched successfully */
+    uint64_t fetched;
+    /** Number of documents, which failed to fetch */
+    uint64_t failed;
+    /** Sum of the windows of all KV nodes at the end of the query */
+    uint32_t window;
+    /** Largest sum of the windows during the query */
+    uint32_t max_window;
+    /** Number of times, when the window of some node has been shrunk */
+    uint32_t window_decreases;
+    /** Time between the first row and the last document */
+    uint64_t elapsed_us;
+    /** Number of fetched documents per second */
+    double docs_per_second;
+} lcb_VIEW_FETCH_STATS;
+
+/**
+ * @uncommitted
+ * Get the statistics of the document fetching.
+ *
+ * @return LCB_ERR_INVALID_ARGUMENT if the response is not final, or the documents were not requested
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_respview_fetch_stats(const lcb_RESPVIEW *resp, lcb_VIEW_FETCH_STATS *stats);
+
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdview_create(lcb_CMDVIEW **cmd);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdview_destroy(lcb_CMDVIEW *cmd);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdview_parent_span(lcb_CMDVIEW *cmd, lcbtrace_SPAN *span);
@@ -3221,6 +3514,13 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdview_view_name(lcb_CMDVIEW *cmd, const char *
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdview_option_string(lcb_CMDVIEW *cmd, const char *optstr, size_t optstr_len);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdview_post_data(lcb_CMDVIEW *cmd, const char *data, size_t data_len);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdview_include_docs(lcb_CMDVIEW *cmd, int include_docs);
+/**
+ * Limit the number of documents, which might be fetched concurrently from
+ * all KV nodes together (see @ref lcb_cmdview_include_docs). The default is 10.
+ *
+ * Every node also has its own window, which adapts to the latency of the
+ * node, and never exceeds this limit.
+ */
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdview_max_concurrent_docs(lcb_CMDVIEW *cmd, uint32_t num);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdview_no_row_parse(lcb_CMDVIEW *cmd, int flag);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdview_handle(lcb_CMDVIEW *cmd, lcb_VIEW_HANDLE **handle);
@@ -3229,6 +3529,136 @@ LIBCOUCHBASE_API lcb_STATUS lcb_view(lcb_INSTANCE *instance, void *cookie, const
 LIBCOUCHBASE_API lcb_STATUS lcb_view_cancel(lcb_INSTANCE *instance, lcb_VIEW_HANDLE *handle);
 /** @} */
 
+/**
+ * @ingroup lcb-public-api
+ * @defgroup lcb-scan-api KV Range Scan
+ * @brief Iterate over the documents of the collection directly from the data service
+ *
+ * @details
+ * The scan is split by vBuckets, and every KV node scans its vBuckets
+ * concurrently (see @ref lcb_cmdscan_concurrency). The documents are
+ * streamed to the callback as soon as they arrive, so the order of the rows
+ * is only defined within single vBucket. Requires server support for range
+ * scans (Couchbase Server 7.2 or later).
+ *
+ * @code{.c}
+ * static void scan_callback(lcb_INSTANCE *instance, int cbtype, const lcb_RESPSCAN *resp)
+ * {
+ *     if (lcb_respscan_is_final(resp)) {
+ *         printf("scan completed: %s\n", lcb_strerror_short(lcb_respscan_status(resp)));
+ *         return;
+ *     }
+ *     const char *key;
+ *     size_t key_len;
+ *     lcb_respscan_key(resp, &key, &key_len);
+ *     printf("%.*s\n", (int)key_len, key);
+ * }
+ *
+ * lcb_CMDSCAN *cmd;
+ * lcb_cmdscan_create(&cmd);
+ * lcb_cmdscan_collection(cmd, "inventory", strlen("inventory"), "airline", strlen("airline"));
+ * lcb_cmdscan_prefix(cmd, "airline_", strlen("airline_"));
+ * lcb_cmdscan_callback(cmd, scan_callback);
+ * lcb_scan(instance, NULL, cmd);
+ * lcb_cmdscan_destroy(cmd);
+ * lcb_wait(instance, LCB_WAIT_DEFAULT);
+ * @endcode
+ */
+
+/**
+ * @addtogroup lcb-scan-api
+ * @{
+ */
+
+typedef struct lcb_RESPSCAN_ lcb_RESPSCAN;
+typedef struct lcb_CMDSCAN_ lcb_CMDSCAN;
+typedef struct lcb_SCAN_HANDLE_ lcb_SCAN_HANDLE;
+
+/**
+ * Callback function invoked for each document of the scan
+ * @param instance the library handle
+ * @param cbtype the callback type. This is set to @ref LCB_CALLBACK_SCAN
+ * @param resp the document, or the final response, when lcb_respscan_is_final() is true
+ */
+typedef void (*lcb_SCAN_CALLBACK)(lcb_INSTANCE *instance, int cbtype, const lcb_RESPSCAN *resp);
+
+LIBCOUCHBASE_API lcb_STATUS lcb_respscan_status(const lcb_RESPSCAN *resp);
+LIBCOUCHBASE_API lcb_STATUS lcb_respscan_cookie(const lcb_RESPSCAN *resp, void **cookie);
+LIBCOUCHBASE_API lcb_STATUS lcb_respscan_key(const lcb_RESPSCAN *resp, const char **key, size_t *key_len);
+/** The value is empty, if the scan was created with @ref lcb_cmdscan_ids_only */
+LIBCOUCHBASE_API lcb_STATUS lcb_respscan_value(const lcb_RESPSCAN *resp, const char **value, size_t *value_len);
+LIBCOUCHBASE_API lcb_STATUS lcb_respscan_cas(const lcb_RESPSCAN *resp, uint64_t *cas);
+LIBCOUCHBASE_API lcb_STATUS lcb_respscan_flags(const lcb_RESPSCAN *resp, uint32_t *flags);
+LIBCOUCHBASE_API lcb_STATUS lcb_respscan_expiry(const lcb_RESPSCAN *resp, uint32_t *expiry);
+LIBCOUCHBASE_API lcb_STATUS lcb_respscan_datatype(const lcb_RESPSCAN *resp, uint8_t *datatype);
+LIBCOUCHBASE_API lcb_STATUS lcb_respscan_seqno(const lcb_RESPSCAN *resp, uint64_t *seqno);
+LIBCOUCHBASE_API lcb_STATUS lcb_respscan_vbucket(const lcb_RESPSCAN *resp, uint16_t *vbid);
+LIBCOUCHBASE_API lcb_STATUS lcb_respscan_handle(const lcb_RESPSCAN *resp, lcb_SCAN_HANDLE **handle);
+LIBCOUCHBASE_API int lcb_respscan_is_final(const lcb_RESPSCAN *resp);
+
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdscan_create(lcb_CMDSCAN **cmd);
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdscan_destroy(lcb_CMDSCAN *cmd);
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdscan_callback(lcb_CMDSCAN *cmd, lcb_SCAN_CALLBACK callback);
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdscan_collection(lcb_CMDSCAN *cmd, const char *scope, size_t scope_len,
+                                                   const char *collection, size_t collection_len);
+/**
+ * Scan the documents, which IDs start with the given prefix. This is the
+ * default (with an empty prefix, all the documents of the collection are scanned).
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdscan_prefix(lcb_CMDSCAN *cmd, const char *prefix, size_t prefix_len);
+/**
+ * Scan the documents, which IDs are between `start` and `end` (both inclusive).
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdscan_range(lcb_CMDSCAN *cmd, const char *start, size_t start_len, const char *end,
+                                              size_t end_len);
+/**
+ * Return random sample of the documents instead of the range.
+ *
+ * @param cmd the command
+ * @param limit maximum number of the documents to return
+ * @param seed seed for the random generator of the server, which allows to repeat the sample
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdscan_sampling(lcb_CMDSCAN *cmd, uint64_t limit, uint64_t seed);
+/** Return only IDs and metadata of the documents, without the values */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdscan_ids_only(lcb_CMDSCAN *cmd, int ids_only);
+/** Number of vBuckets, which are scanned concurrently on every KV node (default 2) */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdscan_concurrency(lcb_CMDSCAN *cmd, uint32_t vbuckets_per_node);
+/** Maximum number of documents, which the server returns per round trip (default 50) */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdscan_batch_item_limit(lcb_CMDSCAN *cmd, uint32_t items);
+/** Maximum number of bytes, which the server returns per round trip (default 15000) */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdscan_batch_byte_limit(lcb_CMDSCAN *cmd, uint32_t bytes);
+/**
+ * Continue the range scan, which has been interrupted. The token is returned
+ * by @ref lcb_scan_resume_token, the rest of the command must be the same as
+ * in the original scan.
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdscan_resume_token(lcb_CMDSCAN *cmd, const char *token, size_t token_len);
+/** Timeout for every KV request of the scan */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdscan_timeout(lcb_CMDSCAN *cmd, uint32_t timeout);
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdscan_handle(lcb_CMDSCAN *cmd, lcb_SCAN_HANDLE **handle);
+
+LIBCOUCHBASE_API lcb_STATUS lcb_scan(lcb_INSTANCE *instance, void *cookie, const lcb_CMDSCAN *cmd);
+/**
+ * Stop the scan. The callback will not be invoked anymore, not even with
+ * the final response.
+ *
+ * The server-side scans, which wait for the next batch, are cancelled
+ * immediately. The scans with the create or continue request in flight are
+ * cancelled as soon as the request completes.
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_scan_cancel(lcb_INSTANCE *instance, lcb_SCAN_HANDLE *handle);
+/**
+ * Get the progress of the range scan, which might be passed to
+ * @ref lcb_cmdscan_resume_token to continue the scan later. Documents, which
+ * have been delivered to the callback before this call, will not be returned
+ * again. The token is valid until the next call of this function, or until
+ * the scan is completed.
+ *
+ * @return LCB_ERR_UNSUPPORTED_OPERATION for the sampling scans
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_scan_resume_token(lcb_SCAN_HANDLE *handle, const char **token, size_t *token_len);
+/** @} */
+
 /* @ingroup lcb-public-api
  * @defgroup lcb-subdoc Sub-Document API
  * @brief Experimental in-document API access
@@ -3308,6 +3738,19 @@ LIBCOUCHBASE_API lcb_STATUS lcb_subdocspecs_remove(lcb_SUBDOCSPECS *operations,
                                                    const char *path, size_t path_len);
 LIBCOUCHBASE_API lcb_STATUS lcb_subdocspecs_get_count(lcb_SUBDOCSPECS *operations, size_t index, uint32_t flags,
                                                       const char *path, size_t path_len);
+/**
+ * Encode the specs into their wire representation once, so that commands
+ * which use them do not have to validate and encode every path again.
+ *
+ * lcb_cmdsubdoc_specs() shares the encoded form with the command instead of
+ * copying the individual specs. Modifying any spec afterwards discards the
+ * encoded form, and this function has to be called again to restore it.
+ *
+ * @param operations the specs to compile
+ * @return LCB_SUCCESS, or the error which lcb_subdoc() would return for the specs
+ * @uncommitted
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_subdocspecs_compile(lcb_SUBDOCSPECS *operations);
 
 typedef struct lcb_CMDSUBDOC_ lcb_CMDSUBDOC;
 
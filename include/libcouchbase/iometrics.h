@@ -62,6 +62,23 @@ typedef struct lcb_SERVERMETRICS_st {
 
     /** Number of NOT_MY_VBUCKET replies received */
     lcb_SIZE packets_nmv;
+
+    /** Number of writes issued to the socket when flushing the send queue */
+    lcb_SIZE flush_writes;
+
+    /** Number of bytes passed to these writes. Divide by flush_writes for the average write size */
+    lcb_SIZE flush_bytes;
+
+    /** Number of bytes copied to merge small adjacent buffers into a single write buffer */
+    lcb_SIZE flush_coalesced_bytes;
+
+    /**
+     * Latency histograms of the packets, see @ref LCB_CNTL_PIPELINE_LATENCY.
+     * NULL unless the setting is enabled.
+     */
+    struct lcb_histogram_st *queue_latency;
+    struct lcb_histogram_st *wire_latency;
+    struct lcb_histogram_st *server_latency;
 } lcb_SERVERMETRICS;
 
 typedef struct lcb_METRICS_st {
@@ -70,6 +87,18 @@ typedef struct lcb_METRICS_st {
 
     /** Number of times a packet entered the retry queue */
     lcb_SIZE packets_retried;
+
+    /** Number of host names resolved for new connections (including cache hits) */
+    lcb_SIZE dns_lookups;
+
+    /** Number of host names found in the cache (see @ref LCB_CNTL_DNS_CACHE_TTL) */
+    lcb_SIZE dns_cache_hits;
+
+    /**
+     * Time spent resolving the host names which were not in the cache, or
+     * NULL if nothing has been resolved yet. See lcb_histogram_read()
+     */
+    struct lcb_histogram_st *dns_latency;
 } lcb_METRICS;
 
 #ifdef __cplusplus
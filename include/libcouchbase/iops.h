@@ -346,6 +346,17 @@ typedef int (*lcb_ioE_chkclosed_fn)(lcb_io_opt_t iops, lcb_socket_t sock, int fl
 /** Enable/Disable TCP Keepalive */
 #define LCB_IO_CNTL_TCP_KEEPALIVE 2
 
+/**
+ * Check whether the recv/send routines of the table perform plain BSD socket
+ * I/O on the descriptor, so that the library may let other code (e.g. OpenSSL)
+ * read and write the descriptor directly. Use it with @ref LCB_IO_CNTL_GET and
+ * the `const lcb_bsd_procs *` of the table as the argument. The call succeeds
+ * only if the routines are the ones of `bsdio-inl.c`.
+ *
+ * @uncommitted
+ */
+#define LCB_IO_CNTL_PLAIN_SOCKET_IO 3
+
 /**
  * @brief Execute a specificied operation on a socket.
  * @param iops The iops
@@ -294,6 +294,16 @@ static int cntl_impl(lcb_io_opt_t io, lcb_socket_t sock, int mode, int option, v
             return cntl_getset_impl(io, sock, mode, IPPROTO_TCP, TCP_NODELAY, sizeof(int), arg);
         case LCB_IO_CNTL_TCP_KEEPALIVE:
             return cntl_getset_impl(io, sock, mode, SOL_SOCKET, SO_KEEPALIVE, sizeof(int), arg);
+        case LCB_IO_CNTL_PLAIN_SOCKET_IO: {
+            /* the table must not have been wrapped or patched */
+            const lcb_bsd_procs *procs = (const lcb_bsd_procs *)arg;
+            if (mode == LCB_IO_CNTL_GET && procs && procs->recv == recv_impl && procs->recvv == recvv_impl &&
+                procs->send == send_impl && procs->sendv == sendv_impl) {
+                return 0;
+            }
+            LCB_IOPS_ERRNO(io) = ENOTSUP;
+            return -1;
+        }
         default:
             LCB_IOPS_ERRNO(io) = ENOTSUP;
             return -1;
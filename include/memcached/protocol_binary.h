@@ -211,6 +211,19 @@ typedef enum {
     PROTOCOL_BINARY_RESPONSE_SYNC_WRITE_AMBIGUOUS = 0xa3,
     PROTOCOL_BINARY_RESPONSE_SYNC_WRITE_RE_COMMIT_IN_PROGRESS = 0xa4,
 
+    /*
+     * Range scan specific responses.
+     */
+
+    /** The range scan has been cancelled */
+    PROTOCOL_BINARY_RESPONSE_RANGE_SCAN_CANCELLED = 0xa5,
+    /** The range scan continue has reached its limits, more items are available */
+    PROTOCOL_BINARY_RESPONSE_RANGE_SCAN_MORE = 0xa6,
+    /** The range scan has returned all the items and has been closed */
+    PROTOCOL_BINARY_RESPONSE_RANGE_SCAN_COMPLETE = 0xa7,
+    /** The vBucket UUID does not match the snapshot requirements of the range scan */
+    PROTOCOL_BINARY_RESPONSE_RANGE_SCAN_VB_UUID_NOT_EQUAL = 0xa8,
+
     /*
      * Sub-document specific responses.
      */
@@ -395,6 +408,11 @@ typedef enum {
     /* Subdoc additions for Spock: */
     PROTOCOL_BINARY_CMD_SUBDOC_GET_COUNT = 0xd2,
 
+    /* Range scans */
+    PROTOCOL_BINARY_CMD_RANGE_SCAN_CREATE = 0xda,
+    PROTOCOL_BINARY_CMD_RANGE_SCAN_CONTINUE = 0xdb,
+    PROTOCOL_BINARY_CMD_RANGE_SCAN_CANCEL = 0xdc,
+
     /* get error code mappings */
     PROTOCOL_BINARY_CMD_GET_ERROR_MAP = 0xfe,
 
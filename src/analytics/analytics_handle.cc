@@ -31,105 +31,6 @@
 #define LOGARGS(req, lvl) (req)->instance_->settings, "analyticsh", LCB_LOG_##lvl, __FILE__, __LINE__
 #define LOGARGS2(req, lvl) (instance)->settings, "analyticsh", LCB_LOG_##lvl, __FILE__, __LINE__
 
-static void doc_callback(lcb_INSTANCE *, int, const lcb_RESPSTORE *rb)
-{
-    lcb::docreq::DocRequest *dreq;
-    lcb_respstore_cookie(rb, reinterpret_cast<void **>(&dreq));
-    lcb::docreq::Queue *q = dreq->parent;
-
-    q->ref();
-
-    q->n_awaiting_response--;
-    dreq->ready = 1;
-
-    q->check();
-
-    q->unref();
-}
-
-static lcb_STATUS cb_op_schedule(lcb::docreq::Queue *q, lcb::docreq::DocRequest *dreq)
-{
-    auto *req = reinterpret_cast<IngestRequest *>(dreq);
-    lcb_ANALYTICS_HANDLE_ *areq = req->request_;
-
-    lcb_STORE_OPERATION op = LCB_STORE_UPSERT;
-    switch (areq->ingest_options().method) {
-        case LCB_INGEST_METHOD__MAX:
-        case LCB_INGEST_METHOD_NONE:
-            return LCB_ERR_INVALID_ARGUMENT;
-        case LCB_INGEST_METHOD_INSERT:
-            op = LCB_STORE_INSERT;
-            break;
-        case LCB_INGEST_METHOD_REPLACE:
-            op = LCB_STORE_REPLACE;
-            break;
-        case LCB_INGEST_METHOD_UPSERT:
-            op = LCB_STORE_UPSERT;
-            break;
-    }
-
-    lcb_INGEST_PARAM param;
-    param.method = areq->ingest_options().method;
-    param.row = req->row.c_str();
-    param.row_len = req->row.size();
-    param.cookie = areq->cookie();
-    switch (areq->ingest_options().data_converter(q->instance, &param)) {
-        case LCB_INGEST_STATUS_OK:
-            /* continue */
-            break;
-        case LCB_INGEST_STATUS_IGNORE:
-            /* assume that the user hasn't allocated anything */
-            return LCB_SUCCESS;
-        default:
-            return LCB_ERR_SDK_INTERNAL;
-    }
-    lcb_CMDSTORE *cmd;
-    lcb_cmdstore_create(&cmd, op);
-    lcb_cmdstore_expiry(cmd, areq->ingest_options().exptime);
-    lcb_cmdstore_key(cmd, param.id, param.id_len);
-    lcb_cmdstore_parent_span(cmd, areq->span());
-    if (param.out) {
-        lcb_cmdstore_value(cmd, param.out, param.out_len);
-    } else {
-        lcb_cmdstore_value(cmd, req->row.c_str(), req->row.size());
-    }
-    dreq->callback = (lcb_RESPCALLBACK)doc_callback;
-    cmd->treat_cookie_as_callback(true);
-    lcb_STATUS err = lcb_store(q->instance, &dreq->callback, cmd);
-    lcb_cmdstore_destroy(cmd);
-    if (param.id_dtor && param.id) {
-        param.id_dtor(param.id);
-    }
-    if (param.out_dtor && param.out) {
-        param.out_dtor(param.out);
-    }
-    return err;
-}
-
-static void cb_doc_ready(lcb::docreq::Queue *q, lcb::docreq::DocRequest *req_base)
-{
-    auto *req = (IngestRequest *)req_base;
-    /* TODO: check if we should ignore errors */
-    delete req;
-
-    if (q->parent) {
-        reinterpret_cast<lcb_ANALYTICS_HANDLE_ *>(q->parent)->unref();
-    }
-}
-
-static void cb_docq_throttle(lcb::docreq::Queue *q, int enabled)
-{
-    const auto *req = reinterpret_cast<const lcb_ANALYTICS_HANDLE_ *>(q->parent);
-    if (req == nullptr || req->http_request() == nullptr) {
-        return;
-    }
-    if (enabled) {
-        req->http_request()->pause();
-    } else {
-        req->http_request()->resume();
-    }
-}
-
 static void chunk_callback(lcb_INSTANCE * /* instance */, int /* cbtype */, const lcb_RESPHTTP *resp)
 {
     lcb_ANALYTICS_HANDLE_ *req = nullptr;
@@ -156,6 +57,9 @@ lcb_ANALYTICS_HANDLE_::lcb_ANALYTICS_HANDLE_(lcb_INSTANCE *obj, void *user_cooki
     : parser_(new lcb::jsparse::Parser(lcb::jsparse::Parser::MODE_ANALYTICS, this)), cookie_(user_cookie),
       callback_(cmd->callback()), instance_(obj), ingest_options_(cmd->ingest_options())
 {
+    if (cmd->columns()) {
+        columns_.reset(new lcb_COLUMN_BATCH(cmd->columns()));
+    }
 
     std::string encoded = Json::FastWriter().write(cmd->root());
 
@@ -229,12 +133,7 @@ lcb_ANALYTICS_HANDLE_::lcb_ANALYTICS_HANDLE_(lcb_INSTANCE *obj, void *user_cooki
     }
 
     if (ingest_options().method != LCB_INGEST_METHOD_NONE) {
-        document_queue_ = new lcb::docreq::Queue(instance_);
-        document_queue_->parent = this;
-        document_queue_->cb_schedule = cb_op_schedule;
-        document_queue_->cb_ready = cb_doc_ready;
-        document_queue_->cb_throttle = cb_docq_throttle;
-        // TODO: docq->max_pending_response;
+        ingest_queue_.reset(new lcb::analytics::IngestQueue(instance_, this, ingest_options_));
         lcb_aspend_add(&instance_->pendops, LCB_PENDTYPE_COUNTER, nullptr);
     }
     if (cmd->want_impersonation()) {
@@ -384,6 +283,9 @@ void lcb_ANALYTICS_HANDLE_::invoke_row(lcb_RESPANALYTICS *resp, bool is_last)
     if (is_last) {
         lcb_IOV meta_buf;
         resp->rflags |= LCB_RESP_F_FINAL;
+        if (ingest_queue_) {
+            resp->ingest_stats = &ingest_queue_->stats();
+        }
         resp->ctx.rc = last_error_;
         parser_->get_postmortem(meta_buf);
         resp->row = static_cast<const char *>(meta_buf.iov_base);
@@ -490,9 +392,8 @@ lcb_ANALYTICS_HANDLE_::~lcb_ANALYTICS_HANDLE_()
     delete parser_;
     parser_ = nullptr;
 
-    if (document_queue_ != nullptr) {
-        document_queue_->parent = nullptr;
-        document_queue_->unref();
+    if (ingest_queue_) {
+        ingest_queue_.reset();
         lcb_aspend_del(&instance_->pendops, LCB_PENDTYPE_COUNTER, nullptr);
     }
 }
@@ -21,21 +21,14 @@
 #include <cstddef>
 #include <cstdint>
 #include <chrono>
+#include <memory>
 
 #include <jsparse/parser.h>
 
-#include "docreq/docreq.h"
+#include "ingest_queue.hh"
 
 #include "capi/cmd_analytics.hh"
 
-/**
- * @private
- */
-struct IngestRequest : lcb::docreq::DocRequest {
-    lcb_ANALYTICS_HANDLE *request_{nullptr};
-    std::string row;
-};
-
 /**
  * @private
  */
@@ -104,12 +97,12 @@ struct lcb_ANALYTICS_HANDLE_ : lcb::jsparse::Parser::Actions {
         resp.row = static_cast<const char *>(row.row.iov_base);
         resp.nrow = row.row.iov_len;
         rows_number_++;
-        if (ingest_options_.method != LCB_INGEST_METHOD_NONE) {
-            auto *req = new IngestRequest();
-            req->request_ = this;
-            req->row.assign(static_cast<const char *>(row.row.iov_base), row.row.iov_len);
-            document_queue_->add(req);
-            ref();
+        if (ingest_queue_) {
+            ingest_queue_->add(static_cast<const char *>(row.row.iov_base), row.row.iov_len);
+        }
+        if (columns_) {
+            append_columns(row.row);
+            return;
         }
         invoke_row(&resp, false);
     }
@@ -157,8 +150,8 @@ struct lcb_ANALYTICS_HANDLE_ : lcb::jsparse::Parser::Actions {
     {
         if (callback_ != nullptr) {
             callback_ = nullptr;
-            if (document_queue_) {
-                document_queue_->cancel();
+            if (ingest_queue_) {
+                ingest_queue_->cancel();
             }
         }
         return LCB_SUCCESS;
@@ -194,10 +187,40 @@ struct lcb_ANALYTICS_HANDLE_ : lcb::jsparse::Parser::Actions {
             const char *body = nullptr;
             std::size_t body_len = 0;
             lcb_resphttp_body(http_response_, &body, &body_len);
+            chunk_begin_ = body;
+            chunk_end_ = body + body_len;
             parser_->feed(body, body_len);
+            // the rows might reference the body, which is valid only during this call
+            flush_columns();
+            chunk_begin_ = chunk_end_ = nullptr;
+        }
+    }
+
+    /**
+     * Decodes the row into the columnar batch
+     */
+    void append_columns(const lcb_IOV &row)
+    {
+        const char *data = static_cast<const char *>(row.iov_base);
+        bool stable = data >= chunk_begin_ && data + row.iov_len <= chunk_end_;
+        if (!columns_->append(data, row.iov_len, stable)) {
+            last_error_ = LCB_ERR_PROTOCOL_ERROR;
+        } else if (columns_->full()) {
+            flush_columns();
         }
     }
 
+    void flush_columns()
+    {
+        if (columns_ == nullptr || columns_->rows() == 0) {
+            return;
+        }
+        lcb_RESPANALYTICS resp{};
+        resp.columns = columns_.get();
+        invoke_row(&resp, false);
+        columns_->clear();
+    }
+
     bool has_error() const
     {
         return last_error_ != LCB_SUCCESS;
@@ -238,6 +261,11 @@ struct lcb_ANALYTICS_HANDLE_ : lcb::jsparse::Parser::Actions {
     const lcb_RESPHTTP *http_response_{nullptr};
     lcb_HTTP_HANDLE *http_request_{nullptr};
     lcb::jsparse::Parser *parser_{nullptr};
+    /** Rows decoded into columns, if the application has requested them */
+    std::unique_ptr<lcb_COLUMN_BATCH> columns_{};
+    /** HTTP body, which is being parsed at the moment */
+    const char *chunk_begin_{nullptr};
+    const char *chunk_end_{nullptr};
     void *cookie_{nullptr};
     lcb_ANALYTICS_CALLBACK callback_{nullptr};
     lcb_INSTANCE *instance_{nullptr};
@@ -264,7 +292,7 @@ struct lcb_ANALYTICS_HANDLE_ : lcb::jsparse::Parser::Actions {
     std::string deferred_handle_{};
 
     lcb_INGEST_OPTIONS ingest_options_{};
-    lcb::docreq::Queue *document_queue_{nullptr};
+    std::unique_ptr<lcb::analytics::IngestQueue> ingest_queue_{};
     unsigned refcount{1};
 
     lcbtrace_SPAN *parent_span_{nullptr};
@@ -0,0 +1,406 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "internal.h"
+#include "http/http-priv.h"
+
+#include "ingest_queue.hh"
+#include "analytics_handle.hh"
+#include "capi/cmd_store.hh"
+
+#define LOGARGS(instance, lvl) (instance)->settings, "ingest", LCB_LOG_##lvl, __FILE__, __LINE__
+
+using namespace lcb::analytics;
+
+/** Maximum number of rows converted in one go */
+static const std::size_t convert_batch_size = 256;
+
+ConverterPool::ConverterPool(std::size_t nthreads)
+{
+    for (std::size_t ii = 0; ii < nthreads; ii++) {
+        threads_.emplace_back(&ConverterPool::worker, this);
+    }
+}
+
+ConverterPool::~ConverterPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    work_cv_.notify_all();
+    for (auto &thread : threads_) {
+        thread.join();
+    }
+}
+
+void ConverterPool::process()
+{
+    std::size_t index;
+    while ((index = next_++) < total_) {
+        (*job_)(index);
+    }
+}
+
+void ConverterPool::run(std::size_t total, const std::function<void(std::size_t)> &fn)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        job_ = &fn;
+        total_ = total;
+        next_ = 0;
+        active_ = threads_.size();
+        generation_++;
+    }
+    work_cv_.notify_all();
+    process();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this] { return active_ == 0; });
+    job_ = nullptr;
+}
+
+void ConverterPool::worker()
+{
+    std::uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        work_cv_.wait(lock, [this, seen] { return stop_ || generation_ != seen; });
+        if (stop_) {
+            return;
+        }
+        seen = generation_;
+        lock.unlock();
+        process();
+        lock.lock();
+        if (--active_ == 0) {
+            done_cv_.notify_one();
+        }
+    }
+}
+
+struct IngestQueue::Item {
+    /* Callback. Must be first, as the cookie of the store operation is treated as callback */
+    lcb_RESPCALLBACK callback{reinterpret_cast<lcb_RESPCALLBACK>(IngestQueue::store_callback)};
+    IngestQueue *queue{nullptr};
+    std::string row{};
+    lcb_INGEST_PARAM param{};
+    lcb_INGEST_STATUS status{LCB_INGEST_STATUS_OK};
+    int node{-1};
+    std::size_t attempts{0};
+
+    ~Item()
+    {
+        if (param.id_dtor && param.id) {
+            param.id_dtor(param.id);
+        }
+        if (param.out_dtor && param.out) {
+            param.out_dtor(param.out);
+        }
+    }
+};
+
+IngestQueue::IngestQueue(lcb_INSTANCE *instance, lcb_ANALYTICS_HANDLE_ *parent, const lcb_INGEST_OPTIONS &options)
+    : instance_(instance), parent_(parent), options_(options),
+      timer_(lcbio_timer_new(instance->iotable, this, pump_handler))
+{
+    // the default converter is cheap, and it is not thread safe
+    if (options_.converter_threads > 0 && options_.data_converter != default_data_converter) {
+        pool_.reset(new ConverterPool(options_.converter_threads));
+    }
+}
+
+IngestQueue::~IngestQueue()
+{
+    // every row holds the reference to the parent, so nothing should be left here
+    lcb_assert(outstanding_ == 0);
+    lcbio_timer_destroy(timer_);
+}
+
+void IngestQueue::add(const char *row, std::size_t row_len)
+{
+    auto *item = new Item();
+    item->queue = this;
+    item->row.assign(row, row_len);
+    if (stats_.rows++ == 0) {
+        first_row_ = gethrtime();
+    }
+    outstanding_++;
+    parent_->ref();
+    if (cancelled_) {
+        finish(item, LCB_ERR_REQUEST_CANCELED);
+        return;
+    }
+    unconverted_.push_back(item);
+    if (!lcbio_timer_armed(timer_)) {
+        // the rows of the current chunk will be converted in one batch
+        lcbio_async_signal(timer_);
+    }
+    update_throttle();
+}
+
+void IngestQueue::cancel()
+{
+    if (cancelled_) {
+        return;
+    }
+    cancelled_ = true;
+    parent_->ref();
+    while (!unconverted_.empty()) {
+        Item *item = unconverted_.front();
+        unconverted_.pop_front();
+        finish(item, LCB_ERR_REQUEST_CANCELED);
+    }
+    for (int node = -1; node < static_cast<int>(nodes_.size()); node++) {
+        auto &queue = node_queue(node);
+        while (!queue.empty()) {
+            Item *item = queue.front();
+            queue.pop_front();
+            ready_--;
+            finish(item, LCB_ERR_REQUEST_CANCELED);
+        }
+    }
+    update_throttle();
+    parent_->unref();
+}
+
+void IngestQueue::pump_handler(void *arg)
+{
+    static_cast<IngestQueue *>(arg)->pump();
+}
+
+void IngestQueue::pump()
+{
+    // finishing the rows might release the last reference to the parent, which owns this queue
+    lcb_ANALYTICS_HANDLE_ *parent = parent_;
+    parent->ref();
+    convert_batch();
+    dispatch();
+    if (!unconverted_.empty()) {
+        lcbio_async_signal(timer_);
+    }
+    update_throttle();
+    parent->unref();
+}
+
+void IngestQueue::convert(Item *item)
+{
+    item->param.method = options_.method;
+    item->param.row = item->row.c_str();
+    item->param.row_len = item->row.size();
+    item->param.cookie = parent_->cookie();
+    item->status = options_.data_converter(instance_, &item->param);
+}
+
+void IngestQueue::convert_batch()
+{
+    std::vector<Item *> batch;
+    std::size_t size = std::min(unconverted_.size(), convert_batch_size);
+    batch.reserve(size);
+    for (std::size_t ii = 0; ii < size; ii++) {
+        batch.push_back(unconverted_.front());
+        unconverted_.pop_front();
+    }
+
+    if (pool_ && batch.size() > 1) {
+        pool_->run(batch.size(), [this, &batch](std::size_t index) { convert(batch[index]); });
+    } else {
+        for (auto *item : batch) {
+            convert(item);
+        }
+    }
+
+    for (auto *item : batch) {
+        switch (item->status) {
+            case LCB_INGEST_STATUS_OK:
+                break;
+            case LCB_INGEST_STATUS_IGNORE:
+                stats_.ignored++;
+                finish(item, LCB_SUCCESS);
+                continue;
+            default:
+                finish(item, LCB_ERR_SDK_INTERNAL);
+                continue;
+        }
+        if (item->param.id == nullptr || item->param.id_len == 0) {
+            finish(item, LCB_ERR_INVALID_ARGUMENT);
+            continue;
+        }
+        item->node = node_of(item);
+        node_queue(item->node).push_back(item);
+        ready_++;
+    }
+}
+
+int IngestQueue::node_of(const Item *item) const
+{
+    const mc_CMDQUEUE *cq = &instance_->cmdq;
+    if (cq->config == nullptr) {
+        return -1;
+    }
+    int vbid = 0, idx = -1;
+    lcb_KEYBUF key{};
+    key.type = LCB_KV_COPY;
+    key.contig.bytes = item->param.id;
+    key.contig.nbytes = item->param.id_len;
+    mcreq_map_key(const_cast<mc_CMDQUEUE *>(cq), &key, MCREQ_PKT_BASESIZE, &vbid, &idx);
+    return idx;
+}
+
+std::deque<IngestQueue::Item *> &IngestQueue::node_queue(int node)
+{
+    if (node < 0) {
+        return unmapped_;
+    }
+    if (static_cast<std::size_t>(node) >= nodes_.size()) {
+        nodes_.resize(node + 1);
+        inflight_.resize(node + 1, 0);
+    }
+    return nodes_[node];
+}
+
+std::size_t &IngestQueue::node_inflight(int node)
+{
+    return node < 0 ? unmapped_inflight_ : inflight_[node];
+}
+
+void IngestQueue::dispatch()
+{
+    lcb_sched_enter(instance_);
+    for (int node = -1; node < static_cast<int>(nodes_.size()); node++) {
+        auto &queue = node_queue(node);
+        std::size_t &inflight = node_inflight(node);
+        while (!queue.empty() && inflight < options_.window) {
+            Item *item = queue.front();
+            queue.pop_front();
+            ready_--;
+            lcb_STATUS rc = send(item);
+            if (rc == LCB_SUCCESS) {
+                inflight++;
+            } else {
+                finish(item, rc);
+            }
+        }
+    }
+    lcb_sched_leave(instance_);
+    lcb_sched_flush(instance_);
+}
+
+lcb_STATUS IngestQueue::send(Item *item)
+{
+    lcb_STORE_OPERATION op;
+    switch (options_.method) {
+        case LCB_INGEST_METHOD_INSERT:
+            op = LCB_STORE_INSERT;
+            break;
+        case LCB_INGEST_METHOD_REPLACE:
+            op = LCB_STORE_REPLACE;
+            break;
+        case LCB_INGEST_METHOD_UPSERT:
+            op = LCB_STORE_UPSERT;
+            break;
+        default:
+            return LCB_ERR_INVALID_ARGUMENT;
+    }
+
+    lcb_CMDSTORE *cmd;
+    lcb_cmdstore_create(&cmd, op);
+    lcb_cmdstore_expiry(cmd, options_.exptime);
+    lcb_cmdstore_key(cmd, item->param.id, item->param.id_len);
+    lcb_cmdstore_parent_span(cmd, parent_->span());
+    if (item->param.out) {
+        lcb_cmdstore_value(cmd, item->param.out, item->param.out_len);
+    } else {
+        lcb_cmdstore_value(cmd, item->row.c_str(), item->row.size());
+    }
+    cmd->treat_cookie_as_callback(true);
+    item->attempts++;
+    lcb_STATUS rc = lcb_store(instance_, &item->callback, cmd);
+    lcb_cmdstore_destroy(cmd);
+    return rc;
+}
+
+void IngestQueue::store_callback(lcb_INSTANCE *, int, const lcb_RESPSTORE *resp)
+{
+    Item *item;
+    lcb_respstore_cookie(resp, reinterpret_cast<void **>(&item));
+    item->queue->completed(item, resp);
+}
+
+void IngestQueue::completed(Item *item, const lcb_RESPSTORE *resp)
+{
+    lcb_ANALYTICS_HANDLE_ *parent = parent_;
+    parent->ref();
+
+    node_inflight(item->node)--;
+
+    lcb_STATUS rc = lcb_respstore_status(resp);
+    bool transient = rc == LCB_ERR_TEMPORARY_FAILURE || rc == LCB_ERR_NO_MATCHING_SERVER;
+    if (transient && !cancelled_ && item->attempts < max_attempts) {
+        stats_.retries++;
+        item->node = node_of(item);
+        node_queue(item->node).push_front(item);
+        ready_++;
+    } else {
+        if (rc != LCB_SUCCESS) {
+            lcb_log(LOGARGS(instance_, DEBUG), "Failed to store analytics row after %u attempt(s): %s",
+                    static_cast<unsigned>(item->attempts), lcb_strerror_short(rc));
+        }
+        finish(item, rc);
+    }
+    if (!lcbio_timer_armed(timer_)) {
+        lcbio_async_signal(timer_);
+    }
+    parent->unref();
+}
+
+void IngestQueue::finish(Item *item, lcb_STATUS rc)
+{
+    if (rc == LCB_SUCCESS) {
+        if (item->status == LCB_INGEST_STATUS_OK) {
+            stats_.stored++;
+        }
+    } else {
+        stats_.failed++;
+    }
+    delete item;
+    outstanding_--;
+    hrtime_t now = gethrtime();
+    stats_.elapsed_us = LCB_NS2US(now - first_row_);
+    if (stats_.elapsed_us > 0) {
+        stats_.rows_per_second =
+            static_cast<double>(stats_.stored + stats_.ignored + stats_.failed) * 1e6 / stats_.elapsed_us;
+    }
+    parent_->unref();
+}
+
+void IngestQueue::update_throttle()
+{
+    lcb_HTTP_HANDLE *http = parent_->http_request();
+    std::size_t high_watermark = std::max<std::size_t>(options_.window * (nodes_.size() + 1) * 2, convert_batch_size);
+    if (!throttled_ && backlog() >= high_watermark) {
+        throttled_ = true;
+        if (http != nullptr) {
+            http->pause();
+        }
+    } else if (throttled_ && backlog() <= high_watermark / 2) {
+        throttled_ = false;
+        if (http != nullptr) {
+            http->resume();
+        }
+    }
+}
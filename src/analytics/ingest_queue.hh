@@ -0,0 +1,151 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_ANALYTICS_INGEST_QUEUE_HH
+#define LCB_ANALYTICS_INGEST_QUEUE_HH
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <lcbio/lcbio.h>
+#include "capi/cmd_analytics.hh"
+
+namespace lcb
+{
+namespace analytics
+{
+
+/**
+ * Fixed set of threads, which run the same function over the range of
+ * indexes. The calling thread participates too, and run() returns only when
+ * the whole range has been processed.
+ */
+class ConverterPool
+{
+  public:
+    explicit ConverterPool(std::size_t nthreads);
+    ~ConverterPool();
+
+    ConverterPool(const ConverterPool &) = delete;
+    ConverterPool &operator=(const ConverterPool &) = delete;
+
+    void run(std::size_t total, const std::function<void(std::size_t)> &fn);
+
+    std::size_t size() const
+    {
+        return threads_.size();
+    }
+
+  private:
+    void worker();
+    void process();
+
+    std::mutex mutex_{};
+    std::condition_variable work_cv_{};
+    std::condition_variable done_cv_{};
+    const std::function<void(std::size_t)> *job_{nullptr};
+    std::size_t total_{0};
+    std::atomic<std::size_t> next_{0};
+    std::size_t active_{0};
+    std::uint64_t generation_{0};
+    bool stop_{false};
+    std::vector<std::thread> threads_{};
+};
+
+/**
+ * Stores analytics rows into KV.
+ *
+ * The rows are converted in batches (on the worker threads, if configured),
+ * and the store operations are scheduled in batches as well. Every KV node
+ * has its own window of operations in flight, so that a slow node does not
+ * stall the rows which belong to the others. When too many rows are waiting,
+ * the HTTP stream of the analytics response is paused.
+ */
+class IngestQueue
+{
+  public:
+    IngestQueue(lcb_INSTANCE *instance, lcb_ANALYTICS_HANDLE_ *parent, const lcb_INGEST_OPTIONS &options);
+    ~IngestQueue();
+
+    void add(const char *row, std::size_t row_len);
+    void cancel();
+
+    const lcb_INGEST_STATS &stats() const
+    {
+        return stats_;
+    }
+
+    /** How many rows are waiting for conversion or for the free slot in the window */
+    std::size_t backlog() const
+    {
+        return unconverted_.size() + ready_;
+    }
+
+    static const std::size_t max_attempts = 3;
+
+  private:
+    struct Item;
+
+    static void store_callback(lcb_INSTANCE *instance, int cbtype, const lcb_RESPSTORE *resp);
+    static void pump_handler(void *arg);
+
+    void pump();
+    void convert(Item *item);
+    void convert_batch();
+    void dispatch();
+    lcb_STATUS send(Item *item);
+    void completed(Item *item, const lcb_RESPSTORE *resp);
+    void finish(Item *item, lcb_STATUS rc);
+    void update_throttle();
+    int node_of(const Item *item) const;
+    std::deque<Item *> &node_queue(int node);
+    std::size_t &node_inflight(int node);
+
+    lcb_INSTANCE *instance_;
+    lcb_ANALYTICS_HANDLE_ *parent_;
+    lcb_INGEST_OPTIONS options_;
+    lcbio_pTIMER timer_;
+    std::unique_ptr<ConverterPool> pool_{};
+
+    std::deque<Item *> unconverted_{};
+    /** Converted rows, grouped by the KV node */
+    std::vector<std::deque<Item *>> nodes_{};
+    std::vector<std::size_t> inflight_{};
+    /** Converted rows, which keys cannot be mapped to the node at the moment */
+    std::deque<Item *> unmapped_{};
+    std::size_t unmapped_inflight_{0};
+    std::size_t ready_{0};
+    std::size_t outstanding_{0};
+    bool throttled_{false};
+    bool cancelled_{false};
+
+    lcb_INGEST_STATS stats_{};
+    hrtime_t first_row_{0};
+};
+} // namespace analytics
+} // namespace lcb
+
+#endif
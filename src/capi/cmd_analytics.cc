@@ -81,6 +81,15 @@ LIBCOUCHBASE_API lcb_STATUS lcb_respanalytics_cookie(const lcb_RESPANALYTICS *re
     return LCB_SUCCESS;
 }
 
+LIBCOUCHBASE_API lcb_STATUS lcb_respanalytics_columns(const lcb_RESPANALYTICS *resp, const lcb_COLUMN_BATCH **batch)
+{
+    if (resp->columns == nullptr) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    *batch = resp->columns;
+    return LCB_SUCCESS;
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_respanalytics_http_response(const lcb_RESPANALYTICS *resp, const lcb_RESPHTTP **http)
 {
     *http = resp->htresp;
@@ -244,6 +253,11 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdanalytics_ingest_options(lcb_CMDANALYTICS *cm
     return cmd->ingest_options(options);
 }
 
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdanalytics_columnar(lcb_CMDANALYTICS *cmd, const lcb_COLUMN_SCHEMA *schema)
+{
+    return cmd->columnar(schema);
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdanalytics_on_behalf_of(lcb_CMDANALYTICS *cmd, const char *data, size_t data_len)
 {
     return cmd->on_behalf_of(std::string(data, data_len));
@@ -286,6 +300,30 @@ LIBCOUCHBASE_API lcb_STATUS lcb_ingest_options_data_converter(lcb_INGEST_OPTIONS
     return LCB_SUCCESS;
 }
 
+LIBCOUCHBASE_API lcb_STATUS lcb_ingest_options_window(lcb_INGEST_OPTIONS *options, uint32_t operations)
+{
+    if (operations == 0) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    options->window = operations;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_ingest_options_converter_threads(lcb_INGEST_OPTIONS *options, uint32_t threads)
+{
+    options->converter_threads = threads;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_respanalytics_ingest_stats(const lcb_RESPANALYTICS *resp, lcb_INGEST_STATS *stats)
+{
+    if (resp->ingest_stats == nullptr) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    *stats = *resp->ingest_stats;
+    return LCB_SUCCESS;
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_respanalytics_deferred_handle_extract(const lcb_RESPANALYTICS *resp,
                                                                       lcb_DEFERRED_HANDLE **handle)
 {
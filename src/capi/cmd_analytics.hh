@@ -22,8 +22,10 @@
 #include <cstdint>
 #include <string>
 #include <chrono>
+#include <memory>
 
 #include "contrib/lcb-jsoncpp/lcb-jsoncpp.h"
+#include "jsparse/columnar.h"
 
 struct lcb_INGEST_PARAM_ {
     lcb_INGEST_METHOD method;
@@ -48,6 +50,10 @@ struct lcb_INGEST_OPTIONS_ {
     std::uint32_t exptime{0};
     bool ignore_errors{false};
     lcb_INGEST_DATACONVERTER_CALLBACK data_converter{default_data_converter};
+    /** Maximum number of store operations in flight for each KV node */
+    std::uint32_t window{16};
+    /** Number of threads for data_converter, zero means the rows are converted on the IO thread */
+    std::uint32_t converter_threads{0};
 };
 
 /**
@@ -79,6 +85,9 @@ struct lcb_RESPANALYTICS_ {
     std::size_t nrow;
     const lcb_RESPHTTP *htresp;
     lcb_ANALYTICS_HANDLE *handle;
+    const lcb_COLUMN_BATCH *columns;
+    /** Statistics of the ingestion (only for the final response) */
+    const lcb_INGEST_STATS *ingest_stats;
 };
 
 struct lcb_DEFERRED_HANDLE_ {
@@ -321,6 +330,21 @@ struct lcb_CMDANALYTICS_ {
         return LCB_SUCCESS;
     }
 
+    lcb_STATUS columnar(const lcb_COLUMN_SCHEMA *schema)
+    {
+        if (schema == nullptr) {
+            columns_.reset();
+        } else {
+            columns_ = std::make_shared<const lcb_COLUMN_SCHEMA>(*schema);
+        }
+        return LCB_SUCCESS;
+    }
+
+    const std::shared_ptr<const lcb_COLUMN_SCHEMA> &columns() const
+    {
+        return columns_;
+    }
+
     lcb_ANALYTICS_CALLBACK callback() const
     {
         return callback_;
@@ -385,6 +409,7 @@ struct lcb_CMDANALYTICS_ {
     lcb_ANALYTICS_CALLBACK callback_{nullptr};
     lcb_ANALYTICS_HANDLE **handle_{nullptr};
     lcb_INGEST_OPTIONS ingest_options_{};
+    std::shared_ptr<const lcb_COLUMN_SCHEMA> columns_{};
     bool priority_{false};
     std::string scope_qualifier_{};
     std::string scope_name_{};
@@ -23,6 +23,40 @@
 #include "cmd_query.hh"
 #include "../mutation_token.hh"
 
+std::shared_ptr<const lcb::query_encoded_options> lcb::encode_query_options(const Json::Value &root)
+{
+    auto options = std::make_shared<query_encoded_options>();
+    if (!root.isObject()) {
+        return options;
+    }
+    Json::FastWriter writer;
+    for (auto it = root.begin(); it != root.end(); ++it) {
+        const std::string name = it.name();
+        if (name == "statement") {
+            options->statement = *it;
+        } else if (name == "timeout") {
+            options->timeout = *it;
+        } else if (name == "client_context_id") {
+            options->client_context_id = *it;
+        } else if (name == "query_context") {
+            options->query_context = *it;
+        } else if (name == "creds") {
+            options->creds = *it;
+        } else {
+            if (name == "readonly") {
+                options->readonly = it->isBool() && it->asBool();
+            }
+            if (options->prefix.size() > 1) {
+                options->prefix += ',';
+            }
+            query_body_writer::append_quoted(options->prefix, name);
+            options->prefix += ':';
+            options->prefix += writer.write(*it);
+        }
+    }
+    return options;
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_respquery_status(const lcb_RESPQUERY *resp)
 {
     return resp->ctx.rc;
@@ -41,6 +75,15 @@ LIBCOUCHBASE_API lcb_STATUS lcb_respquery_row(const lcb_RESPQUERY *resp, const c
     return LCB_SUCCESS;
 }
 
+LIBCOUCHBASE_API lcb_STATUS lcb_respquery_columns(const lcb_RESPQUERY *resp, const lcb_COLUMN_BATCH **batch)
+{
+    if (resp->columns == nullptr) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    *batch = resp->columns;
+    return LCB_SUCCESS;
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_respquery_http_response(const lcb_RESPQUERY *resp, const lcb_RESPHTTP **http)
 {
     *http = resp->htresp;
@@ -81,6 +124,11 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdquery_timeout(lcb_CMDQUERY *cmd, uint32_t tim
     return cmd->timeout_in_microseconds(timeout);
 }
 
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdquery_columnar(lcb_CMDQUERY *cmd, const lcb_COLUMN_SCHEMA *schema)
+{
+    return cmd->columnar(schema);
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdquery_scope_name(lcb_CMDQUERY *cmd, const char *scope, size_t scope_len)
 {
     if (scope == nullptr || scope_len == 0) {
@@ -139,17 +187,17 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdquery_named_param(lcb_CMDQUERY *cmd, const ch
     if (name == nullptr || name_len == 0) {
         return LCB_ERR_INVALID_ARGUMENT;
     }
-    return cmd->option("$" + std::string(name, name_len), value, value_len);
+    return cmd->named_param("$" + std::string(name, name_len), value, value_len);
 }
 
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdquery_positional_params(lcb_CMDQUERY *cmd, const char *value, size_t value_len)
 {
-    return cmd->option_array("args", value, value_len);
+    return cmd->positional_params(value, value_len);
 }
 
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdquery_positional_param(lcb_CMDQUERY *cmd, const char *value, size_t value_len)
 {
-    return cmd->option_array_append("args", value, value_len);
+    return cmd->positional_param(value, value_len);
 }
 
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdquery_adhoc(lcb_CMDQUERY *cmd, int adhoc)
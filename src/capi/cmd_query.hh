@@ -18,12 +18,17 @@
 #ifndef LIBCOUCHBASE_CAPI_QUERY_HH
 #define LIBCOUCHBASE_CAPI_QUERY_HH
 
+#include <cctype>
 #include <cstddef>
 #include <cstdint>
 #include <chrono>
+#include <memory>
+#include <vector>
 
 #include "contrib/lcb-jsoncpp/lcb-jsoncpp.h"
 #include "collection_qualifier.hh"
+#include "jsparse/parser.h"
+#include "jsparse/columnar.h"
 
 /**
  * @private
@@ -48,6 +53,122 @@ struct lcb_QUERY_ERROR_CONTEXT_ {
     size_t endpoint_len{};
 };
 
+namespace lcb
+{
+/**
+ * Options of the query, encoded once and shared between copies of the command
+ * (see lcb_CMDQUERY_::encoded_options()). The members which the query handle
+ * inspects or overrides are kept decoded, the rest is stored as JSON text.
+ */
+struct query_encoded_options {
+    /** Other members of the request body: starts with '{', has no closing brace */
+    std::string prefix{"{"};
+    Json::Value statement{};
+    Json::Value timeout{};
+    Json::Value client_context_id{};
+    Json::Value query_context{};
+    Json::Value creds{};
+    bool readonly{false};
+};
+
+std::shared_ptr<const query_encoded_options> encode_query_options(const Json::Value &root);
+
+/**
+ * Builds the request body by appending members to the encoded options,
+ * instead of assembling Json::Value and serializing it.
+ */
+class query_body_writer
+{
+  public:
+    explicit query_body_writer(const std::string &prefix, std::size_t reserve = 0)
+    {
+        body_.reserve(prefix.size() + reserve + 1);
+        body_.append(prefix);
+    }
+
+    /** Appends member with already encoded value */
+    void member(const char *name, const std::string &value)
+    {
+        key(name);
+        body_.append(value);
+    }
+
+    void string_member(const char *name, const std::string &value)
+    {
+        key(name);
+        append_quoted(body_, value);
+    }
+
+    /** Appends comma-separated members, e.g. "a":1,"b":2 */
+    void members(const std::string &encoded)
+    {
+        if (encoded.empty()) {
+            return;
+        }
+        separator();
+        body_.append(encoded);
+    }
+
+    std::string &finish()
+    {
+        body_ += '}';
+        return body_;
+    }
+
+    static void append_quoted(std::string &out, const std::string &value)
+    {
+        static const char hex[] = "0123456789abcdef";
+        out += '"';
+        for (char ch : value) {
+            switch (ch) {
+                case '"':
+                    out.append("\\\"");
+                    break;
+                case '\\':
+                    out.append("\\\\");
+                    break;
+                case '\n':
+                    out.append("\\n");
+                    break;
+                case '\r':
+                    out.append("\\r");
+                    break;
+                case '\t':
+                    out.append("\\t");
+                    break;
+                default:
+                    if (static_cast<unsigned char>(ch) < 0x20) {
+                        out.append("\\u00");
+                        out += hex[(ch >> 4) & 0xf];
+                        out += hex[ch & 0xf];
+                    } else {
+                        out += ch;
+                    }
+            }
+        }
+        out += '"';
+    }
+
+  private:
+    void separator()
+    {
+        if (body_.size() > 1) {
+            body_ += ',';
+        }
+    }
+
+    void key(const char *name)
+    {
+        separator();
+        body_ += '"';
+        body_.append(name);
+        body_.append("\":");
+    }
+
+    std::string body_{};
+};
+} // namespace lcb
+
 /**
  * Command structure for N1QL queries. Typically an application will use the
  * lcb_N1QLPARAMS structure to populate the #query and #content_type fields.
@@ -58,7 +179,7 @@ struct lcb_QUERY_ERROR_CONTEXT_ {
 struct lcb_CMDQUERY_ {
     bool empty_statement_and_root_object() const
     {
-        return query_.empty() && root_.empty();
+        return query_.empty() && root_->empty() && !has_positional_params_ && named_params_.empty();
     }
 
     bool is_query_json() const
@@ -68,15 +189,54 @@ struct lcb_CMDQUERY_ {
 
     const Json::Value &root() const
     {
-        return root_;
+        return *root_;
     }
 
     void root(const Json::Value &new_body)
     {
-        root_ = new_body;
+        replace_root(new_body);
         query_is_json_ = true;
     }
 
+    /**
+     * Returns the options encoded into JSON text. The result is cached until
+     * the next modification, so the command reused for many queries encodes
+     * its options only once.
+     */
+    const std::shared_ptr<const lcb::query_encoded_options> &encoded_options() const
+    {
+        if (!encoded_) {
+            encoded_ = lcb::encode_query_options(*root_);
+        }
+        return encoded_;
+    }
+
+    /**
+     * Returns positional and named parameters as comma-separated members of
+     * the request body.
+     */
+    std::string encoded_params() const
+    {
+        std::string out;
+        std::size_t size = positional_params_.size() + 9;
+        for (const auto &param : named_params_) {
+            size += param.first.size() + param.second.size() + 4;
+        }
+        out.reserve(size);
+        if (has_positional_params_) {
+            out.append("\"args\":[").append(positional_params_).append("]");
+        }
+        for (const auto &param : named_params_) {
+            if (!out.empty()) {
+                out += ',';
+            }
+            lcb::query_body_writer::append_quoted(out, param.first);
+            out += ':';
+            out.append(param.second);
+        }
+        return out;
+    }
+
     void use_multi_bucket_authentication(bool use)
     {
         use_multi_bucket_authentication_ = use;
@@ -100,58 +260,58 @@ struct lcb_CMDQUERY_ {
 
     lcb_STATUS pretty(bool pretty)
     {
-        root_["pretty"] = pretty;
+        mutable_root()["pretty"] = pretty;
         return LCB_SUCCESS;
     }
 
     lcb_STATUS readonly(bool readonly)
     {
-        root_["readonly"] = readonly;
+        mutable_root()["readonly"] = readonly;
         return LCB_SUCCESS;
     }
 
     lcb_STATUS metrics(bool show_metrics)
     {
-        root_["metrics"] = show_metrics;
+        mutable_root()["metrics"] = show_metrics;
         return LCB_SUCCESS;
     }
 
     lcb_STATUS scan_cap(int cap_value)
     {
-        root_["scan_cap"] = Json::valueToString(cap_value);
+        mutable_root()["scan_cap"] = Json::valueToString(cap_value);
         return LCB_SUCCESS;
     }
 
     lcb_STATUS scan_wait(uint32_t duration_us)
     {
-        root_["scan_wait"] = Json::valueToString(duration_us) + "us";
+        mutable_root()["scan_wait"] = Json::valueToString(duration_us) + "us";
         return LCB_SUCCESS;
     }
 
     lcb_STATUS pipeline_cap(int value)
     {
-        root_["pipeline_cap"] = Json::valueToString(value);
+        mutable_root()["pipeline_cap"] = Json::valueToString(value);
         return LCB_SUCCESS;
     }
 
     lcb_STATUS pipeline_batch(int value)
     {
-        root_["pipeline_batch"] = Json::valueToString(value);
+        mutable_root()["pipeline_batch"] = Json::valueToString(value);
         return LCB_SUCCESS;
     }
 
     lcb_STATUS max_parallelism(int value)
     {
-        root_["max_parallelism"] = Json::valueToString(value);
+        mutable_root()["max_parallelism"] = Json::valueToString(value);
         return LCB_SUCCESS;
     }
 
     lcb_STATUS flex_index(bool value)
     {
         if (value) {
-            root_["use_fts"] = true;
+            mutable_root()["use_fts"] = true;
         } else {
-            root_.removeMember("use_fts");
+            mutable_root().removeMember("use_fts");
         }
         return LCB_SUCCESS;
     }
@@ -160,13 +320,13 @@ struct lcb_CMDQUERY_ {
     {
         switch (mode) {
             case LCB_QUERY_PROFILE_OFF:
-                root_["profile"] = "off";
+                mutable_root()["profile"] = "off";
                 break;
             case LCB_QUERY_PROFILE_PHASES:
-                root_["profile"] = "phases";
+                mutable_root()["profile"] = "phases";
                 break;
             case LCB_QUERY_PROFILE_TIMINGS:
-                root_["profile"] = "timings";
+                mutable_root()["profile"] = "timings";
                 break;
             default:
                 return LCB_ERR_INVALID_ARGUMENT;
@@ -178,13 +338,13 @@ struct lcb_CMDQUERY_ {
     {
         switch (mode) {
             case LCB_QUERY_CONSISTENCY_NONE:
-                root_.removeMember("scan_consistency");
+                mutable_root().removeMember("scan_consistency");
                 break;
             case LCB_QUERY_CONSISTENCY_REQUEST:
-                root_["scan_consistency"] = "request_plus";
+                mutable_root()["scan_consistency"] = "request_plus";
                 break;
             case LCB_QUERY_CONSISTENCY_STATEMENT:
-                root_["scan_consistency"] = "statement_plus";
+                mutable_root()["scan_consistency"] = "statement_plus";
                 break;
             default:
                 return LCB_ERR_INVALID_ARGUMENT;
@@ -198,8 +358,8 @@ struct lcb_CMDQUERY_ {
         if (!lcb_mutation_token_is_valid(token)) {
             return LCB_ERR_INVALID_ARGUMENT;
         }
-        root_["scan_consistency"] = "at_plus";
-        auto &vb = root_["scan_vectors"][std::string(keyspace, keyspace_len)][std::to_string(token->vbid_)];
+        mutable_root()["scan_consistency"] = "at_plus";
+        auto &vb = mutable_root()["scan_vectors"][std::string(keyspace, keyspace_len)][std::to_string(token->vbid_)];
         vb[0] = static_cast<Json::UInt64>(token->seqno_);
         vb[1] = std::to_string(token->uuid_);
         return LCB_SUCCESS;
@@ -207,7 +367,7 @@ struct lcb_CMDQUERY_ {
 
     lcb_STATUS preserve_expiry(bool preserve_expiry)
     {
-        root_["preserve_expiry"] = preserve_expiry;
+        mutable_root()["preserve_expiry"] = preserve_expiry;
         return LCB_SUCCESS;
     }
 
@@ -227,6 +387,21 @@ struct lcb_CMDQUERY_ {
         return callback_ != nullptr;
     }
 
+    lcb_STATUS columnar(const lcb_COLUMN_SCHEMA *schema)
+    {
+        if (schema == nullptr) {
+            columns_.reset();
+        } else {
+            columns_ = std::make_shared<const lcb_COLUMN_SCHEMA>(*schema);
+        }
+        return LCB_SUCCESS;
+    }
+
+    const std::shared_ptr<const lcb_COLUMN_SCHEMA> &columns() const
+    {
+        return columns_;
+    }
+
     lcb_STATUS store_handle_refence_to(lcb_QUERY_HANDLE **storage)
     {
         handle_ = storage;
@@ -319,7 +494,23 @@ struct lcb_CMDQUERY_ {
 
     lcb_STATUS encode_payload()
     {
-        query_ = Json::FastWriter().write(root_);
+        if (!has_positional_params_ && named_params_.empty()) {
+            query_ = Json::FastWriter().write(*root_);
+            return LCB_SUCCESS;
+        }
+        Json::Value payload = *root_;
+        if (has_positional_params_) {
+            std::string args = "[" + positional_params_ + "]";
+            if (!Json::Reader().parse(args, payload["args"])) {
+                return LCB_ERR_INVALID_ARGUMENT;
+            }
+        }
+        for (const auto &param : named_params_) {
+            if (!Json::Reader().parse(param.second, payload[param.first])) {
+                return LCB_ERR_INVALID_ARGUMENT;
+            }
+        }
+        query_ = Json::FastWriter().write(payload);
         return LCB_SUCCESS;
     }
 
@@ -329,7 +520,7 @@ struct lcb_CMDQUERY_ {
         if (!Json::Reader().parse(query, query + query_len, value)) {
             return LCB_ERR_INVALID_ARGUMENT;
         }
-        root_ = value;
+        replace_root(value);
         return LCB_SUCCESS;
     }
 
@@ -343,7 +534,7 @@ struct lcb_CMDQUERY_ {
         if (statement == nullptr) {
             return LCB_ERR_INVALID_ARGUMENT;
         }
-        root_["statement"] = std::string(statement, statement_len);
+        mutable_root()["statement"] = std::string(statement, statement_len);
         return LCB_SUCCESS;
     }
 
@@ -356,7 +547,9 @@ struct lcb_CMDQUERY_ {
         if (!Json::Reader().parse(value, value + value_len, json_value)) {
             return LCB_ERR_INVALID_ARGUMENT;
         }
-        root_[std::string(name, name_len)] = json_value;
+        std::string key(name, name_len);
+        forget_param(key);
+        mutable_root()[key] = json_value;
         return LCB_SUCCESS;
     }
 
@@ -369,36 +562,85 @@ struct lcb_CMDQUERY_ {
         if (!Json::Reader().parse(value, value + value_len, json_value)) {
             return LCB_ERR_INVALID_ARGUMENT;
         }
-        root_[name] = json_value;
+        forget_param(name);
+        mutable_root()[name] = json_value;
         return LCB_SUCCESS;
     }
 
-    lcb_STATUS option_array(const std::string &name, const char *value, std::size_t value_len)
+    /**
+     * Sets all positional parameters. The value must be JSON array, it is
+     * validated, but otherwise sent as is.
+     */
+    lcb_STATUS positional_params(const char *value, std::size_t value_len)
     {
-        if (name.empty() || value == nullptr) {
+        if (value == nullptr || !lcb::jsparse::validate(value, value_len)) {
             return LCB_ERR_INVALID_ARGUMENT;
         }
-        Json::Value json_value;
-        if (!Json::Reader().parse(value, value + value_len, json_value)) {
-            return LCB_ERR_INVALID_ARGUMENT;
+        const char *begin = value;
+        const char *end = value + value_len;
+        while (begin < end && std::isspace(static_cast<unsigned char>(*begin))) {
+            ++begin;
+        }
+        while (end > begin && std::isspace(static_cast<unsigned char>(end[-1]))) {
+            --end;
         }
-        if (json_value.type() != Json::ValueType::arrayValue) {
+        if (*begin != '[') {
             return LCB_ERR_INVALID_ARGUMENT;
         }
-        root_[name] = json_value;
+        positional_params_.assign(begin + 1, end - 1);
+        if (positional_params_.find_first_not_of(" \t\r\n") == std::string::npos) {
+            positional_params_.clear();
+        }
+        has_positional_params_ = true;
+        if (root_->isMember("args")) {
+            mutable_root().removeMember("args");
+        }
         return LCB_SUCCESS;
     }
 
-    lcb_STATUS option_array_append(const std::string &name, const char *value, std::size_t value_len)
+    /** Appends JSON value to the positional parameters */
+    lcb_STATUS positional_param(const char *value, std::size_t value_len)
     {
-        if (name.empty() || value == nullptr) {
+        if (value == nullptr || !lcb::jsparse::validate(value, value_len)) {
             return LCB_ERR_INVALID_ARGUMENT;
         }
-        Json::Value json_value;
-        if (!Json::Reader().parse(value, value + value_len, json_value)) {
+        if (!has_positional_params_ && root_->isMember("args")) {
+            // the arguments were set with the payload, keep them
+            positional_params_ = Json::FastWriter().write(root()["args"]);
+            if (positional_params_.size() < 2 || positional_params_[0] != '[') {
+                positional_params_.clear();
+                return LCB_ERR_INVALID_ARGUMENT;
+            }
+            positional_params_ = positional_params_.substr(1, positional_params_.size() - 2);
+            mutable_root().removeMember("args");
+        }
+        if (!positional_params_.empty()) {
+            positional_params_ += ',';
+        }
+        positional_params_.append(value, value_len);
+        has_positional_params_ = true;
+        return LCB_SUCCESS;
+    }
+
+    /**
+     * Sets the named parameter (the name includes '$' prefix). The value is
+     * validated, but otherwise sent as is.
+     */
+    lcb_STATUS named_param(std::string name, const char *value, std::size_t value_len)
+    {
+        if (value == nullptr || !lcb::jsparse::validate(value, value_len)) {
             return LCB_ERR_INVALID_ARGUMENT;
         }
-        root_[name].append(json_value);
+        if (root_->isMember(name)) {
+            mutable_root().removeMember(name);
+        }
+        for (auto &param : named_params_) {
+            if (param.first == name) {
+                param.second.assign(value, value_len);
+                return LCB_SUCCESS;
+            }
+        }
+        named_params_.emplace_back(std::move(name), std::string(value, value_len));
         return LCB_SUCCESS;
     }
 
@@ -407,7 +649,7 @@ struct lcb_CMDQUERY_ {
         if (name.empty() || value == nullptr || value_len == 0) {
             return LCB_ERR_INVALID_ARGUMENT;
         }
-        root_[name] = std::string(value, value_len);
+        mutable_root()[name] = std::string(value, value_len);
         return LCB_SUCCESS;
     }
 
@@ -415,13 +657,14 @@ struct lcb_CMDQUERY_ {
     {
         timeout_ = std::chrono::milliseconds::zero();
         parent_span_ = nullptr;
-        root_.clear();
+        replace_root(Json::Value());
         scope_.clear();
         scope_qualifier_.clear();
         query_.clear();
         cookie_ = nullptr;
         callback_ = nullptr;
         handle_ = nullptr;
+        columns_.reset();
         prepare_statement_ = false;
         query_is_json_ = false;
         use_multi_bucket_authentication_ = false;
@@ -455,6 +698,43 @@ struct lcb_CMDQUERY_ {
     }
 
   private:
+    /**
+     * Returns the options for modification. The copies of the command share
+     * options until one of them is modified.
+     */
+    Json::Value &mutable_root()
+    {
+        if (root_.use_count() > 1) {
+            root_ = std::make_shared<Json::Value>(*root_);
+        }
+        encoded_.reset();
+        return *root_;
+    }
+
+    void replace_root(const Json::Value &value)
+    {
+        root_ = std::make_shared<Json::Value>(value);
+        encoded_.reset();
+        positional_params_.clear();
+        has_positional_params_ = false;
+        named_params_.clear();
+    }
+
+    void forget_param(const std::string &name)
+    {
+        if (name == "args") {
+            positional_params_.clear();
+            has_positional_params_ = false;
+            return;
+        }
+        for (auto it = named_params_.begin(); it != named_params_.end(); ++it) {
+            if (it->first == name) {
+                named_params_.erase(it);
+                return;
+            }
+        }
+    }
+
     std::string scope_{};
     std::string scope_qualifier_{};
     std::chrono::microseconds timeout_{0};
@@ -466,7 +746,13 @@ struct lcb_CMDQUERY_ {
     bool query_is_json_{false};
     bool use_multi_bucket_authentication_{false};
 
-    Json::Value root_{};
+    std::shared_ptr<Json::Value> root_{std::make_shared<Json::Value>()};
+    mutable std::shared_ptr<const lcb::query_encoded_options> encoded_{};
+    /** Positional parameters: encoded values separated by commas */
+    std::string positional_params_{};
+    bool has_positional_params_{false};
+    /** Named parameters: pairs of name (with '$') and encoded value */
+    std::vector<std::pair<std::string, std::string>> named_params_{};
     /**Query to be placed in the POST request. The library will not perform
      * any conversions or validation on this string, so it is up to the user
      * (or wrapping library) to ensure that the string is well formed.
@@ -484,6 +770,9 @@ struct lcb_CMDQUERY_ {
     /** Callback to be invoked for each row */
     lcb_QUERY_CALLBACK callback_{nullptr};
 
+    /** Projection of the rows, if they have to be delivered in columnar batches */
+    std::shared_ptr<const lcb_COLUMN_SCHEMA> columns_{};
+
     /**Request handle. Will be set to the handle which may be passed to
      * lcb_query_cancel() */
     lcb_QUERY_HANDLE **handle_{nullptr};
@@ -512,6 +801,8 @@ struct lcb_RESPQUERY_ {
     /** Raw HTTP response, if applicable */
     const lcb_RESPHTTP *htresp;
     lcb_QUERY_HANDLE *handle;
+    /** Decoded rows, if the command was configured with the columnar schema */
+    const lcb_COLUMN_BATCH *columns;
 };
 
 #endif // LIBCOUCHBASE_CAPI_QUERY_HH
@@ -0,0 +1,251 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LIBCOUCHBASE_CAPI_SCAN_HH
+#define LIBCOUCHBASE_CAPI_SCAN_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <string>
+
+#include "collection_qualifier.hh"
+
+/**
+ * @private
+ */
+struct lcb_CMDSCAN_ {
+    enum scan_type { RANGE, SAMPLING };
+
+    lcb_STATUS callback(lcb_SCAN_CALLBACK item_callback)
+    {
+        callback_ = item_callback;
+        return LCB_SUCCESS;
+    }
+
+    lcb_SCAN_CALLBACK callback() const
+    {
+        return callback_;
+    }
+
+    lcb_STATUS collection(lcb::collection_qualifier collection)
+    {
+        collection_ = std::move(collection);
+        return LCB_SUCCESS;
+    }
+
+    const lcb::collection_qualifier &collection() const
+    {
+        return collection_;
+    }
+
+    lcb::collection_qualifier &collection()
+    {
+        return collection_;
+    }
+
+    /** Used only to pick the node for the collection ID resolution */
+    const std::string &key() const
+    {
+        return key_;
+    }
+
+    lcb_STATUS range(std::string start, std::string end)
+    {
+        type_ = RANGE;
+        start_ = std::move(start);
+        end_ = std::move(end);
+        return LCB_SUCCESS;
+    }
+
+    lcb_STATUS prefix(const std::string &prefix)
+    {
+        /* the largest code point of UTF-8, so that all the keys with the prefix sort before it */
+        return range(prefix, prefix + "\xf4\x8f\xbf\xbf");
+    }
+
+    const std::string &start() const
+    {
+        return start_;
+    }
+
+    const std::string &end() const
+    {
+        return end_;
+    }
+
+    lcb_STATUS sampling(std::uint64_t limit, std::uint64_t seed)
+    {
+        if (limit == 0) {
+            return LCB_ERR_INVALID_ARGUMENT;
+        }
+        type_ = SAMPLING;
+        sample_limit_ = limit;
+        sample_seed_ = seed;
+        return LCB_SUCCESS;
+    }
+
+    scan_type type() const
+    {
+        return type_;
+    }
+
+    std::uint64_t sample_limit() const
+    {
+        return sample_limit_;
+    }
+
+    std::uint64_t sample_seed() const
+    {
+        return sample_seed_;
+    }
+
+    lcb_STATUS ids_only(bool ids_only)
+    {
+        ids_only_ = ids_only;
+        return LCB_SUCCESS;
+    }
+
+    bool ids_only() const
+    {
+        return ids_only_;
+    }
+
+    lcb_STATUS concurrency(std::uint32_t vbuckets_per_node)
+    {
+        if (vbuckets_per_node == 0) {
+            return LCB_ERR_INVALID_ARGUMENT;
+        }
+        concurrency_ = vbuckets_per_node;
+        return LCB_SUCCESS;
+    }
+
+    std::uint32_t concurrency() const
+    {
+        return concurrency_;
+    }
+
+    lcb_STATUS batch_item_limit(std::uint32_t items)
+    {
+        batch_item_limit_ = items;
+        return LCB_SUCCESS;
+    }
+
+    std::uint32_t batch_item_limit() const
+    {
+        return batch_item_limit_;
+    }
+
+    lcb_STATUS batch_byte_limit(std::uint32_t bytes)
+    {
+        batch_byte_limit_ = bytes;
+        return LCB_SUCCESS;
+    }
+
+    std::uint32_t batch_byte_limit() const
+    {
+        return batch_byte_limit_;
+    }
+
+    lcb_STATUS resume_token(std::string token)
+    {
+        resume_token_ = std::move(token);
+        return LCB_SUCCESS;
+    }
+
+    const std::string &resume_token() const
+    {
+        return resume_token_;
+    }
+
+    lcb_STATUS timeout_in_microseconds(std::uint32_t timeout)
+    {
+        timeout_ = std::chrono::microseconds(timeout);
+        return LCB_SUCCESS;
+    }
+
+    std::uint64_t timeout_or_default_in_nanoseconds(std::uint64_t default_timeout) const
+    {
+        if (timeout_ > std::chrono::microseconds::zero()) {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(timeout_).count();
+        }
+        return default_timeout;
+    }
+
+    lcb_STATUS handle(lcb_SCAN_HANDLE **handle)
+    {
+        handle_ = handle;
+        return LCB_SUCCESS;
+    }
+
+    lcb_SCAN_HANDLE **handle() const
+    {
+        return handle_;
+    }
+
+    void cookie(void *cookie)
+    {
+        cookie_ = cookie;
+    }
+
+    void *cookie() const
+    {
+        return cookie_;
+    }
+
+  private:
+    lcb_SCAN_CALLBACK callback_{nullptr};
+    lcb::collection_qualifier collection_{};
+    std::string key_{};
+    scan_type type_{RANGE};
+    std::string start_{std::string(1, '\0')};
+    std::string end_{"\xf4\x8f\xbf\xbf"};
+    std::uint64_t sample_limit_{0};
+    std::uint64_t sample_seed_{0};
+    bool ids_only_{false};
+    std::uint32_t concurrency_{2};
+    std::uint32_t batch_item_limit_{50};
+    std::uint32_t batch_byte_limit_{15000};
+    std::string resume_token_{};
+    std::chrono::microseconds timeout_{0};
+    lcb_SCAN_HANDLE **handle_{nullptr};
+    void *cookie_{nullptr};
+};
+
+/**
+ * @private
+ */
+struct lcb_RESPSCAN_ {
+    lcb_STATUS rc;
+    void *cookie;
+    std::uint16_t rflags;
+
+    const char *key;
+    std::size_t nkey;
+    const char *value;
+    std::size_t nvalue;
+    std::uint64_t cas;
+    std::uint32_t flags;
+    std::uint32_t expiry;
+    std::uint64_t seqno;
+    std::uint8_t datatype;
+    std::uint16_t vbid;
+
+    lcb_SCAN_HANDLE *handle;
+};
+
+#endif // LIBCOUCHBASE_CAPI_SCAN_HH
@@ -231,12 +231,15 @@ struct lcb_CMDSTORE_ {
 
     lcb_STATUS value(std::string value)
     {
+        borrowed_value_.clear();
         value_ = std::move(value);
         return LCB_SUCCESS;
     }
 
     lcb_STATUS value(const lcb_IOV *iov, std::size_t iov_len)
     {
+        borrowed_value_.clear();
+        value_.clear();
         std::size_t total_size = 0;
         for (std::size_t i = 0; i < iov_len; ++i) {
             total_size += iov[i].iov_len;
@@ -250,6 +253,33 @@ struct lcb_CMDSTORE_ {
         return LCB_SUCCESS;
     }
 
+    /**
+     * Reference the value from the application memory instead of copying it.
+     * The buffers must stay valid until lcb_pktflushed_callback is invoked
+     * for the operation cookie.
+     */
+    lcb_STATUS value_borrowed(const lcb_IOV *iov, std::size_t iov_len)
+    {
+        value_.clear();
+        borrowed_value_.clear();
+        for (std::size_t i = 0; i < iov_len; ++i) {
+            if (iov[i].iov_len > 0 && iov[i].iov_base != nullptr) {
+                borrowed_value_.push_back(iov[i]);
+            }
+        }
+        return LCB_SUCCESS;
+    }
+
+    bool value_is_borrowed() const
+    {
+        return !borrowed_value_.empty();
+    }
+
+    const std::vector<lcb_IOV> &borrowed_value() const
+    {
+        return borrowed_value_;
+    }
+
     lcb_STATUS collection(lcb::collection_qualifier collection)
     {
         collection_ = std::move(collection);
@@ -402,6 +432,7 @@ struct lcb_CMDSTORE_ {
     std::uint32_t expiry_{0};
     std::string key_{};
     std::string value_{};
+    std::vector<lcb_IOV> borrowed_value_{};
     std::uint64_t cas_{0};
     std::uint32_t flags_{0};
     durability_mode durability_mode_{durability_mode::none};
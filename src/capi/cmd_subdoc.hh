@@ -21,8 +21,10 @@
 #include <cstddef>
 #include <cstdint>
 #include <chrono>
+#include <memory>
 
 #include "key_value_error_context.hh"
+#include "collection_qualifier.hh"
 
 /**
  * @private
@@ -210,10 +212,26 @@ struct subdoc_options {
     bool create_as_deleted{false};
 };
 
+/**
+ * Wire representation of the specs, encoded once by lcb_subdocspecs_compile() and shared between the commands.
+ */
+struct subdoc_compiled_specs {
+    /* LCB_SDMULTI_MODE_LOOKUP or LCB_SDMULTI_MODE_MUTATE */
+    unsigned mode{LCB_SDMULTI_MODE_INVALID};
+
+    /* Number of encoded specs */
+    std::size_t nspecs{0};
+
+    /* Spec headers, paths and values, ready to be used as the packet body */
+    std::string body{};
+};
+
 struct lcb_SUBDOCSPECS_ {
   public:
     std::vector<subdoc_spec> &specs()
     {
+        /* any modification of the specs invalidates their encoded form */
+        compiled_.reset();
         return specs_;
     }
 
@@ -224,11 +242,35 @@ struct lcb_SUBDOCSPECS_ {
 
     bool is_lookup() const
     {
+        if (compiled_) {
+            return compiled_->mode == LCB_SDMULTI_MODE_LOOKUP;
+        }
         return specs_.empty() || specs_[0].is_lookup();
     }
 
+    std::size_t size() const
+    {
+        return compiled_ ? compiled_->nspecs : specs_.size();
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    const std::shared_ptr<const subdoc_compiled_specs> &compiled() const
+    {
+        return compiled_;
+    }
+
+    void compiled(std::shared_ptr<const subdoc_compiled_specs> compiled)
+    {
+        compiled_ = std::move(compiled);
+    }
+
   private:
     std::vector<subdoc_spec> specs_{};
+    std::shared_ptr<const subdoc_compiled_specs> compiled_{};
 };
 
 struct lcb_CMDSUBDOC_ {
@@ -288,10 +330,16 @@ struct lcb_CMDSUBDOC_ {
 
     lcb_STATUS specs(const lcb_SUBDOCSPECS *operations)
     {
-        if (operations == nullptr || operations->specs().empty()) {
+        if (operations == nullptr || operations->empty()) {
             return LCB_ERR_INVALID_ARGUMENT;
         }
-        specs_ = *operations;
+        if (operations->compiled()) {
+            /* the encoded body is all the command needs, so the individual specs are not copied */
+            specs_ = lcb_SUBDOCSPECS_{};
+            specs_.compiled(operations->compiled());
+        } else {
+            specs_ = *operations;
+        }
         return LCB_SUCCESS;
     }
 
@@ -522,7 +570,17 @@ struct lcb_RESPSUBDOC_ {
     /** Use with lcb_backbuf_ref/unref */
     void *bufh;
     std::size_t nres;
-    lcb_SDENTRY *res;
+
+    /* Entries are decoded from #responses on demand, see lcb_respsubdoc_result_status(). */
+
+    /** Index and body offset of the entry which sequential access decodes next */
+    mutable std::size_t next_index{0};
+    mutable std::size_t next_offset{0};
+    /** Body offset of every entry, only built when the results are accessed out of order */
+    mutable std::vector<std::size_t> offsets{};
+    /** The entry decoded last, as its status and value are usually read one after another */
+    mutable std::size_t cached_index{static_cast<std::size_t>(-1)};
+    mutable lcb_SDENTRY cached{};
 };
 
 #endif // LIBCOUCHBASE_CAPI_SUBDOC_HH
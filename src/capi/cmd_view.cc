@@ -80,6 +80,15 @@ LIBCOUCHBASE_API int lcb_respview_is_final(const lcb_RESPVIEW *resp)
     return resp->rflags & LCB_RESP_F_FINAL;
 }
 
+LIBCOUCHBASE_API lcb_STATUS lcb_respview_fetch_stats(const lcb_RESPVIEW *resp, lcb_VIEW_FETCH_STATS *stats)
+{
+    if (resp->fetch_stats == nullptr || stats == nullptr) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    *stats = *resp->fetch_stats;
+    return LCB_SUCCESS;
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdview_create(lcb_CMDVIEW **cmd)
 {
     *cmd = new lcb_CMDVIEW{};
@@ -340,6 +340,9 @@ struct lcb_RESPVIEW_ {
     const lcb_RESPGET *docresp;
 
     lcb_VIEW_HANDLE *handle;
+
+    /** Statistics of the document fetching, only set for the final response */
+    const lcb_VIEW_FETCH_STATS *fetch_stats;
 };
 
 #endif // LIBCOUCHBASE_CAPI_VIEWS_HH
@@ -22,6 +22,7 @@
 #include <mcserver/negotiate.h>
 #include <lcbio/ssl.h>
 #include "n1ql/query_utils.hh"
+#include "n1ql/query_cache.hh"
 
 #define LOGARGS(instance, lvl) instance->settings, "cntl", LCB_LOG_##lvl, __FILE__, __LINE__
 
@@ -135,6 +136,8 @@ static std::uint32_t *get_timeout_field(lcb_INSTANCE *instance, int cmd)
             return &settings->persistence_timeout_floor;
         case LCB_CNTL_OP_METRICS_FLUSH_INTERVAL:
             return &settings->op_metrics_flush_interval;
+        case LCB_CNTL_DNS_CACHE_TTL:
+            return &settings->dns_cache_ttl;
         default:
             return nullptr;
     }
@@ -205,6 +208,64 @@ HANDLER(http_poolsz_handler){RETURN_GET_SET(std::size_t, instance->http_sockpool
 
 HANDLER(http_pooltmo_handler){RETURN_GET_SET(uint32_t, instance->http_sockpool->get_options().tmoidle)}
 
+HANDLER(http_maxconns_handler){RETURN_GET_SET(std::size_t, instance->http_sockpool->get_options().maxtotal)}
+
+HANDLER(http_warmup_handler){RETURN_GET_SET(lcb_U32, LCBT_SETTING(instance, http_warmup_connections))}
+
+HANDLER(enable_http2_handler){RETURN_GET_SET(int, LCBT_SETTING(instance, enable_http2))}
+
+HANDLER(n1ql_cache_size_handler)
+{
+    if (mode == LCB_CNTL_SET && *reinterpret_cast<lcb_SIZE *>(arg) == 0) {
+        return LCB_ERR_CONTROL_INVALID_ARGUMENT;
+    }
+    RETURN_GET_SET(lcb_SIZE, LCBT_SETTING(instance, n1ql_cache_size))
+}
+
+HANDLER(n1ql_shared_cache_handler){RETURN_GET_SET(int, LCBT_SETTING(instance, n1ql_shared_cache))}
+
+HANDLER(optimistic_negotiation_handler){RETURN_GET_SET(int, LCBT_SETTING(instance, optimistic_negotiation))}
+
+HANDLER(tls_session_cache_handler){RETURN_GET_SET(int, LCBT_SETTING(instance, tls_session_cache))}
+
+HANDLER(enable_ktls_handler){RETURN_GET_SET(int, LCBT_SETTING(instance, enable_ktls))}
+
+HANDLER(pipeline_latency_handler)
+{
+    if (mode == LCB_CNTL_SET && *reinterpret_cast<int *>(arg) && !instance->settings->metrics) {
+        instance->settings->metrics = lcb_metrics_new();
+    }
+    RETURN_GET_SET(int, LCBT_SETTING(instance, pipeline_latency))
+}
+
+HANDLER(kv_preconnect_handler){RETURN_GET_SET(int, LCBT_SETTING(instance, kv_preconnect))}
+
+HANDLER(tls_session_stats_handler)
+{
+    if (mode != LCB_CNTL_GET) {
+        return LCB_ERR_CONTROL_UNSUPPORTED_MODE;
+    }
+    lcbio_ssl_session_stats(LCBT_SETTING(instance, ssl_ctx), reinterpret_cast<lcb_TLS_SESSION_STATS *>(arg));
+    (void)cmd;
+    return LCB_SUCCESS;
+}
+
+HANDLER(n1ql_cache_stats_handler)
+{
+    if (mode != LCB_CNTL_GET) {
+        return LCB_ERR_CONTROL_UNSUPPORTED_MODE;
+    }
+    const auto &stats = instance->n1ql_cache->stats();
+    auto *out = reinterpret_cast<lcb_N1QL_CACHE_STATS *>(arg);
+    out->hits = stats.hits;
+    out->misses = stats.misses;
+    out->evictions = stats.evictions;
+    out->coalesced = stats.coalesced;
+    out->size = instance->n1ql_cache->size();
+    (void)cmd;
+    return LCB_SUCCESS;
+}
+
 HANDLER(http_refresh_config_handler){RETURN_GET_SET(int, LCBT_SETTING(instance, refresh_on_hterr))}
 
 HANDLER(compmode_handler){RETURN_GET_SET(int, LCBT_SETTING(instance, compressopts))}
@@ -381,6 +442,9 @@ HANDLER(force_sasl_mech_handler)
 {
     if (mode == LCB_CNTL_SET) {
         free(instance->settings->sasl_mech_force);
+        instance->settings->sasl_mech_force = nullptr;
+        free(instance->settings->sasl_mech_cached);
+        instance->settings->sasl_mech_cached = nullptr;
         if (arg) {
             const char *s = reinterpret_cast<const char *>(arg);
             instance->settings->sasl_mech_force = lcb_strdup(s);
@@ -731,6 +795,19 @@ HANDLER(comp_min_ratio_handler)
     RETURN_GET_SET(float, LCBT_SETTING(instance, compress_min_ratio))
 }
 
+HANDLER(tracing_sample_rate_handler)
+{
+    if (mode == LCB_CNTL_SET) {
+        float val = *reinterpret_cast<float *>(arg);
+        if (val > 1 || val < 0) {
+            return LCB_ERR_CONTROL_INVALID_ARGUMENT;
+        }
+    }
+    RETURN_GET_SET(float, LCBT_SETTING(instance, tracer_sample_rate))
+}
+
+HANDLER(tracing_tail_based_handler){RETURN_GET_SET(int, LCBT_SETTING(instance, tracer_tail_based))}
+
 HANDLER(network_handler)
 {
     if (mode == LCB_CNTL_SET) {
@@ -860,6 +937,21 @@ static ctl_handler handlers[] = {
     enable_errmap_handler,                /* LCB_CNTL_ENABLE_ERRMAP */
     timeout_common,                       /* LCB_CNTL_OP_METRICS_FLUSH_INTERVAL */
     enable_op_metrics_handler,            /* LCB_CNTL_ENABLE_OP_METRICS */
+    tracing_sample_rate_handler,          /* LCB_CNTL_TRACING_SAMPLE_RATE */
+    tracing_tail_based_handler,           /* LCB_CNTL_TRACING_TAIL_BASED */
+    http_maxconns_handler,                /* LCB_CNTL_HTTP_MAX_CONNECTIONS_PER_NODE */
+    http_warmup_handler,                  /* LCB_CNTL_HTTP_WARMUP_CONNECTIONS */
+    enable_http2_handler,                 /* LCB_CNTL_ENABLE_HTTP2 */
+    n1ql_cache_size_handler,              /* LCB_CNTL_N1QL_CACHE_SIZE */
+    n1ql_shared_cache_handler,            /* LCB_CNTL_N1QL_SHARED_CACHE */
+    n1ql_cache_stats_handler,             /* LCB_CNTL_N1QL_CACHE_STATS */
+    optimistic_negotiation_handler,       /* LCB_CNTL_OPTIMISTIC_NEGOTIATION */
+    tls_session_cache_handler,            /* LCB_CNTL_TLS_SESSION_CACHE */
+    tls_session_stats_handler,            /* LCB_CNTL_TLS_SESSION_STATS */
+    enable_ktls_handler,                  /* LCB_CNTL_ENABLE_KTLS */
+    pipeline_latency_handler,             /* LCB_CNTL_PIPELINE_LATENCY */
+    timeout_common,                       /* LCB_CNTL_DNS_CACHE_TTL */
+    kv_preconnect_handler,                /* LCB_CNTL_KV_PRECONNECT */
     nullptr
 };
 /* clang-format on */
@@ -1101,6 +1193,19 @@ static cntl_OPCODESTRS stropcode_map[] = {
     {"enable_errmap", LCB_CNTL_ENABLE_ERRMAP, convert_intbool},
     {"operation_metrics_flush_interval", LCB_CNTL_OP_METRICS_FLUSH_INTERVAL, convert_timevalue},
     {"enable_operation_metrics", LCB_CNTL_ENABLE_OP_METRICS, convert_intbool},
+    {"tracing_sample_rate", LCB_CNTL_TRACING_SAMPLE_RATE, convert_float},
+    {"tracing_tail_based", LCB_CNTL_TRACING_TAIL_BASED, convert_intbool},
+    {"http_max_connections_per_node", LCB_CNTL_HTTP_MAX_CONNECTIONS_PER_NODE, convert_SIZE},
+    {"http_warmup_connections", LCB_CNTL_HTTP_WARMUP_CONNECTIONS, convert_u32},
+    {"enable_http2", LCB_CNTL_ENABLE_HTTP2, convert_intbool},
+    {"n1ql_cache_size", LCB_CNTL_N1QL_CACHE_SIZE, convert_SIZE},
+    {"n1ql_shared_cache", LCB_CNTL_N1QL_SHARED_CACHE, convert_intbool},
+    {"optimistic_negotiation", LCB_CNTL_OPTIMISTIC_NEGOTIATION, convert_intbool},
+    {"tls_session_cache", LCB_CNTL_TLS_SESSION_CACHE, convert_intbool},
+    {"enable_ktls", LCB_CNTL_ENABLE_KTLS, convert_intbool},
+    {"pipeline_latency", LCB_CNTL_PIPELINE_LATENCY, convert_intbool},
+    {"dns_cache_ttl", LCB_CNTL_DNS_CACHE_TTL, convert_timevalue},
+    {"kv_preconnect", LCB_CNTL_KV_PRECONNECT, convert_intbool},
     {nullptr, -1}};
 
 #define CNTL_NUM_HANDLERS (sizeof(handlers) / sizeof(handlers[0]))
@@ -103,11 +103,16 @@ lcb_STATUS collcache_get(lcb_INSTANCE *instance, const char *scope, size_t nscop
     return LCB_ERR_COLLECTION_NOT_FOUND;
 }
 
+lcb_STATUS collcache_get(lcb_INSTANCE *instance, const lcb::collection_qualifier &collection, uint32_t *cid)
+{
+    return collcache_get(instance, collection.scope().c_str(), collection.scope().size(),
+                         collection.collection().c_str(), collection.collection().size(), cid);
+}
+
 lcb_STATUS collcache_get(lcb_INSTANCE *instance, lcb::collection_qualifier &collection)
 {
     uint32_t collection_id;
-    lcb_STATUS rc = collcache_get(instance, collection.scope().c_str(), collection.scope().size(),
-                                  collection.collection().c_str(), collection.collection().size(), &collection_id);
+    lcb_STATUS rc = collcache_get(instance, static_cast<const lcb::collection_qualifier &>(collection), &collection_id);
     if (rc != LCB_SUCCESS) {
         return rc;
     }
@@ -50,6 +50,7 @@ typedef lcb::CollectionCache lcb_COLLCACHE;
 
 lcb_STATUS collcache_get(lcb_INSTANCE *instance, const char *scope, size_t nscope, const char *collection,
                          size_t ncollection, uint32_t *cid);
+lcb_STATUS collcache_get(lcb_INSTANCE *instance, const lcb::collection_qualifier &collection, uint32_t *cid);
 lcb_STATUS collcache_get(lcb_INSTANCE *instance, lcb::collection_qualifier &collection);
 std::string collcache_build_spec(const char *scope, size_t nscope, const char *collection, size_t ncollection);
 
@@ -26,10 +26,62 @@ static void invoke_pending(Queue *);
 
 #define DOCQ_DELAY_US 200000
 
+const unsigned AdaptiveWindow::latency_factor;
+const hrtime_t AdaptiveWindow::min_baseline;
+
+AdaptiveWindow::AdaptiveWindow(unsigned initial, unsigned maximum)
+    : window_(initial ? initial : 1), maximum_(maximum ? maximum : 1)
+{
+    if (window_ > maximum_) {
+        window_ = maximum_;
+    }
+}
+
+void AdaptiveWindow::on_success(hrtime_t sent, hrtime_t now)
+{
+    hrtime_t latency = now > sent ? now - sent : 0;
+    if (baseline_ == 0 || latency < baseline_) {
+        baseline_ = latency;
+    } else {
+        /* let the baseline follow the latency slowly, so that single lucky
+         * response does not make all the following ones look congested */
+        baseline_ += (latency - baseline_) / 64;
+    }
+
+    hrtime_t threshold = (baseline_ < min_baseline ? min_baseline : baseline_) * latency_factor;
+    if (latency > threshold) {
+        decrease(sent, now);
+        return;
+    }
+    if (window_ < maximum_ && ++acked_ >= window_) {
+        window_++;
+        acked_ = 0;
+    }
+}
+
+void AdaptiveWindow::on_failure(hrtime_t sent, hrtime_t now)
+{
+    decrease(sent, now);
+}
+
+void AdaptiveWindow::decrease(hrtime_t sent, hrtime_t now)
+{
+    if (last_decrease_ && sent <= last_decrease_) {
+        /* the window has been decreased already during this round trip */
+        return;
+    }
+    window_ /= 2;
+    if (window_ < 1) {
+        window_ = 1;
+    }
+    acked_ = 0;
+    last_decrease_ = now;
+    decreases_++;
+}
+
 Queue::Queue(lcb_INSTANCE *instance_)
     : instance(instance_), timer(lcbio_timer_new(instance->iotable, this, docreq_handler))
 {
-    memset(&pending_gets, 0, sizeof pending_gets);
     memset(&cb_queue, 0, sizeof cb_queue);
 }
 
@@ -52,16 +104,77 @@ void Queue::cancel()
     cancelled = true;
 }
 
+unsigned Queue::window_size() const
+{
+    unsigned total = 0;
+    for (const auto &node : nodes) {
+        total += node.window.size();
+    }
+    return total;
+}
+
+Queue::Node &Queue::node_of(DocRequest *req)
+{
+    int vbid = 0, idx = -1;
+    if (instance->cmdq.config != nullptr) {
+        lcb_KEYBUF key{};
+        key.type = LCB_KV_COPY;
+        key.contig.bytes = req->docid.iov_base;
+        key.contig.nbytes = req->docid.iov_len;
+        mcreq_map_key(&instance->cmdq, &key, MCREQ_PKT_BASESIZE, &vbid, &idx);
+    }
+    req->node = idx < 0 ? 0 : static_cast<std::size_t>(idx) + 1;
+    while (nodes.size() <= req->node) {
+        unsigned initial = default_max_pending_docreq;
+        if (initial > max_pending_response) {
+            initial = max_pending_response;
+        }
+        nodes.emplace_back(initial, max_pending_response);
+    }
+    return nodes[req->node];
+}
+
+static bool has_room(const Queue *q)
+{
+    if (q->n_awaiting_response >= q->max_pending_response) {
+        return false;
+    }
+    for (const auto &node : q->nodes) {
+        if (!node.pending.empty() && node.inflight < node.window.size()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void update_throttle(Queue *q)
+{
+    unsigned window = q->window_size();
+    if (window > q->max_pending_response) {
+        window = q->max_pending_response;
+    }
+    unsigned limit = 2 * window;
+    if (limit < q->min_batch_size) {
+        limit = q->min_batch_size;
+    }
+    if (!q->throttled && q->n_awaiting_schedule > limit) {
+        q->throttled = true;
+        q->cb_throttle(q, 1);
+    } else if (q->throttled && q->n_awaiting_schedule <= limit / 2) {
+        q->throttled = false;
+        q->cb_throttle(q, 0);
+    }
+}
+
 /* Calling this function ensures that the request will be scheduled in due
  * time. This may be done at the next event loop iteration, or after a delay
  * depending on how many items are actually found within the queue. */
 static void docq_poke(Queue *q)
 {
-    if (q->n_awaiting_response < q->max_pending_response) {
-        if (q->n_awaiting_schedule > q->min_batch_size) {
-            lcbio_async_signal(q->timer);
-            q->cb_throttle(q, 0);
-        }
+    /* while responses are arriving, the window slots are refilled right away,
+     * otherwise wait for the batch to accumulate */
+    if ((q->n_awaiting_schedule > q->min_batch_size || q->n_awaiting_response) && has_room(q)) {
+        lcbio_async_signal(q->timer);
     }
 
     if (!lcbio_timer_armed(q->timer)) {
@@ -71,57 +184,84 @@ static void docq_poke(Queue *q)
 
 void Queue::add(DocRequest *req)
 {
-    sllist_append(&pending_gets, &req->slnode);
-    n_awaiting_schedule++;
     req->parent = this;
     req->ready = 0;
+    req->start = 0;
+    node_of(req).pending.push_back(req);
+    /* requests are delivered in the order they were added, regardless of the node */
+    sllist_append(&cb_queue, &req->slnode);
+    n_awaiting_schedule++;
+    if (stats.first_request == 0) {
+        stats.first_request = gethrtime();
+    }
     ref();
+    update_throttle(this);
     docq_poke(this);
 }
 
+void Queue::complete(DocRequest *req, lcb_STATUS rc)
+{
+    Node &node = nodes[req->node];
+    hrtime_t now = gethrtime();
+
+    n_awaiting_response--;
+    node.inflight--;
+    if (rc == LCB_ERR_TIMEOUT || rc == LCB_ERR_TEMPORARY_FAILURE || LCB_ERROR_IS_NETWORK(rc)) {
+        node.window.on_failure(req->start, now);
+    } else {
+        node.window.on_success(req->start, now);
+    }
+    if (rc == LCB_SUCCESS) {
+        stats.fetched++;
+    } else {
+        stats.failed++;
+    }
+    stats.last_response = now;
+}
+
 static void docreq_handler(void *arg)
 {
     auto *q = reinterpret_cast<Queue *>(arg);
-    sllist_iterator iter;
     lcb_INSTANCE *instance = q->instance;
+    hrtime_t now = gethrtime();
 
+    /* every node gets its own batch, which is flushed to its pipeline at once */
     lcb_sched_enter(instance);
-    SLLIST_ITERFOR(&q->pending_gets, &iter)
-    {
-        DocRequest *cont = SLLIST_ITEM(iter.cur, DocRequest, slnode);
+    for (auto &node : q->nodes) {
+        while (!node.pending.empty() &&
+               (q->cancelled ||
+                (node.inflight < node.window.size() && q->n_awaiting_response < q->max_pending_response))) {
+            DocRequest *cont = node.pending.front();
+            node.pending.pop_front();
+            q->n_awaiting_schedule--;
 
-        if (q->n_awaiting_response > q->max_pending_response) {
-            lcbio_timer_rearm(q->timer, DOCQ_DELAY_US);
-            q->cb_throttle(q, 1);
-            break;
-        }
-
-        q->n_awaiting_schedule--;
-
-        if (q->cancelled) {
-            cont->docresp.ctx.rc = LCB_ERR_SDK_INTERNAL;
-            cont->ready = 1;
-
-        } else {
-            lcb_STATUS rc;
-            rc = q->cb_schedule(q, cont);
-            if (rc != LCB_SUCCESS) {
-                cont->docresp.ctx.rc = rc;
+            if (q->cancelled) {
+                cont->docresp.ctx.rc = LCB_ERR_SDK_INTERNAL;
                 cont->ready = 1;
+
             } else {
-                q->n_awaiting_response++;
+                lcb_STATUS rc;
+                cont->start = now;
+                rc = q->cb_schedule(q, cont);
+                if (rc != LCB_SUCCESS) {
+                    cont->docresp.ctx.rc = rc;
+                    cont->ready = 1;
+                    q->stats.failed++;
+                } else {
+                    q->n_awaiting_response++;
+                    node.inflight++;
+                }
             }
         }
-        sllist_iter_remove(&q->pending_gets, &iter);
-        sllist_append(&q->cb_queue, &cont->slnode);
     }
-
     lcb_sched_leave(instance);
     lcb_sched_flush(instance);
 
-    if (q->n_awaiting_schedule < q->min_batch_size) {
-        q->cb_throttle(q, 0);
+    unsigned window = q->window_size();
+    if (window > q->stats.max_window) {
+        q->stats.max_window = window;
     }
+    update_throttle(q);
 
     /* Ensure we're called again */
     docq_poke(q);
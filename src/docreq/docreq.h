@@ -29,6 +29,9 @@
 
 #include "capi/cmd_get.hh"
 
+#include <deque>
+#include <vector>
+
 namespace lcb
 {
 namespace docreq
@@ -37,10 +40,67 @@ namespace docreq
 struct Queue;
 struct DocRequest;
 
+/**
+ * Window of the document fetches, which might be in flight for single KV
+ * node (AIMD).
+ *
+ * The window grows by one document per round trip while the latency stays
+ * close to the lowest recently observed one, and it is halved when the node
+ * reports error, or the latency exceeds the baseline by latency_factor.
+ * The window is decreased only once per round trip: responses to the
+ * requests, which were sent before the last decrease, do not shrink it again.
+ */
+class AdaptiveWindow
+{
+  public:
+    AdaptiveWindow(unsigned initial, unsigned maximum);
+
+    void on_success(hrtime_t sent, hrtime_t now);
+    void on_failure(hrtime_t sent, hrtime_t now);
+
+    /** Number of documents, which might be fetched concurrently */
+    unsigned size() const
+    {
+        return window_;
+    }
+
+    unsigned maximum() const
+    {
+        return maximum_;
+    }
+
+    hrtime_t baseline() const
+    {
+        return baseline_;
+    }
+
+    unsigned decreases() const
+    {
+        return decreases_;
+    }
+
+    static const unsigned latency_factor{4};
+    /** Latencies below this value (in nanoseconds) are not considered as congestion */
+    static const hrtime_t min_baseline{100000};
+
+  private:
+    void decrease(hrtime_t sent, hrtime_t now);
+
+    unsigned window_;
+    unsigned maximum_;
+    /** Successful responses since the last growth of the window */
+    unsigned acked_{0};
+    hrtime_t baseline_{0};
+    hrtime_t last_decrease_{0};
+    unsigned decreases_{0};
+};
+
 struct Queue {
     explicit Queue(lcb_INSTANCE *);
     ~Queue();
     void add(DocRequest *);
+    /** Must be called by the get callback before the document is marked as ready */
+    void complete(DocRequest *, lcb_STATUS rc);
     void unref();
     void ref()
     {
@@ -52,6 +112,8 @@ struct Queue {
     {
         return n_awaiting_response || n_awaiting_schedule;
     }
+    /** Sum of the windows of all nodes */
+    unsigned window_size() const;
 
     lcb_INSTANCE *instance;
     void *parent{nullptr};
@@ -73,12 +135,28 @@ struct Queue {
      * @param enabled Whether throttling has been enabled or disabled */
     void (*cb_throttle)(struct Queue *, int enabled){nullptr};
 
-    /**This queue holds requests which were not yet issued to the library
-     * via lcb_get3(). This list is aggregated after each chunk callback and
-     * sent as a batch*/
-    sllist_root pending_gets{};
+    struct Node {
+        explicit Node(unsigned initial, unsigned maximum) : window(initial, maximum) {}
+
+        /**Requests which were not yet issued to the library via lcb_get3().
+         * They are aggregated after each chunk callback and sent as a batch */
+        std::deque<DocRequest *> pending{};
+        unsigned inflight{0};
+        AdaptiveWindow window;
+    };
 
-    /**This queue holds the requests which were already passed to lcb_get3().
+    struct Stats {
+        uint64_t fetched{0};
+        uint64_t failed{0};
+        unsigned max_window{0};
+        hrtime_t first_request{0};
+        hrtime_t last_response{0};
+    };
+
+    /** Doc requests grouped by the owner of the vBucket. The first one holds the keys, which cannot be mapped */
+    std::vector<Node> nodes{};
+
+    /**This queue holds all the requests in the order they were added.
      * It is popped when the callback arrives (and is popped in order!) */
     sllist_root cb_queue{};
 
@@ -86,12 +164,18 @@ struct Queue {
     unsigned n_awaiting_response{0};
 
     static const int default_max_pending_docreq{10};
+    /** Limit of the documents in flight for all nodes together, every window is capped by it as well */
     unsigned max_pending_response{default_max_pending_docreq};
 
     static const int default_min_sched_size{5};
     unsigned min_batch_size{default_min_sched_size};
     unsigned cancelled{false};
+    unsigned throttled{false};
     unsigned refcount{1};
+    Stats stats{};
+
+  private:
+    Node &node_of(DocRequest *);
 };
 
 struct DocRequest {
@@ -103,6 +187,9 @@ struct DocRequest {
     /* To be filled in by the subclass */
     lcb_IOV docid;
     unsigned ready;
+    /* Index of the node in Queue::nodes */
+    std::size_t node;
+    hrtime_t start;
 };
 
 } // namespace docreq
@@ -157,6 +157,12 @@ lcb_STATUS lcb_map_error(lcb_INSTANCE *instance, int in)
             return LCB_ERR_DURABILITY_AMBIGUOUS;
         case PROTOCOL_BINARY_RESPONSE_LOCKED:
             return LCB_ERR_DOCUMENT_LOCKED;
+        case PROTOCOL_BINARY_RESPONSE_RANGE_SCAN_MORE:
+        case PROTOCOL_BINARY_RESPONSE_RANGE_SCAN_COMPLETE:
+            return LCB_SUCCESS;
+        case PROTOCOL_BINARY_RESPONSE_RANGE_SCAN_CANCELLED:
+            return LCB_ERR_REQUEST_CANCELED;
+
         case PROTOCOL_BINARY_RATE_LIMITED_NETWORK_INGRESS:
         case PROTOCOL_BINARY_RATE_LIMITED_NETWORK_EGRESS:
         case PROTOCOL_BINARY_RATE_LIMITED_MAX_CONNECTIONS:
@@ -493,30 +499,6 @@ static void H_getreplica(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedRes
     free(freeptr);
 }
 
-static int lcb_sdresult_next(const lcb_RESPSUBDOC *resp, lcb_SDENTRY *ent, size_t *iter);
-
-static void lcb_sdresult_parse(lcb_RESPSUBDOC *resp, lcb_CALLBACK_TYPE type)
-{
-    std::vector<lcb_SDENTRY> results;
-    size_t iter = 0, oix = 0;
-    lcb_SDENTRY ent;
-    results.resize(resp->nres);
-
-    while (lcb_sdresult_next(resp, &ent, &iter)) {
-        size_t index = oix++;
-        if (type == LCB_CALLBACK_SDMUTATE) {
-            index = ent.index;
-        }
-        results[index] = ent;
-    }
-    if (resp->nres) {
-        resp->res = (lcb_SDENTRY *)calloc(resp->nres, sizeof(lcb_SDENTRY));
-        for (size_t ii = 0; ii < resp->nres; ii++) {
-            resp->res[ii] = results[ii];
-        }
-    }
-}
-
 static void H_subdoc(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedResponse *response, lcb_STATUS immerr)
 {
     lcb_INSTANCE *o = get_instance(pipeline);
@@ -524,7 +506,6 @@ static void H_subdoc(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedRespons
     lcb_CALLBACK_TYPE cbtype;
     init_resp(o, pipeline, response, request, immerr, &resp);
     resp.rflags |= LCB_RESP_F_FINAL;
-    resp.res = nullptr;
 
     /* For mutations, add the mutation token */
     switch (response->opcode()) {
@@ -547,7 +528,6 @@ static void H_subdoc(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedRespons
         if (resp.ctx.rc == LCB_SUCCESS) {
             resp.responses = response;
             resp.nres = MCREQ_PKT_RDATA(request)->nsubreq;
-            lcb_sdresult_parse(&resp, cbtype);
         } else {
             handle_error_info(response, resp);
         }
@@ -556,7 +536,6 @@ static void H_subdoc(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedRespons
         resp.rflags |= LCB_RESP_F_SDSINGLE;
         if (resp.ctx.rc == LCB_SUCCESS || LCB_ERROR_IS_SUBDOC(resp.ctx.rc)) {
             resp.responses = response;
-            lcb_sdresult_parse(&resp, cbtype);
         } else {
             handle_error_info(response, resp);
         }
@@ -570,121 +549,6 @@ static void H_subdoc(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedRespons
     }
 
     invoke_callback(request, o, &resp, cbtype);
-    free(resp.res);
-}
-
-static int sdlookup_next(const MemcachedResponse *response, lcb_SDENTRY *ent, size_t *iter)
-{
-    const char *buf;
-    uint16_t rc;
-    uint32_t vlen;
-
-    if (*iter == response->vallen()) {
-        return 0;
-    }
-
-    buf = response->value();
-    buf += *iter;
-
-    memcpy(&rc, buf, 2);
-    memcpy(&vlen, buf + 2, 4);
-
-    rc = ntohs(rc);
-    vlen = ntohl(vlen);
-
-    ent->status = lcb_map_error(nullptr, rc);
-    ent->nvalue = vlen;
-
-    if (ent->status == LCB_SUCCESS) {
-        ent->value = buf + 6;
-    } else {
-        ent->value = nullptr;
-        ent->nvalue = 0;
-    }
-
-    *iter += (6 + vlen);
-    return 1;
-}
-
-static int sdmutate_next(const MemcachedResponse *response, lcb_SDENTRY *ent, size_t *iter)
-{
-    const char *buf, *buf_end;
-    uint16_t rc;
-    uint32_t vlen;
-
-    if (*iter == response->vallen()) {
-        return 0;
-    }
-
-    buf_end = (const char *)response->value() + response->vallen();
-    buf = ((const char *)(response->value())) + *iter;
-
-#define ADVANCE_BUF(sz)                                                                                                \
-    buf += sz;                                                                                                         \
-    *iter += sz;                                                                                                       \
-    lcb_assert(buf <= buf_end)
-
-    /* Index */
-    ent->index = *(lcb_U8 *)buf;
-    ADVANCE_BUF(1);
-
-    /* Status */
-    memcpy(&rc, buf, 2);
-    ADVANCE_BUF(2);
-
-    rc = ntohs(rc);
-    ent->status = lcb_map_error(nullptr, rc);
-
-    if (rc == PROTOCOL_BINARY_RESPONSE_SUCCESS) {
-        memcpy(&vlen, buf, 4);
-        ADVANCE_BUF(4);
-
-        vlen = ntohl(vlen);
-        ent->nvalue = vlen;
-        ent->value = buf;
-        ADVANCE_BUF(vlen);
-
-    } else {
-        ent->value = nullptr;
-        ent->nvalue = 0;
-    }
-
-    (void)buf_end;
-    return 1;
-#undef ADVANCE_BUF
-}
-
-static int lcb_sdresult_next(const lcb_RESPSUBDOC *resp, lcb_SDENTRY *ent, size_t *iter)
-
-{
-    size_t iter_s = 0;
-    const auto *response = reinterpret_cast<const MemcachedResponse *>(resp->responses);
-    if (!response) {
-        fprintf(stderr, "no response set\n");
-        return 0;
-    }
-    if (!iter) {
-        /* Single response */
-        iter = &iter_s;
-    }
-
-    switch (response->opcode()) {
-        case PROTOCOL_BINARY_CMD_SUBDOC_MULTI_LOOKUP:
-            return sdlookup_next(response, ent, iter);
-        case PROTOCOL_BINARY_CMD_SUBDOC_MULTI_MUTATION:
-            return sdmutate_next(response, ent, iter);
-        default:
-            if (*iter) {
-                return 0;
-            }
-            *iter = 1;
-
-            ent->status = lcb_map_error(nullptr, response->status());
-            ent->value = response->value();
-            ent->nvalue = response->vallen();
-            ent->index = 0;
-            return 1;
-    }
 }
 
 static void H_delete(mc_PIPELINE *pipeline, mc_PACKET *packet, MemcachedResponse *response, lcb_STATUS immerr)
@@ -943,6 +807,30 @@ static void H_collections_get_cid(mc_PIPELINE *pipeline, mc_PACKET *request, Mem
     }
 }
 
+/**
+ * RANGE_SCAN_CONTINUE streams the items with success status, and ends the
+ * batch with "more" or "complete" status. The operation is traced and timed
+ * only once, by the response which ends it.
+ */
+static bool is_range_scan_item(const MemcachedResponse *response, lcb_STATUS immerr)
+{
+    return immerr == LCB_SUCCESS && response->opcode() == PROTOCOL_BINARY_CMD_RANGE_SCAN_CONTINUE &&
+           response->status() == PROTOCOL_BINARY_RESPONSE_SUCCESS;
+}
+
+static void H_range_scan(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedResponse *response, lcb_STATUS immerr)
+{
+    lcb_INSTANCE *root = get_instance(pipeline);
+    lcb_RESPNOOP resp{};
+    make_error(root, &resp, response, immerr, request);
+    if (!is_range_scan_item(response, immerr)) {
+        lcb::trace::finish_kv_span(pipeline, request, response);
+    }
+    /* the scan parses the payload itself, response is not available on client side errors */
+    request->u_rdata.exdata->procs->handler(pipeline, request, LCB_CALLBACK_DEFAULT, resp.ctx.rc,
+                                            immerr == LCB_SUCCESS ? response : nullptr);
+}
+
 static void H_noop(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedResponse *response, lcb_STATUS immerr)
 {
     lcb_INSTANCE *root = get_instance(pipeline);
@@ -1008,12 +896,15 @@ static void H_select_bucket(mc_PIPELINE *pipeline, mc_PACKET *request, Memcached
     }
 }
 
-static void record_metrics(mc_PIPELINE *pipeline, mc_PACKET *req, MemcachedResponse *)
+static void record_metrics(mc_PIPELINE *pipeline, mc_PACKET *req, MemcachedResponse *res, lcb_STATUS immerr)
 {
     lcb_INSTANCE *instance = get_instance(pipeline);
     if (instance == nullptr) {
         return; /* the instance already destroyed */
     }
+    if (is_range_scan_item(res, immerr)) {
+        return;
+    }
     if (
 #ifdef HAVE_DTRACE
         1
@@ -1039,7 +930,7 @@ static void dispatch_ufwd_error(mc_PIPELINE *pipeline, mc_PACKET *req, lcb_STATU
 
 int mcreq_dispatch_response(mc_PIPELINE *pipeline, mc_PACKET *req, MemcachedResponse *res, lcb_STATUS immerr)
 {
-    record_metrics(pipeline, req, res);
+    record_metrics(pipeline, req, res, immerr);
 
     if (req->flags & MCREQ_F_UFWD) {
         dispatch_ufwd_error(pipeline, req, immerr);
@@ -1123,6 +1014,11 @@ int mcreq_dispatch_response(mc_PIPELINE *pipeline, mc_PACKET *req, MemcachedResp
         case PROTOCOL_BINARY_CMD_GET_META:
             INVOKE_OP(H_exists);
 
+        case PROTOCOL_BINARY_CMD_RANGE_SCAN_CREATE:
+        case PROTOCOL_BINARY_CMD_RANGE_SCAN_CONTINUE:
+        case PROTOCOL_BINARY_CMD_RANGE_SCAN_CANCEL:
+            INVOKE_OP(H_range_scan);
+
         default:
             fprintf(stderr, "COUCHBASE: Received unknown opcode=0x%x\n", res->opcode());
             return -1;
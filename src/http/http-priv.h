@@ -25,9 +25,12 @@
 #include <lcbht/lcbht.h>
 #include "contrib/http_parser/http_parser.h"
 #include "http.h"
+#include "http2.h"
 #include <string>
 #include <vector>
 #include <set>
+#include <map>
+#include <memory>
 
 namespace lcb
 {
@@ -41,6 +44,39 @@ struct Header {
     Header(const std::string &key_, const std::string &value_) : key(key_), value(value_) {}
 };
 
+/**
+ * Cache of the header block which is the same for all requests sent with the
+ * given credentials (User-Agent, Accept and Authorization). The block is
+ * formatted (and the credentials are base64-encoded) once, and then copied
+ * into the preamble of every request.
+ */
+class HeaderCache
+{
+  public:
+    typedef std::shared_ptr<const std::string> Block;
+
+    /**
+     * @param settings the settings used to build the User-Agent header
+     * @param username the user (empty if the Authorization header should be omitted)
+     * @param password the password
+     * @return the header block, or empty pointer if the credentials cannot be encoded
+     */
+    Block get(const lcb_settings *settings, const std::string &username, const std::string &password);
+
+    size_t size() const
+    {
+        return entries.size();
+    }
+
+  private:
+    /** Maximum number of the cached credential sets. The cache is reset once reached */
+    static const size_t max_entries = 64;
+
+    std::map<std::string, Block> entries;
+    /** Value of the client_string, which has been used to build the entries */
+    std::string client_string;
+};
+
 struct Request {
     /**
      * Initializes the request. This simply copies the relevant fields from the
@@ -159,10 +195,18 @@ struct Request {
     }
 
     // Helper methods to populate request buffer
+    void build_preamble();
     inline void add_to_preamble(const char *);
     inline void add_to_preamble(const std::string &);
     inline void add_to_preamble(const Header &);
 
+    /**
+     * Fill the header list of the request sent over HTTP/2: the pseudo-header
+     * fields, followed by the same headers as in the preamble, with the names
+     * in lowercase, and without the connection-specific ones
+     */
+    void build_http2_headers(std::vector<lcb::htparse::MimeHeader> &fields) const;
+
     /**
      * Starts the IO on the current request. This really belongs in submit(),
      * but submit() handles building the request while start_io() sets up
@@ -175,10 +219,29 @@ struct Request {
      */
     void close_io();
 
+    /** @return the socket of the connection used by the request, or NULL */
+    lcbio_SOCKET *get_socket() const;
+
     // Helper functions for parsing response data from network
     inline unsigned handle_parse_chunked(const char *buf, unsigned nbuf);
     inline void assign_response_headers(const lcb::htparse::Response &);
 
+    /**
+     * Called once the headers of the response have been received (by either
+     * HTTP/1.1 parser or HTTP/2 session)
+     * @return false if the response is a redirect (see ::pending_redirect)
+     */
+    bool handle_response_headers(const lcb::htparse::Response &);
+
+    /** Pass the chunk of the response body to the callback, or append it to the body */
+    void handle_response_body(const char *buf, unsigned nbuf);
+
+    /** Called once the response is complete. Invokes the final callback */
+    void handle_response_done();
+
+    /** Refresh the configuration and transfer control to redirect() */
+    void handle_redirect();
+
     /**
      * Called when a redirect has happened. pending_redirect must not be empty.
      * This will transfer control to the redirect call. If there is an error
@@ -312,6 +375,7 @@ struct Request {
     };
     int status;                          /**< OR'd flags of ::State */
     std::vector<Header> request_headers; /**< List of request headers */
+    HeaderCache::Block common_headers;   /**< Cached User-Agent, Accept and Authorization headers */
 
     /**
      * Response headers for callback (array of char*). Buffers are mapped to
@@ -331,6 +395,12 @@ struct Request {
     lcbio_pTIMER timer;
     lcb::io::ConnectionRequest *creq{};
 
+    /** Whether the request is sent over HTTP/2 (see LCB_CNTL_ENABLE_HTTP2) */
+    bool http2{false};
+    /** HTTP/2 connection and stream of the request, while the stream is open */
+    Http2Session *h2session{nullptr};
+    Http2Stream *h2stream{nullptr};
+
     /** HTTP Protocol parser */
     lcb::htparse::Parser *parser;
 
@@ -25,6 +25,9 @@
 
 #include "../capi/cmd_http.hh"
 
+#include <algorithm>
+#include <cctype>
+
 LIBCOUCHBASE_API lcb_STATUS lcb_resphttp_status(const lcb_RESPHTTP *resp)
 {
     return resp->ctx.rc;
@@ -193,6 +196,44 @@ static const char *method_strings[] = {
     "DELETE " /* LCB_HTTP_METHOD_DELETE */
 };
 
+HeaderCache::Block HeaderCache::get(const lcb_settings *settings, const std::string &username,
+                                    const std::string &password)
+{
+    const char *cs = settings->client_string ? settings->client_string : "";
+    if (client_string != cs) {
+        entries.clear();
+        client_string = cs;
+    }
+
+    std::string key;
+    key.reserve(username.size() + password.size() + 1);
+    key.append(username).append(1, ':').append(password);
+    auto it = entries.find(key);
+    if (it != entries.end()) {
+        return it->second;
+    }
+
+    std::string block("User-Agent: " LCB_CLIENT_ID);
+    if (!client_string.empty()) {
+        block.append(" ").append(client_string);
+    }
+    block.append("\r\nAccept: application/json\r\n");
+    if (!username.empty()) {
+        char auth[256];
+        if (lcb_base64_encode(key.c_str(), key.size(), auth, sizeof(auth)) == -1) {
+            return Block();
+        }
+        block.append("Authorization: Basic ").append(auth).append("\r\n");
+    }
+
+    if (entries.size() >= max_entries) {
+        entries.clear();
+    }
+    Block result = std::make_shared<const std::string>(std::move(block));
+    entries.insert(std::make_pair(std::move(key), result));
+    return result;
+}
+
 void Request::decref()
 {
     lcb_assert(refcount > 0);
@@ -341,6 +382,11 @@ void Request::finish(lcb_STATUS error)
     /* Cancel the timeout */
     lcbio_timer_disarm(timer);
 
+    /* Reset the HTTP/2 stream, the rest of the response is not needed */
+    if (h2session) {
+        h2session->cancel(this);
+    }
+
     /* Remove the initial refcount=1 (set from lcb_http3). Typically this will
      * also free the request (though this is dependent on pending I/O operations) */
     decref();
@@ -362,26 +408,10 @@ void Request::add_to_preamble(const Header &header)
     add_to_preamble("\r\n");
 }
 
-lcb_STATUS Request::submit()
+void Request::build_preamble()
 {
-    lcb_STATUS rc;
-    lcb_host_t reqhost = {"", "", 0};
-
-    // Stop any pending socket/request
-    close_io();
-
-    if (host.size() > sizeof reqhost.host || port.size() > sizeof reqhost.port) {
-        decref();
-        return LCB_ERR_VALUE_TOO_LARGE;
-    }
-
     preamble.clear();
-
-    strncpy(reqhost.host, host.c_str(), host.size());
-    strncpy(reqhost.port, port.c_str(), port.size());
-    reqhost.host[host.size()] = '\0';
-    reqhost.port[port.size()] = '\0';
-    reqhost.ipv6 = ipv6;
+    preamble.reserve(url.size() + (common_headers ? common_headers->size() : 0) + 128);
 
     // Add the HTTP verb (e.g. "GET ") [note, the string contains a trailing space]
     add_to_preamble(method_strings[method]);
@@ -391,8 +421,6 @@ lcb_STATUS Request::submit()
     size_t path_off = url_info.field_data[UF_PATH].off;
     size_t path_len = url.size() - path_off;
     preamble.insert(preamble.end(), url_s + path_off, url_s + path_off + path_len);
-    lcb_log(LOGARGS(this, TRACE), LOGFMT "%s %s. Body=%lu bytes", LOGID(this), method_strings[method], url.c_str(),
-            (unsigned long int)body.size());
 
     add_to_preamble(" HTTP/1.1\r\n");
 
@@ -405,6 +433,11 @@ lcb_STATUS Request::submit()
     add_to_preamble(port);
     add_to_preamble("\r\n");
 
+    // Add the headers shared by all requests with the same credentials
+    if (common_headers) {
+        add_to_preamble(*common_headers);
+    }
+
     // Add the rest of the headers
     std::vector<Header>::const_iterator ii = request_headers.begin();
     for (; ii != request_headers.end(); ++ii) {
@@ -412,6 +445,86 @@ lcb_STATUS Request::submit()
     }
     add_to_preamble("\r\n");
     // If there is a body, it is appended in the IO stage
+}
+
+static void add_http2_header(std::vector<lcb::htparse::MimeHeader> &fields, const char *key, size_t nkey,
+                             const std::string &value)
+{
+    static const char *connection_headers[] = {"connection", "host",    "keep-alive",       "proxy-connection",
+                                               "te",         "upgrade", "transfer-encoding"};
+    std::string name(key, nkey);
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    for (const char *connection_header : connection_headers) {
+        if (name == connection_header) {
+            return;
+        }
+    }
+    fields.push_back({name, value});
+}
+
+void Request::build_http2_headers(std::vector<lcb::htparse::MimeHeader> &fields) const
+{
+    static const char *methods[] = {"GET", "POST", "PUT", "DELETE"};
+    size_t path_off = url_info.field_data[UF_PATH].off;
+
+    fields.push_back({":method", methods[method]});
+    fields.push_back({":scheme", url.compare(0, 8, "https://") == 0 ? "https" : "http"});
+    fields.push_back({":authority", peer});
+    fields.push_back({":path", url.substr(path_off)});
+
+    if (common_headers) {
+        // "Name: value\r\n" lines
+        const std::string &block = *common_headers;
+        size_t pos = 0;
+        while (pos < block.size()) {
+            size_t eol = block.find("\r\n", pos);
+            if (eol == std::string::npos) {
+                eol = block.size();
+            }
+            size_t colon = block.find(':', pos);
+            if (colon < eol) {
+                size_t value_off = block.find_first_not_of(' ', colon + 1);
+                if (value_off > eol) {
+                    value_off = eol;
+                }
+                add_http2_header(fields, block.data() + pos, colon - pos, block.substr(value_off, eol - value_off));
+            }
+            pos = eol + 2;
+        }
+    }
+    for (const auto &header : request_headers) {
+        add_http2_header(fields, header.key.data(), header.key.size(), header.value);
+    }
+}
+
+lcb_STATUS Request::submit()
+{
+    lcb_STATUS rc;
+    lcb_host_t reqhost = {"", "", 0};
+
+    // Stop any pending socket/request
+    close_io();
+
+    if (host.size() > sizeof reqhost.host || port.size() > sizeof reqhost.port) {
+        decref();
+        return LCB_ERR_VALUE_TOO_LARGE;
+    }
+
+    strncpy(reqhost.host, host.c_str(), host.size());
+    strncpy(reqhost.port, port.c_str(), port.size());
+    reqhost.host[host.size()] = '\0';
+    reqhost.port[port.size()] = '\0';
+    reqhost.ipv6 = ipv6;
+
+    lcb_log(LOGARGS(this, TRACE), LOGFMT "%s %s. Body=%lu bytes", LOGID(this), method_strings[method], url.c_str(),
+            (unsigned long int)body.size());
+
+    // The hosts which have answered the HTTP/2 preface with HTTP/1.x get the
+    // requests over HTTP/1.1
+    http2 = LCBT_SETTING(instance, enable_http2) && !instance->http2_pool->is_http1(reqhost);
+    if (!http2) {
+        build_preamble();
+    }
 
     rc = start_io(reqhost);
 
@@ -689,27 +802,15 @@ lcb_STATUS Request::setup_inputs(const lcb_CMDHTTP *cmd)
         return rc;
     }
 
-    std::string ua(LCB_CLIENT_ID);
-    if (instance->settings->client_string) {
-        ua.append(" ").append(instance->settings->client_string);
+    common_headers = instance->http_headers->get(instance->settings, username, password);
+    if (!common_headers) {
+        return LCB_ERR_INVALID_ARGUMENT;
     }
-    add_header("User-Agent", ua);
 
     if (instance->http_sockpool->get_options().maxidle == 0 || !is_data_request()) {
         add_header("Connection", "close");
     }
 
-    add_header("Accept", "application/json");
-    if (!username.empty()) {
-        char auth[256];
-        std::string upassbuf;
-        upassbuf.append(username).append(":").append(password);
-        if (lcb_base64_encode(upassbuf.c_str(), upassbuf.size(), auth, sizeof(auth)) == -1) {
-            return LCB_ERR_INVALID_ARGUMENT;
-        }
-        add_header("Authorization", std::string("Basic ") + auth);
-    }
-
     if (!body.empty()) {
         char lenbuf[64];
         sprintf(lenbuf, "%lu", (unsigned long int)body.size());
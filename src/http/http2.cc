@@ -0,0 +1,1062 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "internal.h"
+#include "logging.h"
+#include "settings.h"
+#include "http-priv.h"
+#include "http2.h"
+#include <lcbio/ssl.h>
+#include <algorithm>
+
+#define LOGARGS(s, lvl) (s)->settings, "http2", LCB_LOG_##lvl, __FILE__, __LINE__
+#define LOGFMT "<%s%s%s:%s> (SESS=%p) "
+#define LOGID(s) ((s)->host.ipv6 ? "[" : ""), (s)->host.host, ((s)->host.ipv6 ? "]" : ""), (s)->host.port, (void *)(s)
+
+using namespace lcb::http;
+using lcb::htparse::MimeHeader;
+
+namespace
+{
+enum FrameType {
+    FRAME_DATA = 0x0,
+    FRAME_HEADERS = 0x1,
+    FRAME_PRIORITY = 0x2,
+    FRAME_RST_STREAM = 0x3,
+    FRAME_SETTINGS = 0x4,
+    FRAME_PUSH_PROMISE = 0x5,
+    FRAME_PING = 0x6,
+    FRAME_GOAWAY = 0x7,
+    FRAME_WINDOW_UPDATE = 0x8,
+    FRAME_CONTINUATION = 0x9
+};
+
+enum FrameFlag {
+    FLAG_END_STREAM = 0x1,
+    FLAG_ACK = 0x1,
+    FLAG_END_HEADERS = 0x4,
+    FLAG_PADDED = 0x8,
+    FLAG_PRIORITY = 0x20
+};
+
+enum SettingId {
+    SETTING_HEADER_TABLE_SIZE = 0x1,
+    SETTING_ENABLE_PUSH = 0x2,
+    SETTING_MAX_CONCURRENT_STREAMS = 0x3,
+    SETTING_INITIAL_WINDOW_SIZE = 0x4,
+    SETTING_MAX_FRAME_SIZE = 0x5
+};
+
+const char connection_preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+const size_t frame_header_size = 9;
+/** Largest frame we accept (the default SETTINGS_MAX_FRAME_SIZE, which is not changed) */
+const uint32_t max_frame_size = 16384;
+const uint32_t default_window = 65535;
+const int64_t max_window = 0x7fffffff;
+/** Flow control windows we announce. Paused streams buffer up to the stream window */
+const uint32_t stream_window = 1 << 20;
+const uint32_t connection_window = 1 << 24;
+
+uint32_t get_u32(const char *buf)
+{
+    const auto *p = reinterpret_cast<const unsigned char *>(buf);
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+void put_u32(char *buf, uint32_t value)
+{
+    buf[0] = static_cast<char>(value >> 24);
+    buf[1] = static_cast<char>(value >> 16);
+    buf[2] = static_cast<char>(value >> 8);
+    buf[3] = static_cast<char>(value);
+}
+
+void put_setting(std::string &out, uint16_t id, uint32_t value)
+{
+    char buf[6];
+    buf[0] = static_cast<char>(id >> 8);
+    buf[1] = static_cast<char>(id);
+    put_u32(buf + 2, value);
+    out.append(buf, sizeof(buf));
+}
+
+/** Remove the padding of DATA and HEADERS frames. @return false if the padding is longer than the frame */
+bool strip_padding(uint8_t flags, std::string &payload)
+{
+    if (!(flags & FLAG_PADDED)) {
+        return true;
+    }
+    if (payload.empty()) {
+        return false;
+    }
+    size_t padlen = static_cast<unsigned char>(payload[0]);
+    if (padlen >= payload.size()) {
+        return false;
+    }
+    payload.erase(payload.size() - padlen);
+    payload.erase(0, 1);
+    return true;
+}
+
+void resubmit(Request *req)
+{
+    lcb_STATUS rc = req->submit();
+    if (rc != LCB_SUCCESS) {
+        req->finish(rc);
+    }
+}
+
+extern "C" {
+static void on_connected(lcbio_SOCKET *sock, void *arg, lcb_STATUS err, lcbio_OSERR)
+{
+    static_cast<Http2Session *>(arg)->handle_connected(sock, err);
+}
+
+static void on_read(lcbio_CTX *ctx, unsigned)
+{
+    static_cast<Http2Session *>(lcbio_ctx_data(ctx))->handle_read();
+}
+
+static void on_error(lcbio_CTX *ctx, lcb_STATUS err)
+{
+    static_cast<Http2Session *>(lcbio_ctx_data(ctx))->handle_error(err);
+}
+}
+} // namespace
+
+Http2Session::Http2Session(Http2Pool *pool_, const lcb_host_t &host_, const std::string &key_)
+    : pool(pool_), host(host_), key(key_), settings(pool_->get_instance()->settings),
+      idle_timer(pool_->get_instance()->iotable, this), drain_timer(pool_->get_instance()->iotable, this)
+{
+}
+
+Http2Session::~Http2Session()
+{
+    idle_timer.release();
+    drain_timer.release();
+}
+
+lcb_STATUS Http2Session::connect(uint32_t timeout)
+{
+    lcb_log(LOGARGS(this, DEBUG), LOGFMT "Opening HTTP/2 connection", LOGID(this));
+    creq = lcbio_connect(pool->get_instance()->iotable, settings, &host, timeout, on_connected, this);
+    return creq ? LCB_SUCCESS : LCB_ERR_CONNECT_ERROR;
+}
+
+void Http2Session::handle_connected(lcbio_SOCKET *sock, lcb_STATUS err)
+{
+    busy++;
+    creq = nullptr;
+    if (err == LCB_SUCCESS && (err = lcbio_sslify_if_needed(sock, settings)) == LCB_SUCCESS &&
+        lcbio_ssl_check(sock)) {
+        if (lcbio_ssl_set_alpn(sock, reinterpret_cast<const unsigned char *>("\x02h2"), 3) != LCB_SUCCESS) {
+            lcb_log(LOGARGS(this, WARN), LOGFMT "Unable to offer h2 with ALPN", LOGID(this));
+        }
+    }
+    if (err != LCB_SUCCESS) {
+        lcb_log(LOGARGS(this, ERR), LOGFMT "Connection failed with Err=%s", LOGID(this), lcb_strerror_short(err));
+        fail(err);
+        leave();
+        return;
+    }
+
+    lcbio_CTXPROCS procs{};
+    procs.cb_err = on_error;
+    procs.cb_read = on_read;
+    ctx = lcbio_ctx_new(sock, this, &procs);
+    ctx->subsys = "http2";
+
+    std::string local_settings;
+    put_setting(local_settings, SETTING_ENABLE_PUSH, 0);
+    put_setting(local_settings, SETTING_INITIAL_WINDOW_SIZE, stream_window);
+    lcbio_ctx_put(ctx, connection_preface, sizeof(connection_preface) - 1);
+    write_frame(FRAME_SETTINGS, 0, 0, local_settings.data(), local_settings.size());
+    write_window_update(0, connection_window - default_window);
+    recv_window = connection_window;
+
+    open_streams();
+    send_data();
+    lcbio_ctx_rwant(ctx, frame_header_size);
+    flush();
+    leave();
+}
+
+void Http2Session::submit(Request *req)
+{
+    busy++;
+    auto *stream = new Http2Stream(req);
+    req->h2session = this;
+    req->h2stream = stream;
+    idle_timer.cancel();
+    waiting.push_back(stream);
+    if (ctx) {
+        open_streams();
+        send_data();
+        flush();
+    }
+    leave();
+}
+
+void Http2Session::cancel(Request *req)
+{
+    busy++;
+    if (req->h2stream) {
+        release(req->h2stream);
+        flush();
+    }
+    leave();
+}
+
+void Http2Session::resume(Request *req)
+{
+    if (req->h2stream) {
+        drain_timer.signal();
+    }
+}
+
+void Http2Session::shutdown()
+{
+    busy++;
+    go_away();
+    close_socket();
+    release_all(0, [](Request *) {});
+    close();
+    leave();
+}
+
+void Http2Session::handle_read()
+{
+    busy++;
+    rdb_IOROPE *ior = &ctx->ior;
+    unsigned want = frame_header_size;
+
+    while (!closed) {
+        unsigned nused = rdb_get_nused(ior);
+        if (nused < frame_header_size) {
+            want = frame_header_size;
+            break;
+        }
+        char hdr[frame_header_size];
+        rdb_copyread(ior, hdr, frame_header_size);
+        uint32_t length = get_u32(hdr) >> 8;
+        auto type = static_cast<uint8_t>(hdr[3]);
+        auto flags = static_cast<uint8_t>(hdr[4]);
+        uint32_t stream_id = get_u32(hdr + 5) & 0x7fffffff;
+
+        if (!preface_received) {
+            if (memcmp(hdr, "HTTP/", 5) == 0) {
+                fallback_http1();
+                break;
+            }
+            if (type != FRAME_SETTINGS || (flags & FLAG_ACK)) {
+                connection_error(H2_PROTOCOL_ERROR, "the server preface is not SETTINGS");
+                break;
+            }
+            preface_received = true;
+        }
+        if (length > max_frame_size) {
+            connection_error(H2_FRAME_SIZE_ERROR, "frame is larger than SETTINGS_MAX_FRAME_SIZE");
+            break;
+        }
+        if (nused < frame_header_size + length) {
+            want = frame_header_size + length;
+            break;
+        }
+        rdb_consumed(ior, frame_header_size);
+        std::string payload(length, '\0');
+        if (length) {
+            rdb_copyread(ior, &payload[0], length);
+            rdb_consumed(ior, length);
+        }
+        handle_frame(type, flags, stream_id, payload);
+    }
+
+    if (!closed) {
+        lcbio_ctx_rwant(ctx, want);
+        flush();
+    }
+    leave();
+}
+
+void Http2Session::handle_error(lcb_STATUS err)
+{
+    busy++;
+    lcb_log(LOGARGS(this, ERR), LOGFMT "Got error while performing I/O on HTTP/2 connection. Err=%s", LOGID(this),
+            lcb_strerror_short(err));
+    fail(err);
+    leave();
+}
+
+void Http2Session::handle_frame(uint8_t type, uint8_t flags, uint32_t stream_id, std::string &payload)
+{
+    if (header_stream_id && type != FRAME_CONTINUATION) {
+        connection_error(H2_PROTOCOL_ERROR, "header block is interrupted");
+        return;
+    }
+
+    switch (type) {
+        case FRAME_DATA:
+            handle_data(flags, stream_id, payload);
+            break;
+
+        case FRAME_HEADERS:
+            handle_headers(flags, stream_id, payload);
+            break;
+
+        case FRAME_CONTINUATION:
+            if (header_stream_id == 0 || stream_id != header_stream_id) {
+                connection_error(H2_PROTOCOL_ERROR, "unexpected CONTINUATION");
+                return;
+            }
+            header_block.append(payload);
+            if (flags & FLAG_END_HEADERS) {
+                handle_header_block();
+            }
+            break;
+
+        case FRAME_RST_STREAM:
+            if (stream_id == 0) {
+                connection_error(H2_PROTOCOL_ERROR, "RST_STREAM for stream 0");
+            } else if (payload.size() != 4) {
+                connection_error(H2_FRAME_SIZE_ERROR, "invalid RST_STREAM");
+            } else {
+                handle_rst_stream(stream_id, payload);
+            }
+            break;
+
+        case FRAME_SETTINGS:
+            if (stream_id != 0) {
+                connection_error(H2_PROTOCOL_ERROR, "SETTINGS for a stream");
+            } else {
+                handle_settings(flags, payload);
+            }
+            break;
+
+        case FRAME_PUSH_PROMISE:
+            connection_error(H2_PROTOCOL_ERROR, "PUSH_PROMISE, while push is disabled");
+            break;
+
+        case FRAME_PING:
+            if (stream_id != 0) {
+                connection_error(H2_PROTOCOL_ERROR, "PING for a stream");
+            } else if (payload.size() != 8) {
+                connection_error(H2_FRAME_SIZE_ERROR, "invalid PING");
+            } else if (!(flags & FLAG_ACK)) {
+                write_frame(FRAME_PING, FLAG_ACK, 0, payload.data(), payload.size());
+            }
+            break;
+
+        case FRAME_GOAWAY:
+            if (stream_id != 0) {
+                connection_error(H2_PROTOCOL_ERROR, "GOAWAY for a stream");
+            } else if (payload.size() < 8) {
+                connection_error(H2_FRAME_SIZE_ERROR, "invalid GOAWAY");
+            } else {
+                handle_goaway(payload);
+            }
+            break;
+
+        case FRAME_WINDOW_UPDATE:
+            if (payload.size() != 4) {
+                connection_error(H2_FRAME_SIZE_ERROR, "invalid WINDOW_UPDATE");
+            } else {
+                handle_window_update(stream_id, payload);
+            }
+            break;
+
+        default:
+            // PRIORITY, and the frames of unknown types are ignored
+            break;
+    }
+}
+
+void Http2Session::handle_headers(uint8_t flags, uint32_t stream_id, std::string &payload)
+{
+    if (stream_id == 0 || (stream_id & 1) == 0) {
+        // the server cannot open streams, because push is disabled
+        connection_error(H2_PROTOCOL_ERROR, "HEADERS for a stream not opened by the client");
+        return;
+    }
+    if (!strip_padding(flags, payload)) {
+        connection_error(H2_PROTOCOL_ERROR, "invalid padding");
+        return;
+    }
+    if (flags & FLAG_PRIORITY) {
+        if (payload.size() < 5) {
+            connection_error(H2_FRAME_SIZE_ERROR, "invalid HEADERS");
+            return;
+        }
+        payload.erase(0, 5);
+    }
+    header_block.swap(payload);
+    header_stream_id = stream_id;
+    header_end_stream = flags & FLAG_END_STREAM;
+    if (flags & FLAG_END_HEADERS) {
+        handle_header_block();
+    }
+}
+
+void Http2Session::handle_header_block()
+{
+    uint32_t stream_id = header_stream_id;
+    bool end_stream = header_end_stream;
+    std::vector<MimeHeader> fields;
+    bool decoded = decoder.decode(header_block.data(), header_block.size(), fields);
+    header_stream_id = 0;
+    header_block.clear();
+    if (!decoded) {
+        connection_error(H2_COMPRESSION_ERROR, "unable to decode header block");
+        return;
+    }
+
+    // the block has to be decoded even for the cancelled streams, to keep the table in sync
+    auto it = streams.find(stream_id);
+    if (it == streams.end()) {
+        return;
+    }
+    Http2Stream *stream = it->second;
+    lcbio_timer_rearm(stream->request->timer, stream->request->timeout());
+    if (stream->remote_closed) {
+        stream_error(stream, H2_STREAM_CLOSED, "HEADERS after END_STREAM");
+        return;
+    }
+
+    if (!stream->have_headers) {
+        lcb::htparse::Response::HeaderList headers;
+        int status = 0;
+        for (const auto &field : fields) {
+            if (field.key == ":status") {
+                status = atoi(field.value.c_str());
+            } else if (!field.key.empty() && field.key[0] != ':') {
+                headers.push_back(field);
+            }
+        }
+        if (status < 100 || status > 999) {
+            stream_error(stream, H2_PROTOCOL_ERROR, "invalid :status");
+            return;
+        }
+        if (status < 200) {
+            // informational response, the final one follows
+            if (end_stream) {
+                stream_error(stream, H2_PROTOCOL_ERROR, "END_STREAM on informational response");
+            }
+            return;
+        }
+        stream->have_headers = true;
+
+        Request *req = stream->request;
+        lcb::htparse::Response &resp = req->parser->get_cur_response();
+        resp.status = status;
+        resp.state = lcb::htparse::Parser::S_HTSTATUS | lcb::htparse::Parser::S_HEADER;
+        resp.headers.swap(headers);
+        if (!req->handle_response_headers(resp)) {
+            req->incref();
+            release(stream);
+            req->handle_redirect();
+            req->decref();
+            return;
+        }
+    } else if (!end_stream) {
+        stream_error(stream, H2_PROTOCOL_ERROR, "trailers without END_STREAM");
+        return;
+    }
+
+    if (end_stream) {
+        stream->remote_closed = true;
+        maybe_complete(stream);
+    }
+}
+
+void Http2Session::handle_data(uint8_t flags, uint32_t stream_id, std::string &payload)
+{
+    if (stream_id == 0) {
+        connection_error(H2_PROTOCOL_ERROR, "DATA for stream 0");
+        return;
+    }
+
+    // the connection window covers the whole payload, and is replenished right away
+    size_t length = payload.size();
+    recv_window -= length;
+    if (recv_window < 0) {
+        connection_error(H2_FLOW_CONTROL_ERROR, "connection window exceeded");
+        return;
+    }
+    recv_consumed += length;
+    if (recv_consumed >= connection_window / 2) {
+        write_window_update(0, recv_consumed);
+        recv_window += recv_consumed;
+        recv_consumed = 0;
+    }
+
+    if (!strip_padding(flags, payload)) {
+        connection_error(H2_PROTOCOL_ERROR, "invalid padding");
+        return;
+    }
+    auto it = streams.find(stream_id);
+    if (it == streams.end()) {
+        return;
+    }
+    Http2Stream *stream = it->second;
+    lcbio_timer_rearm(stream->request->timer, stream->request->timeout());
+    if (!stream->have_headers || stream->remote_closed) {
+        stream_error(stream, H2_STREAM_CLOSED, "unexpected DATA");
+        return;
+    }
+    stream->recv_window -= length;
+    if (stream->recv_window < 0) {
+        stream_error(stream, H2_FLOW_CONTROL_ERROR, "stream window exceeded");
+        return;
+    }
+    // the padding is never delivered
+    stream->recv_consumed += length - payload.size();
+    if (flags & FLAG_END_STREAM) {
+        stream->remote_closed = true;
+    }
+
+    if (stream->request->paused || !stream->buffered.empty()) {
+        // the window is not updated until the data is delivered, which stops the server
+        stream->buffered.append(payload);
+        return;
+    }
+    if (!payload.empty()) {
+        deliver(stream, payload.data(), payload.size());
+        if ((it = streams.find(stream_id)) == streams.end()) {
+            return;
+        }
+        stream = it->second;
+    }
+    update_window(stream);
+    maybe_complete(stream);
+}
+
+void Http2Session::handle_settings(uint8_t flags, const std::string &payload)
+{
+    if (flags & FLAG_ACK) {
+        if (!payload.empty()) {
+            connection_error(H2_FRAME_SIZE_ERROR, "SETTINGS acknowledgement with payload");
+        }
+        return;
+    }
+    if (payload.size() % 6) {
+        connection_error(H2_FRAME_SIZE_ERROR, "invalid SETTINGS");
+        return;
+    }
+
+    for (size_t off = 0; off < payload.size(); off += 6) {
+        auto id = static_cast<uint16_t>((static_cast<unsigned char>(payload[off]) << 8) |
+                                        static_cast<unsigned char>(payload[off + 1]));
+        uint32_t value = get_u32(payload.data() + off + 2);
+        switch (id) {
+            case SETTING_HEADER_TABLE_SIZE:
+                encoder.set_max_table_size(value);
+                break;
+
+            case SETTING_ENABLE_PUSH:
+                if (value > 1) {
+                    connection_error(H2_PROTOCOL_ERROR, "invalid SETTINGS_ENABLE_PUSH");
+                    return;
+                }
+                break;
+
+            case SETTING_MAX_CONCURRENT_STREAMS:
+                peer_max_streams = value;
+                break;
+
+            case SETTING_INITIAL_WINDOW_SIZE: {
+                if (value > max_window) {
+                    connection_error(H2_FLOW_CONTROL_ERROR, "invalid SETTINGS_INITIAL_WINDOW_SIZE");
+                    return;
+                }
+                int64_t delta = int64_t(value) - int64_t(peer_initial_window);
+                for (auto &it : streams) {
+                    it.second->send_window += delta;
+                }
+                peer_initial_window = value;
+                break;
+            }
+
+            case SETTING_MAX_FRAME_SIZE:
+                if (value < 16384 || value > 16777215) {
+                    connection_error(H2_PROTOCOL_ERROR, "invalid SETTINGS_MAX_FRAME_SIZE");
+                    return;
+                }
+                peer_max_frame_size = value;
+                break;
+
+            default:
+                break;
+        }
+    }
+    write_frame(FRAME_SETTINGS, FLAG_ACK, 0, nullptr, 0);
+    open_streams();
+    send_data();
+}
+
+void Http2Session::handle_window_update(uint32_t stream_id, const std::string &payload)
+{
+    uint32_t increment = get_u32(payload.data()) & 0x7fffffff;
+    if (stream_id == 0) {
+        if (increment == 0 || send_window + increment > max_window) {
+            connection_error(H2_FLOW_CONTROL_ERROR, "invalid connection WINDOW_UPDATE");
+            return;
+        }
+        send_window += increment;
+    } else {
+        auto it = streams.find(stream_id);
+        if (it == streams.end()) {
+            return;
+        }
+        if (increment == 0) {
+            stream_error(it->second, H2_PROTOCOL_ERROR, "WINDOW_UPDATE with zero increment");
+            return;
+        }
+        if (it->second->send_window + increment > max_window) {
+            stream_error(it->second, H2_FLOW_CONTROL_ERROR, "stream window overflow");
+            return;
+        }
+        it->second->send_window += increment;
+    }
+    send_data();
+}
+
+void Http2Session::handle_rst_stream(uint32_t stream_id, const std::string &payload)
+{
+    auto it = streams.find(stream_id);
+    if (it == streams.end()) {
+        return;
+    }
+    Http2Stream *stream = it->second;
+    uint32_t code = get_u32(payload.data());
+    stream->local_closed = true;
+    if (stream->remote_closed) {
+        // the response is complete, only its delivery has been paused
+        return;
+    }
+    stream->remote_closed = true;
+
+    Request *req = stream->request;
+    lcb_log(LOGARGS(this, WARN), LOGFMT "Stream %u has been reset by the server with code 0x%x", LOGID(this),
+            stream_id, code);
+    req->incref();
+    release(stream);
+    if (code == H2_REFUSED_STREAM) {
+        // the server has not processed the request, so it is safe to send it again
+        resubmit(req);
+    } else {
+        req->finish_or_retry(LCB_ERR_PROTOCOL_ERROR);
+    }
+    req->decref();
+}
+
+void Http2Session::handle_goaway(const std::string &payload)
+{
+    uint32_t last_id = get_u32(payload.data()) & 0x7fffffff;
+    uint32_t code = get_u32(payload.data() + 4);
+    lcb_log(LOGARGS(this, DEBUG), LOGFMT "Got GOAWAY (last stream %u, code 0x%x)", LOGID(this), last_id, code);
+    go_away();
+    // the streams above the last one have not been processed, and can be sent on another connection
+    release_all(last_id, resubmit);
+    maybe_close();
+}
+
+void Http2Session::connection_error(ErrorCode code, const char *reason)
+{
+    lcb_log(LOGARGS(this, ERR), LOGFMT "HTTP/2 protocol error: %s", LOGID(this), reason);
+    write_goaway(code);
+    flush();
+    fail(LCB_ERR_PROTOCOL_ERROR);
+}
+
+void Http2Session::stream_error(Http2Stream *stream, ErrorCode code, const char *reason)
+{
+    Request *req = stream->request;
+    lcb_log(LOGARGS(this, ERR), LOGFMT "HTTP/2 protocol error on stream %u: %s", LOGID(this), stream->id, reason);
+    if (!stream->local_closed || !stream->remote_closed) {
+        write_rst_stream(stream->id, code);
+    }
+    stream->local_closed = stream->remote_closed = true;
+    req->incref();
+    release(stream);
+    req->finish_or_retry(LCB_ERR_PROTOCOL_ERROR);
+    req->decref();
+}
+
+void Http2Session::fail(lcb_STATUS err)
+{
+    go_away();
+    close_socket();
+    release_all(0, [err](Request *req) { req->finish_or_retry(err); });
+    close();
+}
+
+void Http2Session::fallback_http1()
+{
+    lcb_log(LOGARGS(this, INFO), LOGFMT "Server does not support HTTP/2, falling back to HTTP/1.1", LOGID(this));
+    pool->mark_http1(key);
+    go_away();
+    close_socket();
+    release_all(0, resubmit);
+    close();
+}
+
+void Http2Session::go_away()
+{
+    if (!going_away) {
+        going_away = true;
+        pool->detach(this);
+    }
+}
+
+void Http2Session::close_socket()
+{
+    if (creq) {
+        lcbio_connect_cancel(creq);
+        creq = nullptr;
+    }
+    if (ctx) {
+        lcbio_ctx_close(ctx, nullptr, nullptr);
+        ctx = nullptr;
+    }
+}
+
+void Http2Session::close()
+{
+    if (closed) {
+        return;
+    }
+    closed = true;
+    go_away();
+    idle_timer.cancel();
+    drain_timer.cancel();
+    close_socket();
+    pool->remove(this);
+}
+
+void Http2Session::maybe_close()
+{
+    if (closed || !streams.empty() || !waiting.empty()) {
+        return;
+    }
+    const lcb::io::Pool::Options &options = pool->get_instance()->http_sockpool->get_options();
+    if (going_away || options.maxidle == 0 || options.tmoidle == 0) {
+        close();
+    } else {
+        idle_timer.rearm(options.tmoidle);
+    }
+}
+
+void Http2Session::leave()
+{
+    if (--busy == 0 && closed) {
+        delete this;
+    }
+}
+
+void Http2Session::idle_timeout()
+{
+    busy++;
+    lcb_log(LOGARGS(this, DEBUG), LOGFMT "Closing idle connection", LOGID(this));
+    write_goaway(H2_NO_ERROR);
+    flush();
+    close();
+    leave();
+}
+
+void Http2Session::open_streams()
+{
+    while (ctx && !waiting.empty() && streams.size() < peer_max_streams) {
+        if (!is_available()) {
+            // the stream identifiers are exhausted, the requests go to a new connection
+            go_away();
+            release_all(UINT32_MAX, resubmit);
+            return;
+        }
+        Http2Stream *stream = waiting.front();
+        waiting.pop_front();
+        open_stream(stream);
+    }
+}
+
+void Http2Session::open_stream(Http2Stream *stream)
+{
+    Request *req = stream->request;
+    stream->id = next_stream_id;
+    next_stream_id += 2;
+    stream->send_window = peer_initial_window;
+    stream->recv_window = stream_window;
+    streams[stream->id] = stream;
+
+    std::vector<MimeHeader> fields;
+    req->build_http2_headers(fields);
+    std::string block;
+    encoder.encode(fields, block);
+
+    bool end_stream = req->body.empty();
+    uint8_t type = FRAME_HEADERS;
+    size_t off = 0;
+    do {
+        size_t nframe = std::min(block.size() - off, size_t(peer_max_frame_size));
+        uint8_t flags = (off + nframe == block.size()) ? FLAG_END_HEADERS : 0;
+        if (type == FRAME_HEADERS && end_stream) {
+            flags |= FLAG_END_STREAM;
+        }
+        write_frame(type, flags, stream->id, block.data() + off, nframe);
+        off += nframe;
+        type = FRAME_CONTINUATION;
+    } while (off < block.size());
+    stream->local_closed = end_stream;
+    lcb_log(LOGARGS(this, TRACE), LOGFMT "Opened stream %u for %s. Body=%lu bytes", LOGID(this), stream->id,
+            req->url.c_str(), (unsigned long int)req->body.size());
+}
+
+void Http2Session::send_data()
+{
+    for (auto &it : streams) {
+        Http2Stream *stream = it.second;
+        const std::vector<char> &body = stream->request->body;
+        while (!stream->local_closed && send_window > 0 && stream->send_window > 0) {
+            size_t nframe = std::min<int64_t>(std::min(send_window, stream->send_window), peer_max_frame_size);
+            nframe = std::min(nframe, body.size() - stream->body_sent);
+            bool last = stream->body_sent + nframe == body.size();
+            write_frame(FRAME_DATA, last ? FLAG_END_STREAM : 0, stream->id, &body[stream->body_sent], nframe);
+            stream->body_sent += nframe;
+            stream->send_window -= nframe;
+            send_window -= nframe;
+            stream->local_closed = last;
+        }
+    }
+}
+
+void Http2Session::deliver(Http2Stream *stream, const char *data, size_t ndata)
+{
+    Request *req = stream->request;
+    stream->recv_consumed += ndata;
+    req->incref();
+    req->handle_response_body(data, ndata);
+    req->decref();
+}
+
+void Http2Session::update_window(Http2Stream *stream)
+{
+    if (!stream->remote_closed && stream->recv_consumed >= stream_window / 2) {
+        write_window_update(stream->id, stream->recv_consumed);
+        stream->recv_window += stream->recv_consumed;
+        stream->recv_consumed = 0;
+    }
+}
+
+void Http2Session::maybe_complete(Http2Stream *stream)
+{
+    Request *req = stream->request;
+    if (!stream->remote_closed || !stream->buffered.empty() || req->paused) {
+        return;
+    }
+    uint32_t stream_id = stream->id;
+    req->incref();
+    req->handle_response_done();
+    auto it = streams.find(stream_id);
+    if (it != streams.end()) {
+        release(it->second);
+    }
+    req->finish(LCB_SUCCESS);
+    req->decref();
+}
+
+void Http2Session::release(Http2Stream *stream)
+{
+    if (stream->id) {
+        streams.erase(stream->id);
+        if (!stream->local_closed || !stream->remote_closed) {
+            write_rst_stream(stream->id, stream->remote_closed ? H2_NO_ERROR : H2_CANCEL);
+        }
+    } else {
+        waiting.erase(std::find(waiting.begin(), waiting.end(), stream));
+    }
+    bool freed = stream->id != 0;
+    stream->request->h2session = nullptr;
+    stream->request->h2stream = nullptr;
+    delete stream;
+    if (freed && !going_away && !waiting.empty()) {
+        // the streams held back by the peer's concurrency limit can be started now
+        open_streams();
+        send_data();
+        flush();
+    }
+    maybe_close();
+}
+
+template <typename Fn>
+void Http2Session::release_all(uint32_t last_id, Fn fn)
+{
+    std::vector<Http2Stream *> released(waiting.begin(), waiting.end());
+    for (auto &it : streams) {
+        if (it.first > last_id) {
+            released.push_back(it.second);
+        }
+    }
+    std::vector<Request *> requests;
+    for (auto *stream : released) {
+        // the server has forgotten these streams, or the connection is gone
+        stream->local_closed = stream->remote_closed = true;
+        requests.push_back(stream->request);
+        stream->request->incref();
+        release(stream);
+    }
+    for (auto *req : requests) {
+        fn(req);
+        req->decref();
+    }
+}
+
+void Http2Session::drain_buffered()
+{
+    busy++;
+    std::vector<uint32_t> ready;
+    for (auto &it : streams) {
+        if (!it.second->request->paused && (!it.second->buffered.empty() || it.second->remote_closed)) {
+            ready.push_back(it.first);
+        }
+    }
+    for (uint32_t stream_id : ready) {
+        auto it = streams.find(stream_id);
+        if (it == streams.end() || it->second->request->paused) {
+            continue;
+        }
+        if (!it->second->buffered.empty()) {
+            std::string data;
+            data.swap(it->second->buffered);
+            deliver(it->second, data.data(), data.size());
+            if ((it = streams.find(stream_id)) == streams.end()) {
+                continue;
+            }
+            update_window(it->second);
+        }
+        maybe_complete(it->second);
+    }
+    flush();
+    leave();
+}
+
+void Http2Session::write_frame(uint8_t type, uint8_t flags, uint32_t stream_id, const char *payload,
+                               size_t npayload)
+{
+    if (!ctx) {
+        return;
+    }
+    char hdr[frame_header_size];
+    put_u32(hdr, uint32_t(npayload) << 8);
+    hdr[3] = static_cast<char>(type);
+    hdr[4] = static_cast<char>(flags);
+    put_u32(hdr + 5, stream_id);
+    lcbio_ctx_put(ctx, hdr, sizeof(hdr));
+    if (npayload) {
+        lcbio_ctx_put(ctx, payload, npayload);
+    }
+}
+
+void Http2Session::write_window_update(uint32_t stream_id, uint32_t increment)
+{
+    char buf[4];
+    put_u32(buf, increment);
+    write_frame(FRAME_WINDOW_UPDATE, 0, stream_id, buf, sizeof(buf));
+}
+
+void Http2Session::write_rst_stream(uint32_t stream_id, ErrorCode code)
+{
+    char buf[4];
+    put_u32(buf, code);
+    write_frame(FRAME_RST_STREAM, 0, stream_id, buf, sizeof(buf));
+}
+
+void Http2Session::write_goaway(ErrorCode code)
+{
+    char buf[8];
+    put_u32(buf, 0);
+    put_u32(buf + 4, code);
+    write_frame(FRAME_GOAWAY, 0, 0, buf, sizeof(buf));
+}
+
+void Http2Session::flush()
+{
+    if (ctx) {
+        lcbio_ctx_schedule(ctx);
+    }
+}
+
+Http2Pool::~Http2Pool()
+{
+    std::vector<Http2Session *> all(sessions.begin(), sessions.end());
+    active.clear();
+    for (auto *session : all) {
+        session->shutdown();
+    }
+}
+
+std::string Http2Pool::host_key(const lcb_host_t &host)
+{
+    std::string key;
+    if (host.ipv6) {
+        key.append("[").append(host.host).append("]");
+    } else {
+        key.append(host.host);
+    }
+    return key.append(":").append(host.port);
+}
+
+lcb_STATUS Http2Pool::submit(const lcb_host_t &host, Request *req)
+{
+    std::string key = host_key(host);
+    Http2Session *session = nullptr;
+    auto it = active.find(key);
+    if (it != active.end() && it->second->is_available()) {
+        session = it->second;
+    } else {
+        session = new Http2Session(this, host, key);
+        sessions.insert(session);
+        active[key] = session;
+        lcb_STATUS rc = session->connect(req->timeout());
+        if (rc != LCB_SUCCESS) {
+            session->shutdown();
+            return rc;
+        }
+    }
+    session->submit(req);
+    return LCB_SUCCESS;
+}
+
+bool Http2Pool::is_http1(const lcb_host_t &host) const
+{
+    return !http1_hosts.empty() && http1_hosts.count(host_key(host)) != 0;
+}
+
+void Http2Pool::detach(Http2Session *session)
+{
+    auto it = active.find(session->get_key());
+    if (it != active.end() && it->second == session) {
+        active.erase(it);
+    }
+}
+
+void Http2Pool::remove(Http2Session *session)
+{
+    sessions.erase(session);
+}
+
+void Http2Pool::mark_http1(const std::string &key)
+{
+    http1_hosts.insert(key);
+}
@@ -0,0 +1,267 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_HTTP2_H
+#define LCB_HTTP2_H
+
+#include <libcouchbase/couchbase.h>
+#include <lcbio/lcbio.h>
+#include <lcbio/timer-cxx.h>
+#include <lcbht/hpack.h>
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+
+/**
+ * @file
+ * HTTP/2 (RFC 7540) transport for lcb::http::Request.
+ *
+ * All requests to the same host and port are sent as streams of a single
+ * connection (Http2Session). The connection speaks HTTP/2 without upgrade
+ * (prior knowledge) over plain TCP, and offers `h2` with ALPN over TLS. If the
+ * server answers the connection preface with HTTP/1.x, the host is remembered
+ * by the Http2Pool, and the requests are submitted again over HTTP/1.1.
+ */
+
+namespace lcb
+{
+namespace http
+{
+
+struct Request;
+class Http2Pool;
+
+/** Request sent (or waiting to be sent) as HTTP/2 stream */
+struct Http2Stream {
+    explicit Http2Stream(Request *req) : request(req) {}
+
+    Request *request;
+    uint32_t id{0};
+    /** Part of the request body, which has been sent */
+    size_t body_sent{0};
+    /** How much data the peer allows us to send on the stream */
+    int64_t send_window{0};
+    /** How much data we allow the peer to send on the stream */
+    int64_t recv_window{0};
+    /** Data processed since the last WINDOW_UPDATE */
+    uint32_t recv_consumed{0};
+    /** Data received while the request was paused */
+    std::string buffered{};
+    /** The final (non-informational) response headers have been received */
+    bool have_headers{false};
+    /** The peer has closed its side of the stream (END_STREAM) */
+    bool remote_closed{false};
+    /** We have closed our side of the stream (END_STREAM) */
+    bool local_closed{false};
+};
+
+/** Single HTTP/2 connection */
+class Http2Session
+{
+  public:
+    Http2Session(Http2Pool *pool, const lcb_host_t &host, const std::string &key);
+    ~Http2Session();
+
+    /** Start connecting to the host */
+    lcb_STATUS connect(uint32_t timeout);
+
+    /** Send the request as a new stream (once the connection allows it) */
+    void submit(Request *req);
+
+    /** Detach the request, resetting its stream if it is still open */
+    void cancel(Request *req);
+
+    /** Deliver the data buffered while the request was paused */
+    void resume(Request *req);
+
+    /** Whether new streams can be started on the connection */
+    bool is_available() const
+    {
+        return !going_away && next_stream_id <= 0x7fffffff;
+    }
+
+    const std::string &get_key() const
+    {
+        return key;
+    }
+
+    lcbio_SOCKET *get_socket() const
+    {
+        return ctx ? ctx->sock : nullptr;
+    }
+
+    size_t get_nstreams() const
+    {
+        return streams.size() + waiting.size();
+    }
+
+    /** Close the connection and detach all the requests without invoking their callbacks */
+    void shutdown();
+
+    void handle_connected(lcbio_SOCKET *sock, lcb_STATUS err);
+    void handle_read();
+    void handle_error(lcb_STATUS err);
+
+  private:
+    enum ErrorCode {
+        H2_NO_ERROR = 0x0,
+        H2_PROTOCOL_ERROR = 0x1,
+        H2_INTERNAL_ERROR = 0x2,
+        H2_FLOW_CONTROL_ERROR = 0x3,
+        H2_STREAM_CLOSED = 0x5,
+        H2_FRAME_SIZE_ERROR = 0x6,
+        H2_REFUSED_STREAM = 0x7,
+        H2_CANCEL = 0x8,
+        H2_COMPRESSION_ERROR = 0x9
+    };
+
+    void write_frame(uint8_t type, uint8_t flags, uint32_t stream_id, const char *payload, size_t npayload);
+    void write_window_update(uint32_t stream_id, uint32_t increment);
+    void write_rst_stream(uint32_t stream_id, ErrorCode code);
+    void write_goaway(ErrorCode code);
+    void flush();
+
+    void handle_frame(uint8_t type, uint8_t flags, uint32_t stream_id, std::string &payload);
+    void handle_headers(uint8_t flags, uint32_t stream_id, std::string &payload);
+    void handle_header_block();
+    void handle_data(uint8_t flags, uint32_t stream_id, std::string &payload);
+    void handle_settings(uint8_t flags, const std::string &payload);
+    void handle_window_update(uint32_t stream_id, const std::string &payload);
+    void handle_rst_stream(uint32_t stream_id, const std::string &payload);
+    void handle_goaway(const std::string &payload);
+
+    /** Terminate the connection with GOAWAY, and fail the requests */
+    void connection_error(ErrorCode code, const char *reason);
+    /** Reset the stream, and fail (or retry) its request */
+    void stream_error(Http2Stream *stream, ErrorCode code, const char *reason);
+    /** Close the connection, and fail (or retry) the requests */
+    void fail(lcb_STATUS err);
+    /** Submit the requests over HTTP/1.1, after the server has answered with HTTP/1.x */
+    void fallback_http1();
+
+    /** Stop accepting new streams. The connection is closed once the last stream is done */
+    void go_away();
+    void close_socket();
+    void close();
+    /** Close the connection (or arm the idle timer) if there are no streams */
+    void maybe_close();
+    /** Delete the session if it has been closed, and there are no callbacks in progress */
+    void leave();
+
+    void open_streams();
+    void open_stream(Http2Stream *stream);
+    void send_data();
+    void deliver(Http2Stream *stream, const char *data, size_t ndata);
+    void update_window(Http2Stream *stream);
+    void maybe_complete(Http2Stream *stream);
+    /** Remove the stream from the session (resetting it, if still open). The request is not notified */
+    void release(Http2Stream *stream);
+    /** Remove the waiting streams and the streams above `last_id`, and pass their requests to `fn` */
+    template <typename Fn>
+    void release_all(uint32_t last_id, Fn fn);
+
+    void drain_buffered();
+    void idle_timeout();
+
+    Http2Pool *pool;
+    lcb_host_t host;
+    std::string key;
+    lcb_settings *settings;
+    lcbio_CTX *ctx{nullptr};
+    lcbio_pCONNSTART creq{nullptr};
+    lcb::io::Timer<Http2Session, &Http2Session::idle_timeout> idle_timer;
+    lcb::io::Timer<Http2Session, &Http2Session::drain_buffered> drain_timer;
+
+    lcb::htparse::HpackEncoder encoder{};
+    lcb::htparse::HpackDecoder decoder{};
+
+    /** Open streams by their identifiers */
+    std::map<uint32_t, Http2Stream *> streams{};
+    /** Streams waiting for the connection, or for the concurrency limit of the peer */
+    std::deque<Http2Stream *> waiting{};
+
+    uint32_t next_stream_id{1};
+
+    /** Settings of the peer */
+    uint32_t peer_max_streams{UINT32_MAX};
+    uint32_t peer_initial_window{65535};
+    uint32_t peer_max_frame_size{16384};
+
+    int64_t send_window{65535};
+    int64_t recv_window{65535};
+    uint32_t recv_consumed{0};
+
+    /** Header block being received in HEADERS and CONTINUATION frames */
+    std::string header_block{};
+    uint32_t header_stream_id{0};
+    bool header_end_stream{false};
+
+    bool preface_received{false};
+    bool going_away{false};
+    bool closed{false};
+    /** Number of calls into the session in progress (it is not deleted while positive) */
+    unsigned busy{0};
+};
+
+/** HTTP/2 connections of the instance */
+class Http2Pool
+{
+  public:
+    explicit Http2Pool(lcb_INSTANCE *instance_) : instance(instance_) {}
+    ~Http2Pool();
+
+    /**
+     * Send the request over the connection to the host, opening the connection
+     * if there is none
+     */
+    lcb_STATUS submit(const lcb_host_t &host, Request *req);
+
+    /** Whether the host has answered the HTTP/2 preface with HTTP/1.x */
+    bool is_http1(const lcb_host_t &host) const;
+
+    lcb_INSTANCE *get_instance() const
+    {
+        return instance;
+    }
+
+    size_t get_nsessions() const
+    {
+        return sessions.size();
+    }
+
+  private:
+    friend class Http2Session;
+    static std::string host_key(const lcb_host_t &host);
+
+    /** The session does not accept new streams anymore */
+    void detach(Http2Session *session);
+    /** The session has been closed */
+    void remove(Http2Session *session);
+    void mark_http1(const std::string &key);
+
+    lcb_INSTANCE *instance;
+    /** Sessions accepting new streams, by host and port */
+    std::map<std::string, Http2Session *> active{};
+    /** All sessions, including those which are finishing their streams */
+    std::set<Http2Session *> sessions{};
+    std::set<std::string> http1_hosts{};
+};
+
+} // namespace http
+} // namespace lcb
+#endif
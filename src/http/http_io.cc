@@ -45,6 +45,67 @@ void Request::assign_response_headers(const lcb::htparse::Response &resp)
     response_headers_clist.push_back(nullptr);
 }
 
+bool Request::handle_response_headers(const lcb::htparse::Response &res)
+{
+    assign_response_headers(res);
+    if (res.status >= 300 && res.status <= 400) {
+        const char *redir = res.get_header_value("Location");
+        if (redir != nullptr) {
+            pending_redirect.assign(redir);
+            return false;
+        }
+    }
+    return true;
+}
+
+void Request::handle_response_body(const char *rbody, unsigned nbody)
+{
+    if (chunked) {
+        lcb_RESPHTTP htresp{};
+        init_resp(&htresp);
+        htresp.ctx.body = rbody;
+        htresp.ctx.body_len = nbody;
+        htresp.ctx.rc = LCB_SUCCESS;
+        passed_data = true;
+        callback(instance, LCB_CALLBACK_HTTP, (const lcb_RESPBASE *)&htresp);
+
+    } else {
+        parser->get_cur_response().body.append(rbody, nbody);
+    }
+}
+
+void Request::handle_response_done()
+{
+    if (!is_ongoing()) {
+        return;
+    }
+
+    const lcb::htparse::Response &res = parser->get_cur_response();
+    lcb_RESPHTTP resp{};
+    init_resp(&resp);
+    resp.rflags = LCB_RESP_F_FINAL;
+    resp.ctx.rc = LCB_SUCCESS;
+    if (!chunked) {
+        resp.ctx.body = res.body.c_str();
+        resp.ctx.body_len = res.body.size();
+    }
+    passed_data = true;
+    lcbio_SOCKET *sock = get_socket();
+    if (nullptr != span && nullptr != sock) {
+        lcbtrace_span_add_host_and_port(span, sock->info);
+    }
+    callback(instance, LCB_CALLBACK_HTTP, (const lcb_RESPBASE *)&resp);
+    status |= Request::CBINVOKED;
+}
+
+void Request::handle_redirect()
+{
+    instance->bootstrap(lcb::BS_REFRESH_THROTTLE);
+    // Transfer control to redirect function()
+    lcb_log(LOGARGS(this, DEBUG), LOGFMT "Attempting redirect to %s", LOGID(this), pending_redirect.c_str());
+    redirect();
+}
+
 unsigned Request::handle_parse_chunked(const char *buf, unsigned nbuf)
 {
     unsigned parse_state, diff;
@@ -60,15 +121,8 @@ unsigned Request::handle_parse_chunked(const char *buf, unsigned nbuf)
         diff = oldstate ^ parse_state;
 
         /* Got headers now for the first time */
-        if (diff & Parser::S_HEADER) {
-            assign_response_headers(res);
-            if (res.status >= 300 && res.status <= 400) {
-                const char *redir = res.get_header_value("Location");
-                if (redir != nullptr) {
-                    pending_redirect.assign(redir);
-                    return Parser::S_DONE;
-                }
-            }
+        if ((diff & Parser::S_HEADER) && !handle_response_headers(res)) {
+            return Parser::S_DONE;
         }
 
         if (parse_state & Parser::S_ERROR) {
@@ -77,45 +131,15 @@ unsigned Request::handle_parse_chunked(const char *buf, unsigned nbuf)
         }
 
         if (nbody) {
-            if (chunked) {
-                lcb_RESPHTTP htresp{};
-                init_resp(&htresp);
-                htresp.ctx.body = rbody;
-                htresp.ctx.body_len = nbody;
-                htresp.ctx.rc = LCB_SUCCESS;
-                passed_data = true;
-                callback(instance, LCB_CALLBACK_HTTP, (const lcb_RESPBASE *)&htresp);
-
-            } else {
-                res.body.append(rbody, nbody);
-            }
+            handle_response_body(rbody, nbody);
         }
 
         buf += nused;
         nbuf -= nused;
     } while ((parse_state & Parser::S_DONE) == 0 && is_ongoing() && nbuf);
 
-    if ((parse_state & Parser::S_DONE) && is_ongoing()) {
-        lcb_RESPHTTP resp{};
-        if (chunked) {
-            buf = nullptr;
-            nbuf = 0;
-        } else {
-            buf = res.body.c_str();
-            nbuf = res.body.size();
-        }
-
-        init_resp(&resp);
-        resp.rflags = LCB_RESP_F_FINAL;
-        resp.ctx.rc = LCB_SUCCESS;
-        resp.ctx.body = buf;
-        resp.ctx.body_len = nbuf;
-        passed_data = true;
-        if (nullptr != span && nullptr != ioctx) {
-            lcbtrace_span_add_host_and_port(span, ioctx->sock->info);
-        }
-        callback(instance, LCB_CALLBACK_HTTP, (const lcb_RESPBASE *)&resp);
-        status |= Request::CBINVOKED;
+    if (parse_state & Parser::S_DONE) {
+        handle_response_done();
     }
     return parse_state;
 }
@@ -123,7 +147,6 @@ unsigned Request::handle_parse_chunked(const char *buf, unsigned nbuf)
 static void io_read(lcbio_CTX *ctx, unsigned nr)
 {
     auto *req = reinterpret_cast<Request *>(lcbio_ctx_data(ctx));
-    lcb_INSTANCE *instance = req->instance;
     /** this variable set to 0 (in progress), -1 (error), 1 (done) */
     int rv = 0;
     lcbio_CTXRDITER iter;
@@ -155,10 +178,7 @@ static void io_read(lcbio_CTX *ctx, unsigned nr)
         // parse error or redirect
         lcb_STATUS err;
         if (req->has_pending_redirect()) {
-            instance->bootstrap(lcb::BS_REFRESH_THROTTLE);
-            // Transfer control to redirect function()
-            lcb_log(LOGARGS(req, DEBUG), LOGFMT "Attempting redirect to %s", LOGID(req), req->pending_redirect.c_str());
-            req->redirect();
+            req->handle_redirect();
         } else {
             err = LCB_ERR_PROTOCOL_ERROR;
             lcb_log(LOGARGS(req, ERR), LOGFMT "Got parser error while parsing HTTP stream", LOGID(req));
@@ -193,6 +213,11 @@ void Request::resume()
         return;
     }
 
+    if (h2session) {
+        paused = false;
+        h2session->resume(this);
+        return;
+    }
     if (ioctx == nullptr) {
         return;
     }
@@ -267,11 +292,18 @@ static void on_connected(lcbio_SOCKET *sock, void *arg, lcb_STATUS err, lcbio_OS
 
 lcb_STATUS Request::start_io(lcb_host_t &dest)
 {
-    lcbio_MGR *pool = instance->http_sockpool;
+    if (http2) {
+        lcb_STATUS rc = instance->http2_pool->submit(dest, this);
+        if (rc != LCB_SUCCESS) {
+            return rc;
+        }
+    } else {
+        lcbio_MGR *pool = instance->http_sockpool;
 
-    creq = pool->get(dest, timeout(), on_connected, this);
-    if (!creq) {
-        return LCB_ERR_CONNECT_ERROR;
+        creq = pool->get(dest, timeout(), on_connected, this);
+        if (!creq) {
+            return LCB_ERR_CONNECT_ERROR;
+        }
     }
 
     if (!timer) {
@@ -301,6 +333,10 @@ void Request::close_io()
 {
     lcb::io::ConnectionRequest::cancel(&creq);
 
+    if (h2session) {
+        h2session->cancel(this);
+    }
+
     if (!ioctx) {
         return;
     }
@@ -316,3 +352,14 @@ void Request::close_io()
     lcbio_ctx_close(ioctx, pool_close_cb, &can_ka);
     ioctx = nullptr;
 }
+
+lcbio_SOCKET *Request::get_socket() const
+{
+    if (ioctx) {
+        return ioctx->sock;
+    }
+    if (h2session) {
+        return h2session->get_socket();
+    }
+    return nullptr;
+}
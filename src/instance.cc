@@ -537,6 +537,8 @@ lcb_STATUS lcb_create(lcb_INSTANCE **instance, const lcb_CREATEOPTS *options)
     obj->iotable = lcbio_table_new(io_priv);
     obj->memd_sockpool = new io::Pool(settings, obj->iotable);
     obj->http_sockpool = new io::Pool(settings, obj->iotable);
+    obj->http_headers = new http::HeaderCache();
+    obj->http2_pool = new http::Http2Pool(obj);
 
     {
         // Needs its own scope because there are prior GOTOs
@@ -551,7 +553,7 @@ lcb_STATUS lcb_create(lcb_INSTANCE **instance, const lcb_CREATEOPTS *options)
     obj->ht_nodes = new Hostlist();
     obj->mc_nodes = new Hostlist();
     obj->retryq = new RetryQueue(&obj->cmdq, obj->iotable, obj->settings);
-    obj->n1ql_cache = lcb_n1qlcache_create();
+    obj->n1ql_cache = lcb_n1qlcache_create(settings);
     lcb_initialize_packet_handlers(obj);
     lcb_aspend_init(&obj->pendops);
     obj->collcache = new lcb::CollectionCache();
@@ -676,7 +678,9 @@ void lcb_destroy(lcb_INSTANCE *instance)
     DESTROY(delete, retryq)
     DESTROY(delete, confmon)
     DESTROY(do_pool_shutdown, memd_sockpool)
+    DESTROY(delete, http2_pool)
     DESTROY(do_pool_shutdown, http_sockpool)
+    DESTROY(delete, http_headers)
     DESTROY(lcb_vbguess_destroy, vbguess)
     DESTROY(lcb_n1qlcache_destroy, n1ql_cache)
 
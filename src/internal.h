@@ -76,6 +76,11 @@ namespace clconfig
 struct Confmon;
 class ConfigInfo;
 } // namespace clconfig
+namespace http
+{
+class HeaderCache;
+class Http2Pool;
+} // namespace http
 } // namespace lcb
 extern "C" {
 #endif
@@ -145,6 +150,9 @@ struct lcb_st {
 
     std::list<std::function<void(lcb_STATUS)>> *deferred_operations;
 
+    lcb::http::HeaderCache *http_headers; /**< Common headers of the HTTP requests */
+    lcb::http::Http2Pool *http2_pool;     /**< HTTP/2 connections (see LCB_CNTL_ENABLE_HTTP2) */
+
     lcb_settings *getSettings()
     {
         return settings;
@@ -264,6 +272,13 @@ lcb_RETRY_ACTION lcb_query_should_retry(const lcb_settings *settings, lcb_QUERY_
 
 lcb_RESPCALLBACK lcb_find_callback(lcb_INSTANCE *instance, lcb_CALLBACK_TYPE cbtype);
 
+/**
+ * Map the status of the memcached response to the library error code. The
+ * unknown statuses are looked up in the error map of the instance, which
+ * might be NULL.
+ */
+lcb_STATUS lcb_map_error(lcb_INSTANCE *instance, int in);
+
 /* These two functions exist to allow the tests to keep the loop alive while
  * scheduling other operations asynchronously */
 
@@ -33,6 +33,15 @@ class MetricsEntry : public lcb_SERVERMETRICS
         iometrics.hostport = m_hostport.c_str();
     }
 
+    ~MetricsEntry()
+    {
+        if (queue_latency) {
+            lcb_histogram_destroy(queue_latency);
+            lcb_histogram_destroy(wire_latency);
+            lcb_histogram_destroy(server_latency);
+        }
+    }
+
     MetricsEntry() = delete;
     MetricsEntry(const MetricsEntry &) = delete;
 };
@@ -50,6 +59,9 @@ class Metrics : public lcb_METRICS
         for (auto &entry : entries) {
             delete entry;
         }
+        if (dns_latency) {
+            lcb_histogram_destroy(dns_latency);
+        }
     }
 
     MetricsEntry *get(const char *host, const char *port, int create)
@@ -117,7 +129,27 @@ void lcb_metrics_dumpserver(const lcb_SERVERMETRICS *metrics, FILE *fp)
     fprintf(fp, "Packets errored: %lu\n", (unsigned long int)metrics->packets_errored);
     fprintf(fp, "Packets NMV: %lu\n", (unsigned long int)metrics->packets_nmv);
     fprintf(fp, "Packets timeout: %lu\n", (unsigned long int)metrics->packets_timeout);
-    fprintf(fp, "Packets orphaned: %lu", (unsigned long int)metrics->packets_ownerless);
+    fprintf(fp, "Packets orphaned: %lu\n", (unsigned long int)metrics->packets_ownerless);
+    fprintf(fp, "Flush writes: %lu\n", (unsigned long int)metrics->flush_writes);
+    fprintf(fp, "Flush bytes: %lu\n", (unsigned long int)metrics->flush_bytes);
+    fprintf(fp, "Flush bytes coalesced: %lu", (unsigned long int)metrics->flush_coalesced_bytes);
+    if (metrics->queue_latency) {
+        fprintf(fp, "\nQueue latency:\n");
+        lcb_histogram_print(metrics->queue_latency, fp);
+        fprintf(fp, "Wire latency:\n");
+        lcb_histogram_print(metrics->wire_latency, fp);
+        fprintf(fp, "Server latency:\n");
+        lcb_histogram_print(metrics->server_latency, fp);
+    }
+}
+
+void lcb_metrics_enable_latency(lcb_SERVERMETRICS *metrics)
+{
+    if (metrics->queue_latency == nullptr) {
+        metrics->queue_latency = lcb_histogram_create();
+        metrics->wire_latency = lcb_histogram_create();
+        metrics->server_latency = lcb_histogram_create();
+    }
 }
 
 void lcb_metrics_reset_pipeline_gauges(lcb_SERVERMETRICS *metrics)
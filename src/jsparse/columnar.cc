@@ -0,0 +1,707 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "columnar.h"
+
+#include <cstring>
+#include <locale>
+#include <sstream>
+
+/*
+ * Converts the JSON number regardless of the decimal separator of the current
+ * locale. When the significant digits and the power of ten are both exact in
+ * double, single multiplication or division gives correctly rounded result,
+ * the rest of the numbers go through the stream with the classic locale.
+ */
+static bool parse_double(const char *token, std::size_t token_len, double &value)
+{
+    static const double powers_of_ten[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                           1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    const char *p = token;
+    const char *end = token + token_len;
+    bool negative = p < end && *p == '-';
+    if (negative) {
+        p++;
+    }
+
+    std::uint64_t mantissa = 0;
+    bool truncated = false;
+    int exponent = 0;
+    std::size_t ndigits = 0;
+    bool fraction = false;
+    for (; p < end; p++) {
+        if (*p == '.' && !fraction) {
+            fraction = true;
+            continue;
+        }
+        if (*p < '0' || *p > '9') {
+            break;
+        }
+        ndigits++;
+        if (mantissa < UINT64_MAX / 10 - 9) {
+            mantissa = mantissa * 10 + static_cast<unsigned>(*p - '0');
+            exponent -= fraction ? 1 : 0;
+        } else {
+            truncated = true;
+            exponent += fraction ? 0 : 1;
+        }
+    }
+    if (ndigits == 0) {
+        return false;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        bool negative_exponent = p < end && *p == '-';
+        if (p < end && (*p == '-' || *p == '+')) {
+            p++;
+        }
+        if (p == end) {
+            return false;
+        }
+        int explicit_exponent = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; p++) {
+            if (explicit_exponent < 100000) {
+                explicit_exponent = explicit_exponent * 10 + (*p - '0');
+            }
+        }
+        exponent += negative_exponent ? -explicit_exponent : explicit_exponent;
+    }
+    if (p != end) {
+        return false;
+    }
+
+    if (!truncated && mantissa <= (UINT64_C(1) << 53) && exponent >= -22 && exponent <= 22) {
+        value = static_cast<double>(mantissa);
+        value = exponent < 0 ? value / powers_of_ten[-exponent] : value * powers_of_ten[exponent];
+        if (negative) {
+            value = -value;
+        }
+        return true;
+    }
+    std::istringstream stream(std::string(token, token_len));
+    stream.imbue(std::locale::classic());
+    stream >> value;
+    return !stream.fail() && stream.peek() == std::char_traits<char>::eof();
+}
+
+lcb_STATUS lcb_COLUMN_SCHEMA_::add(const char *path, std::size_t path_len, lcb_COLUMN_TYPE type)
+{
+    if ((path == nullptr && path_len != 0) || type < LCB_COLUMN_INT64 || type > LCB_COLUMN_BOOLEAN) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    std::vector<std::string> keys;
+    if (path_len > 0) {
+        const char *begin = path;
+        const char *end = path + path_len;
+        while (true) {
+            const char *dot = static_cast<const char *>(std::memchr(begin, '.', end - begin));
+            const char *stop = dot == nullptr ? end : dot;
+            if (stop == begin) {
+                return LCB_ERR_INVALID_ARGUMENT;
+            }
+            keys.emplace_back(begin, stop);
+            if (dot == nullptr) {
+                break;
+            }
+            begin = dot + 1;
+        }
+    }
+
+    std::size_t current = 0;
+    for (const auto &key : keys) {
+        std::size_t next = 0;
+        for (auto child : nodes_[current].children) {
+            if (nodes_[child].key == key) {
+                next = child;
+                break;
+            }
+        }
+        if (next == 0) {
+            next = nodes_.size();
+            nodes_.emplace_back();
+            nodes_.back().key = key;
+            nodes_[current].children.push_back(next);
+        }
+        current = next;
+    }
+    nodes_[current].columns.push_back(types_.size());
+    types_.push_back(type);
+    return LCB_SUCCESS;
+}
+
+lcb_COLUMN_BATCH_::lcb_COLUMN_BATCH_(std::shared_ptr<const lcb_COLUMN_SCHEMA_> schema) : schema_(std::move(schema))
+{
+    std::size_t capacity = schema_->batch_size();
+    for (auto type : schema_->types()) {
+        Column column;
+        column.type = type;
+        switch (type) {
+            case LCB_COLUMN_INT64:
+                column.int64s.reserve(capacity);
+                break;
+            case LCB_COLUMN_DOUBLE:
+                column.doubles.reserve(capacity);
+                break;
+            case LCB_COLUMN_STRING:
+                column.strings.reserve(capacity);
+                break;
+            case LCB_COLUMN_BOOLEAN:
+                column.booleans.reserve(capacity);
+                break;
+        }
+        column.valid.reserve(capacity);
+        columns_.emplace_back(std::move(column));
+    }
+}
+
+void lcb_COLUMN_BATCH_::resize(std::size_t rows)
+{
+    for (auto &column : columns_) {
+        switch (column.type) {
+            case LCB_COLUMN_INT64:
+                column.int64s.resize(rows);
+                break;
+            case LCB_COLUMN_DOUBLE:
+                column.doubles.resize(rows);
+                break;
+            case LCB_COLUMN_STRING:
+                column.strings.resize(rows);
+                break;
+            case LCB_COLUMN_BOOLEAN:
+                column.booleans.resize(rows);
+                break;
+        }
+        column.valid.resize(rows);
+    }
+}
+
+void lcb_COLUMN_BATCH_::clear()
+{
+    resize(0);
+    rows_ = 0;
+    storage_.clear();
+}
+
+static bool is_json_whitespace(char ch)
+{
+    return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+}
+
+static int hex_value(char ch)
+{
+    if (ch >= '0' && ch <= '9') {
+        return ch - '0';
+    }
+    if (ch >= 'a' && ch <= 'f') {
+        return ch - 'a' + 10;
+    }
+    if (ch >= 'A' && ch <= 'F') {
+        return ch - 'A' + 10;
+    }
+    return -1;
+}
+
+static bool parse_hex4(const char *p, const char *end, unsigned *out)
+{
+    if (end - p < 4) {
+        return false;
+    }
+    unsigned value = 0;
+    for (int ii = 0; ii < 4; ii++) {
+        int digit = hex_value(p[ii]);
+        if (digit < 0) {
+            return false;
+        }
+        value = (value << 4) | static_cast<unsigned>(digit);
+    }
+    *out = value;
+    return true;
+}
+
+static void append_utf8(std::string &out, unsigned cp)
+{
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xc0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3f));
+    } else if (cp < 0x10000) {
+        out += static_cast<char>(0xe0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+        out += static_cast<char>(0x80 | (cp & 0x3f));
+    } else {
+        out += static_cast<char>(0xf0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3f));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+        out += static_cast<char>(0x80 | (cp & 0x3f));
+    }
+}
+
+/**
+ * Decodes the escape sequences of the JSON string (without quotes)
+ */
+static bool unescape(const char *p, const char *end, std::string &out)
+{
+    out.reserve(end - p);
+    while (p < end) {
+        char ch = *p++;
+        if (ch != '\\') {
+            out += ch;
+            continue;
+        }
+        if (p == end) {
+            return false;
+        }
+        ch = *p++;
+        switch (ch) {
+            case '"':
+            case '\\':
+            case '/':
+                out += ch;
+                break;
+            case 'b':
+                out += '\b';
+                break;
+            case 'f':
+                out += '\f';
+                break;
+            case 'n':
+                out += '\n';
+                break;
+            case 'r':
+                out += '\r';
+                break;
+            case 't':
+                out += '\t';
+                break;
+            case 'u': {
+                unsigned cp;
+                if (!parse_hex4(p, end, &cp)) {
+                    return false;
+                }
+                p += 4;
+                if (cp >= 0xd800 && cp < 0xdc00) {
+                    unsigned low;
+                    if (end - p < 6 || p[0] != '\\' || p[1] != 'u' || !parse_hex4(p + 2, end, &low) || low < 0xdc00 ||
+                        low > 0xdfff) {
+                        return false;
+                    }
+                    p += 6;
+                    cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                } else if (cp >= 0xdc00 && cp <= 0xdfff) {
+                    return false;
+                }
+                append_utf8(out, cp);
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Single pass over the row. Only the fields referenced by the schema are
+ * decoded, everything else is skipped without building any values.
+ */
+struct ColumnScanner {
+    lcb_COLUMN_BATCH_ &batch;
+    const lcb_COLUMN_SCHEMA_ &schema;
+    std::size_t row;
+    const char *p;
+    const char *end;
+
+    void skip_whitespace()
+    {
+        while (p < end && is_json_whitespace(*p)) {
+            p++;
+        }
+    }
+
+    /**
+     * Positions after the closing quote of the string
+     * @param escaped set to true if the string contains escape sequences
+     */
+    bool skip_string(bool *escaped)
+    {
+        p++; // opening quote
+        while (p < end) {
+            char ch = *p++;
+            if (ch == '"') {
+                return true;
+            }
+            if (ch == '\\') {
+                *escaped = true;
+                if (p == end) {
+                    return false;
+                }
+                p++;
+            }
+        }
+        return false;
+    }
+
+    bool skip_scalar()
+    {
+        const char *begin = p;
+        while (p < end && !is_json_whitespace(*p) && *p != ',' && *p != ']' && *p != '}') {
+            p++;
+        }
+        return p != begin;
+    }
+
+    bool skip_value()
+    {
+        if (p == end) {
+            return false;
+        }
+        if (*p == '"') {
+            bool escaped = false;
+            return skip_string(&escaped);
+        }
+        if (*p != '{' && *p != '[') {
+            return skip_scalar();
+        }
+        std::size_t depth = 0;
+        while (p < end) {
+            char ch = *p;
+            if (ch == '"') {
+                bool escaped = false;
+                if (!skip_string(&escaped)) {
+                    return false;
+                }
+                continue;
+            }
+            p++;
+            if (ch == '{' || ch == '[') {
+                depth++;
+            } else if ((ch == '}' || ch == ']') && --depth == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool object(std::size_t node_index)
+    {
+        const lcb_COLUMN_SCHEMA_::Node &node = schema.node(node_index);
+        p++; // opening brace
+        skip_whitespace();
+        if (p < end && *p == '}') {
+            p++;
+            return true;
+        }
+        while (p < end) {
+            if (*p != '"') {
+                return false;
+            }
+            const char *key = p + 1;
+            bool escaped = false;
+            if (!skip_string(&escaped)) {
+                return false;
+            }
+            std::size_t key_len = p - key - 1;
+            std::string unescaped;
+            if (escaped) {
+                if (!unescape(key, key + key_len, unescaped)) {
+                    return false;
+                }
+                key = unescaped.data();
+                key_len = unescaped.size();
+            }
+            skip_whitespace();
+            if (p == end || *p != ':') {
+                return false;
+            }
+            p++;
+            skip_whitespace();
+
+            std::size_t field = 0;
+            for (auto child : node.children) {
+                const std::string &name = schema.node(child).key;
+                if (name.size() == key_len && std::memcmp(name.data(), key, key_len) == 0) {
+                    field = child;
+                    break;
+                }
+            }
+            if (!(field == 0 ? skip_value() : value(field))) {
+                return false;
+            }
+
+            skip_whitespace();
+            if (p == end) {
+                return false;
+            }
+            if (*p == '}') {
+                p++;
+                return true;
+            }
+            if (*p != ',') {
+                return false;
+            }
+            p++;
+            skip_whitespace();
+        }
+        return false;
+    }
+
+    bool value(std::size_t node_index)
+    {
+        const lcb_COLUMN_SCHEMA_::Node &node = schema.node(node_index);
+        if (p == end) {
+            return false;
+        }
+        if (*p == '{' && !node.children.empty()) {
+            return object(node_index);
+        }
+        if (node.columns.empty()) {
+            return skip_value();
+        }
+
+        const char *begin = p;
+        if (*p == '"') {
+            bool escaped = false;
+            if (!skip_string(&escaped)) {
+                return false;
+            }
+            lcb_COLUMN_STRING str{begin + 1, static_cast<std::size_t>(p - begin - 2)};
+            bool decoded = false;
+            for (auto idx : node.columns) {
+                lcb_COLUMN_BATCH_::Column &column = batch.columns_[idx];
+                if (column.type != LCB_COLUMN_STRING) {
+                    continue;
+                }
+                if (escaped && !decoded) {
+                    batch.storage_.emplace_back();
+                    if (!unescape(str.data, str.data + str.length, batch.storage_.back())) {
+                        return false;
+                    }
+                    str.data = batch.storage_.back().data();
+                    str.length = batch.storage_.back().size();
+                    decoded = true;
+                }
+                column.strings[row] = str;
+                column.valid[row] = 1;
+            }
+            return true;
+        }
+        if (!skip_value()) {
+            return false;
+        }
+        std::size_t token_len = p - begin;
+
+        if (*begin == 't' || *begin == 'f') {
+            std::uint8_t flag;
+            if (token_len == 4 && std::memcmp(begin, "true", 4) == 0) {
+                flag = 1;
+            } else if (token_len == 5 && std::memcmp(begin, "false", 5) == 0) {
+                flag = 0;
+            } else {
+                return false;
+            }
+            for (auto idx : node.columns) {
+                lcb_COLUMN_BATCH_::Column &column = batch.columns_[idx];
+                if (column.type == LCB_COLUMN_BOOLEAN) {
+                    column.booleans[row] = flag;
+                    column.valid[row] = 1;
+                }
+            }
+            return true;
+        }
+        if (*begin == 'n') {
+            return token_len == 4 && std::memcmp(begin, "null", 4) == 0;
+        }
+        if (*begin != '-' && (*begin < '0' || *begin > '9')) {
+            // objects and arrays do not have representation in the columns
+            return true;
+        }
+        return number(node, begin, token_len);
+    }
+
+    bool number(const lcb_COLUMN_SCHEMA_::Node &node, const char *token, std::size_t token_len)
+    {
+        bool negative = *token == '-';
+        std::size_t ii = negative ? 1 : 0;
+        std::uint64_t magnitude = 0;
+        bool integer = ii < token_len;
+        bool overflow = false;
+        for (; ii < token_len; ii++) {
+            char ch = token[ii];
+            if (ch < '0' || ch > '9') {
+                integer = false;
+                break;
+            }
+            unsigned digit = static_cast<unsigned>(ch - '0');
+            if (magnitude > (UINT64_MAX - digit) / 10) {
+                overflow = true;
+            } else {
+                magnitude = magnitude * 10 + digit;
+            }
+        }
+        bool fits = integer && !overflow &&
+                    magnitude <= (negative ? static_cast<std::uint64_t>(INT64_MAX) + 1 : static_cast<std::uint64_t>(INT64_MAX));
+        std::int64_t int_value = 0;
+        if (fits) {
+            int_value = negative ? static_cast<std::int64_t>(0 - magnitude) : static_cast<std::int64_t>(magnitude);
+        }
+
+        double double_value = 0;
+        bool have_double = false;
+        for (auto idx : node.columns) {
+            lcb_COLUMN_BATCH_::Column &column = batch.columns_[idx];
+            if (column.type == LCB_COLUMN_INT64) {
+                if (fits) {
+                    column.int64s[row] = int_value;
+                    column.valid[row] = 1;
+                }
+            } else if (column.type == LCB_COLUMN_DOUBLE) {
+                if (!have_double) {
+                    if (fits && (int_value >= -(INT64_C(1) << 53) && int_value <= (INT64_C(1) << 53))) {
+                        double_value = static_cast<double>(int_value);
+                    } else {
+                        if (!parse_double(token, token_len, double_value)) {
+                            return false;
+                        }
+                    }
+                    have_double = true;
+                }
+                column.doubles[row] = double_value;
+                column.valid[row] = 1;
+            }
+        }
+        return true;
+    }
+};
+
+bool lcb_COLUMN_BATCH_::append(const char *row, std::size_t row_len, bool stable)
+{
+    if (!stable) {
+        storage_.emplace_back(row, row_len);
+        row = storage_.back().data();
+    }
+    resize(rows_ + 1);
+    ColumnScanner scanner{*this, *schema_, rows_, row, row + row_len};
+    scanner.skip_whitespace();
+    bool ok = scanner.value(0);
+    if (ok) {
+        scanner.skip_whitespace();
+        ok = scanner.p == scanner.end;
+    }
+    if (!ok) {
+        resize(rows_);
+        return false;
+    }
+    rows_++;
+    return true;
+}
+
+lcb_STATUS lcb_COLUMN_BATCH_::int64_values(std::size_t column, const std::int64_t **values,
+                                           const std::uint8_t **valid) const
+{
+    if (column >= columns_.size() || columns_[column].type != LCB_COLUMN_INT64) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    *values = columns_[column].int64s.data();
+    *valid = columns_[column].valid.data();
+    return LCB_SUCCESS;
+}
+
+lcb_STATUS lcb_COLUMN_BATCH_::double_values(std::size_t column, const double **values,
+                                            const std::uint8_t **valid) const
+{
+    if (column >= columns_.size() || columns_[column].type != LCB_COLUMN_DOUBLE) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    *values = columns_[column].doubles.data();
+    *valid = columns_[column].valid.data();
+    return LCB_SUCCESS;
+}
+
+lcb_STATUS lcb_COLUMN_BATCH_::string_values(std::size_t column, const lcb_COLUMN_STRING **values,
+                                            const std::uint8_t **valid) const
+{
+    if (column >= columns_.size() || columns_[column].type != LCB_COLUMN_STRING) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    *values = columns_[column].strings.data();
+    *valid = columns_[column].valid.data();
+    return LCB_SUCCESS;
+}
+
+lcb_STATUS lcb_COLUMN_BATCH_::boolean_values(std::size_t column, const std::uint8_t **values,
+                                             const std::uint8_t **valid) const
+{
+    if (column >= columns_.size() || columns_[column].type != LCB_COLUMN_BOOLEAN) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    *values = columns_[column].booleans.data();
+    *valid = columns_[column].valid.data();
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_column_schema_create(lcb_COLUMN_SCHEMA **schema)
+{
+    *schema = new lcb_COLUMN_SCHEMA_();
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_column_schema_destroy(lcb_COLUMN_SCHEMA *schema)
+{
+    delete schema;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_column_schema_add(lcb_COLUMN_SCHEMA *schema, const char *path, size_t path_len,
+                                                  lcb_COLUMN_TYPE type)
+{
+    return schema->add(path, path_len, type);
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_column_schema_batch_size(lcb_COLUMN_SCHEMA *schema, size_t rows)
+{
+    return schema->batch_size(rows);
+}
+
+LIBCOUCHBASE_API size_t lcb_column_batch_rows(const lcb_COLUMN_BATCH *batch)
+{
+    return batch->rows();
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_column_batch_int64(const lcb_COLUMN_BATCH *batch, size_t column,
+                                                   const int64_t **values, const uint8_t **valid)
+{
+    return batch->int64_values(column, values, valid);
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_column_batch_double(const lcb_COLUMN_BATCH *batch, size_t column,
+                                                    const double **values, const uint8_t **valid)
+{
+    return batch->double_values(column, values, valid);
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_column_batch_string(const lcb_COLUMN_BATCH *batch, size_t column,
+                                                    const lcb_COLUMN_STRING **values, const uint8_t **valid)
+{
+    return batch->string_values(column, values, valid);
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_column_batch_boolean(const lcb_COLUMN_BATCH *batch, size_t column,
+                                                     const uint8_t **values, const uint8_t **valid)
+{
+    return batch->boolean_values(column, values, valid);
+}
@@ -0,0 +1,129 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_JSPARSE_COLUMNAR_H
+#define LCB_JSPARSE_COLUMNAR_H
+
+#include <libcouchbase/couchbase.h>
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Projection of the rows: list of the typed columns, compiled into the tree
+ * of the field names, so that the row can be decoded in one pass.
+ */
+struct lcb_COLUMN_SCHEMA_ {
+    struct Node {
+        std::string key{};
+        /** indexes of the nested fields in nodes_ */
+        std::vector<std::size_t> children{};
+        /** indexes of the columns, which take value of this field */
+        std::vector<std::size_t> columns{};
+    };
+
+    lcb_STATUS add(const char *path, std::size_t path_len, lcb_COLUMN_TYPE type);
+
+    lcb_STATUS batch_size(std::size_t rows)
+    {
+        if (rows == 0) {
+            return LCB_ERR_INVALID_ARGUMENT;
+        }
+        batch_size_ = rows;
+        return LCB_SUCCESS;
+    }
+
+    std::size_t batch_size() const
+    {
+        return batch_size_;
+    }
+
+    const std::vector<lcb_COLUMN_TYPE> &types() const
+    {
+        return types_;
+    }
+
+    const Node &node(std::size_t index) const
+    {
+        return nodes_[index];
+    }
+
+  private:
+    std::vector<Node> nodes_{Node{}};
+    std::vector<lcb_COLUMN_TYPE> types_{};
+    std::size_t batch_size_{1024};
+};
+
+/**
+ * Rows decoded into columns. The string values reference the row data passed
+ * to append(), unless the row was not stable or the string had to be
+ * unescaped.
+ */
+struct lcb_COLUMN_BATCH_ {
+    explicit lcb_COLUMN_BATCH_(std::shared_ptr<const lcb_COLUMN_SCHEMA_> schema);
+
+    /**
+     * Decode the row and append its values to the columns.
+     * @param row the row JSON
+     * @param row_len length of the row
+     * @param stable true if the data will not change until the batch is cleared
+     * @return false if the row is not valid JSON, the row is not appended in this case
+     */
+    bool append(const char *row, std::size_t row_len, bool stable);
+
+    void clear();
+
+    std::size_t rows() const
+    {
+        return rows_;
+    }
+
+    bool full() const
+    {
+        return rows_ >= schema_->batch_size();
+    }
+
+    lcb_STATUS int64_values(std::size_t column, const std::int64_t **values, const std::uint8_t **valid) const;
+    lcb_STATUS double_values(std::size_t column, const double **values, const std::uint8_t **valid) const;
+    lcb_STATUS string_values(std::size_t column, const lcb_COLUMN_STRING **values, const std::uint8_t **valid) const;
+    lcb_STATUS boolean_values(std::size_t column, const std::uint8_t **values, const std::uint8_t **valid) const;
+
+  private:
+    friend struct ColumnScanner;
+
+    struct Column {
+        lcb_COLUMN_TYPE type{LCB_COLUMN_INT64};
+        std::vector<std::int64_t> int64s{};
+        std::vector<double> doubles{};
+        std::vector<lcb_COLUMN_STRING> strings{};
+        std::vector<std::uint8_t> booleans{};
+        std::vector<std::uint8_t> valid{};
+    };
+
+    void resize(std::size_t rows);
+
+    std::shared_ptr<const lcb_COLUMN_SCHEMA_> schema_;
+    std::vector<Column> columns_{};
+    std::size_t rows_{0};
+    /** copies of the unstable rows and unescaped strings */
+    std::deque<std::string> storage_{};
+};
+
+#endif
@@ -25,13 +25,23 @@
 #include "contrib/lcb-jsoncpp/lcb-jsoncpp.h"
 #include "parser.h"
 
+#include <cctype>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LCB_JSPARSE_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
 #define DECLARE_JSONSL_CALLBACK(name)                                                                                  \
     static void name(jsonsl_t, jsonsl_action_t, struct jsonsl_state_st *, const char *)
 
-DECLARE_JSONSL_CALLBACK(row_pop_callback);
+DECLARE_JSONSL_CALLBACK(rowset_pop_callback);
 DECLARE_JSONSL_CALLBACK(initial_push_callback);
 DECLARE_JSONSL_CALLBACK(initial_pop_callback);
-DECLARE_JSONSL_CALLBACK(meta_header_complete_callback);
 DECLARE_JSONSL_CALLBACK(trailer_pop_callback);
 
 using namespace lcb::jsparse;
@@ -99,53 +109,21 @@ static Parser *get_ctx(jsonsl_t jsn)
     return reinterpret_cast<Parser *>(jsn->data);
 }
 
-static void meta_header_complete_callback(jsonsl_t jsn, jsonsl_action_t, struct jsonsl_state_st *state,
-                                          const jsonsl_char_t *)
-{
-    Parser *ctx = get_ctx(jsn);
-    ctx->meta_buf.append(ctx->current_buf.c_str(), state->pos_begin);
-
-    ctx->header_len = state->pos_begin;
-    jsn->action_callback_PUSH = nullptr;
-}
-
-static void row_pop_callback(jsonsl_t jsn, jsonsl_action_t, struct jsonsl_state_st *state, const jsonsl_char_t *)
+/**
+ * Invoked for the closing bracket of the rows. The rows themselves are split
+ * by Parser::feed_rows(), which feeds jsonsl again starting from the bracket.
+ */
+static void rowset_pop_callback(jsonsl_t jsn, jsonsl_action_t, struct jsonsl_state_st *state, const jsonsl_char_t *)
 {
     Parser *ctx = get_ctx(jsn);
-    const char *rowbuf;
-    size_t szdummy;
 
-    if (ctx->have_error) {
+    if (ctx->have_error || state->data != JOBJ_ROWSET) {
         return;
     }
 
     ctx->keep_pos = jsn->pos;
     ctx->last_row_endpos = jsn->pos;
-
-    if (state->data == JOBJ_ROWSET) {
-        jsn->action_callback_POP = trailer_pop_callback;
-        jsn->action_callback_PUSH = nullptr;
-        if (ctx->rowcount == 0) {
-            /* Emulate what meta_header_complete callback does. */
-
-            /* While the entire meta is available to us, the _closing_ part
-             * of the meta is handled in a different callback. */
-            ctx->meta_buf.append(ctx->current_buf.c_str(), jsn->pos);
-            ctx->header_len = jsn->pos;
-        }
-        return;
-    }
-
-    ctx->rowcount++;
-    if (!ctx->actions) {
-        return;
-    }
-
-    rowbuf = ctx->get_buffer_region(state->pos_begin, -1, &szdummy);
-    Row dt{};
-    dt.row.iov_base = (void *)rowbuf;
-    dt.row.iov_len = jsn->pos - state->pos_begin + (state->type == JSONSL_T_SPECIAL ? 0 : 1);
-    ctx->actions->JSPARSE_on_row(dt);
+    jsn->action_callback_POP = trailer_pop_callback;
 }
 
 static int parse_error_callback(jsonsl_t jsn, jsonsl_error_t, struct jsonsl_state_st *, jsonsl_char_t *)
@@ -231,19 +209,278 @@ static void initial_push_callback(jsonsl_t jsn, jsonsl_action_t, struct jsonsl_s
     }
 
     if (state->type == JSONSL_T_LIST && match == JSONSL_MATCH_POSSIBLE) {
-        /* we have a match, e.g. "rows:[]" */
-        jsn->action_callback_POP = row_pop_callback;
-        jsn->action_callback_PUSH = meta_header_complete_callback;
+        /* we have a match, e.g. "rows:[]". Hand the contents over to the splitter */
+        jsn->action_callback_POP = rowset_pop_callback;
+        jsn->action_callback_PUSH = nullptr;
         state->data = JOBJ_ROWSET;
+        ctx->begin_rows(jsn->pos + 1);
+        jsonsl_stop(jsn);
     }
 }
 
+#ifdef LCB_JSPARSE_SSE2
+static inline unsigned first_bit(unsigned mask)
+{
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanForward(&idx, mask);
+    return idx;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+/** @return position of the first quote or backslash in s[pos..n), or n */
+static size_t find_string_special(const char *s, size_t pos, size_t n)
+{
+#ifdef LCB_JSPARSE_SSE2
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    for (; pos + 16 <= n; pos += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + pos));
+        unsigned mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)));
+        if (mask) {
+            return pos + first_bit(mask);
+        }
+    }
+#endif
+    for (; pos < n; pos++) {
+        if (s[pos] == '"' || s[pos] == '\\') {
+            return pos;
+        }
+    }
+    return n;
+}
+
+/** @return position of the first quote or bracket in s[pos..n), or n */
+static size_t find_structural(const char *s, size_t pos, size_t n)
+{
+#ifdef LCB_JSPARSE_SSE2
+    /* '[' and ']' differ from '{' and '}' only by 0x20 bit */
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+    const __m128i open = _mm_set1_epi8('{');
+    const __m128i close = _mm_set1_epi8('}');
+    for (; pos + 16 <= n; pos += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + pos));
+        __m128i folded = _mm_or_si128(chunk, case_bit);
+        __m128i found = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                                     _mm_or_si128(_mm_cmpeq_epi8(folded, open), _mm_cmpeq_epi8(folded, close)));
+        unsigned mask = _mm_movemask_epi8(found);
+        if (mask) {
+            return pos + first_bit(mask);
+        }
+    }
+#endif
+    for (; pos < n; pos++) {
+        switch (s[pos]) {
+            case '"':
+            case '{':
+            case '}':
+            case '[':
+            case ']':
+                return pos;
+            default:
+                break;
+        }
+    }
+    return n;
+}
+
+static inline bool is_json_whitespace(char ch)
+{
+    return ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t';
+}
+
+void Parser::begin_rows(size_t pos)
+{
+    /* Everything up to (and including) the opening bracket is the header of the metadata */
+    meta_buf.append(current_buf.c_str(), pos - min_pos);
+    header_len = meta_buf.size();
+
+    row_scan = 1;
+    scan_expect = SCAN_FIRST_ROW;
+    scan_string = 0;
+    scan_escape = 0;
+    scan_scalar = 0;
+    scan_depth = 0;
+    row_begin = std::string::npos;
+}
+
+void Parser::rows_error()
+{
+    have_error = 1;
+    if (actions) {
+        actions->JSPARSE_on_error(current_buf);
+        actions = nullptr;
+    }
+}
+
+void Parser::emit_row(const char *data, size_t chunk_pos, size_t end_pos)
+{
+    const char *rowbuf;
+
+    if (row_begin >= chunk_pos) {
+        /* the row is entirely contained in the input */
+        rowbuf = data + (row_begin - chunk_pos);
+    } else {
+        /* the beginning of the row has been received earlier */
+        current_buf.append(data, end_pos - chunk_pos);
+        rowbuf = current_buf.c_str() + (row_begin - min_pos);
+    }
+
+    Row dt{};
+    dt.row.iov_base = (void *)rowbuf;
+    dt.row.iov_len = end_pos - row_begin;
+    row_begin = std::string::npos;
+    rowcount++;
+    if (actions) {
+        actions->JSPARSE_on_row(dt);
+    }
+}
+
+void Parser::feed_rows(const char *data, size_t ndata)
+{
+    /* absolute position of the first byte of the input */
+    const size_t chunk_pos = min_pos + current_buf.size();
+    size_t ii = 0;
+
+    if (have_error) {
+        return;
+    }
+
+    while (ii < ndata) {
+        if (scan_string) {
+            if (scan_escape) {
+                scan_escape = 0;
+                ii++;
+                continue;
+            }
+            ii = find_string_special(data, ii, ndata);
+            if (ii == ndata) {
+                break;
+            }
+            if (data[ii++] == '\\') {
+                scan_escape = 1;
+                continue;
+            }
+            scan_string = 0;
+            if (scan_depth == 0) {
+                emit_row(data, chunk_pos, chunk_pos + ii);
+            }
+            continue;
+        }
+
+        if (scan_scalar) {
+            char ch = data[ii];
+            if (!is_json_whitespace(ch) && ch != ',' && ch != ']' && ch != '}') {
+                ii++;
+                continue;
+            }
+            scan_scalar = 0;
+            emit_row(data, chunk_pos, chunk_pos + ii);
+            continue;
+        }
+
+        if (scan_depth) {
+            ii = find_structural(data, ii, ndata);
+            if (ii == ndata) {
+                break;
+            }
+            char ch = data[ii++];
+            if (ch == '"') {
+                scan_string = 1;
+            } else if (ch == '{' || ch == '[') {
+                scan_depth++;
+            } else if (--scan_depth == 0) {
+                emit_row(data, chunk_pos, chunk_pos + ii);
+            }
+            continue;
+        }
+
+        /* between the rows */
+        char ch = data[ii];
+        if (is_json_whitespace(ch)) {
+            ii++;
+            continue;
+        }
+        if (ch == ',') {
+            if (scan_expect != SCAN_COMMA) {
+                rows_error();
+                return;
+            }
+            scan_expect = SCAN_NEXT_ROW;
+            ii++;
+            continue;
+        }
+        if (ch == ']') {
+            if (scan_expect == SCAN_NEXT_ROW) {
+                rows_error();
+                return;
+            }
+            /* end of the rows: let jsonsl continue from the closing bracket */
+            size_t end_pos = chunk_pos + ii;
+            current_buf.assign(data + ii, ndata - ii);
+            min_pos = keep_pos = end_pos;
+            row_scan = 0;
+            jsn->stopfl = 0;
+            jsn->tok_last = 0;
+            jsn->pos = end_pos;
+            jsonsl_feed(jsn, current_buf.c_str(), current_buf.size());
+            return;
+        }
+        if (scan_expect == SCAN_COMMA || ch == '}') {
+            rows_error();
+            return;
+        }
+        row_begin = chunk_pos + ii;
+        scan_expect = SCAN_COMMA;
+        ii++;
+        if (ch == '{' || ch == '[') {
+            scan_depth = 1;
+        } else if (ch == '"') {
+            scan_string = 1;
+        } else {
+            scan_scalar = 1;
+        }
+    }
+
+    /* keep only the incomplete row (if any) for the next input */
+    if (row_begin == std::string::npos) {
+        current_buf.clear();
+        min_pos = chunk_pos + ndata;
+    } else if (row_begin >= chunk_pos) {
+        current_buf.assign(data + (row_begin - chunk_pos), ndata - (row_begin - chunk_pos));
+        min_pos = row_begin;
+    } else {
+        current_buf.append(data, ndata);
+    }
+    keep_pos = min_pos;
+}
+
 void Parser::feed(const char *data_, size_t ndata)
 {
+    if (row_scan) {
+        feed_rows(data_, ndata);
+        return;
+    }
+
     size_t old_len = current_buf.size();
     current_buf.append(data_, ndata);
     jsonsl_feed(jsn, current_buf.c_str() + old_len, ndata);
 
+    if (row_scan) {
+        /* jsonsl has stopped at the opening bracket of the rows, split the rest of the input */
+        size_t rows_pos = jsn->pos + 1;
+        /* the bracket is always in the current input, so the rows can be referenced from there */
+        size_t skip = rows_pos - min_pos - old_len;
+        current_buf.clear();
+        min_pos = keep_pos = rows_pos;
+        feed_rows(data_ + skip, ndata - skip);
+        return;
+    }
+
     /* Do we need to cut off some bytes? */
     if (keep_pos > min_pos) {
         current_buf.erase(0, keep_pos - min_pos);
@@ -270,7 +507,8 @@ const char *Parser::jprstr_for_mode(Mode mode)
 Parser::Parser(Mode mode_, Parser::Actions *actions_)
     : jsn(jsonsl_new(512)), jsn_rdetails(jsonsl_new(32)), jpr(jsonsl_jpr_new(jprstr_for_mode(mode_), nullptr)),
       mode(mode_), have_error(0), initialized(0), meta_complete(0), rowcount(0), min_pos(0), keep_pos(0), header_len(0),
-      last_row_endpos(0), cxx_data(), actions(actions_)
+      last_row_endpos(0), row_scan(0), scan_expect(SCAN_FIRST_ROW), scan_string(0), scan_escape(0), scan_scalar(0),
+      scan_depth(0), row_begin(std::string::npos), cxx_data(), actions(actions_)
 {
 
     jsonsl_jpr_match_state_init(jsn, &jpr, 1);
@@ -421,3 +659,195 @@ void Parser::parse_viewrow(Row &vr)
 
     jsonsl_feed(jsn_rdetails, static_cast<const char *>(vr.row.iov_base), vr.row.iov_len);
 }
+
+namespace
+{
+class Validator
+{
+  public:
+    Validator(const char *data, size_t size) : cur(data), end(data + size) {}
+
+    bool run()
+    {
+        if (!value()) {
+            return false;
+        }
+        skip_ws();
+        return cur == end;
+    }
+
+  private:
+    static const unsigned max_depth = 512;
+
+    void skip_ws()
+    {
+        while (cur != end && (*cur == ' ' || *cur == '\t' || *cur == '\n' || *cur == '\r')) {
+            ++cur;
+        }
+    }
+
+    bool literal(const char *lit, size_t nlit)
+    {
+        if (static_cast<size_t>(end - cur) < nlit || memcmp(cur, lit, nlit) != 0) {
+            return false;
+        }
+        cur += nlit;
+        return true;
+    }
+
+    bool digits()
+    {
+        const char *begin = cur;
+        while (cur != end && *cur >= '0' && *cur <= '9') {
+            ++cur;
+        }
+        return cur != begin;
+    }
+
+    bool number()
+    {
+        if (*cur == '-') {
+            ++cur;
+        }
+        if (cur != end && *cur == '0') {
+            ++cur;
+        } else if (!digits()) {
+            return false;
+        }
+        if (cur != end && *cur == '.') {
+            ++cur;
+            if (!digits()) {
+                return false;
+            }
+        }
+        if (cur != end && (*cur == 'e' || *cur == 'E')) {
+            ++cur;
+            if (cur != end && (*cur == '+' || *cur == '-')) {
+                ++cur;
+            }
+            if (!digits()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool string()
+    {
+        ++cur; // opening quote
+        while (cur != end) {
+            auto c = static_cast<unsigned char>(*cur++);
+            if (c == '"') {
+                return true;
+            }
+            if (c < 0x20) {
+                return false;
+            }
+            if (c != '\\') {
+                continue;
+            }
+            if (cur == end) {
+                return false;
+            }
+            switch (*cur++) {
+                case '"':
+                case '\\':
+                case '/':
+                case 'b':
+                case 'f':
+                case 'n':
+                case 'r':
+                case 't':
+                    break;
+                case 'u':
+                    for (int ii = 0; ii < 4; ii++, cur++) {
+                        if (cur == end || !isxdigit(static_cast<unsigned char>(*cur))) {
+                            return false;
+                        }
+                    }
+                    break;
+                default:
+                    return false;
+            }
+        }
+        return false;
+    }
+
+    bool container(char closing)
+    {
+        if (++depth > max_depth) {
+            return false;
+        }
+        ++cur; // opening bracket
+        skip_ws();
+        if (cur != end && *cur == closing) {
+            ++cur;
+            --depth;
+            return true;
+        }
+        for (;;) {
+            if (closing == '}') {
+                skip_ws();
+                if (cur == end || *cur != '"' || !string()) {
+                    return false;
+                }
+                skip_ws();
+                if (cur == end || *cur != ':') {
+                    return false;
+                }
+                ++cur;
+            }
+            if (!value()) {
+                return false;
+            }
+            skip_ws();
+            if (cur == end) {
+                return false;
+            }
+            if (*cur == ',') {
+                ++cur;
+                continue;
+            }
+            if (*cur != closing) {
+                return false;
+            }
+            ++cur;
+            --depth;
+            return true;
+        }
+    }
+
+    bool value()
+    {
+        skip_ws();
+        if (cur == end) {
+            return false;
+        }
+        switch (*cur) {
+            case '{':
+                return container('}');
+            case '[':
+                return container(']');
+            case '"':
+                return string();
+            case 't':
+                return literal("true", 4);
+            case 'f':
+                return literal("false", 5);
+            case 'n':
+                return literal("null", 4);
+            default:
+                return number();
+        }
+    }
+
+    const char *cur;
+    const char *end;
+    unsigned depth{0};
+};
+} // namespace
+
+bool lcb::jsparse::validate(const char *data, size_t size)
+{
+    return data != nullptr && Validator(data, size).run();
+}
@@ -110,6 +110,23 @@ struct Parser {
     inline void combine_meta();
     inline static const char *jprstr_for_mode(Mode);
 
+    /**
+     * Start splitting the rows array, which begins at the given (absolute)
+     * position. Called when jsonsl encounters the opening bracket of the rows.
+     */
+    inline void begin_rows(size_t pos);
+
+    /**
+     * Split the rows array without passing it through jsonsl. Only the row
+     * boundaries are located (strings, escapes and nesting are tracked), and
+     * rows which are entirely contained in the input are handed to the
+     * callback without copying. Once the closing bracket of the array is
+     * found, the rest of the input is fed to jsonsl.
+     */
+    inline void feed_rows(const char *data, size_t ndata);
+    inline void emit_row(const char *data, size_t chunk_pos, size_t end_pos);
+    inline void rows_error();
+
     jsonsl_t jsn;            /**< Parser for the row itself */
     jsonsl_t jsn_rdetails;   /**< Parser for the row details */
     jsonsl_jpr_t jpr;        /**< jsonpointer match object */
@@ -143,6 +160,16 @@ struct Parser {
      */
     size_t last_row_endpos;
 
+    /* Row splitter state (see feed_rows()) */
+    enum ScanExpect { SCAN_FIRST_ROW, SCAN_COMMA, SCAN_NEXT_ROW };
+    lcb_U8 row_scan;     /**< Rows array is being split by feed_rows() */
+    lcb_U8 scan_expect;  /**< What is expected between rows (::ScanExpect) */
+    lcb_U8 scan_string;  /**< Inside string literal */
+    lcb_U8 scan_escape;  /**< Previous character was backslash inside string */
+    lcb_U8 scan_scalar;  /**< Inside top-level number, true, false or null */
+    unsigned scan_depth; /**< Nesting level inside the current row */
+    size_t row_begin;    /**< Absolute position of the current row, or npos */
+
     /**
      * std::string to contain parsed document ID.
      */
@@ -152,6 +179,13 @@ struct Parser {
     Actions *actions;
 };
 
+/**
+ * Checks that the buffer contains exactly one well-formed JSON value (which
+ * may be a scalar). The check does not allocate, so it is cheaper than
+ * parsing the value with Json::Reader when only the raw bytes are needed.
+ */
+bool validate(const char *data, size_t size);
+
 } // namespace jsparse
 } // namespace lcb
 #endif /* LCB_VIEWROW_H_ */
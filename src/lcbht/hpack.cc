@@ -0,0 +1,518 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "hpack.h"
+#include <cstring>
+
+using namespace lcb::htparse;
+
+namespace
+{
+struct StaticEntry {
+    const char *name;
+    const char *value;
+};
+
+/** RFC 7541, Appendix A */
+const StaticEntry static_table[] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+
+const size_t static_count = sizeof(static_table) / sizeof(static_table[0]);
+
+/** Overhead of every entry of the dynamic table (RFC 7541, section 4.1) */
+const size_t entry_overhead = 32;
+
+size_t entry_size(const MimeHeader &field)
+{
+    return field.key.size() + field.value.size() + entry_overhead;
+}
+
+struct HuffmanCode {
+    uint32_t code;
+    uint8_t bits;
+};
+
+/** RFC 7541, Appendix B. Indexed by the symbol, the last one is EOS */
+const HuffmanCode huffman_codes[257] = {
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+    {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+    {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+    {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+    {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+    {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+    {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+    {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6},
+    {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+    {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+    {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7},
+    {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7},
+    {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+    {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+    {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13},
+    {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5},
+    {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+    {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+    {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5},
+    {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15},
+    {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+    {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+    {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23},
+    {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23},
+    {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+    {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+    {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22},
+    {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24},
+    {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+    {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+    {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22},
+    {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19},
+    {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+    {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+    {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27},
+    {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26},
+    {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+    {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+    {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25},
+    {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26},
+    {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+    {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+    {0x3fffffff, 30}, /* EOS */
+};
+
+const unsigned huffman_eos = 256;
+const unsigned huffman_max_bits = 30;
+
+/**
+ * The code is canonical: the codes of the same length are consecutive
+ * numbers, assigned in the order of the symbols, so that the symbol can be
+ * found by its distance from the first code of the length.
+ */
+struct HuffmanDecodeTable {
+    uint32_t first_code[huffman_max_bits + 1]{};
+    uint16_t count[huffman_max_bits + 1]{};
+    uint16_t offset[huffman_max_bits + 1]{};
+    uint16_t symbols[257]{};
+
+    HuffmanDecodeTable()
+    {
+        for (const auto &hc : huffman_codes) {
+            count[hc.bits]++;
+        }
+        uint16_t next[huffman_max_bits + 1]{};
+        for (unsigned bits = 1, total = 0; bits <= huffman_max_bits; bits++) {
+            offset[bits] = next[bits] = total;
+            total += count[bits];
+        }
+        for (unsigned sym = 0; sym < 257; sym++) {
+            const HuffmanCode &hc = huffman_codes[sym];
+            if (next[hc.bits] == offset[hc.bits]) {
+                first_code[hc.bits] = hc.code;
+            }
+            symbols[next[hc.bits]++] = sym;
+        }
+    }
+};
+
+const HuffmanDecodeTable &huffman_table()
+{
+    static const HuffmanDecodeTable table;
+    return table;
+}
+
+bool decode_integer(const unsigned char *&p, const unsigned char *end, unsigned prefix_bits, size_t &value)
+{
+    if (p == end) {
+        return false;
+    }
+    const size_t max_prefix = (1U << prefix_bits) - 1;
+    value = *p++ & max_prefix;
+    if (value < max_prefix) {
+        return true;
+    }
+    for (unsigned shift = 0; p != end && shift <= 28; shift += 7) {
+        unsigned char octet = *p++;
+        value += static_cast<size_t>(octet & 0x7f) << shift;
+        if ((octet & 0x80) == 0) {
+            return true;
+        }
+    }
+    /* truncated, or too large for any sensible header */
+    return false;
+}
+
+bool decode_string(const unsigned char *&p, const unsigned char *end, std::string &out)
+{
+    if (p == end) {
+        return false;
+    }
+    bool huffman = (*p & 0x80) != 0;
+    size_t len;
+    if (!decode_integer(p, end, 7, len) || len > static_cast<size_t>(end - p)) {
+        return false;
+    }
+    out.clear();
+    if (huffman) {
+        if (!hpack_huffman_decode(p, len, out)) {
+            return false;
+        }
+    } else {
+        out.assign(reinterpret_cast<const char *>(p), len);
+    }
+    p += len;
+    return true;
+}
+
+void encode_string(std::string &out, const std::string &str)
+{
+    hpack_encode_integer(out, str.size(), 7, 0x00);
+    out.append(str);
+}
+
+enum IndexPolicy { INDEX_ALWAYS, INDEX_NONE, INDEX_NEVER };
+
+IndexPolicy index_policy(const std::string &name)
+{
+    if (name == "authorization" || name == "proxy-authorization" || name == "cookie") {
+        return INDEX_NEVER;
+    }
+    if (name == ":path" || name == "content-length") {
+        return INDEX_NONE;
+    }
+    return INDEX_ALWAYS;
+}
+} // namespace
+
+namespace lcb
+{
+namespace htparse
+{
+
+void hpack_encode_integer(std::string &out, size_t value, unsigned prefix_bits, unsigned char first_octet)
+{
+    const size_t max_prefix = (1U << prefix_bits) - 1;
+    if (value < max_prefix) {
+        out.push_back(static_cast<char>(first_octet | value));
+        return;
+    }
+    out.push_back(static_cast<char>(first_octet | max_prefix));
+    value -= max_prefix;
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+bool hpack_huffman_decode(const unsigned char *data, size_t ndata, std::string &out)
+{
+    const HuffmanDecodeTable &table = huffman_table();
+    uint32_t code = 0;
+    unsigned bits = 0;
+
+    for (size_t ii = 0; ii < ndata; ii++) {
+        for (int bit = 7; bit >= 0; bit--) {
+            code = (code << 1) | ((data[ii] >> bit) & 1);
+            bits++;
+            if (table.count[bits] && code >= table.first_code[bits] &&
+                code - table.first_code[bits] < table.count[bits]) {
+                unsigned sym = table.symbols[table.offset[bits] + code - table.first_code[bits]];
+                if (sym == huffman_eos) {
+                    return false;
+                }
+                out.push_back(static_cast<char>(sym));
+                code = 0;
+                bits = 0;
+            } else if (bits == huffman_max_bits) {
+                return false;
+            }
+        }
+    }
+    /* the padding is the most significant bits of EOS (all ones), shorter than an octet */
+    return bits < 8 && code == (1U << bits) - 1;
+}
+
+bool HpackTable::get(size_t index, MimeHeader &field) const
+{
+    if (index == 0) {
+        return false;
+    }
+    if (index <= static_count) {
+        field.key = static_table[index - 1].name;
+        field.value = static_table[index - 1].value;
+        return true;
+    }
+    index -= static_count + 1;
+    if (index >= entries.size()) {
+        return false;
+    }
+    field = entries[index];
+    return true;
+}
+
+size_t HpackTable::find(const MimeHeader &field, size_t &name_index) const
+{
+    name_index = 0;
+    for (size_t ii = 0; ii < static_count; ii++) {
+        if (field.key != static_table[ii].name) {
+            continue;
+        }
+        if (name_index == 0) {
+            name_index = ii + 1;
+        }
+        if (field.value == static_table[ii].value) {
+            return ii + 1;
+        }
+    }
+    for (size_t ii = 0; ii < entries.size(); ii++) {
+        if (field.key != entries[ii].key) {
+            continue;
+        }
+        if (name_index == 0) {
+            name_index = static_count + ii + 1;
+        }
+        if (field.value == entries[ii].value) {
+            return static_count + ii + 1;
+        }
+    }
+    return 0;
+}
+
+void HpackTable::evict(size_t limit)
+{
+    while (size > limit) {
+        size -= entry_size(entries.back());
+        entries.pop_back();
+    }
+}
+
+void HpackTable::insert(const MimeHeader &field)
+{
+    size_t needed = entry_size(field);
+    if (needed > max_size) {
+        /* not an error: the table is simply emptied */
+        evict(0);
+        return;
+    }
+    evict(max_size - needed);
+    entries.push_front(field);
+    size += needed;
+}
+
+void HpackTable::resize(size_t new_max_size)
+{
+    max_size = new_max_size;
+    evict(max_size);
+}
+
+bool HpackDecoder::decode(const char *data, size_t ndata, std::vector<MimeHeader> &headers)
+{
+    const auto *p = reinterpret_cast<const unsigned char *>(data);
+    const unsigned char *end = p + ndata;
+    bool have_fields = false;
+
+    while (p != end) {
+        unsigned char first = *p;
+        size_t index;
+
+        if (first & 0x80) {
+            /* indexed header field */
+            MimeHeader field;
+            if (!decode_integer(p, end, 7, index) || !table.get(index, field)) {
+                return false;
+            }
+            headers.push_back(std::move(field));
+            have_fields = true;
+            continue;
+        }
+
+        if ((first & 0xe0) == 0x20) {
+            /* dynamic table size update, allowed only before the first field */
+            if (have_fields || !decode_integer(p, end, 5, index) || index > limit) {
+                return false;
+            }
+            table.resize(index);
+            continue;
+        }
+
+        /* literal header field: with incremental indexing (6-bit prefix),
+         * without indexing or never indexed (4-bit prefix) */
+        bool indexing = (first & 0xc0) == 0x40;
+        MimeHeader field;
+        if (!decode_integer(p, end, indexing ? 6 : 4, index)) {
+            return false;
+        }
+        if (index) {
+            if (!table.get(index, field)) {
+                return false;
+            }
+        } else if (!decode_string(p, end, field.key)) {
+            return false;
+        }
+        if (!decode_string(p, end, field.value)) {
+            return false;
+        }
+        if (indexing) {
+            table.insert(field);
+        }
+        headers.push_back(std::move(field));
+        have_fields = true;
+    }
+    return true;
+}
+
+void HpackEncoder::set_max_table_size(size_t max_size)
+{
+    /* larger table would not make the requests smaller */
+    if (max_size > HPACK_DEFAULT_TABLE_SIZE) {
+        max_size = HPACK_DEFAULT_TABLE_SIZE;
+    }
+    if (max_size == table.get_max_size() && !pending_update) {
+        return;
+    }
+    if (max_size < pending_min) {
+        pending_min = max_size;
+    }
+    table.resize(max_size);
+    pending_update = true;
+}
+
+void HpackEncoder::encode(const std::vector<MimeHeader> &headers, std::string &out)
+{
+    if (pending_update) {
+        if (pending_min < table.get_max_size()) {
+            hpack_encode_integer(out, pending_min, 5, 0x20);
+        }
+        hpack_encode_integer(out, table.get_max_size(), 5, 0x20);
+        pending_update = false;
+        pending_min = SIZE_MAX;
+    }
+
+    for (const auto &field : headers) {
+        IndexPolicy policy = index_policy(field.key);
+        size_t name_index;
+        size_t index = table.find(field, name_index);
+
+        if (index && policy != INDEX_NEVER) {
+            hpack_encode_integer(out, index, 7, 0x80);
+            continue;
+        }
+        switch (policy) {
+            case INDEX_ALWAYS:
+                hpack_encode_integer(out, name_index, 6, 0x40);
+                break;
+            case INDEX_NEVER:
+                hpack_encode_integer(out, name_index, 4, 0x10);
+                break;
+            default:
+                hpack_encode_integer(out, name_index, 4, 0x00);
+                break;
+        }
+        if (name_index == 0) {
+            encode_string(out, field.key);
+        }
+        encode_string(out, field.value);
+        if (policy == INDEX_ALWAYS) {
+            table.insert(field);
+        }
+    }
+}
+
+} // namespace htparse
+} // namespace lcb
@@ -0,0 +1,172 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_HPACK_H
+#define LCB_HPACK_H
+
+#include "lcbht.h"
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+/**
+ * @file
+ * HPACK (RFC 7541) header compression for HTTP/2.
+ *
+ * Both sides of the connection keep a dynamic table of the recently used
+ * header fields, so the table of the decoder must see every header block
+ * received on the connection (even those of the cancelled streams), and the
+ * blocks produced by the encoder must be sent in the order they have been
+ * encoded.
+ */
+
+namespace lcb
+{
+namespace htparse
+{
+
+/** Default size of the dynamic table (SETTINGS_HEADER_TABLE_SIZE) */
+static const size_t HPACK_DEFAULT_TABLE_SIZE = 4096;
+
+class HpackTable
+{
+  public:
+    explicit HpackTable(size_t max_size_) : max_size(max_size_) {}
+
+    /**
+     * Look up the field by its HPACK index (the static table first, then the
+     * dynamic one)
+     * @return false if the index is out of range
+     */
+    bool get(size_t index, MimeHeader &field) const;
+
+    /**
+     * Find the index of the field in both tables
+     * @param[out] name_index index of the entry with the same name, or 0
+     * @return index of the entry with the same name and value, or 0
+     */
+    size_t find(const MimeHeader &field, size_t &name_index) const;
+
+    void insert(const MimeHeader &field);
+    void resize(size_t new_max_size);
+
+    size_t get_max_size() const
+    {
+        return max_size;
+    }
+
+    /** Size of the dynamic table (as defined by RFC 7541, section 4.1) */
+    size_t get_size() const
+    {
+        return size;
+    }
+
+    size_t get_count() const
+    {
+        return entries.size();
+    }
+
+  private:
+    void evict(size_t limit);
+
+    /** Newest entries first */
+    std::deque<MimeHeader> entries{};
+    size_t size{0};
+    size_t max_size;
+};
+
+/**
+ * Decodes header blocks of the responses.
+ */
+class HpackDecoder
+{
+  public:
+    /**
+     * @param max_size_ the size of the dynamic table, which has been announced
+     *        to the peer. The peer may use smaller table, but not larger one.
+     */
+    explicit HpackDecoder(size_t max_size_ = HPACK_DEFAULT_TABLE_SIZE) : table(max_size_), limit(max_size_) {}
+
+    /**
+     * Decode the complete header block (HEADERS and CONTINUATION frames
+     * concatenated). The fields are appended to `headers`.
+     * @return false if the block is malformed. This is a connection error
+     *         (COMPRESSION_ERROR), because the state of the table is lost.
+     */
+    bool decode(const char *data, size_t ndata, std::vector<MimeHeader> &headers);
+
+    const HpackTable &get_table() const
+    {
+        return table;
+    }
+
+  private:
+    HpackTable table;
+    size_t limit;
+};
+
+/**
+ * Encodes header blocks of the requests.
+ *
+ * The fields which are the same for many requests (the method, the scheme,
+ * the authority, the user agent, the content type) are added to the dynamic
+ * table, so that they take a single byte in the subsequent requests. The path
+ * and the content length are sent as literals, and the credentials are sent as
+ * literals which must never be indexed (neither by the peer nor by the
+ * intermediaries). Huffman coding is not used.
+ */
+class HpackEncoder
+{
+  public:
+    HpackEncoder() : table(HPACK_DEFAULT_TABLE_SIZE) {}
+
+    /**
+     * Set the maximum size of the dynamic table, after the peer has changed
+     * SETTINGS_HEADER_TABLE_SIZE. The change is announced at the beginning
+     * of the next header block.
+     */
+    void set_max_table_size(size_t max_size);
+
+    /** Append the header block for the fields to `out` */
+    void encode(const std::vector<MimeHeader> &headers, std::string &out);
+
+    const HpackTable &get_table() const
+    {
+        return table;
+    }
+
+  private:
+    HpackTable table;
+    /** Smallest size since the last block, which the decoder must see before the final one */
+    size_t pending_min{SIZE_MAX};
+    bool pending_update{false};
+};
+
+/** Append the HPACK integer with the given prefix length and the bits of the first octet */
+void hpack_encode_integer(std::string &out, size_t value, unsigned prefix_bits, unsigned char first_octet);
+
+/**
+ * Decode the HPACK string literal with Huffman coding.
+ * @return false if the input is not a valid Huffman code (including invalid
+ *         padding and EOS symbol)
+ */
+bool hpack_huffman_decode(const unsigned char *data, size_t ndata, std::string &out);
+
+} // namespace htparse
+} // namespace lcb
+#endif
@@ -169,7 +169,8 @@ const MimeHeader *Response::get_header(const std::string &key) const
 {
     std::list<MimeHeader>::const_iterator it;
     for (it = headers.begin(); it != headers.end(); ++it) {
-        if (it->key == key) {
+        // field names are case-insensitive, and HTTP/2 sends them in lowercase
+        if (strcasecmp(it->key.c_str(), key.c_str()) == 0) {
             return &*it;
         }
     }
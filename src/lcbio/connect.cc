@@ -19,10 +19,16 @@
 #include "connect.h"
 #include "ioutils.h"
 #include "iotable.h"
+#include "resolver.h"
 #include "settings.h"
 #include "timer-cxx.h"
 #include "rnd.h"
 
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
 using namespace lcb::io;
 
 /* win32 lacks EAI_SYSTEM */
@@ -52,19 +58,55 @@ static const lcb_host_t *get_loghost(lcbio_SOCKET *s)
 #define LOGARGS_T(lvl) LOGARGS(this->sock, lvl)
 #define CSLOGID_T() CSLOGID(this->sock)
 
+/**
+ * Delay between starting connection attempts to the next address while the
+ * previous ones are still pending (RFC 8305 "Connection Attempt Delay").
+ */
+#define LCBIO_CONNECT_ATTEMPT_DELAY LCB_MS2US(250)
+
+/** How long the address family which won the race is preferred for the host */
+#define LCBIO_FAMILY_CACHE_TTL LCB_S2NS(600)
+#define LCBIO_FAMILY_CACHE_MAX 256
+
 namespace lcb
 {
 namespace io
 {
+/**
+ * Resolved address which may be used to connect to the endpoint. The
+ * candidates own the storage for the socket addresses and are linked together
+ * through `ai.ai_next`, so that they can also be traversed as addrinfo list.
+ */
+struct Candidate {
+    addrinfo ai;
+    sockaddr_storage addr;
+};
+
 struct Connstart : ConnectionRequest {
     Connstart(lcbio_TABLE *, lcb_settings *, const lcb_host_t *, uint32_t, lcbio_CONNDONE_cb, void *);
 
     ~Connstart() override;
-    void unwatch();
     void handler();
     void cancel() override;
+    void resolve(const lcb_host_t *dest);
+    void start(const addrinfo *list);
     void C_connect();
 
+    /** Single socket racing to connect to one of the candidates (Event only) */
+    struct Attempt {
+        Connstart *parent;
+        lcb_socket_t fd;
+        void *event;
+        bool ev_active;
+        const Candidate *cand;
+    };
+    void E_start_next();
+    bool E_try_connect(Attempt &att, short events);
+    void E_attempt_ready(Attempt &att, short events);
+    void E_attempt_won(Attempt &att);
+    void E_close_attempt(Attempt &att);
+    size_t E_pending_attempts() const;
+
     enum State { CS_PENDING, CS_CANCELLED, CS_CONNECTED, CS_ERROR, CS_ERROR_CANCELLED };
 
     void state_signal(State next_state, lcb_STATUS err);
@@ -78,27 +120,149 @@ struct Connstart : ConnectionRequest {
 
     lcbio_SOCKET *sock;
     lcbio_OSERR syserr;
-    void *event;
-    bool ev_active;   /* whether the event pointer is active (Event only) */
     bool in_uhandler; /* Whether we're inside the user-defined handler */
-    addrinfo *ai_root;
-    addrinfo *ai;
+    Resolver::Lookup *lookup; /* pending host name lookup */
+    std::vector<Candidate> candidates;
+    addrinfo *ai; /* current candidate (Completion), or the winner (Event) */
+    size_t next_candidate;
+    std::vector<Attempt> attempts;
     State state;
     lcb_STATUS last_error;
     Timer<Connstart, &Connstart::handler> timer;
+    Timer<Connstart, &Connstart::E_start_next> stagger;
 };
 } // namespace io
 } // namespace lcb
 
-void Connstart::unwatch()
+namespace
+{
+/**
+ * Address family which most recently won the connection race for the given
+ * host. It is shared by all instances, so that new connections to the same
+ * node do not have to wait for the broken family again.
+ */
+struct FamilyCache {
+    struct Entry {
+        int family;
+        hrtime_t expires;
+    };
+    std::mutex mutex;
+    std::map<std::string, Entry> entries;
+
+    int lookup(const std::string &host)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(host);
+        if (it == entries.end()) {
+            return AF_UNSPEC;
+        }
+        if (it->second.expires < gethrtime()) {
+            entries.erase(it);
+            return AF_UNSPEC;
+        }
+        return it->second.family;
+    }
+
+    void store(const std::string &host, int family)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        hrtime_t now = gethrtime();
+        if (entries.size() >= LCBIO_FAMILY_CACHE_MAX && entries.find(host) == entries.end()) {
+            for (auto it = entries.begin(); it != entries.end();) {
+                if (it->second.expires < now) {
+                    it = entries.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            if (entries.size() >= LCBIO_FAMILY_CACHE_MAX) {
+                entries.clear();
+            }
+        }
+        Entry &entry = entries[host];
+        entry.family = family;
+        entry.expires = now + LCBIO_FAMILY_CACHE_TTL;
+    }
+};
+
+FamilyCache &family_cache()
+{
+    static FamilyCache cache;
+    return cache;
+}
+} // namespace
+
+static bool family_allowed(const lcb_settings *settings, int family)
+{
+    if (family != AF_INET && family != AF_INET6) {
+        return false;
+    }
+    if (settings->ipv6 == LCB_IPV6_DISABLED) {
+        return family == AF_INET;
+    }
+    if (settings->ipv6 == LCB_IPV6_ONLY) {
+        return family == AF_INET6;
+    }
+    return true;
+}
+
+/**
+ * Copy the resolved addresses and order them as described in RFC 8305: the
+ * families are interleaved, starting with the family which won the last race
+ * for this host, or with the family of the first resolved address.
+ */
+static void build_candidates(const lcb_settings *settings, const char *host, const addrinfo *list,
+                             std::vector<Candidate> &out)
 {
-    if (sock && ev_active) {
-        lcb_assert(sock->u.fd != INVALID_SOCKET);
-        sock->io->E_event_cancel(sock->u.fd, event);
-        ev_active = false;
+    std::vector<const addrinfo *> primary, secondary;
+    int first_family = AF_UNSPEC;
+    int cached = family_cache().lookup(host);
+
+    for (const addrinfo *cur = list; cur != nullptr; cur = cur->ai_next) {
+        if (!family_allowed(settings, cur->ai_family) || cur->ai_addrlen > sizeof(sockaddr_storage)) {
+            continue;
+        }
+        if (first_family == AF_UNSPEC || cur->ai_family == cached) {
+            first_family = cur->ai_family;
+        }
+    }
+    for (const addrinfo *cur = list; cur != nullptr; cur = cur->ai_next) {
+        if (!family_allowed(settings, cur->ai_family) || cur->ai_addrlen > sizeof(sockaddr_storage)) {
+            continue;
+        }
+        (cur->ai_family == first_family ? primary : secondary).push_back(cur);
+    }
+
+    out.clear();
+    out.reserve(primary.size() + secondary.size());
+    for (size_t ii = 0; ii < primary.size() || ii < secondary.size(); ++ii) {
+        const addrinfo *pair[] = {ii < primary.size() ? primary[ii] : nullptr,
+                                  ii < secondary.size() ? secondary[ii] : nullptr};
+        for (const addrinfo *src : pair) {
+            if (src == nullptr) {
+                continue;
+            }
+            out.emplace_back();
+            Candidate &cand = out.back();
+            memset(&cand, 0, sizeof(cand));
+            cand.ai.ai_family = src->ai_family;
+            cand.ai.ai_socktype = src->ai_socktype;
+            cand.ai.ai_protocol = src->ai_protocol;
+            cand.ai.ai_addrlen = src->ai_addrlen;
+            memcpy(&cand.addr, src->ai_addr, src->ai_addrlen);
+        }
+    }
+    for (size_t ii = 0; ii < out.size(); ++ii) {
+        out[ii].ai.ai_addr = reinterpret_cast<sockaddr *>(&out[ii].addr);
+        out[ii].ai.ai_next = ii + 1 < out.size() ? &out[ii + 1].ai : nullptr;
     }
 }
 
+static const char *family_name(int family)
+{
+    return family == AF_INET6 ? "IPv6" : "IPv4";
+}
+
 static void try_enable_sockopt(lcbio_SOCKET *sock, int cntl)
 {
     lcb_STATUS rv = lcbio_enable_sockopt(sock, cntl);
@@ -118,9 +282,13 @@ void Connstart::handler()
 {
     lcb_STATUS err;
 
-    if (sock && event) {
-        unwatch();
-        sock->io->E_event_destroy(event);
+    if (lookup) {
+        Resolver::get(sock->settings)->cancel(lookup);
+        lookup = nullptr;
+    }
+    stagger.cancel();
+    for (auto &att : attempts) {
+        E_close_attempt(att);
     }
 
     if (state == CS_PENDING) {
@@ -157,6 +325,9 @@ void Connstart::handler()
         lcbio__load_socknames(sock);
         if (err == LCB_SUCCESS) {
             lcb_log(LOGARGS_T(INFO), CSLOGFMT "Connected established", CSLOGID_T());
+            if (ai != nullptr && candidates.size() > 1) {
+                family_cache().store(sock->info->ep_remote.host, ai->ai_family);
+            }
 
             if (sock->settings->tcp_nodelay) {
                 try_enable_sockopt(sock, LCB_IO_CNTL_TCP_NODELAY);
@@ -167,6 +338,10 @@ void Connstart::handler()
         } else {
             lcb_log(LOGARGS_T(ERR), CSLOGFMT "Failed to establish connection: %s, os errno=%u", CSLOGID_T(),
                     lcb_strerror_short(err), syserr);
+            if (!candidates.empty() && sock->settings->resolver) {
+                /* the addresses may have changed, do not reuse them for the next attempt */
+                sock->settings->resolver->invalidate(sock->info->ep_remote.host);
+            }
         }
     }
 
@@ -182,12 +357,10 @@ GT_DTOR:
 Connstart::~Connstart()
 {
     timer.release();
+    stagger.release();
     if (sock) {
         lcbio_unref(sock)
     }
-    if (ai_root) {
-        freeaddrinfo(ai_root);
-    }
 }
 
 void Connstart::state_signal(State next_state, lcb_STATUS err)
@@ -250,32 +423,17 @@ bool Connstart::ensure_sock()
         return false;
     }
 
-    if (io->is_E()) {
-        if (sock->u.fd != INVALID_SOCKET) {
-            /* already have one? */
-            return true;
-        }
+    if (sock->u.sd) {
+        return true;
+    }
 
-        while (sock->u.fd == INVALID_SOCKET && ai != nullptr) {
-            sock->u.fd = lcbio_E_ai2sock(io, &ai, &errtmp);
-            if (sock->u.fd != INVALID_SOCKET) {
-                lcb_log(LOGARGS_T(DEBUG), CSLOGFMT "Created new socket with FD=%d", CSLOGID_T(), sock->u.fd);
-                return true;
-            }
-        }
-    } else {
+    while (sock->u.sd == nullptr && ai != nullptr) {
+        sock->u.sd = lcbio_C_ai2sock(io, &ai, &errtmp);
         if (sock->u.sd) {
+            sock->u.sd->lcbconn = const_cast<lcbio_SOCKET *>(sock);
+            sock->u.sd->parent = IOT_ARG(io);
             return true;
         }
-
-        while (sock->u.sd == nullptr && ai != nullptr) {
-            sock->u.sd = lcbio_C_ai2sock(io, &ai, &errtmp);
-            if (sock->u.sd) {
-                sock->u.sd->lcbconn = const_cast<lcbio_SOCKET *>(sock);
-                sock->u.sd->parent = IOT_ARG(io);
-                return true;
-            }
-        }
     }
 
     if (ai == nullptr) {
@@ -296,57 +454,102 @@ void Connstart::clear_sock()
         return;
     }
 
-    if (iot->is_E()) {
-        unwatch();
-        iot->E_close(sock->u.fd);
-        sock->u.fd = INVALID_SOCKET;
-    } else {
-        if (sock->u.sd) {
-            iot->C_close(sock->u.sd);
-            sock->u.sd = nullptr;
-        }
+    if (sock->u.sd) {
+        iot->C_close(sock->u.sd);
+        sock->u.sd = nullptr;
     }
 }
 
 static void E_conncb(lcb_socket_t, short events, void *arg)
 {
-    auto *cs = reinterpret_cast<Connstart *>(arg);
-    lcbio_SOCKET *s = cs->sock;
-    lcbio_TABLE *io = s->io;
-    int retry_once = 0;
-    lcbio_CSERR connstatus;
-    addrinfo *ai = nullptr;
+    auto *att = reinterpret_cast<Connstart::Attempt *>(arg);
+    att->parent->E_attempt_ready(*att, events);
+}
 
-GT_NEXTSOCK:
-    if (!cs->ensure_sock()) {
-        cs->notify_error(LCB_ERR_CONNECT_ERROR);
-        return;
+void Connstart::E_close_attempt(Attempt &att)
+{
+    lcbio_TABLE *io = sock->io;
+    if (att.ev_active) {
+        io->E_event_cancel(att.fd, att.event);
+        att.ev_active = false;
+    }
+    if (att.event) {
+        io->E_event_destroy(att.event);
+        att.event = nullptr;
+    }
+    if (att.fd != INVALID_SOCKET) {
+        io->E_close(att.fd);
+        att.fd = INVALID_SOCKET;
     }
+}
+
+size_t Connstart::E_pending_attempts() const
+{
+    size_t ret = 0;
+    for (const auto &att : attempts) {
+        if (att.fd != INVALID_SOCKET) {
+            ret++;
+        }
+    }
+    return ret;
+}
+
+/**
+ * The first attempt to complete the connection takes over the socket. All
+ * other attempts are closed, and the stagger timer is stopped.
+ */
+void Connstart::E_attempt_won(Attempt &att)
+{
+    lcb_socket_t fd = att.fd;
+    if (att.ev_active) {
+        sock->io->E_event_cancel(att.fd, att.event);
+        att.ev_active = false;
+    }
+    att.fd = INVALID_SOCKET;
+    E_close_attempt(att);
+    stagger.cancel();
+    for (auto &other : attempts) {
+        E_close_attempt(other);
+    }
+    sock->u.fd = fd;
+    ai = const_cast<addrinfo *>(&att.cand->ai);
+    lcb_log(LOGARGS_T(DEBUG), CSLOGFMT "%s attempt won the race (FD=%d)", CSLOGID_T(), family_name(ai->ai_family),
+            (int)fd);
+    notify_success();
+}
+
+/**
+ * Drive the connection of the single attempt.
+ * @return true if the attempt is still in progress (or connected), false if
+ *         it failed and was closed.
+ */
+bool Connstart::E_try_connect(Attempt &att, short events)
+{
+    lcbio_TABLE *io = sock->io;
+    bool retry_once = false;
+    lcbio_CSERR connstatus;
+    int rv;
 
     if (events & LCB_ERROR_EVENT) {
         socklen_t errlen = sizeof(int);
         int sockerr = 0;
-        getsockopt(s->u.fd, SOL_SOCKET, SO_ERROR, (char *)&sockerr, &errlen);
-        lcbio_mksyserr(sockerr, &cs->syserr);
-        lcb_log(LOGARGS(s, TRACE), CSLOGFMT "Received ERROR_EVENT, sockerr=%d, syserr=%d", CSLOGID(s), sockerr,
-                (int)cs->syserr);
-        cs->clear_sock();
-        goto GT_NEXTSOCK;
-
-    } else {
-        ai = cs->ai;
+        getsockopt(att.fd, SOL_SOCKET, SO_ERROR, (char *)&sockerr, &errlen);
+        lcbio_mksyserr(sockerr, &syserr);
+        lcb_log(LOGARGS_T(TRACE), CSLOGFMT "Received ERROR_EVENT on FD=%d, sockerr=%d, syserr=%d", CSLOGID_T(),
+                (int)att.fd, sockerr, (int)syserr);
+        E_close_attempt(att);
+        return false;
+    }
 
-    GT_CONNECT:
-        int rv = io->E_connect(s->u.fd, ai->ai_addr, ai->ai_addrlen);
-        if (rv == 0) {
-            cs->unwatch();
-            cs->notify_success();
-            return;
-        }
+GT_CONNECT:
+    rv = io->E_connect(att.fd, att.cand->ai.ai_addr, att.cand->ai.ai_addrlen);
+    if (rv == 0) {
+        E_attempt_won(att);
+        return true;
     }
 
     connstatus = lcbio_mkcserr(io->get_errno());
-    lcbio_mksyserr(io->get_errno(), &cs->syserr);
+    lcbio_mksyserr(io->get_errno(), &syserr);
 
     switch (connstatus) {
 
@@ -354,31 +557,96 @@ GT_NEXTSOCK:
             goto GT_CONNECT;
 
         case LCBIO_CSERR_CONNECTED:
-            cs->unwatch();
-            cs->notify_success();
-            return;
+            E_attempt_won(att);
+            return true;
 
         case LCBIO_CSERR_BUSY:
-            lcb_log(LOGARGS(s, TRACE), CSLOGFMT "Scheduling I/O watcher for asynchronous connection completion.",
-                    CSLOGID(s));
-            io->E_event_watch(s->u.fd, cs->event, LCB_WRITE_EVENT, cs, E_conncb);
-            cs->ev_active = true;
-            return;
+            lcb_log(LOGARGS_T(TRACE), CSLOGFMT "Scheduling I/O watcher for asynchronous connection completion (FD=%d).",
+                    CSLOGID_T(), (int)att.fd);
+            io->E_event_watch(att.fd, att.event, LCB_WRITE_EVENT, &att, E_conncb);
+            att.ev_active = true;
+            return true;
 
         case LCBIO_CSERR_EINVAL:
             if (!retry_once) {
-                retry_once = 1;
+                retry_once = true;
                 goto GT_CONNECT;
             }
             /* fallthrough */
 
         case LCBIO_CSERR_EFAIL:
         default:
-            /* close the current socket and try again */
-            lcb_log(LOGARGS(s, TRACE), CSLOGFMT "connect() failed. errno=%d [%s]", CSLOGID(s), IOT_ERRNO(io),
-                    strerror(IOT_ERRNO(io)));
-            cs->clear_sock();
-            goto GT_NEXTSOCK;
+            lcb_log(LOGARGS_T(TRACE), CSLOGFMT "connect() failed on FD=%d. errno=%d [%s]", CSLOGID_T(), (int)att.fd,
+                    IOT_ERRNO(io), strerror(IOT_ERRNO(io)));
+            E_close_attempt(att);
+            return false;
+    }
+}
+
+void Connstart::E_attempt_ready(Attempt &att, short events)
+{
+    if (att.ev_active) {
+        sock->io->E_event_cancel(att.fd, att.event);
+        att.ev_active = false;
+    }
+    if (E_try_connect(att, events)) {
+        return;
+    }
+    /* do not wait for the stagger delay, if the attempt failed already */
+    stagger.cancel();
+    E_start_next();
+}
+
+/**
+ * Start the attempt to connect to the next candidate. If the connection does
+ * not complete immediately, the next candidate is started after the attempt
+ * delay, while this attempt is still in flight.
+ */
+void Connstart::E_start_next()
+{
+    lcbio_TABLE *io = sock->io;
+
+    while (state == CS_PENDING && next_candidate < candidates.size()) {
+        const Candidate *cand = &candidates[next_candidate++];
+        lcb_socket_t fd = io->E_socket(&cand->ai);
+        if (fd == INVALID_SOCKET) {
+            lcbio_mksyserr(io->get_errno(), &syserr);
+            continue;
+        }
+        lcb_log(LOGARGS_T(DEBUG), CSLOGFMT "Created new %s socket with FD=%d", CSLOGID_T(),
+                family_name(cand->ai.ai_family), (int)fd);
+
+        attempts.push_back(Attempt{this, fd, io->E_event_create(), false, cand});
+        if (E_try_connect(attempts.back(), LCB_WRITE_EVENT)) {
+            if (state == CS_PENDING && next_candidate < candidates.size()) {
+                stagger.rearm(LCBIO_CONNECT_ATTEMPT_DELAY);
+            }
+            return;
+        }
+    }
+
+    if (state == CS_PENDING && E_pending_attempts() == 0) {
+        notify_error(LCB_ERR_CONNECT_ERROR);
+    }
+}
+
+void Connstart::start(const addrinfo *list)
+{
+    build_candidates(sock->settings, sock->info->ep_remote.host, list, candidates);
+    if (candidates.empty()) {
+        lcb_log(LOGARGS_T(ERR), CSLOGFMT "No usable addresses for %s", CSLOGID_T(), sock->info->ep_remote.host);
+        notify_error(LCB_ERR_UNKNOWN_HOST);
+        return;
+    }
+
+    /** Figure out how to connect */
+    if (sock->io->is_E()) {
+        /* the attempts are referenced by the I/O events, and must not move */
+        attempts.reserve(candidates.size());
+        E_start_next();
+    } else {
+        ai = &candidates.front().ai;
+        C_connect();
     }
 }
 
@@ -459,21 +727,58 @@ GT_CONNECT:
     }
 }
 
+static void resolve_cb(void *arg, int status, const addrinfo *addrs)
+{
+    auto *cs = reinterpret_cast<Connstart *>(arg);
+    lcbio_SOCKET *s = cs->sock;
+
+    cs->lookup = nullptr;
+    if (status != 0) {
+        const char *errstr = status != EAI_SYSTEM ? gai_strerror(status) : "";
+        lcb_log(LOGARGS(s, ERR), CSLOGFMT "Couldn't look up %s (%s) [EAI=%d]", CSLOGID(s), s->info->ep_remote.host,
+                errstr, status);
+        cs->notify_error(LCB_ERR_UNKNOWN_HOST);
+    } else {
+        cs->start(addrs);
+    }
+}
+
+void Connstart::resolve(const lcb_host_t *dest)
+{
+    int family;
+
+    /** Hostname lookup: */
+    if (sock->settings->ipv6 == LCB_IPV6_DISABLED) {
+        family = AF_INET;
+    } else if (sock->settings->ipv6 == LCB_IPV6_ONLY) {
+        family = AF_INET6;
+    } else {
+        family = AF_UNSPEC;
+    }
+    lookup = Resolver::get(sock->settings)->resolve(sock->io, dest, family, resolve_cb, this);
+}
+
 ConnectionRequest *lcbio_connect(lcbio_TABLE *iot, lcb_settings *settings, const lcb_host_t *dest, uint32_t timeout,
                                  lcbio_CONNDONE_cb handler, void *arg)
 {
-    return new Connstart(iot, settings, dest, timeout, handler, arg);
+    auto *cs = new Connstart(iot, settings, dest, timeout, handler, arg);
+    cs->resolve(dest);
+    return cs;
+}
+
+ConnectionRequest *lcbio_connect_addrs(lcbio_TABLE *iot, lcb_settings *settings, const lcb_host_t *dest,
+                                       const addrinfo *addrs, uint32_t timeout, lcbio_CONNDONE_cb handler, void *arg)
+{
+    auto *cs = new Connstart(iot, settings, dest, timeout, handler, arg);
+    cs->start(addrs);
+    return cs;
 }
 
 Connstart::Connstart(lcbio_TABLE *iot_, lcb_settings *settings_, const lcb_host_t *dest, uint32_t timeout,
                      lcbio_CONNDONE_cb handler_, void *arg)
-    : user_handler(handler_), user_arg(arg), sock(nullptr), syserr(0), event(nullptr), ev_active(false),
-      in_uhandler(false), ai_root(nullptr), ai(nullptr), state(CS_PENDING), last_error(LCB_SUCCESS), timer(iot_, this)
+    : user_handler(handler_), user_arg(arg), sock(nullptr), syserr(0), in_uhandler(false), lookup(nullptr), ai(nullptr),
+      next_candidate(0), state(CS_PENDING), last_error(LCB_SUCCESS), timer(iot_, this), stagger(iot_, this)
 {
-
-    addrinfo hints{};
-    int rv;
-
     sock = reinterpret_cast<lcbio_SOCKET *>(calloc(1, sizeof(*sock)));
 
     /** Initialize the socket first */
@@ -490,38 +795,10 @@ Connstart::Connstart(lcbio_TABLE *iot_, lcb_settings *settings_, const lcb_host_
 
     if (iot_->is_E()) {
         sock->u.fd = INVALID_SOCKET;
-        event = iot_->E_event_create();
     }
 
     timer.rearm(timeout);
     lcb_log(LOGARGS_T(INFO), CSLOGFMT "Starting. Timeout=%uus", CSLOGID_T(), timeout);
-
-    /** Hostname lookup: */
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_flags = AI_PASSIVE;
-    hints.ai_socktype = SOCK_STREAM;
-    if (settings_->ipv6 == LCB_IPV6_DISABLED) {
-        hints.ai_family = AF_INET;
-    } else if (settings_->ipv6 == LCB_IPV6_ONLY) {
-        hints.ai_family = AF_INET6;
-    } else {
-        hints.ai_family = AF_UNSPEC;
-    }
-
-    if ((rv = getaddrinfo(dest->host, dest->port, &hints, &ai_root))) {
-        const char *errstr = rv != EAI_SYSTEM ? gai_strerror(rv) : "";
-        lcb_log(LOGARGS_T(ERR), CSLOGFMT "Couldn't look up %s (%s) [EAI=%d]", CSLOGID_T(), dest->host, errstr, rv);
-        notify_error(LCB_ERR_UNKNOWN_HOST);
-    } else {
-        ai = ai_root;
-
-        /** Figure out how to connect */
-        if (iot_->is_E()) {
-            E_conncb(-1, LCB_WRITE_EVENT, this);
-        } else {
-            C_connect();
-        }
-    }
 }
 
 ConnectionRequest *lcbio_connect_hl(lcbio_TABLE *iot, lcb_settings *settings, lcb::Hostlist *hl, int rollover,
@@ -177,6 +177,25 @@ typedef void (*lcbio_CONNDONE_cb)(lcbio_SOCKET *s, void *arg, lcb_STATUS err, lc
 lcbio_pCONNSTART lcbio_connect(lcbio_pTABLE iot, lcb_settings *settings, const lcb_host_t *dest, uint32_t timeout,
                                lcbio_CONNDONE_cb handler, void *arg);
 
+/**
+ * Like lcbio_connect(), but uses the given list of addresses instead of
+ * resolving `dest`. The list is copied, and may be freed once this function
+ * returns.
+ *
+ * For event-based I/O plugins, the addresses are raced as described in
+ * RFC 8305 ("Happy Eyeballs"): the address families are interleaved, and the
+ * next address is tried if the previous attempt has not completed within
+ * 250ms, while the slower attempts are kept in flight. The first socket to
+ * connect wins, and the family which won is preferred for the same host in
+ * subsequent connections. Completion-based plugins try the addresses one by
+ * one in the same order.
+ *
+ * @param addrs list of resolved addresses, linked through `ai_next`
+ */
+lcbio_pCONNSTART lcbio_connect_addrs(lcbio_pTABLE iot, lcb_settings *settings, const lcb_host_t *dest,
+                                     const struct addrinfo *addrs, uint32_t timeout, lcbio_CONNDONE_cb handler,
+                                     void *arg);
+
 /**
  * Wraps `lcb_connect()` by traversing a list of hosts. This will cycle through
  * each host in the list until a connection has been successful. Currently
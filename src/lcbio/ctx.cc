@@ -35,6 +35,13 @@
 
 #include "rw-inl.h"
 
+/* The largest IOV array passed to a single sendv() by lcbio_ctx_put_ex() */
+#if defined(IOV_MAX)
+#define PUTEX_MAXIOV IOV_MAX
+#else
+#define PUTEX_MAXIOV 1024
+#endif
+
 typedef enum { ES_ACTIVE = 0, ES_DETACHED } easy_state;
 
 static void err_handler(void *cookie)
@@ -496,7 +503,7 @@ static int E_put_ex(lcbio_CTX *ctx, lcb_IOV *iov, unsigned niov, unsigned nb)
     lcb_socket_t fd = CTX_FD(ctx);
 
 GT_WRITE_AGAIN:
-    nw = IOT_V0IO(iot).sendv(IOT_ARG(iot), fd, iov, niov <= RWINL_IOVSIZE ? niov : RWINL_IOVSIZE);
+    nw = IOT_V0IO(iot).sendv(IOT_ARG(iot), fd, iov, niov <= PUTEX_MAXIOV ? niov : PUTEX_MAXIOV);
     if (nw > 0) {
         CTX_INCR_METRIC(ctx, bytes_sent, nw);
         ctx->procs.cb_flush_done(ctx, nb, nw);
@@ -300,7 +300,9 @@ void lcbio_ctx_wwant(lcbio_CTX *ctx);
  *
  * @param ctx
  * @param iov the IOV array. The IOV array may point to a stack-based array
- * @param niov number of elements in the array
+ * @param niov number of elements in the array. With event-based models at most
+ * `IOV_MAX` elements are written at once, and the remaining ones are reported
+ * as not flushed.
  * @param nb The total number of bytes described by all the elements of the
  * array.
  *
@@ -319,6 +319,10 @@ lcbio_pSSLCTX lcbio_ssl_new__fallback(const char *, const char *, const char *,
 
 #ifdef LCB_NO_SSL
 void lcbio_ssl_free(lcbio_pSSLCTX) {}
+void lcbio_ssl_session_stats(lcbio_pSSLCTX, lcb_TLS_SESSION_STATS *stats)
+{
+    *stats = lcb_TLS_SESSION_STATS{};
+}
 lcb_STATUS lcbio_ssl_apply(lcbio_SOCKET *, lcbio_pSSLCTX)
 {
     return LCB_ERR_SDK_FEATURE_UNAVAILABLE;
@@ -331,6 +335,10 @@ lcb_STATUS lcbio_ssl_get_error(lcbio_SOCKET *)
 {
     return LCB_SUCCESS;
 }
+lcb_STATUS lcbio_ssl_set_alpn(lcbio_SOCKET *, const unsigned char *, unsigned)
+{
+    return LCB_ERR_SDK_FEATURE_UNAVAILABLE;
+}
 void lcbio_ssl_global_init(void) {}
 lcb_STATUS lcbio_sslify_if_needed(lcbio_SOCKET *, lcb_settings *)
 {
@@ -17,6 +17,8 @@
 
 #include "manager.h"
 
+#include <algorithm>
+#include <set>
 #include <utility>
 #include "hostlist.h"
 #include "iotable.h"
@@ -25,6 +27,12 @@
 
 #define LOGARGS(mgr, lvl) mgr->settings, "lcbio_mgr", LCB_LOG_##lvl, __FILE__, __LINE__
 
+/** Delay before the first attempt to replace the warm connection which failed to connect */
+#define LCBIO_MGR_REPLENISH_BACKOFF_MIN LCB_MS2US(100)
+
+/** Upper bound of the delay between the attempts to replace the warm connections */
+#define LCBIO_MGR_REPLENISH_BACKOFF_MAX LCB_S2US(10)
+
 using namespace lcb::io;
 
 namespace lcb
@@ -36,6 +44,7 @@ struct PoolHost {
     inline PoolHost(Pool *, std::string);
     inline void connection_available();
     inline void start_new_connection(uint32_t timeout);
+    inline void replenish();
 
     void ref()
     {
@@ -59,6 +68,43 @@ struct PoolHost {
 
     inline void dump(FILE *out) const;
 
+    /** Whether a new connection may be opened without exceeding Options::maxtotal */
+    bool has_capacity() const
+    {
+        return parent->options.maxtotal == 0 || n_total < parent->options.maxtotal;
+    }
+
+    /** Serve the queued requests asynchronously (if there are any) */
+    void schedule_available()
+    {
+        if (!closed && LCB_CLIST_SIZE(&requests)) {
+            async.signal();
+        }
+    }
+
+    /**
+     * Restore the number of connections requested by Pool::preconnect() after
+     * some of them have been closed or failed to connect
+     */
+    void schedule_replenish()
+    {
+        if (closed || n_total >= n_warm || replenish_timer.is_armed()) {
+            return;
+        }
+        if (warm_backoff) {
+            replenish_timer.rearm(warm_backoff);
+        } else {
+            replenish_timer.signal();
+        }
+    }
+
+    /** Double the delay before the next attempt to open the warm connection */
+    void backoff_replenish()
+    {
+        warm_backoff = std::min(std::max(warm_backoff * 2, (uint32_t)LCBIO_MGR_REPLENISH_BACKOFF_MIN),
+                                (uint32_t)LCBIO_MGR_REPLENISH_BACKOFF_MAX);
+    }
+
     size_t num_pending() const
     {
         return LCB_CLIST_SIZE(&ll_pending);
@@ -82,7 +128,12 @@ struct PoolHost {
     const std::string key;    /* host:port */
     Pool *parent;
     lcb::io::Timer<PoolHost, &PoolHost::connection_available> async;
+    lcb::io::Timer<PoolHost, &PoolHost::replenish> replenish_timer;
     unsigned n_total; /* number of total connections */
+    unsigned n_warm;  /* number of connections maintained by Pool::preconnect() */
+    uint32_t warm_timeout;
+    uint32_t warm_backoff; /* delay before reopening the warm connection, grows while connects fail */
+    bool closed;      /* set when the pool has been shut down */
     unsigned refcount;
 };
 } // namespace io
@@ -139,7 +190,7 @@ namespace io
 struct PoolRequest : ReqNode, ConnectionRequest {
     PoolRequest(PoolHost *host_, lcbio_CONNDONE_cb cb, void *cbarg)
         : host(host_), callback(cb), arg(cbarg), timer(host->parent->io, this), state(PENDING), sock(nullptr),
-          err(LCB_SUCCESS)
+          err(LCB_SUCCESS), timeout(0)
     {
     }
 
@@ -161,8 +212,9 @@ struct PoolRequest : ReqNode, ConnectionRequest {
         timer.signal();
     }
 
-    inline void set_pending(uint32_t timeout)
+    inline void set_pending(uint32_t timeout_)
     {
+        timeout = timeout_;
         timer.rearm(timeout);
     }
 
@@ -180,6 +232,7 @@ struct PoolRequest : ReqNode, ConnectionRequest {
     State state;
     lcbio_SOCKET *sock;
     lcb_STATUS err;
+    uint32_t timeout;
 };
 } // namespace io
 } // namespace lcb
@@ -202,6 +255,11 @@ PoolConnInfo::~PoolConnInfo()
 {
     idle_timer.release();
     parent->n_total--;
+    if (parent->parent->options.maxtotal) {
+        // the slot might be awaited by the queued requests
+        parent->schedule_available();
+    }
+    parent->schedule_replenish();
     if (state == IDLE) {
         lcb_clist_delete(&parent->ll_idle, this);
 
@@ -248,6 +306,7 @@ void Pool::shutdown()
 
     for (h_it = ht.begin(); h_it != ht.end(); ++h_it) {
         PoolHost *he = h_it->second;
+        he->closed = true;
 
         lcb_list_t *cur, *next;
         LCB_LIST_SAFE_FOR(cur, next, (lcb_list_t *)&he->ll_idle)
@@ -265,6 +324,7 @@ void Pool::shutdown()
     for (auto he : hes) {
         ht.erase(he->key);
         he->async.release();
+        he->replenish_timer.release();
         he->unref();
     }
 
@@ -351,6 +411,14 @@ void PoolHost::connection_available()
         req->sock = info->sock;
         req->invoke();
     }
+
+    /* Connections might have been closed while requests were waiting for a free slot */
+    if (num_pending() < num_requests() && has_capacity()) {
+        uint32_t timeout = PoolRequest::from_llnode(requests.next)->timeout;
+        while (num_pending() < num_requests() && has_capacity()) {
+            start_new_connection(timeout);
+        }
+    }
 }
 
 /**
@@ -380,6 +448,7 @@ void PoolConnInfo::on_connected(lcbio_SOCKET *sock_, lcb_STATUS err)
             req->sock = nullptr;
             req->invoke(err);
         }
+        parent->backoff_replenish();
         delete this;
 
     } else {
@@ -388,8 +457,9 @@ void PoolConnInfo::on_connected(lcbio_SOCKET *sock_, lcb_STATUS err)
         lcbio_ref(sock);
         lcbio_protoctx_add(sock, this);
 
+        parent->warm_backoff = 0;
         lcb_clist_append(&parent->ll_idle, this);
-        idle_timer.rearm(parent->parent->options.maxidle);
+        idle_timer.rearm(parent->parent->options.tmoidle);
         parent->connection_available();
     }
 }
@@ -439,7 +509,8 @@ void PoolRequest::timer_handler()
 }
 
 PoolHost::PoolHost(Pool *parent_, std::string key_)
-    : key(std::move(key_)), parent(parent_), async(parent->io, this), n_total(0), refcount(1)
+    : key(std::move(key_)), parent(parent_), async(parent->io, this), replenish_timer(parent->io, this), n_total(0),
+      n_warm(0), warm_timeout(0), warm_backoff(0), closed(false), refcount(1)
 {
 
     lcb_clist_init(&ll_idle);
@@ -448,17 +519,21 @@ PoolHost::PoolHost(Pool *parent_, std::string key_)
     parent->ref();
 }
 
-ConnectionRequest *Pool::get(const lcb_host_t &dest, uint32_t timeout, lcbio_CONNDONE_cb cb, void *cbarg)
+static std::string host_key(const lcb_host_t &dest)
 {
-    PoolHost *he;
-    lcb_list_t *cur;
-
     std::string key;
     if (dest.ipv6) {
         key.append("[").append(dest.host).append("]:").append(dest.port);
     } else {
         key.append(dest.host).append(":").append(dest.port);
     }
+    return key;
+}
+
+PoolHost *Pool::get_host(const lcb_host_t &dest)
+{
+    PoolHost *he;
+    std::string key = host_key(dest);
 
     auto m = ht.find(key);
     if (m == ht.end()) {
@@ -467,7 +542,13 @@ ConnectionRequest *Pool::get(const lcb_host_t &dest, uint32_t timeout, lcbio_CON
     } else {
         he = m->second;
     }
+    return he;
+}
 
+ConnectionRequest *Pool::get(const lcb_host_t &dest, uint32_t timeout, lcbio_CONNDONE_cb cb, void *cbarg)
+{
+    PoolHost *he = get_host(dest);
+    lcb_list_t *cur;
     auto *req = new PoolRequest(he, cb, cbarg);
 
 GT_POPAGAIN:
@@ -497,11 +578,15 @@ GT_POPAGAIN:
         req->set_pending(timeout);
 
         lcb_clist_append(&he->requests, req);
-        if (he->num_pending() < he->num_requests()) {
+        if (he->num_pending() < he->num_requests() && he->has_capacity()) {
             lcb_log(LOGARGS(this, DEBUG), HE_LOGFMT "Creating new connection because none are available in the pool",
                     HE_LOGID(he));
             he->start_new_connection(timeout);
 
+        } else if (he->num_pending() < he->num_requests()) {
+            lcb_log(LOGARGS(this, DEBUG),
+                    HE_LOGFMT "Queueing request. Maximum number of connections reached (%u). Queued=%lu",
+                    HE_LOGID(he), options.maxtotal, (unsigned long int)he->num_requests());
         } else {
             lcb_log(LOGARGS(this, DEBUG), HE_LOGFMT "Not creating a new connection. There are still pending ones",
                     HE_LOGID(he));
@@ -510,6 +595,46 @@ GT_POPAGAIN:
     return req;
 }
 
+void Pool::preconnect(const lcb_host_t &dest, unsigned count, uint32_t timeout)
+{
+    PoolHost *he = get_host(dest);
+    he->n_warm = count;
+    he->warm_timeout = timeout;
+    if (he->replenish_timer.is_armed()) {
+        /* the previous attempt failed, wait for the backoff to expire */
+        return;
+    }
+    he->replenish();
+}
+
+void Pool::cancel_preconnect(const std::vector<lcb_host_t> &keep)
+{
+    std::set<std::string> kept;
+    for (const auto &host : keep) {
+        kept.insert(host_key(host));
+    }
+    for (auto &it : ht) {
+        if (kept.count(it.first)) {
+            continue;
+        }
+        it.second->n_warm = 0;
+        it.second->warm_backoff = 0;
+        it.second->replenish_timer.cancel();
+    }
+}
+
+void PoolHost::replenish()
+{
+    if (closed || n_total >= n_warm) {
+        return;
+    }
+    const PoolHost *he = this;
+    lcb_log(LOGARGS(parent, DEBUG), HE_LOGFMT "Warming up %u connection(s)", HE_LOGID(he), n_warm - n_total);
+    while (n_total < n_warm && has_capacity()) {
+        start_new_connection(warm_timeout);
+    }
+}
+
 void PoolRequest::cancel()
 {
     Pool *mgr = host->parent;
@@ -528,6 +653,12 @@ void PoolRequest::cancel()
 
 void PoolConnInfo::on_idle_timeout()
 {
+    if (parent->n_total <= parent->n_warm && parent->parent->options.tmoidle &&
+        lcbio_is_netclosed(sock, LCB_IO_SOCKCHECK_PEND_IS_ERROR) != LCB_IO_SOCKCHECK_STATUS_CLOSED) {
+        /* keep the minimum number of connections, but check them periodically */
+        idle_timer.rearm(parent->parent->options.tmoidle);
+        return;
+    }
     lcb_log(LOGARGS(parent->parent, DEBUG), HE_LOGFMT "Idle connection expired", HE_LOGID(parent));
     lcbio_unref(sock)
 }
@@ -546,7 +677,7 @@ void Pool::put(lcbio_SOCKET *sock)
     he = info->parent;
     mgr = he->parent;
 
-    if (he->num_idle() >= mgr->options.maxidle) {
+    if (he->num_idle() >= mgr->options.maxidle && he->num_requests() == 0 && he->n_total > he->n_warm) {
         lcb_log(LOGARGS(mgr, INFO), HE_LOGFMT "Closing idle connection. Too many in quota", HE_LOGID(he));
         lcbio_unref(info->sock) return;
     }
@@ -556,6 +687,7 @@ void Pool::put(lcbio_SOCKET *sock)
     info->idle_timer.rearm(mgr->options.tmoidle);
     lcb_clist_append(&he->ll_idle, info);
     info->state = PoolConnInfo::IDLE;
+    he->schedule_available();
 }
 
 void Pool::discard(lcbio_SOCKET *sock)
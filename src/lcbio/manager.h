@@ -42,6 +42,7 @@
 
 #ifdef __cplusplus
 #include <map>
+#include <vector>
 
 namespace lcb
 {
@@ -139,6 +140,36 @@ class Pool
 
     static bool is_from_pool(const lcbio_SOCKET *sock);
 
+    /**
+     * Open connections to the given host in the background, so that up to
+     * @p count of them are available before the first request. The
+     * connections are placed into the pool as idle ones, and are subject to
+     * Options::maxtotal.
+     *
+     * The pool keeps this number of connections to the host until
+     * cancel_preconnect() is called: the idle ones do not expire (they are only
+     * checked for being closed by the peer), and the connections which have been
+     * closed are reopened in the background. Failed attempts are retried with
+     * exponential backoff.
+     *
+     * @param dest the host to connect to
+     * @param count the desired number of connections to the host
+     * @param timeout amount of time to wait for a connection to be established
+     */
+    void preconnect(const lcb_host_t &dest, unsigned count, uint32_t timeout);
+
+    /**
+     * Stop maintaining the connections requested by preconnect() for all hosts
+     * except the ones in @p keep. The open connections are not closed, and
+     * expire as usual.
+     *
+     * The hosts in @p keep retain their retry state, so that a host which is
+     * failing to connect is not retried before its backoff expires.
+     *
+     * @param keep the hosts which are still needed
+     */
+    void cancel_preconnect(const std::vector<lcb_host_t> &keep = {});
+
     /**
      * Dumps the connection manager state to stderr
      */
@@ -150,9 +181,10 @@ class Pool
     struct Options {
         Options() : maxtotal(0), maxidle(0), tmoidle(0) {}
 
-        /** Maximum *total* number of connections opened by the pool. If this
-         * number is exceeded, the pool will black hole future requests until
-         * a new slot becomes available.
+        /** Maximum number of connections (leased, idle and pending) opened
+         * to a single host. If this number is reached, new requests are queued
+         * until a connection is released back into the pool, or until a slot
+         * becomes available. Zero means no limit.
          */
         unsigned maxtotal;
 
@@ -185,6 +217,8 @@ class Pool
     friend struct PoolConnInfo;
     friend struct PoolHost;
 
+    PoolHost *get_host(const lcb_host_t &dest);
+
     typedef std::map< std::string, PoolHost * > HostMap;
     HostMap ht;
     lcb_settings *settings;
@@ -0,0 +1,365 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include "resolver.h"
+#include "settings.h"
+#include "logging.h"
+#include <libcouchbase/utils.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+/** Maximum number of background threads of the instance */
+#define LCBIO_RESOLVER_MAXTHREADS 4
+
+/** Background threads exit after being idle for this number of seconds */
+#define LCBIO_RESOLVER_IDLE_TIMEOUT 30
+
+/**
+ * How often the event loop collects the results while lookups are pending.
+ * The interval starts short, so that fast lookups are delivered without delay,
+ * and doubles while the lookups take longer
+ */
+#define LCBIO_RESOLVER_POLL_MIN LCB_MS2US(1)
+#define LCBIO_RESOLVER_POLL_MAX LCB_MS2US(32)
+
+#define LCBIO_RESOLVER_CACHE_MAX 256
+
+#define LOGARGS(lvl) settings_, "resolver", LCB_LOG_##lvl, __FILE__, __LINE__
+#define HOSTFMT LCB_LOG_SPEC("%s:%s")
+#define HOSTARGS(host, port)                                                                                           \
+    settings_->log_redaction ? LCB_LOG_SD_OTAG : "", host, port, settings_->log_redaction ? LCB_LOG_SD_CTAG : ""
+
+using namespace lcb::io;
+
+AddressList::AddressList(const addrinfo *list)
+{
+    size_t count = 0;
+    for (const addrinfo *cur = list; cur != nullptr; cur = cur->ai_next) {
+        if (cur->ai_addrlen <= sizeof(sockaddr_storage)) {
+            count++;
+        }
+    }
+    entries_.resize(count);
+
+    Entry *entry = entries_.data();
+    for (const addrinfo *cur = list; cur != nullptr; cur = cur->ai_next) {
+        if (cur->ai_addrlen > sizeof(sockaddr_storage)) {
+            continue;
+        }
+        memset(entry, 0, sizeof(*entry));
+        entry->ai.ai_flags = cur->ai_flags;
+        entry->ai.ai_family = cur->ai_family;
+        entry->ai.ai_socktype = cur->ai_socktype;
+        entry->ai.ai_protocol = cur->ai_protocol;
+        entry->ai.ai_addrlen = cur->ai_addrlen;
+        entry->ai.ai_addr = reinterpret_cast<sockaddr *>(&entry->addr);
+        memcpy(&entry->addr, cur->ai_addr, cur->ai_addrlen);
+        if (entry != entries_.data()) {
+            entry[-1].ai.ai_next = &entry->ai;
+        }
+        entry++;
+    }
+}
+
+struct Resolver::Lookup {
+    std::string key;
+    std::string host;
+    std::string port;
+    addrinfo hints{};
+    LookupFunction fn{nullptr};
+    hrtime_t started{0};
+
+    /** Accessed only on the event loop */
+    Callback callback{nullptr};
+    void *arg{nullptr};
+
+    /** Filled by the background thread */
+    int status{0};
+    std::shared_ptr<const AddressList> addrs{};
+
+    void run()
+    {
+        addrinfo *res = nullptr;
+        status = fn(host.c_str(), port.c_str(), &hints, &res);
+        if (status == 0) {
+            addrs = std::make_shared<AddressList>(res);
+            freeaddrinfo(res);
+        }
+    }
+};
+
+/**
+ * State shared with the background threads. The threads are detached, and
+ * keep the state alive until they exit, so that destroying the instance is
+ * never blocked by a slow lookup.
+ */
+struct Resolver::Shared {
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<std::shared_ptr<Lookup>> queue;
+    std::vector<std::shared_ptr<Lookup>> done;
+    size_t nthreads{0};
+    size_t nidle{0};
+    bool shutdown{false};
+};
+
+static void resolver_thread(std::shared_ptr<Resolver::Shared> shared)
+{
+    std::unique_lock<std::mutex> lock(shared->mutex);
+    while (!shared->shutdown) {
+        if (shared->queue.empty()) {
+            shared->nidle++;
+            bool ready = shared->cond.wait_for(lock, std::chrono::seconds(LCBIO_RESOLVER_IDLE_TIMEOUT),
+                                               [&shared] { return shared->shutdown || !shared->queue.empty(); });
+            shared->nidle--;
+            if (!ready) {
+                break;
+            }
+            continue;
+        }
+        std::shared_ptr<Resolver::Lookup> lookup = shared->queue.front();
+        shared->queue.pop_front();
+        lock.unlock();
+        lookup->run();
+        lock.lock();
+        shared->done.push_back(std::move(lookup));
+    }
+    shared->nthreads--;
+}
+
+Resolver::Resolver(lcb_settings *settings)
+    : settings_(settings), shared_(std::make_shared<Shared>()), lookup_fn_(getaddrinfo)
+{
+}
+
+Resolver::~Resolver()
+{
+    pending_.clear();
+    stop_polling_if_idle();
+    std::lock_guard<std::mutex> lock(shared_->mutex);
+    shared_->shutdown = true;
+    shared_->queue.clear();
+    shared_->done.clear();
+    shared_->cond.notify_all();
+}
+
+Resolver *Resolver::get(lcb_settings *settings)
+{
+    if (settings->resolver == nullptr) {
+        settings->resolver = new Resolver(settings);
+    }
+    return settings->resolver;
+}
+
+Resolver::Lookup *Resolver::resolve(lcbio_TABLE *iot, const lcb_host_t *host, int family, Callback callback,
+                                    void *arg)
+{
+    addrinfo hints{};
+    hints.ai_flags = AI_PASSIVE;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_family = family;
+
+    {
+        /* numeric addresses are converted without blocking */
+        addrinfo numeric = hints;
+        addrinfo *res = nullptr;
+        numeric.ai_flags |= AI_NUMERICHOST | AI_NUMERICSERV;
+        if (getaddrinfo(host->host, host->port, &numeric, &res) == 0) {
+            callback(arg, 0, res);
+            freeaddrinfo(res);
+            return nullptr;
+        }
+    }
+
+    lcb_METRICS *metrics = settings_->metrics;
+    if (metrics) {
+        metrics->dns_lookups++;
+    }
+
+    std::string key;
+    key.append(host->host).append("/").append(host->port).append("/").append(std::to_string(family));
+    if (settings_->dns_cache_ttl) {
+        auto it = cache_.find(key);
+        if (it != cache_.end()) {
+            if (it->second.expires > gethrtime()) {
+                std::shared_ptr<const AddressList> addrs = it->second.addrs;
+                if (metrics) {
+                    metrics->dns_cache_hits++;
+                }
+                lcb_log(LOGARGS(TRACE), "Using cached addresses of " HOSTFMT, HOSTARGS(host->host, host->port));
+                callback(arg, 0, addrs->head());
+                return nullptr;
+            }
+            cache_.erase(it);
+        }
+    }
+
+    auto lookup = std::make_shared<Lookup>();
+    lookup->key = key;
+    lookup->host = host->host;
+    lookup->port = host->port;
+    lookup->hints = hints;
+    lookup->fn = lookup_fn_;
+    lookup->started = gethrtime();
+    lookup->callback = callback;
+    lookup->arg = arg;
+
+    bool queued = iot_ == nullptr || iot_ == iot;
+    if (queued) {
+        std::lock_guard<std::mutex> lock(shared_->mutex);
+        shared_->queue.push_back(lookup);
+        if (shared_->nidle < shared_->queue.size() && shared_->nthreads < LCBIO_RESOLVER_MAXTHREADS) {
+            try {
+                std::thread(resolver_thread, shared_).detach();
+                shared_->nthreads++;
+            } catch (const std::system_error &) {
+                if (shared_->nthreads == 0) {
+                    shared_->queue.pop_back();
+                    queued = false;
+                }
+            }
+        }
+        shared_->cond.notify_one();
+    }
+
+    if (!queued) {
+        /* the results cannot be delivered asynchronously, fall back to the blocking lookup */
+        lcb_log(LOGARGS(DEBUG), "Resolving " HOSTFMT " synchronously", HOSTARGS(host->host, host->port));
+        lookup->run();
+        deliver(lookup.get());
+        return nullptr;
+    }
+
+    lcb_log(LOGARGS(TRACE), "Scheduled lookup of " HOSTFMT, HOSTARGS(host->host, host->port));
+    pending_.push_back(lookup);
+    if (timer_ == nullptr) {
+        iot_ = iot;
+        timer_ = lcbio_timer_new(iot, this, poll_cb);
+    }
+    if (!lcbio_timer_armed(timer_)) {
+        poll_interval_ = LCBIO_RESOLVER_POLL_MIN;
+        lcbio_timer_rearm(timer_, poll_interval_);
+    }
+    return lookup.get();
+}
+
+void Resolver::cancel(Lookup *lookup)
+{
+    auto it = std::find_if(pending_.begin(), pending_.end(),
+                           [lookup](const std::shared_ptr<Lookup> &cur) { return cur.get() == lookup; });
+    if (it != pending_.end()) {
+        pending_.erase(it);
+    }
+    stop_polling_if_idle();
+}
+
+void Resolver::invalidate(const char *host)
+{
+    std::string prefix(host);
+    prefix.append("/");
+    for (auto it = cache_.begin(); it != cache_.end();) {
+        if (it->first.compare(0, prefix.size(), prefix) == 0) {
+            it = cache_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void Resolver::poll_cb(void *arg)
+{
+    reinterpret_cast<Resolver *>(arg)->poll();
+}
+
+void Resolver::poll()
+{
+    std::vector<std::shared_ptr<Lookup>> done;
+    {
+        std::lock_guard<std::mutex> lock(shared_->mutex);
+        done.swap(shared_->done);
+    }
+    if (done.empty()) {
+        poll_interval_ = std::min(poll_interval_ * 2, (uint32_t)LCBIO_RESOLVER_POLL_MAX);
+    }
+    for (auto &lookup : done) {
+        auto it = std::find(pending_.begin(), pending_.end(), lookup);
+        if (it == pending_.end()) {
+            /* cancelled */
+            continue;
+        }
+        pending_.erase(it);
+        deliver(lookup.get());
+    }
+    if (timer_ && !pending_.empty()) {
+        lcbio_timer_rearm(timer_, poll_interval_);
+    } else {
+        stop_polling_if_idle();
+    }
+}
+
+void Resolver::deliver(Lookup *lookup)
+{
+    hrtime_t now = gethrtime();
+    lcb_METRICS *metrics = settings_->metrics;
+    if (metrics) {
+        if (metrics->dns_latency == nullptr) {
+            metrics->dns_latency = lcb_histogram_create();
+        }
+        lcb_histogram_record(metrics->dns_latency, now - lookup->started);
+    }
+
+    if (lookup->status == 0) {
+        lcb_log(LOGARGS(DEBUG), "Resolved " HOSTFMT " in %uus", HOSTARGS(lookup->host.c_str(), lookup->port.c_str()),
+                (unsigned)LCB_NS2US(now - lookup->started));
+        if (settings_->dns_cache_ttl) {
+            if (cache_.size() >= LCBIO_RESOLVER_CACHE_MAX && cache_.find(lookup->key) == cache_.end()) {
+                for (auto it = cache_.begin(); it != cache_.end();) {
+                    if (it->second.expires < now) {
+                        it = cache_.erase(it);
+                    } else {
+                        ++it;
+                    }
+                }
+                if (cache_.size() >= LCBIO_RESOLVER_CACHE_MAX) {
+                    cache_.clear();
+                }
+            }
+            CacheEntry &entry = cache_[lookup->key];
+            entry.addrs = lookup->addrs;
+            entry.expires = now + LCB_US2NS(settings_->dns_cache_ttl);
+        }
+    }
+    lookup->callback(lookup->arg, lookup->status, lookup->addrs ? lookup->addrs->head() : nullptr);
+}
+
+void Resolver::stop_polling_if_idle()
+{
+    if (timer_ && pending_.empty()) {
+        /* do not keep the I/O table referenced while there is nothing to wait for */
+        lcbio_timer_destroy(timer_);
+        timer_ = nullptr;
+        iot_ = nullptr;
+    }
+}
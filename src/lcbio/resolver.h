@@ -0,0 +1,158 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCBIO_RESOLVER_H
+#define LCBIO_RESOLVER_H
+
+#include "connect.h"
+#include "timer-ng.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @file
+ * Non-blocking host name resolution.
+ *
+ * getaddrinfo() may block for seconds when the DNS server is slow, and if it
+ * was called from the event loop, all I/O of the instance would stall with it.
+ * The Resolver runs the lookups on a small pool of background threads, and
+ * delivers the results on the event loop of the instance (through the timer of
+ * the I/O plugin, so that completion-based plugins are supported as well).
+ *
+ * The I/O plugins have no wakeup which a foreign thread could trigger, so the
+ * event loop polls for the results while lookups are pending. The interval
+ * grows from 1ms to 32ms while a lookup is in progress: fast lookups are
+ * delivered with little latency, and a slow DNS server costs at most ~30
+ * wakeups per second. Nothing is polled while no lookup is pending.
+ *
+ * The results are cached for @ref LCB_CNTL_DNS_CACHE_TTL, and the cache is
+ * shared by all connections of the instance.
+ */
+
+namespace lcb
+{
+namespace io
+{
+
+/**
+ * Copy of the addrinfo list, which owns the socket addresses. The entries are
+ * linked through `ai_next`, so that head() may be passed wherever the result of
+ * getaddrinfo() is expected.
+ */
+class AddressList
+{
+  public:
+    explicit AddressList(const addrinfo *list);
+    AddressList(const AddressList &) = delete;
+    AddressList &operator=(const AddressList &) = delete;
+
+    const addrinfo *head() const
+    {
+        return entries_.empty() ? nullptr : &entries_.front().ai;
+    }
+
+  private:
+    struct Entry {
+        addrinfo ai;
+        sockaddr_storage addr;
+    };
+    std::vector<Entry> entries_;
+};
+
+class Resolver
+{
+  public:
+    /**
+     * Invoked on the event loop when the name has been resolved.
+     * @param arg the argument passed to resolve()
+     * @param status zero on success, otherwise the error returned by getaddrinfo()
+     * @param addrs resolved addresses. Valid only during the callback
+     */
+    typedef void (*Callback)(void *arg, int status, const addrinfo *addrs);
+
+    /** Function which performs the lookup, has the signature of getaddrinfo() */
+    typedef int (*LookupFunction)(const char *host, const char *port, const addrinfo *hints, addrinfo **res);
+
+    struct Lookup;
+
+    explicit Resolver(lcb_settings *settings);
+    ~Resolver();
+    Resolver(const Resolver &) = delete;
+    Resolver &operator=(const Resolver &) = delete;
+
+    /** @return the resolver of the instance, creating it if necessary */
+    static Resolver *get(lcb_settings *settings);
+
+    /**
+     * Resolve the host name.
+     *
+     * Numeric addresses and names found in the cache are resolved
+     * immediately: the callback is invoked before this function returns, and
+     * the return value is NULL. Otherwise the lookup is scheduled on the
+     * background thread, and the returned handle may be passed to cancel()
+     * until the callback has been invoked.
+     *
+     * @param iot the I/O table of the event loop which receives the result
+     * @param host the host and port to resolve
+     * @param family the address family (`ai_family` of the hints)
+     */
+    Lookup *resolve(lcbio_TABLE *iot, const lcb_host_t *host, int family, Callback callback, void *arg);
+
+    /** Cancel the pending lookup. The callback will not be invoked */
+    void cancel(Lookup *lookup);
+
+    /** Drop the cached addresses of the host (e.g. when they are not reachable) */
+    void invalidate(const char *host);
+
+    /** Replace getaddrinfo(). Used by the tests to emulate slow DNS servers */
+    void set_lookup_function(LookupFunction fn)
+    {
+        lookup_fn_ = fn;
+    }
+
+    struct Shared;
+
+  private:
+    static void poll_cb(void *arg);
+    void poll();
+    void deliver(Lookup *lookup);
+    void stop_polling_if_idle();
+
+    struct CacheEntry {
+        std::shared_ptr<const AddressList> addrs;
+        hrtime_t expires;
+    };
+
+    lcb_settings *settings_;
+    std::shared_ptr<Shared> shared_;
+    LookupFunction lookup_fn_;
+    /** Delivers the results, armed only while there are pending lookups */
+    lcbio_pTIMER timer_{nullptr};
+    uint32_t poll_interval_{0};
+    lcbio_TABLE *iot_{nullptr};
+    /** Lookups which have been submitted and not cancelled */
+    std::vector<std::shared_ptr<Lookup>> pending_;
+    std::map<std::string, CacheEntry> cache_;
+};
+
+} // namespace io
+} // namespace lcb
+
+#endif
@@ -86,6 +86,14 @@ lcbio_pSSLCTX lcbio_ssl_new(const char *tsfile, const char *cafile, const char *
  */
 void lcbio_ssl_free(lcbio_pSSLCTX ctx);
 
+/**
+ * Retrieve the number of full and resumed handshakes performed with the
+ * context, and the number of sessions cached for resumption.
+ * @param ctx the context, may be NULL
+ * @param stats the structure to fill
+ */
+void lcbio_ssl_session_stats(lcbio_pSSLCTX ctx, lcb_TLS_SESSION_STATS *stats);
+
 /**
  * Apply the SSL settings to a given socket.
  *
@@ -117,6 +125,19 @@ int lcbio_ssl_check(lcbio_SOCKET *sock);
 LCB_INTERNAL_API
 lcb_STATUS lcbio_ssl_get_error(lcbio_SOCKET *sock);
 
+/**
+ * Offer the application protocols to the server during the TLS handshake
+ * (ALPN). Must be called after lcbio_ssl_apply(), before any I/O on the socket.
+ *
+ * @param sock the socket
+ * @param protos the list of protocols in the wire format (every name is
+ *        prefixed with its length, e.g. `"\x02h2"`)
+ * @param nprotos the size of the list
+ * @return LCB_ERR_SDK_FEATURE_UNAVAILABLE if the TLS library does not support
+ *         ALPN
+ */
+lcb_STATUS lcbio_ssl_set_alpn(lcbio_SOCKET *sock, const unsigned char *protos, unsigned nprotos);
+
 /**
  * @brief
  * Initialize any application-level globals needed for SSL support
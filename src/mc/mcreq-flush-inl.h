@@ -23,6 +23,7 @@ extern "C" {
 typedef struct {
     mc_PIPELINE *pl;
     hrtime_t now;
+    hrtime_t flushed; /* lazily initialized for the latency histograms */
 } mc__FLUSHINFO;
 
 /**
@@ -51,6 +52,18 @@ static nb_SIZE mcreq__pktflush_callback(void *p, nb_SIZE hint, void *arg)
 
     pktsize = mcreq_get_size(pkt);
 
+    if (hint >= pktsize && info->pl->metrics && info->pl->metrics->queue_latency) {
+        /* before the start time is readjusted below */
+        mc_REQDATA *rdata = MCREQ_PKT_RDATA(pkt);
+        if (!info->flushed) {
+            info->flushed = gethrtime();
+        }
+        rdata->flushed = info->flushed;
+        if (rdata->start && rdata->start < info->flushed) {
+            lcb_histogram_record(info->pl->metrics->queue_latency, info->flushed - rdata->start);
+        }
+    }
+
     if (info->now && hint) {
         MCREQ_PKT_RDATA(pkt)->start = info->now;
     }
@@ -89,7 +102,7 @@ static nb_SIZE mcreq__pktflush_callback(void *p, nb_SIZE hint, void *arg)
 static void mcreq_flush_done_ex(mc_PIPELINE *pl, unsigned nflushed, unsigned expected, lcb_U64 now)
 {
     if (nflushed) {
-        mc__FLUSHINFO info = {pl, now};
+        mc__FLUSHINFO info = {pl, now, 0};
         netbuf_end_flush2(&pl->nbmgr, nflushed, mcreq__pktflush_callback, offsetof(mc_PACKET, sl_flushq), &info);
     }
     if (nflushed < expected) {
@@ -319,6 +319,7 @@ mc_PACKET *mcreq_allocate_packet(mc_PIPELINE *pipeline)
     ret->opaque = pipeline->parent->seq++;
     ret->u_rdata.reqdata.span = NULL;
     ret->u_rdata.reqdata.deadline = 0;
+    ret->u_rdata.reqdata.flushed = 0;
     return ret;
 }
 
@@ -780,6 +781,31 @@ void mcreq_sched_enter(mc_CMDQUEUE *queue)
     queue->ctxenter = 1;
 }
 
+/* Tells the owner of the user-allocated buffers that the packet does not reference them anymore */
+static void release_user_buffers(mc_PIPELINE *pipeline, mc_PACKET *pkt)
+{
+    void *kbuf, *vbuf;
+
+    if (!(pkt->flags & MCREQ_UBUF_FLAGS) || pipeline->buf_done_callback == NULL) {
+        return;
+    }
+    if (pkt->flags & MCREQ_F_KEY_NOCOPY) {
+        kbuf = SPAN_BUFFER(&pkt->kh_span);
+    } else {
+        kbuf = NULL;
+    }
+    if (pkt->flags & MCREQ_F_VALUE_NOCOPY) {
+        if (pkt->flags & MCREQ_F_VALUE_IOV) {
+            vbuf = pkt->u_value.multi.iov->iov_base;
+        } else {
+            vbuf = SPAN_SABUFFER_NC(&pkt->u_value.single);
+        }
+    } else {
+        vbuf = NULL;
+    }
+    pipeline->buf_done_callback(pipeline, MCREQ_PKT_COOKIE(pkt), kbuf, vbuf);
+}
+
 static void queuectx_leave(mc_CMDQUEUE *queue, int success, int flush)
 {
     if (queue->ctxenter) {
@@ -814,6 +840,7 @@ static void queuectx_leave(mc_CMDQUEUE *queue, int success, int flush)
                         rd->procs->fail_dtor(pkt);
                     }
                 }
+                release_user_buffers(pipeline, pkt);
                 mcreq_wipe_packet(pipeline, pkt);
                 mcreq_release_packet(pipeline, pkt);
             }
@@ -883,28 +910,7 @@ void mcreq_packet_done(mc_PIPELINE *pipeline, mc_PACKET *pkt)
 {
     lcb_assert(pkt->flags & MCREQ_F_FLUSHED);
     lcb_assert(pkt->flags & MCREQ_F_INVOKED);
-    if (pkt->flags & MCREQ_UBUF_FLAGS) {
-        void *kbuf, *vbuf;
-        const void *cookie;
-
-        cookie = MCREQ_PKT_COOKIE(pkt);
-        if (pkt->flags & MCREQ_F_KEY_NOCOPY) {
-            kbuf = SPAN_BUFFER(&pkt->kh_span);
-        } else {
-            kbuf = NULL;
-        }
-        if (pkt->flags & MCREQ_F_VALUE_NOCOPY) {
-            if (pkt->flags & MCREQ_F_VALUE_IOV) {
-                vbuf = pkt->u_value.multi.iov->iov_base;
-            } else {
-                vbuf = SPAN_SABUFFER_NC(&pkt->u_value.single);
-            }
-        } else {
-            vbuf = NULL;
-        }
-
-        pipeline->buf_done_callback(pipeline, cookie, kbuf, vbuf);
-    }
+    release_user_buffers(pipeline, pkt);
     mcreq_wipe_packet(pipeline, pkt);
     mcreq_release_packet(pipeline, pkt);
 }
@@ -152,6 +152,7 @@ typedef struct mc_REQDATA {
     hrtime_t dispatch;
     lcbtrace_SPAN *span;
     uint32_t nsubreq; /* number of subrequests */
+    hrtime_t flushed; /**< When the packet was written. Only set for LCB_CNTL_PIPELINE_LATENCY */
 } mc_REQDATA;
 
 struct mc_packet_st;
@@ -198,11 +199,12 @@ typedef struct mc_REQDATAEX {
     hrtime_t dispatch;
     lcbtrace_SPAN *span;
     uint32_t nsubreq;             /* number of subrequests */
+    hrtime_t flushed;             /**< When the packet was written */
     const mc_REQDATAPROCS *procs; /**< Common routines for the packet */
 
 #ifdef __cplusplus
     mc_REQDATAEX(void *cookie_, const mc_REQDATAPROCS &procs_, hrtime_t start_)
-        : cookie(cookie_), start(start_), dispatch(0), span(NULL), nsubreq(0), procs(&procs_)
+        : cookie(cookie_), start(start_), dispatch(0), span(NULL), nsubreq(0), flushed(0), procs(&procs_)
     {
         deadline = start_ + LCB_DEFAULT_TIMEOUT;
     }
@@ -15,6 +15,8 @@
  *   limitations under the License.
  */
 
+#include <algorithm>
+#include <climits> /* For IOV_MAX */
 #include <cstring>
 
 #include "internal.h"
@@ -24,6 +26,7 @@
 #include "negotiate.h"
 #include "bucketconfig/clconfig.h"
 #include "mc/mcreq-flush-inl.h"
+#include <lcbio/iotable.h>
 #include <lcbio/ssl.h>
 #include <include/memcached/protocol_binary.h>
 #include "ctx-log-inl.h"
@@ -41,7 +44,22 @@
 #define LOGID(server) CTX_LOGID(server->connctx), (void *)server, server->index
 #define LOGID_T() LOGID(this)
 
-#define MCREQ_MAXIOV 32
+/* Smallest and largest number of IOVs passed to a single write */
+#define MCREQ_MINIOV 32
+#if defined(IOV_MAX) && IOV_MAX < 1024
+#define MCREQ_MAXIOV IOV_MAX
+#else
+#define MCREQ_MAXIOV 1024
+#endif
+
+/* Adjacent spans smaller than this are copied into the scratch buffer */
+#define MCREQ_COALESCE_SPAN 512
+#define MCREQ_SCRATCH_SIZE 16384
+
+/* Bounds of the delay between the background reconnection attempts (LCB_CNTL_KV_PRECONNECT) */
+#define MCSERVER_RECONNECT_BACKOFF_MIN LCB_MS2US(100)
+#define MCSERVER_RECONNECT_BACKOFF_MAX LCB_S2US(10)
+
 #define LCBCONN_UNWANT(conn, flags) (conn)->want &= ~(flags)
 
 using namespace lcb;
@@ -51,16 +69,35 @@ static void on_error(lcbio_CTX *ctx, lcb_STATUS err);
 static void on_flush_ready(lcbio_CTX *ctx)
 {
     Server *server = Server::get(ctx);
-    nb_IOV iov[MCREQ_MAXIOV] = {};
     int ready;
+    /* Event-model writes complete before lcbio_ctx_put_ex() returns, so the
+     * scratch buffer may be reused for the next write. TLS sockets merge
+     * small buffers into records on their own. */
+    bool coalesce = IOT_IS_EVENT(ctx->io) && !lcbio_ssl_check(ctx->sock);
+
+    if (server->flush_iov.empty()) {
+        server->flush_iov.resize(MCREQ_MAXIOV);
+        server->iov_window = MCREQ_MINIOV;
+    }
 
     do {
+        nb_IOV *iov = &server->flush_iov[0];
         int niov = 0;
         unsigned nb;
-        nb = mcreq_flush_iov_fill(server, iov, MCREQ_MAXIOV, &niov);
+        nb = mcreq_flush_iov_fill(server, iov, server->iov_window, &niov);
         if (!nb) {
             return;
         }
+        server->iov_window_full = niov == (int)server->iov_window;
+        if (coalesce && niov > 1) {
+            nb_SIZE ncopied = 0;
+            if (server->flush_scratch.empty()) {
+                server->flush_scratch.resize(MCREQ_SCRATCH_SIZE);
+            }
+            niov = netbuf_coalesce_iov(iov, niov, &server->flush_scratch[0], server->flush_scratch.size(),
+                                       MCREQ_COALESCE_SPAN, &ncopied);
+            MC_INCR_METRIC(server, flush_coalesced_bytes, ncopied);
+        }
 #ifdef LCB_DUMP_PACKETS
         {
             char *b64 = nullptr;
@@ -70,6 +107,8 @@ static void on_flush_ready(lcbio_CTX *ctx)
             free(b64);
         }
 #endif
+        MC_INCR_METRIC(server, flush_writes, 1);
+        MC_INCR_METRIC(server, flush_bytes, nb);
         ready = lcbio_ctx_put_ex(ctx, (lcb_IOV *)iov, niov, nb);
     } while (ready);
     lcbio_ctx_wwant(ctx);
@@ -86,6 +125,15 @@ static void on_flush_done(lcbio_CTX *ctx, unsigned expected, unsigned actual)
 #ifdef LCB_DUMP_PACKETS
     lcb_log(LOGARGS(server, TRACE), LOGFMT "pkt,snd,flush: expected=%u, actual=%u", LOGID(server), expected, actual);
 #endif
+    /* Widen the window while the socket accepts everything, and narrow it
+     * back once the socket buffer is full. */
+    if (actual < expected) {
+        if (server->iov_window > MCREQ_MINIOV) {
+            server->iov_window /= 2;
+        }
+    } else if (server->iov_window_full && server->iov_window < MCREQ_MAXIOV) {
+        server->iov_window = server->iov_window * 2 < MCREQ_MAXIOV ? server->iov_window * 2 : MCREQ_MAXIOV;
+    }
     mcreq_flush_done_ex(server, actual, expected, now);
     server->check_closed();
 }
@@ -341,6 +389,9 @@ static bool is_fastpath_error(uint16_t rc)
         case PROTOCOL_BINARY_RESPONSE_SYNC_WRITE_IN_PROGRESS:
         case PROTOCOL_BINARY_RESPONSE_SYNC_WRITE_AMBIGUOUS:
         case PROTOCOL_BINARY_RESPONSE_LOCKED:
+        case PROTOCOL_BINARY_RESPONSE_RANGE_SCAN_CANCELLED:
+        case PROTOCOL_BINARY_RESPONSE_RANGE_SCAN_MORE:
+        case PROTOCOL_BINARY_RESPONSE_RANGE_SCAN_COMPLETE:
         case PROTOCOL_BINARY_RATE_LIMITED_NETWORK_INGRESS:
         case PROTOCOL_BINARY_RATE_LIMITED_NETWORK_EGRESS:
         case PROTOCOL_BINARY_RATE_LIMITED_MAX_CONNECTIONS:
@@ -440,8 +491,6 @@ int Server::handle_unknown_error(const mc_PACKET *request, const MemcachedRespon
     return rv;
 }
 
-lcb_STATUS lcb_map_error(lcb_INSTANCE *instance, int in);
-
 static bool is_warmup_issue(uint16_t status)
 {
     return status == PROTOCOL_BINARY_RESPONSE_NO_BUCKET || status == PROTOCOL_BINARY_RESPONSE_NOT_INITIALIZED;
@@ -496,7 +545,11 @@ Server::ReadState Server::try_read(lcbio_CTX *ctx, rdb_IOROPE *ior)
     }
 
     /* Find the packet */
-    if (mcresp.opcode() == PROTOCOL_BINARY_CMD_STAT && mcresp.keylen() != 0) {
+    if ((mcresp.opcode() == PROTOCOL_BINARY_CMD_STAT && mcresp.keylen() != 0) ||
+        (mcresp.opcode() == PROTOCOL_BINARY_CMD_RANGE_SCAN_CONTINUE &&
+         mcresp.status() == PROTOCOL_BINARY_RESPONSE_SUCCESS)) {
+        /* range scan continue streams the items with success status, and
+         * terminates the batch with "more" or "complete" status */
         is_last = 0;
         request = mcreq_pipeline_find(this, mcresp.opaque());
     } else {
@@ -537,6 +590,10 @@ Server::ReadState Server::try_read(lcbio_CTX *ctx, rdb_IOROPE *ior)
     ReadState rdstate = PKT_READ_COMPLETE;
     int unknown_err_rv;
 
+    if (metrics && metrics->wire_latency) {
+        record_latency(request, mcresp);
+    }
+
     auto status = static_cast<protocol_binary_response_status>(mcresp.status());
     if (is_warmup_issue(status)) {
         DO_ASSIGN_PAYLOAD()
@@ -616,6 +673,18 @@ GT_DONE:
     return rdstate;
 }
 
+void Server::record_latency(const mc_PACKET *request, const MemcachedResponse &resinfo)
+{
+    const mc_REQDATA *rdata = MCREQ_PKT_RDATA(request);
+    if (rdata->flushed && rdata->flushed < last_read) {
+        lcb_histogram_record(metrics->wire_latency, last_read - rdata->flushed);
+    }
+    uint64_t server_us = resinfo.duration();
+    if (server_us) {
+        lcb_histogram_record(metrics->server_latency, LCB_US2NS(server_us));
+    }
+}
+
 static void on_read(lcbio_CTX *ctx, unsigned)
 {
     Server *server = Server::get(ctx);
@@ -625,6 +694,9 @@ static void on_read(lcbio_CTX *ctx, unsigned)
         return;
     }
 
+    if (server->metrics && server->metrics->wire_latency) {
+        server->last_read = gethrtime();
+    }
     while (server->try_read(ctx, ior) == Server::PKT_READ_COMPLETE)
         ;
     lcbio_ctx_schedule(ctx);
@@ -641,6 +713,11 @@ static void server_connect(Server *server)
     server->connect();
 }
 
+static void reconnect_server(void *arg)
+{
+    reinterpret_cast<Server *>(arg)->preconnect();
+}
+
 bool Server::maybe_retry_packet(mc_PACKET *pkt, lcb_STATUS err, protocol_binary_response_status status)
 {
     lcbvb_DISTMODE dist_t = lcbvb_get_distmode(parent->config);
@@ -757,6 +834,12 @@ static const char *opcode_name(uint8_t code)
             return "get_error_map";
         case PROTOCOL_BINARY_CMD_GET_META:
             return "exists";
+        case PROTOCOL_BINARY_CMD_RANGE_SCAN_CREATE:
+            return "range_scan_create";
+        case PROTOCOL_BINARY_CMD_RANGE_SCAN_CONTINUE:
+            return "range_scan_continue";
+        case PROTOCOL_BINARY_CMD_RANGE_SCAN_CANCEL:
+            return "range_scan_cancel";
         default:
             return "unknown";
     }
@@ -788,6 +871,10 @@ void Server::purge_single(mc_PACKET *pkt, lcb_STATUS err)
     MemcachedResponse resp(protocol_binary_command(hdr.request.opcode), hdr.request.opaque,
                            PROTOCOL_BINARY_RESPONSE_EINVAL);
 
+    if (MCREQ_PKT_RDATA(pkt)->span == nullptr && lcb::trace::is_tail_based(settings)) {
+        /* the orphan report needs the span, even though it has not been created upfront */
+        MCREQ_PKT_RDATA(pkt)->span = lcb::trace::materialize_kv_span(this, pkt);
+    }
     lcbtrace_span_set_orphaned(MCREQ_PKT_RDATA(pkt)->span, true);
     if (err == LCB_ERR_TIMEOUT && settings->use_tracing) {
         Json::Value info;
@@ -1015,6 +1102,7 @@ void Server::handle_connected(lcbio_SOCKET *sock, lcb_STATUS err, lcbio_OSERR sy
     procs.cb_read = on_read;
     procs.cb_flush_done = on_flush_done;
     procs.cb_flush_ready = on_flush_ready;
+    reconnect_backoff = 0;
     connctx = lcbio_ctx_new(sock, this, &procs);
     connctx->subsys = "memcached";
     sock->service = LCBIO_SERVICE_KV;
@@ -1034,15 +1122,45 @@ void Server::handle_connected(lcbio_SOCKET *sock, lcb_STATUS err, lcbio_OSERR sy
 
 void Server::connect()
 {
+    if (reconnect_timer) {
+        lcbio_timer_disarm(reconnect_timer);
+    }
     connreq = instance->memd_sockpool->get(*curhost, default_timeout(), on_connected, this);
     flush_start = flush_noop;
     state = Server::S_CLEAN;
 }
 
+void Server::preconnect()
+{
+    if (connctx || connreq || (state != S_CLEAN && state != S_ERRDRAIN) || !has_valid_host()) {
+        return;
+    }
+    lcb_log(LOGARGS_T(DEBUG), LOGFMT "Connecting in advance", LOGID_T());
+    connect();
+}
+
+void Server::schedule_reconnect()
+{
+    if (reconnect_timer == nullptr) {
+        reconnect_timer = lcbio_timer_new(instance->iotable, this, reconnect_server);
+    }
+    reconnect_backoff = std::min(std::max(reconnect_backoff * 2, (uint32_t)MCSERVER_RECONNECT_BACKOFF_MIN),
+                                 (uint32_t)MCSERVER_RECONNECT_BACKOFF_MAX);
+    lcb_log(LOGARGS_T(DEBUG), LOGFMT "Reconnecting in %ums", LOGID_T(), (unsigned)(reconnect_backoff / 1000));
+    lcbio_timer_rearm(reconnect_timer, reconnect_backoff);
+}
+
 static void buf_done_cb(mc_PIPELINE *pl, const void *cookie, void *, void *)
 {
     auto *server = static_cast<Server *>(pl);
-    server->instance->callbacks.pktflushed(server->instance, cookie);
+    lcb_INSTANCE *instance = server->instance;
+    if (instance == nullptr && pl->parent != nullptr) {
+        /* the server is being destroyed, but the instance is still alive */
+        instance = static_cast<lcb_INSTANCE *>(pl->parent->cqdata);
+    }
+    if (instance != nullptr) {
+        instance->callbacks.pktflushed(instance, cookie);
+    }
 }
 
 Server::Server(lcb_INSTANCE *instance_, int ix)
@@ -1067,6 +1185,9 @@ Server::Server(lcb_INSTANCE *instance_, int ix)
         /** Allocate / reinitialize the metrics here */
         metrics = lcb_metrics_getserver(settings->metrics, curhost->host, curhost->port, 1);
         lcb_metrics_reset_pipeline_gauges(metrics);
+        if (settings->pipeline_latency) {
+            lcb_metrics_enable_latency(metrics);
+        }
     }
 }
 
@@ -1096,11 +1217,21 @@ Server::~Server()
     this->instance = nullptr;
     purge(LCB_ERR_REQUEST_CANCELED, 0, Server::REFRESH_NEVER);
 
+    /* Release the packets which have never been written, so that the owners of borrowed buffers learn about it */
+    unsigned toflush;
+    nb_IOV iov;
+    while ((toflush = mcreq_flush_iov_fill(this, &iov, 1, nullptr))) {
+        mcreq_flush_done(this, toflush, toflush);
+    }
+
     mcreq_pipeline_cleanup(this);
 
     if (io_timer) {
         lcbio_timer_destroy(io_timer);
     }
+    if (reconnect_timer) {
+        lcbio_timer_destroy(reconnect_timer);
+    }
 
     delete curhost;
     lcb_settings_unref(settings);
@@ -1161,6 +1292,10 @@ void Server::start_errored_ctx(State next_state)
         lcbio_timer_destroy(io_timer);
         io_timer = nullptr;
     }
+    if (next_state == Server::S_CLOSED && reconnect_timer != nullptr) {
+        lcbio_timer_destroy(reconnect_timer);
+        reconnect_timer = nullptr;
+    }
 
     if (ctx == nullptr) {
         if (next_state == Server::S_CLOSED) {
@@ -1177,6 +1312,10 @@ void Server::start_errored_ctx(State next_state)
             } else {
                 // Connect once someone actually wants a connection.
                 flush_start = (mcreq_flushstart_fn)server_connect;
+                if (settings->kv_preconnect) {
+                    // ... or earlier, if the connection should be ready before the first command
+                    schedule_reconnect();
+                }
             }
         }
 
@@ -24,6 +24,8 @@
 #include <netbuf/netbuf.h>
 
 #ifdef __cplusplus
+#include <vector>
+
 namespace lcb
 {
 
@@ -192,11 +194,21 @@ class Server : public mc_PIPELINE
 
     void connect();
 
+    /**
+     * Open the connection in advance if the server has none (see
+     * LCB_CNTL_KV_PRECONNECT), so that the first command does not wait for it
+     */
+    void preconnect();
+
+    /** Retry the connection in the background after the current backoff */
+    void schedule_reconnect();
+
     void handle_connected(lcbio_SOCKET *socket, lcb_STATUS err, lcbio_OSERR syserr);
 
     enum ReadState { PKT_READ_COMPLETE, PKT_READ_PARTIAL, PKT_READ_ABORT };
 
     ReadState try_read(lcbio_CTX *ctx, rdb_IOROPE *ior);
+    void record_latency(const mc_PACKET *request, const MemcachedResponse &resinfo);
     int handle_unknown_error(const mc_PACKET *request, const MemcachedResponse &resinfo, lcb_STATUS &newerr);
     bool handle_nmv(MemcachedResponse &resinfo, mc_PACKET *oldpkt);
     bool handle_unknown_collection(MemcachedResponse &resinfo, mc_PACKET *oldpkt);
@@ -212,6 +224,12 @@ class Server : public mc_PIPELINE
     /** IO/Operation timer */
     lcbio_pTIMER io_timer;
 
+    /** Background reconnection timer (only with LCB_CNTL_KV_PRECONNECT) */
+    lcbio_pTIMER reconnect_timer{};
+
+    /** Delay before the next background reconnection, grows while the attempts fail */
+    uint32_t reconnect_backoff{};
+
     /** Pointer back to the instance */
     lcb_INSTANCE *instance;
 
@@ -235,6 +253,19 @@ class Server : public mc_PIPELINE
     lcbio_CTX *connctx;
     lcb::io::ConnectionRequest *connreq{};
 
+    /** IOVs for lcbio_ctx_put_ex(). Only the first iov_window items are filled on every write */
+    std::vector<nb_IOV> flush_iov{};
+    unsigned iov_window{};
+
+    /** Whether the last write used the whole window */
+    bool iov_window_full{};
+
+    /** Buffer for merging small adjacent spans into a single IOV */
+    std::vector<char> flush_scratch{};
+
+    /** When the last read event was handled (for LCB_CNTL_PIPELINE_LATENCY) */
+    hrtime_t last_read{};
+
     /** Request for current connection */
     lcb_host_t *curhost;
     std::string bucket{}; /** non-empty if bucket has been selected */
@@ -64,8 +64,12 @@ class lcb::SessionRequestImpl : public SessionRequest
     }
 
     bool setup(const lcbio_NAMEINFO &nistrs, const lcb_host_t &host, const lcb::Authenticator &auth);
+    bool create_sasl_client(const lcbio_NAMEINFO &nistrs);
     void start(lcbio_SOCKET *sock);
     void send_list_mechs() const;
+    bool send_optimistic_auth();
+    bool fallback_to_list_mechs(uint16_t status);
+    void remember_mech() const;
     std::string generate_agent_json() const;
     bool send_hello();
     bool send_step(const lcb::MemcachedResponse &packet);
@@ -74,6 +78,8 @@ class lcb::SessionRequestImpl : public SessionRequest
     void send_auth(const char *sasl_data, unsigned ndata) const;
     void handle_read(lcbio_CTX *ioctx);
     bool maybe_select_bucket();
+    void pipeline_select_bucket();
+    void send_select_bucket();
 
     enum MechStatus { MECH_UNAVAILABLE, MECH_NOT_NEEDED, MECH_OK };
     MechStatus set_chosen_mech(std::string &mechlist, const char **data, unsigned int *ndata);
@@ -186,6 +192,13 @@ class lcb::SessionRequestImpl : public SessionRequest
     lcb_settings *settings;
     lcb_host_t host_{};
     bool expecting_error_map{false};
+    /** SASL_AUTH has been sent with the mechanism of the previous connection */
+    bool optimistic_auth{false};
+    bool select_pending{false};
+    /** SELECT_BUCKET has been sent before the reply for HELLO */
+    bool select_unverified{false};
+    /** SELECT_BUCKET has been sent with the rejected optimistic SASL_AUTH */
+    bool discard_select_reply{false};
 };
 
 static void handle_read(lcbio_CTX *ioctx, unsigned)
@@ -225,11 +238,6 @@ SessionInfo::SessionInfo() : lcbio_PROTOCTX()
 
 bool SessionRequestImpl::setup(const lcbio_NAMEINFO &nistrs, const lcb_host_t &host, const lcb::Authenticator &auth)
 {
-    cbsasl_callbacks_t sasl_callbacks;
-    sasl_callbacks.context = this;
-    sasl_callbacks.username = sasl_get_username;
-    sasl_callbacks.password = sasl_get_password;
-
     // Get the credentials
     host_ = host;
     auto creds = auth.credentials_for(LCBAUTH_SERVICE_KEY_VALUE, LCBAUTH_REASON_NEW_OPERATION, host_.host, host_.port,
@@ -248,8 +256,21 @@ bool SessionRequestImpl::setup(const lcbio_NAMEINFO &nistrs, const lcb_host_t &h
         }
     }
 
+    return create_sasl_client(nistrs);
+}
+
+bool SessionRequestImpl::create_sasl_client(const lcbio_NAMEINFO &nistrs)
+{
+    cbsasl_callbacks_t sasl_callbacks;
+    sasl_callbacks.context = this;
+    sasl_callbacks.username = sasl_get_username;
+    sasl_callbacks.password = sasl_get_password;
+
+    if (sasl_client) {
+        cbsasl_dispose(&sasl_client);
+    }
     cbsasl_error_t saslerr =
-        cbsasl_client_new("couchbase", host.host, nistrs.local, nistrs.remote, &sasl_callbacks, 0, &sasl_client);
+        cbsasl_client_new("couchbase", host_.host, nistrs.local, nistrs.remote, &sasl_callbacks, 0, &sasl_client);
     return saslerr == SASL_OK;
 }
 
@@ -369,6 +390,11 @@ bool SessionRequestImpl::send_step(const lcb::MemcachedResponse &packet)
     lcbio_ctx_put(ctx, info->mech.c_str(), info->mech.size());
     lcbio_ctx_put(ctx, step_data, ndata);
     lcbio_ctx_rwant(ctx, 24);
+    if (settings->optimistic_negotiation) {
+        // the server processes the commands in order, so the bucket will be
+        // selected right after the last step of authentication
+        maybe_select_bucket();
+    }
     return true;
 }
 
@@ -437,7 +463,7 @@ bool SessionRequestImpl::send_hello()
     if (settings->fetch_mutation_tokens) {
         features[nfeatures++] = PROTOCOL_BINARY_FEATURE_MUTATION_SEQNO;
     }
-    if (settings->use_tracing) {
+    if (settings->use_tracing || settings->pipeline_latency) {
         features[nfeatures++] = PROTOCOL_BINARY_FEATURE_TRACING;
     }
     if (settings->use_collections) {
@@ -482,6 +508,82 @@ void SessionRequestImpl::send_list_mechs() const
     LCBIO_CTX_RSCHEDULE(ctx, 24);
 }
 
+/**
+ * Starts authentication with the mechanism negotiated by the previous
+ * connection without waiting for SASL_LIST_MECHS.
+ * @return false if the regular negotiation should be used
+ */
+bool SessionRequestImpl::send_optimistic_auth()
+{
+    if (!settings->optimistic_negotiation || settings->sasl_mech_cached == nullptr) {
+        return false;
+    }
+
+    const char *data = nullptr;
+    unsigned int ndata = 0;
+    const char *chosenmech = nullptr;
+    cbsasl_error_t saslerr =
+        cbsasl_client_start(sasl_client, settings->sasl_mech_cached, nullptr, &data, &ndata, &chosenmech);
+    if (saslerr != SASL_OK) {
+        lcb_log(LOGARGS(this, DEBUG), LOGFMT "Unable to reuse SASL mechanism %s (%d)", LOGID(this),
+                settings->sasl_mech_cached, saslerr);
+        lcbio_NAMEINFO nistrs{};
+        lcbio_get_nameinfo(ctx->sock, &nistrs);
+        if (!create_sasl_client(nistrs)) {
+            set_error(LCB_ERR_SDK_INTERNAL, "Couldn't start SASL client");
+        }
+        return false;
+    }
+    lcb_log(LOGARGS(this, DEBUG), LOGFMT "Using %s SASL mechanism of the previous connection", LOGID(this),
+            chosenmech);
+    info->mech.assign(chosenmech);
+    optimistic_auth = true;
+    send_auth(data, ndata);
+    if (info->mech == MECH_PLAIN) {
+        pipeline_select_bucket();
+    }
+    return true;
+}
+
+/**
+ * The server has rejected the mechanism of the previous connection. Start
+ * over with a new SASL client and SASL_LIST_MECHS.
+ */
+bool SessionRequestImpl::fallback_to_list_mechs(uint16_t status)
+{
+    lcb_log(LOGARGS(this, INFO), LOGFMT "SASL AUTH with %s failed (status 0x%x), requesting list of mechanisms",
+            LOGID(this), info->mech.c_str(), status);
+    optimistic_auth = false;
+    free(settings->sasl_mech_cached);
+    settings->sasl_mech_cached = nullptr;
+    if (select_pending) {
+        select_pending = false;
+        discard_select_reply = true;
+    }
+    info->mech.clear();
+
+    lcbio_NAMEINFO nistrs{};
+    lcbio_get_nameinfo(ctx->sock, &nistrs);
+    if (!create_sasl_client(nistrs)) {
+        set_error(LCB_ERR_SDK_INTERNAL, "Couldn't start SASL client");
+        return false;
+    }
+    send_list_mechs();
+    return true;
+}
+
+void SessionRequestImpl::remember_mech() const
+{
+    if (!settings->optimistic_negotiation || info->mech.empty()) {
+        return;
+    }
+    if (settings->sasl_mech_cached != nullptr && info->mech == settings->sasl_mech_cached) {
+        return;
+    }
+    free(settings->sasl_mech_cached);
+    settings->sasl_mech_cached = lcb_strdup(info->mech.c_str());
+}
+
 bool SessionRequestImpl::read_hello(const lcb::MemcachedResponse &packet)
 {
     /* some caps */
@@ -537,6 +639,9 @@ bool SessionRequestImpl::update_errmap(const lcb::MemcachedResponse &packet)
 // Returns true if sending the SELECT_BUCKET command, false otherwise.
 bool SessionRequestImpl::maybe_select_bucket()
 {
+    if (select_pending) {
+        return true;
+    }
     if (settings->conntype != LCB_TYPE_BUCKET || settings->bucket == nullptr) {
         return false;
     }
@@ -550,7 +655,22 @@ bool SessionRequestImpl::maybe_select_bucket()
         return false;
     }
 
-    // send the SELECT_BUCKET command:
+    send_select_bucket();
+    return true;
+}
+
+// Sends SELECT_BUCKET before the server features are known (optimistic negotiation).
+void SessionRequestImpl::pipeline_select_bucket()
+{
+    if (settings->conntype != LCB_TYPE_BUCKET || settings->bucket == nullptr || !settings->select_bucket) {
+        return;
+    }
+    select_unverified = true;
+    send_select_bucket();
+}
+
+void SessionRequestImpl::send_select_bucket()
+{
     lcb_log(LOGARGS(this, DEBUG), LOGFMT "Sending SELECT_BUCKET \"%s\"", LOGID(this), settings->bucket);
     lcb::MemcachedRequest req(PROTOCOL_BINARY_CMD_SELECT_BUCKET);
     req.sizes(0, strlen(settings->bucket), 0);
@@ -558,7 +678,7 @@ bool SessionRequestImpl::maybe_select_bucket()
     info->bucket_name_.assign(settings->bucket);
     lcbio_ctx_put(ctx, info->bucket_name_.data(), info->bucket_name_.size());
     LCBIO_CTX_RSCHEDULE(ctx, 24);
-    return true;
+    select_pending = true;
 }
 
 static bool isUnsupported(uint16_t status)
@@ -594,6 +714,9 @@ GT_NEXT_PACKET:
             MechStatus mechrc = set_chosen_mech(mechs, &mechlist_data, &nmechlist_data);
             if (mechrc == MECH_OK) {
                 send_auth(mechlist_data, nmechlist_data);
+                if (settings->optimistic_negotiation && info->mech == MECH_PLAIN) {
+                    maybe_select_bucket();
+                }
             } else if (mechrc == MECH_UNAVAILABLE) {
                 // Do nothing - error already set
             } else {
@@ -604,10 +727,13 @@ GT_NEXT_PACKET:
 
         case PROTOCOL_BINARY_CMD_SASL_AUTH: {
             if (status == PROTOCOL_BINARY_RESPONSE_SUCCESS) {
+                remember_mech();
                 completed = !maybe_select_bucket();
                 break;
             } else if (status == PROTOCOL_BINARY_RESPONSE_AUTH_CONTINUE) {
                 send_step(resp);
+            } else if (optimistic_auth) {
+                fallback_to_list_mechs(status);
             } else {
                 set_error(LCB_ERR_AUTHENTICATION_FAILURE, "SASL AUTH failed", &resp);
                 break;
@@ -617,6 +743,7 @@ GT_NEXT_PACKET:
 
         case PROTOCOL_BINARY_CMD_SASL_STEP: {
             if (status == PROTOCOL_BINARY_RESPONSE_SUCCESS && check_auth(resp)) {
+                remember_mech();
                 completed = !maybe_select_bucket();
             } else {
                 lcb_log(LOGARGS(this, WARN), LOGFMT "SASL auth failed with STATUS=0x%x", LOGID(this), status);
@@ -669,6 +796,20 @@ GT_NEXT_PACKET:
         }
 
         case PROTOCOL_BINARY_CMD_SELECT_BUCKET: {
+            select_pending = false;
+            if (discard_select_reply) {
+                // reply to the command pipelined with the rejected SASL_AUTH
+                discard_select_reply = false;
+                break;
+            }
+            if (select_unverified && !info->has_feature(PROTOCOL_BINARY_FEATURE_SELECT_BUCKET) &&
+                (status == PROTOCOL_BINARY_RESPONSE_NOT_SUPPORTED ||
+                 status == PROTOCOL_BINARY_RESPONSE_UNKNOWN_COMMAND)) {
+                lcb_log(LOGARGS(this, DEBUG), LOGFMT "Server does not support SELECT_BUCKET", LOGID(this));
+                info->bucket_name_.clear();
+                completed = true;
+                break;
+            }
             switch (status) {
                 case PROTOCOL_BINARY_RESPONSE_SUCCESS:
                     completed = true;
@@ -767,13 +908,26 @@ void SessionRequestImpl::start(lcbio_SOCKET *sock)
 
     send_hello();
     if (settings->use_errmap) {
-        request_errmap();
-        expecting_error_map = true;
+        if (settings->optimistic_negotiation && settings->errmap->isLoaded()) {
+            lcb_log(LOGARGS(this, TRACE), LOGFMT "Reusing error map (version: %d, revision: %d)", LOGID(this),
+                    (int)settings->errmap->getVersion(), (int)settings->errmap->getRevision());
+        } else {
+            request_errmap();
+            expecting_error_map = true;
+        }
     } else {
         lcb_log(LOGARGS(this, TRACE), LOGFMT "GET_ERRORMAP disabled", LOGID(this));
     }
     if (!settings->keypath) {
-        send_list_mechs();
+        if (!send_optimistic_auth()) {
+            if (has_error()) {
+                lcbio_async_signal(timer);
+                return;
+            }
+            send_list_mechs();
+        }
+    } else if (settings->optimistic_negotiation) {
+        pipeline_select_bucket();
     }
     LCBIO_CTX_RSCHEDULE(ctx, 24);
 }
@@ -18,9 +18,9 @@
 #include "query_cache.hh"
 #include "n1ql-internal.h"
 
-lcb_QUERY_CACHE *lcb_n1qlcache_create(void)
+lcb_QUERY_CACHE *lcb_n1qlcache_create(const lcb_settings *settings)
 {
-    return new lcb_QUERY_CACHE{};
+    return new lcb_QUERY_CACHE{settings};
 }
 
 void lcb_n1qlcache_destroy(lcb_QUERY_CACHE *cache)
@@ -32,3 +32,97 @@ void lcb_n1qlcache_clear(lcb_QUERY_CACHE *cache)
 {
     cache->clear();
 }
+
+void lcb_QUERY_CACHE_::sync_shared(const lcbvb_CONFIG *config)
+{
+    if (!settings_->n1ql_shared_cache || config == nullptr) {
+        shared_.reset();
+        shared_cluster_.clear();
+        return;
+    }
+
+    std::vector<std::string> nodes;
+    for (unsigned ii = 0; ii < config->nsrv; ii++) {
+        if (config->servers[ii].authority) {
+            nodes.emplace_back(config->servers[ii].authority);
+        }
+    }
+    std::sort(nodes.begin(), nodes.end());
+    // plans prepared with and without enhanced prepared statements have different formats
+    std::string cluster =
+        (config->ccaps & LCBVB_CCAP_N1QL_ENHANCED_PREPARED_STATEMENTS) ? "enhanced:" : "legacy:";
+    for (const auto &node : nodes) {
+        cluster.append(node).append(",");
+    }
+    if (shared_ && cluster == shared_cluster_) {
+        return;
+    }
+    shared_ = lcb::n1ql::SharedPlanCache::attach(cluster);
+    shared_cluster_ = cluster;
+}
+
+namespace lcb
+{
+namespace n1ql
+{
+std::shared_ptr<SharedPlanCache> SharedPlanCache::attach(const std::string &cluster)
+{
+    static std::mutex registry_mutex;
+    static std::map<std::string, std::weak_ptr<SharedPlanCache>> registry;
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (auto it = registry.begin(); it != registry.end();) {
+        if (it->second.expired()) {
+            it = registry.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    std::shared_ptr<SharedPlanCache> cache = registry[cluster].lock();
+    if (!cache) {
+        cache = std::make_shared<SharedPlanCache>();
+        registry[cluster] = cache;
+    }
+    return cache;
+}
+
+bool SharedPlanCache::get(const std::string &key, std::string &planstr)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto m = by_name_.find(key);
+    if (m == by_name_.end()) {
+        return false;
+    }
+    lru_.splice(lru_.begin(), lru_, m->second);
+    planstr = m->second->second;
+    return true;
+}
+
+void SharedPlanCache::put(const std::string &key, const std::string &planstr, std::size_t capacity)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto m = by_name_.find(key);
+    if (m != by_name_.end()) {
+        m->second->second = planstr;
+        lru_.splice(lru_.begin(), lru_, m->second);
+        return;
+    }
+    while (!lru_.empty() && lru_.size() >= capacity) {
+        by_name_.erase(lru_.back().first);
+        lru_.pop_back();
+    }
+    lru_.emplace_front(key, planstr);
+    by_name_[key] = lru_.begin();
+}
+
+void SharedPlanCache::remove(const std::string &key)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto m = by_name_.find(key);
+    if (m != by_name_.end()) {
+        lru_.erase(m->second);
+        by_name_.erase(m);
+    }
+}
+} // namespace n1ql
+} // namespace lcb
@@ -27,8 +27,9 @@ extern "C" {
 #endif
 
 typedef struct lcb_QUERY_CACHE_ lcb_QUERY_CACHE;
+struct lcb_settings_st;
 
-lcb_QUERY_CACHE *lcb_n1qlcache_create(void);
+lcb_QUERY_CACHE *lcb_n1qlcache_create(const struct lcb_settings_st *settings);
 void lcb_n1qlcache_destroy(lcb_QUERY_CACHE *);
 void lcb_n1qlcache_clear(lcb_QUERY_CACHE *);
 
@@ -93,7 +93,8 @@ static lcb_STATUS query_schedule(lcb_INSTANCE *instance, lcb_QUERY_HANDLE_ *req)
             return LCB_ERR_INVALID_ARGUMENT;
         }
 
-        const Plan *cached = req->cache().get_entry(req->statement());
+        req->cache().sync_shared(LCBT_VBCONFIG(instance));
+        const Plan *cached = req->cache().get_entry(req->plan_key());
         if (cached != nullptr) {
             lcb_STATUS rc = req->apply_plan(*cached);
             if (rc != LCB_SUCCESS) {
@@ -101,7 +102,7 @@ static lcb_STATUS query_schedule(lcb_INSTANCE *instance, lcb_QUERY_HANDLE_ *req)
             }
         } else {
             lcb_log(LOGARGS2(instance, DEBUG), LOGFMT "No cached plan found. Issuing prepare", LOGID(req));
-            lcb_STATUS rc = req->request_plan();
+            lcb_STATUS rc = req->prepare_or_wait();
             if (rc != LCB_SUCCESS) {
                 return rc;
             }
@@ -138,6 +139,8 @@ lcb_STATUS lcb_query(lcb_INSTANCE *instance, void *cookie, const lcb_CMDQUERY *c
         return err;
     }
 
+    // encode options before copying, so the reused command encodes them only once
+    command->encoded_options();
     auto cmd = std::make_shared<lcb_CMDQUERY>(*command);
     cmd->cookie(cookie);
 
@@ -24,8 +24,16 @@
 #include <string>
 #include <map>
 #include <list>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <algorithm>
 
 #include "contrib/lcb-jsoncpp/lcb-jsoncpp.h"
+#include "settings.h"
+#include <libcouchbase/vbucket.h>
+
+struct lcb_QUERY_HANDLE_;
 
 class Plan
 {
@@ -37,26 +45,12 @@ class Plan
 
   public:
     /**
-     * Applies the plan to the output 'bodystr'. We don't assign the
-     * Json::Value directly, as this appears to be horribly slow. On my system
-     * an assignment took about 200ms!
-     * @param body The request body (e.g. lcb_QUERY_HANDLE_::json)
-     * @param[out] bodystr the actual request payload
+     * Members of the request body which refer to the plan (they replace the
+     * "statement" member)
      */
-    void apply_plan(Json::Value &body, std::string &bodystr) const
+    const std::string &encoded() const
     {
-        body.removeMember("statement");
-        bodystr = Json::FastWriter().write(body);
-
-        // Assume bodystr ends with '}'
-        size_t pos = bodystr.rfind('}');
-        bodystr.erase(pos);
-
-        if (!body.empty()) {
-            bodystr.append(",");
-        }
-        bodystr.append(planstr);
-        bodystr.append("}");
+        return planstr;
     }
 
   private:
@@ -77,20 +71,55 @@ class Plan
     }
 };
 
+namespace lcb
+{
+namespace n1ql
+{
+/**
+ * Plan storage shared by all instances connected to the same cluster. Unlike
+ * lcb_QUERY_CACHE, which is owned by a single instance, this one may be
+ * accessed from several threads, and therefore guarded by the mutex.
+ */
+class SharedPlanCache
+{
+  public:
+    /**
+     * Returns the cache for the given cluster, creating it if necessary. The
+     * cache lives as long as at least one instance holds a reference to it.
+     * @param cluster identity of the cluster (see lcb_QUERY_CACHE_::sync_shared)
+     */
+    static std::shared_ptr<SharedPlanCache> attach(const std::string &cluster);
+
+    bool get(const std::string &key, std::string &planstr);
+    void put(const std::string &key, const std::string &planstr, std::size_t capacity);
+    void remove(const std::string &key);
+
+  private:
+    std::mutex mutex_;
+    std::list<std::pair<std::string, std::string>> lru_;
+    std::map<std::string, decltype(lru_)::iterator> by_name_;
+};
+} // namespace n1ql
+} // namespace lcb
+
 /**
  * @private
  */
 // LRU Cache structure..
 struct lcb_QUERY_CACHE_ {
+    explicit lcb_QUERY_CACHE_(const lcb_settings *settings) : settings_(settings) {}
+
     ~lcb_QUERY_CACHE_()
     {
-        clear();
+        for (auto &ii : lru) {
+            delete ii;
+        }
     }
 
-    /** Maximum number of entries in LRU cache. This is fixed at 5000 */
-    static size_t max_size()
+    /** Maximum number of entries in LRU cache (LCB_CNTL_N1QL_CACHE_SIZE) */
+    std::size_t max_size() const
     {
-        return 5000;
+        return settings_->n1ql_cache_size;
     }
 
     /**
@@ -101,18 +130,12 @@ struct lcb_QUERY_CACHE_ {
      */
     const Plan &add_entry(const std::string &key, const Json::Value &json, bool include_encoded_plan = true)
     {
-        if (lru.size() == max_size()) {
-            // Purge entry from end
-            remove_entry(lru.back()->key);
+        Plan *plan = new Plan(key);
+        plan->set_plan(json, include_encoded_plan);
+        if (shared_) {
+            shared_->put(key, plan->planstr, max_size());
         }
-
-        // Remove old entry, if present
-        remove_entry(key);
-
-        lru.push_front(new Plan(key));
-        by_name[key] = lru.begin();
-        lru.front()->set_plan(json, include_encoded_plan);
-        return *lru.front();
+        return insert(plan);
     }
 
     /**
@@ -124,6 +147,14 @@ struct lcb_QUERY_CACHE_ {
     {
         auto m = by_name.find(key);
         if (m == by_name.end()) {
+            std::string planstr;
+            if (shared_ && shared_->get(key, planstr)) {
+                Plan *plan = new Plan(key);
+                plan->planstr = std::move(planstr);
+                stats_.hits++;
+                return &insert(plan);
+            }
+            stats_.misses++;
             return nullptr;
         }
 
@@ -133,24 +164,24 @@ struct lcb_QUERY_CACHE_ {
         lru.splice(lru.begin(), lru, m->second);
         // Note, updating of iterators is not required since splice doesn't
         // invalidate iterators.
+        stats_.hits++;
         return cur;
     }
 
     /** Removes an entry with the given key */
     void remove_entry(const std::string &key)
     {
-        auto m = by_name.find(key);
-        if (m == by_name.end()) {
-            return;
+        if (shared_) {
+            // the plan is stale for every instance
+            shared_->remove(key);
         }
-        // Remove entry from map
-        auto m2 = m->second;
-        delete *m2;
-        by_name.erase(m);
-        lru.erase(m2);
+        erase(key);
     }
 
-    /** Clears the LRU cache */
+    /**
+     * Clears the LRU cache, and detaches it from the shared cache. The plans
+     * in the shared cache belong to other instances as well, so they are kept.
+     */
     void clear()
     {
         for (auto &ii : lru) {
@@ -158,11 +189,139 @@ struct lcb_QUERY_CACHE_ {
         }
         lru.clear();
         by_name.clear();
+        shared_.reset();
+        shared_cluster_.clear();
+    }
+
+    /**
+     * Attaches the cache to (or detaches it from) the process-wide plan cache
+     * according to LCB_CNTL_N1QL_SHARED_CACHE. The cluster is identified by
+     * the set of its nodes in the given configuration.
+     */
+    void sync_shared(const lcbvb_CONFIG *config);
+
+    /**
+     * Registers the request as waiting for the plan of the given statement.
+     * @return true if the caller has to issue the PREPARE itself, false if
+     *  PREPARE for this statement is already in flight, and the request will
+     *  be notified when it completes
+     */
+    bool join_prepare(const std::string &key, lcb_QUERY_HANDLE_ *req)
+    {
+        auto &inflight = prepares_[key];
+        if (inflight.empty()) {
+            inflight.push_back(req);
+            return true;
+        }
+        inflight.push_back(req);
+        stats_.coalesced++;
+        return false;
+    }
+
+    /**
+     * Completes the in-flight PREPARE for the statement.
+     * @param req the request which issued PREPARE
+     * @return the requests which were waiting for the plan (except the one
+     *  which issued the PREPARE)
+     */
+    std::vector<lcb_QUERY_HANDLE_ *> finish_prepare(const std::string &key, lcb_QUERY_HANDLE_ *req)
+    {
+        std::vector<lcb_QUERY_HANDLE_ *> waiters;
+        auto m = prepares_.find(key);
+        if (m == prepares_.end() || m->second.front() != req) {
+            leave_prepare(key, req);
+            return waiters;
+        }
+        waiters.assign(m->second.begin() + 1, m->second.end());
+        prepares_.erase(m);
+        return waiters;
+    }
+
+    /**
+     * Unregisters the request (e.g. it was cancelled or timed out).
+     * @return the request which has to issue PREPARE instead of the leaving
+     *  one, or nullptr
+     */
+    lcb_QUERY_HANDLE_ *leave_prepare(const std::string &key, lcb_QUERY_HANDLE_ *req)
+    {
+        auto m = prepares_.find(key);
+        if (m == prepares_.end()) {
+            return nullptr;
+        }
+        auto &inflight = m->second;
+        auto it = std::find(inflight.begin(), inflight.end(), req);
+        if (it == inflight.end()) {
+            return nullptr;
+        }
+        bool was_leader = it == inflight.begin();
+        inflight.erase(it);
+        if (inflight.empty()) {
+            prepares_.erase(m);
+            return nullptr;
+        }
+        return was_leader ? inflight.front() : nullptr;
+    }
+
+    std::size_t size() const
+    {
+        return lru.size();
+    }
+
+    struct Stats {
+        std::uint64_t hits{0};
+        std::uint64_t misses{0};
+        std::uint64_t evictions{0};
+        std::uint64_t coalesced{0};
+    };
+
+    const Stats &stats() const
+    {
+        return stats_;
+    }
+
+    bool is_shared() const
+    {
+        return shared_ != nullptr;
     }
 
   private:
+    const Plan &insert(Plan *plan)
+    {
+        // Remove old entry, if present
+        erase(plan->key);
+
+        while (!lru.empty() && lru.size() >= max_size()) {
+            // Purge entry from end
+            erase(lru.back()->key);
+            stats_.evictions++;
+        }
+
+        lru.push_front(plan);
+        by_name[plan->key] = lru.begin();
+        return *plan;
+    }
+
+    void erase(const std::string &key)
+    {
+        auto m = by_name.find(key);
+        if (m == by_name.end()) {
+            return;
+        }
+        // Remove entry from map
+        auto m2 = m->second;
+        delete *m2;
+        by_name.erase(m);
+        lru.erase(m2);
+    }
+
+    const lcb_settings *settings_;
     std::list<Plan *> lru;
     std::map<std::string, decltype(lru)::iterator> by_name;
+    /** Requests waiting for PREPARE, the first one has issued it */
+    std::map<std::string, std::vector<lcb_QUERY_HANDLE_ *>> prepares_;
+    std::shared_ptr<lcb::n1ql::SharedPlanCache> shared_{};
+    std::string shared_cluster_{};
+    Stats stats_{};
 };
 
 #endif // LIBCOUCHBASE_N1QL_QUERY_CACHE_HH
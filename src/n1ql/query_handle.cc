@@ -83,13 +83,14 @@ static void prepare_rowcb(lcb_INSTANCE *instance, int, const lcb_RESPQUERY *row)
         // Insert plan into cache
         lcb_log(LOGARGS2(instance, DEBUG), LOGFMT "Got %sprepared statement. Inserting into cache and reissuing",
                 LOGID(origreq), eps ? "(enhanced) " : "");
-        const Plan &ent = origreq->cache().add_entry(origreq->statement(), prepared, !eps);
+        const Plan &ent = origreq->cache().add_entry(origreq->plan_key(), prepared, !eps);
 
-        // Issue the query with the newly prepared plan
-        lcb_STATUS rc = origreq->apply_plan(ent);
-        if (rc != LCB_SUCCESS) {
-            return origreq->fail_prepared(row, rc);
+        // Issue the query with the newly prepared plan, and resume the queries
+        // which were waiting for the same statement
+        for (auto *waiter : origreq->take_waiters()) {
+            waiter->resume_prepared(ent, row);
         }
+        origreq->resume_prepared(ent, row);
     }
 }
 
@@ -360,8 +361,8 @@ bool lcb_QUERY_HANDLE_::maybe_retry()
 
         // Let's see if we can actually retry. First remove the existing prepared
         // entry:
-        cache().remove_entry(statement_);
-        last_error_ = request_plan();
+        cache().remove_entry(plan_key_);
+        last_error_ = prepare_or_wait();
     } else {
         // re-issue original request body
         backoff_and_issue_http_request(LCB_MS2US(action.retry_after_ms));
@@ -471,8 +472,8 @@ lcb_STATUS lcb_QUERY_HANDLE_::request_plan()
 {
     Json::Value newbody(Json::objectValue);
     newbody["statement"] = "PREPARE " + statement_;
-    if (json.isMember("query_context") && json["query_context"].isString()) {
-        newbody["query_context"] = json["query_context"];
+    if (!query_context_.empty()) {
+        newbody["query_context"] = query_context_;
     }
     lcb_CMDQUERY newcmd;
     newcmd.callback(prepare_rowcb);
@@ -483,12 +484,90 @@ lcb_STATUS lcb_QUERY_HANDLE_::request_plan()
     return lcb_query(instance_, this, &newcmd);
 }
 
+lcb_STATUS lcb_QUERY_HANDLE_::prepare_or_wait()
+{
+    awaiting_plan_ = true;
+    if (!cache().join_prepare(plan_key_, this)) {
+        lcb_log(LOGARGS(this, DEBUG), LOGFMT "PREPARE for the statement is in flight. Waiting for the plan", LOGID(this));
+        return LCB_SUCCESS;
+    }
+    lcb_STATUS rc = request_plan();
+    if (rc != LCB_SUCCESS) {
+        // nobody could join yet
+        awaiting_plan_ = false;
+        cache().leave_prepare(plan_key_, this);
+    }
+    return rc;
+}
+
+std::vector<lcb_QUERY_HANDLE_ *> lcb_QUERY_HANDLE_::take_waiters()
+{
+    std::vector<lcb_QUERY_HANDLE_ *> waiters;
+    if (!awaiting_plan_) {
+        return waiters;
+    }
+    awaiting_plan_ = false;
+    waiters = cache().finish_prepare(plan_key_, this);
+    for (auto *waiter : waiters) {
+        waiter->awaiting_plan_ = false;
+    }
+    return waiters;
+}
+
+void lcb_QUERY_HANDLE_::leave_prepare()
+{
+    if (!awaiting_plan_ || instance_->n1ql_cache == nullptr) {
+        return;
+    }
+    awaiting_plan_ = false;
+    lcb_QUERY_HANDLE_ *next = cache().leave_prepare(plan_key_, this);
+    if (next == nullptr) {
+        return;
+    }
+    // The request which issued PREPARE has gone, pass the duty to the next one
+    lcb_STATUS rc = LCB_ERR_REQUEST_CANCELED;
+    if (!instance_->destroying) {
+        lcb_log(LOGARGS(next, DEBUG), LOGFMT "Re-issuing PREPARE abandoned by " LOGFMT, LOGID(next), LOGID(this));
+        rc = next->request_plan();
+    }
+    if (rc != LCB_SUCCESS) {
+        lcb_RESPQUERY resp{};
+        next->fail_prepared(&resp, rc);
+    }
+}
+
+void lcb_QUERY_HANDLE_::resume_prepared(const Plan &plan, const lcb_RESPQUERY *row)
+{
+    lcb_STATUS rc = apply_plan(plan);
+    if (rc != LCB_SUCCESS) {
+        fail_prepared(row, rc);
+    }
+}
+
 lcb_STATUS lcb_QUERY_HANDLE_::apply_plan(const Plan &plan)
 {
     lcb_log(LOGARGS(this, DEBUG), LOGFMT "Using prepared plan", LOGID(this));
-    std::string bodystr;
-    plan.apply_plan(json, bodystr);
-    return issue_htreq(bodystr);
+    return issue_htreq(encode_body(&plan));
+}
+
+std::string lcb_QUERY_HANDLE_::encode_body(const Plan *plan) const
+{
+    lcb::query_body_writer body(options_->prefix, statement_.size() + params_.size() + 128);
+    if (plan != nullptr) {
+        body.members(plan->encoded());
+    } else if (!options_->statement.isNull()) {
+        body.string_member("statement", statement_);
+    }
+    body.string_member("timeout", timeout_str_);
+    body.string_member("client_context_id", client_context_id_);
+    if (!query_context_.empty()) {
+        body.string_member("query_context", query_context_);
+    }
+    if (!creds_.isNull()) {
+        body.member("creds", Json::FastWriter().write(creds_));
+    }
+    body.members(params_);
+    return std::move(body.finish());
 }
 
 lcb_QUERY_HANDLE_::lcb_QUERY_HANDLE_(lcb_INSTANCE *obj, void *user_cookie, const lcb_CMDQUERY *cmd)
@@ -497,17 +576,14 @@ lcb_QUERY_HANDLE_::lcb_QUERY_HANDLE_(lcb_INSTANCE *obj, void *user_cookie, const
       use_multi_bucket_authentication_(cmd->use_multi_bucket_authentication()),
       timeout_timer_(instance_->iotable, this), backoff_timer_(instance_->iotable, this)
 {
-    if (cmd->is_query_json()) {
-        json = cmd->root();
-    } else {
-        std::string encoded = Json::FastWriter().write(cmd->root());
-        if (!Json::Reader().parse(encoded, json)) {
-            last_error_ = LCB_ERR_INVALID_ARGUMENT;
-            return;
-        }
+    options_ = cmd->encoded_options();
+    params_ = cmd->encoded_params();
+    if (cmd->columns()) {
+        columns_.reset(new lcb_COLUMN_BATCH(cmd->columns()));
     }
+
     if (cmd->has_explicit_scope_qualifier()) {
-        json["query_context"] = cmd->scope_qualifier();
+        query_context_ = cmd->scope_qualifier();
     } else if (cmd->has_scope()) {
         if (obj->settings->conntype != LCB_TYPE_BUCKET || obj->settings->bucket == nullptr) {
             lcb_log(LOGARGS(this, ERROR),
@@ -517,29 +593,38 @@ lcb_QUERY_HANDLE_::lcb_QUERY_HANDLE_(lcb_INSTANCE *obj, void *user_cookie, const
             last_error_ = LCB_ERR_INVALID_ARGUMENT;
             return;
         }
-        std::string scope_qualifier(obj->settings->bucket);
-        scope_qualifier += "." + cmd->scope();
-        json["query_context"] = scope_qualifier;
+        query_context_ = obj->settings->bucket;
+        query_context_ += "." + cmd->scope();
+    } else if (options_->query_context.isString()) {
+        query_context_ = options_->query_context.asString();
+    } else if (!options_->query_context.isNull()) {
+        last_error_ = LCB_ERR_INVALID_ARGUMENT;
+        return;
     }
 
-    const Json::Value &j_statement = json_const()["statement"];
+    const Json::Value &j_statement = options_->statement;
     if (j_statement.isString()) {
         statement_ = j_statement.asString();
     } else if (!j_statement.isNull()) {
         last_error_ = LCB_ERR_INVALID_ARGUMENT;
         return;
     }
+    if (query_context_.empty()) {
+        plan_key_ = statement_;
+    } else {
+        plan_key_ = query_context_ + "\n" + statement_;
+    }
 
     timeout = cmd->timeout_or_default_in_microseconds(LCBT_SETTING(obj, n1ql_timeout));
-    Json::Value &tmoval = json["timeout"];
+    const Json::Value &tmoval = options_->timeout;
     if (tmoval.isNull()) {
         char buf[64] = {0};
         sprintf(buf, "%uus", timeout);
-        tmoval = buf;
-        json["timeout"] = buf;
+        timeout_str_ = buf;
     } else if (tmoval.isString()) {
+        timeout_str_ = tmoval.asString();
         try {
-            auto tmo_ns = lcb_parse_golang_duration(tmoval.asString());
+            auto tmo_ns = lcb_parse_golang_duration(timeout_str_);
             timeout = std::chrono::duration_cast<std::chrono::microseconds>(tmo_ns).count();
         } catch (const lcb_duration_parse_error &) {
             last_error_ = LCB_ERR_INVALID_ARGUMENT;
@@ -550,30 +635,27 @@ lcb_QUERY_HANDLE_::lcb_QUERY_HANDLE_(lcb_INSTANCE *obj, void *user_cookie, const
         last_error_ = LCB_ERR_INVALID_ARGUMENT;
         return;
     }
-    const Json::Value &ccid = json["client_context_id"];
+    const Json::Value &ccid = options_->client_context_id;
     if (ccid.isNull()) {
         char buf[32];
         size_t nbuf = snprintf(buf, sizeof(buf), "%016" PRIx64, lcb_next_rand64());
         client_context_id_.assign(buf, nbuf);
-        json["client_context_id"] = client_context_id_;
     } else {
         client_context_id_ = ccid.asString();
     }
-    if (json.isMember("readonly") && json["readonly"].asBool()) {
-        idempotent_ = true;
-    }
+    idempotent_ = options_->readonly;
     timeout_timer_.rearm(timeout + LCBT_SETTING(obj, n1ql_grace_period));
 
     // Determine if we need to add more credentials.
     // Because N1QL multi-bucket auth will not work on server versions < 4.5
     // using JSON encoding, we need to only use the multi-bucket auth feature
     // if there are actually multiple credentials to employ.
+    creds_ = options_->creds;
     const lcb::Authenticator &auth = *instance_->settings->auth;
     if (auth.buckets().size() > 1 && cmd->use_multi_bucket_authentication()) {
         use_multi_bucket_authentication_ = true;
-        Json::Value &creds = json["creds"];
         auto ii = auth.buckets().begin();
-        if (!(creds.isNull() || creds.isArray())) {
+        if (!(creds_.isNull() || creds_.isArray())) {
             last_error_ = LCB_ERR_INVALID_ARGUMENT;
             return;
         }
@@ -581,7 +663,7 @@ lcb_QUERY_HANDLE_::lcb_QUERY_HANDLE_(lcb_INSTANCE *obj, void *user_cookie, const
             if (ii->second.empty()) {
                 continue;
             }
-            Json::Value &curCreds = creds.append(Json::Value(Json::objectValue));
+            Json::Value &curCreds = creds_.append(Json::Value(Json::objectValue));
             curCreds["user"] = ii->first;
             curCreds["pass"] = ii->second;
         }
@@ -614,6 +696,7 @@ lcb_QUERY_HANDLE_::~lcb_QUERY_HANDLE_()
         lcb_query_cancel(instance_, prepare_query_);
         delete prepare_query_;
     }
+    leave_prepare();
     timeout_timer_.release();
     if (backoff_timer_.is_armed()) {
         lcb_aspend_del(&instance_->pendops, LCB_PENDTYPE_COUNTER, nullptr);
@@ -626,6 +709,11 @@ void lcb_QUERY_HANDLE_::fail_prepared(const lcb_RESPQUERY *orig, lcb_STATUS err)
 {
     lcb_log(LOGARGS(this, ERROR), LOGFMT "Prepare failed!", LOGID(this));
 
+    // The queries waiting for the same PREPARE share its outcome
+    for (auto *waiter : take_waiters()) {
+        waiter->fail_prepared(orig, err);
+    }
+
     lcb_RESPQUERY newresp = *orig;
     newresp.rflags = LCB_RESP_F_FINAL;
     newresp.cookie = cookie_;
@@ -647,12 +735,12 @@ void lcb_QUERY_HANDLE_::on_backoff()
     delete parser_;
     parser_ = new lcb::jsparse::Parser(lcb::jsparse::Parser::MODE_N1QL, this);
     if (use_prepcache()) {
-        const Plan *cached = cache().get_entry(statement_);
+        const Plan *cached = cache().get_entry(plan_key_);
         if (cached != nullptr) {
             last_error_ = apply_plan(*cached);
         } else {
             lcb_log(LOGARGS(this, DEBUG), LOGFMT "No cached plan found. Issuing prepare", LOGID(this));
-            last_error_ = request_plan();
+            last_error_ = prepare_or_wait();
         }
         return;
     }
@@ -21,6 +21,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <chrono>
+#include <memory>
 
 #include <jsparse/parser.h>
 
@@ -87,13 +88,38 @@ struct lcb_QUERY_HANDLE_ : lcb::jsparse::Parser::Actions {
             const char *body = nullptr;
             std::size_t body_len = 0;
             lcb_resphttp_body(http_response_, &body, &body_len);
+            chunk_begin_ = body;
+            chunk_end_ = body + body_len;
             parser_->feed(body, body_len);
+            // the rows might reference the body, which is valid only during this call
+            flush_columns();
+            chunk_begin_ = chunk_end_ = nullptr;
         }
     }
 
-    const Json::Value &json_const() const
+    /**
+     * Decodes the row into the columnar batch
+     */
+    void append_columns(const lcb_IOV &row)
     {
-        return json;
+        const char *data = static_cast<const char *>(row.iov_base);
+        bool stable = data >= chunk_begin_ && data + row.iov_len <= chunk_end_;
+        if (!columns_->append(data, row.iov_len, stable)) {
+            last_error_ = LCB_ERR_PROTOCOL_ERROR;
+        } else if (columns_->full()) {
+            flush_columns();
+        }
+    }
+
+    void flush_columns()
+    {
+        if (columns_ == nullptr || columns_->rows() == 0) {
+            return;
+        }
+        lcb_RESPQUERY resp{};
+        resp.columns = columns_.get();
+        invoke_row(&resp, false);
+        columns_->clear();
     }
 
     lcb_QUERY_CACHE &cache() const
@@ -103,12 +129,34 @@ struct lcb_QUERY_HANDLE_ : lcb::jsparse::Parser::Actions {
 
     /**
      * Creates the sub-lcb_QUERY_HANDLE_ for the PREPARE statement. This inspects the
-     * current request (see ::json) and copies it so that we execute the
+     * current request (see ::options_) and copies it so that we execute the
      * PREPARE instead of the actual query.
      * @return see issue_htreq()
      */
     lcb_STATUS request_plan();
 
+    /**
+     * Issues PREPARE for the statement, unless another request is already
+     * preparing it. In the latter case this request waits for the plan and
+     * will be resumed (or failed) together with the one issuing PREPARE.
+     * @return see request_plan()
+     */
+    lcb_STATUS prepare_or_wait();
+
+    /**
+     * Stops waiting for the in-flight PREPARE (if this request is the one who
+     * issued it).
+     * @return the requests which were waiting for the same plan
+     */
+    std::vector<lcb_QUERY_HANDLE_ *> take_waiters();
+
+    /**
+     * Resumes the request waiting for PREPARE once the plan is available.
+     * @param plan The plan
+     * @param row The row of the PREPARE response, used to report errors
+     */
+    void resume_prepared(const Plan &plan, const lcb_RESPQUERY *row);
+
     /**
      * Use the plan to execute the given query, and issues the query
      * @param plan The plan itself
@@ -125,10 +173,15 @@ struct lcb_QUERY_HANDLE_ : lcb::jsparse::Parser::Actions {
 
     lcb_STATUS issue_htreq()
     {
-        std::string s = Json::FastWriter().write(json);
-        return issue_htreq(s);
+        return issue_htreq(encode_body(nullptr));
     }
 
+    /**
+     * Encodes the request body
+     * @param plan The prepared plan to use instead of the statement, or nullptr
+     */
+    std::string encode_body(const Plan *plan) const;
+
     void backoff_and_issue_http_request(uint32_t interval)
     {
         lcb_aspend_add(&instance_->pendops, LCB_PENDTYPE_COUNTER, nullptr);
@@ -185,6 +238,10 @@ struct lcb_QUERY_HANDLE_ : lcb::jsparse::Parser::Actions {
         resp.row = static_cast<const char *>(row.row.iov_base);
         resp.nrow = row.row.iov_len;
         rows_number_++;
+        if (columns_) {
+            append_columns(row.row);
+            return;
+        }
         invoke_row(&resp, false);
     }
 
@@ -220,6 +277,15 @@ struct lcb_QUERY_HANDLE_ : lcb::jsparse::Parser::Actions {
         return statement_;
     }
 
+    /**
+     * Key of the statement in the plan cache. The plan depends on the query
+     * context, so it is the part of the key.
+     */
+    const std::string &plan_key() const
+    {
+        return plan_key_;
+    }
+
     void *cookie()
     {
         return cookie_;
@@ -255,6 +321,7 @@ struct lcb_QUERY_HANDLE_ : lcb::jsparse::Parser::Actions {
             prepare_query_->cancel();
             prepare_query_ = nullptr;
         }
+        leave_prepare();
         callback_ = nullptr;
         return LCB_SUCCESS;
     }
@@ -287,10 +354,16 @@ struct lcb_QUERY_HANDLE_ : lcb::jsparse::Parser::Actions {
 
   private:
     void on_backoff();
+    void leave_prepare();
 
     const lcb_RESPHTTP *http_response_{nullptr};
     lcb_HTTP_HANDLE *http_request_{nullptr};
     lcb::jsparse::Parser *parser_{nullptr};
+    /** Rows decoded into columns, if the application has requested them */
+    std::unique_ptr<lcb_COLUMN_BATCH> columns_{};
+    /** HTTP body, which is being parsed at the moment */
+    const char *chunk_begin_{nullptr};
+    const char *chunk_end_{nullptr};
     void *cookie_{nullptr};
     lcb_QUERY_CALLBACK callback_{nullptr};
     lcb_INSTANCE *instance_{nullptr};
@@ -304,10 +377,18 @@ struct lcb_QUERY_HANDLE_ : lcb::jsparse::Parser::Actions {
     /** The PREPARE query itself */
     struct lcb_QUERY_HANDLE_ *prepare_query_{nullptr};
 
-    /** Request body as received from the application */
-    Json::Value json;
+    /** Request options as received from the application */
+    std::shared_ptr<const lcb::query_encoded_options> options_{};
+    /** Encoded positional and named parameters */
+    std::string params_{};
+    std::string timeout_str_{};
+    std::string query_context_{};
+    Json::Value creds_{};
     /** String of the original statement. Cached here to avoid jsoncpp lookups */
     std::string statement_;
+    std::string plan_key_;
+    /** Whether this request is registered as waiting for PREPARE in the cache */
+    bool awaiting_plan_{false};
     std::string client_context_id_;
     lcb::query_error first_error{};
 
@@ -605,6 +605,40 @@ nb_SIZE netbuf_start_flush(nb_MGR *mgr, nb_IOV *iovs, int niov, int *nused)
     return ret;
 }
 
+int netbuf_coalesce_iov(nb_IOV *iovs, int niov, char *scratch, nb_SIZE nscratch, nb_SIZE maxspan, nb_SIZE *ncopied)
+{
+    int ii = 0, nout = 0;
+    nb_SIZE used = 0;
+
+    while (ii < niov) {
+        int end = ii;
+        nb_SIZE run = 0;
+
+        while (end < niov && iovs[end].iov_len < maxspan && used + run + iovs[end].iov_len <= nscratch) {
+            run += iovs[end].iov_len;
+            end++;
+        }
+        if (end - ii < 2) {
+            iovs[nout++] = iovs[ii++];
+            continue;
+        }
+
+        /* copy first: the merged IOV may overwrite the first item of the run */
+        for (; ii < end; ii++) {
+            memcpy(scratch + used, iovs[ii].iov_base, iovs[ii].iov_len);
+            used += iovs[ii].iov_len;
+        }
+        iovs[nout].iov_base = scratch + used - run;
+        iovs[nout].iov_len = run;
+        nout++;
+    }
+
+    if (ncopied) {
+        *ncopied = used;
+    }
+    return nout;
+}
+
 void netbuf_end_flush(nb_MGR *mgr, unsigned int nflushed)
 {
     nb_SENDQ *q = &mgr->sendq;
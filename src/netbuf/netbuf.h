@@ -269,6 +269,26 @@ unsigned int netbuf_get_niov(nb_MGR *mgr);
  */
 nb_SIZE netbuf_start_flush(nb_MGR *mgr, nb_IOV *iovs, int niov, int *nused);
 
+/**
+ * @brief Merge runs of small adjacent IOVs into a single buffer
+ *
+ * IOVs returned by netbuf_start_flush() which are smaller than `maxspan` and
+ * follow each other are copied into `scratch`, and each run is replaced by a
+ * single IOV pointing into it. The IOVs still describe the same bytes, so the
+ * size returned by netbuf_start_flush() is unchanged. `scratch` must not be
+ * reused until the IOVs have been written.
+ *
+ * @param iovs the IOVs to merge. They are rewritten in place
+ * @param niov the number of IOVs used
+ * @param scratch the buffer to copy the small IOVs into
+ * @param nscratch the size of the buffer
+ * @param maxspan IOVs of this size or bigger are never copied
+ * @param[out] ncopied how many bytes have been copied (may be NULL)
+ *
+ * @return the number of IOVs after merging
+ */
+int netbuf_coalesce_iov(nb_IOV *iovs, int niov, char *scratch, nb_SIZE nscratch, nb_SIZE maxspan, nb_SIZE *ncopied);
+
 /**
  * @brief Indicate that a flush has completed.
  *
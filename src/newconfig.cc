@@ -308,6 +308,38 @@ static void replace_config(lcb_INSTANCE *instance, lcbvb_CONFIG *oldconfig, lcbv
     free(ppold);
 }
 
+/* Open connections to the query, search and analytics nodes in advance, so
+ * that the first requests do not pay for TCP (and TLS) handshakes. The pool
+ * keeps them open until the node leaves the cluster */
+static void warmup_http_pool(lcb_INSTANCE *instance, lcbvb_CONFIG *config)
+{
+    static const lcbvb_SVCTYPE services[] = {LCBVB_SVCTYPE_QUERY, LCBVB_SVCTYPE_SEARCH, LCBVB_SVCTYPE_ANALYTICS};
+    unsigned count = LCBT_SETTING(instance, http_warmup_connections);
+    std::vector<lcb_host_t> hosts;
+
+    if (count) {
+        for (size_t ii = 0; ii < LCBVB_NSERVERS(config); ++ii) {
+            for (auto service : services) {
+                const char *hp = lcbvb_get_hostport(config, ii, service, LCBT_SETTING_SVCMODE(instance));
+                if (hp == nullptr) {
+                    continue;
+                }
+                lcb_host_t host{};
+                if (lcb_host_parsez(&host, hp, LCB_CONFIG_HTTP_PORT) != LCB_SUCCESS) {
+                    continue;
+                }
+                hosts.push_back(host);
+            }
+        }
+    }
+
+    /* the hosts which are still in the configuration keep their backoff */
+    instance->http_sockpool->cancel_preconnect(hosts);
+    for (const auto &host : hosts) {
+        instance->http_sockpool->preconnect(host, count, LCBT_SETTING(instance, http_timeout));
+    }
+}
+
 void lcb_update_vbconfig(lcb_INSTANCE *instance, lcb_pCONFIGINFO config)
 {
     lcb::clconfig::ConfigInfo *old_config = instance->cur_configinfo;
@@ -342,6 +374,12 @@ void lcb_update_vbconfig(lcb_INSTANCE *instance, lcb_pCONFIGINFO config)
         mcreq_queue_add_pipelines(q, &servers[0], nservers, config->vbc);
     }
 
+    if (LCBT_SETTING(instance, kv_preconnect)) {
+        for (unsigned ii = 0; ii < q->npipelines; ii++) {
+            static_cast<lcb::Server *>(q->pipelines[ii])->preconnect();
+        }
+    }
+
     /* Update the list of nodes here for server list */
     instance->ht_nodes->clear();
     for (size_t ii = 0; ii < LCBVB_NSERVERS(config->vbc); ++ii) {
@@ -350,6 +388,7 @@ void lcb_update_vbconfig(lcb_INSTANCE *instance, lcb_pCONFIGINFO config)
             instance->ht_nodes->add(hp, LCB_CONFIG_HTTP_PORT);
         }
     }
+    warmup_http_pool(instance, config->vbc);
 
     lcb_maybe_breakout(instance);
 }
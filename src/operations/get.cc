@@ -148,7 +148,8 @@ static lcb_STATUS get_validate(lcb_INSTANCE *instance, const lcb_CMDGET *cmd)
     return LCB_SUCCESS;
 }
 
-static lcb_STATUS get_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDGET> cmd)
+static lcb_STATUS get_schedule(lcb_INSTANCE *instance, const lcb_CMDGET *cmd, void *cookie,
+                               std::uint32_t collection_id)
 {
     mc_PIPELINE *pl;
     mc_PACKET *pkt;
@@ -185,14 +186,14 @@ static lcb_STATUS get_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDGE
     }
 
     lcb_KEYBUF keybuf{LCB_KV_COPY, {cmd->key().c_str(), cmd->key().size()}};
-    err = mcreq_basic_packet(q, &keybuf, cmd->collection().collection_id(), &hdr, extlen, ffextlen, &pkt, &pl,
+    err = mcreq_basic_packet(q, &keybuf, collection_id, &hdr, extlen, ffextlen, &pkt, &pl,
                              MCREQ_BASICPACKET_F_FALLBACKOK);
     if (err != LCB_SUCCESS) {
         return err;
     }
 
     rdata = &pkt->u_rdata.reqdata;
-    rdata->cookie = cmd->cookie();
+    rdata->cookie = cookie;
     rdata->start = cmd->start_time_or_default_in_nanoseconds(gethrtime());
     rdata->deadline =
         rdata->start + cmd->timeout_or_default_in_nanoseconds(LCB_US2NS(LCBT_SETTING(instance, operation_timeout)));
@@ -231,11 +232,11 @@ static lcb_STATUS get_execute(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDGET
 {
     if (!LCBT_SETTING(instance, use_collections)) {
         /* fast path if collections are not enabled */
-        return get_schedule(instance, cmd);
+        return get_schedule(instance, cmd.get(), cmd->cookie(), cmd->collection().collection_id());
     }
 
     if (collcache_get(instance, cmd->collection()) == LCB_SUCCESS) {
-        return get_schedule(instance, cmd);
+        return get_schedule(instance, cmd.get(), cmd->cookie(), cmd->collection().collection_id());
     }
 
     return collcache_resolve(
@@ -260,7 +261,8 @@ static lcb_STATUS get_execute(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDGET
                 operation_callback(instance, callback_type, &response);
                 return;
             }
-            response.ctx.rc = get_schedule(instance, operation);
+            response.ctx.rc = get_schedule(instance, operation.get(), operation->cookie(),
+                                             operation->collection().collection_id());
             if (response.ctx.rc != LCB_SUCCESS) {
                 operation_callback(instance, callback_type, &response);
             }
@@ -277,10 +279,9 @@ lcb_STATUS lcb_get(lcb_INSTANCE *instance, void *cookie, const lcb_CMDGET *comma
         return rc;
     }
 
-    auto cmd = std::make_shared<lcb_CMDGET>(*command);
-    cmd->cookie(cookie);
-
     if (instance->cmdq.config == nullptr) {
+        auto cmd = std::make_shared<lcb_CMDGET>(*command);
+        cmd->cookie(cookie);
         cmd->start_time_in_nanoseconds(gethrtime());
         return lcb::defer_operation(instance, [instance, cmd](lcb_STATUS status) {
             const auto callback_type = LCB_CALLBACK_GET;
@@ -299,5 +300,15 @@ lcb_STATUS lcb_get(lcb_INSTANCE *instance, void *cookie, const lcb_CMDGET *comma
             }
         });
     }
+
+    std::uint32_t collection_id = command->collection().collection_id();
+    if (!LCBT_SETTING(instance, use_collections) ||
+        collcache_get(instance, command->collection(), &collection_id) == LCB_SUCCESS) {
+        /* the packet is built right away, so there is no need to keep a copy of the command */
+        return get_schedule(instance, command, cookie, collection_id);
+    }
+
+    auto cmd = std::make_shared<lcb_CMDGET>(*command);
+    cmd->cookie(cookie);
     return get_execute(instance, cmd);
 }
@@ -491,12 +491,12 @@ static void handle_http(lcb_INSTANCE *instance, lcb_PING_SERVICE type, const lcb
                 svc.status = LCB_PING_STATUS_ERROR;
                 break;
         }
-        lcbio_CTX *ctx = htreq->ioctx;
-        if (ctx) {
+        lcbio_SOCKET *sock = htreq->get_socket();
+        if (sock) {
             char id[20] = {0};
-            snprintf(id, sizeof(id), "%p", (void *)ctx->sock);
+            snprintf(id, sizeof(id), "%p", (void *)sock);
             svc.id = lcb_strdup(id);
-            svc.local = lcb_strdup(ctx->sock->info->ep_local_host_and_port);
+            svc.local = lcb_strdup(sock->info->ep_local_host_and_port);
         }
         ck->responses.push_back(svc);
     }
@@ -715,6 +715,62 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmddiag_prettify(lcb_CMDDIAG *cmd, int enable)
     return LCB_SUCCESS;
 }
 
+typedef std::vector<std::pair<lcb_U64, lcb_U32>> latency_buckets;
+
+static void collect_latency(const void *cookie, lcb_timeunit_t unit, lcb_U32, lcb_U32 max, lcb_U32 total, lcb_U32)
+{
+    lcb_U64 scale = 1;
+    switch (unit) {
+        case LCB_TIMEUNIT_USEC:
+            scale = 1000;
+            break;
+        case LCB_TIMEUNIT_MSEC:
+            scale = 1000000;
+            break;
+        case LCB_TIMEUNIT_SEC:
+            scale = 1000000000;
+            break;
+        default:
+            break;
+    }
+    /* upper bound of the bucket in nanoseconds */
+    static_cast<latency_buckets *>(const_cast<void *>(cookie))->emplace_back((lcb_U64)max * scale, total);
+}
+
+/* Summarizes LCB_CNTL_PIPELINE_LATENCY histogram with percentiles (upper bounds of the buckets) */
+static Json::Value latency_to_json(const lcb_HISTOGRAM *hg)
+{
+    latency_buckets buckets;
+    lcb_histogram_read(hg, &buckets, collect_latency);
+
+    lcb_U64 count = 0;
+    for (const auto &bucket : buckets) {
+        count += bucket.second;
+    }
+    Json::Value res;
+    res["count"] = (Json::Value::UInt64)count;
+    if (count == 0) {
+        return res;
+    }
+
+    static const struct {
+        const char *name;
+        double quantile;
+    } percentiles[] = {{"p50_us", 0.5}, {"p99_us", 0.99}, {"p999_us", 0.999}};
+    for (const auto &percentile : percentiles) {
+        lcb_U64 seen = 0;
+        for (const auto &bucket : buckets) {
+            seen += bucket.second;
+            if (seen >= percentile.quantile * count) {
+                res[percentile.name] = (Json::Value::UInt64)LCB_NS2US(bucket.first);
+                break;
+            }
+        }
+    }
+    res["max_us"] = (Json::Value::UInt64)LCB_NS2US(buckets.back().first);
+    return res;
+}
+
 LIBCOUCHBASE_API
 lcb_STATUS lcb_diag(lcb_INSTANCE *instance, void *cookie, const lcb_CMDDIAG *cmd)
 {
@@ -764,6 +820,11 @@ lcb_STATUS lcb_diag(lcb_INSTANCE *instance, void *cookie, const lcb_CMDDIAG *cmd
                 endpoint["last_activity_us"] =
                     (Json::Value::UInt64)(now > ctx->sock->atime ? now - ctx->sock->atime : 0);
                 endpoint["status"] = "connected";
+                if (server->metrics && server->metrics->queue_latency) {
+                    endpoint["latency"]["queue"] = latency_to_json(server->metrics->queue_latency);
+                    endpoint["latency"]["wire"] = latency_to_json(server->metrics->wire_latency);
+                    endpoint["latency"]["server"] = latency_to_json(server->metrics->server_latency);
+                }
                 root[lcbio_svcstr(ctx->sock->service)].append(endpoint);
             }
         }
@@ -777,26 +838,23 @@ lcb_STATUS lcb_diag(lcb_INSTANCE *instance, void *cookie, const lcb_CMDDIAG *cmd
         if ((pendq = instance->pendops.items[LCB_PENDTYPE_HTTP])) {
             for (it = pendq->begin(); it != pendq->end(); ++it) {
                 lcb::http::Request *htreq = reinterpret_cast<lcb::http::Request *>(*it);
-                lcbio_CTX *ctx = htreq->ioctx;
-                if (ctx) {
+                lcbio_SOCKET *sock = htreq->get_socket();
+                if (sock) {
                     Json::Value endpoint;
                     char id[20] = {0};
-                    snprintf(id, sizeof(id), "%016" PRIx64, ctx->sock ? ctx->sock->id : (lcb_U64)0);
+                    snprintf(id, sizeof(id), "%016" PRIx64, sock->id);
                     endpoint["id"] = id;
                     if (htreq->ipv6) {
                         endpoint["remote"] = "[" + std::string(htreq->host) + "]:" + std::string(htreq->port);
                     } else {
                         endpoint["remote"] = std::string(htreq->host) + ":" + std::string(htreq->port);
                     }
-                    if (ctx->sock) {
-                        if (ctx->sock->info) {
-                            endpoint["local"] = ctx->sock->info->ep_local_host_and_port;
-                        }
-                        endpoint["last_activity_us"] =
-                            (Json::Value::UInt64)(now > ctx->sock->atime ? now - ctx->sock->atime : 0);
-                        endpoint["status"] = "connected";
-                        root[lcbio_svcstr(ctx->sock->service)].append(endpoint);
+                    if (sock->info) {
+                        endpoint["local"] = sock->info->ep_local_host_and_port;
                     }
+                    endpoint["last_activity_us"] = (Json::Value::UInt64)(now > sock->atime ? now - sock->atime : 0);
+                    endpoint["status"] = "connected";
+                    root[lcbio_svcstr(sock->service)].append(endpoint);
                 }
             }
         }
@@ -188,6 +188,20 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_value_iov(lcb_CMDSTORE *cmd, const lcb_
     return cmd->value(value, value_len);
 }
 
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_value_borrowed(lcb_CMDSTORE *cmd, const char *value, size_t value_len)
+{
+    lcb_IOV iov;
+    iov.iov_base = const_cast<char *>(value);
+    iov.iov_len = value_len;
+    return cmd->value_borrowed(&iov, 1);
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_value_iov_borrowed(lcb_CMDSTORE *cmd, const lcb_IOV *value,
+                                                            size_t value_len)
+{
+    return cmd->value_borrowed(value, value_len);
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_expiry(lcb_CMDSTORE *cmd, uint32_t expiration)
 {
     return cmd->expiry(expiration);
@@ -374,7 +388,19 @@ static lcb_STATUS store_validate(lcb_INSTANCE *instance, const lcb_CMDSTORE *cmd
     return LCB_SUCCESS;
 }
 
-static lcb_STATUS store_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDSTORE> cmd)
+/**
+ * Borrowed values are released by the packet once it has been flushed. When the operation fails before the packet
+ * has been created, the application still has to learn that its buffers are not referenced anymore.
+ */
+static void release_borrowed_value(lcb_INSTANCE *instance, const std::shared_ptr<lcb_CMDSTORE> &cmd)
+{
+    if (cmd->value_is_borrowed()) {
+        instance->callbacks.pktflushed(instance, cmd->cookie());
+    }
+}
+
+static lcb_STATUS store_schedule(lcb_INSTANCE *instance, const lcb_CMDSTORE *cmd, void *cookie,
+                                 std::uint32_t collection_id)
 {
     lcb_STATUS err;
 
@@ -418,22 +444,39 @@ static lcb_STATUS store_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMD
     hdr.request.opcode = cmd->opcode();
     hdr.request.extlen = cmd->extras_size();
     lcb_KEYBUF keybuf{LCB_KV_COPY, {cmd->key().c_str(), cmd->key().size()}};
-    err = mcreq_basic_packet(cq, &keybuf, cmd->collection().collection_id(), &hdr, hdr.request.extlen, ffextlen,
-                             &packet, &pipeline, MCREQ_BASICPACKET_F_FALLBACKOK);
+    err = mcreq_basic_packet(cq, &keybuf, collection_id, &hdr, hdr.request.extlen, ffextlen, &packet, &pipeline,
+                             MCREQ_BASICPACKET_F_FALLBACKOK);
     if (err != LCB_SUCCESS) {
         return err;
     }
 
-    int should_compress = can_compress(instance, pipeline, cmd->value_is_compressed());
-    lcb_VALBUF valuebuf{LCB_KV_COPY, {{cmd->value().c_str(), cmd->value().size()}}};
-    if (should_compress) {
-        int rv = mcreq_compress_value(pipeline, packet, &valuebuf, instance->settings, &should_compress);
-        if (rv != 0) {
-            mcreq_release_packet(pipeline, packet);
-            return LCB_ERR_NO_MEMORY;
+    int should_compress = 0;
+    if (cmd->value_is_borrowed()) {
+        /* reference application memory, buf_done_callback will report when it is not used anymore */
+        const auto &borrowed = cmd->borrowed_value();
+        lcb_VALBUF valuebuf{};
+        if (borrowed.size() == 1) {
+            valuebuf.vtype = LCB_KV_CONTIG;
+            valuebuf.u_buf.contig.bytes = borrowed[0].iov_base;
+            valuebuf.u_buf.contig.nbytes = borrowed[0].iov_len;
+        } else {
+            valuebuf.vtype = LCB_KV_IOV;
+            valuebuf.u_buf.multi.iov = const_cast<lcb_IOV *>(borrowed.data());
+            valuebuf.u_buf.multi.niov = static_cast<unsigned int>(borrowed.size());
         }
-    } else {
         mcreq_reserve_value(pipeline, packet, &valuebuf);
+    } else {
+        should_compress = can_compress(instance, pipeline, cmd->value_is_compressed());
+        lcb_VALBUF valuebuf{LCB_KV_COPY, {{cmd->value().c_str(), cmd->value().size()}}};
+        if (should_compress) {
+            int rv = mcreq_compress_value(pipeline, packet, &valuebuf, instance->settings, &should_compress);
+            if (rv != 0) {
+                mcreq_release_packet(pipeline, packet);
+                return LCB_ERR_NO_MEMORY;
+            }
+        } else {
+            mcreq_reserve_value(pipeline, packet, &valuebuf);
+        }
     }
 
     if (cmd->need_poll_durability()) {
@@ -450,12 +493,12 @@ static lcb_STATUS store_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMD
             return err;
         }
 
-        auto *dctx = new DurStoreCtx(instance, persist_to, replicate_to, cmd->cookie());
+        auto *dctx = new DurStoreCtx(instance, persist_to, replicate_to, cookie);
         packet->u_rdata.exdata = dctx;
         packet->flags |= MCREQ_F_REQEXT;
     }
     mc_REQDATA *rdata = MCREQ_PKT_RDATA(packet);
-    rdata->cookie = cmd->cookie();
+    rdata->cookie = cookie;
     rdata->start = cmd->start_time_or_default_in_nanoseconds(gethrtime());
     rdata->deadline =
         rdata->start + cmd->timeout_or_default_in_nanoseconds(LCB_US2NS(LCBT_SETTING(instance, operation_timeout)));
@@ -509,11 +552,11 @@ static lcb_STATUS store_execute(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDS
 {
     if (!LCBT_SETTING(instance, use_collections)) {
         /* fast path if collections are not enabled */
-        return store_schedule(instance, cmd);
+        return store_schedule(instance, cmd.get(), cmd->cookie(), cmd->collection().collection_id());
     }
 
     if (collcache_get(instance, cmd->collection()) == LCB_SUCCESS) {
-        return store_schedule(instance, cmd);
+        return store_schedule(instance, cmd.get(), cmd->cookie(), cmd->collection().collection_id());
     }
 
     return collcache_resolve(
@@ -532,15 +575,19 @@ static lcb_STATUS store_execute(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDS
             if (status == LCB_ERR_SHEDULE_FAILURE || resp == nullptr) {
                 response.ctx.rc = LCB_ERR_TIMEOUT;
                 operation_callback(instance, callback_type, &response);
+                release_borrowed_value(instance, operation);
                 return;
             }
             if (resp->ctx.rc != LCB_SUCCESS) {
                 operation_callback(instance, callback_type, &response);
+                release_borrowed_value(instance, operation);
                 return;
             }
-            response.ctx.rc = store_schedule(instance, operation);
+            response.ctx.rc = store_schedule(instance, operation.get(), operation->cookie(),
+                                             operation->collection().collection_id());
             if (response.ctx.rc != LCB_SUCCESS) {
                 operation_callback(instance, callback_type, &response);
+                release_borrowed_value(instance, operation);
             }
         });
 }
@@ -554,10 +601,9 @@ LIBCOUCHBASE_API lcb_STATUS lcb_store(lcb_INSTANCE *instance, void *cookie, cons
         return rc;
     }
 
-    auto cmd = std::make_shared<lcb_CMDSTORE>(*command);
-    cmd->cookie(cookie);
-
     if (instance->cmdq.config == nullptr) {
+        auto cmd = std::make_shared<lcb_CMDSTORE>(*command);
+        cmd->cookie(cookie);
         cmd->start_time_in_nanoseconds(gethrtime());
         return lcb::defer_operation(instance, [instance, cmd](lcb_STATUS status) {
             const auto callback_type = LCB_CALLBACK_STORE;
@@ -568,13 +614,25 @@ LIBCOUCHBASE_API lcb_STATUS lcb_store(lcb_INSTANCE *instance, void *cookie, cons
             if (status == LCB_ERR_REQUEST_CANCELED) {
                 response.ctx.rc = status;
                 operation_callback(instance, callback_type, &response);
+                release_borrowed_value(instance, cmd);
                 return;
             }
             response.ctx.rc = store_execute(instance, cmd);
             if (response.ctx.rc != LCB_SUCCESS) {
                 operation_callback(instance, callback_type, &response);
+                release_borrowed_value(instance, cmd);
             }
         });
     }
+
+    std::uint32_t collection_id = command->collection().collection_id();
+    if (!LCBT_SETTING(instance, use_collections) ||
+        collcache_get(instance, command->collection(), &collection_id) == LCB_SUCCESS) {
+        /* the packet is built right away, so there is no need to keep a copy of the command */
+        return store_schedule(instance, command, cookie, collection_id);
+    }
+
+    auto cmd = std::make_shared<lcb_CMDSTORE>(*command);
+    cmd->cookie(cookie);
     return store_execute(instance, cmd);
 }
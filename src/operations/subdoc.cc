@@ -15,6 +15,7 @@
  *   limitations under the License.
  */
 #include "internal.h"
+#include "packetutils.h"
 #include "collections.h"
 #include <vector>
 #include <string>
@@ -28,22 +29,156 @@ LIBCOUCHBASE_API size_t lcb_respsubdoc_result_size(const lcb_RESPSUBDOC *resp)
     return resp->nres;
 }
 
+static const size_t SDENTRY_MISSING = static_cast<size_t>(-1);
+/* the entry would follow the truncated one */
+static const size_t SDENTRY_TRUNCATED = static_cast<size_t>(-2);
+
+/**
+ * Decode the entry which starts at the given offset of the response body.
+ *
+ * Lookup entries are laid out as status(2), length(4), value. Mutation responses only carry entries for the specs
+ * which produced a value or failed, prefixed with the spec index(1), and only successful entries have a value.
+ *
+ * @return offset of the following entry, or zero if the entry is truncated
+ */
+static size_t sdentry_decode(const lcb::MemcachedResponse *response, size_t offset, bool is_mutation, lcb_SDENTRY *ent)
+{
+    const char *buf = response->value() + offset;
+    size_t left = response->vallen() - offset;
+    size_t hdrlen = is_mutation ? 3 : 6;
+    if (left < hdrlen) {
+        return 0;
+    }
+
+    uint16_t rc;
+    uint32_t vlen = 0;
+    if (is_mutation) {
+        ent->index = *reinterpret_cast<const lcb_U8 *>(buf++);
+    }
+    memcpy(&rc, buf, sizeof(rc));
+    buf += sizeof(rc);
+    rc = ntohs(rc);
+    if (!is_mutation || rc == PROTOCOL_BINARY_RESPONSE_SUCCESS) {
+        if (is_mutation) {
+            hdrlen += sizeof(vlen);
+            if (left < hdrlen) {
+                return 0;
+            }
+        }
+        memcpy(&vlen, buf, sizeof(vlen));
+        buf += sizeof(vlen);
+        vlen = ntohl(vlen);
+    }
+    if (left - hdrlen < vlen) {
+        return 0;
+    }
+
+    ent->status = lcb_map_error(nullptr, rc);
+    if (ent->status == LCB_SUCCESS) {
+        ent->value = buf;
+        ent->nvalue = vlen;
+    } else {
+        ent->value = nullptr;
+        ent->nvalue = 0;
+    }
+    return offset + hdrlen + vlen;
+}
+
+/**
+ * Entries are decoded straight from the response buffer when the application asks for them. Reading the results in
+ * order only moves a cursor through the body, and the offsets of all entries are collected in a single pass the
+ * first time an entry before the cursor is requested.
+ */
+static const lcb_SDENTRY *sdresult_get(const lcb_RESPSUBDOC *resp, size_t index)
+{
+    if (index >= resp->nres || resp->responses == nullptr) {
+        return nullptr;
+    }
+    if (index == resp->cached_index) {
+        return &resp->cached;
+    }
+
+    const auto *response = static_cast<const lcb::MemcachedResponse *>(resp->responses);
+    bool is_mutation = response->opcode() == PROTOCOL_BINARY_CMD_SUBDOC_MULTI_MUTATION;
+    size_t body_size = response->vallen();
+    lcb_SDENTRY ent{};
+
+    if (index >= resp->next_index && resp->offsets.empty()) {
+        while (resp->next_offset < body_size) {
+            lcb_SDENTRY cur{};
+            size_t next = sdentry_decode(response, resp->next_offset, is_mutation, &cur);
+            if (next == 0) {
+                ent.status = LCB_ERR_PROTOCOL_ERROR;
+                break;
+            }
+            size_t cur_index = is_mutation ? cur.index : resp->next_index;
+            if (cur_index > index) {
+                /* the entry belongs to a later spec, keep it for the next call */
+                break;
+            }
+            resp->next_index = cur_index + 1;
+            resp->next_offset = next;
+            if (cur_index == index) {
+                ent = cur;
+                break;
+            }
+        }
+    } else {
+        if (resp->offsets.empty()) {
+            resp->offsets.assign(resp->nres, SDENTRY_MISSING);
+            size_t offset = 0;
+            /* index of the spec after the last decoded entry */
+            size_t next_index = 0;
+            for (size_t position = 0; offset < body_size; position++) {
+                lcb_SDENTRY cur{};
+                size_t next = sdentry_decode(response, offset, is_mutation, &cur);
+                if (next == 0) {
+                    /* same as the sequential access: the specs, which might follow the truncated entry, are failed */
+                    for (size_t ii = next_index; ii < resp->nres; ii++) {
+                        resp->offsets[ii] = SDENTRY_TRUNCATED;
+                    }
+                    break;
+                }
+                size_t cur_index = is_mutation ? cur.index : position;
+                if (cur_index < resp->nres) {
+                    resp->offsets[cur_index] = offset;
+                }
+                next_index = cur_index + 1;
+                offset = next;
+            }
+        }
+        if (resp->offsets[index] == SDENTRY_TRUNCATED) {
+            ent.status = LCB_ERR_PROTOCOL_ERROR;
+        } else if (resp->offsets[index] != SDENTRY_MISSING) {
+            sdentry_decode(response, resp->offsets[index], is_mutation, &ent);
+        }
+    }
+
+    /* mutation specs without a value are not present in the response */
+    ent.index = static_cast<lcb_U8>(index);
+    resp->cached_index = index;
+    resp->cached = ent;
+    return &resp->cached;
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_respsubdoc_result_status(const lcb_RESPSUBDOC *resp, size_t index)
 {
-    if (index >= resp->nres) {
+    const lcb_SDENTRY *ent = sdresult_get(resp, index);
+    if (ent == nullptr) {
         return LCB_ERR_OPTIONS_CONFLICT;
     }
-    return resp->res[index].status;
+    return ent->status;
 }
 
 LIBCOUCHBASE_API lcb_STATUS lcb_respsubdoc_result_value(const lcb_RESPSUBDOC *resp, size_t index, const char **value,
                                                         size_t *value_len)
 {
-    if (index >= resp->nres) {
+    const lcb_SDENTRY *ent = sdresult_get(resp, index);
+    if (ent == nullptr) {
         return LCB_ERR_OPTIONS_CONFLICT;
     }
-    *value = (const char *)resp->res[index].value;
-    *value_len = resp->res[index].nvalue;
+    *value = static_cast<const char *>(ent->value);
+    *value_len = ent->nvalue;
     return LCB_SUCCESS;
 }
 
@@ -588,6 +723,9 @@ static uint8_t make_doc_flags(const subdoc_options &options)
 
 static unsigned infer_mode(const lcb_SUBDOCSPECS &specs)
 {
+    if (specs.compiled()) {
+        return specs.compiled()->mode;
+    }
     if (specs.specs().empty()) {
         return 0;
     }
@@ -599,11 +737,11 @@ static unsigned infer_mode(const lcb_SUBDOCSPECS &specs)
 }
 
 struct MultiBuilder {
-    explicit MultiBuilder(std::shared_ptr<lcb_CMDSUBDOC> cmd) : cmd_(cmd)
+    explicit MultiBuilder(const lcb_SUBDOCSPECS &specs)
     {
-        mode_ = infer_mode(cmd_->specs());
-        size_t ebufsz = cmd->specs().specs().size() * (is_lookup() ? 4 : 8);
-        extra_body_ = new char[ebufsz];
+        mode_ = infer_mode(specs);
+        size_t ebufsz = specs.specs().size() * (is_lookup() ? 4 : 8);
+        extra_body_ = ebufsz > 0 ? new char[ebufsz] : nullptr;
     }
 
     ~MultiBuilder()
@@ -612,7 +750,6 @@ struct MultiBuilder {
     }
 
     // IOVs which are fed into lcb_VALBUF for subsequent use
-    std::shared_ptr<lcb_CMDSUBDOC> cmd_;
     std::vector<lcb_IOV> iovs_;
     char *extra_body_;
     size_t bodysz_{0};
@@ -716,8 +853,49 @@ struct MultiBuilder {
         }
         return LCB_SUCCESS;
     }
+
+    lcb_STATUS add_specs(const lcb_SUBDOCSPECS &specs)
+    {
+        for (const auto &spec : specs.specs()) {
+            lcb_STATUS rc = add_spec(spec);
+            if (rc != LCB_SUCCESS) {
+                return rc;
+            }
+        }
+        return LCB_SUCCESS;
+    }
 };
 
+LIBCOUCHBASE_API lcb_STATUS lcb_subdocspecs_compile(lcb_SUBDOCSPECS *operations)
+{
+    if (operations == nullptr) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    const lcb_SUBDOCSPECS &specs = *operations;
+    if (specs.compiled()) {
+        return LCB_SUCCESS;
+    }
+    if (specs.specs().empty()) {
+        return LCB_ERR_NO_COMMANDS;
+    }
+
+    MultiBuilder ctx(specs);
+    lcb_STATUS rc = ctx.add_specs(specs);
+    if (rc != LCB_SUCCESS) {
+        return rc;
+    }
+
+    auto compiled = std::make_shared<subdoc_compiled_specs>();
+    compiled->mode = ctx.mode_;
+    compiled->nspecs = specs.specs().size();
+    compiled->body.reserve(ctx.payload_size_);
+    for (const auto &iov : ctx.iovs_) {
+        compiled->body.append(static_cast<const char *>(iov.iov_base), iov.iov_len);
+    }
+    operations->compiled(std::move(compiled));
+    return LCB_SUCCESS;
+}
+
 static lcb_STATUS subdoc_validate(lcb_INSTANCE *instance, const lcb_CMDSUBDOC *cmd)
 {
     if (cmd->key().empty()) {
@@ -727,7 +905,7 @@ static lcb_STATUS subdoc_validate(lcb_INSTANCE *instance, const lcb_CMDSUBDOC *c
         /* only allow default collection when collections disabled for the instance */
         return LCB_ERR_SDK_FEATURE_UNAVAILABLE;
     }
-    if (cmd->specs().specs().empty()) {
+    if (cmd->specs().empty()) {
         return LCB_ERR_NO_COMMANDS;
     }
     if (!LCBT_SETTING(instance, enable_durable_write) && cmd->has_durability_requirements()) {
@@ -737,7 +915,8 @@ static lcb_STATUS subdoc_validate(lcb_INSTANCE *instance, const lcb_CMDSUBDOC *c
     return LCB_SUCCESS;
 }
 
-static lcb_STATUS subdoc_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDSUBDOC> cmd)
+static lcb_STATUS subdoc_schedule(lcb_INSTANCE *instance, const lcb_CMDSUBDOC *cmd, void *cookie,
+                                  std::uint32_t collection_id)
 {
     uint8_t docflags = make_doc_flags(cmd->options());
 
@@ -746,7 +925,8 @@ static lcb_STATUS subdoc_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CM
         return LCB_ERR_SDK_FEATURE_UNAVAILABLE;
     }
 
-    MultiBuilder ctx(cmd);
+    const auto &compiled = cmd->specs().compiled();
+    MultiBuilder ctx(cmd->specs());
 
     if ((cmd->has_expiry() || cmd->should_preserve_expiry()) && !ctx.is_mutate()) {
         return LCB_ERR_OPTIONS_CONFLICT;
@@ -754,12 +934,13 @@ static lcb_STATUS subdoc_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CM
 
     lcb_STATUS rc = LCB_SUCCESS;
 
-    for (const auto &spec : cmd->specs().specs()) {
-        rc = ctx.add_spec(spec);
+    if (!compiled) {
+        rc = ctx.add_specs(cmd->specs());
         if (rc != LCB_SUCCESS) {
             return rc;
         }
     }
+    std::size_t payload_size = compiled ? compiled->body.size() : ctx.payload_size_;
 
     mc_PIPELINE *pl;
     mc_PACKET *pkt;
@@ -815,7 +996,7 @@ static lcb_STATUS subdoc_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CM
     auto ffextlen = static_cast<std::uint8_t>(framing_extras.size());
 
     lcb_KEYBUF keybuf{LCB_KV_COPY, {cmd->key().c_str(), cmd->key().size()}};
-    rc = mcreq_basic_packet(&instance->cmdq, &keybuf, cmd->collection().collection_id(), &hdr, extlen, ffextlen, &pkt,
+    rc = mcreq_basic_packet(&instance->cmdq, &keybuf, collection_id, &hdr, extlen, ffextlen, &pkt,
                             &pl, MCREQ_BASICPACKET_F_FALLBACKOK);
 
     if (rc != LCB_SUCCESS) {
@@ -823,9 +1004,15 @@ static lcb_STATUS subdoc_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CM
     }
 
     lcb_VALBUF vb = {LCB_KV_IOVCOPY};
-    vb.u_buf.multi.iov = &ctx.iovs_[0];
-    vb.u_buf.multi.niov = ctx.iovs_.size();
-    vb.u_buf.multi.total_length = ctx.payload_size_;
+    if (compiled) {
+        vb.vtype = LCB_KV_COPY;
+        vb.u_buf.contig.bytes = compiled->body.data();
+        vb.u_buf.contig.nbytes = compiled->body.size();
+    } else {
+        vb.u_buf.multi.iov = &ctx.iovs_[0];
+        vb.u_buf.multi.niov = ctx.iovs_.size();
+        vb.u_buf.multi.total_length = ctx.payload_size_;
+    }
     rc = mcreq_reserve_value(pl, pkt, &vb);
 
     if (rc != LCB_SUCCESS) {
@@ -838,7 +1025,7 @@ static lcb_STATUS subdoc_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CM
     hdr.request.extlen = extlen;
     hdr.request.opaque = pkt->opaque;
     hdr.request.cas = lcb_htonll(cmd->cas());
-    hdr.request.bodylen = htonl(hdr.request.extlen + ffextlen + mcreq_get_key_size(&hdr) + ctx.payload_size_);
+    hdr.request.bodylen = htonl(hdr.request.extlen + ffextlen + mcreq_get_key_size(&hdr) + payload_size);
     memcpy(SPAN_BUFFER(&pkt->kh_span), hdr.bytes, sizeof(hdr.bytes));
 
     std::size_t offset = sizeof(hdr);
@@ -859,12 +1046,12 @@ static lcb_STATUS subdoc_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CM
         pkt->flags |= MCREQ_F_REPLACE_SEMANTICS;
     }
 
-    MCREQ_PKT_RDATA(pkt)->cookie = cmd->cookie();
+    MCREQ_PKT_RDATA(pkt)->cookie = cookie;
     MCREQ_PKT_RDATA(pkt)->start = cmd->start_time_or_default_in_nanoseconds(gethrtime());
     MCREQ_PKT_RDATA(pkt)->deadline =
         MCREQ_PKT_RDATA(pkt)->start +
         cmd->timeout_or_default_in_nanoseconds(LCB_US2NS(LCBT_SETTING(instance, operation_timeout)));
-    MCREQ_PKT_RDATA(pkt)->nsubreq = cmd->specs().specs().size();
+    MCREQ_PKT_RDATA(pkt)->nsubreq = cmd->specs().size();
     MCREQ_PKT_RDATA(pkt)->span = lcb::trace::start_kv_span(instance->settings, pkt, cmd);
     LCB_SCHED_ADD(instance, pl, pkt)
     return LCB_SUCCESS;
@@ -874,11 +1061,11 @@ static lcb_STATUS subdoc_execute(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMD
 {
     if (!LCBT_SETTING(instance, use_collections)) {
         /* fast path if collections are not enabled */
-        return subdoc_schedule(instance, cmd);
+        return subdoc_schedule(instance, cmd.get(), cmd->cookie(), cmd->collection().collection_id());
     }
 
     if (collcache_get(instance, cmd->collection()) == LCB_SUCCESS) {
-        return subdoc_schedule(instance, cmd);
+        return subdoc_schedule(instance, cmd.get(), cmd->cookie(), cmd->collection().collection_id());
     }
 
     return collcache_resolve(
@@ -905,7 +1092,8 @@ static lcb_STATUS subdoc_execute(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMD
                 operation_callback(instance, callback_type, &response);
                 return;
             }
-            response.ctx.rc = subdoc_schedule(instance, operation);
+            response.ctx.rc = subdoc_schedule(instance, operation.get(), operation->cookie(),
+                                             operation->collection().collection_id());
             if (response.ctx.rc != LCB_SUCCESS) {
                 operation_callback(instance, callback_type, &response);
             }
@@ -922,10 +1110,9 @@ lcb_STATUS lcb_subdoc(lcb_INSTANCE *instance, void *cookie, const lcb_CMDSUBDOC
         return err;
     }
 
-    auto cmd = std::make_shared<lcb_CMDSUBDOC>(*command);
-    cmd->cookie(cookie);
-
     if (instance->cmdq.config == nullptr) {
+        auto cmd = std::make_shared<lcb_CMDSUBDOC>(*command);
+        cmd->cookie(cookie);
         cmd->start_time_in_nanoseconds(gethrtime());
         return lcb::defer_operation(instance, [instance, cmd](lcb_STATUS status) {
             const auto callback_type =
@@ -945,5 +1132,15 @@ lcb_STATUS lcb_subdoc(lcb_INSTANCE *instance, void *cookie, const lcb_CMDSUBDOC
             }
         });
     }
+
+    std::uint32_t collection_id = command->collection().collection_id();
+    if (!LCBT_SETTING(instance, use_collections) ||
+        collcache_get(instance, command->collection(), &collection_id) == LCB_SUCCESS) {
+        /* the packet is built right away, so there is no need to keep a copy of the command */
+        return subdoc_schedule(instance, command, cookie, collection_id);
+    }
+
+    auto cmd = std::make_shared<lcb_CMDSUBDOC>(*command);
+    cmd->cookie(cookie);
     return subdoc_execute(instance, cmd);
 }
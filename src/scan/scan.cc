@@ -0,0 +1,297 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "internal.h"
+#include "collections.h"
+#include "defer.h"
+#include "scan/scan_handle.hh"
+
+LIBCOUCHBASE_API lcb_STATUS lcb_respscan_status(const lcb_RESPSCAN *resp)
+{
+    return resp->rc;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_respscan_cookie(const lcb_RESPSCAN *resp, void **cookie)
+{
+    *cookie = resp->cookie;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_respscan_key(const lcb_RESPSCAN *resp, const char **key, size_t *key_len)
+{
+    *key = resp->key;
+    *key_len = resp->nkey;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_respscan_value(const lcb_RESPSCAN *resp, const char **value, size_t *value_len)
+{
+    *value = resp->value;
+    *value_len = resp->nvalue;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_respscan_cas(const lcb_RESPSCAN *resp, uint64_t *cas)
+{
+    *cas = resp->cas;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_respscan_flags(const lcb_RESPSCAN *resp, uint32_t *flags)
+{
+    *flags = resp->flags;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_respscan_expiry(const lcb_RESPSCAN *resp, uint32_t *expiry)
+{
+    *expiry = resp->expiry;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_respscan_datatype(const lcb_RESPSCAN *resp, uint8_t *datatype)
+{
+    *datatype = resp->datatype;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_respscan_seqno(const lcb_RESPSCAN *resp, uint64_t *seqno)
+{
+    *seqno = resp->seqno;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_respscan_vbucket(const lcb_RESPSCAN *resp, uint16_t *vbid)
+{
+    *vbid = resp->vbid;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_respscan_handle(const lcb_RESPSCAN *resp, lcb_SCAN_HANDLE **handle)
+{
+    *handle = resp->handle;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API int lcb_respscan_is_final(const lcb_RESPSCAN *resp)
+{
+    return resp->rflags & LCB_RESP_F_FINAL;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdscan_create(lcb_CMDSCAN **cmd)
+{
+    *cmd = new lcb_CMDSCAN{};
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdscan_destroy(lcb_CMDSCAN *cmd)
+{
+    delete cmd;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdscan_callback(lcb_CMDSCAN *cmd, lcb_SCAN_CALLBACK callback)
+{
+    return cmd->callback(callback);
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdscan_collection(lcb_CMDSCAN *cmd, const char *scope, size_t scope_len,
+                                                   const char *collection, size_t collection_len)
+{
+    try {
+        lcb::collection_qualifier qualifier(scope, scope_len, collection, collection_len);
+        return cmd->collection(std::move(qualifier));
+    } catch (const std::invalid_argument &) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdscan_prefix(lcb_CMDSCAN *cmd, const char *prefix, size_t prefix_len)
+{
+    if (prefix == nullptr && prefix_len > 0) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    if (prefix_len == 0) {
+        /* all documents of the collection */
+        return cmd->range(std::string(1, '\0'), "\xf4\x8f\xbf\xbf");
+    }
+    return cmd->prefix(std::string(prefix, prefix_len));
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdscan_range(lcb_CMDSCAN *cmd, const char *start, size_t start_len, const char *end,
+                                              size_t end_len)
+{
+    if (start == nullptr || start_len == 0 || end == nullptr || end_len == 0) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    return cmd->range(std::string(start, start_len), std::string(end, end_len));
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdscan_sampling(lcb_CMDSCAN *cmd, uint64_t limit, uint64_t seed)
+{
+    return cmd->sampling(limit, seed);
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdscan_ids_only(lcb_CMDSCAN *cmd, int ids_only)
+{
+    return cmd->ids_only(ids_only != 0);
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdscan_concurrency(lcb_CMDSCAN *cmd, uint32_t vbuckets_per_node)
+{
+    return cmd->concurrency(vbuckets_per_node);
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdscan_batch_item_limit(lcb_CMDSCAN *cmd, uint32_t items)
+{
+    return cmd->batch_item_limit(items);
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdscan_batch_byte_limit(lcb_CMDSCAN *cmd, uint32_t bytes)
+{
+    return cmd->batch_byte_limit(bytes);
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdscan_resume_token(lcb_CMDSCAN *cmd, const char *token, size_t token_len)
+{
+    if (token == nullptr || token_len == 0) {
+        return cmd->resume_token(std::string());
+    }
+    return cmd->resume_token(std::string(token, token_len));
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdscan_timeout(lcb_CMDSCAN *cmd, uint32_t timeout)
+{
+    return cmd->timeout_in_microseconds(timeout);
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdscan_handle(lcb_CMDSCAN *cmd, lcb_SCAN_HANDLE **handle)
+{
+    return cmd->handle(handle);
+}
+
+static lcb_STATUS scan_validate(lcb_INSTANCE *instance, const lcb_CMDSCAN *cmd)
+{
+    if (cmd->callback() == nullptr) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    if (LCBT_SETTING(instance, conntype) != LCB_TYPE_BUCKET) {
+        return LCB_ERR_UNSUPPORTED_OPERATION;
+    }
+    if (!LCBT_SETTING(instance, use_collections) && !cmd->collection().is_default_collection()) {
+        /* only allow default collection when collections disabled for the instance */
+        return LCB_ERR_SDK_FEATURE_UNAVAILABLE;
+    }
+    return LCB_SUCCESS;
+}
+
+static lcb_STATUS scan_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDSCAN> cmd)
+{
+    auto *handle = new lcb_SCAN_HANDLE_(instance, cmd->cookie(), cmd.get());
+    if (cmd->handle() != nullptr) {
+        *cmd->handle() = handle;
+    }
+    lcb_STATUS rc = handle->start(cmd->collection().collection_id());
+    if (rc != LCB_SUCCESS) {
+        if (cmd->handle() != nullptr) {
+            *cmd->handle() = nullptr;
+        }
+        delete handle;
+    }
+    return rc;
+}
+
+static void scan_fail(lcb_INSTANCE *instance, const std::shared_ptr<lcb_CMDSCAN> &cmd, lcb_STATUS rc)
+{
+    lcb_RESPSCAN response{};
+    response.rc = rc;
+    response.cookie = cmd->cookie();
+    response.rflags = LCB_RESP_F_FINAL;
+    cmd->callback()(instance, LCB_CALLBACK_SCAN, &response);
+}
+
+static lcb_STATUS scan_execute(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDSCAN> cmd)
+{
+    if (!LCBT_SETTING(instance, use_collections)) {
+        /* fast path if collections are not enabled */
+        return scan_schedule(instance, cmd);
+    }
+
+    if (collcache_get(instance, cmd->collection()) == LCB_SUCCESS) {
+        return scan_schedule(instance, cmd);
+    }
+
+    return collcache_resolve(
+        instance, cmd,
+        [instance](lcb_STATUS status, const lcb_RESPGETCID *resp, std::shared_ptr<lcb_CMDSCAN> operation) {
+            if (status == LCB_ERR_SHEDULE_FAILURE || resp == nullptr) {
+                scan_fail(instance, operation, LCB_ERR_TIMEOUT);
+                return;
+            }
+            if (resp->ctx.rc != LCB_SUCCESS) {
+                scan_fail(instance, operation, resp->ctx.rc);
+                return;
+            }
+            lcb_STATUS rc = scan_schedule(instance, operation);
+            if (rc != LCB_SUCCESS) {
+                scan_fail(instance, operation, rc);
+            }
+        });
+}
+
+LIBCOUCHBASE_API
+lcb_STATUS lcb_scan(lcb_INSTANCE *instance, void *cookie, const lcb_CMDSCAN *command)
+{
+    lcb_STATUS rc = scan_validate(instance, command);
+    if (rc != LCB_SUCCESS) {
+        return rc;
+    }
+
+    auto cmd = std::make_shared<lcb_CMDSCAN>(*command);
+    cmd->cookie(cookie);
+
+    if (instance->cmdq.config == nullptr) {
+        return lcb::defer_operation(instance, [instance, cmd](lcb_STATUS status) {
+            if (status == LCB_ERR_REQUEST_CANCELED) {
+                scan_fail(instance, cmd, status);
+                return;
+            }
+            status = scan_execute(instance, cmd);
+            if (status != LCB_SUCCESS) {
+                scan_fail(instance, cmd, status);
+            }
+        });
+    }
+    return scan_execute(instance, cmd);
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_scan_cancel(lcb_INSTANCE *, lcb_SCAN_HANDLE *handle)
+{
+    if (handle == nullptr) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    handle->cancel();
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_scan_resume_token(lcb_SCAN_HANDLE *handle, const char **token, size_t *token_len)
+{
+    if (handle == nullptr || token == nullptr || token_len == nullptr) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    return handle->resume_token(token, token_len);
+}
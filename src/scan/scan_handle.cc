@@ -0,0 +1,517 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "internal.h"
+#include "scan/scan_handle.hh"
+#include "strcodecs/strcodecs.h"
+#include "contrib/lcb-jsoncpp/lcb-jsoncpp.h"
+
+#define LOGARGS(instance, lvl) (instance)->settings, "scan", LCB_LOG_##lvl, __FILE__, __LINE__
+
+using lcb::MemcachedResponse;
+
+static std::string to_base64(const std::string &input)
+{
+    char *out = nullptr;
+    std::size_t nout = 0;
+    if (lcb_base64_encode2(input.data(), input.size(), &out, &nout) != 0) {
+        return std::string();
+    }
+    std::string result(out, nout);
+    free(out);
+    return result;
+}
+
+static bool from_base64(const std::string &input, std::string &result)
+{
+    char *out = nullptr;
+    std::size_t nout = 0;
+    if (lcb_base64_decode2(input.data(), input.size(), &out, &nout) < 0) {
+        return false;
+    }
+    result.assign(out, nout);
+    free(out);
+    return true;
+}
+
+bool lcb::scan::read_leb128(const char *&ptr, const char *end, std::uint32_t &value)
+{
+    int nbytes = leb128_decode(reinterpret_cast<const std::uint8_t *>(ptr), end - ptr, &value);
+    if (nbytes <= 0) {
+        return false;
+    }
+    ptr += nbytes;
+    return true;
+}
+
+std::string lcb::scan::encode_resume_token(std::uint32_t collection_id, const std::vector<Progress> &progress)
+{
+    Json::Value token;
+    token["cid"] = collection_id;
+    token["vbuckets"] = static_cast<Json::UInt>(progress.size());
+    Json::Value &done = token["done"];
+    Json::Value &keys = token["keys"];
+    done = Json::arrayValue;
+    keys = Json::objectValue;
+    for (std::size_t vbid = 0; vbid < progress.size(); vbid++) {
+        if (progress[vbid].done) {
+            done.append(static_cast<Json::UInt>(vbid));
+        } else if (progress[vbid].has_last_key) {
+            keys[std::to_string(vbid)] = to_base64(progress[vbid].last_key);
+        }
+    }
+    return Json::FastWriter().write(token);
+}
+
+lcb_STATUS lcb::scan::decode_resume_token(const std::string &token, std::uint32_t collection_id,
+                                          std::vector<Progress> &progress)
+{
+    Json::Value root;
+    if (!Json::Reader().parse(token, root) || !root.isObject()) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    if (!root["cid"].isUInt() || root["cid"].asUInt() != collection_id || !root["vbuckets"].isUInt() ||
+        root["vbuckets"].asUInt() != progress.size()) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    const Json::Value &done = root["done"];
+    const Json::Value &keys = root["keys"];
+    if (!done.isArray() || !keys.isObject()) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    for (const auto &vbid : done) {
+        if (!vbid.isUInt() || vbid.asUInt() >= progress.size()) {
+            return LCB_ERR_INVALID_ARGUMENT;
+        }
+        progress[vbid.asUInt()].done = true;
+    }
+    for (auto it = keys.begin(); it != keys.end(); ++it) {
+        std::string name = it.name();
+        char *end = nullptr;
+        unsigned long vbid = strtoul(name.c_str(), &end, 10);
+        if (name.empty() || *end != '\0' || vbid >= progress.size() || !(*it).isString()) {
+            return LCB_ERR_INVALID_ARGUMENT;
+        }
+        if (!from_base64((*it).asString(), progress[vbid].last_key)) {
+            return LCB_ERR_INVALID_ARGUMENT;
+        }
+        progress[vbid].has_last_key = true;
+    }
+    return LCB_SUCCESS;
+}
+
+struct lcb_SCAN_HANDLE_::Request : mc_REQDATAEX {
+    Request(lcb_SCAN_HANDLE_ *scan_, std::uint16_t vbid_)
+        : mc_REQDATAEX(nullptr, lcb_SCAN_HANDLE_::procs, gethrtime()), scan(scan_), vbid(vbid_)
+    {
+    }
+
+    lcb_SCAN_HANDLE_ *scan;
+    std::uint16_t vbid;
+};
+
+const mc_REQDATAPROCS lcb_SCAN_HANDLE_::procs = {lcb_SCAN_HANDLE_::response_handler, lcb_SCAN_HANDLE_::fail_dtor};
+
+lcb_SCAN_HANDLE_::lcb_SCAN_HANDLE_(lcb_INSTANCE *instance, void *cookie, const lcb_CMDSCAN *cmd)
+    : instance_(instance), cookie_(cookie), cmd_(*cmd),
+      timeout_(cmd->timeout_or_default_in_nanoseconds(LCB_US2NS(LCBT_SETTING(instance, operation_timeout))))
+{
+    lcb_aspend_add(&instance_->pendops, LCB_PENDTYPE_COUNTER, nullptr);
+}
+
+lcb_SCAN_HANDLE_::~lcb_SCAN_HANDLE_()
+{
+    lcb_aspend_del(&instance_->pendops, LCB_PENDTYPE_COUNTER, nullptr);
+    lcb_maybe_breakout(instance_);
+}
+
+lcb_STATUS lcb_SCAN_HANDLE_::start(std::uint32_t collection_id)
+{
+    lcbvb_CONFIG *config = instance_->cmdq.config;
+    if (config == nullptr) {
+        return LCB_ERR_NO_CONFIGURATION;
+    }
+    if (lcbvb_get_distmode(config) != LCBVB_DIST_VBUCKET) {
+        return LCB_ERR_UNSUPPORTED_OPERATION;
+    }
+    collection_id_ = collection_id;
+
+    std::size_t nvb = lcbvb_get_nvbuckets(config);
+    partitions_.resize(nvb);
+    if (!cmd_.resume_token().empty()) {
+        if (cmd_.type() == lcb_CMDSCAN::SAMPLING) {
+            return LCB_ERR_INVALID_ARGUMENT;
+        }
+        std::vector<lcb::scan::Progress> progress(nvb);
+        lcb_STATUS rc = lcb::scan::decode_resume_token(cmd_.resume_token(), collection_id_, progress);
+        if (rc != LCB_SUCCESS) {
+            return rc;
+        }
+        for (std::size_t vbid = 0; vbid < nvb; vbid++) {
+            partitions_[vbid].progress = progress[vbid];
+        }
+    }
+
+    std::size_t npipelines = instance_->cmdq.npipelines;
+    queues_.resize(npipelines);
+    active_.resize(npipelines, 0);
+    for (std::size_t vbid = 0; vbid < nvb; vbid++) {
+        Partition &partition = partitions_[vbid];
+        if (partition.progress.done) {
+            partition.state = DONE;
+            continue;
+        }
+        int node = lcbvb_vbmaster(config, static_cast<int>(vbid));
+        if (node < 0 || static_cast<std::size_t>(node) >= npipelines) {
+            return LCB_ERR_NO_MATCHING_SERVER;
+        }
+        partition.node = node;
+        queues_[node].push_back(static_cast<std::uint16_t>(vbid));
+    }
+
+    started_ = true;
+    lcb_log(LOGARGS(instance_, DEBUG), "Starting %s scan of %d vBuckets, collection ID: 0x%x",
+            cmd_.type() == lcb_CMDSCAN::SAMPLING ? "sampling" : "range", (int)nvb, collection_id_);
+    lcb_sched_enter(instance_);
+    pump();
+    lcb_sched_leave(instance_);
+    /* might be already completed, if the resume token does not have anything left to scan */
+    maybe_finish();
+    return LCB_SUCCESS;
+}
+
+void lcb_SCAN_HANDLE_::cancel()
+{
+    if (cancelled_) {
+        return;
+    }
+    cancelled_ = true;
+    stopping_ = true;
+    /* the scans with the request in flight are cancelled when it completes */
+    for (std::size_t vbid = 0; vbid < partitions_.size(); vbid++) {
+        const Partition &partition = partitions_[vbid];
+        if (partition.state == CONTINUING && !partition.continuing && !partition.uuid.empty()) {
+            send_cancel(static_cast<std::uint16_t>(vbid));
+        }
+    }
+}
+
+lcb_STATUS lcb_SCAN_HANDLE_::resume_token(const char **token, std::size_t *token_len)
+{
+    if (cmd_.type() == lcb_CMDSCAN::SAMPLING) {
+        return LCB_ERR_UNSUPPORTED_OPERATION;
+    }
+    std::vector<lcb::scan::Progress> progress;
+    progress.reserve(partitions_.size());
+    for (const auto &partition : partitions_) {
+        progress.push_back(partition.progress);
+    }
+    token_ = lcb::scan::encode_resume_token(collection_id_, progress);
+    *token = token_.c_str();
+    *token_len = token_.size();
+    return LCB_SUCCESS;
+}
+
+void lcb_SCAN_HANDLE_::pump()
+{
+    for (std::size_t node = 0; node < queues_.size() && !stopping_; node++) {
+        auto &queue = queues_[node];
+        while (!stopping_ && !queue.empty() && active_[node] < cmd_.concurrency()) {
+            std::uint16_t vbid = queue.front();
+            queue.pop_front();
+            lcb_STATUS rc = send_create(vbid);
+            if (rc != LCB_SUCCESS) {
+                fail(rc);
+                break;
+            }
+            partitions_[vbid].state = CREATING;
+            active_[node]++;
+        }
+    }
+}
+
+lcb_STATUS lcb_SCAN_HANDLE_::send(std::uint16_t vbid, std::uint8_t opcode, const std::string &extras,
+                                  const std::string &body)
+{
+    mc_PIPELINE *pipeline = instance_->cmdq.pipelines[partitions_[vbid].node];
+    mc_PACKET *pkt = mcreq_allocate_packet(pipeline);
+    if (pkt == nullptr) {
+        return LCB_ERR_NO_MEMORY;
+    }
+    if (mcreq_reserve_header(pipeline, pkt, MCREQ_PKT_BASESIZE + extras.size()) != LCB_SUCCESS) {
+        mcreq_release_packet(pipeline, pkt);
+        return LCB_ERR_NO_MEMORY;
+    }
+    if (!body.empty()) {
+        if (mcreq_reserve_value2(pipeline, pkt, body.size()) != LCB_SUCCESS) {
+            mcreq_wipe_packet(pipeline, pkt);
+            mcreq_release_packet(pipeline, pkt);
+            return LCB_ERR_NO_MEMORY;
+        }
+        memcpy(SPAN_BUFFER(&pkt->u_value.single), body.data(), body.size());
+    }
+    /* the scan does not have a key, the collection is specified in the body of the create request */
+    pkt->flags |= MCREQ_F_NOCID | MCREQ_F_REQEXT;
+
+    protocol_binary_request_header hdr{};
+    hdr.request.magic = PROTOCOL_BINARY_REQ;
+    hdr.request.opcode = opcode;
+    hdr.request.datatype = body.empty() ? PROTOCOL_BINARY_RAW_BYTES : PROTOCOL_BINARY_DATATYPE_JSON;
+    hdr.request.extlen = static_cast<std::uint8_t>(extras.size());
+    hdr.request.vbucket = htons(vbid);
+    hdr.request.bodylen = htonl(static_cast<std::uint32_t>(extras.size() + body.size()));
+    hdr.request.opaque = pkt->opaque;
+    mcreq_write_hdr(pkt, &hdr);
+    if (!extras.empty()) {
+        memcpy(SPAN_BUFFER(&pkt->kh_span) + MCREQ_PKT_BASESIZE, extras.data(), extras.size());
+    }
+
+    auto *req = new Request(this, vbid);
+    req->deadline = req->start + timeout_;
+    pkt->u_rdata.exdata = req;
+    inflight_++;
+    LCB_SCHED_ADD(instance_, pipeline, pkt)
+    return LCB_SUCCESS;
+}
+
+lcb_STATUS lcb_SCAN_HANDLE_::send_create(std::uint16_t vbid)
+{
+    const lcb::scan::Progress &progress = partitions_[vbid].progress;
+    Json::Value body;
+    char cid[16];
+    snprintf(cid, sizeof(cid), "%x", collection_id_);
+    body["collection"] = cid;
+    if (cmd_.ids_only()) {
+        body["key_only"] = true;
+    }
+    if (cmd_.type() == lcb_CMDSCAN::SAMPLING) {
+        body["sampling"]["samples"] = static_cast<Json::UInt64>(cmd_.sample_limit());
+        body["sampling"]["seed"] = static_cast<Json::UInt64>(cmd_.sample_seed());
+    } else {
+        if (progress.has_last_key) {
+            /* continue after the last key which has been delivered */
+            body["range"]["excl_start"] = to_base64(progress.last_key);
+        } else {
+            body["range"]["start"] = to_base64(cmd_.start());
+        }
+        body["range"]["end"] = to_base64(cmd_.end());
+    }
+    return send(vbid, PROTOCOL_BINARY_CMD_RANGE_SCAN_CREATE, std::string(), Json::FastWriter().write(body));
+}
+
+lcb_STATUS lcb_SCAN_HANDLE_::send_continue(std::uint16_t vbid)
+{
+    std::string extras = partitions_[vbid].uuid;
+    std::uint32_t limits[3] = {htonl(cmd_.batch_item_limit()), 0 /* time limit */, htonl(cmd_.batch_byte_limit())};
+    extras.append(reinterpret_cast<const char *>(limits), sizeof(limits));
+    lcb_STATUS rc = send(vbid, PROTOCOL_BINARY_CMD_RANGE_SCAN_CONTINUE, extras, std::string());
+    if (rc == LCB_SUCCESS) {
+        partitions_[vbid].continuing = true;
+    }
+    return rc;
+}
+
+void lcb_SCAN_HANDLE_::send_cancel(std::uint16_t vbid)
+{
+    Partition &partition = partitions_[vbid];
+    partition.state = PENDING;
+    active_[partition.node]--;
+    if (send(vbid, PROTOCOL_BINARY_CMD_RANGE_SCAN_CANCEL, partition.uuid, std::string()) != LCB_SUCCESS) {
+        lcb_log(LOGARGS(instance_, WARN), "Unable to cancel range scan of vBucket %d", (int)vbid);
+    }
+}
+
+void lcb_SCAN_HANDLE_::response_handler(mc_PIPELINE *, mc_PACKET *pkt, lcb_CALLBACK_TYPE, lcb_STATUS rc,
+                                        const void *arg)
+{
+    auto *req = static_cast<Request *>(pkt->u_rdata.exdata);
+    const auto *response = static_cast<const MemcachedResponse *>(arg);
+    lcb_SCAN_HANDLE_ *scan = req->scan;
+    std::uint16_t vbid = req->vbid;
+
+    protocol_binary_request_header hdr;
+    mcreq_read_hdr(pkt, &hdr);
+    bool is_last = response == nullptr || hdr.request.opcode != PROTOCOL_BINARY_CMD_RANGE_SCAN_CONTINUE ||
+                   response->status() != PROTOCOL_BINARY_RESPONSE_SUCCESS;
+    if (is_last) {
+        delete req;
+        scan->inflight_--;
+    }
+
+    lcb_sched_enter(scan->instance_);
+    switch (hdr.request.opcode) {
+        case PROTOCOL_BINARY_CMD_RANGE_SCAN_CREATE:
+            scan->on_create(vbid, rc, response);
+            break;
+        case PROTOCOL_BINARY_CMD_RANGE_SCAN_CONTINUE:
+            scan->on_continue(vbid, rc, response, is_last);
+            break;
+        default:
+            break;
+    }
+    scan->pump();
+    lcb_sched_leave(scan->instance_);
+
+    if (is_last) {
+        scan->maybe_finish();
+    }
+}
+
+void lcb_SCAN_HANDLE_::fail_dtor(mc_PACKET *pkt)
+{
+    auto *req = static_cast<Request *>(pkt->u_rdata.exdata);
+    lcb_SCAN_HANDLE_ *scan = req->scan;
+    delete req;
+    scan->inflight_--;
+    scan->fail(LCB_ERR_SHEDULE_FAILURE);
+}
+
+void lcb_SCAN_HANDLE_::on_create(std::uint16_t vbid, lcb_STATUS rc, const MemcachedResponse *response)
+{
+    Partition &partition = partitions_[vbid];
+    if (rc == LCB_ERR_DOCUMENT_NOT_FOUND) {
+        /* nothing in the range */
+        partition_done(vbid);
+        return;
+    }
+    if (rc != LCB_SUCCESS || response == nullptr) {
+        partition.state = PENDING;
+        active_[partition.node]--;
+        fail(rc == LCB_SUCCESS ? LCB_ERR_PROTOCOL_ERROR : rc);
+        return;
+    }
+    partition.uuid.assign(response->value(), response->vallen());
+    if (stopping_) {
+        send_cancel(vbid);
+        return;
+    }
+    partition.state = CONTINUING;
+    rc = send_continue(vbid);
+    if (rc != LCB_SUCCESS) {
+        partition.state = PENDING;
+        active_[partition.node]--;
+        fail(rc);
+    }
+}
+
+void lcb_SCAN_HANDLE_::on_continue(std::uint16_t vbid, lcb_STATUS rc, const MemcachedResponse *response,
+                                   bool is_last)
+{
+    Partition &partition = partitions_[vbid];
+    if (is_last) {
+        partition.continuing = false;
+    }
+    if (rc == LCB_SUCCESS && response != nullptr && response->vallen() > 0) {
+        bool ok = lcb::scan::decode_items(response->value(), response->vallen(), cmd_.ids_only(),
+                                          [this, vbid](const lcb::scan::Item &item) { deliver(vbid, item); });
+        if (!ok) {
+            lcb_log(LOGARGS(instance_, ERROR), "Malformed range scan response for vBucket %d", (int)vbid);
+            fail(LCB_ERR_PROTOCOL_ERROR);
+        }
+    }
+    if (!is_last || partition.state != CONTINUING) {
+        /* the callback might have cancelled the scan already */
+        return;
+    }
+
+    if (rc != LCB_SUCCESS) {
+        partition.state = PENDING;
+        active_[partition.node]--;
+        if (!(stopping_ && rc == LCB_ERR_REQUEST_CANCELED)) {
+            fail(rc);
+        }
+        return;
+    }
+    if (response->status() == PROTOCOL_BINARY_RESPONSE_RANGE_SCAN_COMPLETE) {
+        partition_done(vbid);
+        return;
+    }
+    if (stopping_) {
+        send_cancel(vbid);
+        return;
+    }
+    rc = send_continue(vbid);
+    if (rc != LCB_SUCCESS) {
+        partition.state = PENDING;
+        active_[partition.node]--;
+        fail(rc);
+    }
+}
+
+void lcb_SCAN_HANDLE_::deliver(std::uint16_t vbid, const lcb::scan::Item &item)
+{
+    if (stopping_) {
+        return;
+    }
+    lcb_RESPSCAN resp{};
+    resp.rc = LCB_SUCCESS;
+    resp.cookie = cookie_;
+    resp.key = item.key;
+    resp.nkey = item.nkey;
+    resp.value = item.value;
+    resp.nvalue = item.nvalue;
+    resp.cas = item.cas;
+    resp.flags = item.flags;
+    resp.expiry = item.expiry;
+    resp.seqno = item.seqno;
+    resp.datatype = item.datatype;
+    resp.vbid = vbid;
+    resp.handle = this;
+
+    lcb::scan::Progress &progress = partitions_[vbid].progress;
+    progress.last_key.assign(item.key, item.nkey);
+    progress.has_last_key = true;
+    delivered_++;
+    cmd_.callback()(instance_, LCB_CALLBACK_SCAN, &resp);
+
+    if (cmd_.type() == lcb_CMDSCAN::SAMPLING && delivered_ >= cmd_.sample_limit()) {
+        stopping_ = true;
+    }
+}
+
+void lcb_SCAN_HANDLE_::partition_done(std::uint16_t vbid)
+{
+    Partition &partition = partitions_[vbid];
+    partition.state = DONE;
+    partition.progress.done = true;
+    active_[partition.node]--;
+}
+
+void lcb_SCAN_HANDLE_::fail(lcb_STATUS rc)
+{
+    if (last_error_ == LCB_SUCCESS) {
+        lcb_log(LOGARGS(instance_, WARN), "Stopping the scan: %s", lcb_strerror_short(rc));
+        last_error_ = rc;
+    }
+    stopping_ = true;
+}
+
+void lcb_SCAN_HANDLE_::maybe_finish()
+{
+    if (!started_ || inflight_ > 0) {
+        return;
+    }
+    if (!cancelled_) {
+        lcb_RESPSCAN resp{};
+        resp.rc = last_error_;
+        resp.cookie = cookie_;
+        resp.rflags = LCB_RESP_F_FINAL;
+        resp.handle = this;
+        cmd_.callback()(instance_, LCB_CALLBACK_SCAN, &resp);
+    }
+    delete this;
+}
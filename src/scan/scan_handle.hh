@@ -0,0 +1,209 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_SCAN_HANDLE_HH
+#define LCB_SCAN_HANDLE_HH
+
+#include <libcouchbase/couchbase.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "mc/mcreq.h"
+#include "capi/cmd_scan.hh"
+
+namespace lcb
+{
+class MemcachedResponse;
+
+namespace scan
+{
+/**
+ * Document (or only its key) decoded from the payload of the range scan
+ * continue response. Pointers refer to the payload.
+ */
+struct Item {
+    const char *key{nullptr};
+    std::size_t nkey{0};
+    const char *value{nullptr};
+    std::size_t nvalue{0};
+    std::uint32_t flags{0};
+    std::uint32_t expiry{0};
+    std::uint64_t seqno{0};
+    std::uint64_t cas{0};
+    std::uint8_t datatype{0};
+};
+
+/**
+ * Decodes the items of the range scan continue response. Every key is
+ * prefixed with its length (LEB128), and unless the scan returns only the
+ * keys, the key is preceded by the fixed metadata (flags, expiry, seqno, cas
+ * and datatype), and followed by the value, prefixed with its length.
+ *
+ * @return false if the payload is malformed. The items decoded before the
+ *  error have been passed to the handler already.
+ */
+template <typename Handler>
+bool decode_items(const char *payload, std::size_t npayload, bool ids_only, Handler &&handler);
+
+/** Progress of the single vBucket, which is preserved in the resume token */
+struct Progress {
+    bool done{false};
+    /** The last key, which has been delivered to the application */
+    std::string last_key{};
+    bool has_last_key{false};
+};
+
+/**
+ * Serializes progress of the scan to the opaque string, which can be used
+ * to continue the scan later.
+ */
+std::string encode_resume_token(std::uint32_t collection_id, const std::vector<Progress> &progress);
+
+/**
+ * @return LCB_ERR_INVALID_ARGUMENT if the token is malformed, or belongs to
+ *  the different collection or number of vBuckets
+ */
+lcb_STATUS decode_resume_token(const std::string &token, std::uint32_t collection_id, std::vector<Progress> &progress);
+
+bool read_leb128(const char *&ptr, const char *end, std::uint32_t &value);
+} // namespace scan
+} // namespace lcb
+
+/**
+ * @private
+ *
+ * Scans every vBucket with range scan create/continue requests. The number
+ * of the vBuckets, which are scanned at the same time on single node, is
+ * limited by the concurrency of the command. The handle destroys itself
+ * when the last request has been completed.
+ */
+struct lcb_SCAN_HANDLE_ {
+    lcb_SCAN_HANDLE_(lcb_INSTANCE *instance, void *cookie, const lcb_CMDSCAN *cmd);
+    ~lcb_SCAN_HANDLE_();
+
+    lcb_STATUS start(std::uint32_t collection_id);
+    void cancel();
+    lcb_STATUS resume_token(const char **token, std::size_t *token_len);
+
+  private:
+    enum State { PENDING, CREATING, CONTINUING, DONE };
+
+    struct Partition {
+        State state{PENDING};
+        /** Index of the node, which owns the vBucket */
+        std::size_t node{0};
+        /** Identifier of the scan on the server */
+        std::string uuid{};
+        /** Whether the continue request is in flight */
+        bool continuing{false};
+        lcb::scan::Progress progress{};
+    };
+
+    struct Request;
+
+    static void response_handler(mc_PIPELINE *pipeline, mc_PACKET *pkt, lcb_CALLBACK_TYPE, lcb_STATUS rc,
+                                 const void *arg);
+    static void fail_dtor(mc_PACKET *pkt);
+    static const mc_REQDATAPROCS procs;
+
+    void pump();
+    lcb_STATUS send(std::uint16_t vbid, std::uint8_t opcode, const std::string &extras, const std::string &body);
+    lcb_STATUS send_create(std::uint16_t vbid);
+    lcb_STATUS send_continue(std::uint16_t vbid);
+    void send_cancel(std::uint16_t vbid);
+    void on_create(std::uint16_t vbid, lcb_STATUS rc, const lcb::MemcachedResponse *response);
+    void on_continue(std::uint16_t vbid, lcb_STATUS rc, const lcb::MemcachedResponse *response, bool is_last);
+    void deliver(std::uint16_t vbid, const lcb::scan::Item &item);
+    void partition_done(std::uint16_t vbid);
+    void fail(lcb_STATUS rc);
+    void maybe_finish();
+
+    lcb_INSTANCE *instance_;
+    void *cookie_;
+    lcb_CMDSCAN cmd_;
+    std::uint32_t collection_id_{0};
+    std::uint64_t timeout_;
+
+    std::vector<Partition> partitions_{};
+    /** vBuckets waiting to be scanned, grouped by the node */
+    std::vector<std::deque<std::uint16_t>> queues_{};
+    std::vector<std::uint32_t> active_{};
+    std::size_t inflight_{0};
+    std::uint64_t delivered_{0};
+
+    bool started_{false};
+    /** No more vBuckets should be started, because of the error or limit */
+    bool stopping_{false};
+    bool cancelled_{false};
+    lcb_STATUS last_error_{LCB_SUCCESS};
+    std::string token_{};
+};
+
+template <typename Handler>
+bool lcb::scan::decode_items(const char *payload, std::size_t npayload, bool ids_only, Handler &&handler)
+{
+    static const std::size_t meta_size = 4 + 4 + 8 + 8 + 1;
+    const char *ptr = payload;
+    const char *end = payload + npayload;
+
+    while (ptr < end) {
+        Item item;
+        if (!ids_only) {
+            if (static_cast<std::size_t>(end - ptr) < meta_size) {
+                return false;
+            }
+            std::uint32_t u32;
+            std::uint64_t u64;
+            memcpy(&u32, ptr, sizeof(u32));
+            item.flags = ntohl(u32);
+            memcpy(&u32, ptr + 4, sizeof(u32));
+            item.expiry = ntohl(u32);
+            memcpy(&u64, ptr + 8, sizeof(u64));
+            item.seqno = lcb_ntohll(u64);
+            memcpy(&u64, ptr + 16, sizeof(u64));
+            item.cas = lcb_ntohll(u64);
+            item.datatype = static_cast<std::uint8_t>(ptr[24]);
+            ptr += meta_size;
+        }
+
+        std::uint32_t len = 0;
+        if (!read_leb128(ptr, end, len) || static_cast<std::size_t>(end - ptr) < len) {
+            return false;
+        }
+        item.key = ptr;
+        item.nkey = len;
+        ptr += len;
+
+        if (!ids_only) {
+            if (!read_leb128(ptr, end, len) || static_cast<std::size_t>(end - ptr) < len) {
+                return false;
+            }
+            item.value = ptr;
+            item.nvalue = len;
+            ptr += len;
+        }
+        handler(item);
+    }
+    return true;
+}
+
+#endif
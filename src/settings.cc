@@ -17,6 +17,7 @@
 
 #include "settings.h"
 #include <lcbio/ssl.h>
+#include <lcbio/resolver.h>
 #include <rdb/rope.h>
 
 LCB_INTERNAL_API
@@ -85,6 +86,18 @@ void lcb_default_settings(lcb_settings *settings)
     settings->use_errmap = 1;
     settings->op_metrics_flush_interval = LCB_DEFAULT_OP_METRICS_FLUSH_INTERVAL;
     settings->op_metrics_enabled = 1;
+    settings->tracer_sample_rate = (float)LCBTRACE_DEFAULT_SAMPLE_RATE;
+    settings->tracer_tail_based = 0;
+    settings->http_warmup_connections = 0;
+    settings->enable_http2 = 0;
+    settings->n1ql_cache_size = LCB_DEFAULT_N1QL_CACHE_SIZE;
+    settings->n1ql_shared_cache = 0;
+    settings->optimistic_negotiation = 0;
+    settings->tls_session_cache = 1;
+    settings->enable_ktls = 0;
+    settings->pipeline_latency = 0;
+    settings->dns_cache_ttl = LCB_DEFAULT_DNS_CACHE_TTL;
+    settings->kv_preconnect = 0;
 }
 
 LCB_INTERNAL_API
@@ -106,6 +119,7 @@ void lcb_settings_unref(lcb_settings *settings)
     }
     free(settings->bucket);
     free(settings->sasl_mech_force);
+    free(settings->sasl_mech_cached);
     free(settings->certpath);
     free(settings->keypath);
     free(settings->client_string);
@@ -117,6 +131,7 @@ void lcb_settings_unref(lcb_settings *settings)
     if (settings->ssl_ctx) {
         lcbio_ssl_free(settings->ssl_ctx);
     }
+    delete settings->resolver;
     if (settings->metrics) {
         lcb_metrics_destroy(settings->metrics);
     }
@@ -54,6 +54,7 @@
 
 #define LCB_DEFAULT_VIEW_TIMEOUT LCB_MS2US(75000)
 #define LCB_DEFAULT_N1QL_TIMEOUT LCB_MS2US(75000)
+#define LCB_DEFAULT_N1QL_CACHE_SIZE 5000
 #define LCB_DEFAULT_ANALYTICS_TIMEOUT LCB_MS2US(75000)
 #define LCB_DEFAULT_SEARCH_TIMEOUT LCB_MS2US(75000)
 #define LCB_DEFAULT_DURABILITY_TIMEOUT LCB_MS2US(5000)
@@ -110,10 +111,13 @@
 #define LCBTRACE_DEFAULT_THRESHOLD_FTS LCB_MS2US(1000)
 #define LCBTRACE_DEFAULT_THRESHOLD_ANALYTICS LCB_MS2US(1000)
 
+#define LCBTRACE_DEFAULT_SAMPLE_RATE 1.0
 #define LCB_DEFAULT_OP_METRICS_FLUSH_INTERVAL LCB_MS2US(600000)
 
 #define LCB_DEFAULT_PERSISTENCE_TIMEOUT_FLOOR 1500000
 
+#define LCB_DEFAULT_DNS_CACHE_TTL LCB_S2US(60)
+
 #include "config.h"
 #include <libcouchbase/couchbase.h>
 #include <libcouchbase/metrics.h>
@@ -122,7 +126,17 @@
 #include <libcouchbase/tracing.h>
 
 #ifdef __cplusplus
+namespace lcb
+{
+namespace io
+{
+class Resolver;
+} // namespace io
+} // namespace lcb
+typedef lcb::io::Resolver *lcbio_pRESOLVER;
 extern "C" {
+#else
+typedef struct lcbio_RESOLVER *lcbio_pRESOLVER;
 #endif
 
 struct lcbio_SSLCTX;
@@ -234,6 +248,34 @@ typedef struct lcb_settings_st {
     char *network; /** network resolution, AKA "Multi Network Configurations" */
     lcb_U32 op_metrics_flush_interval;
     unsigned op_metrics_enabled : 1;
+    /** Probability of the operation to be traced (head-based sampling) */
+    float tracer_sample_rate;
+    /** Create KV spans only for slow, failed or orphaned operations */
+    unsigned tracer_tail_based : 1;
+    /** Number of connections to open to each query/search/analytics node on new configuration */
+    lcb_U32 http_warmup_connections;
+    /** Send HTTP requests over multiplexed HTTP/2 connections */
+    unsigned enable_http2 : 1;
+    /** Maximum number of prepared statements in the N1QL plan cache */
+    lcb_SIZE n1ql_cache_size;
+    /** Share N1QL plans with other instances connected to the same cluster */
+    unsigned n1ql_shared_cache : 1;
+    /** Pipeline negotiation commands of KV connections */
+    unsigned optimistic_negotiation : 1;
+    /** Resume TLS sessions of the previous connections */
+    unsigned tls_session_cache : 1;
+    /** Offload TLS encryption to the kernel */
+    unsigned enable_ktls : 1;
+    /** Collect queue/wire/server latency histograms of the KV pipelines */
+    unsigned pipeline_latency : 1;
+    /** SASL mechanism negotiated by the last KV connection (for optimistic negotiation) */
+    char *sasl_mech_cached;
+    /** How long the resolved addresses are cached (microseconds) */
+    lcb_U32 dns_cache_ttl;
+    /** Background resolver of the host names, created on first use */
+    lcbio_pRESOLVER resolver;
+    /** Connect to all KV nodes on new configuration, and reconnect in the background */
+    unsigned kv_preconnect : 1;
 } lcb_settings;
 
 LCB_INTERNAL_API
@@ -264,6 +306,9 @@ lcb_SERVERMETRICS *lcb_metrics_getserver(lcb_METRICS *metrics, const char *host,
 
 void lcb_metrics_reset_pipeline_gauges(lcb_SERVERMETRICS *metrics);
 
+/** Allocate the latency histograms of the server (LCB_CNTL_PIPELINE_LATENCY) */
+void lcb_metrics_enable_latency(lcb_SERVERMETRICS *metrics);
+
 #ifdef __cplusplus
 }
 #endif
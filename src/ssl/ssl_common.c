@@ -134,6 +134,11 @@ void iotssl_init_common(lcbio_XSSL *xs, lcbio_TABLE *orig, SSL_CTX *sctx)
 
 void iotssl_destroy_common(lcbio_XSSL *xs)
 {
+    if (!xs->error) {
+        /* the connection is not shut down with close_notify, but its session is
+         * still valid, and OpenSSL would otherwise mark it as not resumable */
+        SSL_set_shutdown(xs->ssl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+    }
     free(xs->iops_dummy_);
     SSL_free(xs->ssl);
     lcbio_table_unref(xs->orig);
@@ -217,6 +222,24 @@ int iotssl_maybe_error(lcbio_XSSL *xs, int rv)
  ** Higher Level SSL_CTX Wrappers                                            **
  ******************************************************************************
  ******************************************************************************/
+/** Maximum number of TLS sessions kept for resumption */
+#define LCBIO_SSL_SESSION_CACHE_SIZE 64
+
+typedef struct {
+    char *key; /**< "host:port" of the server */
+    SSL_SESSION *session;
+    lcb_U64 last_used;
+} lcbio_SSLSESSION;
+
+struct lcbio_SSLCTX {
+    SSL_CTX *ctx;
+    lcbio_SSLSESSION sessions[LCBIO_SSL_SESSION_CACHE_SIZE];
+    lcb_U64 clock;
+    lcb_U64 nfull;
+    lcb_U64 nresumed;
+    lcb_U64 nktls;
+};
+
 static void log_callback(const SSL *ssl, int where, int ret)
 {
     int should_log = 0;
@@ -242,8 +265,22 @@ static void log_callback(const SSL *ssl, int where, int ret)
             where, SSL_state_string_long(ssl), ret, SSL_alert_type_string_long(ret), SSL_alert_desc_string_long(ret));
 
     if (where == SSL_CB_HANDSHAKE_DONE) {
-        lcb_log(LOGARGS(ssl, LCB_LOG_DEBUG), "sock=%p. Using SSL version %s. Cipher=%s", (void *)sock,
-                SSL_get_version(ssl), SSL_get_cipher_name(ssl));
+        struct lcbio_SSLCTX *sctx = SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl));
+        int reused = SSL_session_reused((SSL *)ssl);
+        if (sctx) {
+            if (reused) {
+                sctx->nresumed++;
+            } else {
+                sctx->nfull++;
+            }
+#if LCB_CAN_KTLS
+            if (BIO_get_ktls_send(SSL_get_wbio(ssl))) {
+                sctx->nktls++;
+            }
+#endif
+        }
+        lcb_log(LOGARGS(ssl, LCB_LOG_DEBUG), "sock=%p. Using SSL version %s. Cipher=%s. Session %s", (void *)sock,
+                SSL_get_version(ssl), SSL_get_cipher_name(ssl), reused ? "resumed" : "established");
     }
 }
 
@@ -273,12 +310,100 @@ msg_callback(int write_p, int version, int ctype, const void *buf, size_t n,
 }
 #endif
 
-struct lcbio_SSLCTX {
-    SSL_CTX *ctx;
-};
-
 #define LOGARGS_S(settings, lvl) settings, "SSL", lvl, __FILE__, __LINE__
 
+static char *session_key(const lcb_host_t *host)
+{
+    size_t len = strlen(host->host) + strlen(host->port) + 2;
+    char *key = malloc(len);
+    snprintf(key, len, "%s:%s", host->host, host->port);
+    return key;
+}
+
+static lcbio_SSLSESSION *session_find(struct lcbio_SSLCTX *sctx, const char *key)
+{
+    size_t ii;
+    for (ii = 0; ii < LCBIO_SSL_SESSION_CACHE_SIZE; ii++) {
+        if (sctx->sessions[ii].key && strcmp(sctx->sessions[ii].key, key) == 0) {
+            return &sctx->sessions[ii];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Invoked by OpenSSL for every session established by the client (with TLS
+ * 1.3 the sessions arrive in tickets after the handshake). The session is kept
+ * for the next connection to the same endpoint, replacing the least recently
+ * used one when the cache is full.
+ * @return 1 if the session has been retained
+ */
+static int new_session_callback(SSL *ssl, SSL_SESSION *session)
+{
+    lcbio_SOCKET *sock = SSL_get_app_data(ssl);
+    struct lcbio_SSLCTX *sctx = SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl));
+    lcbio_SSLSESSION *entry;
+    char *key;
+    size_t ii;
+
+    if (sctx == NULL || sock == NULL || sock->info == NULL || !sock->settings->tls_session_cache) {
+        return 0;
+    }
+
+    key = session_key(&sock->info->ep_remote);
+    entry = session_find(sctx, key);
+    if (entry) {
+        free(key);
+    } else {
+        entry = &sctx->sessions[0];
+        for (ii = 0; ii < LCBIO_SSL_SESSION_CACHE_SIZE && entry->key; ii++) {
+            lcbio_SSLSESSION *cur = &sctx->sessions[ii];
+            if (cur->key == NULL || cur->last_used < entry->last_used) {
+                entry = cur;
+            }
+        }
+        free(entry->key);
+        entry->key = key;
+    }
+    if (entry->session) {
+        SSL_SESSION_free(entry->session);
+    }
+    entry->session = session;
+    entry->last_used = ++sctx->clock;
+    return 1;
+}
+
+static void session_resume(struct lcbio_SSLCTX *sctx, lcbio_SOCKET *sock, SSL *ssl)
+{
+    lcbio_SSLSESSION *entry;
+    char *key;
+
+    if (!sock->settings->tls_session_cache || sock->info == NULL) {
+        return;
+    }
+    key = session_key(&sock->info->ep_remote);
+    entry = session_find(sctx, key);
+    if (entry && SSL_set_session(ssl, entry->session)) {
+        entry->last_used = ++sctx->clock;
+        lcb_log(LOGARGS(ssl, LCB_LOG_TRACE), "sock=%p. Trying to resume TLS session for %s", (void *)sock, key);
+    }
+    free(key);
+}
+
+static void session_cache_clear(struct lcbio_SSLCTX *sctx)
+{
+    size_t ii;
+    for (ii = 0; ii < LCBIO_SSL_SESSION_CACHE_SIZE; ii++) {
+        lcbio_SSLSESSION *entry = &sctx->sessions[ii];
+        if (entry->session) {
+            SSL_SESSION_free(entry->session);
+        }
+        free(entry->key);
+        entry->session = NULL;
+        entry->key = NULL;
+    }
+}
+
 static long decode_ssl_protocol(const char *protocol)
 {
     long disallow = SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3;
@@ -383,6 +508,11 @@ lcbio_pSSLCTX lcbio_ssl_new(const char *tsfile, const char *cafile, const char *
     }
 
     SSL_CTX_set_info_callback(ret->ctx, log_callback);
+    SSL_CTX_set_app_data(ret->ctx, ret);
+    /* sessions are stored in lcbio_SSLCTX, because OpenSSL does not look up
+     * client sessions in its own cache */
+    SSL_CTX_set_session_cache_mode(ret->ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ret->ctx, new_session_callback);
 #ifdef LCB_TLS_LOG_KEYS
     {
         const char *log_file_path = getenv("LCB_TLS_KEY_LOG_FILE");
@@ -433,7 +563,7 @@ lcb_STATUS lcbio_ssl_apply(lcbio_SOCKET *sock, lcbio_pSSLCTX sctx)
     lcbio_PROTOCTX *sproto;
 
     if (old_iot->model == LCB_IOMODEL_EVENT) {
-        new_iot = lcbio_Essl_new(old_iot, sock->u.fd, sctx->ctx);
+        new_iot = lcbio_Essl_new(old_iot, sock->u.fd, sctx->ctx, sock->settings->enable_ktls);
     } else {
         new_iot = lcbio_Cssl_new(old_iot, sock->u.sd, sctx->ctx);
     }
@@ -445,8 +575,9 @@ lcb_STATUS lcbio_ssl_apply(lcbio_SOCKET *sock, lcbio_pSSLCTX sctx)
         lcbio_protoctx_add(sock, sproto);
         lcbio_table_unref(old_iot);
         sock->io = new_iot;
-        /* just for logging */
+        /* used for logging and to find the endpoint of the session */
         SSL_set_app_data(((lcbio_XSSL *)new_iot)->ssl, sock);
+        session_resume(sctx, sock, ((lcbio_XSSL *)new_iot)->ssl);
         return LCB_SUCCESS;
 
     } else {
@@ -465,12 +596,47 @@ lcb_STATUS lcbio_ssl_get_error(lcbio_SOCKET *sock)
     return xs->errcode;
 }
 
+lcb_STATUS lcbio_ssl_set_alpn(lcbio_SOCKET *sock, const unsigned char *protos, unsigned nprotos)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x10002000L
+    lcbio_XSSL *xs = (lcbio_XSSL *)sock->io;
+    if (SSL_set_alpn_protos(xs->ssl, protos, nprotos) != 0) {
+        return LCB_ERR_SSL_ERROR;
+    }
+    return LCB_SUCCESS;
+#else
+    (void)sock;
+    (void)protos;
+    (void)nprotos;
+    return LCB_ERR_SDK_FEATURE_UNAVAILABLE;
+#endif
+}
+
 void lcbio_ssl_free(lcbio_pSSLCTX ctx)
 {
+    session_cache_clear(ctx);
+    SSL_CTX_set_app_data(ctx->ctx, NULL);
     SSL_CTX_free(ctx->ctx);
     free(ctx);
 }
 
+void lcbio_ssl_session_stats(lcbio_pSSLCTX ctx, lcb_TLS_SESSION_STATS *stats)
+{
+    size_t ii;
+    memset(stats, 0, sizeof(*stats));
+    if (ctx == NULL) {
+        return;
+    }
+    stats->full_handshakes = ctx->nfull;
+    stats->resumed_handshakes = ctx->nresumed;
+    stats->ktls_connections = ctx->nktls;
+    for (ii = 0; ii < LCBIO_SSL_SESSION_CACHE_SIZE; ii++) {
+        if (ctx->sessions[ii].session) {
+            stats->size++;
+        }
+    }
+}
+
 /**
  * According to https://www.openssl.org/docs/crypto/threads.html we need
  * to install two functions for locking support, a function that returns
@@ -22,12 +22,31 @@
  *
  * This wraps the IO Table for SSL I/O
  *
+ * If the wrapped table performs plain socket I/O (see
+ * LCB_IO_CNTL_PLAIN_SOCKET_IO, which holds for the built-in plugins), the SSL
+ * object is attached to the socket itself (socket BIO), so there is no
+ * intermediate buffering of the ciphertext: SSL_read() receives the records
+ * and decrypts them straight into the buffers of the caller (the rdb segments),
+ * and SSL_write() sends the records as it encrypts them.
  *
- * Writes and reads will always use SSL_write and SSL_read methods respectively.
- * I/O will be preemptively scheduled whenever:
+ * Otherwise (custom or wrapped plugins) the ciphertext goes through a pair of
+ * memory BIOs, which are filled and drained with the recv and send routines of
+ * the wrapped table.
  *
- * - SSL_want_read() is true
- * - The wbio is not empty
+ * In both cases small buffers of the IOV chain are coalesced into a single
+ * record, so that a pipeline flushing many small packets does not produce a
+ * record (and a system call) per buffer.
+ *
+ * The watcher follows SSL_want_read() and SSL_want_write() (and the contents
+ * of the write BIO) while the handshake is in progress, and the events
+ * requested by the user afterwards. Events are delivered immediately (via a
+ * 'fake' event) when SSL already holds data which has not been read by the
+ * user.
+ *
+ * When kernel TLS is requested on a socket BIO, OpenSSL installs the keys into
+ * the socket once the handshake is complete. If the kernel has accepted the
+ * transmit keys, the outgoing data bypasses OpenSSL and is sent with the
+ * routines of the wrapped table (including vectored writes).
  */
 
 typedef struct {
@@ -38,10 +57,15 @@ typedef struct {
     short fakewhich;      /**< Flags to deliver immediately */
     lcb_ioE_callback ucb; /**< User defined callback */
     int entered;          /**< Whether we are inside a handler */
-    int closed;
-    lcb_socket_t fd; /**< Socket descriptor */
+    lcb_socket_t fd;      /**< Socket descriptor */
     lcbio_pTIMER as_fake;
-    lcb_SIZE last_nw; /**< Last failed call to SSL_write() */
+    lcb_SIZE last_nw;  /**< Length of the last SSL_write() which has to be retried */
+    char *wbuf;        /**< Buffer to coalesce small IOVs into a single record */
+    int ktls_checked;  /**< Whether the kernel TLS state has been inspected */
+    int ktls_tx;       /**< The kernel encrypts outgoing data */
+    int rd_starved;    /**< SSL_read() needs more ciphertext than SSL has buffered */
+    int direct;        /**< SSL reads and writes the socket itself (no memory BIOs) */
+    int closed;        /**< The peer has closed the socket (memory BIOs only) */
 } lcbio_ESSL;
 
 #ifdef USE_EAGAIN
@@ -55,6 +79,25 @@ typedef struct {
 #define ES_FROM_IOPS(iops) (lcbio_ESSL *)(IOTSSL_FROM_IOPS(iops))
 #define MINIMUM(a, b) a < b ? a : b
 
+/** Maximum amount of plain data in a single record */
+#define ESSL_RECORD_SIZE SSL3_RT_MAX_PLAIN_LENGTH
+
+/** Amount of records in the write BIO, above which the user has to wait for
+ * the socket (memory BIOs only) */
+#define ESSL_WBIO_LIMIT (4 * ESSL_RECORD_SIZE)
+
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+/* read-ahead lets SSL receive as many records as available with a single
+ * recv(), and SSL_has_pending() also accounts the unprocessed ones. Note that
+ * these may be an incomplete record, which cannot be read until the rest of
+ * it arrives (see lcbio_ESSL::rd_starved) */
+#define ESSL_READ_AHEAD 1
+#define ESSL_HAS_PENDING(ssl) SSL_has_pending(ssl)
+#else
+#define ESSL_READ_AHEAD 0
+#define ESSL_HAS_PENDING(ssl) (SSL_pending(ssl) > 0)
+#endif
+
 static int maybe_error(lcbio_ESSL *es, int rv)
 {
     return iotssl_maybe_error((lcbio_XSSL *)es, rv);
@@ -67,32 +110,66 @@ static void event_handler(lcb_socket_t, short, void *);
         schedule_pending(es);                                                                                          \
     }
 /* Schedule watch events:
- * - If we have SSL data to be written, the watcher is activated for WRITE_EVENT
- * - If SSL_pending() is true and the user has requested read, the as_fake
- *   handler is triggered
+ * - During the handshake, the watcher is activated for the events SSL needs
+ * - If SSL has data which the user has not read yet, and the user has
+ *   requested read, the as_fake handler is triggered
+ * - Otherwise the watcher is activated for the events requested by the user
  */
 static void schedule_pending(lcbio_ESSL *es)
 {
-    short avail = LCB_WRITE_EVENT;
+    short avail = 0;
     /* Bitflags of events that the SSL pointer needs in order to progress */
     short wanted = 0;
+    int handshake = !SSL_is_init_finished(es->ssl);
 
-    IOTSSL_PENDING_PRECHECK(es->ssl);
-    if (IOTSSL_IS_PENDING(es->ssl)) {
-        /* have user data in buffer */
+    if (!es->direct && !handshake) {
+        /* the records might still be in the read BIO */
+        IOTSSL_PENDING_PRECHECK(es->ssl);
+    }
+    if (SSL_pending(es->ssl) > 0) {
+        /* have decrypted user data in buffer */
+        avail |= LCB_READ_EVENT;
+    } else if (!es->rd_starved && ESSL_HAS_PENDING(es->ssl)) {
+        /* have unprocessed records, which might be complete. If the last
+         * SSL_read() has shown that they are not, the rest of the record has
+         * to arrive on the socket first */
         avail |= LCB_READ_EVENT;
     }
 
-    if (SSL_want_read(es->ssl)) {
-        /* SSL need data from the network */
-        wanted |= LCB_READ_EVENT;
+    if (handshake) {
+        if (SSL_want_read(es->ssl)) {
+            wanted |= LCB_READ_EVENT;
+        }
+        if (SSL_want_write(es->ssl)) {
+            wanted |= LCB_WRITE_EVENT;
+        }
+        if (!SSL_want_read(es->ssl) && !SSL_want_write(es->ssl)) {
+            /* the handshake has not started yet, and the server waits for
+             * the client hello, even if the user only wants to read */
+            wanted |= LCB_WRITE_EVENT;
+        }
     }
 
-    if (BIO_ctrl_pending(es->wbio)) {
+    if (!es->direct && BIO_ctrl_pending(es->wbio)) {
         /* have data to flush */
         wanted |= LCB_WRITE_EVENT;
     }
 
+    if (!es->direct && !handshake) {
+        /* SSL_write() only fills the write BIO. Take more data from the user
+         * until the socket falls behind */
+        if (BIO_ctrl_pending(es->wbio) < ESSL_WBIO_LIMIT) {
+            avail |= LCB_WRITE_EVENT;
+        }
+    } else if (es->requested & LCB_WRITE_EVENT) {
+        if (handshake && SSL_want_read(es->ssl)) {
+            /* cannot write anything until the server responds */
+            wanted |= LCB_READ_EVENT;
+        } else {
+            wanted |= LCB_WRITE_EVENT;
+        }
+    }
+
     /* set the events to deliver on the next 'fake' event. This will be all
      * the available events AND'ed with all the events the user cared about */
     es->fakewhich = avail;
@@ -111,7 +188,7 @@ static void schedule_pending(lcbio_ESSL *es)
     IOT_V0EV(es->orig).watch(IOT_ARG(es->orig), es->fd, es->event, wanted, es, event_handler);
 }
 
-/* Reads encrypted data from the socket into SSL */
+/* Reads encrypted data from the socket into the read BIO */
 static int read_ssl_data(lcbio_ESSL *es)
 {
     int nr, total = 0;
@@ -164,7 +241,7 @@ static int read_ssl_data(lcbio_ESSL *es)
     return 0;
 }
 
-/* Writes encrypted data from SSL over to the network */
+/* Writes encrypted data from the write BIO over to the network */
 static int flush_ssl_data(lcbio_ESSL *es)
 {
     BUF_MEM *wmb;
@@ -207,9 +284,6 @@ static int flush_ssl_data(lcbio_ESSL *es)
         }
     }
 
-/* TODO: This block is inefficient as it results in a bunch of memmove()
- * calls. While we could have done this inline with the send() call this
- * would make future optimization more difficult. */
 GT_WRITE_DONE:
 #if !LCB_CAN_OPTIMIZE_SSL_BIO
     BIO_get_mem_ptr(es->wbio, &wmb);
@@ -226,45 +300,61 @@ GT_WRITE_DONE:
     return 0;
 }
 
+/* Stops the watcher and lets the user find the error with send/recv */
+static void fatal_error(lcbio_ESSL *es, lcb_socket_t fd)
+{
+    es->error = 1;
+
+    /* stop internal watcher */
+    IOT_V0EV(es->orig).watch(IOT_ARG(es->orig), es->fd, es->event, 0, NULL, NULL);
+
+    /* send/recv will detect es->error and return -1/EINVAL appropriately */
+    if (es->requested && es->ucb) {
+        es->ucb(fd, es->requested, es->arg);
+    }
+}
+
 /* This is the raw event handler called from the underlying IOPS */
 static void event_handler(lcb_socket_t fd, short which, void *arg)
 {
     lcbio_ESSL *es = arg;
-    int rv = 0;
     int u_which;
     es->entered++;
 
-    if (which & LCB_READ_EVENT) {
-        rv = read_ssl_data(es);
-    }
-    if (rv == 0 && (which & LCB_WRITE_EVENT)) {
-        rv = flush_ssl_data(es);
+    if (!es->direct) {
+        int rv = 0;
+        if (which & LCB_READ_EVENT) {
+            rv = read_ssl_data(es);
+        }
+        if (rv == 0 && (which & LCB_WRITE_EVENT)) {
+            rv = flush_ssl_data(es);
+        }
+        if (rv == -1) {
+            fatal_error(es, fd);
+            es->entered--;
+            return;
+        }
     }
 
-    if (rv == -1) {
-        es->error = 1;
-
-        /* stop internal watcher */
-        IOT_V0EV(es->orig).watch(IOT_ARG(es->orig), es->fd, es->event, 0, NULL, NULL);
-
-        /* send/recv will detect es->error and return -1/EINVAL appropriately */
-        if (es->requested && es->ucb) {
-            es->ucb(fd, es->requested, es->arg);
+    u_which = which & es->requested;
+    if (which & LCB_READ_EVENT) {
+        es->rd_starved = 0;
+    }
+    if (!SSL_is_init_finished(es->ssl)) {
+        /* the handshake progresses even if the user waits for nothing, and
+         * its progress might unblock any of the user's operations */
+        int rv = SSL_do_handshake(es->ssl);
+        if (rv <= 0 && maybe_error(es, rv) != 0) {
+            fatal_error(es, fd);
+            es->entered--;
+            return;
         }
-        es->entered--;
-        return;
+        u_which = es->requested;
     }
 
     /* deliver stuff back to the user: */
-    u_which = 0;
-    if (es->requested & LCB_READ_EVENT) {
-        u_which |= LCB_READ_EVENT;
-    }
-    if (es->requested & LCB_WRITE_EVENT) {
-        u_which |= LCB_WRITE_EVENT;
-    }
     if (es->ucb && u_which) {
-        es->ucb(fd, u_which & es->requested, es->arg);
+        es->ucb(fd, u_which, es->arg);
     }
 
     /* socket closed. Don't reschedule */
@@ -282,7 +372,7 @@ static void event_handler(lcb_socket_t fd, short which, void *arg)
 }
 
 /* User events are delivered out-of-sync with SSL events. This is mainly with
- * respect to write events. */
+ * respect to read events. */
 static void fake_signal(void *arg)
 {
     lcbio_ESSL *es = arg;
@@ -324,64 +414,169 @@ static void stop_watch(lcb_io_opt_t iops, lcb_socket_t sock, void *event)
 static lcb_ssize_t Essl_recv(lcb_io_opt_t iops, lcb_socket_t sock, void *buf, lcb_size_t nbuf, int ign)
 {
     lcbio_ESSL *es = ES_FROM_IOPS(iops);
-    int rv = SSL_read(es->ssl, buf, nbuf);
+    int rv;
+    (void)ign;
+    (void)sock;
 
     if (es->error) {
         IOTSSL_ERRNO(es) = EINVAL;
         return -1;
     }
 
+    rv = SSL_read(es->ssl, buf, nbuf);
     if (rv >= 0) {
         /* data or clean shutdown */
+        es->rd_starved = 0;
         return rv;
     } else if (es->closed) {
         return 0;
     } else if (maybe_error(es, rv) != 0) {
         IOTSSL_ERRNO(es) = EINVAL;
     } else {
+        es->rd_starved = SSL_want_read(es->ssl);
         IOTSSL_ERRNO(es) = EWOULDBLOCK;
     }
-    (void)ign;
-    (void)sock;
     return -1;
 }
 
-static lcb_ssize_t Essl_send(lcb_io_opt_t iops, lcb_socket_t sock, const void *buf, lcb_size_t nbuf, int ign)
+/* Returns true if the data can be sent without SSL_write() */
+static int can_bypass_ssl(lcbio_ESSL *es)
 {
-    lcbio_ESSL *es = ES_FROM_IOPS(iops);
-    int rv;
-    (void)ign;
-    (void)sock;
+#if LCB_CAN_KTLS
+    if (es->direct && !es->ktls_checked && SSL_is_init_finished(es->ssl)) {
+        es->ktls_checked = 1;
+        es->ktls_tx = BIO_get_ktls_send(SSL_get_wbio(es->ssl));
+    }
+#endif
+    return es->ktls_tx && es->last_nw == 0;
+}
 
-    if (es->error) {
-        IOTSSL_ERRNO(es) = EINVAL;
-        return -1;
+static lcb_ssize_t send_plain(lcbio_ESSL *es, lcb_IOV *iov, lcb_size_t niov)
+{
+    lcb_ssize_t nw = IOT_V0IO(es->orig).sendv(IOT_ARG(es->orig), es->fd, iov, niov);
+    if (nw < 0) {
+        IOTSSL_ERRNO(es) = IOT_ERRNO(es->orig);
     }
+    return nw;
+}
 
-    rv = SSL_write(es->ssl, buf, nbuf);
-    if (rv >= 0) {
-        /* still need to schedule data to get flushed to the network */
-        SCHEDULE_PENDING_SAFE(es);
+static lcb_ssize_t write_ssl(lcbio_ESSL *es, const void *buf, lcb_size_t nbuf)
+{
+    int rv = SSL_write(es->ssl, buf, (int)nbuf);
+    if (rv > 0) {
+        es->last_nw = 0;
+        if (!es->direct) {
+            /* send as much as possible right away, the rest is flushed when the
+             * socket becomes writable */
+            flush_ssl_data(es);
+            SCHEDULE_PENDING_SAFE(es);
+        }
         return rv;
     } else if (maybe_error(es, rv)) {
         IOTSSL_ERRNO(es) = EINVAL;
         return -1;
     } else {
+        /* SSL_write() has to be repeated with the same length, even if the
+         * caller would be able to provide more data next time */
+        es->last_nw = nbuf;
         IOTSSL_ERRNO(es) = EWOULDBLOCK;
         return -1;
     }
 }
 
+static lcb_ssize_t Essl_send(lcb_io_opt_t iops, lcb_socket_t sock, const void *buf, lcb_size_t nbuf, int ign)
+{
+    lcbio_ESSL *es = ES_FROM_IOPS(iops);
+    (void)ign;
+    (void)sock;
+
+    if (es->error) {
+        IOTSSL_ERRNO(es) = EINVAL;
+        return -1;
+    }
+
+    if (can_bypass_ssl(es)) {
+        lcb_IOV iov;
+        iov.iov_base = (void *)buf;
+        iov.iov_len = nbuf;
+        return send_plain(es, &iov, 1);
+    }
+    if (es->last_nw && es->last_nw < nbuf) {
+        nbuf = es->last_nw;
+    }
+    return write_ssl(es, buf, nbuf);
+}
+
 static lcb_ssize_t Essl_recvv(lcb_io_opt_t iops, lcb_socket_t sock, lcb_IOV *iov, lcb_size_t niov)
 {
-    (void)niov;
-    return Essl_recv(iops, sock, iov->iov_base, iov->iov_len, 0);
+    lcbio_ESSL *es = ES_FROM_IOPS(iops);
+    lcb_ssize_t total = 0;
+    lcb_size_t ii;
+
+    for (ii = 0; ii < niov; ii++) {
+        lcb_ssize_t nr = Essl_recv(iops, sock, iov[ii].iov_base, iov[ii].iov_len, 0);
+        if (nr <= 0) {
+            return total ? total : nr;
+        }
+        total += nr;
+        /* continue with the next segment only if it can be filled without
+         * waiting for the socket */
+        if ((lcb_size_t)nr < iov[ii].iov_len || !ESSL_HAS_PENDING(es->ssl)) {
+            break;
+        }
+    }
+    return total;
 }
 
 static lcb_ssize_t Essl_sendv(lcb_io_opt_t iops, lcb_socket_t sock, lcb_IOV *iov, lcb_size_t niov)
 {
-    (void)niov;
-    return Essl_send(iops, sock, iov->iov_base, iov->iov_len, 0);
+    lcbio_ESSL *es = ES_FROM_IOPS(iops);
+    lcb_size_t nbuf, ii;
+
+    if (es->error) {
+        IOTSSL_ERRNO(es) = EINVAL;
+        return -1;
+    }
+    if (can_bypass_ssl(es)) {
+        return send_plain(es, iov, niov);
+    }
+
+    if (es->last_nw) {
+        nbuf = es->last_nw;
+    } else if (niov == 1 || iov[0].iov_len >= ESSL_RECORD_SIZE) {
+        nbuf = iov[0].iov_len;
+    } else {
+        /* fill the record with as many buffers as possible */
+        nbuf = 0;
+        for (ii = 0; ii < niov && nbuf < ESSL_RECORD_SIZE; ii++) {
+            nbuf += iov[ii].iov_len;
+        }
+        if (nbuf > ESSL_RECORD_SIZE) {
+            nbuf = ESSL_RECORD_SIZE;
+        }
+    }
+
+    if (iov[0].iov_len >= nbuf) {
+        return write_ssl(es, iov[0].iov_base, nbuf);
+    }
+
+    if (es->wbuf == NULL) {
+        es->wbuf = malloc(ESSL_RECORD_SIZE);
+    }
+    {
+        lcb_size_t copied = 0;
+        for (ii = 0; ii < niov && copied < nbuf; ii++) {
+            lcb_size_t ncopy = iov[ii].iov_len;
+            if (ncopy > nbuf - copied) {
+                ncopy = nbuf - copied;
+            }
+            memcpy(es->wbuf + copied, iov[ii].iov_base, ncopy);
+            copied += ncopy;
+        }
+        nbuf = copied;
+    }
+    (void)sock;
+    return write_ssl(es, es->wbuf, nbuf);
 }
 
 static void Essl_close(lcb_io_opt_t iops, lcb_socket_t fd)
@@ -397,6 +592,8 @@ static void Essl_dtor(void *arg)
     IOT_V0EV(es->orig).destroy(IOT_ARG(es->orig), es->event);
     lcbio_timer_destroy(es->as_fake);
     iotssl_destroy_common((lcbio_XSSL *)es);
+    free(es->wbuf);
+    es->wbuf = NULL;
     if (es->entered) {
         /* defer free while inside the handler */
         return;
@@ -404,7 +601,19 @@ static void Essl_dtor(void *arg)
     free(es);
 }
 
-lcbio_pTABLE lcbio_Essl_new(lcbio_pTABLE orig, lcb_socket_t fd, SSL_CTX *sctx)
+/* OpenSSL may only read and write the descriptor itself if the plugin would
+ * do nothing else with it. Custom or wrapped plugins keep their own recv and
+ * send routines in the path */
+static int can_use_socket_bio(lcbio_pTABLE orig, lcb_socket_t fd)
+{
+    lcb_ioE_cntl_fn cntl = IOT_V0IO(orig).cntl;
+    if (cntl == NULL) {
+        return 0;
+    }
+    return cntl(IOT_ARG(orig), fd, LCB_IO_CNTL_GET, LCB_IO_CNTL_PLAIN_SOCKET_IO, &IOT_V0IO(orig)) == 0;
+}
+
+lcbio_pTABLE lcbio_Essl_new(lcbio_pTABLE orig, lcb_socket_t fd, SSL_CTX *sctx, int ktls)
 {
     lcbio_ESSL *es = calloc(1, sizeof(*es));
     lcbio_TABLE *iot = &es->base_;
@@ -420,5 +629,30 @@ lcbio_pTABLE lcbio_Essl_new(lcbio_pTABLE orig, lcb_socket_t fd, SSL_CTX *sctx)
     iot->u_io.v0.io.close = Essl_close;
     iot->dtor = Essl_dtor;
     iotssl_init_common((lcbio_XSSL *)es, orig, sctx);
+
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+    /* the server might close the connection without close_notify */
+    SSL_set_options(es->ssl, SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
+
+    es->direct = can_use_socket_bio(orig, fd);
+    if (!es->direct) {
+        /* keep the memory BIOs, kernel TLS requires a socket BIO */
+        return iot;
+    }
+
+    /* replaces the memory BIOs */
+    SSL_set_fd(es->ssl, (int)fd);
+    es->rbio = SSL_get_rbio(es->ssl);
+    es->wbio = SSL_get_wbio(es->ssl);
+    SSL_set_read_ahead(es->ssl, ESSL_READ_AHEAD);
+#if LCB_CAN_KTLS
+    if (ktls) {
+        /* OpenSSL installs the keys into the kernel only for socket BIOs */
+        SSL_set_options(es->ssl, SSL_OP_ENABLE_KTLS);
+    }
+#else
+    (void)ktls;
+#endif
     return iot;
 }
@@ -26,6 +26,13 @@
 #include <openssl/ssl.h>
 #include <lcbio/ssl.h>
 
+/* Kernel TLS offload requires OpenSSL 3.0 (or newer) built with kTLS support */
+#if defined(__linux__) && defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+#define LCB_CAN_KTLS 1
+#else
+#define LCB_CAN_KTLS 0
+#endif
+
 #define IOTSSL_COMMON_FIELDS                                                                                           \
     lcbio_TABLE base_;        /**< Base table structure to export */                                                   \
     lcbio_pTABLE orig;        /**< Table pointer we are wrapping */                                                    \
@@ -168,8 +175,15 @@ lcbio_pTABLE lcbio_Cssl_new(lcbio_pTABLE orig, lcb_sockdata_t *sd, SSL_CTX *sctx
  * @param orig The original pointer
  * @param fd Socket descriptor
  * @param sctx
+ * @param ktls whether to try offloading the encryption to the kernel. Once the
+ * kernel accepts the keys, the data is sent with the routines of `orig`.
+ *
+ * Unlike the completion model, the `SSL` object reads and writes the socket
+ * directly instead of using memory BIOs, if `orig` performs plain socket I/O
+ * (@ref LCB_IO_CNTL_PLAIN_SOCKET_IO). Otherwise the memory BIOs are kept, and
+ * kernel TLS is not used.
  * @return NULL on error.
  */
-lcbio_pTABLE lcbio_Essl_new(lcbio_pTABLE orig, lcb_socket_t fd, SSL_CTX *sctx);
+lcbio_pTABLE lcbio_Essl_new(lcbio_pTABLE orig, lcb_socket_t fd, SSL_CTX *sctx, int ktls);
 
 #endif
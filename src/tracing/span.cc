@@ -41,8 +41,155 @@ typedef struct tag_value {
         double d;
         int b;
     } v;
+    /* copied string values which fit here (ids, ports, addresses) do not need separate allocation */
+    char inline_value[48];
 } tag_value;
 
+namespace
+{
+/**
+ * Per-thread cache of fixed-size blocks. Library instances are not shared
+ * between threads, so in practice a span and its tags are allocated and
+ * released by the same thread and do not need any locking.
+ */
+template <size_t BlockSize, size_t Capacity>
+class BlockCache
+{
+  public:
+    ~BlockCache()
+    {
+        destroyed() = true;
+        while (head_ != nullptr) {
+            Node *node = head_;
+            head_ = node->next;
+            ::operator delete(node);
+        }
+    }
+
+    static void *allocate()
+    {
+        if (!destroyed()) {
+            BlockCache &cache = instance();
+            if (cache.head_ != nullptr) {
+                Node *node = cache.head_;
+                cache.head_ = node->next;
+                cache.size_--;
+                return node;
+            }
+        }
+        return ::operator new(BlockSize);
+    }
+
+    static void release(void *ptr)
+    {
+        if (ptr == nullptr) {
+            return;
+        }
+        if (!destroyed()) {
+            BlockCache &cache = instance();
+            if (cache.size_ < Capacity) {
+                Node *node = static_cast<Node *>(ptr);
+                node->next = cache.head_;
+                cache.head_ = node;
+                cache.size_++;
+                return;
+            }
+        }
+        ::operator delete(ptr);
+    }
+
+  private:
+    struct Node {
+        Node *next;
+    };
+    static_assert(BlockSize >= sizeof(Node), "block is too small to be linked into the cache");
+
+    static BlockCache &instance()
+    {
+        static thread_local BlockCache cache;
+        return cache;
+    }
+
+    /* trivially destructible, so still valid while other thread_local objects are being destroyed */
+    static bool &destroyed()
+    {
+        static thread_local bool flag = false;
+        return flag;
+    }
+
+    Node *head_{nullptr};
+    size_t size_{0};
+};
+
+typedef BlockCache<sizeof(lcb::trace::Span), 256> SpanCache;
+typedef BlockCache<sizeof(tag_value), 4096> TagCache;
+
+tag_value *new_tag(const char *name, int copy_key, tag_type type)
+{
+    auto *val = static_cast<tag_value *>(TagCache::allocate());
+    memset(val, 0, offsetof(tag_value, inline_value));
+    val->t = type;
+    val->key.need_free = copy_key;
+    if (copy_key) {
+        val->key.p = lcb_strdup(name);
+    } else {
+        val->key.p = (char *)name;
+    }
+    return val;
+}
+
+void free_tag(tag_value *val)
+{
+    if (val->key.need_free) {
+        free(val->key.p);
+    }
+    if (val->t == TAGVAL_STRING && val->v.s.need_free) {
+        free(val->v.s.p);
+    }
+    TagCache::release(val);
+}
+
+/**
+ * Returns static copy of the name if it is one of the operations known to the
+ * library, so that the span does not need to keep its own copy.
+ */
+const char *intern_operation_name(const char *opname)
+{
+    static const char *const known_names[] = {
+        LCBTRACE_OP_DISPATCH_TO_SERVER,
+        LCBTRACE_OP_GET,
+        LCBTRACE_OP_UPSERT,
+        LCBTRACE_OP_REPLACE,
+        LCBTRACE_OP_INSERT,
+        LCBTRACE_OP_APPEND,
+        LCBTRACE_OP_PREPEND,
+        LCBTRACE_OP_REMOVE,
+        LCBTRACE_OP_TOUCH,
+        LCBTRACE_OP_UNLOCK,
+        LCBTRACE_OP_EXISTS,
+        LCBTRACE_OP_COUNTER,
+        LCBTRACE_OP_LOOKUPIN,
+        LCBTRACE_OP_MUTATEIN,
+        LCBTRACE_OP_GET_FROM_REPLICA,
+        LCBTRACE_OP_OBSERVE_CAS,
+        LCBTRACE_OP_OBSERVE_CAS_ROUND,
+        LCBTRACE_OP_OBSERVE_SEQNO,
+        LCBTRACE_OP_REQUEST_ENCODING,
+        LCBTRACE_OP_RESPONSE_DECODING,
+        LCBTRACE_OP_QUERY,
+        LCBTRACE_OP_ANALYTICS,
+        LCBTRACE_OP_SEARCH,
+        LCBTRACE_OP_VIEW,
+    };
+    for (const char *name : known_names) {
+        if (strcmp(name, opname) == 0) {
+            return name;
+        }
+    }
+    return nullptr;
+}
+} // namespace
+
 LIBCOUCHBASE_API
 uint64_t lcbtrace_now()
 {
@@ -141,12 +288,14 @@ void lcbtrace_span_add_system_tags(lcbtrace_SPAN *span, const lcb_settings *sett
     }
     span->add_tag(LCBTRACE_TAG_SYSTEM, 0, "couchbase", 0);
     span->add_tag(LCBTRACE_TAG_TRANSPORT, 0, "IP.TCP", 0);
-    std::string client_string(LCB_CLIENT_ID);
     if (settings->client_string) {
+        std::string client_string(LCB_CLIENT_ID);
         client_string += " ";
         client_string += settings->client_string;
+        span->add_tag(LCBTRACE_TAG_COMPONENT, 0, client_string.c_str(), client_string.size(), 1);
+    } else {
+        span->add_tag(LCBTRACE_TAG_COMPONENT, 0, LCB_CLIENT_ID, 0);
     }
-    span->add_tag(LCBTRACE_TAG_COMPONENT, 0, client_string.c_str(), client_string.size(), 1);
     if (settings->bucket) {
         span->add_tag(LCBTRACE_TAG_DB_INSTANCE, 0, settings->bucket, 0);
     }
@@ -212,7 +361,7 @@ const char *lcbtrace_span_get_operation(lcbtrace_SPAN *span)
     if (!span) {
         return nullptr;
     }
-    return span->m_opname.c_str();
+    return span->m_opname;
 }
 
 LIBCOUCHBASE_API
@@ -410,10 +559,137 @@ namespace lcb
 {
 namespace trace
 {
+bool sample_span(const lcb_settings *settings)
+{
+    float rate = settings->tracer_sample_rate;
+    if (rate >= 1) {
+        return true;
+    }
+    if (rate <= 0) {
+        return false;
+    }
+    return lcb_next_rand32() < (uint64_t)(rate * 4294967296.0);
+}
+
+bool is_tail_based(const lcb_settings *settings)
+{
+    return settings->tracer_tail_based && settings->tracer != nullptr &&
+           (settings->tracer->flags & LCBTRACE_F_THRESHOLD);
+}
+
+bool is_kv_failure_status(uint16_t status)
+{
+    switch (status) {
+        case PROTOCOL_BINARY_RESPONSE_SUCCESS:
+        case PROTOCOL_BINARY_RESPONSE_KEY_ENOENT:
+        case PROTOCOL_BINARY_RESPONSE_KEY_EEXISTS:
+        case PROTOCOL_BINARY_RESPONSE_E2BIG:
+        case PROTOCOL_BINARY_RESPONSE_NOT_STORED:
+        case PROTOCOL_BINARY_RESPONSE_DELTA_BADVAL:
+        case PROTOCOL_BINARY_RESPONSE_LOCKED:
+        case PROTOCOL_BINARY_RESPONSE_RANGE_SCAN_MORE:
+        case PROTOCOL_BINARY_RESPONSE_RANGE_SCAN_COMPLETE:
+            return false;
+        default:
+            /* the subdoc statuses describe the outcome for the paths */
+            return status < PROTOCOL_BINARY_RESPONSE_SUBDOC_PATH_ENOENT ||
+                   status > PROTOCOL_BINARY_RESPONSE_SUBDOC_INVALID_XATTR_ORDER;
+    }
+}
+
+static const char *kv_operation_name(uint8_t opcode)
+{
+    switch (opcode) {
+        case PROTOCOL_BINARY_CMD_GET:
+        case PROTOCOL_BINARY_CMD_GAT:
+        case PROTOCOL_BINARY_CMD_GET_LOCKED:
+            return LCBTRACE_OP_GET;
+        case PROTOCOL_BINARY_CMD_SET:
+            return LCBTRACE_OP_UPSERT;
+        case PROTOCOL_BINARY_CMD_ADD:
+            return LCBTRACE_OP_INSERT;
+        case PROTOCOL_BINARY_CMD_REPLACE:
+            return LCBTRACE_OP_REPLACE;
+        case PROTOCOL_BINARY_CMD_APPEND:
+            return LCBTRACE_OP_APPEND;
+        case PROTOCOL_BINARY_CMD_PREPEND:
+            return LCBTRACE_OP_PREPEND;
+        case PROTOCOL_BINARY_CMD_DELETE:
+            return LCBTRACE_OP_REMOVE;
+        case PROTOCOL_BINARY_CMD_TOUCH:
+            return LCBTRACE_OP_TOUCH;
+        case PROTOCOL_BINARY_CMD_UNLOCK_KEY:
+            return LCBTRACE_OP_UNLOCK;
+        case PROTOCOL_BINARY_CMD_INCREMENT:
+        case PROTOCOL_BINARY_CMD_DECREMENT:
+            return LCBTRACE_OP_COUNTER;
+        case PROTOCOL_BINARY_CMD_GET_META:
+            return LCBTRACE_OP_EXISTS;
+        case PROTOCOL_BINARY_CMD_SUBDOC_GET:
+        case PROTOCOL_BINARY_CMD_SUBDOC_EXISTS:
+        case PROTOCOL_BINARY_CMD_SUBDOC_GET_COUNT:
+        case PROTOCOL_BINARY_CMD_SUBDOC_MULTI_LOOKUP:
+            return LCBTRACE_OP_LOOKUPIN;
+        case PROTOCOL_BINARY_CMD_SUBDOC_DICT_ADD:
+        case PROTOCOL_BINARY_CMD_SUBDOC_DICT_UPSERT:
+        case PROTOCOL_BINARY_CMD_SUBDOC_DELETE:
+        case PROTOCOL_BINARY_CMD_SUBDOC_REPLACE:
+        case PROTOCOL_BINARY_CMD_SUBDOC_ARRAY_PUSH_LAST:
+        case PROTOCOL_BINARY_CMD_SUBDOC_ARRAY_PUSH_FIRST:
+        case PROTOCOL_BINARY_CMD_SUBDOC_ARRAY_INSERT:
+        case PROTOCOL_BINARY_CMD_SUBDOC_ARRAY_ADD_UNIQUE:
+        case PROTOCOL_BINARY_CMD_SUBDOC_COUNTER:
+        case PROTOCOL_BINARY_CMD_SUBDOC_MULTI_MUTATION:
+            return LCBTRACE_OP_MUTATEIN;
+        default:
+            return nullptr;
+    }
+}
+
+lcbtrace_SPAN *materialize_kv_span(const mc_PIPELINE *pipeline, const mc_PACKET *packet)
+{
+    if (packet->flags & (MCREQ_F_UFWD | MCREQ_F_PRIVCALLBACK)) {
+        return nullptr;
+    }
+    protocol_binary_request_header hdr;
+    mcreq_read_hdr(packet, &hdr);
+    const char *opname = kv_operation_name(hdr.request.opcode);
+    if (opname == nullptr) {
+        return nullptr;
+    }
+    const lcb_settings *settings = static_cast<const lcb::Server *>(pipeline)->get_settings();
+    uint64_t elapsed_us = LCB_NS2US(gethrtime() - MCREQ_PKT_RDATA(packet)->start);
+    uint64_t now = lcbtrace_now();
+
+    lcbtrace_SPAN *span = lcbtrace_span_start(settings->tracer, opname, now > elapsed_us ? now - elapsed_us : now,
+                                              nullptr);
+    span->should_finish(true);
+    span->is_outer(true);
+    span->is_dispatch(true);
+    char operation_id[16];
+    int operation_id_len = snprintf(operation_id, sizeof(operation_id), "%u", (unsigned)packet->opaque);
+    span->add_tag(LCBTRACE_TAG_OPERATION_ID, 0, operation_id, operation_id_len, 1);
+    lcbtrace_span_add_system_tags(span, settings, LCBTRACE_THRESHOLD_KV);
+    span->add_tag(LCBTRACE_TAG_OPERATION, 0, opname, 0);
+    return span;
+}
+
 void finish_kv_span(const mc_PIPELINE *pipeline, const mc_PACKET *request_pkt,
                     const lcb::MemcachedResponse *response_pkt)
 {
     lcbtrace_SPAN *dispatch_span = MCREQ_PKT_RDATA(request_pkt)->span;
+    if (dispatch_span == nullptr) {
+        const lcb_settings *settings = static_cast<const lcb::Server *>(pipeline)->get_settings();
+        if (!is_tail_based(settings)) {
+            return;
+        }
+        bool failed = response_pkt == nullptr || is_kv_failure_status(response_pkt->status());
+        bool slow = LCB_NS2US(gethrtime() - MCREQ_PKT_RDATA(request_pkt)->start) >
+                    settings->tracer_threshold[LCBTRACE_THRESHOLD_KV];
+        if (failed || slow) {
+            dispatch_span = materialize_kv_span(pipeline, request_pkt);
+        }
+    }
     if (dispatch_span) {
         if (response_pkt != nullptr) {
             dispatch_span->increment_server(response_pkt->duration());
@@ -426,7 +702,7 @@ void finish_kv_span(const mc_PIPELINE *pipeline, const mc_PACKET *request_pkt,
             char local_id[34] = {};
             snprintf(local_id, sizeof(local_id), "%016" PRIx64 "/%016" PRIx64, (uint64_t)server->get_settings()->iid,
                      (uint64_t)ctx->sock->id);
-            lcbtrace_span_add_tag_str(dispatch_span, LCBTRACE_TAG_LOCAL_ID, local_id);
+            dispatch_span->add_tag(LCBTRACE_TAG_LOCAL_ID, 0, local_id, 1);
             lcbtrace_span_add_host_and_port(dispatch_span, ctx->sock->info);
         }
         if (dispatch_span->should_finish()) {
@@ -442,8 +718,15 @@ using namespace lcb::trace;
 
 Span::Span(lcbtrace_TRACER *tracer, const char *opname, uint64_t start, lcbtrace_REF_TYPE ref, lcbtrace_SPAN *other,
            void *external_span)
-    : m_tracer(tracer), m_opname(opname), m_extspan(external_span)
+    : m_tracer(tracer), m_opname(nullptr), m_extspan(external_span)
 {
+    if (opname != nullptr) {
+        m_opname = intern_operation_name(opname);
+    }
+    if (m_opname == nullptr) {
+        m_opname_copy = opname ? opname : "";
+        m_opname = m_opname_copy.c_str();
+    }
     if (other != nullptr && ref == LCBTRACE_REF_CHILD_OF) {
         m_parent = other;
     } else {
@@ -478,17 +761,24 @@ Span::~Span()
         {
             tag_value *val = SLLIST_ITEM(iter.cur, tag_value, slnode);
             sllist_iter_remove(&m_tags, &iter);
-            if (val->key.need_free) {
-                free(val->key.p);
-            }
-            if (val->t == TAGVAL_STRING && val->v.s.need_free) {
-                free(val->v.s.p);
-            }
-            free(val);
+            free_tag(val);
         }
     }
 }
 
+void *Span::operator new(size_t size)
+{
+    if (size != sizeof(Span)) {
+        return ::operator new(size);
+    }
+    return SpanCache::allocate();
+}
+
+void Span::operator delete(void *ptr)
+{
+    SpanCache::release(ptr);
+}
+
 void Span::service(lcbtrace_THRESHOLDOPTS svc)
 {
     m_svc = svc;
@@ -647,17 +937,13 @@ void Span::add_tag(const char *name, int copy_key, const char *value, size_t val
         m_parent->add_tag(name, copy_key, value, value_len, copy_value);
         return;
     }
-    auto *val = (tag_value *)calloc(1, sizeof(tag_value));
-    val->t = TAGVAL_STRING;
-    val->key.need_free = copy_key;
-    if (copy_key) {
-        val->key.p = lcb_strdup(name);
-    } else {
-        val->key.p = (char *)name;
-    }
-    val->v.s.need_free = copy_value;
+    tag_value *val = new_tag(name, copy_key, TAGVAL_STRING);
     val->v.s.l = value_len;
-    if (copy_value) {
+    if (copy_value && value_len <= sizeof(val->inline_value)) {
+        memcpy(val->inline_value, value, value_len);
+        val->v.s.p = val->inline_value;
+    } else if (copy_value) {
+        val->v.s.need_free = 1;
         val->v.s.p = (char *)calloc(value_len, sizeof(char));
         memcpy(val->v.s.p, value, value_len);
     } else {
@@ -678,14 +964,7 @@ void Span::add_tag(const char *name, int copy, uint64_t value)
         m_parent->add_tag(name, copy, value);
         return;
     }
-    auto *val = (tag_value *)calloc(1, sizeof(tag_value));
-    val->t = TAGVAL_UINT64;
-    val->key.need_free = copy;
-    if (copy) {
-        val->key.p = lcb_strdup(name);
-    } else {
-        val->key.p = (char *)name;
-    }
+    tag_value *val = new_tag(name, copy, TAGVAL_UINT64);
     val->v.u64 = value;
     sllist_append(&m_tags, &val->slnode);
 }
@@ -696,14 +975,7 @@ void Span::add_tag(const char *name, int copy, double value)
         m_parent->add_tag(name, copy, value);
         return;
     }
-    auto *val = (tag_value *)calloc(1, sizeof(tag_value));
-    val->t = TAGVAL_DOUBLE;
-    val->key.need_free = copy;
-    if (copy) {
-        val->key.p = lcb_strdup(name);
-    } else {
-        val->key.p = (char *)name;
-    }
+    tag_value *val = new_tag(name, copy, TAGVAL_DOUBLE);
     val->v.d = value;
     sllist_append(&m_tags, &val->slnode);
 }
@@ -714,14 +986,7 @@ void Span::add_tag(const char *name, int copy, bool value)
         m_parent->add_tag(name, copy, value);
         return;
     }
-    auto *val = (tag_value *)calloc(1, sizeof(tag_value));
-    val->t = TAGVAL_BOOL;
-    val->key.need_free = copy;
-    if (copy) {
-        val->key.p = lcb_strdup(name);
-    } else {
-        val->key.p = (char *)name;
-    }
+    tag_value *val = new_tag(name, copy, TAGVAL_BOOL);
     val->v.b = value;
     sllist_append(&m_tags, &val->slnode);
 }
@@ -81,47 +81,78 @@ QueueEntry ThresholdLoggingTracer::convert(lcbtrace_SPAN *span)
 {
     QueueEntry orphan;
     orphan.duration = span->duration();
-    Json::Value entry;
+    if (span->m_opname == span->m_opname_copy.c_str()) {
+        orphan.operation_name_copy = span->m_opname_copy;
+    } else {
+        orphan.operation_name = span->m_opname;
+    }
     char *value, *value2;
     size_t nvalue, nvalue2;
 
-    entry["operation_name"] = std::string(span->m_opname);
     if (lcbtrace_span_get_tag_str(span, LCBTRACE_TAG_OPERATION_ID, &value, &nvalue) == LCB_SUCCESS) {
-        entry["last_operation_id"] = std::string(value, value + nvalue);
+        orphan.last_operation_id.assign(value, nvalue);
     }
     if (lcbtrace_span_get_tag_str(span, LCBTRACE_TAG_LOCAL_ID, &value, &nvalue) == LCB_SUCCESS) {
-        entry["last_local_id"] = std::string(value, value + nvalue);
+        orphan.last_local_id.assign(value, nvalue);
     }
     if (lcbtrace_span_get_tag_str(span, LCBTRACE_TAG_LOCAL_ADDRESS, &value, &nvalue) == LCB_SUCCESS) {
         if (lcbtrace_span_get_tag_str(span, LCBTRACE_TAG_LOCAL_PORT, &value2, &nvalue2) == LCB_SUCCESS) {
-            std::string address(value, value + nvalue);
-            address.append(":");
-            address.append(value2, nvalue2);
-            entry["last_local_socket"] = address;
+            orphan.last_local_socket.assign(value, nvalue);
+            orphan.last_local_socket.append(":");
+            orphan.last_local_socket.append(value2, nvalue2);
         }
     }
     if (lcbtrace_span_get_tag_str(span, LCBTRACE_TAG_PEER_ADDRESS, &value, &nvalue) == LCB_SUCCESS) {
         if (lcbtrace_span_get_tag_str(span, LCBTRACE_TAG_PEER_PORT, &value2, &nvalue2) == LCB_SUCCESS) {
-            std::string address(value, value + nvalue);
-            address.append(":");
-            address.append(value2, nvalue2);
-            entry["last_remote_socket"] = address;
+            orphan.last_remote_socket.assign(value, nvalue);
+            orphan.last_remote_socket.append(":");
+            orphan.last_remote_socket.append(value2, nvalue2);
         }
     }
     if (span->service() == LCBTRACE_THRESHOLD_KV) {
-        entry["last_server_duration_us"] = (Json::UInt64)span->m_last_server;
-        entry["total_server_duration_us"] = (Json::UInt64)span->m_total_server;
+        orphan.has_server_duration = true;
+        orphan.last_server_duration = span->m_last_server;
+        orphan.total_server_duration = span->m_total_server;
     }
-    if (span->m_encode > 0) {
-        entry["encode_duration_us"] = (Json::UInt64)span->m_encode;
-    }
-    entry["total_duration_us"] = (Json::UInt64)orphan.duration;
-    entry["last_dispatch_duration_us"] = (Json::UInt64)span->m_last_dispatch;
-    entry["total_dispatch_duration_us"] = (Json::UInt64)span->m_total_dispatch;
-    orphan.payload = Json::FastWriter().write(entry);
+    orphan.encode_duration = span->m_encode;
+    orphan.last_dispatch_duration = span->m_last_dispatch;
+    orphan.total_dispatch_duration = span->m_total_dispatch;
     return orphan;
 }
 
+static Json::Value encode_entry(const QueueEntry &span)
+{
+    Json::Value entry;
+    if (span.operation_name != nullptr) {
+        entry["operation_name"] = span.operation_name;
+    } else {
+        entry["operation_name"] = span.operation_name_copy;
+    }
+    if (!span.last_operation_id.empty()) {
+        entry["last_operation_id"] = span.last_operation_id;
+    }
+    if (!span.last_local_id.empty()) {
+        entry["last_local_id"] = span.last_local_id;
+    }
+    if (!span.last_local_socket.empty()) {
+        entry["last_local_socket"] = span.last_local_socket;
+    }
+    if (!span.last_remote_socket.empty()) {
+        entry["last_remote_socket"] = span.last_remote_socket;
+    }
+    if (span.has_server_duration) {
+        entry["last_server_duration_us"] = (Json::UInt64)span.last_server_duration;
+        entry["total_server_duration_us"] = (Json::UInt64)span.total_server_duration;
+    }
+    if (span.encode_duration > 0) {
+        entry["encode_duration_us"] = (Json::UInt64)span.encode_duration;
+    }
+    entry["total_duration_us"] = (Json::UInt64)span.duration;
+    entry["last_dispatch_duration_us"] = (Json::UInt64)span.last_dispatch_duration;
+    entry["total_dispatch_duration_us"] = (Json::UInt64)span.total_dispatch_duration;
+    return entry;
+}
+
 void ThresholdLoggingTracer::add_orphan(lcbtrace_SPAN *span)
 {
     m_orphans.push(convert(span));
@@ -158,10 +189,7 @@ void ThresholdLoggingTracer::flush_queue(FixedSpanQueue &queue, const char *mess
     entries["count"] = (Json::UInt)queue.size();
     Json::Value top;
     while (!queue.empty()) {
-        Json::Value entry;
-        if (Json::Reader().parse(queue.top().payload, entry)) {
-            top.append(entry);
-        }
+        top.append(encode_entry(queue.top()));
         queue.pop();
     }
     entries["top"] = top;
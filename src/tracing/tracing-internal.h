@@ -46,6 +46,14 @@ class Span
          void *external_span);
     ~Span();
 
+    /**
+     * Spans are created and destroyed for every operation, so their storage
+     * is recycled through a small per-thread free list instead of going to
+     * the general purpose allocator each time.
+     */
+    static void *operator new(size_t size);
+    static void operator delete(void *ptr);
+
     void finish(uint64_t finish);
     uint64_t duration() const
     {
@@ -81,7 +89,9 @@ class Span
     void should_finish(bool finish);
 
     lcbtrace_TRACER *m_tracer;
-    std::string m_opname;
+    /** points either to the interned name of a well-known operation, or to m_opname_copy */
+    const char *m_opname;
+    std::string m_opname_copy;
     uint64_t m_span_id;
     uint64_t m_start;
     uint64_t m_finish{0};
@@ -102,9 +112,27 @@ class Span
     uint64_t m_encode{0};
 };
 
+/**
+ * Fixed-layout record of a span which has been selected for the threshold or
+ * orphan report. It is only encoded to JSON when the queue is flushed.
+ */
 struct ReportedSpan {
-    uint64_t duration;
-    std::string payload;
+    uint64_t duration{0};
+    /** interned name of a well-known operation (static storage, not owned), or
+     * NULL if the name is held by operation_name_copy */
+    const char *operation_name{nullptr};
+    /** owned copy of the name of the other operations */
+    std::string operation_name_copy{};
+    std::string last_operation_id{};
+    std::string last_local_id{};
+    std::string last_local_socket{};
+    std::string last_remote_socket{};
+    bool has_server_duration{false};
+    uint64_t last_server_duration{0};
+    uint64_t total_server_duration{0};
+    uint64_t encode_duration{0};
+    uint64_t last_dispatch_duration{0};
+    uint64_t total_dispatch_duration{0};
 
     bool operator<(const ReportedSpan &rhs) const
     {
@@ -118,9 +146,9 @@ class FixedQueue : private std::priority_queue<T>
   public:
     explicit FixedQueue(size_t capacity) : m_capacity(capacity) {}
 
-    void push(const T &item)
+    void push(T &&item)
     {
-        std::priority_queue<T>::push(item);
+        std::priority_queue<T>::push(std::move(item));
         if (this->size() > m_capacity) {
             this->c.pop_back();
         }
@@ -164,14 +192,44 @@ class ThresholdLoggingTracer
     lcb::io::Timer<ThresholdLoggingTracer, &ThresholdLoggingTracer::flush_threshold> m_tflush;
 };
 
+/**
+ * Head-based sampling. Returns true if the operation, which does not have
+ * parent span, has been selected to be traced according to the sample rate.
+ */
+bool sample_span(const lcb_settings *settings);
+
+/**
+ * Returns true if the KV spans should not be created upfront, but only
+ * materialized for slow, failed or orphaned operations.
+ */
+bool is_tail_based(const lcb_settings *settings);
+
+/**
+ * Builds the span for the KV request in tail-based mode, using the time when
+ * the packet was scheduled. Returns nullptr if the packet does not represent
+ * traceable operation.
+ */
+lcbtrace_SPAN *materialize_kv_span(const mc_PIPELINE *pipeline, const mc_PACKET *packet);
+
+/**
+ * Returns true if the KV status indicates failure of the request, which should
+ * be kept in tail-based mode. Expected outcomes of the operation (missing key,
+ * CAS mismatch, subdoc path errors etc.) are not failures, otherwise every
+ * get-miss would produce a span.
+ */
+bool is_kv_failure_status(uint16_t status);
+
 template <typename COMMAND>
-lcbtrace_SPAN *start_kv_span(const lcb_settings *settings, const mc_PACKET *packet, std::shared_ptr<COMMAND> cmd)
+lcbtrace_SPAN *start_kv_span(const lcb_settings *settings, const mc_PACKET *packet, const COMMAND &cmd)
 {
     if (settings == nullptr || settings->tracer == nullptr) {
         return nullptr;
     }
     lcbtrace_SPAN *span;
     lcbtrace_SPAN *parent_span = cmd->parent_span();
+    if (parent_span == nullptr && (is_tail_based(settings) || !sample_span(settings))) {
+        return nullptr;
+    }
     if (parent_span != nullptr && parent_span->is_outer() && settings->tracer->flags & LCBTRACE_F_THRESHOLD) {
         span = parent_span;
         span->should_finish(false);
@@ -187,8 +245,9 @@ lcbtrace_SPAN *start_kv_span(const lcb_settings *settings, const mc_PACKET *pack
         span->is_outer(!is_dispatch);
     }
     span->is_dispatch(true);
-    std::string operation_id = std::to_string(packet->opaque);
-    lcbtrace_span_add_tag_str(span, LCBTRACE_TAG_OPERATION_ID, operation_id.c_str());
+    char operation_id[16];
+    int operation_id_len = snprintf(operation_id, sizeof(operation_id), "%u", (unsigned)packet->opaque);
+    span->add_tag(LCBTRACE_TAG_OPERATION_ID, 0, operation_id, operation_id_len, 1);
     lcbtrace_span_add_system_tags(span, settings, LCBTRACE_THRESHOLD_KV);
     span->add_tag(LCBTRACE_TAG_SCOPE, cmd->collection().scope());
     span->add_tag(LCBTRACE_TAG_COLLECTION, cmd->collection().collection());
@@ -200,7 +259,7 @@ void finish_kv_span(const mc_PIPELINE *pipeline, const mc_PACKET *request_pkt, c
 
 template <typename COMMAND>
 lcbtrace_SPAN *start_kv_span_with_durability(const lcb_settings *settings, const mc_PACKET *packet,
-                                             std::shared_ptr<COMMAND> cmd)
+                                             const COMMAND &cmd)
 {
     lcbtrace_SPAN *span = start_kv_span(settings, packet, cmd);
     if (span != nullptr && cmd->durability_level() != LCB_DURABILITYLEVEL_NONE) {
@@ -217,6 +276,9 @@ lcbtrace_SPAN *start_http_span(const lcb_settings *settings, const COMMAND *cmd)
     }
     lcbtrace_SPAN *span;
     lcbtrace_SPAN *parent_span = cmd->parent_span();
+    if (parent_span == nullptr && !sample_span(settings)) {
+        return nullptr;
+    }
     if (parent_span != nullptr && parent_span->is_outer() && settings->tracer->flags & LCBTRACE_F_THRESHOLD) {
         span = parent_span;
         span->should_finish(false);
@@ -232,7 +294,8 @@ lcbtrace_SPAN *start_http_span(const lcb_settings *settings, const COMMAND *cmd)
         span->is_outer(!is_dispatch);
     }
     span->is_dispatch(true);
-    lcbtrace_span_add_tag_str(span, LCBTRACE_TAG_OPERATION_ID, cmd->client_context_id().c_str());
+    const std::string &operation_id = cmd->client_context_id();
+    span->add_tag(LCBTRACE_TAG_OPERATION_ID, 0, operation_id.c_str(), operation_id.size(), 1);
     lcbtrace_span_add_system_tags(span, settings, cmd->service());
     span->add_tag(LCBTRACE_TAG_OPERATION, cmd->operation_name());
     return span;
@@ -111,6 +111,29 @@ void lcb_VIEW_HANDLE_::invoke_last(lcb_STATUS err)
     if (http_request_ != nullptr) {
         record_http_op_latency((design_document_ + "/" + view_).c_str(), "views", instance_, http_request_->start);
     }
+    if (document_queue_ != nullptr) {
+        const lcb::docreq::Queue::Stats &stats = document_queue_->stats;
+        fetch_stats_.fetched = stats.fetched;
+        fetch_stats_.failed = stats.failed;
+        fetch_stats_.window = document_queue_->window_size();
+        fetch_stats_.max_window = stats.max_window;
+        fetch_stats_.window_decreases = 0;
+        for (const auto &node : document_queue_->nodes) {
+            fetch_stats_.window_decreases += node.window.decreases();
+        }
+        if (stats.last_response > stats.first_request) {
+            fetch_stats_.elapsed_us = LCB_NS2US(stats.last_response - stats.first_request);
+        }
+        if (fetch_stats_.elapsed_us) {
+            fetch_stats_.docs_per_second = fetch_stats_.fetched * 1e6 / fetch_stats_.elapsed_us;
+        }
+        lcb_log(LOGARGS(instance_, DEBUG),
+                "Fetched %" PRIu64 " documents (%" PRIu64 " failed) in %" PRIu64
+                "us, window %u (max %u, %u decreases)",
+                fetch_stats_.fetched, fetch_stats_.failed, fetch_stats_.elapsed_us, fetch_stats_.window,
+                fetch_stats_.max_window, fetch_stats_.window_decreases);
+        resp.fetch_stats = &fetch_stats_;
+    }
 
     callback_(instance_, LCB_CALLBACK_VIEWQUERY, &resp);
     cancel();
@@ -241,7 +264,7 @@ static void doc_callback(lcb_INSTANCE *, int, const lcb_RESPGET *resp)
 
     q->ref();
 
-    q->n_awaiting_response--;
+    q->complete(dreq, resp->ctx.rc);
     dreq->docresp = *resp;
     dreq->ready = 1;
     dreq->docresp.ctx.key.assign((const char *)dreq->docid.iov_base, dreq->docid.iov_len);
@@ -152,6 +152,7 @@ struct lcb_VIEW_HANDLE_ : lcb::jsparse::Parser::Actions {
     lcb::jsparse::Parser *parser_{nullptr};
     void *cookie_{nullptr};
     lcb::docreq::Queue *document_queue_{nullptr};
+    lcb_VIEW_FETCH_STATS fetch_stats_{};
     lcb_VIEW_CALLBACK callback_{nullptr};
     lcb_INSTANCE *instance_{nullptr};
 
@@ -0,0 +1,142 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include "tools/import/bulk_loader.h"
+
+#include <stdexcept>
+
+using cbc::BulkRecord;
+using cbc::RecordReader;
+
+class BulkLoaderTests : public ::testing::Test
+{
+  protected:
+    static std::string value(const BulkRecord &record)
+    {
+        return std::string(record.value, record.nvalue);
+    }
+};
+
+TEST_F(BulkLoaderTests, testIsNumber)
+{
+    ASSERT_TRUE(cbc::is_number("0"));
+    ASSERT_TRUE(cbc::is_number("42"));
+    ASSERT_TRUE(cbc::is_number("-42"));
+    ASSERT_TRUE(cbc::is_number("3.14"));
+    ASSERT_TRUE(cbc::is_number("-0.5e10"));
+    ASSERT_TRUE(cbc::is_number("1E+3"));
+
+    // zip codes and phone numbers stay strings
+    ASSERT_FALSE(cbc::is_number("01234"));
+    ASSERT_FALSE(cbc::is_number("+1"));
+    ASSERT_FALSE(cbc::is_number(""));
+    ASSERT_FALSE(cbc::is_number("-"));
+    ASSERT_FALSE(cbc::is_number("1."));
+    ASSERT_FALSE(cbc::is_number(".5"));
+    ASSERT_FALSE(cbc::is_number("1e"));
+    ASSERT_FALSE(cbc::is_number("12abc"));
+    ASSERT_FALSE(cbc::is_number(" 1"));
+}
+
+TEST_F(BulkLoaderTests, testJsonLines)
+{
+    std::string input = "{\"id\":\"a\",\"v\":1}\r\n\n{\"id\":7}\nnot json\n{\"v\":2}\n{\"id\":\"b\"}";
+    RecordReader reader(input.data(), input.size(), RecordReader::JSON_LINES, "id", "doc::");
+    std::vector<std::size_t> errors;
+    reader.on_error([&errors](std::size_t line, const std::string &) { errors.push_back(line); });
+
+    BulkRecord record;
+    ASSERT_TRUE(reader.next(record));
+    ASSERT_EQ("doc::a", record.key);
+    ASSERT_EQ("{\"id\":\"a\",\"v\":1}", value(record));
+    ASSERT_EQ(1, record.line);
+    ASSERT_TRUE(reader.next(record));
+    ASSERT_EQ("doc::7", record.key);
+    ASSERT_EQ(3, record.line);
+    ASSERT_TRUE(reader.next(record));
+    ASSERT_EQ("doc::b", record.key);
+    ASSERT_EQ(6, record.line);
+    ASSERT_FALSE(reader.next(record));
+
+    ASSERT_EQ(2, reader.skipped());
+    ASSERT_EQ(std::vector<std::size_t>({4, 5}), errors);
+    ASSERT_EQ(input.size(), reader.position());
+}
+
+TEST_F(BulkLoaderTests, testJsonLinesGeneratedKeys)
+{
+    std::string input = "{\"v\":1}\n{\"v\":2}\n";
+    RecordReader reader(input.data(), input.size(), RecordReader::JSON_LINES, "", "row_");
+    BulkRecord record;
+    ASSERT_TRUE(reader.next(record));
+    ASSERT_EQ("row_1", record.key);
+    ASSERT_TRUE(reader.next(record));
+    ASSERT_EQ("row_2", record.key);
+    ASSERT_EQ("{\"v\":2}", value(record));
+    ASSERT_FALSE(reader.next(record));
+}
+
+TEST_F(BulkLoaderTests, testCsvQuoting)
+{
+    std::string input = "id,name,zip,score\r\n"
+                        "1,\"Smith, John\",01234,4.5\r\n"
+                        "2,\"say \"\"hi\"\"\nthere\",,-3\n"
+                        "\n"
+                        "3,too,many,fields,here\n"
+                        ",empty,id,0\n"
+                        "4,last,00000,1e3";
+    RecordReader reader(input.data(), input.size(), RecordReader::CSV, "id", "");
+    std::vector<std::size_t> errors;
+    reader.on_error([&errors](std::size_t line, const std::string &) { errors.push_back(line); });
+
+    BulkRecord record;
+    ASSERT_TRUE(reader.next(record));
+    ASSERT_EQ("1", record.key);
+    ASSERT_EQ(2, record.line);
+    ASSERT_EQ("{\"id\":1,\"name\":\"Smith, John\",\"score\":4.5,\"zip\":\"01234\"}", value(record));
+
+    // the quoted field spans two lines
+    ASSERT_TRUE(reader.next(record));
+    ASSERT_EQ("2", record.key);
+    ASSERT_EQ(3, record.line);
+    ASSERT_EQ("{\"id\":2,\"name\":\"say \\\"hi\\\"\\nthere\",\"score\":-3,\"zip\":\"\"}", value(record));
+
+    ASSERT_TRUE(reader.next(record));
+    ASSERT_EQ("4", record.key);
+    ASSERT_EQ(8, record.line);
+    ASSERT_EQ("{\"id\":4,\"name\":\"last\",\"score\":1000,\"zip\":\"00000\"}", value(record));
+    ASSERT_FALSE(reader.next(record));
+
+    ASSERT_EQ(2, reader.skipped());
+    ASSERT_EQ(std::vector<std::size_t>({6, 7}), errors);
+}
+
+TEST_F(BulkLoaderTests, testCsvHeader)
+{
+    std::string input = "name,zip\nJohn,01234\n";
+    ASSERT_THROW(RecordReader(input.data(), input.size(), RecordReader::CSV, "id", ""), std::runtime_error);
+    ASSERT_THROW(RecordReader(input.data(), 0, RecordReader::CSV, "", ""), std::runtime_error);
+
+    RecordReader reader(input.data(), input.size(), RecordReader::CSV, "", "user_");
+    BulkRecord record;
+    ASSERT_TRUE(reader.next(record));
+    ASSERT_EQ("user_1", record.key);
+    ASSERT_EQ("{\"name\":\"John\",\"zip\":\"01234\"}", value(record));
+    ASSERT_FALSE(reader.next(record));
+}
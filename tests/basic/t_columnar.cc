@@ -0,0 +1,313 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+#include "jsparse/parser.h"
+#include "jsparse/columnar.h"
+#include "contrib/lcb-jsoncpp/lcb-jsoncpp.h"
+#include <clocale>
+
+class ColumnarTest : public ::testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+        schema = std::make_shared<lcb_COLUMN_SCHEMA>();
+    }
+
+    void addColumn(const std::string &path, lcb_COLUMN_TYPE type)
+    {
+        ASSERT_EQ(LCB_SUCCESS, schema->add(path.c_str(), path.size(), type));
+    }
+
+    std::shared_ptr<lcb_COLUMN_SCHEMA> schema;
+};
+
+static std::string column_string(const lcb_COLUMN_STRING &value)
+{
+    return std::string(value.data, value.length);
+}
+
+TEST_F(ColumnarTest, testSchema)
+{
+    ASSERT_EQ(LCB_ERR_INVALID_ARGUMENT, schema->add("a..b", 4, LCB_COLUMN_INT64));
+    ASSERT_EQ(LCB_ERR_INVALID_ARGUMENT, schema->add(".a", 2, LCB_COLUMN_INT64));
+    ASSERT_EQ(LCB_ERR_INVALID_ARGUMENT, schema->add("a.", 2, LCB_COLUMN_INT64));
+    ASSERT_EQ(LCB_ERR_INVALID_ARGUMENT, schema->batch_size(0));
+    ASSERT_EQ(LCB_SUCCESS, schema->add("", 0, LCB_COLUMN_STRING));
+    ASSERT_EQ(LCB_SUCCESS, schema->add("a.b", 3, LCB_COLUMN_INT64));
+    ASSERT_EQ(LCB_SUCCESS, schema->add("a.b", 3, LCB_COLUMN_DOUBLE));
+    ASSERT_EQ(3, schema->types().size());
+
+    lcb_COLUMN_BATCH batch(schema);
+    const int64_t *ints;
+    const double *doubles;
+    const uint8_t *valid;
+    ASSERT_EQ(LCB_SUCCESS, batch.int64_values(1, &ints, &valid));
+    ASSERT_EQ(LCB_SUCCESS, batch.double_values(2, &doubles, &valid));
+    ASSERT_EQ(LCB_ERR_INVALID_ARGUMENT, batch.int64_values(2, &ints, &valid));
+    ASSERT_EQ(LCB_ERR_INVALID_ARGUMENT, batch.int64_values(3, &ints, &valid));
+}
+
+TEST_F(ColumnarTest, testDecode)
+{
+    addColumn("id", LCB_COLUMN_INT64);
+    addColumn("geo.lat", LCB_COLUMN_DOUBLE);
+    addColumn("name", LCB_COLUMN_STRING);
+    addColumn("active", LCB_COLUMN_BOOLEAN);
+    addColumn("id", LCB_COLUMN_DOUBLE);
+
+    std::vector<std::string> rows = {
+        R"({"id":10,"name":"plain","geo":{"alt":[1,{"lat":0}],"lat":-1.5e2},"active":true})",
+        R"( { "skip" : {"name":"nested"} , "name" : "esc\"aped\u00e9\ud83d\ude00" , "id" : -9223372036854775808 } )",
+        R"({"id":9223372036854775808,"geo":null,"name":42,"active":"yes"})",
+        R"({"id":1.5,"geo":{"lat":7},"active":false,"name":null})",
+    };
+    lcb_COLUMN_BATCH batch(schema);
+    for (const auto &row : rows) {
+        ASSERT_TRUE(batch.append(row.c_str(), row.size(), true)) << row;
+    }
+    ASSERT_EQ(4, batch.rows());
+
+    const int64_t *ids;
+    const double *lats, *dids;
+    const lcb_COLUMN_STRING *names;
+    const uint8_t *flags;
+    const uint8_t *id_valid, *lat_valid, *name_valid, *flag_valid, *did_valid;
+    ASSERT_EQ(LCB_SUCCESS, batch.int64_values(0, &ids, &id_valid));
+    ASSERT_EQ(LCB_SUCCESS, batch.double_values(1, &lats, &lat_valid));
+    ASSERT_EQ(LCB_SUCCESS, batch.string_values(2, &names, &name_valid));
+    ASSERT_EQ(LCB_SUCCESS, batch.boolean_values(3, &flags, &flag_valid));
+    ASSERT_EQ(LCB_SUCCESS, batch.double_values(4, &dids, &did_valid));
+
+    ASSERT_TRUE(id_valid[0]);
+    ASSERT_EQ(10, ids[0]);
+    ASSERT_TRUE(lat_valid[0]);
+    ASSERT_EQ(-150.0, lats[0]);
+    ASSERT_TRUE(name_valid[0]);
+    ASSERT_EQ("plain", column_string(names[0]));
+    // strings without escape sequences reference the row
+    ASSERT_TRUE(names[0].data > rows[0].data() && names[0].data < rows[0].data() + rows[0].size());
+    ASSERT_TRUE(flag_valid[0]);
+    ASSERT_EQ(1, flags[0]);
+    ASSERT_TRUE(did_valid[0]);
+    ASSERT_EQ(10.0, dids[0]);
+
+    ASSERT_TRUE(id_valid[1]);
+    ASSERT_EQ(INT64_MIN, ids[1]);
+    ASSERT_FALSE(lat_valid[1]);
+    ASSERT_EQ("esc\"aped\xc3\xa9\xf0\x9f\x98\x80", column_string(names[1]));
+    ASSERT_FALSE(flag_valid[1]);
+
+    // values of the wrong type are not valid
+    ASSERT_FALSE(id_valid[2]);
+    ASSERT_TRUE(did_valid[2]);
+    ASSERT_EQ(9223372036854775808.0, dids[2]);
+    ASSERT_FALSE(lat_valid[2]);
+    ASSERT_FALSE(name_valid[2]);
+    ASSERT_FALSE(flag_valid[2]);
+
+    ASSERT_FALSE(id_valid[3]);
+    ASSERT_TRUE(did_valid[3]);
+    ASSERT_EQ(1.5, dids[3]);
+    ASSERT_TRUE(lat_valid[3]);
+    ASSERT_EQ(7.0, lats[3]);
+    ASSERT_TRUE(flag_valid[3]);
+    ASSERT_EQ(0, flags[3]);
+    ASSERT_FALSE(name_valid[3]);
+
+    batch.clear();
+    ASSERT_EQ(0, batch.rows());
+}
+
+TEST_F(ColumnarTest, testRawRowsAndInvalidRows)
+{
+    addColumn("", LCB_COLUMN_STRING);
+    addColumn("", LCB_COLUMN_INT64);
+    schema->batch_size(2);
+
+    lcb_COLUMN_BATCH batch(schema);
+    std::string row = "\"value\"";
+    ASSERT_TRUE(batch.append(row.c_str(), row.size(), false));
+    row = "\"other\"";
+    // the row was copied
+    const lcb_COLUMN_STRING *values;
+    const uint8_t *valid;
+    ASSERT_EQ(LCB_SUCCESS, batch.string_values(0, &values, &valid));
+    ASSERT_EQ("value", column_string(values[0]));
+    ASSERT_FALSE(batch.full());
+
+    // the values, which are not referenced by the schema, are only checked for structure
+    const char *bad[] = {"{\"a\":1", "\"abc", "tru", "nul", "[1,2", "1 2", "\"\\x\"", "\"\\ud800\""};
+    for (const char *doc : bad) {
+        ASSERT_FALSE(batch.append(doc, strlen(doc), true)) << doc;
+    }
+    ASSERT_EQ(1, batch.rows());
+
+    ASSERT_TRUE(batch.append("42", 2, true));
+    ASSERT_TRUE(batch.full());
+    const int64_t *ints;
+    ASSERT_EQ(LCB_SUCCESS, batch.int64_values(1, &ints, &valid));
+    ASSERT_FALSE(valid[0]);
+    ASSERT_TRUE(valid[1]);
+    ASSERT_EQ(42, ints[1]);
+}
+
+namespace
+{
+/**
+ * Mimics the query handle: the rows are decoded while the response is split,
+ * and the batches are consumed after every chunk, or when they are full.
+ */
+struct ColumnarContext : lcb::jsparse::Parser::Actions {
+    explicit ColumnarContext(std::shared_ptr<const lcb_COLUMN_SCHEMA> schema) : batch(std::move(schema)) {}
+
+    void JSPARSE_on_row(const lcb::jsparse::Row &row) override
+    {
+        const char *data = static_cast<const char *>(row.row.iov_base);
+        bool stable = data >= chunk_begin && data + row.row.iov_len <= chunk_end;
+        if (!batch.append(data, row.row.iov_len, stable)) {
+            failed = true;
+        } else if (batch.full()) {
+            consume();
+        }
+    }
+    void JSPARSE_on_complete(const std::string &) override
+    {
+        done = true;
+    }
+    void JSPARSE_on_error(const std::string &) override
+    {
+        failed = true;
+    }
+
+    void feed(lcb::jsparse::Parser &parser, const char *data, size_t len)
+    {
+        chunk_begin = data;
+        chunk_end = data + len;
+        parser.feed(data, len);
+        consume();
+    }
+
+    void consume()
+    {
+        const int64_t *ids;
+        const double *lats;
+        const lcb_COLUMN_STRING *names;
+        const uint8_t *valid;
+        batch.int64_values(0, &ids, &valid);
+        for (size_t ii = 0; ii < batch.rows(); ii++) {
+            id_sum += valid[ii] ? ids[ii] : 0;
+        }
+        batch.double_values(1, &lats, &valid);
+        for (size_t ii = 0; ii < batch.rows(); ii++) {
+            lat_sum += valid[ii] ? lats[ii] : 0;
+        }
+        batch.string_values(2, &names, &valid);
+        for (size_t ii = 0; ii < batch.rows(); ii++) {
+            name_bytes += valid[ii] ? names[ii].length : 0;
+        }
+        nrows += batch.rows();
+        batch.clear();
+    }
+
+    lcb_COLUMN_BATCH batch;
+    const char *chunk_begin{nullptr};
+    const char *chunk_end{nullptr};
+    size_t nrows{0};
+    int64_t id_sum{0};
+    double lat_sum{0};
+    size_t name_bytes{0};
+    bool failed{false};
+    bool done{false};
+};
+} // namespace
+
+TEST_F(ColumnarTest, testChunkedResponse)
+{
+    const size_t nrows = 50;
+    addColumn("id", LCB_COLUMN_INT64);
+    addColumn("geo.lat", LCB_COLUMN_DOUBLE);
+    addColumn("name", LCB_COLUMN_STRING);
+    schema->batch_size(8);
+
+    std::string input = R"({"requestID":"1","signature":{"*":"*"},"results":[)";
+    int64_t expected_ids = 0;
+    size_t expected_name_bytes = 0;
+    for (size_t ii = 0; ii < nrows; ii++) {
+        std::string id = std::to_string(ii);
+        input.append(ii ? "," : "")
+            .append(R"({"id":)")
+            .append(id)
+            .append(R"(,"type":"airport","name":"Airport )")
+            .append(id)
+            .append(R"(","geo":{"alt":12,"lat":45.5,"lon":-73.25},"tags":["a","b"],"active":true})");
+        expected_ids += ii;
+        expected_name_bytes += strlen("Airport ") + id.size();
+    }
+    input.append(R"(],"status":"success","metrics":{"resultCount":50}})");
+
+    // small chunks split the rows, so that some of them have to be copied
+    const size_t chunk = 7;
+    ColumnarContext cx(schema);
+    lcb::jsparse::Parser parser(lcb::jsparse::Parser::MODE_N1QL, &cx);
+    for (size_t ii = 0; ii < input.size(); ii += chunk) {
+        cx.feed(parser, input.c_str() + ii, std::min(chunk, input.size() - ii));
+    }
+
+    ASSERT_FALSE(cx.failed);
+    ASSERT_TRUE(cx.done);
+    ASSERT_EQ(nrows, cx.nrows);
+    ASSERT_EQ(expected_ids, cx.id_sum);
+    ASSERT_EQ(45.5 * nrows, cx.lat_sum);
+    ASSERT_EQ(expected_name_bytes, cx.name_bytes);
+}
+
+TEST_F(ColumnarTest, testDoubles)
+{
+    addColumn("", LCB_COLUMN_DOUBLE);
+    const char *tokens[] = {"0.1",  "-2.5e-3", "1e22", "123456789012345678901234", "1.7976931348623157e308",
+                            "5e-324", "0.30000000000000004", "1E+2"};
+    const double expected[] = {0.1, -2.5e-3, 1e22, 123456789012345678901234.0, 1.7976931348623157e308,
+                               5e-324, 0.30000000000000004, 100.0};
+
+    // the conversion does not depend on the decimal separator of the C locale
+    std::string saved = setlocale(LC_NUMERIC, nullptr);
+    const char *locales[] = {"de_DE.UTF-8", "de_DE.utf8", "fr_FR.UTF-8", "ru_RU.UTF-8"};
+    for (const char *locale : locales) {
+        if (setlocale(LC_NUMERIC, locale) != nullptr) {
+            break;
+        }
+    }
+
+    lcb_COLUMN_BATCH batch(schema);
+    for (const char *token : tokens) {
+        EXPECT_TRUE(batch.append(token, strlen(token), true)) << token;
+    }
+    setlocale(LC_NUMERIC, saved.c_str());
+
+    const double *values;
+    const uint8_t *valid;
+    ASSERT_EQ(LCB_SUCCESS, batch.double_values(0, &values, &valid));
+    ASSERT_EQ(sizeof(tokens) / sizeof(tokens[0]), batch.rows());
+    for (size_t ii = 0; ii < batch.rows(); ii++) {
+        ASSERT_TRUE(valid[ii]) << tokens[ii];
+        ASSERT_EQ(expected[ii], values[ii]) << tokens[ii];
+    }
+}
@@ -107,6 +107,70 @@ TEST_F(CtlTest, testStringCtls)
     ASSERT_EQ(LCB_SUCCESS, err);
     ASSERT_EQ(LCB_COMPRESS_IN, getSetting< lcb_COMPRESSOPTS >(instance, LCB_CNTL_COMPRESSION_OPTS));
 
+    err = lcb_cntl_string(instance, "http_max_connections_per_node", "4");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(4, getSetting< lcb_SIZE >(instance, LCB_CNTL_HTTP_MAX_CONNECTIONS_PER_NODE));
+
+    err = lcb_cntl_string(instance, "http_warmup_connections", "2");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(2, getSetting< lcb_U32 >(instance, LCB_CNTL_HTTP_WARMUP_CONNECTIONS));
+
+    ASSERT_EQ(0, getSetting< int >(instance, LCB_CNTL_ENABLE_HTTP2));
+    err = lcb_cntl_string(instance, "enable_http2", "true");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(1, getSetting< int >(instance, LCB_CNTL_ENABLE_HTTP2));
+
+    ASSERT_EQ(5000, getSetting< lcb_SIZE >(instance, LCB_CNTL_N1QL_CACHE_SIZE));
+    err = lcb_cntl_string(instance, "n1ql_cache_size", "100");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(100, getSetting< lcb_SIZE >(instance, LCB_CNTL_N1QL_CACHE_SIZE));
+    err = lcb_cntl_string(instance, "n1ql_cache_size", "0");
+    ASSERT_NE(LCB_SUCCESS, err);
+    err = lcb_cntl_string(instance, "n1ql_shared_cache", "true");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(1, getSetting< int >(instance, LCB_CNTL_N1QL_SHARED_CACHE));
+    lcb_N1QL_CACHE_STATS stats{};
+    err = lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_N1QL_CACHE_STATS, &stats);
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(0, stats.size);
+
+    ASSERT_EQ(0, getSetting< int >(instance, LCB_CNTL_OPTIMISTIC_NEGOTIATION));
+    err = lcb_cntl_string(instance, "optimistic_negotiation", "true");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(1, getSetting< int >(instance, LCB_CNTL_OPTIMISTIC_NEGOTIATION));
+
+    ASSERT_EQ(1, getSetting< int >(instance, LCB_CNTL_TLS_SESSION_CACHE));
+    err = lcb_cntl_string(instance, "tls_session_cache", "false");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(0, getSetting< int >(instance, LCB_CNTL_TLS_SESSION_CACHE));
+    lcb_TLS_SESSION_STATS tls_stats{};
+    err = lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_TLS_SESSION_STATS, &tls_stats);
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(0, tls_stats.full_handshakes);
+    ASSERT_EQ(0, getSetting< int >(instance, LCB_CNTL_ENABLE_KTLS));
+    err = lcb_cntl_string(instance, "enable_ktls", "true");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(1, getSetting< int >(instance, LCB_CNTL_ENABLE_KTLS));
+
+    ASSERT_EQ(0, getSetting< int >(instance, LCB_CNTL_PIPELINE_LATENCY));
+    err = lcb_cntl_string(instance, "pipeline_latency", "true");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(1, getSetting< int >(instance, LCB_CNTL_PIPELINE_LATENCY));
+    lcb_METRICS *metrics = nullptr;
+    err = lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_METRICS, &metrics);
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_NE(nullptr, metrics);
+
+    ASSERT_EQ(LCB_S2US(60), getSetting< lcb_U32 >(instance, LCB_CNTL_DNS_CACHE_TTL));
+    err = lcb_cntl_string(instance, "dns_cache_ttl", "2.5");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(2500000U, getSetting< lcb_U32 >(instance, LCB_CNTL_DNS_CACHE_TTL));
+
+    ASSERT_EQ(0, getSetting< int >(instance, LCB_CNTL_KV_PRECONNECT));
+    err = lcb_cntl_string(instance, "kv_preconnect", "true");
+    ASSERT_EQ(LCB_SUCCESS, err);
+    ASSERT_EQ(1, getSetting< int >(instance, LCB_CNTL_KV_PRECONNECT));
+
     err = lcb_cntl_string(instance, "unsafe_optimize", "1");
     ASSERT_EQ(LCB_SUCCESS, err);
     err = lcb_cntl_string(instance, "unsafe_optimize", "0");
@@ -0,0 +1,182 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include "internal.h"
+#include "docreq/docreq.h"
+
+using lcb::docreq::AdaptiveWindow;
+
+class DocreqTests : public ::testing::Test
+{
+};
+
+static const hrtime_t usec = 1000;
+
+TEST_F(DocreqTests, testWindowGrowth)
+{
+    AdaptiveWindow window(10, 64);
+    ASSERT_EQ(10, window.size());
+
+    hrtime_t now = 1000000;
+    // every round trip adds one document to the window
+    for (unsigned rtt = 0; rtt < 10; rtt++) {
+        unsigned size = window.size();
+        for (unsigned ii = 0; ii < size; ii++) {
+            window.on_success(now, now + 200 * usec);
+        }
+        now += 200 * usec;
+        ASSERT_EQ(size + 1, window.size());
+    }
+
+    // but never beyond the maximum
+    for (unsigned ii = 0; ii < 10000; ii++) {
+        window.on_success(now, now + 200 * usec);
+    }
+    ASSERT_EQ(64, window.size());
+    ASSERT_EQ(0, window.decreases());
+
+    AdaptiveWindow small(10, 4);
+    ASSERT_EQ(4, small.size());
+    AdaptiveWindow empty(0, 0);
+    ASSERT_EQ(1, empty.size());
+}
+
+TEST_F(DocreqTests, testWindowDecrease)
+{
+    AdaptiveWindow window(32, 64);
+    hrtime_t now = 1000000;
+    for (unsigned ii = 0; ii < 10; ii++) {
+        window.on_success(now, now + 500 * usec);
+    }
+    unsigned size = window.size();
+
+    // errors of the requests sent in the same round trip halve the window once
+    now += 1000 * usec;
+    window.on_failure(now, now + 100 * usec);
+    window.on_failure(now, now + 200 * usec);
+    window.on_failure(now, now + 300 * usec);
+    ASSERT_EQ(size / 2, window.size());
+    ASSERT_EQ(1, window.decreases());
+
+    // the requests sent after the decrease shrink it again
+    now += 1000 * usec;
+    window.on_failure(now, now + 100 * usec);
+    ASSERT_EQ(size / 4, window.size());
+    ASSERT_EQ(2, window.decreases());
+
+    // latency spike is treated as congestion
+    now += 1000 * usec;
+    window.on_success(now, now + 500 * usec * AdaptiveWindow::latency_factor * 2);
+    ASSERT_EQ(size / 8, window.size());
+    ASSERT_EQ(3, window.decreases());
+
+    // window never goes below single document
+    for (unsigned ii = 0; ii < 10; ii++) {
+        now += 1000 * usec;
+        window.on_failure(now, now + 100 * usec);
+    }
+    ASSERT_EQ(1, window.size());
+}
+
+TEST_F(DocreqTests, testSmallLatenciesAreNotCongestion)
+{
+    AdaptiveWindow window(10, 64);
+    hrtime_t now = 1000000;
+    window.on_success(now, now + 5 * usec);
+    unsigned size = window.size();
+    // still below the minimal baseline multiplied by the factor
+    for (unsigned ii = 0; ii < size; ii++) {
+        window.on_success(now, now + 300 * usec);
+    }
+    ASSERT_EQ(size + 1, window.size());
+    ASSERT_EQ(0, window.decreases());
+}
+
+namespace
+{
+struct QueueCounters {
+    unsigned scheduled{0};
+    unsigned ready{0};
+};
+
+lcb_STATUS count_schedule(lcb::docreq::Queue *q, lcb::docreq::DocRequest *)
+{
+    static_cast<QueueCounters *>(q->parent)->scheduled++;
+    return LCB_SUCCESS;
+}
+
+void count_ready(lcb::docreq::Queue *q, lcb::docreq::DocRequest *)
+{
+    static_cast<QueueCounters *>(q->parent)->ready++;
+}
+
+void ignore_throttle(lcb::docreq::Queue *, int) {}
+} // namespace
+
+TEST_F(DocreqTests, testQueueLimit)
+{
+    lcb_INSTANCE *instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+
+    QueueCounters counters;
+    auto *q = new lcb::docreq::Queue(instance);
+    q->parent = &counters;
+    q->cb_schedule = count_schedule;
+    q->cb_ready = count_ready;
+    q->cb_throttle = ignore_throttle;
+    ASSERT_EQ(10, q->max_pending_response);
+    q->max_pending_response = 4;
+
+    std::vector<lcb::docreq::DocRequest> reqs(20);
+    for (auto &req : reqs) {
+        memset(&req, 0, sizeof(req));
+        req.docid.iov_base = const_cast<char *>("key");
+        req.docid.iov_len = 3;
+        q->add(&req);
+    }
+    auto run = lcbio_timer_get_target(q->timer);
+
+    // the limit is shared by all nodes, and the window of the node does not exceed it
+    run(q);
+    ASSERT_EQ(4, counters.scheduled);
+    hrtime_t now = gethrtime();
+    for (unsigned ii = 0; ii < 4; ii++) {
+        reqs[ii].start = now;
+        q->complete(&reqs[ii], LCB_SUCCESS);
+        reqs[ii].ready = 1;
+    }
+    q->check();
+    ASSERT_EQ(4, counters.ready);
+    ASSERT_LE(q->window_size(), 4);
+    run(q);
+    ASSERT_EQ(8, counters.scheduled);
+
+    // the cancelled requests are released without scheduling
+    q->cancel();
+    for (unsigned ii = 4; ii < 8; ii++) {
+        q->complete(&reqs[ii], LCB_SUCCESS);
+        reqs[ii].ready = 1;
+    }
+    run(q);
+    ASSERT_EQ(8, counters.scheduled);
+    ASSERT_EQ(20, counters.ready);
+    ASSERT_FALSE(q->has_pending());
+    q->unref();
+    lcb_destroy(instance);
+}
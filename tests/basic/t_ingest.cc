@@ -0,0 +1,85 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+#include "internal.h"
+#include "analytics/ingest_queue.hh"
+#include "contrib/lcb-jsoncpp/lcb-jsoncpp.h"
+
+#include <atomic>
+
+using lcb::analytics::ConverterPool;
+
+class IngestTests : public ::testing::Test
+{
+};
+
+TEST_F(IngestTests, testConverterPool)
+{
+    for (size_t nthreads : {0, 1, 3}) {
+        ConverterPool pool(nthreads);
+        ASSERT_EQ(nthreads, pool.size());
+        for (size_t total : {0, 1, 7, 1000}) {
+            std::vector<std::atomic<int>> visits(total);
+            for (auto &v : visits) {
+                v = 0;
+            }
+            pool.run(total, [&visits](size_t index) { visits[index]++; });
+            for (size_t ii = 0; ii < total; ii++) {
+                ASSERT_EQ(1, visits[ii].load()) << "threads=" << nthreads << ", total=" << total;
+            }
+        }
+    }
+}
+
+TEST_F(IngestTests, testBatchedConversion)
+{
+    const size_t nrows = 1000;
+    std::vector<std::string> rows;
+    for (size_t ii = 0; ii < nrows; ii++) {
+        rows.push_back(R"({"airport":{"id":)" + std::to_string(ii) +
+                       R"(,"airportname":"Calais Dunkerque","city":"Calais","country":"France","faa":"CQF"}})");
+    }
+    // converter, which re-encodes the document, as the applications usually do
+    auto convert = [&rows](size_t index, std::vector<std::string> &ids, std::vector<std::string> &docs) {
+        Json::Value doc;
+        Json::Reader().parse(rows[index], doc);
+        ids[index] = "airport_" + doc["airport"]["id"].asString();
+        doc["airport"]["ingested"] = true;
+        docs[index] = Json::FastWriter().write(doc);
+    };
+
+    std::vector<std::string> expected_ids(nrows), expected_docs(nrows);
+    for (size_t ii = 0; ii < nrows; ii++) {
+        convert(ii, expected_ids, expected_docs);
+    }
+    ASSERT_EQ("airport_42", expected_ids[42]);
+
+    // every row of every batch is converted once, into its own slot
+    for (size_t nthreads : {0, 3}) {
+        ConverterPool pool(nthreads);
+        std::vector<std::string> ids(nrows), docs(nrows);
+        for (size_t ii = 0; ii < nrows; ii += 256) {
+            pool.run(std::min<size_t>(256, nrows - ii),
+                     [&convert, &ids, &docs, ii](size_t index) { convert(ii + index, ids, docs); });
+        }
+        ASSERT_EQ(expected_ids, ids) << "threads=" << nthreads;
+        ASSERT_EQ(expected_docs, docs) << "threads=" << nthreads;
+    }
+}
@@ -112,4 +112,122 @@ TEST_F(JsonParseTest, testInvalidJSON)
     Json::Value meta;
     ASSERT_TRUE(Json::Reader().parse(input.c_str(), input.c_str() + input.size(), meta));
     ASSERT_FALSE(Json::Reader(Json::Features::strictMode()).parse(input.c_str(), input.c_str() + input.size(), meta));
-}
\ No newline at end of file
+}
+static void feedInChunks(Parser &parser, const std::string &input, size_t chunk)
+{
+    for (size_t ii = 0; ii < input.size(); ii += chunk) {
+        parser.feed(input.c_str() + ii, std::min(chunk, input.size() - ii));
+    }
+}
+
+TEST_F(JsonParseTest, testValidate)
+{
+    const char *valid[] = {"0",          "-1.5e+10",       "\"a\\u00e9\\n\"", "true", " null ", "[]",
+                           "[1, [2, {}]]", "{\"a\": {\"b\": []}}", "{ }"};
+    const char *invalid[] = {"",   "01",      "1.",     "-",         "\"abc",   "tru",  "[1,]", "{\"a\"}",
+                             "{1:2}", "[1 2]", "\"\\x\"", "\"\\u12\"", "[] []", "{\"a\":1,}"};
+    for (const char *doc : valid) {
+        ASSERT_TRUE(lcb::jsparse::validate(doc, strlen(doc))) << doc;
+    }
+    for (const char *doc : invalid) {
+        ASSERT_FALSE(lcb::jsparse::validate(doc, strlen(doc))) << doc;
+    }
+    std::string deep(1000, '[');
+    deep.append(1000, ']');
+    ASSERT_FALSE(lcb::jsparse::validate(deep.c_str(), deep.size()));
+}
+
+TEST_F(JsonParseTest, testRowSplitting)
+{
+    std::vector<std::string> expected = {
+        R"({"id":"a","nested":{"list":[1,2,[3]],"obj":{}}})",
+        R"({"str":"brackets ]}[{ and \"quotes\" and \\"})",
+        R"(["list",{"as":"row"}])",
+        R"("plain string with \" escaped quote")",
+        "42",
+        "-1.5e10",
+        "true",
+        "null",
+        "{}",
+    };
+    std::string input = R"({"requestID": "1", "results": [ )";
+    for (size_t ii = 0; ii < expected.size(); ii++) {
+        input.append(ii ? ",\n  " : "").append(expected[ii]);
+    }
+    input.append(R"( ], "status": "success", "metrics": {"resultCount": 9}})");
+
+    size_t chunks[] = {1, 3, 7, 16, 64, input.size()};
+    for (size_t chunk : chunks) {
+        Context cx;
+        Parser parser(Parser::MODE_N1QL, &cx);
+        feedInChunks(parser, input, chunk);
+        ASSERT_EQ(LCB_SUCCESS, cx.rc) << "chunk size " << chunk;
+        ASSERT_TRUE(cx.received_done) << "chunk size " << chunk;
+        ASSERT_EQ(expected, cx.rows) << "chunk size " << chunk;
+
+        Json::Value meta;
+        ASSERT_TRUE(Json::Reader().parse(cx.meta, meta));
+        ASSERT_EQ("success", meta["status"].asString());
+        ASSERT_EQ(9, meta["metrics"]["resultCount"].asInt());
+        ASSERT_TRUE(meta["results"].isArray());
+        ASSERT_EQ(0, meta["results"].size());
+    }
+
+    const char *bad_rows[] = {
+        R"({"results": [{"a":1} {"b":2}], "status": "success"})",
+        R"({"results": [{"a":1},], "status": "success"})",
+        R"({"results": [,{"a":1}], "status": "success"})",
+        R"({"results": [}], "status": "success"})",
+    };
+    for (const char *bad : bad_rows) {
+        Context cx;
+        Parser parser(Parser::MODE_N1QL, &cx);
+        parser.feed(bad, strlen(bad));
+        ASSERT_EQ(LCB_ERR_PROTOCOL_ERROR, cx.rc) << bad;
+    }
+}
+
+struct CountingContext : Parser::Actions {
+    size_t nrows{0};
+    size_t nbytes{0};
+    bool failed{false};
+    bool done{false};
+
+    void JSPARSE_on_row(const Row &row) override
+    {
+        nrows++;
+        nbytes += row.row.iov_len;
+    }
+    void JSPARSE_on_complete(const std::string &) override
+    {
+        done = true;
+    }
+    void JSPARSE_on_error(const std::string &) override
+    {
+        failed = true;
+    }
+};
+
+TEST_F(JsonParseTest, testManyRows)
+{
+    const size_t nrows = 200;
+    std::string row = R"({"airline":{"callsign":"MILE-AIR","country":"United States","iata":"Q5","icao":"MLA",)"
+                      R"("id":10,"name":"40-Mile Air","type":"airline","tags":["a","b",["c"]],)"
+                      R"("note":"escaped \"quotes\" and [brackets] inside"}})";
+    std::string input = R"({"requestID":"1","signature":{"*":"*"},"results":[)";
+    for (size_t ii = 0; ii < nrows; ii++) {
+        input.append(ii ? "," : "").append(row);
+    }
+    input.append(R"(],"status":"success","metrics":{"resultCount":200}})");
+
+    // the chunk is smaller than the row, so that every row spans several chunks
+    for (size_t chunk : {100, 16384}) {
+        CountingContext cx;
+        Parser parser(Parser::MODE_N1QL, &cx);
+        feedInChunks(parser, input, chunk);
+        ASSERT_FALSE(cx.failed) << "chunk size " << chunk;
+        ASSERT_TRUE(cx.done) << "chunk size " << chunk;
+        ASSERT_EQ(nrows, cx.nrows) << "chunk size " << chunk;
+        ASSERT_EQ(nrows * row.size(), cx.nbytes) << "chunk size " << chunk;
+    }
+}
@@ -0,0 +1,171 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+
+#include "n1ql/query_cache.hh"
+#include "n1ql/n1ql-internal.h"
+
+class N1qlCacheTests : public ::testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+        settings = lcb_settings_new();
+    }
+
+    void TearDown() override
+    {
+        lcb_settings_unref(settings);
+    }
+
+    static Json::Value preparedPlan(const std::string &name)
+    {
+        Json::Value plan;
+        plan["name"] = name;
+        plan["encoded_plan"] = "encoded-" + name;
+        return plan;
+    }
+
+    lcb_settings *settings{nullptr};
+};
+
+TEST_F(N1qlCacheTests, testCapacityAndStats)
+{
+    settings->n1ql_cache_size = 2;
+    lcb_QUERY_CACHE cache(settings);
+
+    ASSERT_EQ(nullptr, cache.get_entry("a"));
+    cache.add_entry("a", preparedPlan("pa"));
+    cache.add_entry("b", preparedPlan("pb"));
+    ASSERT_NE(nullptr, cache.get_entry("a")); // "b" is now the least recently used
+    cache.add_entry("c", preparedPlan("pc"));
+    ASSERT_EQ(2, cache.size());
+    ASSERT_EQ(nullptr, cache.get_entry("b"));
+    ASSERT_NE(nullptr, cache.get_entry("c"));
+
+    // replacing the plan does not evict anything
+    cache.add_entry("c", preparedPlan("pc2"));
+    ASSERT_NE(std::string::npos, cache.get_entry("c")->encoded().find("\"prepared\":\"pc2\""));
+
+    ASSERT_EQ(3, cache.stats().hits);
+    ASSERT_EQ(2, cache.stats().misses);
+    ASSERT_EQ(1, cache.stats().evictions);
+
+    settings->n1ql_cache_size = 1;
+    cache.add_entry("d", preparedPlan("pd"));
+    ASSERT_EQ(1, cache.size());
+    ASSERT_EQ(3, cache.stats().evictions);
+}
+
+TEST_F(N1qlCacheTests, testSharedCache)
+{
+    lcbvb_CONFIG *config = lcbvb_create();
+    ASSERT_EQ(0, lcbvb_genconfig(config, 2, 1, 64));
+    lcbvb_CONFIG *other_cluster = lcbvb_create();
+    ASSERT_EQ(0, lcbvb_genconfig(other_cluster, 3, 1, 64));
+
+    settings->n1ql_shared_cache = 1;
+    lcb_QUERY_CACHE first(settings), second(settings), third(settings);
+    first.sync_shared(config);
+    second.sync_shared(config);
+    third.sync_shared(other_cluster);
+    ASSERT_TRUE(first.is_shared());
+
+    std::string expected = first.add_entry("select", preparedPlan("p1")).encoded();
+    const Plan *plan = second.get_entry("select");
+    ASSERT_NE(nullptr, plan);
+    ASSERT_EQ(expected, plan->encoded());
+    ASSERT_EQ(1, second.stats().hits);
+    ASSERT_EQ(nullptr, third.get_entry("select"));
+
+    // stale plan is removed for everyone
+    second.remove_entry("select");
+    third.sync_shared(config);
+    ASSERT_EQ(nullptr, third.get_entry("select"));
+
+    settings->n1ql_shared_cache = 0;
+    second.sync_shared(config);
+    ASSERT_FALSE(second.is_shared());
+    first.add_entry("other", preparedPlan("p2"));
+    ASSERT_EQ(nullptr, second.get_entry("other"));
+
+    lcbvb_destroy(config);
+    lcbvb_destroy(other_cluster);
+}
+
+TEST_F(N1qlCacheTests, testClearSharedCache)
+{
+    lcbvb_CONFIG *config = lcbvb_create();
+    ASSERT_EQ(0, lcbvb_genconfig(config, 2, 1, 64));
+
+    settings->n1ql_shared_cache = 1;
+    lcb_QUERY_CACHE first(settings), second(settings);
+    first.sync_shared(config);
+    second.sync_shared(config);
+    first.add_entry("select", preparedPlan("p1"));
+    second.add_entry("update", preparedPlan("p2"));
+
+    // only the entries of the instance are dropped
+    first.clear();
+    ASSERT_EQ(0, first.size());
+    ASSERT_FALSE(first.is_shared());
+    ASSERT_NE(nullptr, second.get_entry("select"));
+    ASSERT_NE(nullptr, second.get_entry("update"));
+    ASSERT_EQ(2, second.size());
+
+    // the other instance still shares its plans after the cache has been cleared
+    first.sync_shared(config);
+    ASSERT_TRUE(first.is_shared());
+    ASSERT_NE(nullptr, first.get_entry("update"));
+
+    lcbvb_destroy(config);
+}
+
+TEST_F(N1qlCacheTests, testCoalescePrepare)
+{
+    lcb_QUERY_CACHE cache(settings);
+    auto *leader = reinterpret_cast<lcb_QUERY_HANDLE_ *>(0x1);
+    auto *waiter1 = reinterpret_cast<lcb_QUERY_HANDLE_ *>(0x2);
+    auto *waiter2 = reinterpret_cast<lcb_QUERY_HANDLE_ *>(0x3);
+    auto *waiter3 = reinterpret_cast<lcb_QUERY_HANDLE_ *>(0x4);
+
+    ASSERT_TRUE(cache.join_prepare("select", leader));
+    ASSERT_FALSE(cache.join_prepare("select", waiter1));
+    ASSERT_FALSE(cache.join_prepare("select", waiter2));
+    ASSERT_TRUE(cache.join_prepare("other", waiter3));
+    ASSERT_EQ(2, cache.stats().coalesced);
+
+    // waiter leaves, nobody has to re-issue PREPARE
+    ASSERT_EQ(nullptr, cache.leave_prepare("select", waiter2));
+    // only the leader can complete PREPARE
+    ASSERT_TRUE(cache.finish_prepare("select", waiter3).empty());
+    std::vector<lcb_QUERY_HANDLE_ *> waiters = cache.finish_prepare("select", leader);
+    ASSERT_EQ(1, waiters.size());
+    ASSERT_EQ(waiter1, waiters[0]);
+
+    // the statement is not in flight anymore
+    ASSERT_TRUE(cache.join_prepare("select", waiter1));
+    ASSERT_FALSE(cache.join_prepare("select", waiter2));
+    // leader leaves, the next one takes over
+    ASSERT_EQ(waiter2, cache.leave_prepare("select", waiter1));
+    ASSERT_TRUE(cache.finish_prepare("select", waiter2).empty());
+    ASSERT_EQ(nullptr, cache.leave_prepare("other", waiter3));
+    ASSERT_TRUE(cache.join_prepare("other", waiter3));
+}
@@ -20,8 +20,11 @@
 #include <libcouchbase/couchbase.h>
 
 #include "n1ql/query_utils.hh"
+#include "capi/cmd_query.hh"
 #include "../iotests/testutil.h"
 
+#include <chrono>
+
 class N1qLStringTests : public ::testing::Test
 {
 };
@@ -108,3 +111,99 @@ TEST_F(N1qLStringTests, testAnalyticsPositionalParams)
         R"({"args":["Universe","life","Everything"],"statement":"SELECT 42 AS the_answer WHERE question IN (?, ?, ?) "})",
         std::string(payload, payload_len));
 }
+
+/* Composes the body the way query handle does for the ad hoc query */
+static std::string encodeQueryBody(const lcb_CMDQUERY &cmd)
+{
+    const auto &options = cmd.encoded_options();
+    std::string params = cmd.encoded_params();
+    lcb::query_body_writer body(options->prefix, params.size() + 128);
+    body.string_member("statement", options->statement.asString());
+    body.string_member("timeout", "75000000us");
+    body.string_member("client_context_id", "0123456789abcdef");
+    body.members(params);
+    return std::move(body.finish());
+}
+
+TEST_F(N1qLStringTests, testQueryBodyEncoding)
+{
+    lcb_CMDQUERY cmd;
+    std::string statement = "SELECT \"\\\" FROM b WHERE x = $x AND y IN [?, ?]\n";
+    ASSERT_STATUS_EQ(LCB_SUCCESS, cmd.statement(statement.c_str(), statement.size()));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, cmd.readonly(true));
+
+    ASSERT_STATUS_EQ(LCB_ERR_INVALID_ARGUMENT, cmd.positional_param("{\"a\":", 5));
+    ASSERT_STATUS_EQ(LCB_ERR_INVALID_ARGUMENT, cmd.positional_param("1 2", 3));
+    ASSERT_STATUS_EQ(LCB_ERR_INVALID_ARGUMENT, cmd.positional_params("42", 2));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, cmd.positional_params(" [ ] ", 5));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, cmd.positional_param("42", 2));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, cmd.positional_param(" {\"k\": [true, null]}", 20));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, cmd.named_param("$x", "\"first\"", 7));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, cmd.named_param("$x", "\"second\"", 8));
+
+    Json::Value body;
+    ASSERT_TRUE(Json::Reader().parse(encodeQueryBody(cmd), body));
+    ASSERT_EQ(statement, body["statement"].asString());
+    ASSERT_TRUE(body["readonly"].asBool());
+    ASSERT_EQ("75000000us", body["timeout"].asString());
+    ASSERT_EQ(2, body["args"].size());
+    ASSERT_EQ(42, body["args"][0].asInt());
+    ASSERT_TRUE(body["args"][1]["k"][0].asBool());
+    ASSERT_EQ("second", body["$x"].asString());
+
+    // copies share the encoded options until modified
+    lcb_CMDQUERY copy(cmd);
+    ASSERT_EQ(cmd.encoded_options().get(), copy.encoded_options().get());
+    ASSERT_STATUS_EQ(LCB_SUCCESS, copy.metrics(true));
+    ASSERT_NE(cmd.encoded_options().get(), copy.encoded_options().get());
+    ASSERT_EQ(std::string::npos, cmd.encoded_options()->prefix.find("metrics"));
+    ASSERT_NE(std::string::npos, copy.encoded_options()->prefix.find("metrics"));
+
+    // the option with the same name replaces parameters
+    ASSERT_STATUS_EQ(LCB_SUCCESS, cmd.option("args", "[1]", 3));
+    ASSERT_TRUE(Json::Reader().parse(encodeQueryBody(cmd), body));
+    ASSERT_EQ(1, body["args"].size());
+    ASSERT_STATUS_EQ(LCB_SUCCESS, cmd.positional_param("2", 1));
+    ASSERT_TRUE(Json::Reader().parse(encodeQueryBody(cmd), body));
+    ASSERT_EQ(2, body["args"].size());
+    ASSERT_EQ(2, body["args"][1].asInt());
+}
+
+TEST_F(N1qLStringTests, testReusedCommandBody)
+{
+    std::string statement = "SELECT * FROM `travel-sample` WHERE type = $type AND country = $country AND id > ?";
+
+    lcb_CMDQUERY cmd;
+    cmd.statement(statement.c_str(), statement.size());
+    cmd.consistency(LCB_QUERY_CONSISTENCY_REQUEST);
+    cmd.readonly(true);
+    cmd.pipeline_batch(16);
+    cmd.named_param("$type", "\"airline\"", 9);
+    cmd.named_param("$country", "\"United States\"", 15);
+
+    // the same document, built through DOM
+    Json::Value root;
+    root["statement"] = statement;
+    root["scan_consistency"] = "request_plus";
+    root["readonly"] = true;
+    root["pipeline_batch"] = "16";
+    root["$type"] = "airline";
+    root["$country"] = "United States";
+    root["timeout"] = "75000000us";
+    root["client_context_id"] = "0123456789abcdef";
+
+    // the command is reused with different parameters, its options are encoded only once
+    const lcb::query_encoded_options *options = cmd.encoded_options().get();
+    for (int ii = 0; ii < 3; ii++) {
+        std::string arg = std::to_string(ii);
+        cmd.positional_params("[]", 2);
+        cmd.positional_param(arg.c_str(), arg.size());
+        lcb_CMDQUERY request(cmd);
+        ASSERT_EQ(options, request.encoded_options().get());
+
+        Json::Value body;
+        ASSERT_TRUE(Json::Reader().parse(encodeQueryBody(request), body));
+        root["args"][0] = ii;
+        ASSERT_EQ(root, body) << Json::FastWriter().write(body);
+    }
+}
@@ -18,6 +18,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stddef.h>
+#include <string>
 #include <gtest/gtest.h>
 #ifdef _WIN32
 #include <windows.h>
@@ -456,3 +457,44 @@ TEST_F(NetbufTest, testOutOfOrder)
 
     clean_check(&mgr);
 }
+
+TEST_F(NetbufTest, testCoalesceIov)
+{
+    char small[5][4] = {"aaa", "bbb", "ccc", "ddd", "eee"};
+    char big[BIG_BUF_SIZE];
+    memset(big, 'x', sizeof(big));
+
+    nb_IOV iovs[7];
+    int order[7] = {0, 1, -1, 2, 3, 4, -1};
+    std::string expected;
+    for (int ii = 0; ii < 7; ii++) {
+        if (order[ii] < 0) {
+            iovs[ii].iov_base = big;
+            iovs[ii].iov_len = sizeof(big);
+        } else {
+            iovs[ii].iov_base = small[order[ii]];
+            iovs[ii].iov_len = 3;
+        }
+        expected.append((const char *)iovs[ii].iov_base, iovs[ii].iov_len);
+    }
+
+    /* the scratch buffer fits only four small IOVs, so "eee" is left as is */
+    char scratch[12];
+    nb_SIZE ncopied = 0;
+    int niov = netbuf_coalesce_iov(iovs, 7, scratch, sizeof(scratch), SMALL_BUF_SIZE, &ncopied);
+    ASSERT_EQ(5, niov);
+    ASSERT_EQ(12, ncopied);
+    ASSERT_EQ(scratch, iovs[0].iov_base);
+    ASSERT_EQ(6, iovs[0].iov_len);
+    ASSERT_EQ(big, iovs[1].iov_base);
+    ASSERT_EQ(scratch + 6, iovs[2].iov_base);
+    ASSERT_EQ(6, iovs[2].iov_len);
+    ASSERT_EQ(small[4], iovs[3].iov_base);
+    ASSERT_EQ(big, iovs[4].iov_base);
+
+    std::string actual;
+    for (int ii = 0; ii < niov; ii++) {
+        actual.append((const char *)iovs[ii].iov_base, iovs[ii].iov_len);
+    }
+    ASSERT_EQ(expected, actual);
+}
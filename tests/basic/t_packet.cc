@@ -9,6 +9,8 @@
 #include "config.h"
 #include <gtest/gtest.h>
 #include "packetutils.h"
+#include "internal.h"
+#include "capi/cmd_subdoc.hh"
 
 class Packet : public ::testing::Test
 {
@@ -207,3 +209,183 @@ TEST_F(Packet, testKeys)
     pi.release(&ior);
     rdb_cleanup(&ior);
 }
+
+static void loadSubdocResponse(rdb_IOROPE *ior, lcb::MemcachedResponse *pi, uint8_t opcode, const std::string &body)
+{
+    protocol_binary_response_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.response.magic = PROTOCOL_BINARY_RES;
+    hdr.response.opcode = opcode;
+    hdr.response.bodylen = htonl((lcb_uint32_t)body.size());
+    rdb_copywrite(ior, hdr.bytes, sizeof(hdr.bytes));
+    rdb_copywrite(ior, const_cast<char *>(body.data()), body.size());
+    unsigned wanted;
+    ASSERT_TRUE(pi->load(ior, &wanted));
+}
+
+static void appendSubdocEntry(std::string &body, int index, lcb_uint16_t status, const std::string &value)
+{
+    if (index >= 0) {
+        body.push_back(static_cast<char>(index));
+    }
+    lcb_uint16_t rc = htons(status);
+    body.append(reinterpret_cast<const char *>(&rc), sizeof(rc));
+    if (index < 0 || status == PROTOCOL_BINARY_RESPONSE_SUCCESS) {
+        lcb_uint32_t vlen = htonl((lcb_uint32_t)value.size());
+        body.append(reinterpret_cast<const char *>(&vlen), sizeof(vlen));
+        body.append(value);
+    }
+}
+
+static std::string subdocResultValue(const lcb_RESPSUBDOC *resp, size_t index)
+{
+    const char *value = nullptr;
+    size_t nvalue = 0;
+    EXPECT_EQ(LCB_SUCCESS, lcb_respsubdoc_result_value(resp, index, &value, &nvalue));
+    return std::string(value == nullptr ? "" : value, nvalue);
+}
+
+TEST_F(Packet, testSubdocLookupResults)
+{
+    rdb_IOROPE ior;
+    rdb_init(&ior, rdb_libcalloc_new());
+
+    std::string body;
+    appendSubdocEntry(body, -1, PROTOCOL_BINARY_RESPONSE_SUCCESS, "\"first\"");
+    appendSubdocEntry(body, -1, PROTOCOL_BINARY_RESPONSE_SUBDOC_PATH_ENOENT, "");
+    appendSubdocEntry(body, -1, PROTOCOL_BINARY_RESPONSE_SUCCESS, "[1,2,3]");
+    appendSubdocEntry(body, -1, PROTOCOL_BINARY_RESPONSE_SUCCESS, "42");
+    lcb::MemcachedResponse pi;
+    loadSubdocResponse(&ior, &pi, PROTOCOL_BINARY_CMD_SUBDOC_MULTI_LOOKUP, body);
+
+    lcb_RESPSUBDOC resp{};
+    resp.responses = &pi;
+    resp.nres = 4;
+    ASSERT_EQ(4, lcb_respsubdoc_result_size(&resp));
+
+    // sequential access does not need the offset index
+    ASSERT_EQ(LCB_SUCCESS, lcb_respsubdoc_result_status(&resp, 0));
+    ASSERT_EQ("\"first\"", subdocResultValue(&resp, 0));
+    ASSERT_EQ(LCB_ERR_SUBDOC_PATH_NOT_FOUND, lcb_respsubdoc_result_status(&resp, 1));
+    ASSERT_EQ("", subdocResultValue(&resp, 1));
+    ASSERT_EQ("42", subdocResultValue(&resp, 3));
+    ASSERT_TRUE(resp.offsets.empty());
+
+    // going back builds it
+    ASSERT_EQ("[1,2,3]", subdocResultValue(&resp, 2));
+    ASSERT_EQ(4, resp.offsets.size());
+    ASSERT_EQ("\"first\"", subdocResultValue(&resp, 0));
+    ASSERT_EQ(LCB_ERR_OPTIONS_CONFLICT, lcb_respsubdoc_result_status(&resp, 4));
+
+    pi.release(&ior);
+    rdb_cleanup(&ior);
+}
+
+TEST_F(Packet, testSubdocMutationResults)
+{
+    rdb_IOROPE ior;
+    rdb_init(&ior, rdb_libcalloc_new());
+
+    // only specs with values are present in the response
+    std::string body;
+    appendSubdocEntry(body, 1, PROTOCOL_BINARY_RESPONSE_SUCCESS, "10");
+    appendSubdocEntry(body, 3, PROTOCOL_BINARY_RESPONSE_SUCCESS, "-5");
+    lcb::MemcachedResponse pi;
+    loadSubdocResponse(&ior, &pi, PROTOCOL_BINARY_CMD_SUBDOC_MULTI_MUTATION, body);
+
+    lcb_RESPSUBDOC resp{};
+    resp.responses = &pi;
+    resp.nres = 4;
+    const char *expected[] = {"", "10", "", "-5"};
+    for (size_t ii = 0; ii < 4; ii++) {
+        ASSERT_EQ(LCB_SUCCESS, lcb_respsubdoc_result_status(&resp, ii));
+        ASSERT_EQ(expected[ii], subdocResultValue(&resp, ii));
+    }
+    ASSERT_TRUE(resp.offsets.empty());
+    ASSERT_EQ("10", subdocResultValue(&resp, 1));
+    ASSERT_EQ(4, resp.offsets.size());
+    ASSERT_EQ("", subdocResultValue(&resp, 2));
+    pi.release(&ior);
+
+    // failed multi mutation reports the first failed spec only
+    body.clear();
+    appendSubdocEntry(body, 2, PROTOCOL_BINARY_RESPONSE_SUBDOC_PATH_ENOENT, "");
+    lcb::MemcachedResponse failed;
+    loadSubdocResponse(&ior, &failed, PROTOCOL_BINARY_CMD_SUBDOC_MULTI_MUTATION, body);
+    lcb_RESPSUBDOC failed_resp{};
+    failed_resp.responses = &failed;
+    failed_resp.nres = 3;
+    ASSERT_EQ(LCB_ERR_SUBDOC_PATH_NOT_FOUND, lcb_respsubdoc_result_status(&failed_resp, 2));
+    ASSERT_EQ(LCB_SUCCESS, lcb_respsubdoc_result_status(&failed_resp, 0));
+    ASSERT_EQ("", subdocResultValue(&failed_resp, 2));
+    failed.release(&ior);
+
+    // truncated entries are reported as protocol errors
+    body.clear();
+    appendSubdocEntry(body, -1, PROTOCOL_BINARY_RESPONSE_SUCCESS, "value");
+    body.resize(body.size() - 2);
+    lcb::MemcachedResponse truncated;
+    loadSubdocResponse(&ior, &truncated, PROTOCOL_BINARY_CMD_SUBDOC_MULTI_LOOKUP, body);
+    lcb_RESPSUBDOC truncated_resp{};
+    truncated_resp.responses = &truncated;
+    truncated_resp.nres = 1;
+    ASSERT_EQ(LCB_ERR_PROTOCOL_ERROR, lcb_respsubdoc_result_status(&truncated_resp, 0));
+    truncated.release(&ior);
+
+    rdb_cleanup(&ior);
+}
+
+TEST_F(Packet, testSubdocTruncatedResults)
+{
+    rdb_IOROPE ior;
+    rdb_init(&ior, rdb_libcalloc_new());
+
+    std::string body;
+    appendSubdocEntry(body, -1, PROTOCOL_BINARY_RESPONSE_SUCCESS, "\"first\"");
+    appendSubdocEntry(body, -1, PROTOCOL_BINARY_RESPONSE_SUCCESS, "\"second\"");
+    appendSubdocEntry(body, -1, PROTOCOL_BINARY_RESPONSE_SUCCESS, "\"third\"");
+    body.resize(body.size() - 2);
+    lcb::MemcachedResponse lookup;
+    loadSubdocResponse(&ior, &lookup, PROTOCOL_BINARY_CMD_SUBDOC_MULTI_LOOKUP, body);
+
+    // the sequential access and the offset index report the same statuses
+    lcb_RESPSUBDOC sequential{};
+    sequential.responses = &lookup;
+    sequential.nres = 4;
+    lcb_RESPSUBDOC indexed = sequential;
+    ASSERT_EQ(LCB_ERR_PROTOCOL_ERROR, lcb_respsubdoc_result_status(&indexed, 3));
+    ASSERT_EQ(LCB_SUCCESS, lcb_respsubdoc_result_status(&indexed, 1));
+    ASSERT_EQ(4, indexed.offsets.size());
+    lcb_STATUS expected[] = {LCB_SUCCESS, LCB_SUCCESS, LCB_ERR_PROTOCOL_ERROR, LCB_ERR_PROTOCOL_ERROR};
+    for (size_t ii = 0; ii < 4; ii++) {
+        ASSERT_EQ(expected[ii], lcb_respsubdoc_result_status(&sequential, ii)) << ii;
+        ASSERT_EQ(expected[ii], lcb_respsubdoc_result_status(&indexed, ii)) << ii;
+    }
+    ASSERT_TRUE(sequential.offsets.empty());
+    ASSERT_EQ("\"second\"", subdocResultValue(&indexed, 1));
+    ASSERT_EQ("", subdocResultValue(&indexed, 2));
+    lookup.release(&ior);
+
+    // mutation specs without the entry before the truncation have succeeded
+    body.clear();
+    appendSubdocEntry(body, 1, PROTOCOL_BINARY_RESPONSE_SUCCESS, "10");
+    appendSubdocEntry(body, 3, PROTOCOL_BINARY_RESPONSE_SUCCESS, "-5");
+    body.resize(body.size() - 1);
+    lcb::MemcachedResponse mutation;
+    loadSubdocResponse(&ior, &mutation, PROTOCOL_BINARY_CMD_SUBDOC_MULTI_MUTATION, body);
+    sequential = lcb_RESPSUBDOC{};
+    sequential.responses = &mutation;
+    sequential.nres = 4;
+    indexed = sequential;
+    ASSERT_EQ(LCB_ERR_PROTOCOL_ERROR, lcb_respsubdoc_result_status(&indexed, 3));
+    ASSERT_EQ(LCB_SUCCESS, lcb_respsubdoc_result_status(&indexed, 1));
+    ASSERT_EQ(4, indexed.offsets.size());
+    lcb_STATUS expected_mutation[] = {LCB_SUCCESS, LCB_SUCCESS, LCB_ERR_PROTOCOL_ERROR, LCB_ERR_PROTOCOL_ERROR};
+    for (size_t ii = 0; ii < 4; ii++) {
+        ASSERT_EQ(expected_mutation[ii], lcb_respsubdoc_result_status(&sequential, ii)) << ii;
+        ASSERT_EQ(expected_mutation[ii], lcb_respsubdoc_result_status(&indexed, ii)) << ii;
+    }
+    mutation.release(&ior);
+
+    rdb_cleanup(&ior);
+}
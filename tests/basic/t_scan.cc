@@ -0,0 +1,141 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include "internal.h"
+#include "scan/scan_handle.hh"
+
+using lcb::scan::Item;
+using lcb::scan::Progress;
+
+class ScanTests : public ::testing::Test
+{
+};
+
+static void append_u32(std::string &out, std::uint32_t value)
+{
+    value = htonl(value);
+    out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+static void append_u64(std::string &out, std::uint64_t value)
+{
+    value = lcb_htonll(value);
+    out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+static void append_leb128(std::string &out, std::uint32_t value)
+{
+    do {
+        std::uint8_t byte = value & 0x7f;
+        value >>= 7;
+        if (value != 0) {
+            byte |= 0x80;
+        }
+        out.push_back(static_cast<char>(byte));
+    } while (value != 0);
+}
+
+TEST_F(ScanTests, testDecodeDocuments)
+{
+    std::string payload;
+    std::string large_value(300, 'v');
+    for (std::uint32_t ii = 0; ii < 2; ii++) {
+        append_u32(payload, 0x02000006 + ii);
+        append_u32(payload, 42 + ii);
+        append_u64(payload, 100 + ii);
+        append_u64(payload, 0xdeadbeef00000000ULL + ii);
+        payload.push_back(ii == 0 ? 0x01 : 0x00);
+        std::string key = "key_" + std::to_string(ii);
+        append_leb128(payload, key.size());
+        payload += key;
+        const std::string &value = ii == 0 ? std::string("{}") : large_value;
+        append_leb128(payload, value.size());
+        payload += value;
+    }
+
+    std::vector<Item> items;
+    ASSERT_TRUE(lcb::scan::decode_items(payload.data(), payload.size(), false,
+                                        [&items](const Item &item) { items.push_back(item); }));
+    ASSERT_EQ(2, items.size());
+    ASSERT_EQ("key_0", std::string(items[0].key, items[0].nkey));
+    ASSERT_EQ("{}", std::string(items[0].value, items[0].nvalue));
+    ASSERT_EQ(0x02000006, items[0].flags);
+    ASSERT_EQ(42, items[0].expiry);
+    ASSERT_EQ(100, items[0].seqno);
+    ASSERT_EQ(0xdeadbeef00000000ULL, items[0].cas);
+    ASSERT_EQ(0x01, items[0].datatype);
+    ASSERT_EQ("key_1", std::string(items[1].key, items[1].nkey));
+    ASSERT_EQ(large_value, std::string(items[1].value, items[1].nvalue));
+    ASSERT_EQ(0xdeadbeef00000001ULL, items[1].cas);
+
+    // the last document is truncated
+    items.clear();
+    ASSERT_FALSE(lcb::scan::decode_items(payload.data(), payload.size() - 1, false,
+                                         [&items](const Item &item) { items.push_back(item); }));
+    ASSERT_EQ(1, items.size());
+}
+
+TEST_F(ScanTests, testDecodeIdsOnly)
+{
+    std::string payload;
+    for (const char *key : {"a", "bb", "ccc"}) {
+        append_leb128(payload, strlen(key));
+        payload += key;
+    }
+    std::vector<std::string> keys;
+    ASSERT_TRUE(lcb::scan::decode_items(payload.data(), payload.size(), true, [&keys](const Item &item) {
+        ASSERT_EQ(0, item.nvalue);
+        keys.emplace_back(item.key, item.nkey);
+    }));
+    ASSERT_EQ(std::vector<std::string>({"a", "bb", "ccc"}), keys);
+
+    // length of the key is larger than the payload
+    std::string broken;
+    append_leb128(broken, 1000);
+    broken += "short";
+    ASSERT_FALSE(lcb::scan::decode_items(broken.data(), broken.size(), true, [](const Item &) {}));
+    ASSERT_TRUE(lcb::scan::decode_items(broken.data(), 0, true, [](const Item &) {}));
+}
+
+TEST_F(ScanTests, testResumeToken)
+{
+    std::vector<Progress> progress(64);
+    progress[0].done = true;
+    progress[7].last_key = std::string("key\0with\xff" "binary", 15);
+    progress[7].has_last_key = true;
+    progress[63].done = true;
+
+    std::string token = lcb::scan::encode_resume_token(0x08, progress);
+
+    std::vector<Progress> decoded(64);
+    ASSERT_EQ(LCB_SUCCESS, lcb::scan::decode_resume_token(token, 0x08, decoded));
+    for (std::size_t ii = 0; ii < progress.size(); ii++) {
+        ASSERT_EQ(progress[ii].done, decoded[ii].done) << "vbid=" << ii;
+        ASSERT_EQ(progress[ii].has_last_key, decoded[ii].has_last_key) << "vbid=" << ii;
+        ASSERT_EQ(progress[ii].last_key, decoded[ii].last_key) << "vbid=" << ii;
+    }
+
+    // the token cannot be used for the other collection or bucket
+    ASSERT_EQ(LCB_ERR_INVALID_ARGUMENT, lcb::scan::decode_resume_token(token, 0x09, decoded));
+    std::vector<Progress> other_bucket(1024);
+    ASSERT_EQ(LCB_ERR_INVALID_ARGUMENT, lcb::scan::decode_resume_token(token, 0x08, other_bucket));
+    ASSERT_EQ(LCB_ERR_INVALID_ARGUMENT, lcb::scan::decode_resume_token("garbage", 0x08, decoded));
+    ASSERT_EQ(LCB_ERR_INVALID_ARGUMENT,
+              lcb::scan::decode_resume_token(R"({"cid":8,"vbuckets":64,"done":[64],"keys":{}})", 0x08, decoded));
+}
@@ -16,6 +16,7 @@
  */
 #include "config.h"
 #include <gtest/gtest.h>
+#include <string>
 
 #include "contrib/cbsasl/src/scram-sha/scram_utils.h"
 
@@ -444,14 +445,19 @@ TEST_F(ScramTest, FinalServerCheck_SHA512)
     cbsasl_conn_t ctx;
     ctx.client = 1;
     ctx.c.client.auth_mech = SASL_AUTH_MECH_SCRAM_SHA512;
-    // for computing the server signature, we only need the salted password and
-    // the authentication message
-    ctx.c.client.saltedpassword = (unsigned char *)"\xaf\xe6\xc5\x53\x07\x85\xb6\xcc\x6b\x1c\x64\x53\x38\x47\x31"
-                                                   "\xbd\x5e\xe4\x32\xee\x54\x9f\xd4\x2f\xb6\x69\x57\x79\xad\x8a"
-                                                   "\x1c\x5b\xf5\x9d\xe6\x9c\x48\xf7\x74\xef\xc4\x00\x7d\x52\x98"
-                                                   "\xf9\x03\x3c\x02\x41\xd5\xab\x69\x30\x5e\x7b\x64\xec\xee\xb8"
-                                                   "\xd8\x34\xcf\xec";
-    ctx.c.client.saltedpasslen = CBSASL_SHA512_DIGEST_SIZE;
+    // for computing the server signature, we only need the server key (derived
+    // from the salted password) and the authentication message
+    const unsigned char *saltedpassword =
+        (const unsigned char *)"\xaf\xe6\xc5\x53\x07\x85\xb6\xcc\x6b\x1c\x64\x53\x38\x47\x31"
+                               "\xbd\x5e\xe4\x32\xee\x54\x9f\xd4\x2f\xb6\x69\x57\x79\xad\x8a"
+                               "\x1c\x5b\xf5\x9d\xe6\x9c\x48\xf7\x74\xef\xc4\x00\x7d\x52\x98"
+                               "\xf9\x03\x3c\x02\x41\xd5\xab\x69\x30\x5e\x7b\x64\xec\xee\xb8"
+                               "\xd8\x34\xcf\xec";
+    scram_keys_t keys;
+    ASSERT_EQ(SASL_OK,
+              compute_scram_keys(SASL_AUTH_MECH_SCRAM_SHA512, saltedpassword, CBSASL_SHA512_DIGEST_SIZE, &keys));
+    ctx.c.client.server_key = keys.server_key;
+    ctx.c.client.server_key_len = keys.length;
     ctx.c.client.auth_message =
         (char *)"n=foo,r=001122334455667788,r=00112233445566778899aabbccddeeff,s=c2FsdA==,i=1000,"
                 "c=biws,r=00112233445566778899aabbccddeeff";
@@ -470,12 +476,17 @@ TEST_F(ScramTest, FinalServerCheck_SHA256)
     cbsasl_conn_t ctx;
     ctx.client = 1;
     ctx.c.client.auth_mech = SASL_AUTH_MECH_SCRAM_SHA256;
-    // for computing the server signature, we only need the salted password and
-    // the authentication message
-    ctx.c.client.saltedpassword = (unsigned char *)"\x63\x2c\x28\x12\xe4\x6d\x46\x04\x10\x2b\xa7\x61\x8e\x9d\x6d"
-                                                   "\x7d\x2f\x81\x28\xf6\x26\x6b\x4a\x03\x26\x4d\x2a\x04\x60\xb7"
-                                                   "\xdc\xb3";
-    ctx.c.client.saltedpasslen = CBSASL_SHA256_DIGEST_SIZE;
+    // for computing the server signature, we only need the server key (derived
+    // from the salted password) and the authentication message
+    const unsigned char *saltedpassword =
+        (const unsigned char *)"\x63\x2c\x28\x12\xe4\x6d\x46\x04\x10\x2b\xa7\x61\x8e\x9d\x6d"
+                               "\x7d\x2f\x81\x28\xf6\x26\x6b\x4a\x03\x26\x4d\x2a\x04\x60\xb7"
+                               "\xdc\xb3";
+    scram_keys_t keys;
+    ASSERT_EQ(SASL_OK,
+              compute_scram_keys(SASL_AUTH_MECH_SCRAM_SHA256, saltedpassword, CBSASL_SHA256_DIGEST_SIZE, &keys));
+    ctx.c.client.server_key = keys.server_key;
+    ctx.c.client.server_key_len = keys.length;
     ctx.c.client.auth_message =
         (char *)"n=foo,r=001122334455667788,r=00112233445566778899aabbccddeeff,s=c2FsdA==,i=1000,"
                 "c=biws,r=00112233445566778899aabbccddeeff";
@@ -494,11 +505,15 @@ TEST_F(ScramTest, FinalServerCheck_SHA1)
     cbsasl_conn_t ctx;
     ctx.client = 1;
     ctx.c.client.auth_mech = SASL_AUTH_MECH_SCRAM_SHA1;
-    // for computing the server signature, we only need the salted password and
-    // the authentication message
-    ctx.c.client.saltedpassword = (unsigned char *)"\x6e\x88\xbe\x8b\xad\x7e\xae\x9d\x9e\x10\xaa\x06\x12\x24\x03"
-                                                   "\x4f\xed\x48\xd0\x3f";
-    ctx.c.client.saltedpasslen = CBSASL_SHA1_DIGEST_SIZE;
+    // for computing the server signature, we only need the server key (derived
+    // from the salted password) and the authentication message
+    const unsigned char *saltedpassword =
+        (const unsigned char *)"\x6e\x88\xbe\x8b\xad\x7e\xae\x9d\x9e\x10\xaa\x06\x12\x24\x03"
+                               "\x4f\xed\x48\xd0\x3f";
+    scram_keys_t keys;
+    ASSERT_EQ(SASL_OK, compute_scram_keys(SASL_AUTH_MECH_SCRAM_SHA1, saltedpassword, CBSASL_SHA1_DIGEST_SIZE, &keys));
+    ctx.c.client.server_key = keys.server_key;
+    ctx.c.client.server_key_len = keys.length;
     ctx.c.client.auth_message =
         (char *)"n=foo,r=001122334455667788,r=00112233445566778899aabbccddeeff,s=c2FsdA==,i=1000,"
                 "c=biws,r=00112233445566778899aabbccddeeff";
@@ -511,4 +526,143 @@ TEST_F(ScramTest, FinalServerCheck_SHA1)
     EXPECT_EQ(SASL_OK, cbsasl_client_check(&ctx, valid_sign, strlen(valid_sign)));
 }
 
+TEST_F(ScramTest, DeriveKeysUsesCache)
+{
+    union {
+        cbsasl_secret_t secret;
+        char buffer[30];
+    } u_auth;
+    const char *salt = "c2FsdA=="; // "salt" in base64
+    memcpy(u_auth.secret.data, "password", 8);
+    u_auth.secret.len = 8;
+
+    unsigned char saltedpassword[CBSASL_SHA512_DIGEST_SIZE];
+    unsigned int saltedpasslen = 0;
+    ASSERT_EQ(SASL_OK, generate_salted_password(SASL_AUTH_MECH_SCRAM_SHA512, &u_auth.secret, salt, strlen(salt), 1000,
+                                                saltedpassword, &saltedpasslen));
+    scram_keys_t expected;
+    ASSERT_EQ(SASL_OK, compute_scram_keys(SASL_AUTH_MECH_SCRAM_SHA512, saltedpassword, saltedpasslen, &expected));
+
+    unsigned long hits = 0, misses = 0;
+    scram_keys_cache_clear();
+    scram_keys_t keys;
+    ASSERT_EQ(SASL_OK,
+              derive_scram_keys(SASL_AUTH_MECH_SCRAM_SHA512, &u_auth.secret, salt, strlen(salt), 1000, &keys));
+    scram_keys_cache_stats(&hits, &misses);
+    EXPECT_EQ(0, hits);
+    EXPECT_EQ(1, misses);
+    ASSERT_EQ(expected.length, keys.length);
+    EXPECT_EQ(0, memcmp(expected.client_key, keys.client_key, keys.length));
+    EXPECT_EQ(0, memcmp(expected.stored_key, keys.stored_key, keys.length));
+    EXPECT_EQ(0, memcmp(expected.server_key, keys.server_key, keys.length));
+
+    scram_keys_t cached;
+    ASSERT_EQ(SASL_OK,
+              derive_scram_keys(SASL_AUTH_MECH_SCRAM_SHA512, &u_auth.secret, salt, strlen(salt), 1000, &cached));
+    scram_keys_cache_stats(&hits, &misses);
+    EXPECT_EQ(1, hits);
+    EXPECT_EQ(1, misses);
+    EXPECT_EQ(0, memcmp(&keys, &cached, sizeof(keys)));
+
+    // every component of the lookup key must be taken into account
+    const char *othersalt = "cGVwcGVy"; // "pepper" in base64
+    ASSERT_EQ(SASL_OK, derive_scram_keys(SASL_AUTH_MECH_SCRAM_SHA512, &u_auth.secret, othersalt, strlen(othersalt),
+                                         1000, &cached));
+    EXPECT_NE(0, memcmp(keys.server_key, cached.server_key, keys.length));
+    ASSERT_EQ(SASL_OK,
+              derive_scram_keys(SASL_AUTH_MECH_SCRAM_SHA512, &u_auth.secret, salt, strlen(salt), 1001, &cached));
+    EXPECT_NE(0, memcmp(keys.server_key, cached.server_key, keys.length));
+    ASSERT_EQ(SASL_OK,
+              derive_scram_keys(SASL_AUTH_MECH_SCRAM_SHA256, &u_auth.secret, salt, strlen(salt), 1000, &cached));
+    EXPECT_EQ(CBSASL_SHA256_DIGEST_SIZE, cached.length);
+    memcpy(u_auth.secret.data, "passw0rd", 8);
+    ASSERT_EQ(SASL_OK,
+              derive_scram_keys(SASL_AUTH_MECH_SCRAM_SHA512, &u_auth.secret, salt, strlen(salt), 1000, &cached));
+    EXPECT_NE(0, memcmp(keys.server_key, cached.server_key, keys.length));
+    scram_keys_cache_stats(&hits, &misses);
+    EXPECT_EQ(1, hits);
+    EXPECT_EQ(5, misses);
+
+    scram_keys_cache_clear();
+    scram_keys_cache_stats(&hits, &misses);
+    EXPECT_EQ(0, hits);
+    EXPECT_EQ(0, misses);
+}
+
+#ifdef HAVE_PKCS5_PBKDF2_HMAC
+static int scram_test_username(void *, int, const char **result, unsigned int *len)
+{
+    *result = "Administrator";
+    *len = strlen(*result);
+    return SASL_OK;
+}
+
+static int scram_test_password(cbsasl_conn_t *, void *context, int, cbsasl_secret_t **psecret)
+{
+    *psecret = static_cast<cbsasl_secret_t *>(context);
+    return SASL_OK;
+}
+
+/**
+ * Runs the client side of the SCRAM-SHA512 conversation against the server
+ * messages built from the known ServerKey.
+ */
+static void scram_handshake(cbsasl_secret_t *secret, const scram_keys_t *serverkeys, unsigned int itcount)
+{
+    cbsasl_callbacks_t callbacks;
+    callbacks.context = secret;
+    callbacks.username = scram_test_username;
+    callbacks.password = scram_test_password;
+    cbsasl_conn_t *conn = nullptr;
+    ASSERT_EQ(SASL_OK, cbsasl_client_new(nullptr, nullptr, nullptr, nullptr, &callbacks, 0, &conn));
+
+    const char *out = nullptr, *mech = nullptr;
+    unsigned int outlen = 0;
+    ASSERT_EQ(SASL_OK, cbsasl_client_start(conn, "SCRAM-SHA512", nullptr, &out, &outlen, &mech));
+    std::string serverfirst = "r=" + std::string(conn->c.client.nonce) + "c2VydmVy,s=c2FsdA==,i=";
+    serverfirst += std::to_string(itcount);
+    ASSERT_EQ(SASL_CONTINUE,
+              cbsasl_client_step(conn, serverfirst.c_str(), serverfirst.size(), nullptr, &out, &outlen));
+
+    char serversign[(CBSASL_SHA512_DIGEST_SIZE / 3 + 1) * 4 + 1];
+    ASSERT_EQ(SASL_OK,
+              compute_server_signature_with_key(SASL_AUTH_MECH_SCRAM_SHA512, serverkeys->server_key,
+                                                serverkeys->length, conn->c.client.auth_message, serversign,
+                                                sizeof(serversign)));
+    std::string serverfinal = std::string("v=") + serversign;
+    EXPECT_EQ(SASL_OK, cbsasl_client_check(conn, serverfinal.c_str(), serverfinal.size()));
+    cbsasl_dispose(&conn);
+}
+
+TEST_F(ScramTest, HandshakeUsesCache)
+{
+    union {
+        cbsasl_secret_t secret;
+        char buffer[30];
+    } u_auth;
+    const char *salt = "c2FsdA==";
+    memcpy(u_auth.secret.data, "password", 8);
+    u_auth.secret.len = 8;
+    const unsigned int itcount = 1000;
+
+    unsigned char saltedpassword[CBSASL_SHA512_DIGEST_SIZE];
+    unsigned int saltedpasslen = 0;
+    ASSERT_EQ(SASL_OK, generate_salted_password(SASL_AUTH_MECH_SCRAM_SHA512, &u_auth.secret, salt, strlen(salt),
+                                                itcount, saltedpassword, &saltedpasslen));
+    scram_keys_t serverkeys;
+    ASSERT_EQ(SASL_OK, compute_scram_keys(SASL_AUTH_MECH_SCRAM_SHA512, saltedpassword, saltedpasslen, &serverkeys));
+
+    // only the first handshake derives the keys, the rest of them still verify the server
+    scram_keys_cache_clear();
+    for (int ii = 0; ii < 3; ii++) {
+        scram_handshake(&u_auth.secret, &serverkeys, itcount);
+    }
+    unsigned long hits = 0, misses = 0;
+    scram_keys_cache_stats(&hits, &misses);
+    EXPECT_EQ(2, hits);
+    EXPECT_EQ(1, misses);
+    scram_keys_cache_clear();
+}
+#endif // HAVE_PKCS5_PBKDF2_HMAC
+
 #endif // LCB_NO_SSL
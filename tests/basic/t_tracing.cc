@@ -0,0 +1,177 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+#include "internal.h"
+#include <vector>
+
+using namespace lcb::trace;
+
+class Tracing : public ::testing::Test
+{
+};
+
+struct CapturedLogs {
+    lcb_LOGGER *base{nullptr};
+    std::vector<std::string> messages;
+};
+
+extern "C" {
+static void capture_logger(const lcb_LOGGER *logger, uint64_t, const char *, lcb_LOG_SEVERITY, const char *, int,
+                           const char *fmt, va_list ap)
+{
+    char buf[4096];
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    CapturedLogs *logs;
+    lcb_logger_cookie(logger, reinterpret_cast<void **>(&logs));
+    logs->messages.emplace_back(buf);
+}
+}
+
+TEST_F(Tracing, testTagValues)
+{
+    lcbtrace_SPAN *span = lcbtrace_span_start(nullptr, "custom", 1, nullptr);
+    std::string long_value(200, 'x');
+
+    lcbtrace_span_add_tag_str(span, "short", "42");
+    lcbtrace_span_add_tag_str(span, "long", long_value.c_str());
+    lcbtrace_span_add_tag_uint64(span, "number", 42);
+
+    char *value;
+    size_t nvalue;
+    ASSERT_EQ(LCB_SUCCESS, lcbtrace_span_get_tag_str(span, "short", &value, &nvalue));
+    ASSERT_EQ("42", std::string(value, nvalue));
+    ASSERT_EQ(LCB_SUCCESS, lcbtrace_span_get_tag_str(span, "long", &value, &nvalue));
+    ASSERT_EQ(long_value, std::string(value, nvalue));
+    uint64_t number = 0;
+    ASSERT_EQ(LCB_SUCCESS, lcbtrace_span_get_tag_uint64(span, "number", &number));
+    ASSERT_EQ(42, number);
+    ASSERT_STREQ("custom", lcbtrace_span_get_operation(span));
+    lcbtrace_span_finish(span, 2);
+}
+
+TEST_F(Tracing, testThresholdReport)
+{
+    CapturedLogs logs;
+    lcb_logger_create(&logs.base, &logs);
+    lcb_logger_callback(logs.base, capture_logger);
+
+    lcb_INSTANCE *instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_LOGGER, logs.base));
+    lcbtrace_TRACER *tracer = lcb_get_tracer(instance);
+    ASSERT_NE(nullptr, tracer);
+    auto *tlt = reinterpret_cast<ThresholdLoggingTracer *>(tracer->cookie);
+
+    uint64_t threshold = instance->settings->tracer_threshold[LCBTRACE_THRESHOLD_KV];
+    for (uint32_t ii = 0; ii < 3; ii++) {
+        lcbtrace_SPAN *span = lcbtrace_span_start(tracer, LCBTRACE_OP_UPSERT, 1000, nullptr);
+        span->is_outer(true);
+        lcbtrace_span_add_system_tags(span, instance->settings, LCBTRACE_THRESHOLD_KV);
+        std::string opid = std::to_string(ii);
+        lcbtrace_span_add_tag_str(span, LCBTRACE_TAG_OPERATION_ID, opid.c_str());
+        lcbtrace_span_finish(span, 1000 + threshold + 1 + ii);
+    }
+    {
+        std::string opname("custom_operation");
+        lcbtrace_SPAN *span = lcbtrace_span_start(tracer, opname.c_str(), 1000, nullptr);
+        span->is_outer(true);
+        lcbtrace_span_set_orphaned(span, 1);
+        lcbtrace_span_finish(span, 2000);
+    }
+
+    tlt->do_flush_threshold();
+    tlt->do_flush_orphans();
+
+    ASSERT_EQ(2, logs.messages.size());
+    const std::string &threshold_log = logs.messages[0];
+    ASSERT_NE(std::string::npos, threshold_log.find("Operations over threshold: "));
+    ASSERT_NE(std::string::npos, threshold_log.find("\"count\":3"));
+    ASSERT_NE(std::string::npos, threshold_log.find("\"service\":\"kv\""));
+    ASSERT_NE(std::string::npos, threshold_log.find("\"operation_name\":\"upsert\""));
+    /* the slowest operation goes first */
+    size_t slowest = threshold_log.find("\"last_operation_id\":\"2\"");
+    size_t fastest = threshold_log.find("\"last_operation_id\":\"0\"");
+    ASSERT_NE(std::string::npos, slowest);
+    ASSERT_NE(std::string::npos, fastest);
+    ASSERT_LT(slowest, fastest);
+
+    const std::string &orphan_log = logs.messages[1];
+    ASSERT_NE(std::string::npos, orphan_log.find("Orphan responses observed: "));
+    ASSERT_NE(std::string::npos, orphan_log.find("\"operation_name\":\"custom_operation\""));
+    ASSERT_NE(std::string::npos, orphan_log.find("\"total_duration_us\":1000"));
+
+    lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_LOGGER, nullptr);
+    lcb_destroy(instance);
+    lcb_logger_destroy(logs.base);
+}
+
+TEST_F(Tracing, testSampleRate)
+{
+    lcb_INSTANCE *instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+
+    float rate = 0;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_TRACING_SAMPLE_RATE, &rate));
+    ASSERT_EQ(1.0, rate);
+    ASSERT_TRUE(sample_span(instance->settings));
+
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "tracing_sample_rate", "0"));
+    for (int ii = 0; ii < 100; ii++) {
+        ASSERT_FALSE(sample_span(instance->settings));
+    }
+
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "tracing_sample_rate", "0.5"));
+    int sampled = 0;
+    for (int ii = 0; ii < 10000; ii++) {
+        if (sample_span(instance->settings)) {
+            sampled++;
+        }
+    }
+    ASSERT_GT(sampled, 4000);
+    ASSERT_LT(sampled, 6000);
+
+    rate = 1.5;
+    ASSERT_NE(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_TRACING_SAMPLE_RATE, &rate));
+
+    ASSERT_FALSE(is_tail_based(instance->settings));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "tracing_tail_based", "true"));
+    ASSERT_TRUE(is_tail_based(instance->settings));
+
+    lcb_destroy(instance);
+}
+
+TEST_F(Tracing, testTailBasedFailures)
+{
+    // expected outcomes of the operations
+    ASSERT_FALSE(is_kv_failure_status(PROTOCOL_BINARY_RESPONSE_SUCCESS));
+    ASSERT_FALSE(is_kv_failure_status(PROTOCOL_BINARY_RESPONSE_KEY_ENOENT));
+    ASSERT_FALSE(is_kv_failure_status(PROTOCOL_BINARY_RESPONSE_KEY_EEXISTS));
+    ASSERT_FALSE(is_kv_failure_status(PROTOCOL_BINARY_RESPONSE_LOCKED));
+    ASSERT_FALSE(is_kv_failure_status(PROTOCOL_BINARY_RESPONSE_SUBDOC_PATH_ENOENT));
+    ASSERT_FALSE(is_kv_failure_status(PROTOCOL_BINARY_RESPONSE_SUBDOC_MULTI_PATH_FAILURE));
+
+    // server-side errors
+    ASSERT_TRUE(is_kv_failure_status(PROTOCOL_BINARY_RESPONSE_ETMPFAIL));
+    ASSERT_TRUE(is_kv_failure_status(PROTOCOL_BINARY_RESPONSE_EBUSY));
+    ASSERT_TRUE(is_kv_failure_status(PROTOCOL_BINARY_RESPONSE_ENOMEM));
+    ASSERT_TRUE(is_kv_failure_status(PROTOCOL_BINARY_RESPONSE_EINTERNAL));
+    ASSERT_TRUE(is_kv_failure_status(PROTOCOL_BINARY_RESPONSE_NOT_MY_VBUCKET));
+    ASSERT_TRUE(is_kv_failure_status(PROTOCOL_BINARY_RESPONSE_SYNC_WRITE_AMBIGUOUS));
+}
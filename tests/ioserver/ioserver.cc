@@ -17,6 +17,7 @@
 
 #include <sys/types.h>
 #include "ioserver.h"
+#include <iterator>
 using namespace LCBTest;
 using std::list;
 
@@ -34,17 +35,17 @@ void TestServer::run()
         return;
     }
 
-    fd_set fds;
-    struct timeval tmout = {1, 0};
-
-    FD_ZERO(&fds);
-    FD_SET(*lsn, &fds);
-
     while (!closed) {
         struct sockaddr_in newaddr {
         };
         socklen_t naddr = sizeof(newaddr);
 
+        // select() modifies both the set and the timeout
+        fd_set fds;
+        struct timeval tmout = {1, 0};
+        FD_ZERO(&fds);
+        FD_SET(*lsn, &fds);
+
         if (select(*lsn + 1, &fds, nullptr, nullptr, &tmout) == 1) {
             int newsock = accept(*lsn, (struct sockaddr *)&newaddr, &naddr);
 
@@ -123,3 +124,21 @@ TestConnection *TestServer::findConnection(uint16_t port)
 
     return ret;
 }
+
+TestConnection *TestServer::waitConnection(size_t nconns)
+{
+    TestConnection *ret = nullptr;
+
+    while (ret == nullptr) {
+        sched_yield();
+        mutex.lock();
+        if (conns.size() >= nconns) {
+            auto it = conns.begin();
+            std::advance(it, nconns - 1);
+            ret = *it;
+        }
+        mutex.unlock();
+    }
+
+    return ret;
+}
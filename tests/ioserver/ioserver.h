@@ -498,6 +498,12 @@ class TestServer
      */
     TestConnection *findConnection(uint16_t cliport);
 
+    /**Wait until the server accepts the given number of connections
+     * @param nconns The ordinal number of the connection (starting from 1)
+     * @return The connection object accepted as `nconns`-th
+     */
+    TestConnection *waitConnection(size_t nconns);
+
     /**
      * Get the listening port
      * @return The listening ports that clients may use to connect to this
@@ -531,6 +537,10 @@ class TestServer
         return new SockFD(fd);
     }
     static SockFD *sslSocketFactory(int fd);
+    /** Like sslSocketFactory(), but the records are delivered in two pieces */
+    static SockFD *sslSplitSocketFactory(int fd);
+    /** Like sslSocketFactory(), but the handshake fails unless the client offers h2 with ALPN */
+    static SockFD *sslH2SocketFactory(int fd);
 
   private:
     friend class TestConnection;
@@ -2,6 +2,9 @@
 
 #ifndef LCB_NO_SSL
 #include <openssl/ssl.h>
+#include <chrono>
+#include <cstring>
+#include <thread>
 
 using namespace LCBTest;
 using std::vector;
@@ -9,7 +12,7 @@ using std::vector;
 class SslSocket : public SockFD
 {
   public:
-    explicit SslSocket(SockFD *inner);
+    SslSocket(SockFD *inner, bool split_records, bool require_h2 = false);
 
     ~SslSocket() override;
 
@@ -33,11 +36,24 @@ class SslSocket : public SockFD
     SSL_CTX *ctx;
     SockFD *sfd;
     bool ok{};
+    /** Send every record in two halves, with a pause in between */
+    bool split;
+    BIO *wmem{nullptr};
 };
 
 SockFD *TestServer::sslSocketFactory(int fd)
 {
-    return new SslSocket(new SockFD(fd));
+    return new SslSocket(new SockFD(fd), false);
+}
+
+SockFD *TestServer::sslSplitSocketFactory(int fd)
+{
+    return new SslSocket(new SockFD(fd), true);
+}
+
+SockFD *TestServer::sslH2SocketFactory(int fd)
+{
+    return new SslSocket(new SockFD(fd), false, true);
 }
 
 extern "C" {
@@ -102,10 +118,28 @@ static void genCertificate(SSL_CTX *ctx)
     EVP_PKEY_free(pkey);
 }
 
-SslSocket::SslSocket(SockFD *inner) : SockFD(inner->getFD())
+// The context is shared by all the connections, so that the clients are able
+// to resume sessions (both session IDs and tickets are bound to the context).
+#if OPENSSL_VERSION_NUMBER >= 0x10002000L
+extern "C" {
+static int alpn_h2_callback(SSL *, const unsigned char **out, unsigned char *outlen, const unsigned char *in,
+                            unsigned int inlen, void *)
 {
-    sfd = inner;
-    ctx = SSL_CTX_new(SSLv23_server_method());
+    for (unsigned ii = 0; ii < inlen; ii += in[ii] + 1) {
+        if (in[ii] == 2 && ii + 3 <= inlen && memcmp(in + ii + 1, "h2", 2) == 0) {
+            *out = in + ii + 1;
+            *outlen = 2;
+            return SSL_TLSEXT_ERR_OK;
+        }
+    }
+    return SSL_TLSEXT_ERR_ALERT_FATAL;
+}
+}
+#endif
+
+static SSL_CTX *newServerContext(bool require_h2)
+{
+    SSL_CTX *ctx = SSL_CTX_new(SSLv23_server_method());
     assert(ctx != nullptr);
 
     SSL_CTX_set_info_callback(ctx, log_callback);
@@ -114,6 +148,27 @@ SslSocket::SslSocket(SockFD *inner) : SockFD(inner->getFD())
     SSL_CTX_set_options(ctx, SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3);
     SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, nullptr);
     SSL_CTX_load_verify_locations(ctx, nullptr, nullptr);
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_set_session_id_context(ctx, reinterpret_cast<const unsigned char *>("ioserver"), 8);
+    if (require_h2) {
+#if OPENSSL_VERSION_NUMBER >= 0x10002000L
+        SSL_CTX_set_alpn_select_cb(ctx, alpn_h2_callback, nullptr);
+#endif
+    }
+    return ctx;
+}
+
+SslSocket::SslSocket(SockFD *inner, bool split_records, bool require_h2)
+    : SockFD(inner->getFD()), split(split_records)
+{
+    if (require_h2) {
+        static SSL_CTX *h2_ctx = newServerContext(true);
+        ctx = h2_ctx;
+    } else {
+        static SSL_CTX *shared_ctx = newServerContext(false);
+        ctx = shared_ctx;
+    }
+    sfd = inner;
 
     ssl = SSL_new(ctx);
     assert(ssl != nullptr);
@@ -121,9 +176,45 @@ SslSocket::SslSocket(SockFD *inner) : SockFD(inner->getFD())
     SSL_set_fd(ssl, sfd->getFD());
 }
 
+static void send_all(int fd, const char *buf, size_t n)
+{
+    while (n) {
+        ssize_t nw = ::send(fd, buf, n, 0);
+        if (nw <= 0) {
+            return;
+        }
+        buf += nw;
+        n -= nw;
+    }
+}
+
 size_t SslSocket::send(const void *buf, size_t n, int)
 {
-    return SSL_write(ssl, buf, n);
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+    split = false;
+#endif
+    if (split && !SSL_is_init_finished(ssl)) {
+        SSL_do_handshake(ssl);
+    }
+    if (!split || !SSL_is_init_finished(ssl)) {
+        return SSL_write(ssl, buf, n);
+    }
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+    if (wmem == nullptr) {
+        // from now on the records are encrypted into memory, and sent by us
+        wmem = BIO_new(BIO_s_mem());
+        SSL_set0_wbio(ssl, wmem);
+    }
+    int rv = SSL_write(ssl, buf, n);
+    char *data = nullptr;
+    long ndata = BIO_get_mem_data(wmem, &data);
+    size_t half = ndata / 2;
+    send_all(sfd->getFD(), data, half);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    send_all(sfd->getFD(), data + half, ndata - half);
+    (void)BIO_reset(wmem);
+    return rv;
+#endif
 }
 
 ssize_t SslSocket::recv(void *buf, size_t n, int)
@@ -140,7 +231,6 @@ void SslSocket::close()
 SslSocket::~SslSocket()
 {
     SSL_free(ssl);
-    SSL_CTX_free(ctx);
     delete sfd;
 }
 
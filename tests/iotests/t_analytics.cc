@@ -0,0 +1,142 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include "iotests.h"
+#include <libcouchbase/couchbase.h>
+
+#include "internal.h"
+
+#include "analytics/analytics_handle.hh"
+
+class AnalyticsIngestUnitTest : public MockUnitTest
+{
+};
+
+namespace
+{
+struct IngestResult {
+    bool called{false};
+    lcb_STATUS rc{LCB_SUCCESS};
+    lcb_INGEST_STATS stats{};
+};
+
+/**
+ * The mock does not have the analytics service, so the recorded response is
+ * fed to the handle directly.
+ */
+struct ForwardRows : lcb::jsparse::Parser::Actions {
+    explicit ForwardRows(lcb_ANALYTICS_HANDLE_ *handle_) : handle(handle_) {}
+
+    void JSPARSE_on_row(const lcb::jsparse::Row &row) override
+    {
+        handle->JSPARSE_on_row(row);
+    }
+    void JSPARSE_on_error(const std::string &) override {}
+    void JSPARSE_on_complete(const std::string &) override {}
+
+    lcb_ANALYTICS_HANDLE_ *handle;
+};
+} // namespace
+
+extern "C" {
+static void ingestCallback(lcb_INSTANCE *, int, const lcb_RESPANALYTICS *resp)
+{
+    IngestResult *res;
+    lcb_respanalytics_cookie(resp, (void **)&res);
+    if (lcb_respanalytics_is_final(resp)) {
+        res->called = true;
+        res->rc = lcb_respanalytics_status(resp);
+        lcb_respanalytics_ingest_stats(resp, &res->stats);
+    }
+}
+
+static lcb_INGEST_STATUS idConverter(lcb_INSTANCE *, lcb_INGEST_PARAM *param)
+{
+    const char *row;
+    size_t row_len;
+    lcb_ingest_dataconverter_param_row(param, &row, &row_len);
+    std::string doc(row, row_len);
+    size_t begin = doc.find("\"id\":\"");
+    if (begin == std::string::npos) {
+        return LCB_INGEST_STATUS_IGNORE;
+    }
+    begin += 6;
+    size_t end = doc.find('"', begin);
+    char *id = strdup(doc.substr(begin, end - begin).c_str());
+    lcb_ingest_dataconverter_param_set_id(param, id, end - begin, (void (*)(const char *))free);
+    return LCB_INGEST_STATUS_OK;
+}
+}
+
+TEST_F(AnalyticsIngestUnitTest, testBatchedIngest)
+{
+    SKIP_UNLESS_MOCK()
+    HandleWrap hw;
+    lcb_INSTANCE *instance;
+    createConnection(hw, &instance);
+
+    const size_t nrows = 5000;
+    std::string response = R"({"requestID":"7d9e1c1e","signature":{"*":"*"},"results":[)";
+    for (size_t ii = 0; ii < nrows; ii++) {
+        if (ii) {
+            response += ",";
+        }
+        response += R"({"id":"ingest-)" + std::to_string(ii) + R"(","value":)" + std::to_string(ii) + "}";
+    }
+    // this row is skipped by the converter
+    response += R"(,{"value":-1}],"plans":{},"status":"success","metrics":{"resultCount":5001}})";
+
+    for (uint32_t threads : {0, 2}) {
+        lcb_INGEST_OPTIONS *options;
+        lcb_ingest_options_create(&options);
+        lcb_ingest_options_method(options, LCB_INGEST_METHOD_UPSERT);
+        lcb_ingest_options_data_converter(options, idConverter);
+        lcb_ingest_options_window(options, 8);
+        lcb_ingest_options_converter_threads(options, threads);
+
+        lcb_CMDANALYTICS *cmd;
+        lcb_cmdanalytics_create(&cmd);
+        lcb_cmdanalytics_callback(cmd, ingestCallback);
+        std::string statement = "SELECT * FROM recorded";
+        lcb_cmdanalytics_statement(cmd, statement.c_str(), statement.size());
+        lcb_cmdanalytics_ingest_options(cmd, options);
+
+        IngestResult res;
+        auto *handle = new lcb_ANALYTICS_HANDLE_(instance, &res, cmd);
+        lcb_cmdanalytics_destroy(cmd);
+        lcb_ingest_options_destroy(options);
+
+        ForwardRows forward(handle);
+        lcb::jsparse::Parser parser(lcb::jsparse::Parser::MODE_ANALYTICS, &forward);
+        for (size_t ii = 0; ii < response.size(); ii += 4096) {
+            parser.feed(response.c_str() + ii, std::min<size_t>(4096, response.size() - ii));
+        }
+        handle->unref();
+        lcb_wait(instance, LCB_WAIT_DEFAULT);
+
+        ASSERT_TRUE(res.called);
+        ASSERT_EQ(nrows + 1, res.stats.rows);
+        ASSERT_EQ(nrows, res.stats.stored);
+        ASSERT_EQ(1, res.stats.ignored);
+        ASSERT_EQ(0, res.stats.failed);
+    }
+
+    Item itm;
+    getKey(instance, "ingest-42", itm);
+    ASSERT_EQ(R"({"id":"ingest-42","value":42})", itm.val);
+}
@@ -16,6 +16,7 @@
  */
 #include "config.h"
 #include "iotests.h"
+#include <libcouchbase/pktfwd.h>
 
 class MutateUnitTest : public MockUnitTest
 {
@@ -143,6 +144,79 @@ TEST_F(MutateUnitTest, testStoreZeroLengthValue)
     EXPECT_EQ(0, itm.val.length());
 }
 
+struct BorrowedValueCookie {
+    int stored{0};
+    int flushed{0};
+};
+
+extern "C" {
+static void testBorrowedValueStoreCallback(lcb_INSTANCE *, int, const lcb_RESPSTORE *resp)
+{
+    BorrowedValueCookie *cookie;
+    lcb_respstore_cookie(resp, (void **)&cookie);
+    EXPECT_EQ(LCB_SUCCESS, lcb_respstore_status(resp));
+    cookie->stored++;
+}
+
+static void testBorrowedValueFlushedCallback(lcb_INSTANCE *, const void *cookie)
+{
+    auto *bvc = static_cast<BorrowedValueCookie *>(const_cast<void *>(cookie));
+    EXPECT_EQ(1, bvc->stored);
+    bvc->flushed++;
+}
+}
+
+/**
+ * @test Borrowed value
+ * @pre store values which reference application memory, both contiguous and fragmented
+ * @post values are stored, and the application is notified once when it may release the buffers
+ */
+TEST_F(MutateUnitTest, testStoreBorrowedValue)
+{
+    std::string key("testStoreBorrowedValue");
+    lcb_INSTANCE *instance;
+    HandleWrap hw;
+    createConnection(hw, &instance);
+
+    (void)lcb_install_callback(instance, LCB_CALLBACK_STORE, (lcb_RESPCALLBACK)testBorrowedValueStoreCallback);
+    lcb_set_pktflushed_callback(instance, testBorrowedValueFlushedCallback);
+
+    std::string value(1024 * 1024, 'v');
+    BorrowedValueCookie cookie;
+    lcb_CMDSTORE *cmd;
+    lcb_cmdstore_create(&cmd, LCB_STORE_UPSERT);
+    lcb_cmdstore_key(cmd, key.data(), key.length());
+    lcb_cmdstore_value_borrowed(cmd, value.data(), value.size());
+    EXPECT_EQ(LCB_SUCCESS, lcb_store(instance, &cookie, cmd));
+    lcb_cmdstore_destroy(cmd);
+    lcb_wait(instance, LCB_WAIT_NOCHECK);
+    EXPECT_EQ(1, cookie.stored);
+    EXPECT_EQ(1, cookie.flushed);
+
+    Item itm;
+    getKey(instance, key, itm);
+    EXPECT_EQ(value, itm.val);
+
+    std::string prefix("{\"fragmented\":"), suffix("true}");
+    lcb_IOV iov[2];
+    iov[0].iov_base = &prefix[0];
+    iov[0].iov_len = prefix.size();
+    iov[1].iov_base = &suffix[0];
+    iov[1].iov_len = suffix.size();
+    cookie = BorrowedValueCookie();
+    lcb_cmdstore_create(&cmd, LCB_STORE_UPSERT);
+    lcb_cmdstore_key(cmd, key.data(), key.length());
+    lcb_cmdstore_value_iov_borrowed(cmd, iov, 2);
+    EXPECT_EQ(LCB_SUCCESS, lcb_store(instance, &cookie, cmd));
+    lcb_cmdstore_destroy(cmd);
+    lcb_wait(instance, LCB_WAIT_NOCHECK);
+    EXPECT_EQ(1, cookie.stored);
+    EXPECT_EQ(1, cookie.flushed);
+
+    getKey(instance, key, itm);
+    EXPECT_EQ(prefix + suffix, itm.val);
+}
+
 extern "C" {
 static void testRemoveCallback(lcb_INSTANCE *, lcb_CALLBACK_TYPE, const lcb_RESPREMOVE *resp)
 {
@@ -33,8 +33,7 @@ void lcb_n1qlcache_getplan(lcb_QUERY_CACHE_ *cache, const std::string &key, std:
 {
     const Plan *plan = cache->get_entry(key);
     if (plan != nullptr) {
-        Json::Value tmp(Json::objectValue);
-        plan->apply_plan(tmp, out);
+        out = "{" + plan->encoded() + "}";
     }
 }
 
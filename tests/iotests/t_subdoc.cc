@@ -751,6 +751,64 @@ TEST_F(SubdocUnitTest, testMultiLookup)
     lcb_cmdsubdoc_destroy(mcmd);
 }
 
+TEST_F(SubdocUnitTest, testCompiledSpecs)
+{
+    SKIP_IF_CLUSTER_VERSION_IS_LOWER_THAN(MockEnvironment::VERSION_45)
+    HandleWrap hw;
+    lcb_INSTANCE *instance;
+    CREATE_SUBDOC_CONNECTION(hw, &instance)
+
+    lcb_CMDSUBDOC *cmd;
+    lcb_cmdsubdoc_create(&cmd);
+    lcb_cmdsubdoc_key(cmd, key.c_str(), key.size());
+
+    lcb_SUBDOCSPECS *specs;
+    lcb_subdocspecs_create(&specs, 3);
+    lcb_subdocspecs_get(specs, 0, 0, "dictkey", strlen("dictkey"));
+    lcb_subdocspecs_get(specs, 1, 0, "nonexist", strlen("nonexist"));
+    lcb_subdocspecs_get_count(specs, 2, 0, "array", strlen("array"));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_subdocspecs_compile(specs));
+    lcb_cmdsubdoc_specs(cmd, specs);
+
+    // the compiled specs are reused by every request
+    for (int ii = 0; ii < 3; ii++) {
+        MultiResult mr;
+        ASSERT_STATUS_EQ(LCB_SUCCESS, schedwait(instance, &mr, cmd, lcb_subdoc));
+        ASSERT_STATUS_EQ(LCB_SUCCESS, mr.rc);
+        ASSERT_EQ(3, mr.results.size());
+        ASSERT_EQ("\"dictval\"", mr.results[0].value);
+        ASSERT_STATUS_EQ(LCB_ERR_SUBDOC_PATH_NOT_FOUND, mr.results[1].rc);
+        ASSERT_EQ("5", mr.results[2].value);
+    }
+
+    // modifying the specs discards the compiled form
+    lcb_subdocspecs_get(specs, 1, 0, "array[1]", strlen("array[1]"));
+    lcb_cmdsubdoc_specs(cmd, specs);
+    MultiResult mr;
+    ASSERT_STATUS_EQ(LCB_SUCCESS, schedwait(instance, &mr, cmd, lcb_subdoc));
+    ASSERT_EQ(3, mr.results.size());
+    ASSERT_EQ("2", mr.results[1].value);
+
+    // validation errors are reported by the compiler
+    lcb_subdocspecs_remove(specs, 1, 0, "array[0]", strlen("array[0]"));
+    ASSERT_STATUS_EQ(LCB_ERR_OPTIONS_CONFLICT, lcb_subdocspecs_compile(specs));
+    lcb_subdocspecs_destroy(specs);
+
+    lcb_subdocspecs_create(&specs, 2);
+    lcb_subdocspecs_dict_upsert(specs, 0, 0, "compiled", strlen("compiled"), "true", 4);
+    lcb_subdocspecs_counter(specs, 1, LCB_SUBDOCSPECS_F_MKINTERMEDIATES, "counters.compiled",
+                            strlen("counters.compiled"), 42);
+    ASSERT_STATUS_EQ(LCB_SUCCESS, lcb_subdocspecs_compile(specs));
+    lcb_cmdsubdoc_specs(cmd, specs);
+    lcb_subdocspecs_destroy(specs);
+    ASSERT_STATUS_EQ(LCB_SUCCESS, schedwait(instance, &mr, cmd, lcb_subdoc));
+    ASSERT_STATUS_EQ(LCB_SUCCESS, mr.rc);
+    ASSERT_PATHVAL_EQ("true", instance, key, "compiled");
+    ASSERT_PATHVAL_EQ("42", instance, key, "counters.compiled");
+
+    lcb_cmdsubdoc_destroy(cmd);
+}
+
 TEST_F(SubdocUnitTest, testMultiMutations)
 {
     SKIP_IF_CLUSTER_VERSION_IS_LOWER_THAN(MockEnvironment::VERSION_45)
@@ -199,3 +199,51 @@ TEST_F(McFlush, testPartialFlush)
     mcreq_packet_handled(pw.pipeline, pw.pkt);
     ASSERT_EQ(1, cookie.ncalled);
 }
+
+extern "C" {
+static void count_latency(const void *cookie, lcb_timeunit_t, lcb_U32, lcb_U32, lcb_U32 total, lcb_U32)
+{
+    *(lcb_U32 *)cookie += total;
+}
+}
+
+TEST_F(McFlush, testQueueLatency)
+{
+    CQWrap cq;
+    PacketWrap pw;
+    MyCookie cookie;
+
+    lcb_SERVERMETRICS metrics{};
+    metrics.queue_latency = lcb_histogram_create();
+
+    cq.setBufFreeCallback(buf_free_callback);
+    pw.setContigKey("1234");
+    ASSERT_TRUE(pw.reservePacket(&cq));
+    pw.setCookie(&cookie);
+    cookie.exp_kbuf = pw.pktbuf;
+    pw.setHeaderSize();
+    pw.copyHeader();
+    pw.pipeline->metrics = &metrics;
+    hrtime_t start = gethrtime();
+    MCREQ_PKT_RDATA(pw.pkt)->start = start;
+    mcreq_enqueue_packet(pw.pipeline, pw.pkt);
+
+    /* partially flushed packets are not recorded */
+    nb_IOV iovs[10];
+    unsigned toFlush = mcreq_flush_iov_fill(pw.pipeline, iovs, 10, nullptr);
+    mcreq_flush_done(pw.pipeline, 8, toFlush);
+    ASSERT_EQ(0, MCREQ_PKT_RDATA(pw.pkt)->flushed);
+
+    toFlush = mcreq_flush_iov_fill(pw.pipeline, iovs, 10, nullptr);
+    mcreq_flush_done(pw.pipeline, toFlush, toFlush);
+    ASSERT_GE(MCREQ_PKT_RDATA(pw.pkt)->flushed, start);
+
+    lcb_U32 nrecorded = 0;
+    lcb_histogram_read(metrics.queue_latency, &nrecorded, count_latency);
+    ASSERT_EQ(1, nrecorded);
+
+    pw.pipeline->metrics = nullptr;
+    mcreq_pipeline_remove(pw.pipeline, pw.pkt->opaque);
+    mcreq_packet_handled(pw.pipeline, pw.pkt);
+    lcb_histogram_destroy(metrics.queue_latency);
+}
@@ -0,0 +1,179 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/**
+ * @file
+ * Scripted memcached peer for the tests which need the KV protocol.
+ * Include it after socktest.h.
+ */
+#ifndef LCB_SOCKTEST_FAKEMEMCACHED_H
+#define LCB_SOCKTEST_FAKEMEMCACHED_H
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <memcached/protocol_binary.h>
+
+struct Packet {
+    uint8_t opcode;
+    uint32_t opaque;
+    std::string extras;
+    std::string key;
+    std::string value;
+};
+
+/**
+ * Scripted server side of the KV protocol. Every turn the server reads the
+ * given number of requests, waits for the injected latency, and replies to
+ * all of them at once. If the client does not pipeline the commands, it
+ * never sends enough requests for the turn, and the test fails.
+ */
+class FakeMemcached
+{
+  public:
+    FakeMemcached(Loop *l, TestConnection *c, unsigned latency_ms) : loop(l), conn(c), latency(latency_ms) {}
+
+    bool recv(std::vector<Packet> &packets, size_t npackets)
+    {
+        for (size_t ii = 0; ii < npackets; ii++) {
+            std::string hdr;
+            if (!recvBytes(24, hdr)) {
+                return false;
+            }
+            const auto *req = reinterpret_cast<const protocol_binary_request_header *>(hdr.data());
+            Packet pkt;
+            pkt.opcode = req->request.opcode;
+            pkt.opaque = req->request.opaque;
+            uint16_t nkey = ntohs(req->request.keylen);
+            uint32_t nbody = ntohl(req->request.bodylen);
+            std::string body;
+            if (nbody && !recvBytes(nbody, body)) {
+                return false;
+            }
+            pkt.extras = body.substr(0, req->request.extlen);
+            pkt.key = body.substr(req->request.extlen, nkey);
+            pkt.value = body.substr(req->request.extlen + nkey);
+            packets.push_back(pkt);
+        }
+        turns++;
+        return true;
+    }
+
+    void reply(const Packet &req, uint16_t status, const std::string &value = std::string())
+    {
+        protocol_binary_response_header hdr{};
+        hdr.response.magic = PROTOCOL_BINARY_RES;
+        hdr.response.opcode = req.opcode;
+        hdr.response.status = htons(status);
+        hdr.response.bodylen = htonl(value.size());
+        hdr.response.opaque = req.opaque;
+        pending.append(reinterpret_cast<const char *>(hdr.bytes), sizeof(hdr.bytes));
+        pending.append(value);
+    }
+
+    /** Sends all replies of the turn after the injected latency */
+    void flush()
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(latency));
+        SendFuture sf(pending);
+        conn->setSend(&sf);
+        sf.wait();
+        pending.clear();
+    }
+
+    unsigned turns{0};
+
+  private:
+    bool recvBytes(size_t n, std::string &out)
+    {
+        RecvFuture rf(n);
+        conn->setRecv(&rf);
+        FutureBreakCondition cond(&rf);
+        loop->setBreakCondition(&cond);
+        loop->start();
+        if (!rf.checkDone()) {
+            return false;
+        }
+        rf.wait();
+        out = rf.getString();
+        return true;
+    }
+
+    Loop *loop;
+    TestConnection *conn;
+    unsigned latency;
+    std::string pending{};
+};
+
+inline std::string hello_features()
+{
+    uint16_t features[] = {htons(PROTOCOL_BINARY_FEATURE_XERROR), htons(PROTOCOL_BINARY_FEATURE_SELECT_BUCKET)};
+    return std::string(reinterpret_cast<const char *>(features), sizeof(features));
+}
+
+static const char *const errmap_json =
+    "{\"version\":1,\"revision\":1,\"errors\":{\"0\":{\"name\":\"SUCCESS\",\"desc\":\"Success\",\"attrs\":[]}}}";
+
+class PredicateBreakCondition : public BreakCondition
+{
+  public:
+    explicit PredicateBreakCondition(std::function<bool()> p) : pred(std::move(p)) {}
+
+  protected:
+    bool shouldBreakImpl() override
+    {
+        return pred();
+    }
+
+  private:
+    std::function<bool()> pred;
+};
+
+/** Replies to the requests of the negotiation one by one, until the bucket is selected */
+inline void serveNegotiation(FakeMemcached &server)
+{
+    for (;;) {
+        std::vector<Packet> pkts;
+        ASSERT_TRUE(server.recv(pkts, 1));
+        const Packet &pkt = pkts[0];
+        switch (pkt.opcode) {
+            case PROTOCOL_BINARY_CMD_HELLO:
+                server.reply(pkt, PROTOCOL_BINARY_RESPONSE_SUCCESS, hello_features());
+                break;
+            case PROTOCOL_BINARY_CMD_GET_ERROR_MAP:
+                server.reply(pkt, PROTOCOL_BINARY_RESPONSE_SUCCESS, errmap_json);
+                break;
+            case PROTOCOL_BINARY_CMD_SASL_LIST_MECHS:
+                server.reply(pkt, PROTOCOL_BINARY_RESPONSE_SUCCESS, "PLAIN");
+                break;
+            case PROTOCOL_BINARY_CMD_SASL_AUTH:
+            case PROTOCOL_BINARY_CMD_SELECT_BUCKET:
+                server.reply(pkt, PROTOCOL_BINARY_RESPONSE_SUCCESS);
+                break;
+            default:
+                FAIL() << "Unexpected opcode " << (int)pkt.opcode;
+        }
+        server.flush();
+        if (pkt.opcode == PROTOCOL_BINARY_CMD_SELECT_BUCKET) {
+            return;
+        }
+    }
+}
+
+#endif
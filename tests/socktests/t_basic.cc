@@ -157,3 +157,104 @@ TEST_F(SockConnTest, testImmediateUnref)
     ASSERT_EQ(1, sock.callCount);
     ASSERT_TRUE(sock.sock == NULL);
 }
+
+#ifndef _WIN32
+struct RaceResult {
+    Loop *loop;
+    lcb_STATUS err;
+    int family;
+    hrtime_t elapsed;
+    hrtime_t started;
+};
+
+extern "C" {
+static void race_conncb(lcbio_SOCKET *sock, void *arg, lcb_STATUS err, lcbio_OSERR)
+{
+    RaceResult *res = (RaceResult *)arg;
+    res->err = err;
+    res->elapsed = gethrtime() - res->started;
+    if (sock) {
+        res->family = sock->info->sa_remote.ss_family;
+    }
+    res->loop->stop();
+}
+}
+
+static void race_connect(Loop *loop, const addrinfo *addrs, RaceResult *res)
+{
+    lcb_host_t host = {0};
+    strcpy(host.host, "happy-eyeballs.test");
+    strcpy(host.port, "11210");
+    memset(res, 0, sizeof(*res));
+    res->loop = loop;
+    res->started = gethrtime();
+    lcbio_connect_addrs(loop->iot, loop->settings, &host, addrs, LCB_MS2US(5000), race_conncb, res);
+    loop->start();
+}
+
+// The IPv6 address does not answer (its accept queue is full), while IPv4 is
+// listening: the IPv4 attempt must be started after the attempt delay, and
+// win the race long before the connection timeout.
+TEST_F(SockConnTest, testHappyEyeballs)
+{
+    int blackhole = socket(AF_INET6, SOCK_STREAM, 0);
+    if (blackhole < 0) {
+        std::cerr << "IPv6 is not available, skipping" << std::endl;
+        return;
+    }
+    sockaddr_in6 addr6 = {};
+    socklen_t addrlen = sizeof(addr6);
+    addr6.sin6_family = AF_INET6;
+    addr6.sin6_addr = in6addr_loopback;
+    if (bind(blackhole, (sockaddr *)&addr6, sizeof(addr6)) != 0) {
+        close(blackhole);
+        std::cerr << "IPv6 loopback is not available, skipping" << std::endl;
+        return;
+    }
+    ASSERT_EQ(0, listen(blackhole, 0));
+    ASSERT_EQ(0, getsockname(blackhole, (sockaddr *)&addr6, &addrlen));
+    // occupy the only slot of the accept queue
+    int filler = socket(AF_INET6, SOCK_STREAM, 0);
+    ASSERT_EQ(0, ::connect(filler, (sockaddr *)&addr6, sizeof(addr6)));
+
+    sockaddr_in addr4 = {};
+    addr4.sin_family = AF_INET;
+    addr4.sin_port = htons((uint16_t)atoi(loop->server->getPortString().c_str()));
+    addr4.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    addrinfo ai4 = {}, ai6 = {};
+    ai6.ai_family = AF_INET6;
+    ai6.ai_socktype = SOCK_STREAM;
+    ai6.ai_addr = (sockaddr *)&addr6;
+    ai6.ai_addrlen = sizeof(addr6);
+    ai6.ai_next = &ai4;
+    ai4.ai_family = AF_INET;
+    ai4.ai_socktype = SOCK_STREAM;
+    ai4.ai_addr = (sockaddr *)&addr4;
+    ai4.ai_addrlen = sizeof(addr4);
+
+    unsigned policy = loop->settings->ipv6;
+    loop->settings->ipv6 = LCB_IPV6_ALLOW;
+    RaceResult res;
+    race_connect(loop, &ai6, &res);
+    ASSERT_EQ(LCB_SUCCESS, res.err);
+    ASSERT_EQ(AF_INET, res.family);
+    ASSERT_GE(res.elapsed, LCB_MS2NS(200));
+    ASSERT_LT(res.elapsed, LCB_MS2NS(2500));
+
+    // IPv4 won for this host, so it is tried first now
+    race_connect(loop, &ai6, &res);
+    ASSERT_EQ(LCB_SUCCESS, res.err);
+    ASSERT_EQ(AF_INET, res.family);
+    ASSERT_LT(res.elapsed, LCB_MS2NS(200));
+
+    // IPv6 only policy does not fall back to IPv4
+    loop->settings->ipv6 = LCB_IPV6_ONLY;
+    race_connect(loop, &ai4, &res);
+    loop->settings->ipv6 = policy;
+    ASSERT_EQ(LCB_ERR_UNKNOWN_HOST, res.err);
+
+    close(filler);
+    close(blackhole);
+}
+#endif
@@ -0,0 +1,644 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "socktest.h"
+#include "fakememcached.h"
+#include "bucketconfig/clconfig.h"
+#include <lcbht/hpack.h>
+#include <http/http2.h>
+#include <map>
+
+using std::string;
+using std::vector;
+using lcb::htparse::MimeHeader;
+
+namespace
+{
+enum { DATA = 0x0, HEADERS = 0x1, RST_STREAM = 0x3, SETTINGS = 0x4, WINDOW_UPDATE = 0x8, CONTINUATION = 0x9 };
+enum { END_STREAM = 0x1, ACK = 0x1, END_HEADERS = 0x4 };
+enum { SETTINGS_MAX_CONCURRENT_STREAMS = 0x3 };
+
+const string preface("PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n");
+
+uint32_t get_u32(const char *buf)
+{
+    const auto *p = reinterpret_cast<const unsigned char *>(buf);
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+string u32(uint32_t value)
+{
+    char buf[4] = {char(value >> 24), char(value >> 16), char(value >> 8), char(value)};
+    return string(buf, sizeof(buf));
+}
+
+struct H2Request {
+    uint32_t stream_id;
+    vector<MimeHeader> headers;
+    string body;
+    bool ended;
+
+    const char *header(const string &name) const
+    {
+        for (const auto &hdr : headers) {
+            if (hdr.key == name) {
+                return hdr.value.c_str();
+            }
+        }
+        return nullptr;
+    }
+};
+
+struct HttpCookie {
+    bool done{false};
+    lcb_STATUS rc{LCB_SUCCESS};
+    uint16_t status{0};
+    string body;
+    string content_type;
+};
+
+struct QueryCookie {
+    bool done{false};
+    lcb_STATUS rc{LCB_SUCCESS};
+    vector<string> rows;
+};
+
+extern "C" {
+static void http_callback(lcb_INSTANCE *, int, const lcb_RESPHTTP *resp)
+{
+    HttpCookie *cookie;
+    lcb_resphttp_cookie(resp, (void **)&cookie);
+    if (!lcb_resphttp_is_final(resp)) {
+        return;
+    }
+    cookie->done = true;
+    cookie->rc = lcb_resphttp_status(resp);
+    lcb_resphttp_http_status(resp, &cookie->status);
+    const char *body;
+    size_t nbody;
+    lcb_resphttp_body(resp, &body, &nbody);
+    cookie->body.assign(body ? body : "", nbody);
+    const char *const *headers = nullptr;
+    lcb_resphttp_headers(resp, &headers);
+    for (; headers && headers[0]; headers += 2) {
+        if (strcasecmp(headers[0], "content-type") == 0) {
+            cookie->content_type = headers[1];
+        }
+    }
+}
+
+static void query_callback(lcb_INSTANCE *, int, const lcb_RESPQUERY *resp)
+{
+    QueryCookie *cookie;
+    lcb_respquery_cookie(resp, (void **)&cookie);
+    if (lcb_respquery_is_final(resp)) {
+        cookie->done = true;
+        cookie->rc = lcb_respquery_status(resp);
+        return;
+    }
+    const char *row;
+    size_t nrow;
+    lcb_respquery_row(resp, &row, &nrow);
+    cookie->rows.emplace_back(row, nrow);
+}
+}
+} // namespace
+
+/**
+ * Scripted HTTP/2 server. The frames sent by the client are decoded into the
+ * requests (with the library HPACK decoder), and the responses are queued and
+ * sent by flush().
+ */
+class FakeHttp2
+{
+  public:
+    FakeHttp2(Loop *l, TestConnection *c) : loop(l), conn(c) {}
+
+    bool recvPreface()
+    {
+        string data;
+        return recvBytes(preface.size(), data) && data == preface;
+    }
+
+    /** Receive frames until the condition is met */
+    bool recvUntil(const std::function<bool()> &done)
+    {
+        while (!done()) {
+            if (!recvFrame()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /** Receive frames until `n` requests are complete (END_STREAM) */
+    bool recvRequests(size_t n)
+    {
+        return recvUntil([&] { return nended >= n; });
+    }
+
+    void sendFrame(uint8_t type, uint8_t flags, uint32_t stream_id, const string &payload)
+    {
+        pending.append(u32(uint32_t(payload.size()) << 8).substr(0, 3));
+        pending.push_back(char(type));
+        pending.push_back(char(flags));
+        pending.append(u32(stream_id));
+        pending.append(payload);
+    }
+
+    void sendSettings(const vector<std::pair<uint16_t, uint32_t>> &values = {})
+    {
+        string payload;
+        for (const auto &value : values) {
+            payload.push_back(char(value.first >> 8));
+            payload.push_back(char(value.first));
+            payload.append(u32(value.second));
+        }
+        sendFrame(SETTINGS, 0, 0, payload);
+        sendFrame(SETTINGS, ACK, 0, "");
+    }
+
+    void sendHeaders(uint32_t stream_id, const char *status, bool end_stream,
+                     const vector<MimeHeader> &headers = {{"content-type", "application/json"}})
+    {
+        vector<MimeHeader> fields{{":status", status}};
+        fields.insert(fields.end(), headers.begin(), headers.end());
+        string block;
+        encoder.encode(fields, block);
+        sendFrame(HEADERS, END_HEADERS | (end_stream ? END_STREAM : 0), stream_id, block);
+    }
+
+    void sendData(uint32_t stream_id, const string &data, bool end_stream)
+    {
+        size_t off = 0;
+        do {
+            size_t n = std::min<size_t>(data.size() - off, 16384);
+            bool last = off + n == data.size();
+            sendFrame(DATA, last && end_stream ? END_STREAM : 0, stream_id, data.substr(off, n));
+            off += n;
+        } while (off < data.size());
+    }
+
+    void sendRaw(const string &data)
+    {
+        pending.append(data);
+    }
+
+    /** Send the queued frames, while the client keeps reading */
+    void flush()
+    {
+        SendFuture sf(pending);
+        conn->setSend(&sf);
+        FutureBreakCondition cond(&sf);
+        loop->setBreakCondition(&cond);
+        loop->start();
+        sf.wait();
+        pending.clear();
+    }
+
+    bool recvBytes(size_t n, string &out)
+    {
+        RecvFuture rf(n);
+        conn->setRecv(&rf);
+        FutureBreakCondition cond(&rf);
+        loop->setBreakCondition(&cond);
+        loop->start();
+        if (!rf.checkDone()) {
+            return false;
+        }
+        rf.wait();
+        out = rf.getString();
+        return true;
+    }
+
+    vector<H2Request> requests;
+    size_t nended{0};
+    /** Non-ACK SETTINGS frames received */
+    unsigned nsettings{0};
+    /** SETTINGS ACK frames received */
+    unsigned nacks{0};
+    /** Sum of the WINDOW_UPDATE increments by stream */
+    std::map<uint32_t, uint64_t> window_updates;
+    vector<uint32_t> resets;
+
+  private:
+    bool recvFrame()
+    {
+        string hdr, payload;
+        if (!recvBytes(9, hdr)) {
+            return false;
+        }
+        uint32_t length = get_u32(hdr.data()) >> 8;
+        auto type = uint8_t(hdr[3]);
+        auto flags = uint8_t(hdr[4]);
+        uint32_t stream_id = get_u32(hdr.data() + 5) & 0x7fffffff;
+        if (length && !recvBytes(length, payload)) {
+            return false;
+        }
+
+        switch (type) {
+            case HEADERS:
+                block = payload;
+                block_end_stream = flags & END_STREAM;
+                if (flags & END_HEADERS) {
+                    return finishHeaders(stream_id);
+                }
+                break;
+            case CONTINUATION:
+                block += payload;
+                if (flags & END_HEADERS) {
+                    return finishHeaders(stream_id);
+                }
+                break;
+            case DATA:
+                for (auto &req : requests) {
+                    if (req.stream_id == stream_id) {
+                        req.body += payload;
+                        if (flags & END_STREAM) {
+                            req.ended = true;
+                            nended++;
+                        }
+                    }
+                }
+                break;
+            case SETTINGS:
+                if (flags & ACK) {
+                    nacks++;
+                } else {
+                    nsettings++;
+                }
+                break;
+            case WINDOW_UPDATE:
+                window_updates[stream_id] += get_u32(payload.data()) & 0x7fffffff;
+                break;
+            case RST_STREAM:
+                resets.push_back(stream_id);
+                break;
+            default:
+                break;
+        }
+        return true;
+    }
+
+    bool finishHeaders(uint32_t stream_id)
+    {
+        H2Request req{stream_id, {}, "", block_end_stream};
+        if (!decoder.decode(block.data(), block.size(), req.headers)) {
+            return false;
+        }
+        requests.push_back(req);
+        if (req.ended) {
+            nended++;
+        }
+        return true;
+    }
+
+    Loop *loop;
+    TestConnection *conn;
+    lcb::htparse::HpackDecoder decoder{};
+    lcb::htparse::HpackEncoder encoder{};
+    string block{};
+    bool block_end_stream{false};
+    string pending{};
+};
+
+/**
+ * Sends the HTTP requests of the instance (with LCB_CNTL_ENABLE_HTTP2) to the
+ * TestServer, which plays the role of the HTTP/2 server.
+ */
+class Http2Test : public SockTest
+{
+  protected:
+    void TearDown() override
+    {
+        if (instance) {
+            lcb_destroy(instance);
+        }
+        SockTest::TearDown();
+    }
+
+    void createInstance(bool tls = false)
+    {
+        hostport = loop->server->getHostString() + ":" + loop->server->getPortString();
+        string connstr = string(tls ? "couchbases://" : "couchbase://") + hostport + "=mcd/default";
+        if (tls) {
+            connstr += "?ssl=no_verify";
+        }
+        lcb_CREATEOPTS *opts = nullptr;
+        lcb_createopts_create(&opts, LCB_TYPE_BUCKET);
+        lcb_createopts_connstr(opts, connstr.c_str(), connstr.size());
+        lcb_createopts_credentials(opts, "Administrator", strlen("Administrator"), "password", strlen("password"));
+        lcb_createopts_io(opts, loop->io);
+        ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, opts));
+        lcb_createopts_destroy(opts);
+        lcb_install_callback(instance, LCB_CALLBACK_HTTP, (lcb_RESPCALLBACK)http_callback);
+        ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "enable_http2", "true"));
+
+        // the query service of the single node is the TestServer
+        lcbvb_SERVER node{};
+        string hostname = loop->server->getHostString();
+        node.hostname = &hostname[0];
+        node.svc.data = loop->server->getListenPort();
+        node.svc.n1ql = loop->server->getListenPort();
+        node.svc_ssl.data = loop->server->getListenPort();
+        node.svc_ssl.n1ql = loop->server->getListenPort();
+        string querypath = "/query/service";
+        node.querypath = &querypath[0];
+        lcbvb_CONFIG *vbc = lcbvb_create();
+        ASSERT_EQ(0, lcbvb_genconfig_ex(vbc, "default", nullptr, &node, 1, 0, 4));
+        lcb::clconfig::ConfigInfo *config = lcb::clconfig::ConfigInfo::create(vbc, lcb::clconfig::CLCONFIG_FILE, "");
+        lcb_update_vbconfig(instance, config);
+        config->decref();
+    }
+
+    void request(HttpCookie *cookie, lcb_HTTP_METHOD method, const string &path, const string &body = "")
+    {
+        lcb_CMDHTTP *cmd;
+        lcb_cmdhttp_create(&cmd, LCB_HTTP_TYPE_RAW);
+        lcb_cmdhttp_method(cmd, method);
+        lcb_cmdhttp_host(cmd, hostport.c_str(), hostport.size());
+        lcb_cmdhttp_path(cmd, path.c_str(), path.size());
+        lcb_cmdhttp_username(cmd, "Administrator", strlen("Administrator"));
+        lcb_cmdhttp_password(cmd, "password", strlen("password"));
+        if (!body.empty()) {
+            lcb_cmdhttp_body(cmd, body.c_str(), body.size());
+            lcb_cmdhttp_content_type(cmd, "application/json", strlen("application/json"));
+        }
+        ASSERT_EQ(LCB_SUCCESS, lcb_http(instance, cookie, cmd));
+        lcb_cmdhttp_destroy(cmd);
+    }
+
+    void waitFor(const std::function<bool()> &done)
+    {
+        PredicateBreakCondition cond(done);
+        loop->setBreakCondition(&cond);
+        loop->start();
+    }
+
+    lcb_INSTANCE *instance{nullptr};
+    string hostport;
+};
+
+TEST_F(Http2Test, testMultiplexedRequests)
+{
+    createInstance();
+    HttpCookie cookies[3];
+    for (int ii = 0; ii < 3; ii++) {
+        request(&cookies[ii], LCB_HTTP_METHOD_GET, "/path" + std::to_string(ii));
+    }
+
+    // all the requests are sent over the single connection, without waiting for the server preface
+    FakeHttp2 server(loop, loop->server->waitConnection(1));
+    ASSERT_TRUE(server.recvPreface());
+    ASSERT_TRUE(server.recvRequests(3));
+    ASSERT_EQ(1, server.nsettings);
+    ASSERT_EQ(3, server.requests.size());
+    for (int ii = 0; ii < 3; ii++) {
+        const H2Request &req = server.requests[ii];
+        ASSERT_EQ(uint32_t(2 * ii + 1), req.stream_id);
+        ASSERT_STREQ("GET", req.header(":method"));
+        ASSERT_STREQ("http", req.header(":scheme"));
+        ASSERT_EQ(hostport, req.header(":authority"));
+        ASSERT_EQ("/path" + std::to_string(ii), req.header(":path"));
+        ASSERT_STREQ("application/json", req.header("accept"));
+        ASSERT_STREQ("Basic QWRtaW5pc3RyYXRvcjpwYXNzd29yZA==", req.header("authorization"));
+        ASSERT_EQ(nullptr, req.header("host"));
+        ASSERT_EQ(nullptr, req.header("connection"));
+    }
+
+    // the responses may come in any order
+    server.sendSettings();
+    for (int stream_id = 5; stream_id > 0; stream_id -= 2) {
+        server.sendHeaders(stream_id, "200", false);
+        server.sendData(stream_id, "{\"stream\":" + std::to_string(stream_id) + "}", true);
+    }
+    server.flush();
+    waitFor([&] { return cookies[0].done && cookies[1].done && cookies[2].done; });
+    for (int ii = 0; ii < 3; ii++) {
+        ASSERT_EQ(LCB_SUCCESS, cookies[ii].rc);
+        ASSERT_EQ(200, cookies[ii].status);
+        ASSERT_EQ("{\"stream\":" + std::to_string(2 * ii + 1) + "}", cookies[ii].body);
+        ASSERT_EQ("application/json", cookies[ii].content_type);
+    }
+
+    // the connection is reused
+    HttpCookie next;
+    request(&next, LCB_HTTP_METHOD_GET, "/next");
+    ASSERT_TRUE(server.recvRequests(4));
+    ASSERT_EQ(7, server.requests[3].stream_id);
+    server.sendHeaders(7, "204", true);
+    server.flush();
+    waitFor([&] { return next.done; });
+    ASSERT_EQ(204, next.status);
+    ASSERT_TRUE(next.body.empty());
+}
+
+TEST_F(Http2Test, testConcurrentStreamsLimit)
+{
+    createInstance();
+    HttpCookie cookies[3];
+    request(&cookies[0], LCB_HTTP_METHOD_GET, "/path0");
+
+    // the server allows one stream at a time
+    FakeHttp2 server(loop, loop->server->waitConnection(1));
+    ASSERT_TRUE(server.recvPreface());
+    ASSERT_TRUE(server.recvRequests(1));
+    server.sendSettings({{SETTINGS_MAX_CONCURRENT_STREAMS, 1}});
+    server.flush();
+    ASSERT_TRUE(server.recvUntil([&] { return server.nacks > 0; }));
+
+    // the other requests wait for the stream to be released
+    request(&cookies[1], LCB_HTTP_METHOD_GET, "/path1");
+    request(&cookies[2], LCB_HTTP_METHOD_GET, "/path2");
+    for (int ii = 0; ii < 3; ii++) {
+        uint32_t stream_id = 2 * ii + 1;
+        ASSERT_TRUE(server.recvRequests(ii + 1));
+        ASSERT_EQ(ii + 1, server.requests.size());
+        ASSERT_EQ(stream_id, server.requests[ii].stream_id);
+        ASSERT_EQ("/path" + std::to_string(ii), server.requests[ii].header(":path"));
+        server.sendHeaders(stream_id, "200", false);
+        server.sendData(stream_id, "{\"stream\":" + std::to_string(stream_id) + "}", true);
+        server.flush();
+    }
+    waitFor([&] { return cookies[0].done && cookies[1].done && cookies[2].done; });
+    for (int ii = 0; ii < 3; ii++) {
+        ASSERT_EQ(LCB_SUCCESS, cookies[ii].rc);
+        ASSERT_EQ(200, cookies[ii].status);
+        ASSERT_EQ("{\"stream\":" + std::to_string(2 * ii + 1) + "}", cookies[ii].body);
+    }
+}
+
+TEST_F(Http2Test, testFlowControl)
+{
+    createInstance();
+    string body(100000, 'b');
+    for (size_t ii = 0; ii < body.size(); ii++) {
+        body[ii] = char('a' + ii % 26);
+    }
+    HttpCookie cookie;
+    request(&cookie, LCB_HTTP_METHOD_POST, "/upload", body);
+
+    // the client stops at the initial window of the stream and the connection
+    FakeHttp2 server(loop, loop->server->waitConnection(1));
+    ASSERT_TRUE(server.recvPreface());
+    ASSERT_TRUE(server.recvUntil([&] { return !server.requests.empty() && server.requests[0].body.size() >= 65535; }));
+    ASSERT_EQ(65535, server.requests[0].body.size());
+    ASSERT_FALSE(server.requests[0].ended);
+    ASSERT_STREQ("POST", server.requests[0].header(":method"));
+    ASSERT_STREQ("100000", server.requests[0].header("content-length"));
+
+    server.sendSettings();
+    server.sendFrame(WINDOW_UPDATE, 0, 0, u32(body.size()));
+    server.sendFrame(WINDOW_UPDATE, 0, 1, u32(body.size()));
+    server.flush();
+    ASSERT_TRUE(server.recvRequests(1));
+    ASSERT_EQ(body, server.requests[0].body);
+
+    // the client replenishes the window of the stream once half of it has been consumed
+    string response(600000, 'r');
+    server.sendHeaders(1, "200", false);
+    server.sendData(1, response, false);
+    server.flush();
+    ASSERT_TRUE(server.recvUntil([&] { return server.window_updates[1] > 0; }));
+    ASSERT_LE(524288, server.window_updates[1]);
+    server.sendData(1, "", true);
+    server.flush();
+    waitFor([&] { return cookie.done; });
+    ASSERT_EQ(LCB_SUCCESS, cookie.rc);
+    ASSERT_EQ(response, cookie.body);
+}
+
+TEST_F(Http2Test, testRefusedStreamRetried)
+{
+    createInstance();
+    HttpCookie first, second;
+    request(&first, LCB_HTTP_METHOD_GET, "/first");
+    request(&second, LCB_HTTP_METHOD_GET, "/second");
+
+    FakeHttp2 server(loop, loop->server->waitConnection(1));
+    ASSERT_TRUE(server.recvPreface());
+    ASSERT_TRUE(server.recvRequests(2));
+    server.sendSettings();
+    server.sendFrame(RST_STREAM, 0, 3, u32(0x7)); // REFUSED_STREAM
+    server.sendHeaders(1, "200", false);
+    server.sendData(1, "first", true);
+    server.flush();
+
+    // the refused request is sent again as a new stream
+    ASSERT_TRUE(server.recvRequests(3));
+    ASSERT_EQ(5, server.requests[2].stream_id);
+    ASSERT_STREQ("/second", server.requests[2].header(":path"));
+    server.sendHeaders(5, "200", false);
+    server.sendData(5, "second", true);
+    server.flush();
+    waitFor([&] { return first.done && second.done; });
+    ASSERT_EQ("first", first.body);
+    ASSERT_EQ(LCB_SUCCESS, second.rc);
+    ASSERT_EQ("second", second.body);
+}
+
+TEST_F(Http2Test, testHttp1Fallback)
+{
+    createInstance();
+    HttpCookie cookie;
+    request(&cookie, LCB_HTTP_METHOD_GET, "/fallback");
+
+    // the server does not understand the preface
+    FakeHttp2 h2server(loop, loop->server->waitConnection(1));
+    ASSERT_TRUE(h2server.recvPreface());
+    h2server.sendRaw("HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+    h2server.flush();
+    lcb_host_t host{};
+    loop->populateHost(&host);
+    waitFor([&] { return instance->http2_pool->is_http1(host); });
+
+    // the request is sent again over HTTP/1.1
+    FakeHttp2 h1server(loop, loop->server->waitConnection(2));
+    string request;
+    while (request.find("\r\n\r\n") == string::npos) {
+        string chunk;
+        ASSERT_TRUE(h1server.recvBytes(1, chunk));
+        request += chunk;
+    }
+    ASSERT_EQ(0, request.find("GET /fallback HTTP/1.1\r\n"));
+    h1server.sendRaw("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+    h1server.flush();
+    waitFor([&] { return cookie.done; });
+    ASSERT_EQ(LCB_SUCCESS, cookie.rc);
+    ASSERT_EQ("ok", cookie.body);
+
+    // the host is remembered (raw requests do not keep the connection alive)
+    HttpCookie next;
+    this->request(&next, LCB_HTTP_METHOD_GET, "/next");
+    FakeHttp2 next_server(loop, loop->server->waitConnection(3));
+    string method;
+    ASSERT_TRUE(next_server.recvBytes(4, method));
+    ASSERT_EQ("GET ", method);
+}
+
+TEST_F(Http2Test, testQuery)
+{
+    createInstance();
+    QueryCookie cookie;
+    string statement = "SELECT 1";
+    lcb_CMDQUERY *cmd;
+    lcb_cmdquery_create(&cmd);
+    lcb_cmdquery_statement(cmd, statement.c_str(), statement.size());
+    lcb_cmdquery_callback(cmd, query_callback);
+    ASSERT_EQ(LCB_SUCCESS, lcb_query(instance, &cookie, cmd));
+    lcb_cmdquery_destroy(cmd);
+
+    FakeHttp2 server(loop, loop->server->waitConnection(1));
+    ASSERT_TRUE(server.recvPreface());
+    ASSERT_TRUE(server.recvRequests(1));
+    const H2Request &req = server.requests[0];
+    ASSERT_STREQ("POST", req.header(":method"));
+    ASSERT_STREQ("/query/service", req.header(":path"));
+    ASSERT_NE(string::npos, req.body.find("SELECT 1"));
+
+    server.sendSettings();
+    server.sendHeaders(1, "200", false);
+    server.sendData(1, "{\"requestID\":\"1\",\"results\":[{\"$1\":1}],", false);
+    server.sendData(1, "\"status\":\"success\",\"metrics\":{\"resultCount\":1}}", true);
+    server.flush();
+    waitFor([&] { return cookie.done; });
+    ASSERT_EQ(LCB_SUCCESS, cookie.rc);
+    ASSERT_EQ(1, cookie.rows.size());
+    ASSERT_EQ("{\"$1\":1}", cookie.rows[0]);
+}
+
+#ifndef LCB_NO_SSL
+TEST_F(Http2Test, testTlsAlpn)
+{
+    // the handshake fails unless the client offers h2
+    loop->server->factory = TestServer::sslH2SocketFactory;
+    createInstance(true);
+    HttpCookie cookie;
+    request(&cookie, LCB_HTTP_METHOD_GET, "/secure");
+
+    FakeHttp2 server(loop, loop->server->waitConnection(1));
+    ASSERT_TRUE(server.recvPreface());
+    ASSERT_TRUE(server.recvRequests(1));
+    ASSERT_STREQ("https", server.requests[0].header(":scheme"));
+    server.sendSettings();
+    server.sendHeaders(1, "200", false);
+    server.sendData(1, "secure", true);
+    server.flush();
+    waitFor([&] { return cookie.done; });
+    ASSERT_EQ(LCB_SUCCESS, cookie.rc);
+    ASSERT_EQ("secure", cookie.body);
+}
+#endif
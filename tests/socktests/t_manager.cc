@@ -1,5 +1,7 @@
 #include "socktest.h"
 #include <lcbio/manager.h>
+#include <lcbio/resolver.h>
+#include <atomic>
 using namespace LCBTest;
 using std::string;
 using std::vector;
@@ -160,3 +162,239 @@ TEST_F(SockMgrTest, testMaxIdle)
         delete otherSocks[ii];
     }
 }
+
+extern "C" {
+static void queued_conn_cb(lcbio_SOCKET *sock, void *data, lcb_STATUS err, lcbio_OSERR)
+{
+    ESocket *mysock = (ESocket *)data;
+    mysock->assign(sock, err);
+    mysock->parent->stop();
+    mysock->callCount++;
+}
+}
+
+TEST_F(SockMgrTest, testMaxTotal)
+{
+    loop->sockpool->get_options().maxtotal = 1;
+
+    ESocket *sock1 = new ESocket();
+    loop->connectPooled(sock1);
+    ASSERT_TRUE(sock1->sock != NULL);
+    lcbio_SOCKET *rawsock = sock1->sock;
+
+    // The second request must wait until the first connection is released
+    lcb_host_t host = {0};
+    loop->populateHost(&host);
+    ESocket *sock2 = new ESocket();
+    sock2->parent = loop;
+    sock2->creq = loop->sockpool->get(host, LCB_MS2US(1000), queued_conn_cb, sock2);
+    ASSERT_EQ(0, sock2->callCount);
+
+    delete sock1;
+    loop->start();
+    ASSERT_EQ(1, sock2->callCount);
+    ASSERT_EQ(rawsock, sock2->sock);
+    delete sock2;
+}
+
+TEST_F(SockMgrTest, testPreconnect)
+{
+    lcb_host_t host = {0};
+    loop->populateHost(&host);
+    loop->sockpool->preconnect(host, 2, LCB_MS2US(1000));
+
+    // The request is served by the connection which was opened in advance
+    ESocket *sock1 = new ESocket();
+    loop->connectPooled(sock1);
+    ASSERT_TRUE(sock1->sock != NULL);
+    ESocket *sock2 = new ESocket();
+    loop->connectPooled(sock2);
+    ASSERT_TRUE(sock2->sock != NULL);
+    ASSERT_NE(sock1->sock, sock2->sock);
+    delete sock1;
+    delete sock2;
+}
+
+/** Number of the idle connections which have been established */
+static unsigned countConnected(Loop *loop)
+{
+    Json::Value node;
+    loop->sockpool->toJSON(gethrtime(), node);
+    unsigned count = 0;
+    for (const auto &service : node) {
+        for (const auto &endpoint : service) {
+            if (endpoint["status"].asString() == "connected") {
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+class ConnectedCondition : public BreakCondition
+{
+  public:
+    ConnectedCondition(Loop *l, unsigned n, unsigned mstmo = 5000)
+        : loop(l), expected(n), deadline(gethrtime() + LCB_MS2NS(mstmo))
+    {
+    }
+
+  protected:
+    bool shouldBreakImpl()
+    {
+        return countConnected(loop) == expected || gethrtime() > deadline;
+    }
+
+    Loop *loop;
+    unsigned expected;
+    hrtime_t deadline;
+};
+
+class DeadlineCondition : public BreakCondition
+{
+  public:
+    explicit DeadlineCondition(unsigned msdelay) : deadline(gethrtime() + LCB_MS2NS(msdelay)) {}
+
+  protected:
+    bool shouldBreakImpl()
+    {
+        return gethrtime() > deadline;
+    }
+
+    hrtime_t deadline;
+};
+
+TEST_F(SockMgrTest, testPreconnectKeepsMinimum)
+{
+    lcb_host_t host = {0};
+    loop->populateHost(&host);
+    loop->sockpool->get_options().tmoidle = LCB_MS2US(10);
+    loop->sockpool->preconnect(host, 2, LCB_MS2US(1000));
+
+    ConnectedCondition connected(loop, 2);
+    loop->setBreakCondition(&connected);
+    loop->start();
+    ASSERT_EQ(2U, countConnected(loop));
+
+    // The warm connections outlive the idle timeout
+    DeadlineCondition idle(50);
+    loop->setBreakCondition(&idle);
+    loop->start();
+    ASSERT_EQ(2U, countConnected(loop));
+
+    // ... and the closed ones are replaced
+    ESocket *sock1 = new ESocket();
+    loop->connectPooled(sock1);
+    ASSERT_TRUE(sock1->sock != NULL);
+    lcbio_ctx_close(sock1->ctx, NULL, NULL);
+    sock1->clear();
+    sock1->sock = NULL;
+    delete sock1;
+
+    ConnectedCondition replenished(loop, 2);
+    loop->setBreakCondition(&replenished);
+    loop->start();
+    ASSERT_EQ(2U, countConnected(loop));
+
+    // Once the host is not needed, the connections expire as usual
+    loop->sockpool->cancel_preconnect();
+    ConnectedCondition expired(loop, 0);
+    loop->setBreakCondition(&expired);
+    loop->start();
+    ASSERT_EQ(0U, countConnected(loop));
+}
+
+static std::atomic<int> failing_lookups(0);
+static std::atomic<bool> lookups_fail(true);
+
+static int failing_lookup(const char *, const char *port, const addrinfo *hints, addrinfo **res)
+{
+    if (lookups_fail) {
+        failing_lookups++;
+        return EAI_NONAME;
+    }
+    addrinfo numeric = *hints;
+    numeric.ai_family = AF_INET;
+    numeric.ai_flags |= AI_NUMERICHOST;
+    return getaddrinfo("127.0.0.1", port, &numeric, res);
+}
+
+/** Waits until the lookup of the host has failed the given number of times */
+class LookupsCondition : public BreakCondition
+{
+  public:
+    explicit LookupsCondition(int n, unsigned mstmo = 5000) : expected(n), deadline(gethrtime() + LCB_MS2NS(mstmo)) {}
+
+  protected:
+    bool shouldBreakImpl()
+    {
+        return failing_lookups >= expected || gethrtime() > deadline;
+    }
+
+    int expected;
+    hrtime_t deadline;
+};
+
+TEST_F(SockMgrTest, testPreconnectBackoff)
+{
+    failing_lookups = 0;
+    lookups_fail = true;
+    loop->settings->dns_cache_ttl = 0;
+    lcb::io::Resolver::get(loop->settings)->set_lookup_function(failing_lookup);
+
+    lcb_host_t host = {0};
+    loop->populateHost(&host);
+    strcpy(host.host, "unreachable.test");
+    loop->sockpool->preconnect(host, 1, LCB_MS2US(1000));
+
+    // The attempts are retried after 100ms, 200ms, 400ms...
+    DeadlineCondition failing(500);
+    loop->setBreakCondition(&failing);
+    loop->start();
+    ASSERT_GE(failing_lookups, 2);
+    ASSERT_LE(failing_lookups, 4);
+
+    // The connection is opened once the host becomes reachable
+    lookups_fail = false;
+    ConnectedCondition connected(loop, 1);
+    loop->setBreakCondition(&connected);
+    loop->start();
+    ASSERT_EQ(1U, countConnected(loop));
+}
+
+TEST_F(SockMgrTest, testPreconnectKeepsBackoff)
+{
+    failing_lookups = 0;
+    lookups_fail = true;
+    loop->settings->dns_cache_ttl = 0;
+    lcb::io::Resolver::get(loop->settings)->set_lookup_function(failing_lookup);
+
+    lcb_host_t host = {0};
+    loop->populateHost(&host);
+    strcpy(host.host, "unreachable.test");
+    lcb_host_t other = host;
+    strcpy(other.host, "removed.test");
+    loop->sockpool->preconnect(host, 1, LCB_MS2US(1000));
+
+    // The second attempt fails, and the next one is delayed by 200ms
+    LookupsCondition failed(2);
+    loop->setBreakCondition(&failed);
+    loop->start();
+    int attempts = failing_lookups;
+
+    // A new configuration which still contains the host does not reset the backoff
+    loop->sockpool->cancel_preconnect({host, other});
+    loop->sockpool->preconnect(host, 1, LCB_MS2US(1000));
+    DeadlineCondition updated(20);
+    loop->setBreakCondition(&updated);
+    loop->start();
+    ASSERT_EQ(attempts, failing_lookups);
+
+    // ... while the host which has left the configuration is not retried at all
+    loop->sockpool->cancel_preconnect({other});
+    DeadlineCondition cancelled(500);
+    loop->setBreakCondition(&cancelled);
+    loop->start();
+    ASSERT_EQ(attempts, failing_lookups);
+    lookups_fail = false;
+}
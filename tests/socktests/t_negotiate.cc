@@ -0,0 +1,409 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "socktest.h"
+#include "fakememcached.h"
+#include <cbsasl/cbsasl.h>
+#include "mcserver/mcserver.h"
+#include "mcserver/negotiate.h"
+#include "contrib/cbsasl/src/scram-sha/scram_utils.h"
+
+using std::string;
+using std::vector;
+
+namespace
+{
+struct NegotiationResult {
+    bool done{false};
+    lcb_STATUS rc{LCB_SUCCESS};
+    string mech{};
+    bool selected{false};
+    Loop *loop{nullptr};
+};
+
+void negotiation_done(lcbio_SOCKET *sock, void *arg, lcb_STATUS err, lcbio_OSERR)
+{
+    auto *res = reinterpret_cast<NegotiationResult *>(arg);
+    res->done = true;
+    res->rc = err;
+    if (sock) {
+        lcb::SessionInfo *info = lcb::SessionInfo::get(sock);
+        res->mech = info->get_mech();
+        res->selected = info->selected_bucket();
+    }
+    res->loop->stop();
+}
+
+void detach_socket(lcbio_SOCKET *sock, int, void *arg)
+{
+    lcbio_ref(sock);
+    *reinterpret_cast<lcbio_SOCKET **>(arg) = sock;
+}
+
+class DoneBreakCondition : public BreakCondition
+{
+  public:
+    explicit DoneBreakCondition(NegotiationResult *r) : res(r) {}
+
+  protected:
+    bool shouldBreakImpl() override
+    {
+        return res->done;
+    }
+
+  private:
+    NegotiationResult *res;
+};
+
+/** Injected delay of every reply of the server */
+const unsigned latency_ms = 20;
+} // namespace
+
+class NegotiateTest : public SockTest
+{
+  protected:
+    void SetUp() override
+    {
+        SockTest::SetUp();
+        lcb_settings *settings = loop->settings;
+        settings->bucket = lcb_strdup("default");
+        settings->conntype = LCB_TYPE_BUCKET;
+        settings->select_bucket = 1;
+        settings->use_errmap = 1;
+        lcbauth_set_mode(settings->auth, LCBAUTH_MODE_RBAC);
+        lcbauth_add_pass(settings->auth, "Administrator", "password", LCBAUTH_F_CLUSTER);
+    }
+
+    /** Connects the socket and starts negotiation on it */
+    lcbio_SOCKET *startSession(ESocket &sock, NegotiationResult &res)
+    {
+        loop->connect(&sock);
+        EXPECT_TRUE(sock.sock != nullptr);
+        lcbio_SOCKET *raw = nullptr;
+        lcbio_ctx_close(sock.ctx, detach_socket, &raw);
+        sock.ctx = nullptr;
+        sock.sock = nullptr;
+        res.loop = loop;
+        lcb::SessionRequest::start(raw, loop->settings, 5000000, negotiation_done, &res);
+        return raw;
+    }
+
+    void waitDone(NegotiationResult &res)
+    {
+        DoneBreakCondition cond(&res);
+        loop->setBreakCondition(&cond);
+        loop->start();
+        ASSERT_TRUE(res.done);
+    }
+
+    /** Runs PLAIN negotiation and returns the number of round trips */
+    void negotiatePlain(unsigned &turns, bool &fetched_errmap)
+    {
+        ESocket sock;
+        NegotiationResult res;
+        lcbio_SOCKET *raw = startSession(sock, res);
+        FakeMemcached server(loop, sock.conn, latency_ms);
+        fetched_errmap = false;
+
+        vector<Packet> pkts;
+        bool optimistic = loop->settings->optimistic_negotiation;
+        bool cached = optimistic && loop->settings->sasl_mech_cached != nullptr;
+        bool has_errmap = optimistic && loop->settings->errmap->isLoaded();
+
+        // HELLO [+ GET_ERROR_MAP] + (SASL_LIST_MECHS | SASL_AUTH + SELECT_BUCKET)
+        size_t first = 1 + (has_errmap ? 0 : 1) + (cached ? 2 : 1);
+        ASSERT_TRUE(server.recv(pkts, first));
+        for (const auto &pkt : pkts) {
+            switch (pkt.opcode) {
+                case PROTOCOL_BINARY_CMD_HELLO:
+                    server.reply(pkt, PROTOCOL_BINARY_RESPONSE_SUCCESS, hello_features());
+                    break;
+                case PROTOCOL_BINARY_CMD_GET_ERROR_MAP:
+                    fetched_errmap = true;
+                    server.reply(pkt, PROTOCOL_BINARY_RESPONSE_SUCCESS, errmap_json);
+                    break;
+                case PROTOCOL_BINARY_CMD_SASL_LIST_MECHS:
+                    server.reply(pkt, PROTOCOL_BINARY_RESPONSE_SUCCESS, "SCRAM-SHA512 PLAIN");
+                    break;
+                case PROTOCOL_BINARY_CMD_SASL_AUTH:
+                    ASSERT_EQ("PLAIN", pkt.key);
+                    ASSERT_EQ(string("\0Administrator\0password", 23), pkt.value);
+                    server.reply(pkt, PROTOCOL_BINARY_RESPONSE_SUCCESS);
+                    break;
+                case PROTOCOL_BINARY_CMD_SELECT_BUCKET:
+                    ASSERT_EQ("default", pkt.key);
+                    server.reply(pkt, PROTOCOL_BINARY_RESPONSE_SUCCESS);
+                    break;
+                default:
+                    FAIL() << "Unexpected opcode " << (int)pkt.opcode;
+            }
+        }
+        server.flush();
+
+        if (!cached) {
+            pkts.clear();
+            // SASL_AUTH, SELECT_BUCKET is pipelined with it in optimistic mode
+            ASSERT_TRUE(server.recv(pkts, optimistic ? 2 : 1));
+            ASSERT_EQ(PROTOCOL_BINARY_CMD_SASL_AUTH, pkts[0].opcode);
+            server.reply(pkts[0], PROTOCOL_BINARY_RESPONSE_SUCCESS);
+            if (!optimistic) {
+                server.flush();
+                ASSERT_TRUE(server.recv(pkts, 1));
+            }
+            ASSERT_EQ(PROTOCOL_BINARY_CMD_SELECT_BUCKET, pkts[1].opcode);
+            server.reply(pkts[1], PROTOCOL_BINARY_RESPONSE_SUCCESS);
+            server.flush();
+        }
+
+        waitDone(res);
+        ASSERT_EQ(LCB_SUCCESS, res.rc);
+        ASSERT_EQ("PLAIN", res.mech);
+        ASSERT_TRUE(res.selected);
+        lcbio_unref(raw);
+        turns = server.turns;
+    }
+};
+
+TEST_F(NegotiateTest, testRegularNegotiation)
+{
+    // PLAIN is not allowed on plain sockets unless forced
+    loop->settings->sasl_mech_force = lcb_strdup("PLAIN");
+    unsigned turns = 0;
+    bool fetched_errmap = false;
+    negotiatePlain(turns, fetched_errmap);
+    ASSERT_EQ(3, turns);
+    ASSERT_TRUE(fetched_errmap);
+    ASSERT_EQ(nullptr, loop->settings->sasl_mech_cached);
+}
+
+TEST_F(NegotiateTest, testOptimisticNegotiation)
+{
+    loop->settings->sasl_mech_force = lcb_strdup("PLAIN");
+    loop->settings->optimistic_negotiation = 1;
+    unsigned turns = 0;
+    bool fetched_errmap = false;
+
+    // the first connection has to discover the mechanism
+    negotiatePlain(turns, fetched_errmap);
+    ASSERT_EQ(2, turns);
+    ASSERT_TRUE(fetched_errmap);
+    ASSERT_STREQ("PLAIN", loop->settings->sasl_mech_cached);
+
+    // the next ones send everything in a single write, and reuse the error map
+    negotiatePlain(turns, fetched_errmap);
+    ASSERT_EQ(1, turns);
+    ASSERT_FALSE(fetched_errmap);
+}
+
+TEST_F(NegotiateTest, testOptimisticFallback)
+{
+    loop->settings->optimistic_negotiation = 1;
+    loop->settings->sasl_mech_force = lcb_strdup("PLAIN");
+    // mechanism of the previous connection, which the server does not accept anymore
+    loop->settings->sasl_mech_cached = lcb_strdup("CRAM-MD5");
+
+    ESocket sock;
+    NegotiationResult res;
+    lcbio_SOCKET *raw = startSession(sock, res);
+    FakeMemcached server(loop, sock.conn, latency_ms);
+
+    vector<Packet> pkts;
+    ASSERT_TRUE(server.recv(pkts, 3));
+    ASSERT_EQ(PROTOCOL_BINARY_CMD_HELLO, pkts[0].opcode);
+    ASSERT_EQ(PROTOCOL_BINARY_CMD_GET_ERROR_MAP, pkts[1].opcode);
+    ASSERT_EQ(PROTOCOL_BINARY_CMD_SASL_AUTH, pkts[2].opcode);
+    ASSERT_EQ("CRAM-MD5", pkts[2].key);
+    server.reply(pkts[0], PROTOCOL_BINARY_RESPONSE_SUCCESS, hello_features());
+    server.reply(pkts[1], PROTOCOL_BINARY_RESPONSE_SUCCESS, errmap_json);
+    server.reply(pkts[2], PROTOCOL_BINARY_RESPONSE_AUTH_ERROR);
+    server.flush();
+
+    pkts.clear();
+    ASSERT_TRUE(server.recv(pkts, 1));
+    ASSERT_EQ(PROTOCOL_BINARY_CMD_SASL_LIST_MECHS, pkts[0].opcode);
+    server.reply(pkts[0], PROTOCOL_BINARY_RESPONSE_SUCCESS, "PLAIN");
+    server.flush();
+
+    pkts.clear();
+    ASSERT_TRUE(server.recv(pkts, 2));
+    ASSERT_EQ(PROTOCOL_BINARY_CMD_SASL_AUTH, pkts[0].opcode);
+    ASSERT_EQ("PLAIN", pkts[0].key);
+    ASSERT_EQ(PROTOCOL_BINARY_CMD_SELECT_BUCKET, pkts[1].opcode);
+    server.reply(pkts[0], PROTOCOL_BINARY_RESPONSE_SUCCESS);
+    server.reply(pkts[1], PROTOCOL_BINARY_RESPONSE_SUCCESS);
+    server.flush();
+
+    waitDone(res);
+    ASSERT_EQ(LCB_SUCCESS, res.rc);
+    ASSERT_TRUE(res.selected);
+    ASSERT_STREQ("PLAIN", loop->settings->sasl_mech_cached);
+    lcbio_unref(raw);
+}
+
+#if !defined(LCB_NO_SSL) && defined(HAVE_PKCS5_PBKDF2_HMAC)
+TEST_F(NegotiateTest, testOptimisticScram)
+{
+    loop->settings->optimistic_negotiation = 1;
+    loop->settings->sasl_mech_cached = lcb_strdup("SCRAM-SHA512");
+    string errmsg;
+    loop->settings->errmap->parse(errmap_json, strlen(errmap_json), errmsg);
+
+    ESocket sock;
+    NegotiationResult res;
+    lcbio_SOCKET *raw = startSession(sock, res);
+    FakeMemcached server(loop, sock.conn, latency_ms);
+
+    // HELLO + SASL_AUTH
+    vector<Packet> pkts;
+    ASSERT_TRUE(server.recv(pkts, 2));
+    ASSERT_EQ(PROTOCOL_BINARY_CMD_HELLO, pkts[0].opcode);
+    ASSERT_EQ(PROTOCOL_BINARY_CMD_SASL_AUTH, pkts[1].opcode);
+    ASSERT_EQ("SCRAM-SHA512", pkts[1].key);
+    const string &clientfirst = pkts[1].value;
+    ASSERT_EQ(0, clientfirst.find("n,,n=Administrator,r="));
+    string clientfirstbare = clientfirst.substr(3);
+    string nonce = clientfirst.substr(clientfirst.find(",r=") + 3) + "c2VydmVy";
+    string serverfirst = "r=" + nonce + ",s=c2FsdA==,i=4096";
+    server.reply(pkts[0], PROTOCOL_BINARY_RESPONSE_SUCCESS, hello_features());
+    server.reply(pkts[1], PROTOCOL_BINARY_RESPONSE_AUTH_CONTINUE, serverfirst);
+    server.flush();
+
+    // SASL_STEP + SELECT_BUCKET
+    pkts.clear();
+    ASSERT_TRUE(server.recv(pkts, 2));
+    ASSERT_EQ(PROTOCOL_BINARY_CMD_SASL_STEP, pkts[0].opcode);
+    ASSERT_EQ(PROTOCOL_BINARY_CMD_SELECT_BUCKET, pkts[1].opcode);
+    const string &clientfinal = pkts[0].value;
+    string authmessage = clientfirstbare + "," + serverfirst + "," + clientfinal.substr(0, clientfinal.find(",p="));
+
+    union {
+        cbsasl_secret_t secret;
+        char buffer[30];
+    } u_auth;
+    memcpy(u_auth.secret.data, "password", 8);
+    u_auth.secret.len = 8;
+    unsigned char saltedpassword[CBSASL_SHA512_DIGEST_SIZE];
+    unsigned int saltedpasslen = 0;
+    ASSERT_EQ(SASL_OK, generate_salted_password(SASL_AUTH_MECH_SCRAM_SHA512, &u_auth.secret, "c2FsdA==", 8, 4096,
+                                                saltedpassword, &saltedpasslen));
+    char serversign[(CBSASL_SHA512_DIGEST_SIZE / 3 + 1) * 4 + 1];
+    ASSERT_EQ(SASL_OK, compute_server_signature(SASL_AUTH_MECH_SCRAM_SHA512, saltedpassword, saltedpasslen,
+                                                authmessage.c_str(), serversign, sizeof(serversign)));
+    server.reply(pkts[0], PROTOCOL_BINARY_RESPONSE_SUCCESS, string("v=") + serversign);
+    server.reply(pkts[1], PROTOCOL_BINARY_RESPONSE_SUCCESS);
+    server.flush();
+
+    waitDone(res);
+    ASSERT_EQ(LCB_SUCCESS, res.rc);
+    ASSERT_EQ("SCRAM-SHA512", res.mech);
+    ASSERT_TRUE(res.selected);
+    ASSERT_EQ(2, server.turns);
+    lcbio_unref(raw);
+}
+#endif
+
+class PreconnectTest : public SockTest
+{
+  protected:
+    void SetUp() override
+    {
+        SockTest::SetUp();
+
+        // nothing listens on this port anymore, so the connections are refused
+        SockFD *lsn = SockFD::newListener();
+        closed_port = std::to_string(lsn->getLocalPort());
+        delete lsn;
+
+        string connstr = "couchbase://127.0.0.1:" + closed_port + "=mcd/default?sasl_mech_force=PLAIN&kv_preconnect=true&metrics=true";
+        lcb_CREATEOPTS *opts = nullptr;
+        lcb_createopts_create(&opts, LCB_TYPE_BUCKET);
+        lcb_createopts_connstr(opts, connstr.c_str(), connstr.size());
+        lcb_createopts_credentials(opts, "Administrator", strlen("Administrator"), "password", strlen("password"));
+        lcb_createopts_io(opts, loop->io);
+        ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, opts));
+        lcb_createopts_destroy(opts);
+        // failed connections request a new configuration (from the closed port as well)
+        instance->confmon->prepare();
+
+        vbc = lcbvb_create();
+        ASSERT_EQ(0, lcbvb_genconfig(vbc, 1, 0, 4));
+        LCBT_VBCONFIG(instance) = vbc;
+        server = new lcb::Server(instance, 0);
+        strcpy(server->curhost->host, "127.0.0.1");
+        strcpy(server->curhost->port, closed_port.c_str());
+    }
+
+    void TearDown() override
+    {
+        if (server) {
+            server->close();
+        }
+        if (instance) {
+            LCBT_VBCONFIG(instance) = nullptr;
+            lcb_destroy(instance);
+        }
+        if (vbc) {
+            lcbvb_destroy(vbc);
+        }
+        SockTest::TearDown();
+    }
+
+    /** Runs the loop until the next connection attempt fails, and returns the new reconnection delay */
+    uint32_t waitFailedAttempt()
+    {
+        lcb_SIZE prev = server->metrics->iometrics.io_error;
+        PredicateBreakCondition cond([&] { return server->metrics->iometrics.io_error != prev; });
+        loop->setBreakCondition(&cond);
+        loop->start();
+        EXPECT_NE(prev, server->metrics->iometrics.io_error);
+        return server->reconnect_backoff;
+    }
+
+    string closed_port;
+    lcb_INSTANCE *instance{nullptr};
+    lcbvb_CONFIG *vbc{nullptr};
+    lcb::Server *server{nullptr};
+};
+
+TEST_F(PreconnectTest, testReconnectBackoff)
+{
+    server->preconnect();
+    ASSERT_EQ(LCB_MS2US(100), waitFailedAttempt());
+    ASSERT_TRUE(lcbio_timer_armed(server->reconnect_timer));
+
+    // every failed attempt doubles the delay, until it reaches the cap
+    uint32_t expected[] = {200, 400, 800, 1600, 3200, 6400, 10000, 10000};
+    for (uint32_t delay : expected) {
+        // do not wait for the timer, reconnect right away
+        lcbio_async_signal(server->reconnect_timer);
+        ASSERT_EQ(LCB_MS2US(delay), waitFailedAttempt());
+        ASSERT_TRUE(lcbio_timer_armed(server->reconnect_timer));
+    }
+
+    // the successful connection resets the delay
+    loop->populateHost(server->curhost);
+    lcbio_async_signal(server->reconnect_timer);
+    PredicateBreakCondition connecting([&] { return server->connreq != nullptr; });
+    loop->setBreakCondition(&connecting);
+    loop->start();
+    FakeMemcached memcached(loop, loop->server->waitConnection(1), 0);
+    serveNegotiation(memcached);
+    PredicateBreakCondition connected([&] { return server->is_connected(); });
+    loop->setBreakCondition(&connected);
+    loop->start();
+    ASSERT_TRUE(server->is_connected());
+    ASSERT_EQ(0, server->reconnect_backoff);
+}
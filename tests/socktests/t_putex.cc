@@ -274,3 +274,101 @@ TEST_F(SockPutexTest, testClosed)
 
     ASSERT_TRUE(buflist->bufs.empty());
 }
+
+#ifndef LCB_NO_SSL
+#include <lcbio/ssl.h>
+#include <ctime>
+
+/** The chains of buffers flushed over TLS */
+class SockPutexSSLTest : public SockPutexTest
+{
+  public:
+    void SetUp() override
+    {
+        lcbio_ssl_global_init();
+        SockTest::SetUp();
+        lcb_STATUS err = LCB_SUCCESS;
+        loop->settings->sslopts = LCB_SSL_ENABLED | LCB_SSL_NOVERIFY;
+        loop->settings->ssl_ctx = lcbio_ssl_new(nullptr, nullptr, nullptr, 1, &err, loop->settings);
+        ASSERT_FALSE(loop->settings->ssl_ctx == nullptr) << lcb_strerror_short(err);
+        loop->server->factory = TestServer::sslSocketFactory;
+        sock.setActions(&bufActions);
+        loop->connect(&sock);
+        buflist = &bufActions.buflist;
+    }
+
+    void TearDown() override
+    {
+        sock.close();
+        lcbio_ssl_free(loop->settings->ssl_ctx);
+        loop->settings->ssl_ctx = nullptr;
+        SockTest::TearDown();
+    }
+
+    /** Flushes packets made of a header and a value, like the KV pipeline does */
+    void flushPackets(size_t npackets, size_t nvalue)
+    {
+        string header(24, 'H');
+        string value(nvalue, 'V');
+        for (size_t ii = 0; ii < npackets; ii++) {
+            buflist->append(header);
+            buflist->append(value);
+        }
+        size_t expected = npackets * (header.size() + value.size());
+
+        RecvFuture rf(expected);
+        sock.conn->setRecv(&rf);
+        lcbio_ctx_wwant(sock.ctx);
+        sock.schedule();
+        MyBreakCondition mbc(buflist, &rf);
+        loop->setBreakCondition(&mbc);
+        loop->start();
+        rf.wait();
+
+        ASSERT_TRUE(rf.isOk());
+        const vector<char> &received = rf.getBuf();
+        ASSERT_EQ(expected, received.size());
+        for (size_t ii = 0; ii < npackets; ii++) {
+            size_t offset = ii * (header.size() + value.size());
+            ASSERT_EQ(0, memcmp(&received[offset], header.data(), header.size()));
+            ASSERT_EQ(0, memcmp(&received[offset + header.size()], value.data(), value.size()));
+        }
+    }
+};
+
+TEST_F(SockPutexSSLTest, testLargeValues)
+{
+    flushPackets(64, 256 * 1024);
+}
+
+TEST_F(SockPutexSSLTest, testSmallPackets)
+{
+    flushPackets(20000, 16);
+}
+
+// The socket is not polled in a loop while SSL holds an incomplete record
+TEST_F(SockPutexSSLTest, testSplitRecord)
+{
+    loop->server->factory = TestServer::sslSplitSocketFactory;
+    ESocket rsock;
+    loop->connect(&rsock);
+    ASSERT_TRUE(rsock.ctx != nullptr);
+
+    string expected(4000, 'R');
+    SendFuture sf(expected);
+    ReadBreakCondition rbc(&rsock, expected.size());
+    std::clock_t begin = std::clock();
+    rsock.reqrd(expected.size());
+    rsock.schedule();
+    rsock.conn->setSend(&sf);
+    loop->setBreakCondition(&rbc);
+    loop->start();
+    sf.wait();
+    double cpu_ms = 1000.0 * (std::clock() - begin) / CLOCKS_PER_SEC;
+
+    ASSERT_TRUE(rbc.didBreak());
+    ASSERT_EQ(expected, rsock.getReceived());
+    // the second half of the record arrives 100ms after the first one
+    ASSERT_LT(cpu_ms, 50.0);
+}
+#endif
@@ -0,0 +1,204 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "socktest.h"
+#include <lcbio/resolver.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace LCBTest;
+
+/*
+ * Stub DNS server: answers every query with the loopback address after the
+ * configured delay, or fails if the delay is negative.
+ */
+static std::atomic<int> stub_queries(0);
+static std::atomic<int> stub_delay_ms(0);
+
+static int stub_lookup(const char *, const char *port, const addrinfo *hints, addrinfo **res)
+{
+    stub_queries++;
+    int delay = stub_delay_ms;
+    if (delay < 0) {
+        return EAI_NONAME;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+    addrinfo numeric = *hints;
+    numeric.ai_family = AF_INET;
+    numeric.ai_flags |= AI_NUMERICHOST;
+    return getaddrinfo("127.0.0.1", port, &numeric, res);
+}
+
+class SockResolverTest : public SockTest
+{
+  protected:
+    void SetUp() override
+    {
+        SockTest::SetUp();
+        stub_queries = 0;
+        stub_delay_ms = 0;
+        loop->settings->metrics = lcb_metrics_new();
+        lcb::io::Resolver::get(loop->settings)->set_lookup_function(stub_lookup);
+        loop->populateHost(&host);
+        strcpy(host.host, "stub-dns.test");
+    }
+
+    lcb_host_t host{};
+};
+
+/** Counts the iterations of the event loop while the lookup is in progress */
+class TickTimer : public Timer
+{
+  public:
+    explicit TickTimer(lcbio_TABLE *iot) : Timer(iot) {}
+
+    void expired() override
+    {
+        ticks++;
+        schedule(5);
+    }
+
+    int ticks{0};
+};
+
+struct ResolveResult {
+    Loop *loop;
+    int ncalls;
+    lcb_STATUS err;
+};
+
+extern "C" {
+static void resolve_conncb(lcbio_SOCKET *, void *arg, lcb_STATUS err, lcbio_OSERR)
+{
+    auto *res = reinterpret_cast<ResolveResult *>(arg);
+    res->ncalls++;
+    res->err = err;
+    res->loop->stop();
+}
+}
+
+TEST_F(SockResolverTest, testSlowLookupDoesNotBlockLoop)
+{
+    TickTimer ticker(loop->iot);
+    ResolveResult res = {loop, 0, LCB_SUCCESS};
+
+    stub_delay_ms = 200;
+    ticker.schedule(5);
+    lcbio_connect(loop->iot, loop->settings, &host, LCB_MS2US(5000), resolve_conncb, &res);
+    loop->start();
+    ticker.cancel();
+
+    ASSERT_EQ(1, res.ncalls);
+    ASSERT_EQ(LCB_SUCCESS, res.err);
+    ASSERT_EQ(1, stub_queries);
+    // the loop kept running while the name was resolved
+    ASSERT_GE(ticker.ticks, 10);
+
+    lcb_METRICS *metrics = loop->settings->metrics;
+    ASSERT_EQ(1U, metrics->dns_lookups);
+    ASSERT_EQ(0U, metrics->dns_cache_hits);
+    ASSERT_TRUE(metrics->dns_latency != NULL);
+
+    // the second connection reuses the resolved address
+    res.ncalls = 0;
+    lcbio_connect(loop->iot, loop->settings, &host, LCB_MS2US(5000), resolve_conncb, &res);
+    loop->start();
+    ASSERT_EQ(1, res.ncalls);
+    ASSERT_EQ(LCB_SUCCESS, res.err);
+    ASSERT_EQ(1, stub_queries);
+    ASSERT_EQ(2U, metrics->dns_lookups);
+    ASSERT_EQ(1U, metrics->dns_cache_hits);
+}
+
+TEST_F(SockResolverTest, testCacheDisabled)
+{
+    ResolveResult res = {loop, 0, LCB_SUCCESS};
+
+    loop->settings->dns_cache_ttl = 0;
+    for (int ii = 0; ii < 2; ii++) {
+        lcbio_connect(loop->iot, loop->settings, &host, LCB_MS2US(5000), resolve_conncb, &res);
+        loop->start();
+    }
+    ASSERT_EQ(2, res.ncalls);
+    ASSERT_EQ(LCB_SUCCESS, res.err);
+    ASSERT_EQ(2, stub_queries);
+    ASSERT_EQ(0U, loop->settings->metrics->dns_cache_hits);
+}
+
+TEST_F(SockResolverTest, testLookupFailure)
+{
+    ResolveResult res = {loop, 0, LCB_SUCCESS};
+
+    stub_delay_ms = -1;
+    lcbio_connect(loop->iot, loop->settings, &host, LCB_MS2US(5000), resolve_conncb, &res);
+    loop->start();
+    ASSERT_EQ(1, res.ncalls);
+    ASSERT_EQ(LCB_ERR_UNKNOWN_HOST, res.err);
+
+    // failures are not cached
+    stub_delay_ms = 0;
+    lcbio_connect(loop->iot, loop->settings, &host, LCB_MS2US(5000), resolve_conncb, &res);
+    loop->start();
+    ASSERT_EQ(2, res.ncalls);
+    ASSERT_EQ(LCB_SUCCESS, res.err);
+    ASSERT_EQ(2, stub_queries);
+}
+
+TEST_F(SockResolverTest, testTimeoutDuringLookup)
+{
+    ResolveResult res = {loop, 0, LCB_SUCCESS};
+
+    stub_delay_ms = 300;
+    lcbio_connect(loop->iot, loop->settings, &host, LCB_MS2US(50), resolve_conncb, &res);
+    loop->start();
+    ASSERT_EQ(1, res.ncalls);
+    ASSERT_EQ(LCB_ERR_TIMEOUT, res.err);
+}
+
+TEST_F(SockResolverTest, testCancelDuringLookup)
+{
+    ResolveResult res = {loop, 0, LCB_SUCCESS};
+
+    stub_delay_ms = 50;
+    lcbio_pCONNSTART creq = lcbio_connect(loop->iot, loop->settings, &host, LCB_MS2US(5000), resolve_conncb, &res);
+    lcbio_connect_cancel(creq);
+
+    // the result of the lookup is dropped once it arrives
+    TickTimer ticker(loop->iot);
+    ticker.schedule(5);
+    while (stub_queries == 0 || ticker.ticks < 20) {
+        NullBreakCondition nbc;
+        loop->setBreakCondition(&nbc);
+        loop->start();
+    }
+    ticker.cancel();
+    ASSERT_EQ(0, res.ncalls);
+}
+
+TEST_F(SockResolverTest, testNumericHost)
+{
+    ResolveResult res = {loop, 0, LCB_SUCCESS};
+
+    strcpy(host.host, "127.0.0.1");
+    lcbio_connect(loop->iot, loop->settings, &host, LCB_MS2US(5000), resolve_conncb, &res);
+    loop->start();
+    ASSERT_EQ(1, res.ncalls);
+    ASSERT_EQ(LCB_SUCCESS, res.err);
+    ASSERT_EQ(0, stub_queries);
+    ASSERT_EQ(0U, loop->settings->metrics->dns_lookups);
+}
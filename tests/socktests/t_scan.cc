@@ -0,0 +1,226 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "socktest.h"
+#include "fakememcached.h"
+#include "bucketconfig/clconfig.h"
+
+using std::string;
+using std::vector;
+
+namespace
+{
+struct ScanCookie {
+    int items{0};
+    int finals{0};
+    bool cancel_on_item{false};
+    lcb_SCAN_HANDLE *handle{nullptr};
+};
+
+extern "C" {
+static void scan_callback(lcb_INSTANCE *instance, int, const lcb_RESPSCAN *resp)
+{
+    ScanCookie *cookie;
+    lcb_respscan_cookie(resp, (void **)&cookie);
+    if (lcb_respscan_is_final(resp)) {
+        cookie->finals++;
+        return;
+    }
+    cookie->items++;
+    if (cookie->cancel_on_item) {
+        lcb_scan_cancel(instance, cookie->handle);
+    }
+}
+
+static void count_timings(lcb_INSTANCE *, const void *cookie, lcb_timeunit_t, lcb_U32, lcb_U32, lcb_U32 total,
+                          lcb_U32)
+{
+    *static_cast<unsigned *>(const_cast<void *>(cookie)) += total;
+}
+}
+
+const string scan_uuid("0123456789abcdef");
+} // namespace
+
+/**
+ * Scans the bucket with the single vBucket, which is served by the
+ * TestServer.
+ */
+class ScanTest : public SockTest
+{
+  protected:
+    void SetUp() override
+    {
+        SockTest::SetUp();
+
+        string connstr = "couchbase://" + loop->server->getHostString() + ":" + loop->server->getPortString() +
+                         "=mcd/default?sasl_mech_force=PLAIN&enable_collections=false";
+        lcb_CREATEOPTS *opts = nullptr;
+        lcb_createopts_create(&opts, LCB_TYPE_BUCKET);
+        lcb_createopts_connstr(opts, connstr.c_str(), connstr.size());
+        lcb_createopts_credentials(opts, "Administrator", strlen("Administrator"), "password", strlen("password"));
+        lcb_createopts_io(opts, loop->io);
+        ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, opts));
+        lcb_createopts_destroy(opts);
+
+        lcbvb_SERVER node{};
+        string hostname = loop->server->getHostString();
+        node.hostname = &hostname[0];
+        node.svc.data = loop->server->getListenPort();
+        lcbvb_CONFIG *vbc = lcbvb_create();
+        ASSERT_EQ(0, lcbvb_genconfig_ex(vbc, "default", nullptr, &node, 1, 0, 1));
+        lcb::clconfig::ConfigInfo *config = lcb::clconfig::ConfigInfo::create(vbc, lcb::clconfig::CLCONFIG_FILE, "");
+        lcb_update_vbconfig(instance, config);
+        config->decref();
+    }
+
+    void TearDown() override
+    {
+        if (instance) {
+            lcb_destroy(instance);
+        }
+        SockTest::TearDown();
+    }
+
+    void startScan(ScanCookie *cookie)
+    {
+        lcb_CMDSCAN *cmd;
+        lcb_cmdscan_create(&cmd);
+        lcb_cmdscan_prefix(cmd, "doc", strlen("doc"));
+        lcb_cmdscan_ids_only(cmd, 1);
+        lcb_cmdscan_callback(cmd, scan_callback);
+        lcb_cmdscan_handle(cmd, &cookie->handle);
+        ASSERT_EQ(LCB_SUCCESS, lcb_scan(instance, cookie, cmd));
+        lcb_cmdscan_destroy(cmd);
+    }
+
+    /** Runs the loop until the scan handle destroys itself */
+    void waitScanDone()
+    {
+        PredicateBreakCondition done([this] { return !lcb_aspend_pending(&instance->pendops); });
+        loop->setBreakCondition(&done);
+        loop->start();
+        ASSERT_FALSE(lcb_aspend_pending(&instance->pendops));
+    }
+
+    lcb_INSTANCE *instance{nullptr};
+};
+
+TEST_F(ScanTest, testCancelBetweenBatches)
+{
+    ScanCookie cookie;
+    cookie.cancel_on_item = true;
+    startScan(&cookie);
+
+    FakeMemcached memcached(loop, loop->server->waitConnection(1), 0);
+    serveNegotiation(memcached);
+    vector<Packet> pkts;
+    ASSERT_TRUE(memcached.recv(pkts, 1));
+    ASSERT_EQ(PROTOCOL_BINARY_CMD_RANGE_SCAN_CREATE, pkts[0].opcode);
+    memcached.reply(pkts[0], PROTOCOL_BINARY_RESPONSE_SUCCESS, scan_uuid);
+    memcached.flush();
+
+    pkts.clear();
+    ASSERT_TRUE(memcached.recv(pkts, 1));
+    ASSERT_EQ(PROTOCOL_BINARY_CMD_RANGE_SCAN_CONTINUE, pkts[0].opcode);
+    ASSERT_EQ(scan_uuid, pkts[0].extras.substr(0, scan_uuid.size()));
+    string batch;
+    batch.push_back(4);
+    batch.append("doc1");
+    batch.push_back(4);
+    batch.append("doc2");
+    memcached.reply(pkts[0], PROTOCOL_BINARY_RESPONSE_RANGE_SCAN_MORE, batch);
+    memcached.flush();
+
+    // the scan is waiting for the next batch, so it is cancelled instead of being continued
+    pkts.clear();
+    ASSERT_TRUE(memcached.recv(pkts, 1));
+    ASSERT_EQ(PROTOCOL_BINARY_CMD_RANGE_SCAN_CANCEL, pkts[0].opcode);
+    ASSERT_EQ(scan_uuid, pkts[0].extras);
+    ASSERT_EQ(1, cookie.items);
+    memcached.reply(pkts[0], PROTOCOL_BINARY_RESPONSE_SUCCESS);
+    memcached.flush();
+
+    waitScanDone();
+    ASSERT_EQ(1, cookie.items);
+    ASSERT_EQ(0, cookie.finals);
+}
+
+TEST_F(ScanTest, testCancelDuringCreate)
+{
+    ScanCookie cookie;
+    startScan(&cookie);
+
+    FakeMemcached memcached(loop, loop->server->waitConnection(1), 0);
+    serveNegotiation(memcached);
+    vector<Packet> pkts;
+    ASSERT_TRUE(memcached.recv(pkts, 1));
+    ASSERT_EQ(PROTOCOL_BINARY_CMD_RANGE_SCAN_CREATE, pkts[0].opcode);
+
+    // the scan does not exist on the server yet, it is cancelled as soon as it is created
+    ASSERT_EQ(LCB_SUCCESS, lcb_scan_cancel(instance, cookie.handle));
+    memcached.reply(pkts[0], PROTOCOL_BINARY_RESPONSE_SUCCESS, scan_uuid);
+    memcached.flush();
+
+    pkts.clear();
+    ASSERT_TRUE(memcached.recv(pkts, 1));
+    ASSERT_EQ(PROTOCOL_BINARY_CMD_RANGE_SCAN_CANCEL, pkts[0].opcode);
+    ASSERT_EQ(scan_uuid, pkts[0].extras);
+    memcached.reply(pkts[0], PROTOCOL_BINARY_RESPONSE_SUCCESS);
+    memcached.flush();
+
+    waitScanDone();
+    ASSERT_EQ(0, cookie.items);
+    ASSERT_EQ(0, cookie.finals);
+}
+
+TEST_F(ScanTest, testStreamedContinueTimedOnce)
+{
+    ASSERT_EQ(LCB_SUCCESS, lcb_enable_timings(instance));
+    ScanCookie cookie;
+    startScan(&cookie);
+
+    FakeMemcached memcached(loop, loop->server->waitConnection(1), 0);
+    serveNegotiation(memcached);
+    vector<Packet> pkts;
+    ASSERT_TRUE(memcached.recv(pkts, 1));
+    ASSERT_EQ(PROTOCOL_BINARY_CMD_RANGE_SCAN_CREATE, pkts[0].opcode);
+    memcached.reply(pkts[0], PROTOCOL_BINARY_RESPONSE_SUCCESS, scan_uuid);
+    memcached.flush();
+
+    // the items are streamed with success status, and the batch ends with "complete"
+    pkts.clear();
+    ASSERT_TRUE(memcached.recv(pkts, 1));
+    ASSERT_EQ(PROTOCOL_BINARY_CMD_RANGE_SCAN_CONTINUE, pkts[0].opcode);
+    string item1, item2;
+    item1.push_back(4);
+    item1.append("doc1");
+    item2.push_back(4);
+    item2.append("doc2");
+    memcached.reply(pkts[0], PROTOCOL_BINARY_RESPONSE_SUCCESS, item1);
+    memcached.reply(pkts[0], PROTOCOL_BINARY_RESPONSE_SUCCESS, item2);
+    memcached.reply(pkts[0], PROTOCOL_BINARY_RESPONSE_RANGE_SCAN_COMPLETE);
+    memcached.flush();
+
+    waitScanDone();
+    ASSERT_EQ(2, cookie.items);
+    ASSERT_EQ(1, cookie.finals);
+
+    // one sample for the create and one for the continue
+    unsigned samples = 0;
+    ASSERT_EQ(LCB_SUCCESS, lcb_get_timings(instance, &samples, count_timings));
+    ASSERT_EQ(2U, samples);
+}
@@ -46,6 +46,38 @@ class SSLTest : public SockTest
         loop->settings->ssl_ctx = nullptr;
         SockTest::TearDown();
     }
+
+    /** Connects, exchanges a message with the server and closes the socket */
+    void pingPong()
+    {
+        ESocket sock;
+        loop->connect(&sock);
+        ASSERT_FALSE(sock.sock == nullptr);
+
+        string sendStr("ping");
+        RecvFuture rf(sendStr.size());
+        FutureBreakCondition wbc(&rf);
+        sock.conn->setRecv(&rf);
+        sock.put(sendStr);
+        sock.schedule();
+        loop->setBreakCondition(&wbc);
+        loop->start();
+        rf.wait();
+        ASSERT_TRUE(rf.isOk());
+
+        // with TLS 1.3 the session tickets are received after the handshake
+        string recvStr("pong");
+        SendFuture sf(recvStr);
+        ReadBreakCondition rbc(&sock, recvStr.size());
+        sock.conn->setSend(&sf);
+        sock.reqrd(recvStr.size());
+        sock.schedule();
+        loop->setBreakCondition(&rbc);
+        loop->start();
+        sf.wait();
+        ASSERT_EQ(sock.getReceived(), recvStr);
+        sock.close();
+    }
 };
 
 TEST_F(SSLTest, testBasic)
@@ -91,6 +123,149 @@ TEST_F(SSLTest, testBasic)
     sock.close();
 }
 
+TEST_F(SSLTest, testSessionResumption)
+{
+    const int nconnections = 5;
+    lcb_TLS_SESSION_STATS stats{};
+
+    for (int cached = 0; cached < 2; cached++) {
+        loop->settings->tls_session_cache = cached;
+        for (int ii = 0; ii < nconnections; ii++) {
+            pingPong();
+        }
+
+        lcbio_ssl_session_stats(loop->settings->ssl_ctx, &stats);
+        if (cached) {
+            // only the first connection performs the full handshake
+            ASSERT_EQ(nconnections + 1, stats.full_handshakes);
+            ASSERT_EQ(nconnections - 1, stats.resumed_handshakes);
+            ASSERT_EQ(1, stats.size);
+        } else {
+            ASSERT_EQ(nconnections, stats.full_handshakes);
+            ASSERT_EQ(0, stats.resumed_handshakes);
+            ASSERT_EQ(0, stats.size);
+        }
+    }
+}
+
+TEST_F(SSLTest, testKernelTls)
+{
+    // larger than the TLS record, so that the data is split
+    string payload;
+    while (payload.size() < 64 * 1024) {
+        payload += "0123456789abcdefghijklmnopqrstuvwxyz";
+    }
+    loop->settings->tls_session_cache = 0;
+
+    // the data must be intact whether or not the kernel supports the offload
+    for (int ktls = 0; ktls < 2; ktls++) {
+        loop->settings->enable_ktls = ktls;
+        ESocket sock;
+        loop->connect(&sock);
+        ASSERT_FALSE(sock.sock == nullptr);
+
+        RecvFuture rf(payload.size());
+        FutureBreakCondition wbc(&rf);
+        sock.conn->setRecv(&rf);
+        sock.put(payload);
+        sock.schedule();
+        loop->setBreakCondition(&wbc);
+        loop->start();
+        rf.wait();
+        ASSERT_TRUE(rf.isOk());
+        ASSERT_TRUE(rf.getString() == payload);
+
+        SendFuture sf(payload);
+        ReadBreakCondition rbc(&sock, payload.size());
+        sock.conn->setSend(&sf);
+        sock.reqrd(payload.size());
+        sock.schedule();
+        loop->setBreakCondition(&rbc);
+        loop->start();
+        sf.wait();
+        ASSERT_TRUE(sock.getReceived() == payload);
+
+        lcb_TLS_SESSION_STATS stats{};
+        lcbio_ssl_session_stats(loop->settings->ssl_ctx, &stats);
+        if (ktls) {
+            ASSERT_GE(1, stats.ktls_connections);
+        } else {
+            ASSERT_EQ(0, stats.ktls_connections);
+        }
+        sock.close();
+    }
+}
+
+namespace
+{
+lcb_bsd_procs plugin_procs{};
+size_t wrapped_recv = 0;
+size_t wrapped_send = 0;
+
+extern "C" {
+static lcb_ssize_t recv_wrapper(lcb_io_opt_t io, lcb_socket_t sock, void *buf, lcb_size_t nbuf, int flags)
+{
+    wrapped_recv++;
+    return plugin_procs.recv(io, sock, buf, nbuf, flags);
+}
+
+static lcb_ssize_t send_wrapper(lcb_io_opt_t io, lcb_socket_t sock, const void *buf, lcb_size_t nbuf, int flags)
+{
+    wrapped_send++;
+    return plugin_procs.send(io, sock, buf, nbuf, flags);
+}
+}
+} // namespace
+
+TEST_F(SSLTest, testWrappedPlugin)
+{
+    // a plugin which wraps the socket routines keeps them in the path of the
+    // TLS records (memory BIOs), and kernel TLS is not used
+    plugin_procs = IOT_V0IO(loop->iot);
+    IOT_V0IO(loop->iot).recv = recv_wrapper;
+    IOT_V0IO(loop->iot).send = send_wrapper;
+    loop->settings->tls_session_cache = 0;
+    loop->settings->enable_ktls = 1;
+
+    string payload;
+    while (payload.size() < 64 * 1024) {
+        payload += "0123456789abcdefghijklmnopqrstuvwxyz";
+    }
+
+    ESocket sock;
+    loop->connect(&sock);
+    ASSERT_FALSE(sock.sock == nullptr);
+
+    RecvFuture rf(payload.size());
+    FutureBreakCondition wbc(&rf);
+    sock.conn->setRecv(&rf);
+    sock.put(payload);
+    sock.schedule();
+    loop->setBreakCondition(&wbc);
+    loop->start();
+    rf.wait();
+    ASSERT_TRUE(rf.isOk());
+    ASSERT_TRUE(rf.getString() == payload);
+
+    SendFuture sf(payload);
+    ReadBreakCondition rbc(&sock, payload.size());
+    sock.conn->setSend(&sf);
+    sock.reqrd(payload.size());
+    sock.schedule();
+    loop->setBreakCondition(&rbc);
+    loop->start();
+    sf.wait();
+    ASSERT_TRUE(sock.getReceived() == payload);
+    sock.close();
+
+    ASSERT_LT(0, wrapped_recv);
+    ASSERT_LT(0, wrapped_send);
+    lcb_TLS_SESSION_STATS stats{};
+    lcbio_ssl_session_stats(loop->settings->ssl_ctx, &stats);
+    ASSERT_EQ(0, stats.ktls_connections);
+    IOT_V0IO(loop->iot) = plugin_procs;
+}
+
 #else
 class SSLTest : public ::testing::Test
 {
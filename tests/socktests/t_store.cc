@@ -0,0 +1,180 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "socktest.h"
+#include "fakememcached.h"
+#include "bucketconfig/clconfig.h"
+
+using std::string;
+using std::vector;
+
+namespace
+{
+struct StoreCookie {
+    int stored{0};
+    int flushed{0};
+    lcb_STATUS rc{LCB_SUCCESS};
+};
+
+extern "C" {
+static void store_callback(lcb_INSTANCE *, int, const lcb_RESPSTORE *resp)
+{
+    StoreCookie *cookie;
+    lcb_respstore_cookie(resp, (void **)&cookie);
+    cookie->rc = lcb_respstore_status(resp);
+    cookie->stored++;
+}
+
+static void flushed_callback(lcb_INSTANCE *, const void *cookie)
+{
+    static_cast<StoreCookie *>(const_cast<void *>(cookie))->flushed++;
+}
+}
+} // namespace
+
+/**
+ * Stores documents through lcb_store() against the TestServer, which plays
+ * the role of the single KV node of the cluster.
+ */
+class StoreTest : public SockTest
+{
+  protected:
+    void SetUp() override
+    {
+        SockTest::SetUp();
+
+        string connstr = "couchbase://" + loop->server->getHostString() + ":" + loop->server->getPortString() +
+                         "=mcd/default?sasl_mech_force=PLAIN&enable_collections=false";
+        lcb_CREATEOPTS *opts = nullptr;
+        lcb_createopts_create(&opts, LCB_TYPE_BUCKET);
+        lcb_createopts_connstr(opts, connstr.c_str(), connstr.size());
+        lcb_createopts_credentials(opts, "Administrator", strlen("Administrator"), "password", strlen("password"));
+        lcb_createopts_io(opts, loop->io);
+        ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, opts));
+        lcb_createopts_destroy(opts);
+        lcb_install_callback(instance, LCB_CALLBACK_STORE, (lcb_RESPCALLBACK)store_callback);
+        lcb_set_pktflushed_callback(instance, flushed_callback);
+
+        lcbvb_SERVER node{};
+        string hostname = loop->server->getHostString();
+        node.hostname = &hostname[0];
+        node.svc.data = loop->server->getListenPort();
+        lcbvb_CONFIG *vbc = lcbvb_create();
+        ASSERT_EQ(0, lcbvb_genconfig_ex(vbc, "default", nullptr, &node, 1, 0, 4));
+        lcb::clconfig::ConfigInfo *config = lcb::clconfig::ConfigInfo::create(vbc, lcb::clconfig::CLCONFIG_FILE, "");
+        lcb_update_vbconfig(instance, config);
+        config->decref();
+    }
+
+    void TearDown() override
+    {
+        if (instance) {
+            lcb_destroy(instance);
+        }
+        SockTest::TearDown();
+    }
+
+    void storeBorrowed(StoreCookie *cookie, const string &key, const string &value)
+    {
+        lcb_CMDSTORE *cmd;
+        lcb_cmdstore_create(&cmd, LCB_STORE_UPSERT);
+        lcb_cmdstore_key(cmd, key.c_str(), key.size());
+        lcb_cmdstore_value_borrowed(cmd, value.c_str(), value.size());
+        ASSERT_EQ(LCB_SUCCESS, lcb_store(instance, cookie, cmd));
+        lcb_cmdstore_destroy(cmd);
+    }
+
+    lcb_INSTANCE *instance{nullptr};
+};
+
+TEST_F(StoreTest, testBorrowedValueStored)
+{
+    string value(64 * 1024, 'v');
+    StoreCookie cookie;
+    storeBorrowed(&cookie, "borrowed", value);
+
+    FakeMemcached memcached(loop, loop->server->waitConnection(1), 0);
+    serveNegotiation(memcached);
+    vector<Packet> pkts;
+    ASSERT_TRUE(memcached.recv(pkts, 1));
+    ASSERT_EQ(PROTOCOL_BINARY_CMD_SET, pkts[0].opcode);
+    ASSERT_EQ("borrowed", pkts[0].key);
+    ASSERT_EQ(value, pkts[0].value);
+    memcached.reply(pkts[0], PROTOCOL_BINARY_RESPONSE_SUCCESS);
+    memcached.flush();
+
+    PredicateBreakCondition stored([&] { return cookie.stored > 0; });
+    loop->setBreakCondition(&stored);
+    loop->start();
+    ASSERT_EQ(1, cookie.stored);
+    ASSERT_EQ(LCB_SUCCESS, cookie.rc);
+    ASSERT_EQ(1, cookie.flushed);
+
+    lcb_destroy(instance);
+    instance = nullptr;
+    ASSERT_EQ(1, cookie.flushed);
+}
+
+TEST_F(StoreTest, testBorrowedValueSchedFail)
+{
+    string value("borrowed value");
+    StoreCookie borrowed, borrowed_iov, copied;
+
+    lcb_sched_enter(instance);
+    storeBorrowed(&borrowed, "borrowed", value);
+
+    lcb_IOV iov[2];
+    iov[0].iov_base = &value[0];
+    iov[0].iov_len = 8;
+    iov[1].iov_base = &value[8];
+    iov[1].iov_len = value.size() - 8;
+    lcb_CMDSTORE *cmd;
+    lcb_cmdstore_create(&cmd, LCB_STORE_UPSERT);
+    lcb_cmdstore_key(cmd, "borrowed_iov", strlen("borrowed_iov"));
+    lcb_cmdstore_value_iov_borrowed(cmd, iov, 2);
+    ASSERT_EQ(LCB_SUCCESS, lcb_store(instance, &borrowed_iov, cmd));
+    lcb_cmdstore_value(cmd, value.c_str(), value.size());
+    ASSERT_EQ(LCB_SUCCESS, lcb_store(instance, &copied, cmd));
+    lcb_cmdstore_destroy(cmd);
+    lcb_sched_fail(instance);
+
+    // the operations are dropped, but the buffers are released
+    ASSERT_EQ(0, borrowed.stored);
+    ASSERT_EQ(1, borrowed.flushed);
+    ASSERT_EQ(0, borrowed_iov.stored);
+    ASSERT_EQ(1, borrowed_iov.flushed);
+    ASSERT_EQ(0, copied.stored);
+    ASSERT_EQ(0, copied.flushed);
+
+    lcb_destroy(instance);
+    instance = nullptr;
+    ASSERT_EQ(1, borrowed.flushed);
+    ASSERT_EQ(1, borrowed_iov.flushed);
+}
+
+TEST_F(StoreTest, testBorrowedValueDestroyed)
+{
+    string value("borrowed value");
+    StoreCookie cookie;
+    storeBorrowed(&cookie, "borrowed", value);
+
+    // the packet is never written
+    lcb_destroy(instance);
+    instance = nullptr;
+    ASSERT_EQ(1, cookie.stored);
+    ASSERT_EQ(LCB_ERR_REQUEST_CANCELED, cookie.rc);
+    ASSERT_EQ(1, cookie.flushed);
+}
@@ -0,0 +1,221 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <libcouchbase/couchbase.h>
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include "common/options.h"
+#include "import/bulk_loader.h"
+
+using namespace cbc;
+using namespace cliopts;
+using std::cerr;
+using std::endl;
+using std::string;
+
+static void do_or_die(lcb_STATUS rc, const char *message)
+{
+    if (rc != LCB_SUCCESS) {
+        throw std::runtime_error(string(message) + ": " + lcb_strerror_long(rc));
+    }
+}
+
+class Configuration
+{
+  public:
+    Configuration()
+        : o_file("file"), o_format("format"), o_keyField("key-field"), o_keyPrefix("key-prefix"),
+          o_collection("collection"), o_expiry("expiry"), o_inflight("inflight-bytes"), o_retries("max-retries"),
+          o_backoff("backoff"), o_errlog("error-log")
+    {
+        o_file.mandatory(true).abbrev('f').description("Path to the file with the documents");
+        o_format.description("Format of the input: \"jsonl\" (JSON Lines) or \"csv\". "
+                             "By default it is detected from the file extension");
+        o_keyField.abbrev('k').description(
+            "Name of the field (or CSV column), which contains the document ID. "
+            "If not specified, the IDs are generated from the sequence number of the document");
+        o_keyPrefix.setDefault("").description("Prefix for the document IDs");
+        o_collection.description("Target collection, in the form \"scope.collection\"");
+        o_expiry.setDefault(0).description("Expiration time of the documents in seconds");
+        o_inflight.setDefault(4 * 1024 * 1024)
+            .description("Maximum number of bytes which are sent to a single node but not yet acknowledged");
+        o_retries.setDefault(10).description("How many times to retry the document after temporary failure");
+        o_backoff.setDefault(1).description("Initial delay (in milliseconds) before retrying temporary failure. "
+                                            "It is doubled on every attempt up to one second");
+        o_errlog.abbrev('e').description("Path to a file, where IDs of the failed and skipped documents are written");
+    }
+
+    void addToParser(Parser &parser)
+    {
+        parser.addOption(o_file);
+        parser.addOption(o_format);
+        parser.addOption(o_keyField);
+        parser.addOption(o_keyPrefix);
+        parser.addOption(o_collection);
+        parser.addOption(o_expiry);
+        parser.addOption(o_inflight);
+        parser.addOption(o_retries);
+        parser.addOption(o_backoff);
+        parser.addOption(o_errlog);
+        params.addToParser(parser);
+    }
+
+    void processOptions()
+    {
+        const string &path = o_file.const_result();
+        if (o_format.passed()) {
+            if (o_format.const_result() == "jsonl" || o_format.const_result() == "json") {
+                format = RecordReader::JSON_LINES;
+            } else if (o_format.const_result() == "csv") {
+                format = RecordReader::CSV;
+            } else {
+                throw std::runtime_error("Unknown format \"" + o_format.const_result() + "\"");
+            }
+        } else if (path.size() > 4 && path.compare(path.size() - 4, 4, ".csv") == 0) {
+            format = RecordReader::CSV;
+        }
+
+        if (o_collection.passed()) {
+            const string &spec = o_collection.const_result();
+            size_t dot = spec.find('.');
+            if (dot == string::npos) {
+                throw std::runtime_error("Collection must be specified as \"scope.collection\"");
+            }
+            loader.scope = spec.substr(0, dot);
+            loader.collection = spec.substr(dot + 1);
+        }
+        loader.expiry = o_expiry.result();
+        loader.inflight_bytes_per_node = o_inflight.result();
+        loader.max_retries = o_retries.result();
+        loader.initial_backoff_us = o_backoff.result() * 1000ULL;
+        if (loader.inflight_bytes_per_node == 0) {
+            throw std::runtime_error("--inflight-bytes must be positive");
+        }
+
+        if (o_errlog.passed()) {
+            errlog.open(o_errlog.const_result().c_str());
+            if (!errlog.is_open()) {
+                throw std::runtime_error(o_errlog.const_result() + ": unable to open for writing");
+            }
+        }
+    }
+
+    string path()
+    {
+        return o_file.const_result();
+    }
+
+    string keyField()
+    {
+        return o_keyField.passed() ? o_keyField.const_result() : string();
+    }
+
+    string keyPrefix()
+    {
+        return o_keyPrefix.const_result();
+    }
+
+    RecordReader::Format format{RecordReader::JSON_LINES};
+    BulkLoaderOptions loader{};
+    ConnParams params{};
+    std::ofstream errlog{};
+
+  private:
+    StringOption o_file;
+    StringOption o_format;
+    StringOption o_keyField;
+    StringOption o_keyPrefix;
+    StringOption o_collection;
+    UIntOption o_expiry;
+    ULongLongOption o_inflight;
+    UIntOption o_retries;
+    UIntOption o_backoff;
+    StringOption o_errlog;
+};
+
+static void print_stats(const BulkLoaderStats &stats, size_t skipped, const char *prefix)
+{
+    fprintf(stderr, "%s%.1fs: %llu docs (%.0f docs/s, %.2f MB/s), %llu retries, %llu errors, %lu skipped\n", prefix,
+            stats.elapsed_seconds(), (unsigned long long)stats.docs, stats.docs_per_second(),
+            stats.megabytes_per_second(), (unsigned long long)stats.retries, (unsigned long long)stats.errors,
+            (unsigned long)skipped);
+}
+
+static int real_main(int argc, char **argv)
+{
+    Configuration config;
+    Parser parser("cbc-import");
+    config.addToParser(parser);
+    parser.parse(argc, argv);
+    config.processOptions();
+
+    MappedFile input(config.path());
+    RecordReader reader(input.data(), input.size(), config.format, config.keyField(), config.keyPrefix());
+    if (config.errlog.is_open()) {
+        reader.on_error([&config](size_t line, const string &message) {
+            config.errlog << "line " << line << ": " << message << endl;
+        });
+    }
+
+    lcb_CREATEOPTS *cropts = nullptr;
+    config.params.fillCropts(cropts);
+    lcb_INSTANCE *instance = nullptr;
+    lcb_STATUS rc = lcb_create(&instance, cropts);
+    lcb_createopts_destroy(cropts);
+    do_or_die(rc, "Failed to create instance");
+    do_or_die(config.params.doCtls(instance), "Failed to apply settings");
+    if (!config.loader.collection.empty()) {
+        int use = 1;
+        lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_ENABLE_COLLECTIONS, &use);
+    }
+    do_or_die(lcb_connect(instance), "Failed to schedule connection");
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    do_or_die(lcb_get_bootstrap_status(instance), "Failed to connect");
+
+    size_t failed = 0;
+    {
+        BulkLoader loader(instance, reader, config.loader);
+        loader.on_progress([&reader](const BulkLoaderStats &stats) { print_stats(stats, reader.skipped(), ""); });
+        loader.on_error([&config](const BulkRecord &record, lcb_STATUS err) {
+            if (config.errlog.is_open()) {
+                config.errlog << "line " << record.line << ": \"" << record.key << "\" " << lcb_strerror_short(err)
+                              << endl;
+            }
+        });
+        loader.run();
+        print_stats(loader.stats(), reader.skipped(), "Done. ");
+        fprintf(stderr, "Peak in-flight bytes per node: %llu\n",
+                (unsigned long long)loader.stats().peak_inflight_bytes);
+        failed = loader.stats().errors + reader.skipped();
+    }
+    lcb_destroy(instance);
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char **argv)
+{
+    try {
+        return real_main(argc, argv);
+    } catch (std::exception &exc) {
+        cerr << exc.what() << endl;
+        return EXIT_FAILURE;
+    }
+}
@@ -29,6 +29,7 @@
 #include <csignal>
 #ifndef WIN32
 #include <pthread.h>
+#include <sys/resource.h>
 #include <libcouchbase/metrics.h>
 #else
 #define usleep(n) Sleep(n / 1000)
@@ -1238,19 +1239,24 @@ static void diag_callback(lcb_INSTANCE *instance, int, const lcb_RESPDIAG *resp)
             size_t ii;
             lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_METRICS, &metrics);
 
-            fprintf(stderr, "%p: total: %lu, etmpfail: %lu, eexist: %lu, etimeout: %lu, retried: %lu, rq: %lu\n",
+            fprintf(stderr,
+                    "%p: total: %lu, etmpfail: %lu, eexist: %lu, etimeout: %lu, retried: %lu, rq: %lu, dns: %lu "
+                    "(cached: %lu)\n",
                     (void *)instance, (unsigned long)cookie->stats.total, (unsigned long)cookie->stats.etmpfail,
                     (unsigned long)cookie->stats.eexist, (unsigned long)cookie->stats.etimeout,
-                    (unsigned long)cookie->stats.retried, (unsigned long)metrics->packets_retried);
+                    (unsigned long)cookie->stats.retried, (unsigned long)metrics->packets_retried,
+                    (unsigned long)metrics->dns_lookups, (unsigned long)metrics->dns_cache_hits);
             for (ii = 0; ii < metrics->nservers; ii++) {
-                fprintf(stderr, "  [srv-%d] snt: %lu, rcv: %lu, q: %lu, err: %lu, tmo: %lu, nmv: %lu, orph: %lu\n",
-                        (int)ii, (unsigned long)metrics->servers[ii]->packets_sent,
-                        (unsigned long)metrics->servers[ii]->packets_read,
-                        (unsigned long)metrics->servers[ii]->packets_queued,
-                        (unsigned long)metrics->servers[ii]->packets_errored,
-                        (unsigned long)metrics->servers[ii]->packets_timeout,
-                        (unsigned long)metrics->servers[ii]->packets_nmv,
-                        (unsigned long)metrics->servers[ii]->packets_ownerless);
+                const lcb_SERVERMETRICS *srv = metrics->servers[ii];
+                fprintf(stderr,
+                        "  [srv-%d] snt: %lu, rcv: %lu, q: %lu, err: %lu, tmo: %lu, nmv: %lu, orph: %lu, wr: %lu, "
+                        "B/wr: %lu, coal: %lu\n",
+                        (int)ii, (unsigned long)srv->packets_sent, (unsigned long)srv->packets_read,
+                        (unsigned long)srv->packets_queued, (unsigned long)srv->packets_errored,
+                        (unsigned long)srv->packets_timeout, (unsigned long)srv->packets_nmv,
+                        (unsigned long)srv->packets_ownerless, (unsigned long)srv->flush_writes,
+                        (unsigned long)(srv->flush_writes ? srv->flush_bytes / srv->flush_writes : 0),
+                        (unsigned long)srv->flush_coalesced_bytes);
             }
         }
     }
@@ -1346,6 +1352,45 @@ static void *thread_worker(void *arg)
 }
 }
 
+/**
+ * CPU time (user + system) consumed by the process so far, in microseconds.
+ */
+static double process_cpu_time_us()
+{
+#ifndef WIN32
+    struct rusage usage {
+    };
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e6 + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Prints throughput and CPU cost per operation for the whole run. Comparing
+ * this line between runs with "-Denable_tracing=true" and
+ * "-Denable_tracing=false" gives the per-operation overhead of tracing.
+ */
+static void report_summary(lcb_U64 started_ns, double started_cpu_us)
+{
+    double elapsed_s = (lcb_nstime() - started_ns) / 1e9;
+    double cpu_us = process_cpu_time_us() - started_cpu_us;
+    unsigned long nops = 0;
+    int tracing = 0;
+    for (auto &context : contexts) {
+        nops += InstanceCookie::get(context->getInstance())->stats.total;
+        lcb_cntl(context->getInstance(), LCB_CNTL_GET, LCB_CNTL_ENABLE_TRACING, &tracing);
+    }
+    if (nops == 0 || elapsed_s <= 0) {
+        return;
+    }
+    log("Done. %lu operations in %.3f sec, %.0f ops/sec, %.3f us CPU per operation (tracing %s)", nops, elapsed_s,
+        nops / elapsed_s, cpu_us / nops, tracing ? "enabled" : "disabled");
+}
+
 int main(int argc, char **argv)
 {
     int exit_code = EXIT_SUCCESS;
@@ -1377,6 +1422,8 @@ int main(int argc, char **argv)
     lcb_CREATEOPTS *options = nullptr;
     ConnParams &cp = config.params;
     lcb_STATUS error;
+    lcb_U64 started_ns = 0;
+    double started_cpu_us = 0;
 
     for (uint32_t ii = 0; ii < nthreads; ++ii) {
         cp.fillCropts(options);
@@ -1421,12 +1468,17 @@ int main(int argc, char **argv)
         auto *ctx = new ThreadContext(instance, ii);
         cookie->setContext(ctx);
         contexts.push_back(ctx);
+        if (ii == 0) {
+            started_ns = lcb_nstime();
+            started_cpu_us = process_cpu_time_us();
+        }
         start_worker(ctx);
     }
 
     for (auto &context : contexts) {
         join_worker(context);
     }
+    report_summary(started_ns, started_cpu_us);
     if (config.numTimings() > 0) {
         dump_metrics();
     }
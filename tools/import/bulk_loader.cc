@@ -0,0 +1,554 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include "bulk_loader.h"
+
+#include <libcouchbase/utils.h>
+#include <libcouchbase/vbucket.h>
+
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "contrib/lcb-jsoncpp/lcb-jsoncpp.h"
+
+using namespace cbc;
+
+static std::string describe_errno(const std::string &path, int err)
+{
+    return path + ": " + strerror(err);
+}
+
+MappedFile::MappedFile(const std::string &path)
+{
+#ifndef _WIN32
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error(describe_errno(path, errno));
+    }
+    struct stat st {
+    };
+    if (fstat(fd, &st) != 0) {
+        int err = errno;
+        close(fd);
+        throw std::runtime_error(describe_errno(path, err));
+    }
+    m_size = static_cast<std::size_t>(st.st_size);
+    if (m_size > 0) {
+        void *addr = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+            madvise(addr, m_size, MADV_SEQUENTIAL);
+#endif
+            m_data = static_cast<const char *>(addr);
+            m_mapped = true;
+        }
+    }
+    close(fd);
+    if (m_mapped || m_size == 0) {
+        return;
+    }
+#endif
+    /* the file cannot be mapped (e.g. it is a pipe), read it into memory instead */
+    std::ifstream ifs(path.c_str(), std::ios::in | std::ios::binary);
+    if (!ifs.is_open()) {
+        throw std::runtime_error(describe_errno(path, errno));
+    }
+    m_buffer.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+}
+
+MappedFile::~MappedFile()
+{
+#ifndef _WIN32
+    if (m_mapped) {
+        munmap(const_cast<char *>(m_data), m_size);
+    }
+#endif
+}
+
+RecordReader::RecordReader(const char *data, std::size_t size, Format format, std::string key_field,
+                           std::string key_prefix)
+    : m_data(data), m_size(size), m_format(format), m_key_field(std::move(key_field)),
+      m_key_prefix(std::move(key_prefix))
+{
+    if (m_format == CSV) {
+        if (!read_csv_fields(m_columns) || m_columns.empty()) {
+            throw std::runtime_error("CSV input does not have the header");
+        }
+        if (!m_key_field.empty()) {
+            bool found = false;
+            for (std::size_t ii = 0; ii < m_columns.size(); ii++) {
+                if (m_columns[ii] == m_key_field) {
+                    m_key_column = ii;
+                    found = true;
+                    break;
+                }
+            }
+            if (!found) {
+                throw std::runtime_error("CSV header does not have the column \"" + m_key_field + "\"");
+            }
+        }
+    }
+}
+
+bool RecordReader::next(BulkRecord &record)
+{
+    if (m_format == CSV) {
+        return next_csv_row(record);
+    }
+    return next_json_line(record);
+}
+
+void RecordReader::skip(std::size_t line, const std::string &message)
+{
+    m_skipped++;
+    if (m_on_error) {
+        m_on_error(line, message);
+    }
+}
+
+bool RecordReader::next_json_line(BulkRecord &record)
+{
+    while (m_pos < m_size) {
+        const char *begin = m_data + m_pos;
+        const auto *eol = static_cast<const char *>(memchr(begin, '\n', m_size - m_pos));
+        std::size_t len = eol ? static_cast<std::size_t>(eol - begin) : m_size - m_pos;
+        m_pos += len + (eol ? 1 : 0);
+        m_line++;
+        if (len > 0 && begin[len - 1] == '\r') {
+            len--;
+        }
+        if (len == 0) {
+            continue;
+        }
+
+        record.line = m_line;
+        record.owned.clear();
+        record.value = begin;
+        record.nvalue = len;
+        if (m_key_field.empty()) {
+            record.key = m_key_prefix + std::to_string(++m_seqno);
+            return true;
+        }
+
+        Json::Value doc;
+        if (!Json::Reader().parse(begin, begin + len, doc, false) || !doc.isObject()) {
+            skip(m_line, "not a JSON object");
+            continue;
+        }
+        const Json::Value &id = doc[m_key_field];
+        if (!id.isString() && !id.isIntegral()) {
+            skip(m_line, "field \"" + m_key_field + "\" is missing or not a string");
+            continue;
+        }
+        record.key = m_key_prefix + id.asString();
+        m_seqno++;
+        return true;
+    }
+    return false;
+}
+
+bool RecordReader::read_csv_fields(std::vector<std::string> &fields)
+{
+    fields.clear();
+    if (m_pos >= m_size) {
+        return false;
+    }
+    m_line++;
+    std::string field;
+    bool quoted = false;
+    while (m_pos < m_size) {
+        char ch = m_data[m_pos++];
+        if (quoted) {
+            if (ch == '"') {
+                if (m_pos < m_size && m_data[m_pos] == '"') {
+                    field += '"';
+                    m_pos++;
+                } else {
+                    quoted = false;
+                }
+            } else {
+                if (ch == '\n') {
+                    m_line++;
+                }
+                field += ch;
+            }
+            continue;
+        }
+        if (ch == '"') {
+            quoted = true;
+        } else if (ch == ',') {
+            fields.push_back(field);
+            field.clear();
+        } else if (ch == '\n') {
+            break;
+        } else if (ch != '\r') {
+            field += ch;
+        }
+    }
+    fields.push_back(field);
+    return true;
+}
+
+/* matches the JSON number grammar, so that e.g. the zip codes with leading zeros stay strings */
+bool cbc::is_number(const std::string &value)
+{
+    std::size_t pos = 0, len = value.size();
+    auto digits = [&value, &pos, len]() {
+        std::size_t start = pos;
+        while (pos < len && isdigit(static_cast<unsigned char>(value[pos]))) {
+            pos++;
+        }
+        return pos - start;
+    };
+    if (pos < len && value[pos] == '-') {
+        pos++;
+    }
+    std::size_t start = pos;
+    std::size_t nint = digits();
+    if (nint == 0 || (nint > 1 && value[start] == '0')) {
+        return false;
+    }
+    if (pos < len && value[pos] == '.') {
+        pos++;
+        if (digits() == 0) {
+            return false;
+        }
+    }
+    if (pos < len && (value[pos] == 'e' || value[pos] == 'E')) {
+        pos++;
+        if (pos < len && (value[pos] == '+' || value[pos] == '-')) {
+            pos++;
+        }
+        if (digits() == 0) {
+            return false;
+        }
+    }
+    return pos == len;
+}
+
+bool RecordReader::next_csv_row(BulkRecord &record)
+{
+    std::vector<std::string> fields;
+    while (true) {
+        std::size_t line = m_line + 1;
+        if (!read_csv_fields(fields)) {
+            return false;
+        }
+        if (fields.size() == 1 && fields[0].empty()) {
+            continue;
+        }
+        if (fields.size() != m_columns.size()) {
+            skip(line, "expected " + std::to_string(m_columns.size()) + " fields, got " +
+                           std::to_string(fields.size()));
+            continue;
+        }
+
+        Json::Value doc(Json::objectValue);
+        for (std::size_t ii = 0; ii < fields.size(); ii++) {
+            if (is_number(fields[ii])) {
+                Json::Value number;
+                Json::Reader().parse(fields[ii], number, false);
+                doc[m_columns[ii]] = number;
+            } else {
+                doc[m_columns[ii]] = fields[ii];
+            }
+        }
+        m_seqno++;
+        if (m_key_field.empty()) {
+            record.key = m_key_prefix + std::to_string(m_seqno);
+        } else if (fields[m_key_column].empty()) {
+            skip(line, "column \"" + m_key_field + "\" is empty");
+            continue;
+        } else {
+            record.key = m_key_prefix + fields[m_key_column];
+        }
+        record.line = line;
+        record.owned = Json::FastWriter().write(doc);
+        if (!record.owned.empty() && record.owned[record.owned.size() - 1] == '\n') {
+            record.owned.resize(record.owned.size() - 1);
+        }
+        record.value = record.owned.data();
+        record.nvalue = record.owned.size();
+        return true;
+    }
+}
+
+struct BulkLoader::Pending {
+    explicit Pending(BulkLoader *parent) : loader(parent) {}
+
+    BulkLoader *loader;
+    BulkRecord record{};
+    std::size_t node{0};
+    std::uint32_t attempts{0};
+    lcb_U64 not_before{0};
+
+    std::size_t size() const
+    {
+        /* header of the request and the extras of the upsert */
+        return 24 + 8 + record.key.size() + record.nvalue;
+    }
+};
+
+bool BulkLoader::RetryOrder::operator()(const Pending *lhs, const Pending *rhs) const
+{
+    return lhs->not_before > rhs->not_before;
+}
+
+BulkLoader::BulkLoader(lcb_INSTANCE *instance, RecordReader &reader, BulkLoaderOptions options)
+    : m_instance(instance), m_reader(reader), m_options(std::move(options))
+{
+    if (m_options.inflight_bytes_per_node == 0) {
+        throw std::invalid_argument("in-flight budget must be positive");
+    }
+    m_old_callback =
+        lcb_install_callback(m_instance, LCB_CALLBACK_STORE, reinterpret_cast<lcb_RESPCALLBACK>(store_callback));
+}
+
+BulkLoader::~BulkLoader()
+{
+    lcb_install_callback(m_instance, LCB_CALLBACK_STORE, m_old_callback);
+    delete m_next;
+    for (auto &node : m_nodes) {
+        for (auto *op : node.queue) {
+            delete op;
+        }
+    }
+    while (!m_retries.empty()) {
+        delete m_retries.top();
+        m_retries.pop();
+    }
+}
+
+std::uint64_t BulkLoader::backoff_us(std::uint32_t attempt, std::uint64_t initial_us, std::uint64_t max_us)
+{
+    std::uint64_t delay = initial_us;
+    for (std::uint32_t ii = 1; ii < attempt && delay < max_us; ii++) {
+        delay *= 2;
+    }
+    return delay < max_us ? delay : max_us;
+}
+
+void BulkLoader::run()
+{
+    m_stats.started_ns = m_stats.now_ns = m_last_progress = lcb_nstime();
+    while (true) {
+        fill();
+        if (m_inflight > 0) {
+            /* the callbacks will keep the pipelines busy until everything is sent */
+            lcb_wait(m_instance, LCB_WAIT_DEFAULT);
+            continue;
+        }
+        if (finished()) {
+            break;
+        }
+        if (!m_retries.empty()) {
+            /* nothing on the wire, only the documents waiting for their backoff */
+            lcb_U64 now = lcb_nstime();
+            lcb_U64 due = m_retries.top()->not_before;
+            if (due > now) {
+                std::this_thread::sleep_for(std::chrono::nanoseconds(due - now));
+            }
+        }
+    }
+    m_stats.now_ns = lcb_nstime();
+    report_progress();
+}
+
+bool BulkLoader::finished() const
+{
+    if (!m_eof || m_next != nullptr || m_inflight > 0 || !m_retries.empty()) {
+        return false;
+    }
+    for (const auto &node : m_nodes) {
+        if (!node.queue.empty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::size_t BulkLoader::node_for(const std::string &key)
+{
+    lcbvb_CONFIG *config = nullptr;
+    int vbid = 0, srvix = -1;
+    if (lcb_cntl(m_instance, LCB_CNTL_GET, LCB_CNTL_VBCONFIG, &config) == LCB_SUCCESS && config != nullptr) {
+        lcbvb_map_key(config, key.data(), key.size(), &vbid, &srvix);
+    }
+    /* slot zero collects the keys without master, the library will queue them until the next configuration */
+    auto node = static_cast<std::size_t>(srvix + 1);
+    if (node >= m_nodes.size()) {
+        m_nodes.resize(node + 1);
+    }
+    return node;
+}
+
+bool BulkLoader::enqueue(Pending *op)
+{
+    op->node = node_for(op->record.key);
+    Node &node = m_nodes[op->node];
+    if (node.queued_bytes > 0 && node.queued_bytes + op->size() > m_options.inflight_bytes_per_node) {
+        return false;
+    }
+    node.queue.push_back(op);
+    node.queued_bytes += op->size();
+    return true;
+}
+
+lcb_STATUS BulkLoader::dispatch(Pending *op)
+{
+    lcb_CMDSTORE *cmd;
+    lcb_cmdstore_create(&cmd, LCB_STORE_UPSERT);
+    lcb_cmdstore_key(cmd, op->record.key.c_str(), op->record.key.size());
+    lcb_cmdstore_value(cmd, op->record.value, op->record.nvalue);
+    lcb_cmdstore_datatype(cmd, LCB_VALUE_F_JSON);
+    if (m_options.expiry > 0) {
+        lcb_cmdstore_expiry(cmd, m_options.expiry);
+    }
+    if (!m_options.scope.empty() || !m_options.collection.empty()) {
+        lcb_cmdstore_collection(cmd, m_options.scope.c_str(), m_options.scope.size(), m_options.collection.c_str(),
+                                m_options.collection.size());
+    }
+    lcb_STATUS rc = lcb_store(m_instance, op, cmd);
+    lcb_cmdstore_destroy(cmd);
+    return rc;
+}
+
+void BulkLoader::fill()
+{
+    if (m_filling) {
+        return;
+    }
+    m_filling = true;
+    lcb_U64 now = lcb_nstime();
+
+    while (!m_retries.empty() && m_retries.top()->not_before <= now) {
+        Pending *op = m_retries.top();
+        m_retries.pop();
+        /* the topology might have changed since the first attempt */
+        op->node = node_for(op->record.key);
+        Node &node = m_nodes[op->node];
+        /* retries bypass the queue limit, they have been read already */
+        node.queue.push_front(op);
+        node.queued_bytes += op->size();
+    }
+
+    while (!m_eof) {
+        if (m_next == nullptr) {
+            m_next = new Pending(this);
+            if (!m_reader.next(m_next->record)) {
+                delete m_next;
+                m_next = nullptr;
+                m_eof = true;
+                break;
+            }
+        }
+        if (!enqueue(m_next)) {
+            /* the node is saturated, keep the record until it drains */
+            break;
+        }
+        m_next = nullptr;
+    }
+
+    lcb_sched_enter(m_instance);
+    for (auto &node : m_nodes) {
+        while (!node.queue.empty()) {
+            Pending *op = node.queue.front();
+            if (node.inflight_bytes > 0 && node.inflight_bytes + op->size() > m_options.inflight_bytes_per_node) {
+                break;
+            }
+            node.queue.pop_front();
+            node.queued_bytes -= op->size();
+            lcb_STATUS rc = dispatch(op);
+            if (rc != LCB_SUCCESS) {
+                m_stats.errors++;
+                if (m_on_error) {
+                    m_on_error(op->record, rc);
+                }
+                delete op;
+                continue;
+            }
+            node.inflight_bytes += op->size();
+            if (node.inflight_bytes > m_stats.peak_inflight_bytes) {
+                m_stats.peak_inflight_bytes = node.inflight_bytes;
+            }
+            m_inflight++;
+        }
+    }
+    lcb_sched_leave(m_instance);
+
+    m_stats.now_ns = now;
+    if (now - m_last_progress >= 1000000000ULL) {
+        m_last_progress = now;
+        report_progress();
+    }
+    m_filling = false;
+}
+
+void BulkLoader::report_progress()
+{
+    if (m_on_progress) {
+        m_on_progress(m_stats);
+    }
+}
+
+void BulkLoader::store_callback(lcb_INSTANCE *, int, const lcb_RESPSTORE *resp)
+{
+    Pending *op = nullptr;
+    lcb_respstore_cookie(resp, reinterpret_cast<void **>(&op));
+    op->loader->handle_response(op, lcb_respstore_status(resp));
+}
+
+void BulkLoader::handle_response(Pending *op, lcb_STATUS rc)
+{
+    Node &node = m_nodes[op->node];
+    node.inflight_bytes -= op->size();
+    m_inflight--;
+
+    if (rc == LCB_SUCCESS) {
+        m_stats.docs++;
+        m_stats.bytes += op->record.nvalue;
+        delete op;
+    } else if (rc == LCB_ERR_TEMPORARY_FAILURE && op->attempts < m_options.max_retries) {
+        op->attempts++;
+        m_stats.retries++;
+        op->not_before =
+            lcb_nstime() + backoff_us(op->attempts, m_options.initial_backoff_us, m_options.max_backoff_us) * 1000;
+        m_retries.push(op);
+    } else {
+        m_stats.errors++;
+        if (m_on_error) {
+            m_on_error(op->record, rc);
+        }
+        delete op;
+    }
+    fill();
+}
@@ -0,0 +1,259 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef CBC_BULK_LOADER_H
+#define CBC_BULK_LOADER_H
+
+#include <libcouchbase/couchbase.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <queue>
+#include <string>
+#include <vector>
+
+namespace cbc
+{
+
+/**
+ * Read-only view of the whole file. The file is memory-mapped where possible,
+ * so that the records can be sent without copying them into the
+ * intermediate buffers.
+ */
+class MappedFile
+{
+  public:
+    /** @throw std::runtime_error if the file cannot be opened */
+    explicit MappedFile(const std::string &path);
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *data() const
+    {
+        return m_data;
+    }
+
+    std::size_t size() const
+    {
+        return m_size;
+    }
+
+  private:
+    const char *m_data{nullptr};
+    std::size_t m_size{0};
+    bool m_mapped{false};
+    std::vector<char> m_buffer{};
+};
+
+struct BulkRecord {
+    std::string key{};
+    /** Points either to the input file or to #owned */
+    const char *value{nullptr};
+    std::size_t nvalue{0};
+    std::string owned{};
+    /** Line number in the input, where the record starts */
+    std::size_t line{0};
+};
+
+/** Whether the CSV field is stored as the JSON number */
+bool is_number(const std::string &value);
+
+/**
+ * Splits the input into the documents.
+ *
+ * JSON Lines: every non-empty line is the document, which is stored as is.
+ *
+ * CSV: the first row contains the column names. Every other row is converted
+ * to the JSON object, where the numbers become JSON numbers and the rest of
+ * the fields become strings. Quoted fields (RFC 4180) may contain separators,
+ * line breaks and doubled quotes.
+ *
+ * The document ID is taken from the field `key_field`, or generated as
+ * `key_prefix` followed by the sequence number of the document if the field
+ * name is empty.
+ */
+class RecordReader
+{
+  public:
+    enum Format { JSON_LINES, CSV };
+
+    RecordReader(const char *data, std::size_t size, Format format, std::string key_field, std::string key_prefix);
+
+    /**
+     * @return false when the input has been exhausted. Malformed records and
+     *  the records without ID are skipped and reported to the error handler.
+     */
+    bool next(BulkRecord &record);
+
+    std::size_t skipped() const
+    {
+        return m_skipped;
+    }
+
+    /** Number of bytes consumed so far */
+    std::size_t position() const
+    {
+        return m_pos;
+    }
+
+    void on_error(std::function<void(std::size_t line, const std::string &message)> handler)
+    {
+        m_on_error = std::move(handler);
+    }
+
+  private:
+    bool next_json_line(BulkRecord &record);
+    bool next_csv_row(BulkRecord &record);
+    bool read_csv_fields(std::vector<std::string> &fields);
+    void skip(std::size_t line, const std::string &message);
+
+    const char *m_data;
+    std::size_t m_size;
+    std::size_t m_pos{0};
+    std::size_t m_line{0};
+    std::size_t m_seqno{0};
+    std::size_t m_skipped{0};
+    Format m_format;
+    std::string m_key_field;
+    std::string m_key_prefix;
+    std::vector<std::string> m_columns{};
+    std::size_t m_key_column{0};
+    std::function<void(std::size_t, const std::string &)> m_on_error{};
+};
+
+struct BulkLoaderOptions {
+    std::string scope{};
+    std::string collection{};
+    std::uint32_t expiry{0};
+    /** Upper bound of the bytes, which are sent to a single KV node, but not yet acknowledged */
+    std::size_t inflight_bytes_per_node{4 * 1024 * 1024};
+    /** How many times the document will be retried after temporary failure */
+    std::uint32_t max_retries{10};
+    std::uint64_t initial_backoff_us{1000};
+    std::uint64_t max_backoff_us{1000000};
+};
+
+struct BulkLoaderStats {
+    std::uint64_t docs{0};
+    std::uint64_t bytes{0};
+    std::uint64_t retries{0};
+    std::uint64_t errors{0};
+    /** The largest number of bytes in flight to a single node */
+    std::uint64_t peak_inflight_bytes{0};
+    lcb_U64 started_ns{0};
+    lcb_U64 now_ns{0};
+
+    double elapsed_seconds() const
+    {
+        return (now_ns - started_ns) / 1e9;
+    }
+
+    double docs_per_second() const
+    {
+        double elapsed = elapsed_seconds();
+        return elapsed > 0 ? docs / elapsed : 0;
+    }
+
+    double megabytes_per_second() const
+    {
+        double elapsed = elapsed_seconds();
+        return elapsed > 0 ? bytes / 1048576.0 / elapsed : 0;
+    }
+};
+
+/**
+ * Writes all records of the reader with upserts, keeping every KV node busy
+ * without buffering the whole input in the library.
+ *
+ * Records are grouped by the node, which owns the key. New records are
+ * scheduled from the store callbacks as soon as the in-flight bytes of the
+ * node drop below the budget, so the loader does not depend on the batch
+ * size, and a slow node does not hold back the others (until its own queue
+ * fills up). Temporary failures are retried with exponential backoff.
+ *
+ * The loader installs its own store callback on the instance.
+ */
+class BulkLoader
+{
+  public:
+    BulkLoader(lcb_INSTANCE *instance, RecordReader &reader, BulkLoaderOptions options);
+    ~BulkLoader();
+
+    /** Runs the event loop until all records have been written or failed */
+    void run();
+
+    const BulkLoaderStats &stats() const
+    {
+        return m_stats;
+    }
+
+    /** Invoked from the event loop at most once per second */
+    void on_progress(std::function<void(const BulkLoaderStats &)> handler)
+    {
+        m_on_progress = std::move(handler);
+    }
+
+    void on_error(std::function<void(const BulkRecord &, lcb_STATUS)> handler)
+    {
+        m_on_error = std::move(handler);
+    }
+
+    static std::uint64_t backoff_us(std::uint32_t attempt, std::uint64_t initial_us, std::uint64_t max_us);
+
+  private:
+    struct Pending;
+    struct Node {
+        std::deque<Pending *> queue{};
+        std::size_t queued_bytes{0};
+        std::size_t inflight_bytes{0};
+    };
+    struct RetryOrder {
+        bool operator()(const Pending *lhs, const Pending *rhs) const;
+    };
+
+    static void store_callback(lcb_INSTANCE *instance, int cbtype, const lcb_RESPSTORE *resp);
+    void handle_response(Pending *op, lcb_STATUS rc);
+    void fill();
+    bool enqueue(Pending *op);
+    std::size_t node_for(const std::string &key);
+    lcb_STATUS dispatch(Pending *op);
+    bool finished() const;
+    void report_progress();
+
+    lcb_INSTANCE *m_instance;
+    RecordReader &m_reader;
+    BulkLoaderOptions m_options;
+    BulkLoaderStats m_stats{};
+    std::vector<Node> m_nodes{};
+    std::priority_queue<Pending *, std::vector<Pending *>, RetryOrder> m_retries{};
+    /** The record, which has been read, but its node has no room yet */
+    Pending *m_next{nullptr};
+    bool m_eof{false};
+    bool m_filling{false};
+    std::size_t m_inflight{0};
+    lcb_U64 m_last_progress{0};
+    lcb_RESPCALLBACK m_old_callback{nullptr};
+    std::function<void(const BulkLoaderStats &)> m_on_progress{};
+    std::function<void(const BulkRecord &, lcb_STATUS)> m_on_error{};
+};
+
+} // namespace cbc
+
+#endif